@@ -0,0 +1,340 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include "full_system/full_system.h"
+#include "io_wrapper/output_wrapper/ply_output_wrapper.h"
+#include "util/dataset_reader.h"
+#include "util/index_thread_reduce.h"
+#include "util/input_parser.h"
+#include "util/memory_stats.h"
+#include "util/stage_timing.h"
+#include "util/thread_config.h"
+
+using namespace dso;
+
+namespace {
+
+// rough resident bytes of one FullSystem per pixel of its images: per active
+// keyframe (pyramid, gradients) and fixed (the two coarse trackers, distance
+// map, selection map, undistorter), plus points, residuals and Hessians.
+const double kKeyframeBytesPerPixel = 24;
+const double kFixedBytesPerPixel = 200;
+const int64_t kFixedBytes = 32ll << 20;
+
+//! A line of the batch list: its configuration, parsed, and where it writes.
+struct Sequence {
+  std::string config;
+  std::string output;
+  InputParam param;
+  Settings settings;
+};
+
+//! What is logged of a sequence.
+struct SequenceResult {
+  int frames = 0;
+  int keyframes = 0;
+  int resets = 0;
+  bool lost = false;
+  double seconds = 0;
+};
+
+/** \brief Admits sequences while their estimated memory fits the budget
+ *
+ *  acquire() waits until the bytes fit next to the running sequences. A
+ *  sequence is always admitted if none is running, however large it is.
+ */
+class MemoryBudget {
+ public:
+  explicit MemoryBudget(const int64_t total)
+      : total(total), used(0), running(0) {}
+
+  void acquire(const int64_t bytes) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (running > 0 && used + bytes > total) {
+      released.wait(lock);
+    }
+    used += bytes;
+    ++running;
+  }
+
+  void release(const int64_t bytes) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    used -= bytes;
+    --running;
+    released.notify_all();
+  }
+
+ private:
+  const int64_t total;
+  int64_t used;  //!< [mutex]
+  int running;   //!< [mutex]
+  boost::mutex mutex;
+  boost::condition_variable released;
+};
+
+// MemAvailable of /proc/meminfo, 0 if unknown.
+int64_t AvailableBytes() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  int64_t kb;
+  std::string unit;
+  while (meminfo >> key >> kb >> unit) {
+    if (key == "MemAvailable:") {
+      return kb << 10;
+    }
+  }
+  return 0;
+}
+
+// "config.yaml [output]" per line, # starts a comment.
+std::vector<Sequence> ReadList(const std::string &path) {
+  std::ifstream list(path);
+  CHECK(list.is_open()) << "could not read the batch list " << path;
+  std::vector<Sequence> sequences;
+  std::string line;
+  while (std::getline(list, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    Sequence sequence;
+    if (!(words >> sequence.config)) {
+      continue;
+    }
+    if (!(words >> sequence.output)) {
+      sequence.output = "batch_" + std::to_string(sequences.size());
+    }
+    sequences.emplace_back(sequence);
+  }
+  return sequences;
+}
+
+/** Run one sequence on the shared pool in linearizeOperation mode, writing
+ *  result.txt and result_map.ply into its output directory. Waits in budget
+ *  for instanceBytes, or for the estimate from its image size if that is 0.
+ */
+SequenceResult RunSequence(const Sequence &sequence,
+                           IndexThreadReduce<Vec10> *pool,
+                           MemoryBudget *budget, const int64_t instanceBytes) {
+  const InputParam &param = sequence.param;
+  DatasetReader *reader;
+  if (param.path_2_timestamps != "") {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette,
+                               param.path_2_timestamps);
+  } else {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette);
+  }
+  const CalibContext calib = reader->GetCalibContext(param.pyr_levels);
+
+  const double pixels = static_cast<double>(calib.w[0]) * calib.h[0];
+  const int64_t bytes =
+      instanceBytes > 0
+          ? instanceBytes
+          : kFixedBytes + static_cast<int64_t>(
+                              pixels * (kFixedBytesPerPixel +
+                                        kKeyframeBytesPerPixel *
+                                            (sequence.settings.maxFrames + 1)));
+  budget->acquire(bytes);
+  LOG(INFO) << "batch: starting " << sequence.config << " (~"
+            << (bytes >> 20) << " MB)";
+
+  std::vector<int> ids_to_play;
+  for (int i = std::max(param.start_id, 0);
+       i < static_cast<int>(reader->GetNumImages()) && i < param.end_id; ++i) {
+    ids_to_play.emplace_back(i);
+  }
+  ImageAndExposure *reused_img = nullptr;
+  if (param.prefetch && !ids_to_play.empty()) {
+    reader->StartPrefetch(ids_to_play, param.prefetch_threads,
+                          param.prefetch_buffer);
+  } else if (!reader->IsZeroCopy()) {
+    const Eigen::Vector2i size = reader->GetSize();
+    reused_img = new ImageAndExposure(size[0], size[1]);
+  }
+
+  FullSystem *full_system = new FullSystem(calib, sequence.settings, pool);
+  full_system->setGammaFunction(reader->GetPhotometricGamma());
+  full_system->linearizeOperation = true;
+  full_system->outputWrapper.emplace_back(
+      new IOWrap::PlyOutputWrapper(sequence.output + "/result_map.ply"));
+
+  SequenceResult result;
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int ii = 0; ii < static_cast<int>(ids_to_play.size()); ++ii) {
+    const int i = ids_to_play[ii];
+    ImageAndExposure *img;
+    if (param.prefetch) {
+      img = reader->Next();
+    } else if (reader->IsZeroCopy()) {
+      img = reader->GetImage(i);
+    } else {
+      reader->GetImageInto(i, reused_img);
+      img = reused_img;
+    }
+
+    full_system->addActiveFrame(img, i);
+    ++result.frames;
+
+    if (img != reused_img) {
+      delete img;
+    }
+
+    if (full_system->initFailed && ii < 250) {
+      full_system->reset();
+      ++result.resets;
+    }
+
+    if (full_system->isLost) {
+      LOG(ERROR) << "batch: " << sequence.config << " LOST!!";
+      break;
+    }
+  }
+  reader->StopPrefetch();
+  full_system->blockUntilMappingIsFinished();
+  result.seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  delete reused_img;
+
+  full_system->printResult(sequence.output + "/result.txt");
+  result.keyframes = full_system->getNumKeyframes();
+  result.lost = full_system->isLost;
+
+  for (IOWrap::Output3DWrapper *ow : full_system->outputWrapper) {
+    ow->join();
+    delete ow;
+  }
+  delete full_system;
+  delete reader;
+  budget->release(bytes);
+  return result;
+}
+
+}  // namespace
+
+/** Process the sequences of String.BatchList (or the second argument), one
+ *  "config.yaml [output directory]" per line, headless and in
+ *  linearizeOperation mode. Each writes result.txt and result_map.ply into its
+ *  directory (default batch_<line>).
+ *
+ *  The batch configuration holds the process settings, preset and mode of all
+ *  sequences; their configurations the dataset and the tuning. Up to
+ *  Int.BatchJobs (0: one per core) sequences run at once, each as its own
+ *  FullSystem on one shared reduce pool of Int.NumThreads workers, as long as
+ *  their estimated memory (Int.BatchInstanceMB each, 0: from the image size)
+ *  fits into Int.BatchMemoryMB (0: the available memory). Their reductions
+ *  run on the pool at the same time, and a sequence's thread runs the parts
+ *  of its own reductions that busy workers leave. Sequences start in list
+ *  order as others finish, for total throughput. The exit code is 1 if a
+ *  sequence got lost.
+ */
+int main(int argc, char **argv) {
+  LOG_IF(FATAL, argc < 2)
+      << "Usage: ./dso_batch path_to_configuration [sequences.txt]";
+
+  InputParam param = InputParser::Read(argv[1]);
+  if (argc > 2) {
+    param.path_2_batch_list = argv[2];
+  }
+  param.no_gui = true;
+  Settings batch_settings;
+  InputParser::Config(&param, &batch_settings);
+
+  // parsed up front: ConfigTuning() also sets the process settings of the
+  // preset and mode, which are the batch ones for every sequence.
+  std::vector<Sequence> sequences = ReadList(param.path_2_batch_list);
+  for (Sequence &sequence : sequences) {
+    sequence.param = InputParser::Read(sequence.config);
+    sequence.param.preset = param.preset;
+    sequence.param.mode = param.mode;
+    InputParser::ConfigTuning(&sequence.param, &sequence.settings);
+    CHECK(mkdir(sequence.output.c_str(), 0755) == 0 || errno == EEXIST)
+        << sequence.output << ": " << strerror(errno);
+  }
+  LOG_IF(FATAL, sequences.empty())
+      << "no sequences in " << param.path_2_batch_list;
+
+  int jobs = param.batch_jobs;
+  if (jobs <= 0) {
+    jobs = static_cast<int>(boost::thread::hardware_concurrency());
+  }
+  jobs = std::max(1, std::min(jobs, static_cast<int>(sequences.size())));
+  const int64_t budgetBytes = param.batch_memory_mb > 0
+                                  ? static_cast<int64_t>(param.batch_memory_mb)
+                                        << 20
+                                  : AvailableBytes();
+  MemoryBudget budget(budgetBytes > 0 ? budgetBytes : INT64_MAX);
+  const int64_t instanceBytes = static_cast<int64_t>(param.batch_instance_mb)
+                                << 20;
+  IndexThreadReduce<Vec10> pool;
+  LOG(INFO) << "batch: " << sequences.size() << " sequences, up to " << jobs
+            << " at once on " << pool.getNumThreads() << " workers, "
+            << (budgetBytes >> 20) << " MB";
+
+  std::vector<SequenceResult> results(sequences.size());
+  std::atomic<size_t> next(0);
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  std::vector<boost::thread> runners;
+  for (int j = 0; j < jobs; ++j) {
+    runners.emplace_back([&]() {
+      ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_TRACKER);
+      for (size_t s = next++; s < sequences.size(); s = next++) {
+        results[s] = RunSequence(sequences[s], &pool, &budget, instanceBytes);
+        LOG(INFO) << "batch: " << sequences[s].config << " done, "
+                  << results[s].frames << " frames in " << results[s].seconds
+                  << " s";
+      }
+    });
+  }
+  for (boost::thread &runner : runners) {
+    runner.join();
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  int frames = 0;
+  int lost = 0;
+  std::string summary = "\n======================\n";
+  for (size_t s = 0; s < sequences.size(); ++s) {
+    const SequenceResult &result = results[s];
+    frames += result.frames;
+    lost += result.lost ? 1 : 0;
+    char line[256];
+    snprintf(line, sizeof(line),
+             "%s: %d frames, %d keyframes, %d resets, %.1f s%s\n",
+             sequences[s].output.c_str(), result.frames, result.keyframes,
+             result.resets, result.seconds, result.lost ? ", LOST" : "");
+    summary += line;
+  }
+  char line[256];
+  snprintf(line, sizeof(line),
+           "%zu sequences, %d frames in %.1f s: %.1f frames/s, %d lost\n"
+           "======================\n",
+           sequences.size(), frames, seconds,
+           seconds > 0 ? frames / seconds : 0., lost);
+  summary += line;
+  LOG(INFO) << summary;
+
+  if (setting_stageTiming) {
+    StageTiming::logSummary();
+    StageTiming::dump(setting_stageTimingPath);
+  }
+  MemoryStats::logSummary();
+  return lost > 0 ? 1 : 0;
+}
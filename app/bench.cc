@@ -0,0 +1,673 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "full_system/immature_point.h"
+#include "full_system/pixel_selector2.h"
+#include "full_system/residuals.h"
+#include "full_system/tracker/coarse_tracker.h"
+#include "io_wrapper/image_rw.h"
+#include "optimization_backend/accumulated_top_hessian_sse.h"
+#include "optimization_backend/accumulators/accumulator_14.h"
+#include "optimization_backend/accumulators/accumulator_9.h"
+#include "optimization_backend/accumulators/accumulator_approx.h"
+#include "optimization_backend/energy_functional/energy_functional.h"
+#include "optimization_backend/energy_functional/energy_functional_structs.h"
+#include "undistorter/photometric_undistorter.h"
+#include "undistorter/undistorter.h"
+#include "util/frame_shell.h"
+#include "util/calib_context.h"
+#include "util/image_and_exposure.h"
+#include "util/index_thread_reduce.h"
+#include "util/minimal_image.h"
+
+/** \file
+ *  Microbenchmarks of the hot kernels on synthetic input, no dataset needed.
+ *
+ *  The scene is a textured, slanted plane seen by three cameras: host (of all
+ *  points), reference (target of their residuals, reference of the coarse
+ *  tracker) and a new frame a few cm further, which is tracked and traced.
+ *  Everything is built once and reused, only the timed kernel runs in the
+ *  loop. Run with --benchmark_filter=<regex> to pick kernels, and e.g.
+ *  --benchmark_repetitions=5 for the spread.
+ */
+
+using namespace dso;
+
+namespace dso {
+
+//! Access to the private kernels of CoarseTracker.
+class CoarseTrackerBench {
+ public:
+  static Vec6 calcRes(CoarseTracker* tracker, int lvl, const SE3& refToNew,
+                      AffLight aff, float cutoffTH) {
+    return tracker->calcRes(lvl, refToNew, aff, cutoffTH, false);
+  }
+
+  static void calcGSSSE(CoarseTracker* tracker, int lvl, Mat88* H, Vec8* b,
+                        const SE3& refToNew, AffLight aff) {
+    tracker->calcGSSSE(lvl, *H, *b, refToNew, aff);
+  }
+
+  static int numPoints(const CoarseTracker& tracker, int lvl) {
+    return tracker.pc_n[lvl];
+  }
+};
+
+}  // dso
+
+namespace {
+
+const int kWidth = 640;
+const int kHeight = 480;
+// raw size of the undistorter input, cropped to kWidth x kHeight.
+const int kRawWidth = 752;
+const int kRawHeight = 480;
+
+// texture value of the lattice point (x, y), in [0, 1).
+float latticeNoise(int x, int y) {
+  uint32_t h = static_cast<uint32_t>(x) * 374761393u +
+               static_cast<uint32_t>(y) * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  return ((h ^ (h >> 16)) & 0xffffff) / static_cast<float>(0x1000000);
+}
+
+// smooth value noise at (s, t), in [0, 1).
+float valueNoise(float s, float t) {
+  const int x = std::floor(s), y = std::floor(t);
+  float fx = s - x, fy = t - y;
+  fx = fx * fx * (3 - 2 * fx);
+  fy = fy * fy * (3 - 2 * fy);
+  const float top =
+      latticeNoise(x, y) + fx * (latticeNoise(x + 1, y) - latticeNoise(x, y));
+  const float bottom =
+      latticeNoise(x, y + 1) +
+      fx * (latticeNoise(x + 1, y + 1) - latticeNoise(x, y + 1));
+  return top + fy * (bottom - top);
+}
+
+// intensity of the plane at plane coordinates (s, t) in m, 3 octaves.
+float texture(float s, float t) {
+  const float v = 0.5f * valueNoise(s * 8, t * 8) +
+                  0.3f * valueNoise(s * 24 + 17, t * 24 + 5) +
+                  0.2f * valueNoise(s * 72 + 3, t * 72 + 41);
+  return 20 + 215 * v;
+}
+
+/** \brief The plane n^T X = d in world coordinates and cameras looking at it
+ */
+struct Scene {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  Scene() : n(Vec3(0.15, -0.1, 1).normalized()), d(3) {
+    K << 420, 0, (kWidth - 1) / 2.0, 0, 420, (kHeight - 1) / 2.0, 0, 0, 1;
+    Ki = K.inverse();
+    e1 = n.cross(Vec3::UnitY()).normalized();
+    e2 = n.cross(e1);
+  }
+
+  //! Depth-less render of the plane into a kWidth x kHeight image.
+  std::vector<float> render(const SE3& camToWorld) const {
+    std::vector<float> image(kWidth * kHeight);
+    for (int y = 0; y < kHeight; ++y) {
+      for (int x = 0; x < kWidth; ++x) {
+        const Vec3 dir = camToWorld.so3() * (Ki * Vec3(x, y, 1));
+        const Vec3 o = camToWorld.translation();
+        const Vec3 p = o + dir * ((d - n.dot(o)) / n.dot(dir));
+        image[x + y * kWidth] = texture(e1.dot(p), e2.dot(p));
+      }
+    }
+    return image;
+  }
+
+  //! Inverse depth of pixel (x, y) of a camera at camToWorld.
+  double idepth(const SE3& camToWorld, double x, double y) const {
+    const Vec3 ray = Ki * Vec3(x, y, 1);
+    const Vec3 o = camToWorld.translation();
+    const Vec3 dir = camToWorld.so3() * ray;
+    return 1 / ((d - n.dot(o)) / n.dot(dir));
+  }
+
+  Vec3 n, e1, e2;
+  double d;
+  Mat33 K, Ki;
+};
+
+FrameHessian* makeFrame(const SE3& camToWorld, int id, CalibHessian* HCalib,
+                        const Settings& settings, std::vector<float>* image) {
+  FrameHessian* fh = new FrameHessian(*HCalib->calib, settings);
+  fh->shell = new FrameShell();
+  fh->shell->id = fh->shell->incoming_id = id;
+  fh->shell->camToWorld = camToWorld;
+  fh->ab_exposure = 1;
+  fh->frameID = id;
+  fh->idx = id;
+  fh->setEvalPT_scaled(camToWorld.inverse(), AffLight(0, 0));
+  fh->makeImages(image->data(), HCalib);
+  return fh;
+}
+
+/** \brief The shared fixture, built on first use and never freed
+ *
+ *  Frames, points and energy functional reference each other and would have
+ *  to be torn down in the FullSystem order, which is not worth it at exit.
+ */
+struct BenchContext {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  static BenchContext* Get() {
+    static BenchContext* context = new BenchContext();
+    return context;
+  }
+
+  BenchContext() : calib(kWidth, kHeight, scene.K.cast<float>()) {
+    HCalib = new CalibHessian(calib);
+
+    const SE3 poses[3] = {
+        SE3(), SE3(SO3::exp(Vec3(0.01, -0.02, 0.005)), Vec3(0.12, 0.02, 0)),
+        SE3(SO3::exp(Vec3(0.015, -0.03, 0.01)), Vec3(0.18, 0.03, 0.02))};
+    for (int i = 0; i < 3; ++i) {
+      images[i] = scene.render(poses[i]);
+      frames[i] = makeFrame(poses[i], i, HCalib, settings, &images[i]);
+    }
+    FrameHessian* const host = frames[0];
+    FrameHessian* const ref = frames[1];
+
+    // host and reference are the window of the energy functional.
+    ef = new EnergyFunctional(settings);
+    ef->insertFrame(host, HCalib);
+    ef->insertFrame(ref, HCalib);
+    precalc.resize(4);
+    for (int h = 0; h < 2; ++h) {
+      frames[h]->targetPrecalc = precalc.data() + 2 * h;
+      for (int t = 0; t < 2; ++t) {
+        precalc[2 * h + t].set(frames[h], frames[t], HCalib);
+      }
+    }
+    ef->setDeltaF(HCalib);
+
+    PixelSelector selector(calib, settings);
+    std::vector<PixelCandidate> candidates;
+    selector.makeMaps(host, &candidates, settings.desiredImmatureDensity);
+    const int padding = staticPatternPadding[settings.pattern];
+    for (const PixelCandidate& p : candidates) {
+      if (p.u < padding + 1 || p.u >= calib.w[0] - padding - 2 ||
+          p.v < padding + 1 || p.v >= calib.h[0] - padding - 2) {
+        continue;
+      }
+      ImmaturePoint* ip = new ImmaturePoint(p.u, p.v, host, p.type, HCalib);
+      if (!std::isfinite(ip->energyTH)) {
+        delete ip;
+        continue;
+      }
+      immaturePoints.emplace_back(ip);
+      addPoint(ip, scene.idepth(poses[0], p.u, p.v));
+    }
+    ef->makeIDX();
+
+    tracker = new CoarseTracker(calib, settings);
+    tracker->makeK(HCalib);
+    tracker->setCoarseTrackingRef(std::vector<FrameHessian*>{host, ref},
+                                  nullptr);
+    tracker->newFrame = frames[2];
+    // a slightly wrong estimate, as in the middle of the iterations.
+    refToNew = SE3(SO3::exp(Vec3(0.001, 0, 0)), Vec3(0.005, 0, 0)) *
+               poses[2].inverse() * poses[1];
+
+    const SE3 hostToNew = frames[2]->PRE_worldToCam * host->PRE_camToWorld;
+    const Mat33f Kf = scene.K.cast<float>();
+    traceKRKi = Kf * hostToNew.rotationMatrix().cast<float>() * Kf.inverse();
+    traceKt = Kf * hostToNew.translation().cast<float>();
+    traceAff = AffLight::fromToVecExposure(1, 1, host->aff_g2l(),
+                                           frames[2]->aff_g2l())
+                   .cast<float>();
+
+    LOG(INFO) << "bench scene: " << immaturePoints.size() << " points, "
+              << residuals.size() << " residuals";
+  }
+
+  // point with a residual to the reference, linearized and applied.
+  void addPoint(const ImmaturePoint* ip, float idepth) {
+    // as if traced to the true depth.
+    ImmaturePoint traced(*ip);
+    traced.idepth_min = traced.idepth_max = idepth;
+    PointHessian* ph = new PointHessian(&traced, HCalib);
+    ph->setIdepthZero(idepth);
+    ph->setIdepth(idepth);
+    ph->setPointStatus(PointHessian::ACTIVE);
+    ph->lastResiduals[0].first = ph->lastResiduals[1].first = nullptr;
+    ph->lastResiduals[0].second = ph->lastResiduals[1].second = ResState::OOB;
+    frames[0]->pointHessians.emplace_back(ph);
+    ef->insertPoint(ph);
+    ph->efPoint->HdiF = 1e-3;
+
+    PointFrameResidual* r = new PointFrameResidual(ph, frames[0], frames[1]);
+    r->state_NewEnergy = r->state_energy = 0;
+    r->state_NewState = ResState::OUTLIER;
+    r->setState(ResState::IN);
+    ph->residuals.emplace_back(r);
+    ef->insertResidual(r);
+    r->linearize(HCalib);
+    r->applyRes(true);
+    if (r->state_state == ResState::IN) {
+      ph->lastResiduals[0].first = r;
+      ph->lastResiduals[0].second = ResState::IN;
+    }
+    residuals.emplace_back(r);
+  }
+
+  Scene scene;
+  CalibContext calib;
+  Settings settings;
+  CalibHessian* HCalib;
+  std::vector<float> images[3];
+  //! host, reference, new frame.
+  FrameHessian* frames[3];
+  EnergyFunctional* ef;
+  std::vector<FrameFramePrecalc, Eigen::aligned_allocator<FrameFramePrecalc>>
+      precalc;
+  //! untraced, every benchmark iteration traces copies of them.
+  std::vector<ImmaturePoint*> immaturePoints;
+  std::vector<PointFrameResidual*> residuals;
+
+  CoarseTracker* tracker;
+  SE3 refToNew;
+  Mat33f traceKRKi;
+  Vec3f traceKt;
+  Vec2f traceAff;
+};
+
+//! n uniform random values in [-1, 1), aligned for _mm_load_ps.
+std::vector<float, Eigen::aligned_allocator<float>> randomValues(int n) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  std::vector<float, Eigen::aligned_allocator<float>> values(n);
+  for (float& v : values) {
+    v = dist(rng);
+  }
+  return values;
+}
+
+const int kNumUpdates = 4096;
+
+void BM_Accumulator9_updateSSE(benchmark::State& state) {
+  const std::vector<float, Eigen::aligned_allocator<float>> J =
+      randomValues(9 * kNumUpdates);
+  Accumulator9* acc = new Accumulator9();
+  for (auto _ : state) {
+    acc->initialize();
+    for (int i = 0; i < kNumUpdates; i += 4) {
+      const float* j = J.data() + 9 * i;
+      acc->updateSSE(_mm_load_ps(j), _mm_load_ps(j + 4), _mm_load_ps(j + 8),
+                     _mm_load_ps(j + 12), _mm_load_ps(j + 16),
+                     _mm_load_ps(j + 20), _mm_load_ps(j + 24),
+                     _mm_load_ps(j + 28), _mm_load_ps(j + 32));
+    }
+    acc->finish();
+    benchmark::DoNotOptimize(acc->H.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+  delete acc;
+}
+BENCHMARK(BM_Accumulator9_updateSSE);
+
+void BM_Accumulator9_updateSSE_eighted(benchmark::State& state) {
+  const std::vector<float, Eigen::aligned_allocator<float>> J =
+      randomValues(10 * kNumUpdates);
+  Accumulator9* acc = new Accumulator9();
+  for (auto _ : state) {
+    acc->initialize();
+    for (int i = 0; i < kNumUpdates; i += 4) {
+      const float* j = J.data() + 10 * i;
+      acc->updateSSE_eighted(
+          _mm_load_ps(j), _mm_load_ps(j + 4), _mm_load_ps(j + 8),
+          _mm_load_ps(j + 12), _mm_load_ps(j + 16), _mm_load_ps(j + 20),
+          _mm_load_ps(j + 24), _mm_load_ps(j + 28), _mm_load_ps(j + 32),
+          _mm_load_ps(j + 36));
+    }
+    acc->finish();
+    benchmark::DoNotOptimize(acc->H.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+  delete acc;
+}
+BENCHMARK(BM_Accumulator9_updateSSE_eighted);
+
+void BM_Accumulator9_updateSingle(benchmark::State& state) {
+  const std::vector<float, Eigen::aligned_allocator<float>> J =
+      randomValues(9 * kNumUpdates);
+  Accumulator9* acc = new Accumulator9();
+  for (auto _ : state) {
+    acc->initialize();
+    for (int i = 0; i < kNumUpdates; ++i) {
+      const float* j = J.data() + 9 * i;
+      acc->updateSingle(j[0], j[1], j[2], j[3], j[4], j[5], j[6], j[7], j[8]);
+    }
+    acc->finish();
+    benchmark::DoNotOptimize(acc->H.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+  delete acc;
+}
+BENCHMARK(BM_Accumulator9_updateSingle);
+
+void BM_Accumulator14_updateSSE(benchmark::State& state) {
+  const std::vector<float, Eigen::aligned_allocator<float>> J =
+      randomValues(14 * kNumUpdates);
+  Accumulator14* acc = new Accumulator14();
+  for (auto _ : state) {
+    acc->initialize();
+    for (int i = 0; i < kNumUpdates; i += 4) {
+      const float* j = J.data() + 14 * i;
+      acc->updateSSE(_mm_load_ps(j), _mm_load_ps(j + 4), _mm_load_ps(j + 8),
+                     _mm_load_ps(j + 12), _mm_load_ps(j + 16),
+                     _mm_load_ps(j + 20), _mm_load_ps(j + 24),
+                     _mm_load_ps(j + 28), _mm_load_ps(j + 32),
+                     _mm_load_ps(j + 36), _mm_load_ps(j + 40),
+                     _mm_load_ps(j + 44), _mm_load_ps(j + 48),
+                     _mm_load_ps(j + 52));
+    }
+    acc->finish();
+    benchmark::DoNotOptimize(acc->H.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+  delete acc;
+}
+BENCHMARK(BM_Accumulator14_updateSSE);
+
+// one residual as in AccumulatedTopHessianSSE::addPoint.
+void BM_AccumulatorApprox_update(benchmark::State& state) {
+  const int kStride = 32;
+  const std::vector<float, Eigen::aligned_allocator<float>> v =
+      randomValues(kStride * kNumUpdates);
+  AccumulatorApprox* acc = new AccumulatorApprox();
+  for (auto _ : state) {
+    acc->initialize();
+    for (int i = 0; i < kNumUpdates; ++i) {
+      const float* r = v.data() + kStride * i;
+      acc->update(r, r + 4, r + 10, r + 14, r[20], r[21], r[22]);
+      acc->updateTopRight(r, r + 4, r + 10, r + 14, r[23], r[24], r[25],
+                          r[26], r[27], r[28]);
+      acc->updateBotRight(r[29], r[30], r[31], r[20], r[21], r[22]);
+    }
+    acc->finish();
+    benchmark::DoNotOptimize(acc->H.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kNumUpdates);
+  delete acc;
+}
+BENCHMARK(BM_AccumulatorApprox_update);
+
+void BM_CoarseTracker_calcRes(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  const int lvl = state.range(0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        CoarseTrackerBench::calcRes(c->tracker, lvl, c->refToNew,
+                                    AffLight(0, 0),
+                                    c->settings.coarseCutoffTH));
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          CoarseTrackerBench::numPoints(*c->tracker, lvl));
+}
+BENCHMARK(BM_CoarseTracker_calcRes)->DenseRange(0, 3);
+
+void BM_CoarseTracker_calcGSSSE(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  const int lvl = state.range(0);
+  // calcGSSSE works on the points warped by the last calcRes.
+  CoarseTrackerBench::calcRes(c->tracker, lvl, c->refToNew, AffLight(0, 0),
+                              c->settings.coarseCutoffTH);
+  Mat88 H;
+  Vec8 b;
+  for (auto _ : state) {
+    CoarseTrackerBench::calcGSSSE(c->tracker, lvl, &H, &b, c->refToNew,
+                                  AffLight(0, 0));
+    benchmark::DoNotOptimize(H.data());
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          CoarseTrackerBench::numPoints(*c->tracker, lvl));
+}
+BENCHMARK(BM_CoarseTracker_calcGSSSE)->DenseRange(0, 3);
+
+void BM_PointFrameResidual_linearize(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  for (auto _ : state) {
+    double energy = 0;
+    for (PointFrameResidual* r : c->residuals) {
+      energy += r->linearize(c->HCalib);
+    }
+    benchmark::DoNotOptimize(energy);
+  }
+  state.SetItemsProcessed(state.iterations() * c->residuals.size());
+}
+BENCHMARK(BM_PointFrameResidual_linearize);
+
+// a first trace (unbounded epipolar search) of every point of the host.
+void BM_ImmaturePoint_traceOn(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  ImmaturePoint* work = new ImmaturePoint(*c->immaturePoints[0]);
+  int numGood = 0;
+  for (auto _ : state) {
+    numGood = 0;
+    for (const ImmaturePoint* ip : c->immaturePoints) {
+      *work = *ip;
+      numGood += work->traceOn(c->frames[2], c->traceKRKi, c->traceKt,
+                               c->traceAff, c->HCalib) == IPS_GOOD;
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * c->immaturePoints.size());
+  state.counters["good"] = numGood;
+  delete work;
+}
+BENCHMARK(BM_ImmaturePoint_traceOn);
+
+void BM_FrameHessian_makeImages(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  IndexThreadReduce<Vec10>* red =
+      state.range(0) != 0 ? new IndexThreadReduce<Vec10>() : nullptr;
+  FrameHessian* fh = new FrameHessian(c->calib, c->settings);
+  for (auto _ : state) {
+    // hand the pyramid back, as a dropped non-keyframe does.
+    PyramidBufferPool::Release(c->calib, fh->dIp, fh->absSquaredGrad);
+    fh->makeImages(c->images[2].data(), c->HCalib, red);
+    benchmark::DoNotOptimize(fh->dI);
+  }
+  state.SetItemsProcessed(state.iterations() * c->calib.w[0] * c->calib.h[0]);
+  delete fh;
+  delete red;
+}
+BENCHMARK(BM_FrameHessian_makeImages)->Arg(0)->Arg(1)->UseRealTime();
+
+void BM_PixelSelector_makeMaps(benchmark::State& state) {
+  BenchContext* c = BenchContext::Get();
+  PixelSelector selector(c->calib, c->settings);
+  std::vector<PixelCandidate> candidates;
+  int numSelected = 0;
+  for (auto _ : state) {
+    // the histograms and thresholds are recomputed for every frame.
+    selector.allowFast = true;
+    numSelected = selector.makeMaps(c->frames[2], &candidates,
+                                    c->settings.desiredImmatureDensity);
+  }
+  state.SetItemsProcessed(state.iterations() * c->calib.w[0] * c->calib.h[0]);
+  state.counters["selected"] = numSelected;
+}
+BENCHMARK(BM_PixelSelector_makeMaps);
+
+/** \brief Calibration files of a RadTan camera, kRawWidth x kRawHeight
+ *         cropped to kWidth x kHeight, with gamma and vignette
+ */
+struct UndistortContext {
+  static UndistortContext* Get() {
+    static UndistortContext* context = new UndistortContext();
+    return context;
+  }
+
+  UndistortContext() {
+    char dir[] = "/tmp/dso_bench_XXXXXX";
+    CHECK(mkdtemp(dir) != nullptr);
+    calibFile = std::string(dir) + "/camera.txt";
+    gammaFile = std::string(dir) + "/pcalib.txt";
+    vignetteFile = std::string(dir) + "/vignette.png";
+
+    FILE* calib = fopen(calibFile.c_str(), "w");
+    fprintf(calib,
+            "RadTan 458.654 457.296 367.215 248.375 -0.28340811 0.07395907 "
+            "0.00019359 1.76187114e-05\n%d %d\ncrop\n%d %d\n",
+            kRawWidth, kRawHeight, kWidth, kHeight);
+    fclose(calib);
+
+    FILE* gamma = fopen(gammaFile.c_str(), "w");
+    for (int i = 0; i < 256; ++i) {
+      fprintf(gamma, "%f ", 255 * std::pow(i / 255.0, 1.2));
+    }
+    fprintf(gamma, "\n");
+    fclose(gamma);
+
+    raw = new MinimalImageB(kRawWidth, kRawHeight);
+    MinimalImageB vignette(kRawWidth, kRawHeight);
+    const float cx = kRawWidth / 2.f, cy = kRawHeight / 2.f;
+    for (int y = 0; y < kRawHeight; ++y) {
+      for (int x = 0; x < kRawWidth; ++x) {
+        raw->at(x, y) = texture(x / 200.f, y / 200.f);
+        const float r2 = ((x - cx) * (x - cx) + (y - cy) * (y - cy)) /
+                         (cx * cx + cy * cy);
+        vignette.at(x, y) = 255 * (1 - 0.4f * r2);
+      }
+    }
+    IOWrap::writeImage(vignetteFile, &vignette);
+
+    undistorter =
+        Undistorter::GetUndistorterForFile(calibFile, gammaFile, vignetteFile);
+    CHECK_NOTNULL(undistorter);
+    photometric = new PhotometricUndistorter(gammaFile, "", vignetteFile,
+                                             kRawWidth, kRawHeight);
+  }
+
+  std::string calibFile, gammaFile, vignetteFile;
+  MinimalImageB* raw;
+  Undistorter* undistorter;
+  PhotometricUndistorter* photometric;
+};
+
+// without image IO (no OpenCV) the vignette cannot be read back, the
+// photometric calibration is then off and only the remap is timed.
+const char* photometricLabel(PhotometricUndistorter* photometric) {
+  return photometric->GetG() != nullptr ? "gamma+vignette" : "uncalibrated";
+}
+
+void BM_Undistorter_Undistort(benchmark::State& state) {
+  UndistortContext* c = UndistortContext::Get();
+  for (auto _ : state) {
+    ImageAndExposure* image = c->undistorter->Undistort(c->raw, 10);
+    benchmark::DoNotOptimize(image->image);
+    delete image;
+  }
+  state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+  state.SetLabel(photometricLabel(c->photometric));
+}
+BENCHMARK(BM_Undistorter_Undistort);
+
+void BM_Undistorter_UndistortInto(benchmark::State& state) {
+  UndistortContext* c = UndistortContext::Get();
+  ImageAndExposure image(kWidth, kHeight);
+  for (auto _ : state) {
+    c->undistorter->UndistortInto(c->raw, &image, 10);
+    benchmark::DoNotOptimize(image.image);
+  }
+  state.SetItemsProcessed(state.iterations() * kWidth * kHeight);
+  state.SetLabel(photometricLabel(c->photometric));
+}
+BENCHMARK(BM_Undistorter_UndistortInto);
+
+void BM_PhotometricUndistorter_ProcessFrame(benchmark::State& state) {
+  UndistortContext* c = UndistortContext::Get();
+  for (auto _ : state) {
+    c->photometric->ProcessFrame<unsigned char>(c->raw->data, 10);
+    benchmark::DoNotOptimize(c->photometric->output_->image);
+  }
+  state.SetItemsProcessed(state.iterations() * kRawWidth * kRawHeight);
+  state.SetLabel(photometricLabel(c->photometric));
+}
+BENCHMARK(BM_PhotometricUndistorter_ProcessFrame);
+
+/** \brief A window of frames with filled top Hessian accumulators
+ *
+ *  The frames have no images, stitching only needs their states and the
+ *  adjoints of the energy functional.
+ */
+struct StitchContext {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit StitchContext(int nFrames)
+      : ef(BenchContext::Get()->settings),
+        acc(BenchContext::Get()->settings.maxFrames),
+        red(nullptr) {
+    BenchContext* c = BenchContext::Get();
+    for (int i = 0; i < nFrames; ++i) {
+      FrameHessian* fh = new FrameHessian(c->calib, c->settings);
+      fh->shell = new FrameShell();
+      fh->shell->id = fh->frameID = fh->idx = i;
+      fh->ab_exposure = 1;
+      fh->setEvalPT_scaled(
+          SE3(SO3(), Vec3(0.05 * i, 0, 0)).inverse(), AffLight(0, 0));
+      ef.insertFrame(fh, c->HCalib);
+    }
+    ef.setDeltaF(c->HCalib);
+    red = new IndexThreadReduce<Vec10>();
+
+    const std::vector<float, Eigen::aligned_allocator<float>> v =
+        randomValues(32 * 64);
+    for (int tid = 0; tid < red->getNumThreads(); ++tid) {
+      acc.setZero(nFrames, 0, 1, nullptr, tid);
+      for (int k = 0; k < nFrames * nFrames; ++k) {
+        if (k % (nFrames + 1) == 0) {
+          continue;  // no residuals of a frame on itself.
+        }
+        AccumulatorApprox& a = acc.acc[tid][k];
+        for (int i = 0; i < 64; ++i) {
+          const float* r = v.data() + 32 * i;
+          a.update(r, r + 4, r + 10, r + 14, r[20], r[21], r[22]);
+          a.updateTopRight(r, r + 4, r + 10, r + 14, r[23], r[24], r[25],
+                           r[26], r[27], r[28]);
+          a.updateBotRight(r[29], r[30], r[31], r[20], r[21], r[22]);
+        }
+      }
+    }
+  }
+
+  EnergyFunctional ef;
+  AccumulatedTopHessianSSE acc;
+  IndexThreadReduce<Vec10>* red;
+};
+
+void BM_AccumulatedTopHessianSSE_stitchDoubleMT(benchmark::State& state) {
+  static StitchContext* contexts[2][32] = {};
+  const int nFrames = state.range(0);
+  const bool MT = state.range(1) != 0;
+  StitchContext*& c = contexts[MT][nFrames];
+  if (c == nullptr) {
+    c = new StitchContext(nFrames);
+  }
+  MatXX H;
+  VecX b;
+  for (auto _ : state) {
+    c->acc.stitchDoubleMT(c->red, H, b, &c->ef, true, MT);
+    benchmark::DoNotOptimize(H.data());
+  }
+}
+BENCHMARK(BM_AccumulatedTopHessianSSE_stitchDoubleMT)
+    ->ArgsProduct({{4, 8}, {0, 1}})
+    ->UseRealTime();
+
+}  // namespace
+
+BENCHMARK_MAIN();
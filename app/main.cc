@@ -4,11 +4,21 @@
 #include <glog/logging.h>
 
 #include "full_system/full_system.h"
-#include "io_wrapper/output_wrapper/pointcloud_output_wrapper.h"
+#include "io_wrapper/output_wrapper/async_output_wrapper.h"
+#include "io_wrapper/output_wrapper/map_store.h"
+#include "io_wrapper/output_wrapper/ply_output_wrapper.h"
 #include "io_wrapper/output_wrapper/sample_output_wrapper.h"
+#include "io_wrapper/output_wrapper/shm_output_wrapper.h"
+#include "io_wrapper/output_wrapper/trajectory_output_wrapper.h"
 #include "io_wrapper/pangolin/pangolin_dso_viewer.h"
 #include "util/dataset_reader.h"
 #include "util/input_parser.h"
+#include "util/memory_stats.h"
+#include "util/metrics_exporter.h"
+#include "util/sampling_profiler.h"
+#include "util/stage_timing.h"
+#include "util/thread_config.h"
+#include "util/trace_recorder.h"
 
 using namespace dso;
 
@@ -32,11 +42,31 @@ void ExitThread() {
   }
 }
 
+// with Int.OutputQueueSize, ow gets its own publisher thread.
+IOWrap::Output3DWrapper *MaybeAsync(IOWrap::Output3DWrapper *ow,
+                                    const InputParam &param) {
+  if (param.output_queue_size <= 0) {
+    return ow;
+  }
+  return new IOWrap::AsyncOutputWrapper(
+      ow, param.output_queue_size,
+      static_cast<IOWrap::AsyncOutputWrapper::Backpressure>(
+          param.output_backpressure));
+}
+
 int main(int argc, char **argv) {
   LOG_IF(FATAL, argc < 2) << "Usage: ./dso path_to_configuration";
 
   InputParam param = InputParser::Read(argv[1]);
-  InputParser::Config(&param);
+  Settings settings;
+  InputParser::Config(&param, &settings);
+
+  if (setting_metricsPort > 0) {
+    MetricsExporter::start(setting_metricsPort);
+  }
+  if (setting_profile) {
+    SamplingProfiler::start();
+  }
 
   // hook crtl+C.
   boost::thread exit_thread = boost::thread(ExitThread);
@@ -51,7 +81,8 @@ int main(int argc, char **argv) {
                                param.path_2_gamma, param.path_2_vignette);
   }
 
-  reader->SetGlobalCalibration();
+  // outlives the FullSystem and the outputs holding its frames.
+  const CalibContext calib = reader->GetCalibContext(param.pyr_levels);
 
   LOG_IF(FATAL, setting_photometricCalibration > 0 &&
                     reader->GetPhotometricGamma() == 0)
@@ -72,28 +103,67 @@ int main(int argc, char **argv) {
     linc = -1;
   }
 
-  FullSystem *full_system = new FullSystem();
+  FullSystem *full_system = new FullSystem(calib, settings);
   full_system->setGammaFunction(reader->GetPhotometricGamma());
   full_system->linearizeOperation = (param.play_speed == 0.f);
 
+  IOWrap::MapStore *map_store = nullptr;
+  if (!param.path_2_map_store.empty()) {
+    map_store = new IOWrap::MapStore(param.path_2_map_store,
+                                     param.map_store_cell_size,
+                                     param.map_store_cache_points);
+    full_system->outputWrapper.emplace_back(map_store);
+  }
+
   IOWrap::PangolinDSOViewer *viewer = 0;
   if (!disableAllDisplay) {
-    viewer = new IOWrap::PangolinDSOViewer(wG[0], hG[0], false);
-    full_system->outputWrapper.emplace_back(viewer);
+    viewer = new IOWrap::PangolinDSOViewer(calib.w[0], calib.h[0], false);
+    viewer->setSettings(&full_system->settings);
+    if (map_store != nullptr) {
+      viewer->setMapStore(map_store, param.map_store_view_radius);
+    }
+    full_system->outputWrapper.emplace_back(MaybeAsync(viewer, param));
   }
 
   if (param.use_sample_output) {
-    full_system->outputWrapper.emplace_back(new IOWrap::SampleOutputWrapper());
+    full_system->outputWrapper.emplace_back(
+        MaybeAsync(new IOWrap::SampleOutputWrapper(), param));
+  }
+
+  // with a map store result_map.ply is exported from it at the end.
+  if (param.use_pcl_output && map_store == nullptr) {
+    full_system->outputWrapper.emplace_back(new IOWrap::PlyOutputWrapper());
   }
 
-  if (param.use_pcl_output) {
+  if (!param.shm_output.empty()) {
     full_system->outputWrapper.emplace_back(
-        new IOWrap::PointCloudOutputWrapper());
+        new IOWrap::ShmOutputWrapper(param.shm_output, param.shm_slots));
+  }
+
+  // result.txt is written as the poses get final, else at the end.
+  IOWrap::TrajectoryOutputWrapper *trajectory = nullptr;
+  if (param.result_sync_interval_ms > 0) {
+    trajectory = new IOWrap::TrajectoryOutputWrapper(
+        "result.txt", param.result_sync_interval_ms);
+    full_system->outputWrapper.emplace_back(trajectory);
+  }
+
+  // continue the map of a previous run, tracking starts at Int.StartId. In
+  // localization mode the snapshot is the map, there is nothing to track
+  // against without it.
+  if (param.localization_mode) {
+    const bool loaded = full_system->loadSnapshot(param.path_2_snapshot);
+    CHECK(loaded) << "Bool.LocalizationMode needs a snapshot.";
+  } else if (param.resume_from_snapshot &&
+             !full_system->loadSnapshot(param.path_2_snapshot)) {
+    LOG(WARNING) << "Starting without snapshot.";
   }
 
   // to make MacOS happy: run this in dedicated thread -- and use this one to
   // run the GUI.
   std::thread runthread([&]() {
+    ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_TRACKER);
+
     std::vector<int> ids_to_play;
     std::vector<double> times_to_play_at;
     for (int i = lstart; i >= 0 && i < num_of_images && linc * i < linc * lend;
@@ -106,10 +176,18 @@ int main(int argc, char **argv) {
     std::vector<ImageAndExposure *> preloaded_images;
     if (param.preload) {
       LOG(WARNING) << "LOADING ALL IMAGES!";
-      for (size_t ii = 0; ii < ids_to_play.size(); ++ii) {
-        int i = ids_to_play[ii];
-        preloaded_images.emplace_back(reader->GetImage(i));
+      // decoded and undistorted in parallel by the prefetch workers.
+      if (!ids_to_play.empty()) {
+        reader->StartPrefetch(ids_to_play, param.prefetch_threads,
+                              ids_to_play.size());
+        for (size_t ii = 0; ii < ids_to_play.size(); ++ii) {
+          preloaded_images.emplace_back(reader->Next());
+        }
+        reader->StopPrefetch();
       }
+    } else if (param.prefetch) {
+      reader->StartPrefetch(ids_to_play, param.prefetch_threads,
+                            param.prefetch_buffer);
     }
 
     timeval tv_start;
@@ -117,6 +195,14 @@ int main(int argc, char **argv) {
     clock_t started = clock();
     double s_initializer_offset = 0;
 
+    // frames read in the loop are undistorted into the same buffer, unless
+    // they are views into a frame archive anyway.
+    ImageAndExposure *reused_img = nullptr;
+    if (!param.preload && !param.prefetch && !reader->IsZeroCopy()) {
+      const Eigen::Vector2i size = reader->GetSize();
+      reused_img = new ImageAndExposure(size[0], size[1]);
+    }
+
     for (int ii = 0; ii < static_cast<int>(ids_to_play.size()); ++ii) {
       if (!full_system->initialized) {
         // if not initialized: reset start time.
@@ -130,31 +216,25 @@ int main(int argc, char **argv) {
       ImageAndExposure *img;
       if (param.preload) {
         img = preloaded_images[ii];
-      } else {
+      } else if (param.prefetch) {
+        img = reader->Next();
+      } else if (reader->IsZeroCopy()) {
         img = reader->GetImage(i);
+      } else {
+        reader->GetImageInto(i, reused_img);
+        img = reused_img;
       }
 
       full_system->addActiveFrame(img, i);
 
-      delete img;
+      if (img != reused_img) {
+        delete img;
+      }
 
       if (full_system->initFailed || setting_fullResetRequested) {
         if (ii < 250 || setting_fullResetRequested) {
           LOG(WARNING) << "RESETTING!";
-
-          std::vector<IOWrap::Output3DWrapper *> wraps =
-              full_system->outputWrapper;
-          delete full_system;
-
-          for (IOWrap::Output3DWrapper *ow : wraps) {
-            ow->reset();
-          }
-
-          full_system = new FullSystem();
-          full_system->setGammaFunction(reader->GetPhotometricGamma());
-          full_system->linearizeOperation = (param.play_speed == 0.f);
-          full_system->outputWrapper = wraps;
-
+          full_system->reset();
           setting_fullResetRequested = false;
         }
       }
@@ -165,12 +245,18 @@ int main(int argc, char **argv) {
       }
     }
 
+    delete reused_img;
+    reader->StopPrefetch();
     full_system->blockUntilMappingIsFinished();
     clock_t ended = clock();
     struct timeval tv_end;
     gettimeofday(&tv_end, NULL);
 
-    full_system->printResult("result.txt");
+    if (trajectory != nullptr) {
+      trajectory->join();
+    } else {
+      full_system->printResult("result.txt");
+    }
 
     const int frames_processed = abs(ids_to_play[0] - ids_to_play.back());
     const double seconds_processed =
@@ -193,6 +279,23 @@ int main(int argc, char **argv) {
               << 1000 / (milliseconds_taken_mt / seconds_processed)
               << "x (multi core);\n======================\n\n";
 
+    if (setting_stageTiming) {
+      StageTiming::logSummary();
+      StageTiming::dump(setting_stageTimingPath);
+    }
+    MemoryStats::logSummary();
+    if (setting_perfCounters) {
+      PerfCounters::logSummary();
+      PerfCounters::dump(setting_perfCountersPath);
+    }
+    if (setting_trace) {
+      TraceRecorder::write(setting_tracePath);
+    }
+    if (setting_profile) {
+      SamplingProfiler::write(setting_profilePath);
+      SamplingProfiler::logSummary();
+    }
+
     // full_system->printFrameLifetimes();
     if (setting_logStuff) {
       std::ofstream tmp_log;
@@ -215,11 +318,18 @@ int main(int argc, char **argv) {
 
   runthread.join();
 
+  if (map_store != nullptr && param.use_pcl_output) {
+    map_store->join();
+    map_store->writePly("result_map.ply");
+  }
+
   for (IOWrap::Output3DWrapper *ow : full_system->outputWrapper) {
     ow->join();
     delete ow;
   }
 
+  MetricsExporter::stop();
+
   LOG(WARNING) << "DELETE FULLSYSTEM!";
   delete full_system;
 
@@ -16,7 +16,7 @@
 #include "io_wrapper/pangolin/pangolin_dso_viewer.h"
 #include "optimization_backend/accumulators/matrix_accumulators.h"
 #include "util/dataset_reader.h"
-#include "util/global_calib.h"
+#include "util/calib_context.h"
 #include "util/global_funcs.h"
 #include "util/num_type.h"
 #include "util/settings.h"
@@ -38,6 +38,8 @@ bool preload = false;
 bool useSampleOutput = false;
 
 int mode = 0;
+// tuning of the FullSystem, set by the presets and options.
+dso::Settings settings;
 
 bool firstRosSpin = false;
 
@@ -73,12 +75,12 @@ void settingsDefault(int preset) {
 
     playbackSpeed = (preset == 0 ? 0 : 1);
     preload = preset == 1;
-    setting_desiredImmatureDensity = 1500;
-    setting_desiredPointDensity = 2000;
-    setting_minFrames = 5;
-    setting_maxFrames = 7;
-    setting_maxOptIterations = 6;
-    setting_minOptIterations = 1;
+    settings.desiredImmatureDensity = 1500;
+    settings.desiredPointDensity = 2000;
+    settings.minFrames = 5;
+    settings.maxFrames = 7;
+    settings.maxOptIterations = 6;
+    settings.minOptIterations = 1;
 
     setting_logStuff = false;
   }
@@ -95,12 +97,12 @@ void settingsDefault(int preset) {
 
     playbackSpeed = (preset == 2 ? 0 : 5);
     preload = preset == 3;
-    setting_desiredImmatureDensity = 600;
-    setting_desiredPointDensity = 800;
-    setting_minFrames = 4;
-    setting_maxFrames = 6;
-    setting_maxOptIterations = 4;
-    setting_minOptIterations = 1;
+    settings.desiredImmatureDensity = 600;
+    settings.desiredPointDensity = 800;
+    settings.minFrames = 4;
+    settings.maxFrames = 6;
+    settings.maxOptIterations = 4;
+    settings.minOptIterations = 1;
 
     benchmarkSetting_width = 424;
     benchmarkSetting_height = 320;
@@ -177,7 +179,7 @@ void parseArgument(char* arg) {
   }
   if (1 == sscanf(arg, "nomt=%d", &option)) {
     if (option == 1) {
-      multiThreading = false;
+      settings.multiThreading = false;
       printf("NO MultiThreading!\n");
     }
     return;
@@ -268,19 +270,19 @@ void parseArgument(char* arg) {
     if (option == 1) {
       printf("PHOTOMETRIC MODE WITHOUT CALIBRATION!\n");
       setting_photometricCalibration = 0;
-      setting_affineOptModeA =
+      settings.affineOptModeA =
           0;  //-1: fix. >=0: optimize (with prior, if > 0).
-      setting_affineOptModeB =
+      settings.affineOptModeB =
           0;  //-1: fix. >=0: optimize (with prior, if > 0).
     }
     if (option == 2) {
       printf("PHOTOMETRIC MODE WITH PERFECT IMAGES!\n");
       setting_photometricCalibration = 0;
-      setting_affineOptModeA =
+      settings.affineOptModeA =
           -1;  //-1: fix. >=0: optimize (with prior, if > 0).
-      setting_affineOptModeB =
+      settings.affineOptModeB =
           -1;  //-1: fix. >=0: optimize (with prior, if > 0).
-      setting_minGradHistAdd = 3;
+      settings.minGradHistAdd = 3;
     }
     return;
   }
@@ -297,7 +299,7 @@ int main(int argc, char** argv) {
 
   DatasetReader* reader =
       new DatasetReader(source, calib, gammaCalib, vignette);
-  reader->SetGlobalCalibration();
+  const CalibContext calibContext = reader->GetCalibContext();
 
   if (setting_photometricCalibration > 0 &&
       reader->GetPhotometricGamma() == 0) {
@@ -321,13 +323,15 @@ int main(int argc, char** argv) {
     linc = -1;
   }
 
-  FullSystem* fullSystem = new FullSystem();
+  FullSystem* fullSystem = new FullSystem(calibContext, settings);
   fullSystem->setGammaFunction(reader->GetPhotometricGamma());
   fullSystem->linearizeOperation = (playbackSpeed == 0);
 
   IOWrap::PangolinDSOViewer* viewer = 0;
   if (!disableAllDisplay) {
-    viewer = new IOWrap::PangolinDSOViewer(wG[0], hG[0], false);
+    viewer = new IOWrap::PangolinDSOViewer(calibContext.w[0],
+                                           calibContext.h[0], false);
+    viewer->setSettings(&fullSystem->settings);
     fullSystem->outputWrapper.emplace_back(viewer);
   }
 
@@ -407,19 +411,7 @@ int main(int argc, char** argv) {
       if (fullSystem->initFailed || setting_fullResetRequested) {
         if (ii < 250 || setting_fullResetRequested) {
           printf("RESETTING!\n");
-
-          std::vector<IOWrap::Output3DWrapper*> wraps =
-              fullSystem->outputWrapper;
-          delete fullSystem;
-
-          for (IOWrap::Output3DWrapper* ow : wraps) ow->reset();
-
-          fullSystem = new FullSystem();
-          fullSystem->setGammaFunction(reader->GetPhotometricGamma());
-          fullSystem->linearizeOperation = (playbackSpeed == 0);
-
-          fullSystem->outputWrapper = wraps;
-
+          fullSystem->reset();
           setting_fullResetRequested = false;
         }
       }
@@ -0,0 +1,54 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "util/dataset_reader.h"
+#include "util/frame_archive.h"
+#include "util/input_parser.h"
+
+using namespace dso;
+
+/** Undistort the frames [start_id, end_id) of the dataset in a configuration
+ *  once and store them as FrameArchive. Setting path_2_images of the
+ *  configuration to the archive then skips decoding and undistortion.
+ */
+int main(int argc, char **argv) {
+  LOG_IF(FATAL, argc < 3)
+      << "Usage: ./dso_frame_archive path_to_configuration "
+         "output.dsoframes [uint8]";
+  const std::string output = argv[2];
+  LOG_IF(FATAL, !FrameArchive::IsArchivePath(output))
+      << "The archive has to end in .dsoframes!";
+  const FrameArchive::PixelFormat format =
+      (argc > 3 && std::string(argv[3]) == "uint8")
+          ? FrameArchive::PIXEL_UINT8
+          : FrameArchive::PIXEL_FLOAT;
+
+  InputParam param = InputParser::Read(argv[1]);
+  // no FullSystem: only the process settings (photometric mode) matter.
+  Settings settings;
+  InputParser::Config(&param, &settings);
+
+  DatasetReader *reader;
+  if (param.path_2_timestamps != "") {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette,
+                               param.path_2_timestamps);
+  } else {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette);
+  }
+
+  const int num_of_images = static_cast<int>(reader->GetNumImages());
+  std::vector<int> ids;
+  for (int i = std::max(param.start_id, 0);
+       i < num_of_images && i < param.end_id; ++i) {
+    ids.emplace_back(i);
+  }
+
+  const bool ok = FrameArchive::Write(output, reader, ids, format);
+  delete reader;
+  return ok ? 0 : 1;
+}
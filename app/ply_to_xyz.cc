@@ -0,0 +1,18 @@
+#include <string>
+
+#include <glog/logging.h>
+
+#include "io_wrapper/output_wrapper/ply_output_wrapper.h"
+
+using namespace dso;
+
+/** Convert the binary point cloud written with Bool.UsePCLOutput into the
+ *  text format of the former result_map.xyz, one `x y z` line per point.
+ */
+int main(int argc, char **argv) {
+  LOG_IF(FATAL, argc < 2)
+      << "Usage: ./dso_ply_to_xyz result_map.ply [result_map.xyz]";
+  const std::string ply = argv[1];
+  const std::string xyz = (argc > 2) ? argv[2] : "result_map.xyz";
+  return IOWrap::PlyOutputWrapper::WriteXyz(ply, xyz) ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include "util/index_thread_reduce.h"
+#include "util/settings.h"
+
+/** \file
+ *  Stress test of IndexThreadReduce with several threads calling reduce() on
+ *  one pool at once, as the FullSystems of dso_batch do.
+ *
+ *  Every call checks that each index of its range ran exactly once, that no
+ *  tid ran twice at the same time, that every tid was called and that the
+ *  Running add up. With setting_deterministicReduce it also checks that every
+ *  index ran on the same tid as in a run of a single caller before. Runs
+ *  with and without setting_deterministicReduce; the exit code is 1 if any
+ *  check failed. Rerun it after changing the pool.
+ *
+ *  Usage: ./dso_reduce_stress [callers (8)] [reductions per caller (3000)]
+ *                             [workers (setting_numThreads)]
+ */
+
+using namespace dso;
+
+namespace {
+
+// ranges of up to kMaxRange indices, with kStepSizes[i % 4] as stepSize.
+const int kMaxRange = 5000;
+const int kStepSizes[] = {0, 1, 25, 50};
+
+/** \brief Run reductions from one caller, returns the number of failed checks
+ *
+ *  Reduction it has the same range and stepSize in every caller; a caller
+ *  starts at reduction offset, so concurrent calls differ in size.
+ *
+ *  @param[in,out] firstTid - per reduction, the tid of every index of its
+ *                            range: filled if record, else compared with.
+ *                            nullptr to not check the tids.
+ */
+long RunCaller(IndexThreadReduce<Vec10>* const pool, const int reductions,
+               const int offset, std::vector<std::vector<int>>* const firstTid,
+               const bool record) {
+  const int numThreads = pool->getNumThreads();
+  // per tid state of this caller, as FullSystem keeps it.
+  std::vector<std::atomic<int>> inUse(numThreads);
+  std::vector<int> called(numThreads);
+  std::vector<int> hits(kMaxRange);
+  std::vector<int> tids(kMaxRange);
+  std::atomic<long> failed(0);
+
+  for (int i = 0; i < reductions; ++i) {
+    const int it = (i + offset) % reductions;
+    const int n = (it * 37) % kMaxRange;
+    const int first = it % 7;
+    const int stepSize = kStepSizes[it % 4];
+    for (int t = 0; t < numThreads; ++t) {
+      inUse[t] = 0;
+      called[t] = 0;
+    }
+    std::fill(hits.begin(), hits.end(), 0);
+
+    const Vec10 sum = pool->reduce(
+        [&](const int min, const int max, Vec10* const stats, const int tid) {
+          if (inUse[tid]++ != 0) {
+            ++failed;
+          }
+          ++called[tid];
+          for (int k = min; k < max; ++k) {
+            ++hits[k];
+            tids[k] = tid;
+            (*stats)[0] += k;
+            (*stats)[1] += 1;
+          }
+          --inUse[tid];
+        },
+        first, n, stepSize);
+
+    for (int k = 0; k < n; ++k) {
+      if (hits[k] != (k >= first ? 1 : 0)) {
+        ++failed;
+      }
+    }
+    for (int t = 0; t < numThreads; ++t) {
+      if (called[t] == 0) {
+        ++failed;
+      }
+    }
+    const int count = std::max(n - first, 0);
+    const double indexSum =
+        count == 0 ? 0. : (static_cast<double>(first) + n - 1) * count / 2;
+    if (sum[1] != count || sum[0] != indexSum) {
+      ++failed;
+    }
+
+    if (firstTid != nullptr) {
+      const std::vector<int>::iterator begin = tids.begin() + std::min(first, n);
+      if (record) {
+        (*firstTid)[it].assign(begin, tids.begin() + n);
+      } else if (!std::equal((*firstTid)[it].begin(), (*firstTid)[it].end(),
+                             begin)) {
+        ++failed;
+      }
+    }
+  }
+  return failed;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const int callers = argc > 1 ? atoi(argv[1]) : 8;
+  const int reductions = argc > 2 ? atoi(argv[2]) : 3000;
+  const int workers = argc > 3 ? atoi(argv[3]) : 0;
+
+  long failed = 0;
+  for (const bool deterministic : {false, true}) {
+    setting_deterministicReduce = deterministic;
+    IndexThreadReduce<Vec10> pool(workers);
+
+    // the tids of a first run alone, which the callers have to repeat.
+    std::vector<std::vector<int>> firstTid(reductions);
+    if (deterministic) {
+      failed += RunCaller(&pool, reductions, 0, &firstTid, true);
+    }
+
+    std::vector<long> callerFailed(callers, 0);
+    std::vector<boost::thread> threads;
+    for (int c = 0; c < callers; ++c) {
+      threads.emplace_back([&, c]() {
+        callerFailed[c] =
+            RunCaller(&pool, reductions, c * reductions / callers,
+                      deterministic ? &firstTid : nullptr, false);
+      });
+    }
+    for (boost::thread& thread : threads) {
+      thread.join();
+    }
+    for (const long f : callerFailed) {
+      failed += f;
+    }
+    LOG(INFO) << (deterministic ? "deterministic" : "stealing") << ": "
+              << callers << " callers x " << reductions << " reductions on "
+              << pool.getNumThreads() << " workers, " << failed
+              << " failed checks so far.";
+  }
+
+  LOG_IF(ERROR, failed > 0) << failed << " failed checks.";
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,825 @@
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "full_system/full_system.h"
+#include "util/dataset_reader.h"
+#include "util/input_parser.h"
+#include "util/json_reader.h"
+#include "util/memory_stats.h"
+#include "util/stage_timing.h"
+#include "util/trajectory_error.h"
+
+using namespace dso;
+
+namespace {
+
+// estimated and ground truth poses further apart are not compared.
+const double kMaxMatchDt = 0.02;
+
+//! A tuning setting of the sweep and the values it takes.
+struct SweepParam {
+  std::string name;
+  std::vector<double> values;  //!< {lo, hi} of a range
+  bool range;                  //!< lo:hi, sampled uniformly
+};
+
+//! The tuning settings of one run, set after the preset.
+typedef std::vector<std::pair<std::string, double>> SweepPoint;
+
+//! One run of the report, see Run().
+struct Job {
+  int preset;
+  int threads;
+  size_t point;
+  int repeat;
+};
+
+//! What the parent keeps of a run besides its JSON, NaN if unknown.
+struct RunResult {
+  std::string json;
+  double seconds;
+  double rmse;
+  //! The values compared against the baseline, see GateMetrics().
+  std::vector<std::pair<std::string, double>> metrics;
+};
+
+// "1,2,4" -> {1, 2, 4}, fallback if empty.
+std::vector<int> ParseList(const std::string &list, const int fallback) {
+  std::vector<int> values;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      values.emplace_back(std::stoi(item));
+    }
+  }
+  if (values.empty()) {
+    values.emplace_back(fallback);
+  }
+  return values;
+}
+
+// "desiredPointDensity=800,1500;maxFrames=5:7" -> one SweepParam per setting.
+std::vector<SweepParam> ParseSweep(const std::string &spec) {
+  std::vector<SweepParam> params;
+  std::stringstream stream(spec);
+  std::string item;
+  while (std::getline(stream, item, ';')) {
+    if (item.empty()) {
+      continue;
+    }
+    const size_t equals = item.find('=');
+    LOG_IF(FATAL, equals == std::string::npos)
+        << "String.SweepParams: expected name=values, got " << item;
+    SweepParam param;
+    param.name = item.substr(0, equals);
+    LOG_IF(FATAL, !isTuningSetting(param.name))
+        << "String.SweepParams: " << param.name << " is no tuning setting";
+    std::string values = item.substr(equals + 1);
+    param.range = values.find(':') != std::string::npos;
+    std::replace(values.begin(), values.end(), ':', ',');
+    std::stringstream valueStream(values);
+    std::string value;
+    while (std::getline(valueStream, value, ',')) {
+      param.values.emplace_back(std::stod(value));
+    }
+    LOG_IF(FATAL, param.values.empty() ||
+                      (param.range && param.values.size() != 2))
+        << "String.SweepParams: bad values of " << param.name;
+    params.emplace_back(param);
+  }
+  return params;
+}
+
+/** The full grid of params if samples is 0, else samples points drawn from
+ *  the value lists and ranges with seed. Ranges need samples > 0.
+ */
+std::vector<SweepPoint> SweepPoints(const std::vector<SweepParam> &params,
+                                    const int samples, const int seed) {
+  std::vector<SweepPoint> points(1);
+  if (samples > 0 && !params.empty()) {
+    std::mt19937 rng(seed);
+    points.assign(samples, SweepPoint());
+    for (SweepPoint &point : points) {
+      for (const SweepParam &param : params) {
+        double value;
+        if (param.range) {
+          value = std::uniform_real_distribution<double>(
+              param.values[0], param.values[1])(rng);
+        } else {
+          value = param.values[std::uniform_int_distribution<size_t>(
+              0, param.values.size() - 1)(rng)];
+        }
+        point.emplace_back(param.name, value);
+      }
+    }
+    return points;
+  }
+
+  for (const SweepParam &param : params) {
+    LOG_IF(FATAL, param.range) << "String.SweepParams: the range of "
+                               << param.name << " needs Int.SweepSamples";
+    std::vector<SweepPoint> grid;
+    for (const SweepPoint &point : points) {
+      for (const double value : param.values) {
+        grid.emplace_back(point);
+        grid.back().emplace_back(param.name, value);
+      }
+    }
+    points.swap(grid);
+  }
+  return points;
+}
+
+// indices of the runs no other run beats in both seconds and ATE, fastest
+// first.
+std::vector<size_t> ParetoFront(const std::vector<RunResult> &results) {
+  std::vector<size_t> front;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const RunResult &a = results[i];
+    if (!std::isfinite(a.seconds) || !std::isfinite(a.rmse)) {
+      continue;
+    }
+    bool dominated = false;
+    for (const RunResult &b : results) {
+      if (std::isfinite(b.seconds) && std::isfinite(b.rmse) &&
+          b.seconds <= a.seconds && b.rmse <= a.rmse &&
+          (b.seconds < a.seconds || b.rmse < a.rmse)) {
+        dominated = true;
+        break;
+      }
+    }
+    if (!dominated) {
+      front.emplace_back(i);
+    }
+  }
+  std::sort(front.begin(), front.end(), [&](const size_t a, const size_t b) {
+    return results[a].seconds < results[b].seconds;
+  });
+  return front;
+}
+
+// member key of value as number, NaN if missing.
+double Number(const JsonValue &value, const std::string &key) {
+  const JsonValue *member = value.find(key);
+  return member != nullptr ? member->asNumber(NAN) : NAN;
+}
+
+// what the regression gate compares: throughput, peak RSS, peak memory per
+// subsystem and the p99 of every stage that ran.
+std::vector<std::pair<std::string, double>> GateMetrics(const JsonValue &run) {
+  std::vector<std::pair<std::string, double>> metrics;
+  metrics.emplace_back("frames_per_s", Number(run, "frames_per_s"));
+  metrics.emplace_back("peak_rss_kb", Number(run, "peak_rss_kb"));
+  if (const JsonValue *memory = run.find("memory_peak_mb")) {
+    for (const std::pair<std::string, JsonValue> &tag : memory->object) {
+      metrics.emplace_back("memory_peak_mb." + tag.first,
+                           tag.second.asNumber(NAN));
+    }
+  }
+  if (const JsonValue *stages = run.find("stages_ms")) {
+    for (const std::pair<std::string, JsonValue> &stage : stages->object) {
+      if (Number(stage.second, "count") > 0) {
+        metrics.emplace_back("p99_ms." + stage.first,
+                             Number(stage.second, "p99"));
+      }
+    }
+  }
+  return metrics;
+}
+
+// whether a larger value of the gate metric is better.
+bool HigherIsBetter(const std::string &metric) {
+  return metric == "frames_per_s";
+}
+
+/** Quantile of Student's t distribution with df degrees of freedom, 0.975
+ *  for two sided 95% intervals or 0.95 for one sided tests. Rounded down to
+ *  the next tabulated df, i.e. slightly conservative.
+ */
+double StudentT(const double df, const bool twoSided) {
+  static const double kDf[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 15, 20, 30};
+  static const double kTwoSided[] = {12.706, 4.303, 3.182, 2.776, 2.571,
+                                     2.447,  2.365, 2.306, 2.262, 2.228,
+                                     2.179,  2.131, 2.086, 2.042};
+  static const double kOneSided[] = {6.314, 2.920, 2.353, 2.132, 2.015,
+                                     1.943, 1.895, 1.860, 1.833, 1.812,
+                                     1.782, 1.753, 1.725, 1.697};
+  if (df >= 120) {
+    return twoSided ? 1.960 : 1.645;
+  }
+  int i = 0;
+  while (i + 1 < 14 && kDf[i + 1] <= df) {
+    ++i;
+  }
+  return twoSided ? kTwoSided[i] : kOneSided[i];
+}
+
+//! Mean, sample variance and 95% interval half width of repeated values.
+struct Statistics {
+  int n;
+  double mean;
+  double variance;
+  double ci95;
+};
+
+Statistics Summarize(const std::vector<double> &values) {
+  Statistics stats;
+  stats.n = values.size();
+  stats.mean = stats.variance = stats.ci95 = 0;
+  for (const double v : values) {
+    stats.mean += v / stats.n;
+  }
+  if (stats.n > 1) {
+    for (const double v : values) {
+      stats.variance += (v - stats.mean) * (v - stats.mean) / (stats.n - 1);
+    }
+    stats.ci95 =
+        StudentT(stats.n - 1, true) * std::sqrt(stats.variance / stats.n);
+  }
+  return stats;
+}
+
+/** Whether current is worse than baseline by more than tolerance (relative)
+ *  with 95% confidence: one sided Welch t-test of current against baseline
+ *  moved by the tolerance. With fewer than two values on a side there is no
+ *  test, then any change beyond the tolerance counts. t is the statistic.
+ */
+bool Regressed(const Statistics &baseline, const Statistics &current,
+               const bool higherIsBetter, const double tolerance, double *t) {
+  const double excess =
+      higherIsBetter ? baseline.mean * (1 - tolerance) - current.mean
+                     : current.mean - baseline.mean * (1 + tolerance);
+  const double a = baseline.n > 1 ? baseline.variance / baseline.n : 0;
+  const double b = current.n > 1 ? current.variance / current.n : 0;
+  const double se = std::sqrt(a + b);
+  if (baseline.n < 2 || current.n < 2 || !(se > 0)) {
+    *t = NAN;
+    return excess > 0;
+  }
+  *t = excess / se;
+  const double df = (a + b) * (a + b) /
+                    (a * a / (baseline.n - 1) + b * b / (current.n - 1));
+  return *t > StudentT(df, false);
+}
+
+std::string Quote(const std::string &text) {
+  std::string quoted = "\"";
+  for (const char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+void Append(std::string *json, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void Append(std::string *json, const char *format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  *json += buffer;
+}
+
+// FNV-1a of the file, equal for bit identical trajectories.
+uint64_t HashFile(const std::string &path) {
+  uint64_t hash = 14695981039346656037ull;
+  std::ifstream file(path.c_str(), std::ios::binary);
+  char c;
+  while (file.get(c)) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+FullSystem *NewFullSystem(DatasetReader *reader, const CalibContext &calib,
+                          const Settings &settings) {
+  FullSystem *full_system = new FullSystem(calib, settings);
+  full_system->setGammaFunction(reader->GetPhotometricGamma());
+  full_system->linearizeOperation = true;
+  return full_system;
+}
+
+std::string ParamsJson(const SweepPoint &point) {
+  std::string json = "{";
+  for (size_t i = 0; i < point.size(); ++i) {
+    Append(&json, "%s%s: %.9g", i == 0 ? "" : ", ",
+           Quote(point[i].first).c_str(), point[i].second);
+  }
+  return json + "}";
+}
+
+/** Run the dataset once with the preset, threads and repeat of job and the
+ *  tuning settings of point, in a fresh process as the process settings
+ *  (threads, stage timing) are global.
+ *  Returns the JSON object of the run. suffix names its trajectory.
+ */
+std::string Run(InputParam param, const Job &job, const SweepPoint &point,
+                const std::string &suffix) {
+  const int preset = job.preset;
+  const int threads = job.threads;
+  param.preset = preset;
+  param.num_threads = threads;
+  param.no_gui = true;
+  param.stage_timing = true;
+  param.stage_timing_interval = 0;
+  Settings settings;
+  InputParser::Config(&param, &settings);
+  for (const std::pair<std::string, double> &setting : point) {
+    CHECK(setTuningSetting(&settings, setting.first, setting.second));
+  }
+
+  DatasetReader *reader;
+  if (param.path_2_timestamps != "") {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette,
+                               param.path_2_timestamps);
+  } else {
+    reader = new DatasetReader(param.path_2_images, param.path_2_calibration,
+                               param.path_2_gamma, param.path_2_vignette);
+  }
+  const CalibContext calib = reader->GetCalibContext(param.pyr_levels);
+
+  std::vector<int> ids_to_play;
+  for (int i = std::max(param.start_id, 0);
+       i < static_cast<int>(reader->GetNumImages()) && i < param.end_id; ++i) {
+    ids_to_play.emplace_back(i);
+  }
+
+  // preloading is not timed.
+  std::vector<ImageAndExposure *> preloaded_images;
+  if (param.preload && !ids_to_play.empty()) {
+    reader->StartPrefetch(ids_to_play, param.prefetch_threads,
+                          ids_to_play.size());
+    for (size_t ii = 0; ii < ids_to_play.size(); ++ii) {
+      preloaded_images.emplace_back(reader->Next());
+    }
+    reader->StopPrefetch();
+  }
+  ImageAndExposure *reused_img = nullptr;
+  if (!param.preload && !reader->IsZeroCopy()) {
+    const Eigen::Vector2i size = reader->GetSize();
+    reused_img = new ImageAndExposure(size[0], size[1]);
+  }
+
+  FullSystem *full_system = NewFullSystem(reader, calib, settings);
+  int frames = 0;
+  int resets = 0;
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int ii = 0; ii < static_cast<int>(ids_to_play.size()); ++ii) {
+    const int i = ids_to_play[ii];
+    ImageAndExposure *img;
+    if (param.preload) {
+      img = preloaded_images[ii];
+    } else if (reader->IsZeroCopy()) {
+      img = reader->GetImage(i);
+    } else {
+      reader->GetImageInto(i, reused_img);
+      img = reused_img;
+    }
+
+    full_system->addActiveFrame(img, i);
+    ++frames;
+
+    if (img != reused_img) {
+      delete img;
+    }
+
+    if ((full_system->initFailed || setting_fullResetRequested) &&
+        (ii < 250 || setting_fullResetRequested)) {
+      delete full_system;
+      full_system = NewFullSystem(reader, calib, settings);
+      setting_fullResetRequested = false;
+      ++resets;
+    }
+
+    if (full_system->isLost) {
+      break;
+    }
+  }
+  full_system->blockUntilMappingIsFinished();
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  delete reused_img;
+
+  const std::string trajectory = param.path_2_replay_report + "." +
+                                 std::to_string(preset) + "_" +
+                                 std::to_string(threads) + suffix + ".txt";
+  full_system->printResult(trajectory);
+  const int keyframes = full_system->getNumKeyframes();
+  const bool lost = full_system->isLost;
+
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::string json;
+  Append(&json,
+         "{\"preset\": %d, \"threads\": %d, \"repeat\": %d, \"ok\": true, "
+         "\"frames\": %d, "
+         "\"keyframes\": %d, \"resets\": %d, \"lost\": %s, \"seconds\": %.3f, "
+         "\"frames_per_s\": %.3f, \"keyframes_per_s\": %.3f, "
+         "\"peak_rss_kb\": %ld, \"trajectory\": %s, "
+         "\"trajectory_hash\": \"%016llx\", ",
+         preset, threads, job.repeat, frames, keyframes, resets,
+         lost ? "true" : "false",
+         seconds, seconds > 0 ? frames / seconds : 0.,
+         seconds > 0 ? keyframes / seconds : 0., usage.ru_maxrss,
+         Quote(trajectory).c_str(),
+         static_cast<unsigned long long>(HashFile(trajectory)));
+
+  if (!point.empty()) {
+    json += "\"params\": " + ParamsJson(point) + ", ";
+  }
+
+  std::vector<StampedPosition> estimate, groundtruth;
+  TrajectoryError error;
+  if (!param.path_2_groundtruth.empty() &&
+      TrajectoryError::Load(param.path_2_groundtruth, &groundtruth) &&
+      TrajectoryError::Load(trajectory, &estimate) &&
+      TrajectoryError::Compute(estimate, groundtruth, kMaxMatchDt, &error)) {
+    Append(&json,
+           "\"ate\": {\"matched\": %d, \"rmse\": %.6f, \"mean\": %.6f, "
+           "\"median\": %.6f, \"max\": %.6f, \"scale\": %.6f},\n",
+           error.numMatched, error.rmse, error.mean, error.median, error.max,
+           error.scale);
+  } else {
+    json += "\"ate\": null,\n";
+  }
+
+  json += "     \"memory_peak_mb\": {";
+  for (int t = 0; t < NUM_MEMORY_TAGS; ++t) {
+    const MemoryTag tag = static_cast<MemoryTag>(t);
+    Append(&json, "%s\"%s\": %.3f", t == 0 ? "" : ", ", MemoryStats::name(tag),
+           MemoryStats::peak(tag) / (1024. * 1024.));
+  }
+  json += "},\n";
+
+  json += "     \"stages_ms\": {";
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    const TimingStage stage = static_cast<TimingStage>(s);
+    const LatencyHistogram h = StageTiming::getHistogram(stage);
+    Append(&json,
+           "%s\n       \"%s\": {\"count\": %llu, \"mean\": %.4f, "
+           "\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}",
+           s == 0 ? "" : ",", StageTiming::name(stage),
+           static_cast<unsigned long long>(h.count),
+           h.count > 0 ? h.sum * 1e-6 / h.count : 0., h.percentile(0.5) * 1e-6,
+           h.percentile(0.95) * 1e-6, h.percentile(0.99) * 1e-6, h.max * 1e-6);
+  }
+  json += "}}";
+
+  delete full_system;
+  delete reader;
+  return json;
+}
+
+//! A child process running a Job, its result read through fd.
+struct Child {
+  pid_t pid;
+  int fd;
+};
+
+// Run() in a child process, which writes the JSON object to the pipe.
+Child StartChild(const InputParam &param, const Job &job,
+                 const SweepPoint &point, const std::string &suffix) {
+  int fds[2];
+  CHECK_EQ(pipe(fds), 0) << strerror(errno);
+  const pid_t pid = fork();
+  CHECK_GE(pid, 0) << strerror(errno);
+  if (pid == 0) {
+    close(fds[0]);
+    const std::string data = Run(param, job, point, suffix);
+    size_t written = 0;
+    while (written < data.size()) {
+      const ssize_t n =
+          write(fds[1], data.data() + written, data.size() - written);
+      if (n <= 0) {
+        _exit(1);
+      }
+      written += n;
+    }
+    close(fds[1]);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  Child child;
+  child.pid = pid;
+  child.fd = fds[0];
+  return child;
+}
+
+RunResult FinishChild(const Child &child, const Job &job) {
+  std::string data;
+  char buffer[4096];
+  ssize_t n;
+  while ((n = read(child.fd, buffer, sizeof(buffer))) > 0) {
+    data.append(buffer, n);
+  }
+  close(child.fd);
+  int status = 0;
+  waitpid(child.pid, &status, 0);
+
+  RunResult result;
+  result.seconds = result.rmse = NAN;
+  JsonValue run;
+  std::string error;
+  if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+      JsonValue::Parse(data, &run, &error)) {
+    result.json = data;
+    result.seconds = run.find("seconds")->asNumber(NAN);
+    const JsonValue *ate = run.find("ate");
+    if (ate->type == JsonValue::OBJECT) {
+      result.rmse = ate->find("rmse")->asNumber(NAN);
+    }
+    result.metrics = GateMetrics(run);
+    return result;
+  }
+  LOG(ERROR) << "run with preset " << job.preset << " and " << job.threads
+             << " threads failed";
+  Append(&result.json,
+         "{\"preset\": %d, \"threads\": %d, \"repeat\": %d, \"ok\": false}",
+         job.preset, job.threads, job.repeat);
+  return result;
+}
+
+/** Compare the summary of this report (keys and metrics per configuration)
+ *  against the one of the report String.ReplayBaseline and append the
+ *  "gate" object to report. Returns the number of regressions (Regressed()),
+ *  each logged with baseline and current mean.
+ */
+int Gate(const InputParam &param, const std::vector<std::string> &keys,
+         const std::vector<std::map<std::string, std::vector<double>>> &metrics,
+         std::string *report) {
+  const std::string &path = param.path_2_replay_baseline;
+  const double tolerance = param.regression_tolerance;
+  std::ifstream file(path.c_str());
+  std::stringstream text;
+  text << file.rdbuf();
+  JsonValue baseline;
+  std::string error;
+  LOG_IF(FATAL, !file || !JsonValue::Parse(text.str(), &baseline, &error))
+      << "could not read the baseline report " << path << " " << error;
+  const JsonValue *summary = baseline.find("summary");
+  LOG_IF(FATAL, summary == nullptr || summary->type != JsonValue::ARRAY)
+      << "the baseline report " << path << " has no summary";
+  std::map<std::string, const JsonValue *> baselineMetrics;
+  for (const JsonValue &entry : summary->array) {
+    const JsonValue *key = entry.find("key");
+    const JsonValue *values = entry.find("metrics");
+    if (key != nullptr && values != nullptr) {
+      baselineMetrics[key->string] = values;
+    }
+  }
+
+  *report += ",\n  \"gate\": {\"baseline\": " + Quote(path);
+  Append(report, ", \"tolerance\": %.4f, \"regressions\": [", tolerance);
+  int compared = 0;
+  int regressions = 0;
+  bool tested = true;
+  for (size_t g = 0; g < keys.size(); ++g) {
+    const std::map<std::string, const JsonValue *>::const_iterator base =
+        baselineMetrics.find(keys[g]);
+    if (base == baselineMetrics.end()) {
+      LOG(WARNING) << "gate: the baseline has no " << keys[g];
+      continue;
+    }
+    for (const std::pair<const std::string, std::vector<double>> &metric :
+         metrics[g]) {
+      const JsonValue *entry = base->second->find(metric.first);
+      const JsonValue *values = entry != nullptr ? entry->find("values")
+                                                 : nullptr;
+      if (values == nullptr) {
+        continue;
+      }
+      std::vector<double> baseValues;
+      for (const JsonValue &value : values->array) {
+        baseValues.emplace_back(value.asNumber(NAN));
+      }
+      const Statistics before = Summarize(baseValues);
+      const Statistics after = Summarize(metric.second);
+      if (!(before.mean > 0) || !std::isfinite(after.mean)) {
+        continue;
+      }
+      ++compared;
+      tested = tested && before.n > 1 && after.n > 1;
+      double t;
+      if (!Regressed(before, after, HigherIsBetter(metric.first), tolerance,
+                     &t)) {
+        continue;
+      }
+
+      const double change = after.mean / before.mean - 1;
+      char line[256];
+      snprintf(line, sizeof(line),
+               "%s: %.4g +- %.2g -> %.4g +- %.2g (%+.1f%%, tolerance %.1f%%, "
+               "t %.2f)",
+               metric.first.c_str(), before.mean, before.ci95, after.mean,
+               after.ci95, 100 * change, 100 * tolerance, t);
+      LOG(ERROR) << "REGRESSION " << keys[g] << " " << line;
+      *report += regressions == 0 ? "\n    " : ",\n    ";
+      *report += "{\"key\": " + Quote(keys[g]) +
+                 ", \"metric\": " + Quote(metric.first);
+      Append(report,
+             ", \"baseline\": %.6g, \"current\": %.6g, \"change\": %.4f, "
+             "\"t\": ",
+             before.mean, after.mean, change);
+      if (std::isfinite(t)) {
+        Append(report, "%.3f}", t);
+      } else {
+        *report += "null}";
+      }
+      ++regressions;
+    }
+  }
+  Append(report, "%s], \"compared\": %d}", regressions == 0 ? "" : "\n  ",
+         compared);
+
+  LOG_IF(WARNING, !tested)
+      << "gate: single runs, changes beyond the tolerance count without a "
+         "significance test. Set Int.ReplayRepeats (here and in the baseline).";
+  LOG(INFO) << "gate: " << regressions << " of " << compared
+            << " metrics regressed by more than " << 100 * tolerance << "%";
+  return regressions;
+}
+
+}  // namespace
+
+/** Replay the dataset of a configuration without GUI, in linearizeOperation
+ *  mode and with the seed Int.RandomSeed, once per preset of
+ *  String.ReplayPresets, thread count of String.ReplayThreads and point of the
+ *  String.SweepParams sweep. Throughput, stage latencies, peak RSS and the
+ *  error against String.Groundtruth of every run are written as JSON to
+ *  String.ReplayReport (or the second argument), in a fixed order: reports of
+ *  two builds on the same input can be diffed. With a ground truth, the runs
+ *  on the time / error Pareto front are listed too. Up to Int.SweepJobs runs
+ *  run at once.
+ *
+ *  Every configuration is run Int.ReplayRepeats times; the summary lists the
+ *  throughput, p99 stage latencies and peak memory of the repeats. Given a
+ *  baseline report String.ReplayBaseline, the exit code is 1 if one of them
+ *  got worse than Double.RegressionTolerance (relative) with significance.
+ */
+int main(int argc, char **argv) {
+  LOG_IF(FATAL, argc < 2)
+      << "Usage: ./dso_replay_bench path_to_configuration [report.json]";
+
+  InputParam param = InputParser::Read(argv[1]);
+  if (argc > 2) {
+    param.path_2_replay_report = argv[2];
+  }
+  const std::vector<int> presets = ParseList(param.replay_presets, param.preset);
+  const std::vector<int> threads =
+      ParseList(param.replay_threads, param.num_threads);
+  const std::vector<SweepPoint> points =
+      SweepPoints(ParseSweep(param.sweep_params), param.sweep_samples,
+                  param.random_seed);
+
+  std::string report = "{\n  \"config\": " + Quote(argv[1]) +
+                       ",\n  \"images\": " + Quote(param.path_2_images) +
+                       ",\n  \"groundtruth\": " +
+                       Quote(param.path_2_groundtruth) + ",\n";
+  Append(&report,
+         "  \"start_id\": %d,\n  \"end_id\": %d,\n  \"random_seed\": %d,\n"
+         "  \"runs\": [",
+         param.start_id, param.end_id, param.random_seed);
+  // the repeats of a configuration are next to each other.
+  const int repeats = std::max(param.replay_repeats, 1);
+  std::vector<Job> jobs;
+  for (const int preset : presets) {
+    for (const int n : threads) {
+      for (size_t p = 0; p < points.size(); ++p) {
+        for (int r = 0; r < repeats; ++r) {
+          jobs.push_back({preset, n, p, r});
+        }
+      }
+    }
+  }
+
+  // up to Int.SweepJobs children at once, finished in the order started.
+  std::vector<RunResult> results(jobs.size());
+  const size_t maxRunning = std::max(param.sweep_jobs, 1);
+  std::deque<std::pair<size_t, Child>> running;
+  for (size_t j = 0; j <= jobs.size(); ++j) {
+    while (!running.empty() &&
+           (j == jobs.size() || running.size() >= maxRunning)) {
+      const size_t done = running.front().first;
+      results[done] = FinishChild(running.front().second, jobs[done]);
+      running.pop_front();
+    }
+    if (j < jobs.size()) {
+      std::string suffix;
+      if (!points[jobs[j].point].empty()) {
+        suffix += "_" + std::to_string(jobs[j].point);
+      }
+      if (repeats > 1) {
+        suffix += "_r" + std::to_string(jobs[j].repeat);
+      }
+      running.emplace_back(
+          j, StartChild(param, jobs[j], points[jobs[j].point], suffix));
+    }
+  }
+
+  for (size_t j = 0; j < results.size(); ++j) {
+    report += j == 0 ? "\n    " : ",\n    ";
+    report += results[j].json;
+  }
+  report += "\n  ],\n  \"summary\": [";
+
+  // per configuration: the gate metrics over its repeats, and the mean
+  // seconds / ATE for the Pareto front.
+  const size_t numGroups = jobs.size() / repeats;
+  std::vector<RunResult> groups(numGroups);
+  std::vector<std::string> keys(numGroups);
+  std::vector<std::map<std::string, std::vector<double>>> groupMetrics(
+      numGroups);
+  for (size_t g = 0; g < numGroups; ++g) {
+    const Job &job = jobs[g * repeats];
+    Append(&keys[g], "preset %d threads %d", job.preset, job.threads);
+    if (!points[job.point].empty()) {
+      keys[g] += " params " + ParamsJson(points[job.point]);
+    }
+    groups[g].seconds = groups[g].rmse = 0;
+    for (int r = 0; r < repeats; ++r) {
+      const RunResult &result = results[g * repeats + r];
+      groups[g].seconds += result.seconds / repeats;
+      groups[g].rmse += result.rmse / repeats;
+      for (const std::pair<std::string, double> &metric : result.metrics) {
+        if (std::isfinite(metric.second)) {
+          groupMetrics[g][metric.first].emplace_back(metric.second);
+        }
+      }
+    }
+
+    report += g == 0 ? "\n    {\"key\": " : ",\n    {\"key\": ";
+    report += Quote(keys[g]) + ", \"metrics\": {";
+    bool firstMetric = true;
+    for (const std::pair<const std::string, std::vector<double>> &metric :
+         groupMetrics[g]) {
+      const Statistics stats = Summarize(metric.second);
+      Append(&report, "%s\n       %s: {\"mean\": %.6g, \"ci95\": %.6g, "
+             "\"values\": [", firstMetric ? "" : ",",
+             Quote(metric.first).c_str(), stats.mean, stats.ci95);
+      for (size_t i = 0; i < metric.second.size(); ++i) {
+        Append(&report, "%s%.6g", i == 0 ? "" : ", ", metric.second[i]);
+      }
+      report += "]}";
+      firstMetric = false;
+    }
+    report += "}}";
+  }
+  report += numGroups == 0 ? "],\n  \"pareto\": [" : "\n  ],\n  \"pareto\": [";
+
+  const std::vector<size_t> front = ParetoFront(groups);
+  for (size_t i = 0; i < front.size(); ++i) {
+    const size_t first = front[i] * repeats;
+    Append(&report,
+           "%s\n    {\"run\": %zu, \"preset\": %d, \"threads\": %d, "
+           "\"seconds\": %.3f, \"ate_rmse\": %.6f, \"params\": ",
+           i == 0 ? "" : ",", first, jobs[first].preset, jobs[first].threads,
+           groups[front[i]].seconds, groups[front[i]].rmse);
+    report += ParamsJson(points[jobs[first].point]) + "}";
+    LOG(INFO) << "pareto: " << keys[front[i]] << ", "
+              << groups[front[i]].seconds << " s, ATE "
+              << groups[front[i]].rmse;
+  }
+  report += front.empty() ? "]" : "\n  ]";
+
+  int numRegressions = 0;
+  if (!param.path_2_replay_baseline.empty()) {
+    numRegressions = Gate(param, keys, groupMetrics, &report);
+  }
+  report += "\n}\n";
+
+  FILE *file = fopen(param.path_2_replay_report.c_str(), "w");
+  CHECK(file != nullptr) << "could not write " << param.path_2_replay_report;
+  fputs(report.c_str(), file);
+  fclose(file);
+  printf("%s", report.c_str());
+  return numRegressions > 0 ? 1 : 0;
+}
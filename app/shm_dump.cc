@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "io_wrapper/output_wrapper/shm_output_wrapper.h"
+
+using namespace dso;
+using IOWrap::ShmOutputWrapper;
+using IOWrap::ShmRing;
+
+/** Follow the ring of a running dso_new with String.ShmOutput set and print
+ *  one line per message. Poses are read in place, without copying them.
+ */
+int main(int argc, char **argv) {
+  LOG_IF(FATAL, argc < 2) << "Usage: ./dso_shm_dump /dso_output";
+  ShmRing ring(argv[1]);
+  if (!ring.valid()) {
+    return 1;
+  }
+
+  uint64_t next = ring.getHead();
+  uint64_t numLost = 0;
+  while (true) {
+    ShmRing::View view;
+    const ShmRing::ReadResult result = ring.beginRead(next, &view);
+    if (result == ShmRing::RING_EMPTY) {
+      usleep(1000);
+      continue;
+    }
+    if (result == ShmRing::RING_LAPPED) {
+      // fell behind by more than the ring, continue with the newest message.
+      const uint64_t head = ring.getHead();
+      numLost += head - 1 - next;
+      next = head - 1;
+      printf("lost %llu messages\n", static_cast<unsigned long long>(numLost));
+      continue;
+    }
+
+    char line[256];
+    line[0] = '\0';
+    if (view.type == ShmOutputWrapper::MSG_POINTS) {
+      const ShmOutputWrapper::PointsHeader *points =
+          reinterpret_cast<const ShmOutputWrapper::PointsHeader *>(view.data);
+      snprintf(line, sizeof(line), "points kf %d: %u - %u of %u\n",
+               points->incomingId, points->first,
+               points->first + points->num, points->total);
+    } else if (view.size >= sizeof(ShmOutputWrapper::Pose)) {
+      const ShmOutputWrapper::Pose *poses =
+          reinterpret_cast<const ShmOutputWrapper::Pose *>(view.data);
+      const size_t num = view.size / sizeof(ShmOutputWrapper::Pose);
+      const ShmOutputWrapper::Pose &last = poses[num - 1];
+      snprintf(line, sizeof(line), "%s %zu, last %d (%.15g): %g %g %g%s\n",
+               view.type == ShmOutputWrapper::MSG_CAM_POSE ? "pose"
+                                                           : "keyframes",
+               num, last.incomingId, last.timestamp, last.camToWorld[4],
+               last.camToWorld[5], last.camToWorld[6],
+               last.final ? " final" : "");
+    }
+    // only print what the writer did not overwrite meanwhile.
+    if (ring.endRead(view)) {
+      fputs(line, stdout);
+      fflush(stdout);
+      ++next;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+namespace dso {
+
+class FrameHessian;
+class FullSystem;
+class ImageAndExposure;
+
+/** \brief Non-blocking frame input for live cameras
+ *
+ *  push() never waits for DSO: it only puts the frame into a bounded queue
+ *  (under a mutex held for a few pointer operations), from which a dedicated
+ *  tracking thread feeds FullSystem::addActiveFrame. Mapping stays on the
+ *  FullSystem mapping thread as before, so the tracking thread may block on it
+ *  (e.g. before the first keyframe is mapped) while push() keeps returning
+ *  immediately. If the queue is full, the oldest queued or the pushed frame is
+ *  dropped, depending on the DropPolicy.
+ *
+ *  Every pushed frame gets exactly one call of its callback: on the tracking
+ *  thread once tracked, skipped or lost, on the pushing thread if dropped by
+ *  push().
+ *
+ *  With preprocessAhead, a second thread makes the pyramid of the next frame
+ *  (FullSystem::preprocessFrame) while the tracking thread tracks the current
+ *  one (FullSystem::addPreprocessedFrame), so a frame takes about as long as
+ *  before but the larger of the two stages limits the frame rate, not their
+ *  sum. It runs one frame ahead of the tracking thread at most.
+ */
+class FrameIngestor {
+ public:
+  enum DropPolicy {
+    DROP_OLDEST = 0,  //!< make room by dropping the longest queued frame
+    DROP_NEWEST       //!< drop the frame being pushed
+  };
+
+  enum FrameStatus {
+    FRAME_TRACKED = 0,  //!< passed to addActiveFrame
+    FRAME_SKIPPED,      //!< skipped by addActiveFrame (deadline mode)
+    FRAME_LOST,         //!< not tracked, the system is lost
+    FRAME_DROPPED       //!< never passed to DSO (queue full or stopped)
+  };
+
+  typedef std::function<void(int id, FrameStatus status)> Callback;
+
+  /** \brief Start the tracking thread
+   *
+   *  @param[in] system   - fed with the frames, has to outlive this
+   *  @param[in] capacity - maximum number of queued frames, >= 1
+   *  @param[in] policy   - which frame to drop if the queue is full
+   *  @param[in] preprocessAhead - make the pyramids on a thread of their own
+   */
+  FrameIngestor(FullSystem* const system, const int capacity,
+                const DropPolicy policy, const bool preprocessAhead = false);
+
+  //! stop(false).
+  ~FrameIngestor();
+
+  /** \brief Queue image, never blocks
+   *
+   *  @param[in] image - taken over, deleted once processed or dropped
+   *  @param[in] id    - incoming id passed to addActiveFrame
+   *  @param[in] done  - optional, called with the FrameStatus of the frame
+   *  @return false if the pushed frame itself was dropped
+   */
+  bool push(ImageAndExposure* const image, const int id,
+            const Callback& done = Callback());
+
+  /** \brief Stop the tracking thread
+   *
+   *  @param[in] drain - track the queued frames first, else drop them
+   */
+  void stop(const bool drain);
+
+  //! Frames waiting for the tracking thread.
+  int getNumQueued() const { return numQueued; }
+
+  //! Frames dropped by push() or stop().
+  long getNumDropped() const { return numDropped; }
+
+  //! Frames passed to addActiveFrame.
+  long getNumProcessed() const { return numProcessed; }
+
+ private:
+  struct Frame {
+    ImageAndExposure* image;
+    int id;
+    Callback done;
+    FrameHessian* fh;  //!< from preprocessLoop, image is deleted then
+  };
+
+  void trackingLoop();
+  void preprocessLoop();
+
+  //! Wait for the next frame to track, false once there is none.
+  bool nextFrame(boost::unique_lock<boost::mutex>* lock, Frame* frame);
+
+  //! Delete the frame and report it FRAME_DROPPED.
+  void drop(Frame* const frame);
+
+  FullSystem* const system;
+  const int capacity;
+  const DropPolicy policy;
+  const bool preprocessAhead;
+
+  boost::mutex queueMutex;
+  boost::condition_variable queueSignal;
+  boost::condition_variable readySignal;
+  std::deque<Frame> queue;  //!< [queueMutex]
+  //! Preprocessed, for the tracking thread. [queueMutex]
+  std::deque<Frame> ready;
+  bool running, draining;   //!< [queueMutex]
+  bool preprocessing;       //!< preprocessLoop still runs [queueMutex]
+
+  std::atomic<int> numQueued;
+  std::atomic<long> numDropped;
+  std::atomic<long> numProcessed;
+
+  boost::thread trackingThread;
+  boost::thread preprocessThread;
+};
+
+}  // dso
@@ -3,19 +3,32 @@
 #include <glog/logging.h>
 #include <math.h>
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <vector>
 
+#include <boost/lockfree/spsc_queue.hpp>
+
 #include "full_system/hessian_blocks/hessian_blocks.h"
+#include "full_system/immature_point.h"
+#include "full_system/latency_controller.h"
 #include "full_system/pixel_selector2.h"
+#include "full_system/reloc_index.h"
 #include "full_system/residuals.h"
+#include "full_system/window_points.h"
 #include "optimization_backend/energy_functional/energy_functional.h"
+#include "util/frame_history.h"
 #include "util/frame_shell.h"
-#include "util/global_calib.h"
+#include "util/calib_context.h"
 #include "util/index_thread_reduce.h"
+#include "util/log_sink.h"
 #include "util/num_type.h"
+#include "util/pose_predictor.h"
+#include "util/wall_timer.h"
 
 #define MAX_ACTIVE_FRAMES 100
 
@@ -27,14 +40,15 @@ class Output3DWrapper;
 class PixelSelector;
 class PCSyntheticPoint;
 class CoarseTracker;
+struct CoarseTrackerLevelResult;
 class FrameHessian;
+class FramePyramidCuda;
 class PointHessian;
 class CoarseInitializer;
 class ImageAndExposure;
 class CoarseDistanceMap;
 class EnergyFunctional;
 
-struct ImmaturePointTemporaryResidual;
 
 template <typename T>
 inline void deleteOut(std::vector<T*>& v, const int i) {
@@ -51,9 +65,20 @@ inline void deleteOutPt(std::vector<T*>& v, const T* i) {
     if (v[k] == i) {
       v[k] = v.back();
       v.pop_back();
+      break;
     }
 }
 
+/** \brief Remove all null entries (tombstones) of v in one pass
+ *
+ *  The remaining elements keep their order. Loops that drop many elements set
+ *  them to null and compact once, instead of shifting or swapping per removal.
+ */
+template <typename T>
+inline void compactOutNull(std::vector<T*>& v) {
+  v.erase(std::remove(v.begin(), v.end(), nullptr), v.end());
+}
+
 template <typename T>
 inline void deleteOutOrder(std::vector<T*>& v, const int i) {
   delete v[i];
@@ -97,12 +122,47 @@ inline bool eigenTestNan(const MatXX& m, const std::string& msg) {
   return foundNan;
 }
 
+/** \brief Progress and cost of one Gauss-Newton iteration of optimize() */
+struct OptIterationStats {
+  int iteration;
+  double energy;        //!< total energy after the step
+  double stepNorm;      //!< norm of the solved increment (ef->lastX)
+  bool accepted;        //!< step kept (else the state was restored)
+  double linearizeMs;   //!< trial steps, linearizeAll of the new / old state
+  double accumulateMs;  //!< building H and b in solveSystemF
+  double solveMs;       //!< solving and resubstituting in solveSystemF
+  double applyMs;       //!< backup, doStepFromBackup and applyRes / restore
+  int numLazyResiduals;  //!< of the linearizeAll, kept their Jacobians
+};
+
 class FullSystem {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  FullSystem();
+  /** \brief DSO on the images of calib, tuned by settings
+   *
+   *  @param[in] calib      - size and intrinsics of the undistorted images,
+   *                          has to outlive the FullSystem and its outputs
+   *  @param[in] settings   - copied into FullSystem::settings
+   *  @param[in] reducePool - worker pool for tracking and mapping, e.g. shared
+   *                          by the FullSystems of several cameras, has to
+   *                          outlive the FullSystem. nullptr: one pool each
+   *                          for tracking and mapping of this instance.
+   */
+  FullSystem(const CalibContext& calib, const Settings& settings,
+             IndexThreadReduce<Vec10>* reducePool = nullptr);
   virtual ~FullSystem();
 
+  /** \brief Start over as if newly constructed, without the teardown
+   *
+   *  Drops all frames, points, shells and initialization attempts and resets
+   *  the trackers, the window and the counters. The worker pools, the mapping
+   *  thread, the tracker, selector and energy buffers, the gamma function,
+   *  settings and outputWrapper are kept, the wrappers get reset(). Waits for
+   *  the mapper to finish the frames it was given; call it from the thread
+   *  that calls addActiveFrame.
+   */
+  void reset();
+
   /** \brief Interface to add an image.
    *
    *  This function accepts an image and initialize / track.
@@ -112,6 +172,31 @@ class FullSystem {
    */
   void addActiveFrame(ImageAndExposure* image, int id);
 
+  /** \brief The part of addActiveFrame that only depends on image
+   *
+   *  Makes the pyramid of a new frame, with a shell that has the timestamp and
+   *  id but no place in the frame history yet. Safe to call from another
+   *  thread while frames are tracked, so the next frame can be made while the
+   *  current one is tracked (see FrameIngestor). The pyramid is made on the
+   *  calling thread then, without the tracking pool or the gpu.
+   *
+   *  @param[in] image - only read during the call
+   *  @param[in] id    - image id
+   *  @param[in] ahead - called off the tracking thread
+   */
+  FrameHessian* preprocessFrame(const ImageAndExposure* image, int id,
+                                bool ahead);
+
+  /** \brief addActiveFrame for a frame from preprocessFrame
+   *
+   *  The frames have to come in the order of their images, the shell gets its
+   *  id and the pose dependent state here. Takes fh over.
+   */
+  void addPreprocessedFrame(FrameHessian* fh);
+
+  //! Delete a frame from preprocessFrame that was never added.
+  static void deletePreprocessedFrame(FrameHessian* fh);
+
   /** \brief Marginalize a frame.
    *
    *  Marginalize a frame. Drop / marginalize points & residuals.
@@ -121,20 +206,124 @@ class FullSystem {
   void marginalizeFrame(FrameHessian* frame);
   void blockUntilMappingIsFinished();
 
+  /** \brief Gauss-Newton optimization of the window
+   *
+   *  Runs at most mnumOptIts iterations, and breaks after
+   *  settings.minOptIterations on a small step, on an energy decrease below
+   *  settings.minRelEnergyDecrease or if the next iteration would exceed
+   *  settings.keyframeTimeBudgetMs. The iterations are recorded for
+   *  getLastOptStats().
+   *
+   *  @return RMSE of the active residuals
+   */
   float optimize(int mnumOptIts);
 
   void printResult(std::string file);
 
+  /** \brief Save the active window to path (see full_system/map_snapshot.h)
+   *
+   *  Keyframes with their images and points, the marginalization prior and
+   *  the camera calibration; enough for loadSnapshot to continue tracking
+   *  against it. Written to path.tmp and renamed. Takes mapMutex.
+   */
+  bool saveSnapshot(const std::string& path);
+
+  /** \brief Restore a window written by saveSnapshot into this new system
+   *
+   *  The keyframes are re-inserted in window order with their stored states,
+   *  every active point gets residuals into the other keyframes, and one
+   *  window optimization relinearizes them. Afterwards the system counts as
+   *  initialized and tracks the next frame against the newest keyframe.
+   *
+   *  @return false, with the system untouched, if the file is missing or was
+   *          written for another version or image size
+   */
+  bool loadSnapshot(const std::string& path);
+
+  /** \brief Initialize from a single frame with a depth prior, without
+   *  CoarseInitializer
+   *
+   *  image becomes the first keyframe, at the origin. Its points are the
+   *  pixels the selector picks (settings.desiredPointDensity) that have a
+   *  depth in depth, or within settings.depthInitSearchRadius of it for
+   *  sparse depth; they are active right away with hasDepthPrior, in the
+   *  metric scale of depth. Tracking continues with the next addActiveFrame.
+   *  A known ground plane is passed as its rendered depth.
+   *
+   *  @param[in] depth - depth of every level 0 pixel, row major, <= 0 or
+   *                     not finite where unknown
+   *  @return false, with the frame dropped, if the system is initialized
+   *          already or fewer than settings.depthInitMinPoints points have a
+   *          depth
+   */
+  bool initializeFromDepth(ImageAndExposure* image, int id,
+                           const float* depth);
+
   void debugPlot(std::string name);
 
   void printFrameLifetimes();
 
   void setGammaFunction(float* const BInv);
 
+  //! Number of tracked frames waiting for the mapping thread.
+  int getNumUnmappedFrames() const { return numUnmappedFrames; }
+
+  //! Number of keyframes made so far, read after blockUntilMappingIsFinished().
+  int getNumKeyframes() const { return allKeyFramesHistory.size(); }
+
+  //! Whether mapping is behind and drops non-keyframes to catch up.
+  bool isCatchingUpMapping() const { return needToKetchupMapping; }
+
+  //! Number of frames dropped by the mapping thread to catch up.
+  long getNumCatchUpDroppedFrames() const { return numCatchUpDroppedFrames; }
+
+  //! Number of frames skipped by the tracker for missing their deadline.
+  long getNumDeadlineSkippedFrames() const { return numDeadlineSkippedFrames; }
+
+  /** \brief Camera to world at timestamp, from the last tracked frames
+   *
+   *  Lock free, from any thread, e.g. at a fixed rate between the frames;
+   *  see PosePredictor.
+   *
+   *  @return false before the first tracked frame and once tracking is lost.
+   */
+  bool predictPose(double timestamp, SE3* camToWorld) const {
+    return posePredictor.predictPose(timestamp, camToWorld);
+  }
+
+  /** \brief World positions and depths of the active points of the window
+   *
+   *  Waits for mapMutex, so for the points as of the last finished keyframe.
+   *  Only the keyframes whose points changed since out was filled are
+   *  projected again, on the reduce pool if settings.multiThreading.
+   *
+   *  @return false if nothing changed since out was filled.
+   */
+  bool snapshotWindowPoints(WindowPoints* out);
+
+  //! Per-iteration record of the last optimize(), in iteration order.
+  std::vector<OptIterationStats> getLastOptStats() const {
+    boost::unique_lock<boost::mutex> lock(optStatsMutex);
+    return lastOptStats;
+  }
+
  private:
   /** \brief Prerocess a new coming frame */
   FrameHessian* PreprocessNewFrame(ImageAndExposure* const image, const int id);
 
+  //! Give the shell of fh its id and put it into allFrameHistory.
+  void addToFrameHistory(FrameHessian* fh);
+
+  /** \brief Trim the history and check the deadline of a new frame
+   *
+   *  @return false if the frame is skipped (published as such)
+   */
+  bool startNewFrame(double timestamp, int id, double* budgetMs);
+
+  //! Rest of addActiveFrame, for fh in allFrameHistory; unlocks lock.
+  void trackNewFrame(FrameHessian* fh, double budgetMs,
+                     boost::unique_lock<boost::mutex>* lock);
+
   /** \brief Optimize a single point */
   int optimizePoint(PointHessian* point, int minObs, bool flagOOB);
 
@@ -144,27 +333,173 @@ class FullSystem {
 
   double linAllPointSinle(PointHessian* point, float outlierTHSlack, bool plot);
 
-  Vec4 trackNewCoarse(FrameHessian* fh);
+  /** \brief Track fh against the newest keyframe
+   *
+   *  @param[in] budgetMs - wall time budget, 0 for none. Re-track attempts stop
+   *                        once it is used up and one of them was good, the
+   *                        serial tries get the rest of it.
+   *  @return achieved residual on level 0 and the three flow indicators
+   */
+  Vec4 trackNewCoarse(FrameHessian* fh, const double budgetMs);
+
+  /** \brief Wall time left to track the frame with this timestamp
+   *
+   *  With settings.trackingDeadlineFactor > 0, a frame is due at its timestamp
+   *  (1x real time from the first frame tracked after initialization) and
+   *  has to be tracked settings.trackingDeadlineFactor frame intervals later.
+   *
+   *  @param[out] budgetMs - time left, 0 if there is no deadline
+   *  @return false if the deadline has already passed
+   */
+  bool trackingDeadline(const double timestamp, double* budgetMs);
 
   /**
    * @brief Update points' inverse depths in host frame using frame fh
    */
   void traceNewCoarse(FrameHessian* fh);
+
+  /** \brief Track a batch of tries concurrently on coarseTrackerWorkers
+   *
+   *  Tracks lastF_2_fh_tries[first, *end) with minResForAbort as abort
+   *  threshold, one try per worker. Result k belongs to try first + k.
+   *
+   *  @param[out] end    - one past the last try of the batch
+   *  @param[out] poses  - tracked pose, valid if isGood
+   *  @param[out] affs   - tracked affine brightness, valid if isGood
+   *  @param[out] isGood - return value of trackNewestCoarse
+   *  @param[out] levels - lastLevelResults of trackNewestCoarse
+   */
+  void trackNewCoarseBatch(
+      FrameHessian* fh,
+      const std::vector<SE3, Eigen::aligned_allocator<SE3>>& lastF_2_fh_tries,
+      const AffLight& aff_last_2_l, const VecPyr& minResForAbort,
+      const unsigned int first, unsigned int* end,
+      std::vector<SE3, Eigen::aligned_allocator<SE3>>* poses,
+      std::vector<AffLight>* affs, std::vector<char>* isGood,
+      std::vector<std::vector<CoarseTrackerLevelResult>>* levels);
+
+  /** \brief Host-to-new-frame projection shared by all points of one host */
+  struct TraceHostPrecalc {
+    Mat33f KRKi;
+    Vec3f Kt;
+    Vec2f aff;
+  };
+
+  //! slot of the trace stats after the per ImmaturePointStatus counts.
+  static constexpr int kTraceStatTotal = IPS_UNINITIALIZED + 1;
+
+  /** \brief Trace points [min, max) of a flattened immature point list
+   *
+   *  @param[in]  fh          - new frame to trace on
+   *  @param[in]  points      - immature points of all active frames
+   *  @param[in]  pointHost   - index into hostPrecalc for every point
+   *  @param[in]  hostPrecalc - projection to fh for every active frame
+   *  @param[out] stats       - count per ImmaturePointStatus, and
+   *                            the total at kTraceStatTotal
+   */
+  void traceNewCoarse_Reductor(FrameHessian* fh,
+                               const std::vector<ImmaturePoint*>* points,
+                               const std::vector<int>* pointHost,
+                               const std::vector<TraceHostPrecalc>* hostPrecalc,
+                               int min, int max, Vec10* stats, int tid);
   void activatePoints();
   void activatePointsMT();
 
-  /** \brief Flag points to drop or marginalize. */
+  /** \brief Flag points to drop or marginalize.
+   *
+   *  The decisions (and the relinearization of the points to marginalize) run
+   *  on treadReduce, the points move to pointHessiansOut /
+   *  pointHessiansMarginalized afterwards in their order, independent of the
+   *  threads.
+   */
   void flagPointsForRemoval();
+  //! Decide the points [min, max) of pointFlagHostStart into pointFlags.
+  void flagPointsForRemoval_Reductor(
+      const std::vector<FrameHessian*>* fhsToKeepPoints,
+      const std::vector<FrameHessian*>* fhsToMargPoints, int min, int max,
+      Vec10* stats, int tid);
 
   void makeNewTraces(FrameHessian* newFrame, float* gtDepth);
+  //! newTraces [min, max) of selectedPixels.
+  void makeNewTraces_Reductor(FrameHessian* newFrame, int min, int max,
+                              Vec10* stats, int tid);
   void initializeFromInitializer(FrameHessian* newFrame);
+
+  /** \brief Track fh with all initialization attempts (settings.initAttempts)
+   *
+   *  The attempts run in parallel on treadReduceTracking. If one converges,
+   *  the one anchored longest ago becomes coarseInitializer and the others are
+   *  dropped. Otherwise fh may become the anchor of a new attempt, restarting
+   *  the oldest unsnapped one if all are in use, or is deleted.
+   *
+   *  @return true if coarseInitializer is ready for initializeFromInitializer.
+   */
+  bool trackInitAttempts(FrameHessian* fh);
+
+  /** \brief Relocalize fh on relocIndex while tracking is lost
+   *
+   *  The first lost frame moves the keyframes of the window into relocIndex
+   *  and clears the window. fh is tracked against the most similar entries,
+   *  the first one it tracks on well becomes the first keyframe of a new
+   *  window (initializeFromRelocalization). Gives up (isLost) after
+   *  settings.relocMaxFrames frames.
+   *
+   *  @return true if fh was relocalized and has to be delivered as keyframe,
+   *          otherwise it was deleted.
+   */
+  bool relocalize(FrameHessian* fh);
+  //! A keyframe with the image and pose of entry, its shell is new.
+  FrameHessian* restoreKeyframe(const RelocIndex::Entry& entry);
+  //! initializeFromInitializer with keyframe and the points of entry.
+  void initializeFromRelocalization(FrameHessian* keyframe,
+                                    const RelocIndex::Entry& entry,
+                                    FrameHessian* newFrame,
+                                    const SE3& keyframeToNew,
+                                    const AffLight& aff_g2l);
+  /** \brief Start settings.localizationMode on the keyframes just loaded
+   *
+   *  They stay as they are, with their pyramids, and the last one becomes the
+   *  tracking reference. [trackMutex, mapMutex]
+   */
+  void startLocalization();
+  //! The keyframe to track a frame at camToWorld against in localization
+  //! mode: the current reference unless another one is clearly closer.
+  FrameHessian* selectLocalizationReference(const SE3& camToWorld) const;
+  //! Make kf the reference of coarseTracker, from its points. [trackMutex]
+  void setLocalizationReference(FrameHessian* kf);
+  //! Tracking failed (on either thread): relocalize if possible, else isLost.
+  //! In localization mode always isLost, relocalization would clear the map.
+  void setLost();
+  //! Wait until the mapping thread has no frames left and sleeps.
+  void waitForIdleMapper();
+  //! Delete the keyframes, points and tracking references. [trackMutex,
+  //! mapMutex]
+  void clearWindow();
   void flagFramesForMarginalization(FrameHessian* newFH);
 
   void removeOutliers();
+  /** \brief Drop residuals from ef and from their points, and delete them
+   *
+   *  Clears the lastResiduals referring to them. The residuals of every point
+   *  are compacted once, keeping their order.
+   */
+  void dropResiduals(const std::vector<PointFrameResidual*>& residuals);
 
-  // set precalc values.
+  /** \brief Bring framePrecalc up to date and set the deltas in ef
+   *
+   *  Only pairs whose host, target or calibration state changed since their
+   *  last FrameFramePrecalc::set() are recomputed. If the window changed,
+   *  framePrecalc is laid out for the new frameHessians first, keeping the
+   *  entries of frame pairs that are still in it.
+   */
   void setPrecalcValues();
 
+  //! Restamp pointsVersion of all frames in the window, before publishing it.
+  void touchWindowPoints();
+
+  //! The framePrecalc part of setPrecalcValues, without touching ef.
+  void updateFramePrecalc();
+
   // solve. eventually migrate to ef.
   void solveSystem(const int iteration, const double lambda);
 
@@ -172,6 +507,26 @@ class FullSystem {
   bool doStepFromBackup(float stepfacC, float stepfacT, float stepfacR,
                         float stepfacA, float stepfacD);
 
+  /** \brief Pick the scale for doStepFromBackup among settings.optTrialSteps
+   *  candidates
+   *
+   *  Candidates are stepsize, stepsize / 2, stepsize / 4, ... of the solved
+   *  step. The energies of all of them are evaluated in one (parallel) pass
+   *  over activeResiduals with PointFrameResidual::evalEnergy, each with its
+   *  own copy of framePrecalc in trialPrecalc and of the intrinsics in
+   *  trialCalib. Leaves Hcalib and the frame states at the last candidate,
+   *  doStepFromBackup has to be called afterwards.
+   *
+   *  @return the scale with the lowest energy, stepsize if the mode is off
+   *          (settings.optTrialSteps <= 1) or SOLVER_MOMENTUM is set.
+   */
+  float selectTrialStep(const float stepsize);
+
+  //! Energies of the trial scales of selectTrialStep, stats[k] for scales[k].
+  void trialEnergy_Reductor(const std::vector<float>* const scales,
+                            const int min, const int max, Vec10* const stats,
+                            const int tid);
+
   /** \brief Set linearization point.
    *
    *  Back up the current state (Tcw, a, b, inverse depth of all points etc.)
@@ -183,37 +538,76 @@ class FullSystem {
   /** \brief Set linearization point. */
   void loadSateBackup();
 
+  //! fn over optPoints, on treadReduce if settings.multiThreading.
+  Vec10 forAllOptPoints(
+      const boost::function<void(int, int, Vec10*, int)>& fn);
+  //! backupState of optPoints [min, max).
+  void backupPoints_Reductor(const bool backupLastStep, const int min,
+                             const int max, Vec10* const stats,
+                             const int tid);
+  //! loadSateBackup of optPoints [min, max).
+  void loadPointBackup_Reductor(const int min, const int max,
+                                Vec10* const stats, const int tid);
+  //! doStepFromBackup of optPoints [min, max), stats[0]: sum of
+  //! |idepth_backup|, stats[1]: number of points.
+  void stepPoints_Reductor(const float stepfacD, const int min, const int max,
+                           Vec10* const stats, const int tid);
+
   /** \brief A function always returns 0 for now
    *
-   *  Since the global variable setting_forceAceptStep is true by default, this
+   *  Since settings.forceAceptStep is true by default, this
    *  function always returns 0 for now.
    */
   double calcLEnergy();
 
   /** \brief A function always returns 0 for now
    *
-   *  Since the global variable setting_forceAceptStep is true by default, this
+   *  Since settings.forceAceptStep is true by default, this
    *  function always returns 0 for now.
    */
   double calcMEnergy();
 
   /** \brief
    *
-   *  @param[in] fixLinearization flag to fix linearization
+   *  With numLazy given and settings.lazyRelinThreshold > 0, residuals whose
+   *  host, target and point only took small steps (FrameHessian::step,
+   *  PointHessian::step) keep the Jacobians of their last applyRes(true) and
+   *  only get resF and the energy updated, see canRelinLazily. Only valid
+   *  between the applyRes(true) of all active residuals and the next change
+   *  of the evaluation points, i.e. within the iterations of optimize().
+   *
+   *  With applyRes, every residual is applied (applyRes(true)) right after
+   *  its linearization, in the same pass; as applyRes_Reductor afterwards.
+   *  The energies for setNewFrameEnergyTH are collected in the pass as well.
+   *
+   *  @param[in]  fixLinearization flag to fix linearization
+   *  @param[out] numLazy          number of residuals that kept their
+   *                               Jacobians
+   *  @param[in]  applyRes         apply the residuals in the same pass
    *  @return [0]: sum of all active residuals (Note: [1], [2] not used)
    */
-  Vec3 linearizeAll(const bool fixLinearization);
+  Vec3 linearizeAll(const bool fixLinearization, int* const numLazy = nullptr,
+                    const bool applyRes = false);
+
+  //! Whether r may keep its Jacobians in a lazy linearizeAll, with the step
+  //! norms of the frames in lazyFrameSteps.
+  bool canRelinLazily(const PointFrameResidual* const r) const;
 
   /** TODO
    *
    *  @param[in]  fixLinearization  flag to fix linearization
+   *  @param[in]  lazy              keep the Jacobians if canRelinLazily,
+   *                                counted in stats[1]
+   *  @param[in]  apply             applyRes(true) each residual, as with
+   *                                fixLinearization
    *  @param[in]  min               min id of residual to process, usually 0
    *  @param[in]  max               bound of residual to process, usually size()
-   *  @param[in]  tid               index of toRemove to use
+   *  @param[in]  tid               index of toRemove and allResVec to use
    *  @param[out] toRemove          container to store residual to remove
    *  @param[out] stats
    */
-  void linearizeAll_Reductor(const bool fixLinearization,
+  void linearizeAll_Reductor(const bool fixLinearization, const bool lazy,
+                             const bool apply,
                              std::vector<PointFrameResidual*>* const toRemove,
                              const int min, const int max, Vec10* const stats,
                              const int tid);
@@ -243,20 +637,63 @@ class FullSystem {
                                   std::vector<VecX>& nullspaces_affA,
                                   std::vector<VecX>& nullspaces_affB);
 
-  /** Set new threshold for residual of points in the newest frame. */
+  /** Set new threshold for residual of points in the newest frame, from the
+   *  energies linearizeAll collected in allResVec. */
   void setNewFrameEnergyTH();
 
   void printLogLine();
   void printEvalLine();
+
+  /** \brief Log the eigenvalues of the last window Hessian
+   *
+   *  Only copies ef->lastHS, lastbS and the nullspaces, the decompositions run
+   *  deferred on the logSink thread. Called every
+   *  setting_logEigenValInterval keyframes.
+   */
   void printEigenValLine();
 
+  /** \brief Set the MetricsExporter metrics of the tracker / the mapper
+   *
+   *  Only with setting_metricsPort. The tracking ones from the tracking thread
+   *  after every frame, the mapping ones from the mapping thread after every
+   *  keyframe: each only reads what its thread writes.
+   */
+  void publishTrackingMetrics();
+  void publishMappingMetrics();
+
   // tracking always uses the newest KF as reference.
   void makeKeyFrame(FrameHessian* const fh);
   void makeNonKeyFrame(FrameHessian* const fh);
   void deliverTrackedFrame(FrameHessian* const fh, const bool needKF);
   void mappingLoop();
 
+  /** \brief Wait for the next tracked frame in the mapping thread
+   *
+   *  @return false if mapping was stopped.
+   */
+  bool waitForTrackedFrame(FrameHessian** fh);
+
+  //! Wake up the tracker if it waits for the first mapped keyframe.
+  void signalMappedFrame();
+
+  /** \brief Start making the tracking reference of frameHessians.back()
+   *
+   *  Only splats the points in the calling (mapping) thread, the rest is done
+   *  by referenceLoop while the keyframe is finished.
+   */
+  void startTrackingReference();
+  //! Wait until the reference started last is published.
+  void waitForTrackingReference();
+  //! Hand coarseTracker_forNewKF to the tracker, locks coarseTrackerSwapMutex.
+  void publishTrackingReference();
+  void referenceLoop();
+
  public:
+  const CalibContext& calib;
+
+  //! Tuning of this instance, adjusted by the LatencyController and the GUI.
+  Settings settings;
+
   std::vector<IOWrap::Output3DWrapper*> outputWrapper;
 
   bool isLost;
@@ -267,17 +704,19 @@ class FullSystem {
  private:
   CalibHessian Hcalib;
 
-  std::ofstream* calibLog;
-  std::ofstream* numsLog;
-  std::ofstream* errorsLog;
-  std::ofstream* eigenAllLog;
-  std::ofstream* eigenPLog;
-  std::ofstream* eigenALog;
-  std::ofstream* DiagonalLog;
-  std::ofstream* variancesLog;
-  std::ofstream* nullspacesLog;
-
-  std::ofstream* coarseTrackingLog;
+  // setting_logStuff streams, written to logs/<name>.bin by logSink.
+  enum LogStream {
+    LOG_CALIB = 0,
+    LOG_NUMS,
+    LOG_EIGEN_ALL,
+    LOG_EIGEN_P,
+    LOG_EIGEN_A,
+    LOG_DIAGONAL,
+    LOG_VARIANCES,
+    LOG_NULLSPACES,
+    LOG_COARSE_TRACKING
+  };
+  LogSink* logSink;  //!< nullptr without setting_logStuff
 
   // statistics
   long int statistics_lastNumOptIts;
@@ -290,66 +729,165 @@ class FullSystem {
   long int statistics_numMargResBwd;
   float statistics_lastFineTrackRMSE;
 
+  // started by makeKeyFrame, for settings.keyframeTimeBudgetMs.
+  WallTimer keyframeTimer;
+  // scales the point budgets to settings.latencyBudgetMs.
+  LatencyController latencyController;
+  mutable boost::mutex optStatsMutex;
+  std::vector<OptIterationStats> lastOptStats;
+  // poses of the tracked frames, refined by optimize().
+  PosePredictor posePredictor;
+
   // ========== changed by tracker-thread. protected by trackMutex ==========
   boost::mutex trackMutex;
-  std::vector<FrameShell*> allFrameHistory;
+  // owns the shells. With settings.boundedFrameHistory only those from
+  // shellHorizon on (and the last two) are kept.
+  FrameHistory allFrameHistory;
   CoarseInitializer* coarseInitializer;
-  Vec5 lastCoarseRMSE;
+  // all initializers for settings.initAttempts > 1 (one of them is
+  // coarseInitializer), anchored ones first, oldest anchor first.
+  std::vector<CoarseInitializer*> initAttempts;
+  int framesSinceInitAnchor;
+  VecPyr lastCoarseRMSE;
+  // settings.trackingDeadlineFactor: wall clock started when the frame with
+  // timestamp deadlineAnchorTs (< 0: none yet) was due.
+  WallTimer deadlineClock;
+  double deadlineAnchorTs;
+  double lastInputTimestamp;
+  std::atomic<long> numDeadlineSkippedFrames;
+  // pool for work on the tracking thread, treadReduce belongs to the mapper.
+  // Both are the reducePool of the constructor if one was given.
+  IndexThreadReduce<Vec10>* treadReduceTracking;
+  // helpers tracking against coarseTracker's reference, one per pool worker.
+  std::vector<CoarseTracker*> coarseTrackerWorkers;
+  // makeImages on the device, nullptr unless setting_preprocessGPU and built
+  // with DSO_CUDA.
+  FramePyramidCuda* pyramidGPU;
+  // settings.relocKeyframes: keyframes to relocalize on, else nullptr.
+  RelocIndex* relocIndex;
+  // tracking was lost, frames go to relocalize(). Set by setLost.
+  std::atomic<bool> relocalizing;
+  int numRelocFrames;
+  double relocStartTimestamp;
+  // settings.localizationMode: median depth of the map points, the distance a
+  // rotation of one radian counts as in selectLocalizationReference.
+  float localizationSceneDepth;
 
   // ============ changed by mapper-thread. protected by mapMutex ============
   boost::mutex mapMutex;
-  std::vector<FrameShell*> allKeyFramesHistory;
+  FrameHistory allKeyFramesHistory;
+  // the shells of the keyframes made by restoreKeyframe, owned.
+  std::vector<FrameShell*> relocShells;
+  // settings.boundedFrameHistory: shells below this id are final and no longer
+  // referenced by the mapper, set after every keyframe.
+  std::atomic<int> shellHorizon;
 
   EnergyFunctional* ef;
-  IndexThreadReduce<Vec10> treadReduce;
-
-  float* selectionMap;
+  IndexThreadReduce<Vec10>* treadReduce;
+  //! The pools of this instance, if no reducePool was given.
+  std::unique_ptr<IndexThreadReduce<Vec10>> ownTreadReduce;
+  std::unique_ptr<IndexThreadReduce<Vec10>> ownTreadReduceTracking;
+
+  //! Pixels of the last makeNewTraces and their new points (nullptr if
+  //! invalid), reused across keyframes.
+  std::vector<PixelCandidate> selectedPixels;
+  std::vector<ImmaturePoint*> newTraces;
   PixelSelector* pixelSelector;
   CoarseDistanceMap* coarseDistanceMap;
 
+  //! Temporary residuals of activatePointsMT_Reductor per treadReduce thread,
+  //! grown to frameHessians.size() and reused across points and calls.
+  std::vector<ImmaturePointTemporaryResidual> activationScratch[NUM_THREADS];
+
+  //! Points of flagPointsForRemoval: first index of every frame in the points
+  //! of all frames, and what to do with each of them (PointFlag).
+  std::vector<int> pointFlagHostStart;
+  std::vector<uint8_t> pointFlags;
+
   // ONLY changed in marginalizeFrame and addFrame.
   std::vector<FrameHessian*> frameHessians;
 
+  //! FrameFramePrecalc of all (host, target) pairs of framePrecalcFrames, row
+  //! major by host. FrameHessian::targetPrecalc points to the host rows.
+  std::vector<FrameFramePrecalc, Eigen::aligned_allocator<FrameFramePrecalc>>
+      framePrecalc;
+
+  //! frameHessians at the last layout of framePrecalc.
+  std::vector<FrameHessian*> framePrecalcFrames;
+
+  //! framePrecalc of every candidate of selectTrialStep.
+  std::vector<std::vector<FrameFramePrecalc,
+                          Eigen::aligned_allocator<FrameFramePrecalc>>>
+      trialPrecalc;
+  //! Hcalib of every candidate of selectTrialStep, for evalEnergy.
+  std::vector<std::unique_ptr<CalibHessian>> trialCalib;
+
+  //! [rotation, translation] step norm of every frame (by idx) of a lazy
+  //! linearizeAll.
+  std::vector<Vec2f> lazyFrameSteps;
+
   /** \brief Active residuals for optimization
    *
    *  Residuals of those still not linearized points
    */
   std::vector<PointFrameResidual*> activeResiduals;
 
-  float currentMinActDist;
+  //! The points of the window during optimize(), in frameHessians order.
+  std::vector<PointHessian*> optPoints;
 
-  std::vector<float> allResVec;
+  float currentMinActDist;
 
-  // mutex etc. for tracker exchange.
+  //! Energies of the active residuals into the newest frame, per worker of
+  //! linearizeAll_Reductor.
+  std::vector<float> allResVec[NUM_THREADS];
 
-  // if tracker sees that there is a new reference, tracker locks
-  // [coarseTrackerSwapMutex] and swaps the two.
+  // tracking reference triple buffer. A new reference is made in
+  // coarseTracker_forNewKF (mapping thread, then referenceLoop), swapped with
+  // coarseTracker_ready once done, which the tracker swaps with coarseTracker
+  // if newReferenceReady. [coarseTrackerSwapMutex] is only held for these
+  // pointer swaps, never while a reference is made.
   boost::mutex coarseTrackerSwapMutex;
 
-  // set as as reference. protected by [coarseTrackerSwapMutex].
+  // being made. [mapping thread, referenceLoop while referencePending].
   CoarseTracker* coarseTracker_forNewKF;
 
+  // the newest finished reference. [coarseTrackerSwapMutex]
+  CoarseTracker* coarseTracker_ready;
+  std::atomic<bool> newReferenceReady;
+
   // always used to track new frames. protected by [trackMutex].
   CoarseTracker* coarseTracker;
 
+  boost::thread referenceThread;
+  boost::mutex referenceMutex;
+  boost::condition_variable referenceSignal;
+  bool referencePending;  //!< [referenceMutex] started, not yet published
+  bool runReference;      //!< [referenceMutex]
+
   float minIdJetVisTracker, maxIdJetVisTracker;
   float minIdJetVisDebug, maxIdJetVisDebug;
 
   // mutex for camToWorl's in shells (these are always in a good configuration).
   boost::mutex shellPoseMutex;
 
-  // tracking / mapping synchronization. All protected by [trackMapSyncMutex].
+  // tracking / mapping synchronization. unmappedTrackedFrames is written by
+  // the tracker only and read by the mapper only. [trackMapSyncMutex] is only
+  // taken to sleep on / signal the two conditions.
+  boost::lockfree::spsc_queue<FrameHessian*, boost::lockfree::capacity<64>>
+      unmappedTrackedFrames;
+  std::atomic<int> numUnmappedFrames;
+  std::atomic<bool> mapperSleeping;
   boost::mutex trackMapSyncMutex;
   boost::condition_variable trackedFrameSignal;
   boost::condition_variable mappedFrameSignal;
-  std::deque<FrameHessian*> unmappedTrackedFrames;
 
   // Otherwise, a new KF is *needed that has ID bigger than [needNewKFAfter]*.
-  int needNewKFAfter;
+  std::atomic<int> needNewKFAfter;
 
   boost::thread mappingThread;
-  bool runMapping;
-  bool needToKetchupMapping;
+  std::atomic<bool> runMapping;
+  std::atomic<bool> needToKetchupMapping;
+  std::atomic<long> numCatchUpDroppedFrames;
 
   int lastRefStopID;
   SE3 T_c0w;
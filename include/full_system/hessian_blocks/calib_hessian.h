@@ -1,8 +1,11 @@
 #pragma once
 
-#include "util/global_calib.h"
+#include <atomic>
+
+#include "util/calib_context.h"
 #include "util/num_type.h"
 #include "util/settings.h"
+#include "util/state_version.h"
 
 #define SCALE_F 50.0f  // scale for fx, fy
 #define SCALE_C 50.0f  // scale for cx, cy
@@ -18,13 +21,15 @@ class CalibHessian {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  CalibHessian() {
+  //! Starts at the intrinsics of calib, which has to outlive it.
+  explicit CalibHessian(const CalibContext& calib) : calib(&calib) {
     VecC initial_value = VecC::Zero();
-    initial_value[0] = fxG[0];
-    initial_value[1] = fyG[0];
-    initial_value[2] = cxG[0];
-    initial_value[3] = cyG[0];
+    initial_value[0] = calib.fx[0];
+    initial_value[1] = calib.fy[0];
+    initial_value[2] = calib.cx[0];
+    initial_value[3] = calib.cy[0];
 
+    valueVersion = nextStateVersion();
     setValueScaled(initial_value);
     value_zero = value;
     value_minus_value_zero.setZero();
@@ -49,6 +54,9 @@ class CalibHessian {
   float& cyli() { return value_scaledi[3]; }
 
   void setValue(const VecC& value) {
+    if (value != this->value) {
+      valueVersion = nextStateVersion();
+    }
     // [0-3: Kl, 4-7: Kr, 8-12: l2r]
     this->value = value;
     value_scaled[0] = SCALE_F * value[0];
@@ -62,9 +70,13 @@ class CalibHessian {
     this->value_scaledi[2] = -this->value_scaledf[2] / this->value_scaledf[0];
     this->value_scaledi[3] = -this->value_scaledf[3] / this->value_scaledf[1];
     this->value_minus_value_zero = this->value - this->value_zero;
+    updateK();
   };
 
   void setValueScaled(const VecC& value_scaled) {
+    if (value_scaled != this->value_scaled) {
+      valueVersion = nextStateVersion();
+    }
     this->value_scaled = value_scaled;
     this->value_scaledf = this->value_scaled.cast<float>();
     value[0] = SCALE_F_INVERSE * value_scaled[0];
@@ -77,8 +89,13 @@ class CalibHessian {
     this->value_scaledi[1] = 1.0f / this->value_scaledf[1];
     this->value_scaledi[2] = -this->value_scaledf[2] / this->value_scaledf[0];
     this->value_scaledi[3] = -this->value_scaledf[3] / this->value_scaledf[1];
+    updateK();
   };
 
+  //! Camera matrix of value_scaledf and its inverse, kept with the value.
+  const Mat33f& getK() const { return K; }
+  const Mat33f& getKi() const { return Ki; }
+
   float getBGradOnly(float color) {
     int c = color + 0.5f;
     if (c < 5) {
@@ -100,7 +117,13 @@ class CalibHessian {
   }
 
  public:
-  static int instanceCounter;
+  static std::atomic<int> instanceCounter;
+
+  //! Image size, pyramid and initial intrinsics.
+  const CalibContext* calib;
+
+  //! Stamp (nextStateVersion) of the last change of value.
+  uint64_t valueVersion;
 
   VecC value_zero;
   VecC value_scaled;
@@ -114,6 +137,17 @@ class CalibHessian {
 
   float Binv[256];
   float B[256];
+
+ private:
+  void updateK() {
+    K << value_scaledf[0], 0, value_scaledf[2], 0, value_scaledf[1],
+        value_scaledf[3], 0, 0, 1;
+    Ki << value_scaledi[0], 0, value_scaledi[2], 0, value_scaledi[1],
+        value_scaledi[3], 0, 0, 1;
+  }
+
+  Mat33f K;
+  Mat33f Ki;
 };
 
 }  // namespace dso
\ No newline at end of file
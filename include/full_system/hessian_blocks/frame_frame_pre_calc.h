@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "util/num_type.h"
 
 namespace dso {
@@ -11,17 +13,29 @@ class FrameFramePrecalc {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  FrameFramePrecalc() { host = target = nullptr; }
+  FrameFramePrecalc() {
+    host = target = nullptr;
+    hostVersion = targetVersion = calibVersion = 0;
+  }
   ~FrameFramePrecalc() {}
 
   void set(FrameHessian* host, FrameHessian* target, CalibHessian* HCalib);
 
+  //! Whether set(host, target, HCalib) would not change anything.
+  bool isUpToDate(const FrameHessian* host, const FrameHessian* target,
+                  const CalibHessian* HCalib) const;
+
  public:
   // static values
   static int instanceCounter;
   FrameHessian* host;    // defines row
   FrameHessian* target;  // defines column
 
+  // stateVersion of host / target and valueVersion of HCalib used by set().
+  uint64_t hostVersion;
+  uint64_t targetVersion;
+  uint64_t calibVersion;
+
   // precalc values
   // linearized point: Tth_0 = [Rth_0 tth_0]
   // current point: Tth = [Rth tth]
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
+
 #include <glog/logging.h>
 
+#include "util/calib_context.h"
+#include "util/compact_pixel.h"
+#include "util/memory_stats.h"
 #include "util/minimal_image.h"
 #include "util/num_type.h"
+#include "util/pyramid_buffer_pool.h"
 #include "util/settings.h"
+#include "util/state_version.h"
 
 #define SCALE_A 10.0f
 #define SCALE_A_INVERSE (1.0f / SCALE_A)
@@ -24,17 +31,28 @@ class FrameFramePrecalc;
 class FrameHessian;
 class PointHessian;
 class CalibHessian;
+class FramePyramidCuda;
 
 class EFFrame;
 class FrameShell;
 class ImmaturePoint;
 
+template <typename Running>
+class IndexThreadReduce;
+
 class FrameHessian {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   const SE3& get_worldToCam_evalPT() const { return worldToCam_evalPT; }
 
+  //! Camera of host to this camera at the current states, in float: for the
+  //! projections of tracing and point activation. The backend (precalc,
+  //! linearization) stays with the double PRE_worldToCam / PRE_camToWorld.
+  SE3f hostToThisF(const FrameHessian* host) const {
+    return PRE_worldToCamf * host->PRE_camToWorldf;
+  }
+
   const Vec10& get_state_zero() const { return state_zero; }
 
   const Vec10& get_state() const { return state; }
@@ -59,6 +77,9 @@ class FrameHessian {
   }
 
   void setState(const Vec10& state) {
+    if (state != this->state) {
+      stateVersion = nextStateVersion();
+    }
     this->state = state;
     state_scaled.segment<3>(0) = SCALE_XI_TRANS * state.segment<3>(0);
     state_scaled.segment<3>(3) = SCALE_XI_ROT * state.segment<3>(3);
@@ -69,9 +90,14 @@ class FrameHessian {
 
     PRE_worldToCam = SE3::exp(w2c_leftEps()) * get_worldToCam_evalPT();
     PRE_camToWorld = PRE_worldToCam.inverse();
+    PRE_worldToCamf = PRE_worldToCam.cast<float>();
+    PRE_camToWorldf = PRE_camToWorld.cast<float>();
   }
 
   void setStateScaled(const Vec10& state_scaled) {
+    if (state_scaled != this->state_scaled) {
+      stateVersion = nextStateVersion();
+    }
     this->state_scaled = state_scaled;
     state.segment<3>(0) = SCALE_XI_TRANS_INVERSE * state_scaled.segment<3>(0);
     state.segment<3>(3) = SCALE_XI_ROT_INVERSE * state_scaled.segment<3>(3);
@@ -82,6 +108,8 @@ class FrameHessian {
 
     PRE_worldToCam = SE3::exp(w2c_leftEps()) * get_worldToCam_evalPT();
     PRE_camToWorld = PRE_worldToCam.inverse();
+    PRE_worldToCamf = PRE_worldToCam.cast<float>();
+    PRE_camToWorldf = PRE_camToWorld.cast<float>();
   }
 
   void setEvalPT(const SE3& worldToCam_evalPT, const Vec10& state) {
@@ -103,24 +131,36 @@ class FrameHessian {
     CHECK(efFrame == nullptr);
     release();
     --instanceCounter;
-    for (int i = 0; i < PYR_LEVELS_USED; ++i) {
-      delete[] dIp[i];
-      delete[] absSquaredGrad[i];
-    }
+    PyramidBufferPool::Release(*calib, dIp, absSquaredGrad);
+    delete[] dILevel0;
+    delete[] dICompact;
 
     if (debugImage != nullptr) {
       delete debugImage;
     }
   }
 
-  FrameHessian() {
+  //! A frame of the camera calib, tuned by settings. Both have to outlive it.
+  FrameHessian(const CalibContext& calib, const Settings& settings)
+      : calib(&calib), settings(&settings) {
     ++instanceCounter;
     flaggedForMarginalization = false;
     frameID = -1;
     efFrame = nullptr;
-    frameEnergyTH = 8 * 8 * patternNum;
+    frameEnergyTH = 8 * 8 * staticPatternNum[settings.pattern];
+    dI = nullptr;
+    dILevel0 = nullptr;
+    dICompact = nullptr;
+    for (int i = 0; i < PYR_LEVELS; ++i) {
+      dIp[i] = nullptr;
+      absSquaredGrad[i] = nullptr;
+    }
 
     debugImage = nullptr;
+    targetPrecalc = nullptr;
+    stateVersion = nextStateVersion();
+    evalPTVersion = nextStateVersion();
+    pointsVersion = nextStateVersion();
   }
 
   Vec10 getPriorZero() { return Vec10::Zero(); }
@@ -130,13 +170,50 @@ class FrameHessian {
   /** \brief Process images
    *
    *  Set intensity, gradients, sum of square gradients in every pyramid level
+   *
+   *  @param[in] color        - planar intensity image of level 0
+   *  @param[in] HCalib       - camera calibration, for gamma weighted gradients
+   *  @param[in] threadReduce - if set, level 0 is split into row bands on it
+   *  @param[in] gpu          - if set, the pyramid is made on it instead
+   */
+  void makeImages(float* color, CalibHessian* HCalib,
+                  IndexThreadReduce<Vec10>* threadReduce = nullptr,
+                  FramePyramidCuda* gpu = nullptr);
+
+  /** \brief Replace the float pyramid by a compact copy of level 0
+   *
+   *  Converts dI into dICompact and releases dIp / absSquaredGrad (all set to
+   *  nullptr). Only for keyframes whose upper levels are no longer needed, i.e.
+   *  after point selection and after they became the coarse tracking reference.
    */
-  void makeImages(float* color, CalibHessian* HCalib);
+  void makeCompact();
+
+  /** \brief Give the pyramid back to PyramidBufferPool, keeping level 0
+   *
+   *  dI is copied to a buffer of its own, dIp / absSquaredGrad are set to
+   *  nullptr. Lossless, for the same point in the life of a keyframe as
+   *  makeCompact(): from then on only level 0 is read (residuals, tracing,
+   *  point activation).
+   */
+  void releasePyramid();
+
+  //! dIp and absSquaredGrad are there (no releasePyramid() / makeCompact()).
+  inline bool hasPyramid() const { return dIp[0] != nullptr; }
+
+  //! Intensity of pixel idx in level 0, from dI or dICompact.
+  inline float intensityAt(const int idx) const {
+    return dICompact != nullptr ? dICompact[idx].get()[0] : dI[idx][0];
+  }
 
   void release();
   Vec10 getPrior();
 
  public:
+  //! Size and pyramid of the images.
+  const CalibContext* calib;
+  //! Of the FullSystem the frame belongs to.
+  const Settings* settings;
+
   EFFrame* efFrame;
 
   /** \brief Constant info & pre-calculated values */
@@ -150,6 +227,19 @@ class FrameHessian {
    *  dI[2]: gradient y (gy)
    */
   Eigen::Vector3f* dI;
+  //! Owns dI after releasePyramid(), nullptr before (dI is dIp[0] then).
+  Eigen::Vector3f* dILevel0;
+  //! Bytes of dILevel0, counted as pyramid memory.
+  MemoryAccount level0Memory{MEM_PYRAMIDS};
+
+  /** \brief Level 0 as 16 bit fixed point, set once makeCompact() was called
+   *
+   *  Either dI or dICompact is set. Readers of keyframes in the window
+   *  (residuals, point activation) have to handle both.
+   */
+  CompactPixel* dICompact;
+  //! Bytes of dICompact, counted as pyramid memory.
+  MemoryAccount compactMemory{MEM_PYRAMIDS};
 
   /** \brief Image info.
    *
@@ -169,7 +259,7 @@ class FrameHessian {
   /** \brief Incremental ID for keyframes only */
   int frameID;
 
-  static int instanceCounter;
+  static std::atomic<int> instanceCounter;
   int idx;
 
   // Photometric Calibration Stuff
@@ -226,8 +316,33 @@ class FrameHessian {
   /** \brief Precalculated Twc (will be updated later) */
   SE3 PRE_camToWorld;
 
-  std::vector<FrameFramePrecalc, Eigen::aligned_allocator<FrameFramePrecalc>>
-      targetPrecalc;
+  //! PRE_worldToCam / PRE_camToWorld in float, for hostToThisF.
+  SE3f PRE_worldToCamf;
+  SE3f PRE_camToWorldf;
+
+  /** \brief Stamp (nextStateVersion) of the last change of state, state_zero
+   *  or worldToCam_evalPT
+   *
+   *  worldToCam_evalPT is only set together with state_zero (setEvalPT*).
+   */
+  uint64_t stateVersion;
+
+  /** \brief Stamp of the last change of state_zero or worldToCam_evalPT */
+  uint64_t evalPTVersion;
+
+  /** \brief Stamp of the last time pointHessians or the pose may have changed
+   *
+   *  Set at construction and by FullSystem whenever it publishes the window,
+   *  see FullSystem::snapshotWindowPoints.
+   */
+  uint64_t pointsVersion;
+
+  /** \brief Row of this frame (as host) in FullSystem::framePrecalc
+   *
+   *  targetPrecalc[target->idx], valid for all frames in the window after
+   *  FullSystem::setPrecalcValues.
+   */
+  FrameFramePrecalc* targetPrecalc;
   MinimalImageB3* debugImage;
 };
 
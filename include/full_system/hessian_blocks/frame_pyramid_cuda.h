@@ -0,0 +1,38 @@
+#pragma once
+
+namespace dso {
+
+/** \brief FrameHessian::makeImages on a CUDA device
+ *
+ *  Level 0 goes up once, the downsampled levels, the gradients and the
+ *  squared gradient norms are computed on the device and come back into the
+ *  pooled host pyramid. Results are identical to the CPU path. Only compiled
+ *  with DSO_CUDA (HAS_CUDA), see setting_preprocessGPU.
+ *
+ *  Not thread safe, used by the tracking thread of one FullSystem.
+ */
+class FramePyramidCuda {
+ public:
+  //! Device buffers for levels [0, levels) of w[lvl] x h[lvl].
+  FramePyramidCuda(const int* w, const int* h, int levels);
+  ~FramePyramidCuda();
+
+  //! Whether there is a CUDA device to run on.
+  static bool deviceAvailable();
+
+  /** \brief Make the pyramid of the planar level 0 image color
+   *
+   *  @param[in] B              - CalibHessian::B (256) to gamma weight the
+   *                              squared gradients with, nullptr for none
+   *  @param[out] dI            - per level 3 * w * h floats, [intensity gx gy]
+   *  @param[out] absSquaredGrad - per level w * h floats
+   */
+  void make(const float* color, const float* B, float* const* dI,
+            float* const* absSquaredGrad);
+
+ private:
+  struct Impl;
+  Impl* impl;
+};
+
+}  // dso
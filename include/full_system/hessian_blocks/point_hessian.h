@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+
 #include <glog/logging.h>
 
 #include "full_system/residuals.h"
+#include "util/inline_vector.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 #include "util/settings.h"
 
 #define SCALE_IDEPTH 1.0f  // scales internal value to idepth.
@@ -18,7 +22,7 @@ class ImmaturePoint;
 /** \brief Hessian component associated with one point. */
 class PointHessian {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(PointHessian)
 
   enum PtStatus { ACTIVE = 0, INACTIVE, OUTLIER, OOB, MARGINALIZED };
 
@@ -55,17 +59,13 @@ class PointHessian {
     nullspaces_scale = -(idepth * 1.001 - idepth / 1.001) * 500;
   }
 
-  bool isInlierNew() {
-    return static_cast<int>(residuals.size()) >=
-               setting_minGoodActiveResForMarg &&
-           numGoodResiduals >= setting_minGoodResForMarg;
-  }
+  bool isInlierNew() const;
 
   bool isOOB(const std::vector<FrameHessian*>& toKeep,
              const std::vector<FrameHessian*>& toMarg) const;
 
  public:
-  static int instanceCounter;
+  static std::atomic<int> instanceCounter;
   EFPoint* efPoint;
 
   /** \brief Colors in host frame */
@@ -98,7 +98,7 @@ class PointHessian {
   PtStatus status;
 
   /** \brief Container of good residuals (NO OOB and NO OUTLIER) */
-  std::vector<PointFrameResidual*> residuals;
+  InlineVector<PointFrameResidual*, MAX_WINDOW_FRAMES> residuals;
 
   /** \brief Information about residuals in the last two frames.
    *
@@ -2,7 +2,9 @@
 
 #include "full_system/hessian_blocks/hessian_blocks.h"
 #include "full_system/residuals.h"
+#include "util/cpu_features.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 
 namespace dso {
 
@@ -26,7 +28,7 @@ enum ImmaturePointStatus {
 
 class ImmaturePoint {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(ImmaturePoint)
 
   ImmaturePoint(int u_, int v_, FrameHessian* host_, float type,
                 CalibHessian* HCalib);
@@ -37,6 +39,13 @@ class ImmaturePoint {
                               const Vec3f& hostToFrame_Kt,
                               const Vec2f& hostToFrame_affine,
                               CalibHessian* HCalib, bool debugPrint = false);
+  //! traceOn() for pattern kPattern, called by it for settings.pattern.
+  template <int kPattern>
+  ImmaturePointStatus traceOn(FrameHessian* frame,
+                              const Mat33f& hostToFrame_KRKi,
+                              const Vec3f& hostToFrame_Kt,
+                              const Vec2f& hostToFrame_affine,
+                              CalibHessian* HCalib, bool debugPrint);
 
   double linearizeResidual(CalibHessian* HCalib, const float outlierTHSlack,
                            ImmaturePointTemporaryResidual* tmpRes, float& Hdd,
@@ -47,6 +56,25 @@ class ImmaturePoint {
   float calcResidual(CalibHessian* HCalib, const float outlierTHSlack,
                      ImmaturePointTemporaryResidual* tmpRes, float idepth);
 
+  //! Energy of pattern kPattern in the discrete epipolar search at (ptx, pty).
+  /*!
+    @param[in] patternDx x-offsets of the rotated pattern
+    @param[in] patternDy y-offsets of the rotated pattern
+  */
+  template <int kPattern>
+  float traceEnergy(const FrameHessian* frame, const float ptx,
+                    const float pty, const float* patternDx,
+                    const float* patternDy,
+                    const Vec2f& hostToFrame_affine) const;
+#if DSO_AVX_DISPATCH
+  //! traceEnergy() of pattern 8, one lane per point.
+  DSO_TARGET_AVX2 float traceEnergyAVX2(const FrameHessian* frame,
+                                        const float ptx, const float pty,
+                                        const float* patternDx,
+                                        const float* patternDy,
+                                        const Vec2f& hostToFrame_affine) const;
+#endif
+
  public:
   float color[MAX_RES_PER_POINT];
   float weights[MAX_RES_PER_POINT];
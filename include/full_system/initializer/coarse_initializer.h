@@ -6,6 +6,8 @@
 #include "full_system/initializer/pnt.h"
 #include "io_wrapper/output_3d_wrapper.h"
 #include "optimization_backend/accumulators/matrix_accumulators.h"
+#include "util/calib_context.h"
+#include "util/index_thread_reduce.h"
 #include "util/num_type.h"
 #include "util/settings.h"
 
@@ -17,22 +19,33 @@ struct Pnt;
 class CoarseInitializer {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  CoarseInitializer(int w, int h);
+  CoarseInitializer(const CalibContext& calib, const Settings& settings);
   ~CoarseInitializer();
 
   /** \brief Configure the first frame.
    *
    *  Selection and initialization of pixels in the first frame
+   *
+   *  @param[in] red - pool for the neighbour search, nullptr for none
    */
-  void setFirst(CalibHessian* HCalib, FrameHessian* newFrameHessian);
+  void setFirst(CalibHessian* HCalib, FrameHessian* newFrameHessian,
+                IndexThreadReduce<Vec10>* red = nullptr);
 
-  /** \brief Update the first frame using a new frame */
+  /** \brief Update the first frame using a new frame
+   *
+   *  @param[in] red - pool for the per point work, nullptr for none. The
+   *                   result does not depend on it.
+   */
   bool trackFrame(FrameHessian* newFrameHessian,
-                  std::vector<IOWrap::Output3DWrapper*>& wraps);
+                  std::vector<IOWrap::Output3DWrapper*>& wraps,
+                  IndexThreadReduce<Vec10>* red = nullptr);
 
   /** \brief NOT USED */
   void calcTGrads(FrameHessian* newFrameHessian);
 
+  //! true once the translation is large enough, i.e. converging.
+  inline bool isSnapped() const { return frameID >= 0 && snapped; }
+
  public:
   int frameID;
 
@@ -58,6 +71,9 @@ class CoarseInitializer {
   FrameHessian* firstFrame;
   FrameHessian* newFrame;
 
+  const CalibContext& calib;
+  const Settings& settings;
+
  private:
   // Set intrinsic paramters, image width, image height for every pyramid level
   void makeK(CalibHessian* HCalib);
@@ -72,6 +88,12 @@ class CoarseInitializer {
                      Vec8f& b_out_sc, const SE3& refToNew,
                      AffLight refToNew_aff, bool plot);
 
+  //! calcResAndGS() for pattern kPattern, called by it for settings.pattern.
+  template <int kPattern>
+  Vec3f calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out, Mat88f& H_out_sc,
+                     Vec8f& b_out_sc, const SE3& refToNew,
+                     AffLight refToNew_aff, bool plot);
+
   // returns OLD NERGY, NEW ENERGY, NUM TERMS.
   Vec3f calcEC(int lvl);
 
@@ -132,9 +154,19 @@ class CoarseInitializer {
 
   void debugPlot(int lvl, std::vector<IOWrap::Output3DWrapper*>& wraps);
 
-  /** \brief Compute 10 nearest neighbors and parent of a point. */
+  /** \brief Compute 10 nearest neighbors and parent of a point.
+   *
+   *  Done once per first frame, trackFrame only uses the lists in Pnt.
+   */
   void makeNN();
 
+  /** \brief fn over [0, nBlocks) on red if it is not nullptr
+   *
+   *  Makes sure threadAcc9 / threadE have an entry for every tid.
+   */
+  void reduceBlocks(const boost::function<void(int, int, Vec10*, int)>& fn,
+                    int nBlocks);
+
  private:
   Mat33 K[PYR_LEVELS];
   // K.inv
@@ -178,16 +210,23 @@ class CoarseInitializer {
   */
   Vec10f* JbBuffer_new;
 
-  /** \brief Compute the top left of Hessian H11 */
-  Accumulator9 acc9;
-
-  /** \brief Schur complement of inverse depths (H12 * H22 * H12^T)
-  */
-  Accumulator9 acc9SC;
-
   /** \brief NOT USED */
   Vec3f dGrads[PYR_LEVELS];
 
+  //! pool of the current setFirst / trackFrame call, nullptr for none.
+  IndexThreadReduce<Vec10>* red;
+
+  /** \brief Per thread accumulators and per block sums of calcResAndGS
+   *
+   *  The points are summed in blocks of fixed size and the blocks summed in
+   *  order, independent of which thread did which block.
+   */
+  std::vector<Accumulator9, Eigen::aligned_allocator<Accumulator9>> threadAcc9;
+  std::vector<Accumulator11, Eigen::aligned_allocator<Accumulator11>> threadE;
+  std::vector<Mat99f, Eigen::aligned_allocator<Mat99f>> blockH;
+  std::vector<float> blockE;
+  std::vector<size_t> blockNum;
+
   float alphaK;
   float alphaW;
   float regWeight;
@@ -50,6 +50,12 @@ struct Pnt {
 
   float my_type;
   float outlierTH;
+
+  /** \brief Interpolated intensity of the first frame at every pattern pixel
+   *
+   *  Constant from setFirst on.
+   */
+  float refColor[MAX_RES_PER_POINT];
 };
 
 }  // dso
\ No newline at end of file
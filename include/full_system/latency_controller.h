@@ -0,0 +1,72 @@
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+
+#include "util/settings.h"
+
+namespace dso {
+
+/** \brief Feedback controller for the per-frame latency budget
+ *
+ *  Keeps moving averages of the wall time of trackNewCoarse (per frame),
+ *  makeKeyFrame and its optimize (per keyframe) and of the frames per
+ *  keyframe. If the estimated time per frame exceeds Settings::latencyBudgetMs,
+ *  it first lowers Settings::maxOptIterations (if optimize takes most of the
+ *  keyframe time) and otherwise Settings::desiredPointDensity and
+ *  Settings::desiredImmatureDensity. Below (1 - Settings::latencyHysteresis) of
+ *  the budget it raises them again, iterations first, density up to
+ *  Settings::latencyMaxScale times the configured one. Settings change at most
+ *  every few keyframes, so the averages can follow, and every change is
+ *  logged.
+ *
+ *  The adds may come from the tracking and the mapping thread, update() and
+ *  with it all changes of the settings run on the mapping thread.
+ */
+class LatencyController {
+ public:
+  //! Controls settings, which have to outlive it.
+  explicit LatencyController(Settings* settings);
+
+  //! Wall time of one trackNewCoarse, tracking thread.
+  void addTrackingTime(const double ms);
+
+  /** \brief Wall time of one keyframe, mapping thread
+   *
+   *  @param[in] keyframeMs - whole makeKeyFrame
+   *  @param[in] optimizeMs - its optimize()
+   *  @param[in] frames     - frames since the previous keyframe, this one
+   *                          included
+   */
+  void addKeyframeTime(const double keyframeMs, const double optimizeMs,
+                       const int frames);
+
+  /** \brief Adjust the settings to the budget, mapping thread
+   *
+   *  @param[in] sequential - tracking and mapping run on the same thread, so
+   *                          their times add up per frame
+   */
+  void update(const bool sequential);
+
+ private:
+  //! Estimated wall time per frame.
+  double frameMs(const bool sequential) const;
+
+  void setDensityScale(const float scale);
+
+  Settings* settings;
+
+  boost::mutex mutex;
+
+  double trackingMs, keyframeMs, optimizeMs, framesPerKeyframe;
+  int numKeyframes;
+  int keyframesSinceChange;
+
+  //! settings as configured, captured by the first update().
+  bool haveBase;
+  float baseImmatureDensity, basePointDensity;
+  int baseMaxOptIterations;
+
+  float densityScale;
+};
+
+}  // dso
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace dso {
+
+/** \brief On-disk layout of FullSystem::saveSnapshot / loadSnapshot
+ *
+ *  Header, the marginalization prior HM (hmSize x hmSize, column major) and
+ *  bM (hmSize) as doubles, then numFrames times a Frame, its level 0
+ *  intensities (width * height floats), its Point and ImmaturePoint records.
+ *  Every Frame starts at an offset aligned to 8 bytes.
+ *
+ *  Frames are in window order, so HM / bM are indexed like after inserting
+ *  them into a new EnergyFunctional in this order. Residuals are not stored,
+ *  every active point gets one to every other frame of the window, which is
+ *  what EnergyFunctional had for all but the outliers.
+ */
+namespace MapSnapshot {
+
+static const char kMagic[8] = {'D', 'S', 'O', 'S', 'N', 'A', 'P', '1'};
+static const uint32_t kVersion = 1;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t width, height;
+  uint32_t numFrames;
+  uint32_t hmSize;
+  uint32_t reserved;
+  double calib[4];      //!< CalibHessian value
+  double calibZero[4];  //!< CalibHessian value_zero
+};
+
+struct Frame {
+  int32_t incomingId;
+  uint32_t numPoints;
+  uint32_t numImmaturePoints;
+  float abExposure;
+  float frameEnergyTH;
+  uint32_t reserved;
+  double timestamp;
+  double camToWorld[7];  //!< qx qy qz qw tx ty tz
+  double affG2l[2];      //!< shell aff_g2l a, b
+  double evalPT[7];      //!< worldToCam_evalPT, as camToWorld
+  double state[10];
+  double stateZero[10];
+};
+
+struct Point {
+  float u, v;
+  float myType;
+  float idepth;
+  float idepthZero;
+  float idepthHessian;
+  float maxRelBaseline;
+  int32_t numGoodResiduals;
+  int32_t hasDepthPrior;
+};
+
+struct ImmaturePoint {
+  float u, v;
+  float myType;
+  float idepthMin, idepthMax;
+  float quality;
+  int32_t lastTraceStatus;
+};
+
+}  // namespace MapSnapshot
+
+}  // dso
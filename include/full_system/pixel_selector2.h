@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+
+#include "util/calib_context.h"
 #include "util/num_type.h"
 
 namespace dso {
@@ -8,25 +11,40 @@ enum PixelSelectorStatus { PIXSEL_VOID = 0, PIXSEL_1, PIXSEL_2, PIXSEL_3 };
 
 class FrameHessian;
 
+//! A pixel picked by PixelSelector::makeMaps.
+struct PixelCandidate {
+  int u, v;
+  float type;  //!< 1, 2, 4: picked on the gradient of level 0, 1, 2
+};
+
+template <typename Running>
+class IndexThreadReduce;
+
 class PixelSelector {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  // 寻找高梯度点，输出是map_out
-  // map_out[i] == 0: invalid pixel
-  // map_out[i] == 1: 第0层梯度满足条件
-  // map_out[i] == 2: 第1层梯度满足条件
-  // map_out[i] == 4: 第2层梯度满足条件
+  // 寻找高梯度点，输出是candidates_out (按行排序, 和逐像素扫描的顺序一样)
+  // type == 1: 第0层梯度满足条件
+  // type == 2: 第1层梯度满足条件
+  // type == 4: 第2层梯度满足条件
   // density: 希望找到的点的数量
   // recursionsLeft: 0表示不能再搜索一次, 1表示还能通过调整patch大小来搜索一次
   // plot: 是否显示找到的点的位置
   // thFactor: 比较梯度大小时用的系数
-  int makeMaps(const FrameHessian* const fh, float* map_out, float density,
-               int recursionsLeft = 1, bool plot = false, float thFactor = 1);
+  // threadReduce: 如果不为空且settings.parallelPixelSelection,
+  // select()按patch4的行并行
+  int makeMaps(const FrameHessian* const fh,
+               std::vector<PixelCandidate>* candidates_out, float density,
+               int recursionsLeft = 1, bool plot = false, float thFactor = 1,
+               IndexThreadReduce<Vec10>* threadReduce = nullptr);
 
-  PixelSelector(int w, int h);
+  PixelSelector(const CalibContext& calib, const Settings& settings);
   ~PixelSelector();
 
+  // 恢复构造后的状态(FullSystem::reset), randomPattern和缓存保留
+  void reset();
+
   // 将原图片分成多个32x32的patch, 通过直方图统计每一个patch中的梯度,
   // 找出所需要的阈值
   void makeHists(const FrameHessian* const fh);
@@ -44,8 +62,15 @@ class PixelSelector {
  private:
   //　遍历一个个的patch(边长为4 * pot, 2 * pot, pot, 1),
   //　找出高梯度点(同时在某些射线方向投影的模较大)
-  Eigen::Vector3i select(const FrameHessian* const fh, float* map_out, int pot,
-                         float thFactor = 1);
+  Eigen::Vector3i select(const FrameHessian* const fh,
+                         std::vector<PixelCandidate>* candidates_out, int pot,
+                         float thFactor = 1,
+                         IndexThreadReduce<Vec10>* threadReduce = nullptr);
+
+  // select()的主体: 处理第[bandMin, bandMax)行patch4, 找到的点放进
+  // bandCandidates, stats[0-2]累加找到的点的数量(n2, n3, n4)
+  void selectBands(const FrameHessian* const fh, int pot, float thFactor,
+                   int bandMin, int bandMax, Vec10* stats, int tid);
 
  private:
   // 一组随机数 (size: w * h)
@@ -53,10 +78,17 @@ class PixelSelector {
   // 2) 用来选择投影方向 (选取点的时候用)
   unsigned char* randomPattern;
 
+  const CalibContext& calib;
+  const Settings& settings;
+
   int* gradHist;  // 梯度直方图(50 bins)
   float* ths;  //　每一个patch的梯度阈值 (阈值以下的pixel不会被考虑)
   float* thsSmoothed;  // 每一个patch的smooth后的梯度阈值
   int thsStep;         // 横向patch的数量, 一个patch是32x32
   const FrameHessian* gradHistFrame;
+  int gradHistFrameId;  // shell id of gradHistFrame (地址可能被新的帧重用)
+
+  // 每一行patch4找到的点, 每行只由一个线程写
+  std::vector<std::vector<PixelCandidate>> bandCandidates;
 };
 }
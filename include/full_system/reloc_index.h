@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include "util/calib_context.h"
+#include "util/memory_stats.h"
+#include "util/num_type.h"
+
+namespace dso {
+
+class FrameHessian;
+
+/** \brief The last keyframes that left the window, to relocalize on
+ *
+ *  Every entry keeps what a keyframe needs to become the tracking reference
+ *  and the first keyframe of a new window again: its final pose and affine
+ *  brightness, level 0 as 16 bit fixed point (see CompactPixel) and the pixel
+ *  and inverse depth of its points. Frames are found by their thumbnail, the
+ *  coarsest pyramid level normalized to zero mean and unit norm, so the
+ *  score (normalized cross correlation) does not depend on the exposure.
+ *
+ *  add() comes from the mapping thread, query() from the tracking thread.
+ */
+class RelocIndex {
+ public:
+  struct Point {
+    float u, v;
+    float idepthScaled;
+    float type;
+  };
+
+  struct Entry {
+    int id;
+    int incomingId;
+    double timestamp;
+    SE3 camToWorld;
+    AffLight aff_g2l;
+    float ab_exposure;
+    std::vector<float> thumbnail;
+    std::vector<int16_t> image;  //!< intensity of level 0, CompactPixel
+    std::vector<Point> points;
+  };
+
+  typedef std::pair<float, std::shared_ptr<const Entry>> Match;
+
+  //! Keep up to capacity frames of calib, which has to outlive the index.
+  RelocIndex(const CalibContext& calib, size_t capacity);
+
+  /** \brief Keep frame, dropping the oldest entry if full
+   *
+   *  Takes the active and the marginalized points of frame. The pose is read
+   *  from its shell, the caller has to keep it from changing.
+   */
+  void add(const FrameHessian* frame);
+
+  /** \brief The (up to) n entries most similar to frame, best first
+   *
+   *  @param[in] minScore - entries scoring below are skipped
+   */
+  std::vector<Match> query(const FrameHessian* frame, int n,
+                           float minScore) const;
+
+  //! The level 0 intensities of entry, w[0] * h[0] floats, NaN if invalid.
+  void decodeImage(const Entry& entry, float* image) const;
+
+  size_t size() const;
+  void clear();
+
+ private:
+  void makeThumbnail(const FrameHessian* frame,
+                     std::vector<float>* thumbnail) const;
+
+  const CalibContext& calib;
+  const size_t capacity;
+
+  mutable boost::mutex mutex;
+  std::deque<std::shared_ptr<const Entry>> entries;  //!< [mutex] oldest first
+  MemoryAccount memory{MEM_RELOC_INDEX};
+};
+
+}  // namespace dso
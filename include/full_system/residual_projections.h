@@ -36,20 +36,22 @@ EIGEN_STRONG_INLINE float derive_idepth(const Vec3f& t, const float u,
  *  @param[in]  idepth inverse depth wrt. image 1
  *  @param[in]  KRKi   \f$K R_{21} K^{-1}\f$
  *  @param[in]  Kt     \f$K t_{21}\f$
+ *  @param[in]  calib  size of image 2
  *  @param[out] Ku     pixel u in image 2
  *  @param[out] Kv     pixel v in image 2
  *  @return true if inside image, false otherwise
  */
 EIGEN_STRONG_INLINE bool projectPoint(const float u_pt, const float v_pt,
                                       const float idepth, const Mat33f& KRKi,
-                                      const Vec3f& Kt, float* const Ku,
-                                      float* const Kv) {
+                                      const Vec3f& Kt,
+                                      const CalibContext& calib,
+                                      float* const Ku, float* const Kv) {
   CHECK_NOTNULL(Ku);
   CHECK_NOTNULL(Kv);
   Vec3f ptp = KRKi * Vec3f(u_pt, v_pt, 1) + Kt * idepth;
   *Ku = ptp[0] / ptp[2];
   *Kv = ptp[1] / ptp[2];
-  return *Ku > 1.1f && *Kv > 1.1f && *Ku < wM3G && *Kv < hM3G;
+  return *Ku > 1.1f && *Kv > 1.1f && *Ku < calib.wM3 && *Kv < calib.hM3;
 }
 
 /** project a pixel from image 1 to image 2
@@ -58,7 +60,7 @@ EIGEN_STRONG_INLINE bool projectPoint(const float u_pt, const float v_pt,
  *  @param[in]  idepth     inverse depth wrt. image 1
  *  @param[in]  dx         x-offset of pixel coordinates (for residual pattern)
  *  @param[in]  dy         y-offset of pixel coordinates (for residual pattern)
- *  @param[in]  HCalib     intrinsic parameters
+ *  @param[in]  HCalib     intrinsic parameters, and the size of image 2
  *  @param[in]  R          relative rotation R21 from 1 to 2
  *  @param[in]  t          relative translation t21 from 1 to 2
  *  @param[out] drescale   (inverse depth 2) / (inverse depth 1)
@@ -100,6 +102,7 @@ EIGEN_STRONG_INLINE bool projectPoint(
   *Ku = (*u) * HCalib->fxl() + HCalib->cxl();
   *Kv = (*v) * HCalib->fyl() + HCalib->cyl();
 
-  return *Ku > 1.1f && *Kv > 1.1f && *Ku < wM3G && *Kv < hM3G;
+  return *Ku > 1.1f && *Kv > 1.1f && *Ku < HCalib->calib->wM3 &&
+         *Kv < HCalib->calib->hM3;
 }
 }
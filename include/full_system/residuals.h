@@ -1,18 +1,22 @@
 #pragma once
 
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
 #include "optimization_backend/raw_residual_jacobian.h"
-#include "util/global_calib.h"
+#include "util/cpu_features.h"
+#include "util/calib_context.h"
 #include "util/global_funcs.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 
 namespace dso {
 class PointHessian;
 class FrameHessian;
 class CalibHessian;
+class FrameFramePrecalc;
 
 class EFResidual;
 
@@ -25,7 +29,7 @@ struct FullJacRowT {
 
 class PointFrameResidual {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(PointFrameResidual)
 
   ~PointFrameResidual();
   PointFrameResidual();
@@ -41,10 +45,56 @@ class PointFrameResidual {
     the pixel. If the residual is too large, the point will be seen as an
     outlier.
 
-    @param[in] HCalib intrinsic paramters
+    With updateJacobians false only resF, the energy and the state are
+    recomputed, everything else in J is copied from efResidual, i.e. taken
+    over from the last applyRes(true), which must have been IN.
+
+    @param[in] HCalib          intrinsic paramters
+    @param[in] updateJacobians recompute the Jacobians
     @return residual of this point (including the whole pattern)
   */
-  double linearize(CalibHessian* const HCalib);
+  double linearize(CalibHessian* const HCalib,
+                   const bool updateJacobians = true);
+
+  //! Energy of the residual for a trial state, without linearizing.
+  /*!
+    Same energy (and outlier / OOB handling) as linearize(), but for the
+    host-target state in precalc and the point at inverse depth idepthScaled
+    (as idepth and first estimate). Does not change the residual.
+
+    @param[in] precalc      relative state of host and target
+    @param[in] idepthScaled scaled inverse depth of the point
+    @param[in] HCalib       intrinsic paramters
+    @return residual of this point (including the whole pattern)
+  */
+  double evalEnergy(const FrameFramePrecalc& precalc, const float idepthScaled,
+                    CalibHessian* const HCalib) const;
+
+  //! linearize() and evalEnergy() for pattern kPattern, called by them for
+  //! settings.pattern. kOptA / kOptB: affineOptModeA / B >= 0, i.e. whether
+  //! the Jacobian wrt. a / b is kept.
+  template <int kPattern, bool kOptA, bool kOptB>
+  double linearize(CalibHessian* const HCalib, const bool updateJacobians);
+  template <int kPattern>
+  double evalEnergy(const FrameFramePrecalc& precalc, const float idepthScaled,
+                    CalibHessian* const HCalib) const;
+
+#if DSO_AVX_DISPATCH
+  //! Pattern part of linearize() for the 8 points of pattern 8 at once.
+  /*!
+    Writes projectedTo and the pattern rows of J, only resF of them with
+    updateJacobians false.
+
+    @return false if any pattern point is out of bounds or not finite
+  */
+  DSO_TARGET_AVX2 bool linearizePatternAVX2(const Mat33f& KRKi,
+                                            const Vec3f& Kt,
+                                            const Vec2f& affLL, const float b0,
+                                            const bool optA, const bool optB,
+                                            const bool updateJacobians,
+                                            float* const energyLeft,
+                                            float* const wJI2_sum);
+#endif
 
   void resetOOB() {
     state_NewEnergy = state_energy = 0;
@@ -66,7 +116,7 @@ class PointFrameResidual {
                  int res);
 
  public:
-  static int instanceCounter;
+  static std::atomic<int> instanceCounter;
 
   EFResidual* efResidual;
 
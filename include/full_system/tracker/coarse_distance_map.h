@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+
+#include "util/calib_context.h"
 #include "util/num_type.h"
 #include "util/settings.h"
 
@@ -13,10 +16,17 @@ class CoarseDistanceMap {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  CoarseDistanceMap(int w, int h);
+  explicit CoarseDistanceMap(const CalibContext& calib);
   ~CoarseDistanceMap();
 
-  void makeDistanceMap(std::vector<FrameHessian*> frameHessians,
+  /** \brief Distance (at level 1) of every pixel of frame to the nearest
+   *  projected active point of the other frameHessians
+   *
+   *  Same distances as growing them with growDistBFS from all projected
+   *  points (alternating 8- and 4-neighbour steps, capped to 1000 from 40
+   *  steps on), but computed with growDistTwoPass.
+   */
+  void makeDistanceMap(const std::vector<FrameHessian*>& frameHessians,
                        FrameHessian* frame);
 
   void makeK(CalibHessian* HCalib);
@@ -26,6 +36,20 @@ class CoarseDistanceMap {
  private:
   void growDistBFS(int bfsNum);
 
+  /** \brief Distance transform of distWork (0 at the seeds, kDistInf else)
+   *
+   *  Two raster passes (down, then up), each taking the neighbours in the
+   *  previous row and then scanning the row in both directions. The step
+   *  into pixel p from q counts 1, diagonal steps are only allowed from even
+   *  distances (the odd BFS iterations), which gives the exact distances of
+   *  growDistBFS. Border pixels get a distance but do not pass it on, like in
+   *  growDistBFS.
+   */
+  void growDistTwoPass();
+
+  //! One row of growDistTwoPass: row = min(row, step from the row src).
+  void distFromRow(int* row, const int* src);
+
  public:
   float* fwdWarpedIDDistFinal;
 
@@ -43,10 +67,19 @@ class CoarseDistanceMap {
   int h[PYR_LEVELS];
 
  private:
+  const CalibContext& calib;
+
   PointFrameResidual** coarseProjectionGrid;
   int* coarseProjectionGridNum;
   Eigen::Vector2i* bfsList1;
   Eigen::Vector2i* bfsList2;
+
+  static const int kDistInf = 1000;
+
+  //! growDistTwoPass distances, and the padded source rows of distFromRow.
+  int* distWork;
+  int* rowVert;
+  int* rowDiag;
 };
 
 }  // namespace dso
\ No newline at end of file
@@ -5,27 +5,88 @@
 
 #include "full_system/tracker/coarse_distance_map.h"
 #include "io_wrapper/output_3d_wrapper.h"
+#include "util/calib_context.h"
 #include "optimization_backend/accumulators/matrix_accumulators.h"
+#include "util/cpu_features.h"
+#include "util/index_thread_reduce.h"
 #include "util/num_type.h"
 #include "util/settings.h"
+#include "util/wall_timer.h"
 
 namespace dso {
 class CalibHessian;
+class CoarseTrackerCuda;
 class FrameHessian;
 
+/** \brief Outcome of one pyramid level of CoarseTracker::trackNewestCoarse */
+struct CoarseTrackerLevelResult {
+  int lvl;
+  double residual;
+  Vec3 flowIndicators;
+};
+
 class CoarseTracker {
+  // times the private kernels (calcRes, calcGSSSE), see app/bench.cc.
+  friend class CoarseTrackerBench;
+
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  CoarseTracker(int w, int h);
+  /** \brief Create a tracker for the images of calib
+   *
+   *  @param[in] allocReference - false: only allocate the warp buffers, the
+   *                              reference has to come from shareReference()
+   */
+  CoarseTracker(const CalibContext& calib, const Settings& settings,
+                bool allocReference = true);
   ~CoarseTracker();
 
+  /** \brief Track against the reference of other, without copying it
+   *
+   *  Only the buffers written by trackNewestCoarse are owned, so several of
+   *  these can track against the same reference concurrently. Has to be called
+   *  again whenever the reference of other changes.
+   */
+  void shareReference(const CoarseTracker& other);
+
+  /** \brief Track newFrameHessian coarse to fine against the reference
+   *
+   *  @param[in] budgetMs - wall time budget, 0 for none. Once it is used up
+   *                        the iterations stop and the remaining levels are
+   *                        skipped, down to level 0 which only gets its
+   *                        residual evaluated (lastOutOfTime is set then).
+   *                        Levels below settings.coarseTrackingFinestLvl
+   *                        are skipped the same way.
+   *  @return false if a level is worse than 1.5 * minResForAbort or the
+   *          affine brightness parameters are off.
+   */
   bool trackNewestCoarse(FrameHessian* newFrameHessian, SE3& lastToNew_out,
                          AffLight& aff_g2l_out, int coarsestLvl,
-                         Vec5 minResForAbort,
-                         IOWrap::Output3DWrapper* wrap = nullptr);
-
-  void setCoarseTrackingRef(std::vector<FrameHessian*> frameHessians);
+                         VecPyr minResForAbort,
+                         IOWrap::Output3DWrapper* wrap = nullptr,
+                         double budgetMs = 0);
+
+  /** \brief Build the reference (inverse depth pyramid, point lists) from the
+   *  points of frameHessians projected into the last of them
+   *
+   *  @param[in] red - pool for the per row stages, nullptr for none
+   */
+  void setCoarseTrackingRef(const std::vector<FrameHessian*>& frameHessians,
+                            IndexThreadReduce<Vec10>* red = nullptr);
+
+  /** \brief setCoarseTrackingRef in two steps
+   *
+   *  splatCoarseTrackingRef only reads the points (their last residuals) of
+   *  frameHessians, they may change afterwards. finishCoarseTrackingRef does
+   *  the rest (pyramid, dilation, point lists), it only reads the image of
+   *  the reference, which must stay uncompacted until it is done.
+   */
+  void splatCoarseTrackingRef(const std::vector<FrameHessian*>& frameHessians);
+  //! splatCoarseTrackingRef with ref as reference and points (u, v, inverse
+  //! depth in level 0 of ref) instead of the residuals of a window.
+  void splatCoarseTrackingRef(FrameHessian* ref,
+                              const std::vector<Vec3f>& points);
+  void finishCoarseTrackingRef(IndexThreadReduce<Vec10>* red = nullptr);
 
   void makeK(CalibHessian* HCalib);
 
@@ -54,23 +115,83 @@ class CoarseTracker {
   int refFrameID;
 
   // act as pure ouptut
-  Vec5 lastResiduals;
+  VecPyr lastResiduals;
   Vec3 lastFlowIndicators;
+  // every level checked against minResForAbort, in order.
+  std::vector<CoarseTrackerLevelResult> lastLevelResults;
+  // the last trackNewestCoarse ran out of its budget and cut the refinement.
+  bool lastOutOfTime;
   double firstCoarseRMSE;
 
+  const CalibContext& calib;
+  const Settings& settings;
+
  private:
-  void makeCoarseDepthL0(std::vector<FrameHessian*> frameHessians);
+  //! level 0 idepth / weightSums from the points of frameHessians.
+  void splatDepthL0(const std::vector<FrameHessian*>& frameHessians);
+  //! the other levels, dilation and point lists from level 0.
+  void makeCoarseDepthPyramid(IndexThreadReduce<Vec10>* red);
+  //! level of row in the rows of all levels, y its row within the level.
+  int levelOfRow(int row, int* y) const;
+  //! fn over pyrRowStart[0 .. calib.pyrLevelsUsed), on red if not nullptr.
+  void forAllRows(void (CoarseTracker::*fn)(int, int, Vec10*, int),
+                  IndexThreadReduce<Vec10>* red);
+  void dilateRows(int min, int max, Vec10* stats, int tid);
+  //! normalizes idepth / weightSums, sets pcRowStart to the points per row.
+  void normalizeRows(int min, int max, Vec10* stats, int tid);
+  void compactRows(int min, int max, Vec10* stats, int tid);
+  /** \brief Move the subset for the intermediate iterations to the front
+   *
+   *  Stratified over cells of kSubsetCell x kSubsetCell pixels: every cell
+   *  keeps settings.coarseSubsampleRatio of its points (at least one), those
+   *  with the largest reference gradient. Both parts keep their row order.
+   *  Sets pc_nSubset[lvl], pc_n[lvl] if lvl is not subsampled.
+   */
+  void makeSubset(int lvl);
   float* idepth[PYR_LEVELS];
   float* weightSums[PYR_LEVELS];
   float* weightSums_bak[PYR_LEVELS];
 
   Vec6 calcResAndGS(int lvl, Mat88& H_out, Vec8& b_out, const SE3& refToNew,
                     AffLight aff_g2l, float cutoffTH);
-  Vec6 calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l, float cutoffTH);
+  //! residual of the reference points [0, pc_nSubset) if subset, else all.
+  Vec6 calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l, float cutoffTH,
+               bool subset);
+#if DSO_AVX_DISPATCH
+  // calcRes for the leading multiple of 8 of the first nl reference points,
+  // returns it.
+  DSO_TARGET_AVX2 int calcResAVX2(int lvl, int nl, const Mat33f& RKi,
+                                  const Vec3f& t,
+                                  const Vec2f& affLL, float cutoffTH, float* E,
+                                  int* numTermsInE, int* numTermsInWarped,
+                                  int* numSaturated, float* sumSquaredShiftT,
+                                  float* sumSquaredShiftRT,
+                                  float* sumSquaredShiftNum);
+#endif
+  // flow indicator sums of reference point (x, y) projecting to (Ku, Kv).
+  void accumulateShift(int lvl, const Mat33f& RKi, const Vec3f& t, float x,
+                       float y, float id, float Ku, float Kv,
+                       float* sumSquaredShiftT, float* sumSquaredShiftRT,
+                       float* sumSquaredShiftNum) const;
   void calcGSSSE(int lvl, Mat88& H_out, Vec8& b_out, const SE3& refToNew,
                  AffLight aff_g2l);
   void calcGS(int lvl, Mat88& H_out, Vec8& b_out, const SE3& refToNew,
               AffLight aff_g2l);
+#if DSO_AVX_DISPATCH
+  // accumulates the leading multiple of 8 warped points into acc, returns it.
+  DSO_TARGET_AVX int calcGSAVX(int lvl, float affA);
+#endif
+#if DSO_NEON
+  // accumulates all warped points into acc with fused multiply adds, returns
+  // their number.
+  int calcGSNEON(int lvl, float affA);
+#endif
+#if defined(HAS_CUDA)
+  // calcRes of the first nl reference points on gpu, keeps the system of the
+  // warped points in gpuH.
+  Vec6 calcResGPU(int lvl, const Mat33f& RKi, const Vec3f& t,
+                  const Vec2f& affLL, float cutoffTH, int nl);
+#endif
 
  private:
   // pc buffers
@@ -79,6 +200,14 @@ class CoarseTracker {
   float* pc_idepth[PYR_LEVELS];
   float* pc_color[PYR_LEVELS];
   int pc_n[PYR_LEVELS];
+  // reference points [0, pc_nSubset) are the subset the intermediate
+  // iterations of trackNewestCoarse use, pc_nSubset == pc_n: no subsampling.
+  int pc_nSubset[PYR_LEVELS];
+
+  // first row of every level in the rows of all levels, and the first pc
+  // index of every row (while building the reference).
+  int pyrRowStart[PYR_LEVELS + 1];
+  std::vector<int> pcRowStart;
 
   // warped buffers
   float* buf_warped_idepth;
@@ -94,5 +223,14 @@ class CoarseTracker {
   std::vector<float*> ptrToDelete;
 
   Accumulator9 acc;
+
+  // calcRes / calcGSSSE on the device, nullptr unless
+  // settings.coarseTrackingGPU and built with DSO_CUDA.
+  CoarseTrackerCuda* gpu;
+  // changes with every reference (pc_*), tells gpu when to upload it.
+  int refVersion;
+  // the last calcRes ran on gpu, gpuH holds what calcGSSSE would accumulate.
+  bool gpuResValid;
+  Mat99f gpuH;
 };
 }
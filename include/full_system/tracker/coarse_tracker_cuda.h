@@ -0,0 +1,66 @@
+#pragma once
+
+namespace dso {
+
+/** \brief State of one CoarseTrackerCuda::calcResAndGS call */
+struct CoarseTrackerCudaParams {
+  float RKi[9];  // row major, R * K^-1 of the level
+  float t[3];
+  float fx, fy, cx, cy;
+  float affA, affB;  // affLL of CoarseTracker::calcRes
+  float b0;          // lastRef_aff_g2l.b
+  float huberTH, cutoffTH;
+};
+
+/** \brief Sums of one CoarseTrackerCuda::calcResAndGS call */
+struct CoarseTrackerCudaResult {
+  float E;
+  int numTermsInE;
+  int numTermsInWarped;
+  int numSaturated;
+  // upper triangle, row by row, of sum(w * [J r]^T [J r]) over the warped
+  // points: what Accumulator9 sums in CoarseTracker::calcGSSSE.
+  float H[45];
+};
+
+/** \brief CoarseTracker::calcRes and calcGSSSE on a CUDA device
+ *
+ *  The reference points (pc_*) and the pyramid of the tracked frame stay in
+ *  device memory. A call projects, interpolates and Huber weights the points
+ *  and reduces them on the device, only the sums come back. Only compiled
+ *  with DSO_CUDA (HAS_CUDA), see Settings::coarseTrackingGPU.
+ *
+ *  Not thread safe, every CoarseTracker has its own (and its own stream).
+ *  Plain arrays only, so nvcc never sees Eigen.
+ */
+class CoarseTrackerCuda {
+ public:
+  //! Device buffers for levels [0, levels) of w[lvl] x h[lvl].
+  CoarseTrackerCuda(const int* w, const int* h, int levels);
+  ~CoarseTrackerCuda();
+
+  //! Whether there is a CUDA device to run on.
+  static bool deviceAvailable();
+
+  //! Upload the n reference points of lvl.
+  void setReference(int lvl, const float* u, const float* v,
+                    const float* idepth, const float* color, int n);
+
+  //! Upload the [intensity gx gy] pyramid of the tracked frame, dI[lvl] of
+  //! 3 * w[lvl] * h[lvl] floats.
+  void setFrame(const float* const* dI);
+
+  //! Residuals of the first n reference points of lvl and their Gauss-Newton
+  //! system, blocking until the sums are back.
+  void calcResAndGS(int lvl, int n, const CoarseTrackerCudaParams& params,
+                    CoarseTrackerCudaResult* result);
+
+  //! version of the reference uploaded last, -1 for none.
+  int refVersion;
+
+ private:
+  struct Impl;
+  Impl* impl;
+};
+
+}  // dso
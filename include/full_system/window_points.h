@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+namespace dso {
+
+/** \brief The active points of the keyframe window, one array per field
+ *
+ *  Filled by FullSystem::snapshotWindowPoints. Point i is at (x[i], y[i],
+ *  z[i]) in world coordinates; the points of a keyframe are the range
+ *  [first, first + num) of its entry in keyframes, which are in window order.
+ *
+ *  Keep one of these and pass it again: the arrays are reused, and the
+ *  points of a keyframe whose generation did not change are copied over
+ *  instead of projected again.
+ */
+struct WindowPoints {
+  struct Keyframe {
+    int frameID;
+    //! FrameHessian::pointsVersion when its points were taken.
+    uint64_t generation;
+    size_t first, num;
+  };
+
+  std::vector<Keyframe> keyframes;
+
+  std::vector<float> x, y, z;
+  std::vector<float> idepth;
+  //! 1 / idepth hessian, as published to the output wrappers.
+  std::vector<float> idepthVar;
+  //! FrameHessian::frameID of the host.
+  std::vector<int> hostId;
+  //! intensity of the point's center pixel.
+  std::vector<uint8_t> color;
+
+  size_t size() const { return x.size(); }
+
+  void resize(const size_t n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+    idepth.resize(n);
+    idepthVar.resize(n);
+    hostId.resize(n);
+    color.resize(n);
+  }
+
+  //! Swap the per point arrays (not keyframes) with those of other.
+  void swapPoints(WindowPoints* const other) {
+    x.swap(other->x);
+    y.swap(other->y);
+    z.swap(other->z);
+    idepth.swap(other->idepth);
+    idepthVar.swap(other->idepthVar);
+    hostId.swap(other->hostId);
+    color.swap(other->color);
+  }
+
+  //! The points of the fill before, while the next one copies from them.
+  std::unique_ptr<WindowPoints> spare;
+};
+
+}  // namespace dso
@@ -33,7 +33,22 @@ void displayImageStitch(const char* windowName,
                         const std::vector<MinimalImageF3*> images, int cc = 0,
                         int rc = 0);
 
+/** \brief Wait for a key pressed in a window shown above
+ *
+ *  Up to milliseconds, 0 = forever. The keys come from a UI thread that runs
+ *  the window event loop, so the windows stay responsive without calls to
+ *  this.
+ *
+ *  @return the key, 0 if none.
+ */
 int waitKey(int milliseconds);
+//! The next key pressed in a window shown above, 0 if none. Never waits.
+int pollKey();
 void closeAllWindows();
+
+//! Whether images shown by the functions above appear anywhere: false
+//! without a display backend or with disableAllDisplay. Callers skip
+//! rendering them otherwise.
+bool canDisplay();
 }
 }
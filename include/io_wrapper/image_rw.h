@@ -12,6 +12,17 @@ MinimalImage<unsigned short>* readImageBW_16U(std::string filename);
 
 MinimalImageB* readStreamBW_8U(char* data, int numBytes);
 
+/** \brief Decode a grey image into img, resized only if the size changes
+ *
+ *  reduction 2, 4 or 8 decodes at 1/reduction of the size: JPEGs with the
+ *  scaled DCT of the decoder, other formats in full and area averaged.
+ *  @return false if it cannot be read.
+ */
+bool readImageBW_8U(const std::string& filename, MinimalImageB* img,
+                    int reduction = 1);
+bool readStreamBW_8U(const char* data, int numBytes, MinimalImageB* img,
+                     int reduction = 1);
+
 void writeImage(std::string filename, MinimalImageB* img);
 void writeImage(std::string filename, MinimalImageB3* img);
 void writeImage(std::string filename, MinimalImageF* img);
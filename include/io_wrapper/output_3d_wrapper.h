@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "util/flat_hash_map.h"
 #include "util/minimal_image.h"
 #include "util/num_type.h"
 
@@ -93,9 +94,38 @@ namespace IOWrap {
 
 class Output3DWrapper {
  public:
+  //! The render callbacks a wrapper consumes, see capabilities().
+  enum Capability {
+    CAP_LIVE_FRAME = 1 << 0,         //!< pushLiveFrame
+    CAP_DEPTH_IMAGE = 1 << 1,        //!< pushDepthImage
+    CAP_DEPTH_IMAGE_FLOAT = 1 << 2,  //!< pushDepthImageFloat
+  };
+
   Output3DWrapper() {}
   virtual ~Output3DWrapper() {}
 
+  /* Usage:
+   * The Capability flags of the render callbacks this wrapper consumes. The
+   * others are not called, and if no wrapper has a flag the image is not
+   * rendered at all. Asked again for every frame, so it may change while
+   * running (e.g. with the display options of a viewer).
+   *
+   * Wrappers overriding pushLiveFrame, pushDepthImage or pushDepthImageFloat
+   * have to return their flag, the default is none.
+   */
+  virtual int capabilities() { return 0; }
+
+  //! Whether any of wraps has capability.
+  static bool anyCapable(const std::vector<Output3DWrapper*>& wraps,
+                         const Capability capability) {
+    for (Output3DWrapper* ow : wraps) {
+      if (ow->capabilities() & capability) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   /*  Usage:
    *  Called once after each new Keyframe is inserted & optimized.
    *  [connectivity] contains for each frame-frame pair the number of [0] active
@@ -110,9 +140,7 @@ class Output3DWrapper {
    *  Always called, no overhead if not used.
    */
   virtual void publishGraph(
-      const std::map<uint64_t, Eigen::Vector2i, std::less<uint64_t>,
-                     Eigen::aligned_allocator<std::pair<
-                         const uint64_t, Eigen::Vector2i> > >& connectivity) {}
+      const FlatHashMap<Eigen::Vector2i>& connectivity) {}
 
   /* Usage:
    * Called after each new Keyframe is inserted & optimized, with all keyframes
@@ -150,21 +178,32 @@ class Output3DWrapper {
    * a pose yet).
    *
    * Calling:
-   * Always called, no overhead if not used.
+   * Only called with CAP_LIVE_FRAME.
    */
   virtual void pushLiveFrame(FrameHessian* image) {}
 
+  /* Usage:
+   * Called for each incoming frame the tracker skipped because it arrived after
+   * its tracking deadline (Settings::trackingDeadlineFactor), with its id, its
+   * timestamp and by how many ms it was late. The frame is not tracked and
+   * gets no pose.
+   *
+   * Calling:
+   * Only called in deadline mode, no overhead if not used.
+   */
+  virtual void publishSkippedFrame(int incomingId, double timestamp,
+                                   double lateMs) {}
+
   /* called once after a new keyframe is created, with the color-coded,
    * forward-warped inverse depthmap for that keyframe,
    * which is used for initial alignment of future frames. Meant for
    * visualization.
    *
    * Calling:
-   * Needs to prepare the depth image, so it is only called if
-   * [needPushDepthImage()] returned true.
+   * Needs to prepare the depth image (sorting all inverse depths), so it is
+   * only made and called with CAP_DEPTH_IMAGE.
    */
   virtual void pushDepthImage(MinimalImageB3* image) {}
-  virtual bool needPushDepthImage() { return false; }
 
   /* Usage:
    * called once after a new keyframe is created, with the forward-warped
@@ -173,7 +212,7 @@ class Output3DWrapper {
    * value)
    *
    * Calling:
-   * Always called, almost no overhead if not used.
+   * Only called with CAP_DEPTH_IMAGE_FLOAT.
    */
   virtual void pushDepthImageFloat(MinimalImageF* image, FrameHessian* KF) {}
 
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+
+#include <boost/thread.hpp>
+
+#include "io_wrapper/output_3d_wrapper.h"
+
+namespace dso {
+
+class FrameHessian;
+class CalibHessian;
+class FrameShell;
+
+namespace IOWrap {
+
+/** \brief Runs the callbacks of another wrapper on its own publisher thread
+ *
+ *  The callbacks of this wrapper run on the tracking and mapping thread like
+ *  any other, but only copy their arguments into a snapshot and queue it:
+ *  frames with their own FrameShell, points and immature points (detached,
+ *  without residuals), CalibHessian, graph and images. The publisher thread
+ *  hands the snapshots to the wrapped wrapper and deletes them afterwards.
+ *  A slow wrapped wrapper therefore only delays itself, never SLAM.
+ *
+ *  Snapshot frames carry poses, states and points. Only pushLiveFrame copies
+ *  an image, and only level 0 (dI) of it.
+ *
+ *  At most capacity snapshots are queued, what happens with further ones is
+ *  the Backpressure policy. Final keyframes (publishKeyframes, final=true) and
+ *  reset() are never dropped, getNumDropped() counts the rest.
+ *
+ *  Only wrap wrappers that do not keep the pointers they get past the call
+ *  (e.g. not TrajectoryOutputWrapper, which reads the shells later).
+ */
+class AsyncOutputWrapper : public Output3DWrapper {
+ public:
+  enum Backpressure {
+    BLOCK = 0,        //!< the caller waits for space
+    DROP_NEWEST = 1,  //!< the new snapshot is dropped
+    DROP_OLDEST = 2   //!< the oldest droppable queued snapshot is dropped
+  };
+
+  //! Takes ownership of wrapped.
+  AsyncOutputWrapper(Output3DWrapper* wrapped, const size_t capacity,
+                     const Backpressure policy);
+
+  //! Deliver what is queued, stop the publisher thread and delete wrapped.
+  virtual ~AsyncOutputWrapper();
+
+  virtual void publishGraph(
+      const FlatHashMap<Eigen::Vector2i>& connectivity) override;
+
+  virtual void publishKeyframes(std::vector<FrameHessian*>& frames, bool final,
+                                CalibHessian* HCalib) override;
+
+  virtual void publishCamPose(FrameShell* frame,
+                              CalibHessian* HCalib) override;
+
+  virtual void pushLiveFrame(FrameHessian* image) override;
+
+  virtual void publishSkippedFrame(int incomingId, double timestamp,
+                                   double lateMs) override;
+
+  virtual void pushDepthImage(MinimalImageB3* image) override;
+
+  //! Asks the wrapped wrapper directly, nothing is copied for the others.
+  virtual int capabilities() override;
+
+  virtual void pushDepthImageFloat(MinimalImageF* image,
+                                   FrameHessian* KF) override;
+
+  //! Wait until everything queued was delivered, then join the wrapped one.
+  virtual void join() override;
+
+  //! Drop what is queued and reset the wrapped wrapper on the publisher thread.
+  virtual void reset() override;
+
+  uint64_t getNumDropped() const;
+
+  Output3DWrapper* getWrapped() const { return wrapped; }
+
+ private:
+  struct Snapshot;
+
+  void push(Snapshot* snapshot);
+
+  void publisherLoop();
+
+  Output3DWrapper* const wrapped;
+  const size_t capacity;
+  const Backpressure policy;
+
+  mutable boost::mutex queueMutex;
+  boost::condition_variable queueSignal;  //!< something was queued, or stop
+  boost::condition_variable spaceSignal;  //!< something was taken
+  std::deque<Snapshot*> queue;            //!< [queueMutex]
+  bool busy;                              //!< [queueMutex] delivering one
+  bool running;                           //!< [queueMutex]
+  uint64_t numDropped;                    //!< [queueMutex]
+
+  boost::thread publisherThread;
+};
+
+}  // namespace IOWrap
+
+}  // namespace dso
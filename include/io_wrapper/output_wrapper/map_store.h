@@ -0,0 +1,149 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "io_wrapper/output_3d_wrapper.h"
+#include "util/flat_hash_map.h"
+#include "util/memory_stats.h"
+
+namespace dso {
+
+class FrameHessian;
+class CalibHessian;
+
+namespace IOWrap {
+
+/** \brief Out-of-core store of the marginalized points of final keyframes
+ *
+ *  publishKeyframes() converts the points of final keyframes into world
+ *  coordinates, a writer thread sorts them into cubic cells of cellSize and
+ *  appends them to one file per cell in dir. Only the index (cell -> number
+ *  of points) and up to cachePoints points of recently queried cells stay in
+ *  memory, least recently used cells are evicted first, so memory stays flat
+ *  however long the session runs.
+ *
+ *  The viewer and the export query the store instead of keeping their own
+ *  copy of the map: query() for the cells around a position, forEachPoint()
+ *  for all of them. Both are thread safe against the writer thread.
+ */
+class MapStore : public Output3DWrapper {
+ public:
+#pragma pack(push, 1)
+  struct Point {
+    float x, y, z;
+    float intensity;
+    float idepth;
+    float idepthVar;
+    float relObsBaseline;
+    int32_t keyframe;
+  };
+#pragma pack(pop)
+
+  //! Use (and empty) the directory dir, created if missing.
+  MapStore(const std::string& dir, float cellSize, size_t cachePoints);
+
+  //! Write the queued points and remove the cell files.
+  virtual ~MapStore();
+
+  virtual void publishKeyframes(std::vector<FrameHessian*>& frames,
+                                bool is_final, CalibHessian* HCalib) override;
+
+  //! Write the queued points.
+  virtual void join() override;
+
+  //! Drop all points, e.g. for a new map.
+  virtual void reset() override;
+
+  /** \brief Append the points of the cells within radius of center to out
+   *
+   *  The cells are loaded through the cache, the last ones queried are the
+   *  last to be evicted.
+   */
+  void query(const Eigen::Vector3f& center, float radius,
+             std::vector<Point>* out);
+
+  /** \brief Call fn for every point written so far, cell by cell
+   *
+   *  Reads the cells from disk without putting them into the cache.
+   */
+  template <typename Fn>
+  void forEachPoint(Fn fn) {
+    boost::unique_lock<boost::mutex> lock(storeMutex);
+    std::vector<Point> points;
+    for (const auto& it : cells) {
+      readCell(*it.second, &points);
+      for (const Point& p : points) {
+        fn(p);
+      }
+    }
+  }
+
+  //! Changes whenever points were added or dropped.
+  uint64_t version() const;
+
+  uint64_t numPoints() const;
+
+  /** \brief Export all points into a PLY as written by PlyOutputWrapper
+   *
+   *  @return false if path cannot be written
+   */
+  bool writePly(const std::string& path);
+
+ private:
+  struct Cell {
+    int x, y, z;
+    uint64_t numPoints;           //!< in the file
+    bool cached;                  //!< points holds the file contents
+    std::vector<Point> points;    //!< if cached
+    std::list<Cell*>::iterator lru;
+  };
+
+  static uint64_t cellKey(int x, int y, int z);
+  std::string cellPath(const Cell& cell) const;
+
+  //! Append points to the file of their cell (and its cached copy).
+  //! [storeMutex]
+  void appendToCell(Cell* cell, const std::vector<Point>& points);
+  //! The points in the file of cell. [storeMutex]
+  void readCell(const Cell& cell, std::vector<Point>* points) const;
+  //! Load cell if needed and make it the most recently used. [storeMutex]
+  void touchCell(Cell* cell);
+  //! Evict least recently used cells down to cachePoints. [storeMutex]
+  void evictCells();
+  //! Delete the cell files, empty index and cache. [storeMutex]
+  void clearCells();
+
+  void writerLoop();
+
+  const std::string dir;
+  const float cellSize;
+  const size_t cachePoints;
+
+  boost::mutex queueMutex;
+  boost::condition_variable queueSignal;
+  boost::condition_variable idleSignal;
+  std::deque<std::vector<Point>> queue;  //!< [queueMutex]
+  bool writing;                          //!< [queueMutex] a chunk is taken
+  bool running;                          //!< [queueMutex]
+
+  mutable boost::mutex storeMutex;
+  FlatHashMap<Cell*> cells;       //!< [storeMutex] owned
+  std::list<Cell*> lru;           //!< [storeMutex] cached cells, newest first
+  size_t numCachedPoints;         //!< [storeMutex]
+  uint64_t numStoredPoints;       //!< [storeMutex]
+  uint64_t storeVersion;          //!< [storeMutex]
+
+  MemoryAccount memory{MEM_MAP_STORE};
+
+  boost::thread writerThread;
+};
+
+}  // namespace IOWrap
+
+}  // namespace dso
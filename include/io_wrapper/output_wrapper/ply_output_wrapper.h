@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "io_wrapper/output_3d_wrapper.h"
+
+namespace dso {
+
+class FrameHessian;
+class CalibHessian;
+
+namespace IOWrap {
+
+/** \brief Streams the marginalized points of final keyframes into a binary PLY
+ *
+ *  publishKeyframes() runs on the mapping thread and only converts the points
+ *  of a keyframe into one chunk, which a writer thread appends to the file.
+ *  The vertex count in the header is written as a fixed width placeholder and
+ *  patched when the wrapper is destroyed.
+ *
+ *  Every vertex holds the world position, the host intensity, the inverse
+ *  depth with its variance and the incoming id of the host keyframe.
+ *  WriteXyz() converts such a file into the former text result_map.xyz.
+ */
+class PlyOutputWrapper : public Output3DWrapper {
+ public:
+#pragma pack(push, 1)
+  struct Vertex {
+    float x, y, z;
+    float intensity;
+    float idepth;
+    float idepthVar;
+    int32_t keyframe;
+  };
+#pragma pack(pop)
+
+  //! Open path and start the writer thread.
+  explicit PlyOutputWrapper(const std::string& path = "result_map.ply");
+
+  //! Write the queued chunks, patch the vertex count and close the file.
+  virtual ~PlyOutputWrapper();
+
+  virtual void publishKeyframes(std::vector<FrameHessian*>& frames,
+                                bool is_final, CalibHessian* HCalib) override;
+
+  /** \brief Convert a PLY written by this wrapper into `x y z` text lines
+   *
+   *  @return false if ply cannot be read or xyz cannot be written
+   */
+  static bool WriteXyz(const std::string& ply, const std::string& xyz);
+
+  /** \brief Write the header of a PLY of count Vertex to out
+   *
+   *  @return position of the fixed width vertex count, to patch it later
+   */
+  static std::streampos WriteHeader(std::ostream& out, uint64_t count);
+
+ private:
+  void writerLoop();
+
+  std::string path;
+  std::ofstream file;
+  std::streampos countPos;  //!< of the vertex count placeholder
+  uint64_t numWritten;      //!< [writer thread]
+
+  boost::mutex queueMutex;
+  boost::condition_variable queueSignal;
+  std::deque<std::vector<Vertex>> queue;  //!< [queueMutex]
+  bool running;                           //!< [queueMutex]
+
+  boost::thread writerThread;
+};
+
+}  // namespace IOWrap
+
+}  // namespace dso
@@ -27,15 +27,12 @@ class SampleOutputWrapper : public Output3DWrapper {
   }
 
   virtual void publishGraph(
-      const std::map<
-          uint64_t, Eigen::Vector2i, std::less<uint64_t>,
-          Eigen::aligned_allocator<std::pair<const uint64_t, Eigen::Vector2i>>>&
-          connectivity) override {
+      const FlatHashMap<Eigen::Vector2i>& connectivity) override {
     LOG(INFO) << "OUT: Got graph with " << connectivity.size() << " edges.";
 
     int maxWrite = 5;
 
-    for (const std::pair<uint64_t, Eigen::Vector2i> p : connectivity) {
+    for (const std::pair<uint64_t, Eigen::Vector2i>& p : connectivity) {
       int idHost = p.first >> 32;
       int idTarget = p.first & ((uint64_t)0xFFFFFFFF);
       LOG(INFO) << "OUT: Example Edge " << idHost << " -> " << idTarget
@@ -80,6 +77,9 @@ class SampleOutputWrapper : public Output3DWrapper {
               << "). CameraToWorld: " << frame->camToWorld.matrix3x4();
   }
 
+  // add CAP_LIVE_FRAME / CAP_DEPTH_IMAGE to get the callbacks below.
+  virtual int capabilities() override { return CAP_DEPTH_IMAGE_FLOAT; }
+
   virtual void pushLiveFrame(FrameHessian* image) override {
     // can be used to get the raw image / intensity pyramid.
   }
@@ -87,7 +87,6 @@ class SampleOutputWrapper : public Output3DWrapper {
   virtual void pushDepthImage(MinimalImageB3* image) override {
     // can be used to get the raw image with depth overlay.
   }
-  virtual bool needPushDepthImage() override { return false; }
 
   virtual void pushDepthImageFloat(MinimalImageF* image,
                                    FrameHessian* KF) override {
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "io_wrapper/output_3d_wrapper.h"
+#include "io_wrapper/output_wrapper/shm_ring.h"
+
+namespace dso {
+
+class FrameHessian;
+class CalibHessian;
+class FrameShell;
+
+namespace IOWrap {
+
+/** \brief Publishes poses and points into a ShmRing for other processes
+ *
+ *  Every callback converts its data into one message (point clouds into as
+ *  many as needed to fit the slots) and copies it into the ring, nothing is
+ *  allocated or waited for. Messages, all little endian:
+ *  - MSG_CAM_POSE: one Pose per tracked frame (publishCamPose),
+ *  - MSG_KEYFRAMES: a Pose per keyframe of the window after every window
+ *    optimization (publishKeyframes, final=false), or the single keyframe
+ *    about to be marginalized (final=true, Pose::final set),
+ *  - MSG_POINTS: PointsHeader and its Points, the marginalized points of a
+ *    final keyframe in world coordinates.
+ *
+ *  The tracking and the mapping thread publish, their writes are serialized
+ *  by writeMutex; readers never take it. See app/shm_dump.cc for a reader.
+ */
+class ShmOutputWrapper : public Output3DWrapper {
+ public:
+  enum MessageType { MSG_CAM_POSE = 1, MSG_KEYFRAMES = 2, MSG_POINTS = 3 };
+
+#pragma pack(push, 1)
+  struct Pose {
+    int32_t id;          //!< FrameShell id
+    int32_t incomingId;  //!< id passed into DSO
+    int32_t keyframeId;  //!< FrameHessian frameID, -1 for MSG_CAM_POSE
+    int32_t final;       //!< no further updates of this pose will come
+    double timestamp;
+    double camToWorld[7];  //!< qx qy qz qw tx ty tz
+    float calib[4];        //!< fx fy cx cy of level 0
+  };
+
+  struct PointsHeader {
+    int32_t incomingId;  //!< of the host keyframe
+    uint32_t first;      //!< index of the first point of this message
+    uint32_t num;        //!< points in this message
+    uint32_t total;      //!< points of the keyframe over all its messages
+  };
+
+  struct Point {
+    float x, y, z;
+    float intensity;
+    float idepth;
+    float idepthVar;
+  };
+#pragma pack(pop)
+
+  /** \brief Create the ring name with numSlots of slotSize bytes
+   *
+   *  The ring is removed again by the destructor.
+   */
+  ShmOutputWrapper(const std::string& name, const uint32_t numSlots = 256,
+                   const uint32_t slotSize = 64 * 1024);
+
+  virtual ~ShmOutputWrapper();
+
+  virtual void publishKeyframes(std::vector<FrameHessian*>& frames, bool final,
+                                CalibHessian* HCalib) override;
+
+  virtual void publishCamPose(FrameShell* frame,
+                              CalibHessian* HCalib) override;
+
+ private:
+  void publishPoints(const FrameHessian* const frame,
+                     CalibHessian* const HCalib);
+
+  ShmRing ring;
+
+  boost::mutex writeMutex;
+  std::vector<Pose> poses;    //!< [writeMutex] buffer of MSG_KEYFRAMES
+  std::vector<char> message;  //!< [writeMutex] buffer of MSG_POINTS
+  uint64_t numMessages;       //!< [writeMutex]
+};
+
+}  // namespace IOWrap
+
+}  // namespace dso
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace dso {
+namespace IOWrap {
+
+/** \brief Message ring in POSIX shared memory, one writer, any readers
+ *
+ *  The segment holds a Header and numSlots slots of slotSize payload bytes.
+ *  Message i goes into slot i % numSlots. Every slot is a seqlock: its seq is
+ *  2i + 1 while message i is written and 2i + 2 once it is complete, so a
+ *  reader checks seq before and after looking at the payload and retries or
+ *  skips ahead if the writer got there in between. The writer never waits
+ *  for readers, a reader more than numSlots messages behind loses messages
+ *  (RING_LAPPED) instead of slowing it down.
+ *
+ *  Readers in other processes can work on the payload in place (beginRead /
+ *  endRead) or copy it out (read).
+ */
+class ShmRing {
+ public:
+  static const char kMagic[8];
+  static const uint32_t kVersion = 1;
+  //! Header and slots start on their own cache lines.
+  static const uint32_t kAlignment = 64;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t numSlots;
+    uint32_t slotSize;    //!< payload bytes per slot
+    uint32_t slotStride;  //!< bytes between two slots
+    std::atomic<uint64_t> head;  //!< number of messages published
+  };
+
+  struct Slot {
+    std::atomic<uint64_t> seq;
+    uint32_t type;
+    uint32_t size;  //!< payload bytes of the message
+  };
+
+  enum ReadResult { RING_OK, RING_EMPTY, RING_LAPPED };
+
+  //! A message mapped in place, valid until endRead() says otherwise.
+  struct View {
+    uint64_t index;
+    uint64_t seq;
+    uint32_t type;
+    uint32_t size;
+    const char* data;
+  };
+
+  /** \brief Create (or replace) the segment name as its writer
+   *
+   *  The segment is unlinked again by the destructor.
+   */
+  ShmRing(const std::string& name, const uint32_t numSlots,
+          const uint32_t slotSize);
+
+  //! Map the existing segment name read only.
+  explicit ShmRing(const std::string& name);
+
+  ~ShmRing();
+
+  //! false if the segment could not be created or mapped.
+  bool valid() const { return header != nullptr; }
+
+  uint32_t getSlotSize() const { return header->slotSize; }
+
+  //! Number of messages published so far, i.e. the index of the next one.
+  uint64_t getHead() const {
+    return header->head.load(std::memory_order_acquire);
+  }
+
+  /** \brief Publish size (<= getSlotSize()) bytes as message of type
+   *
+   *  Single writer: callers from several threads have to serialize.
+   */
+  void write(const uint32_t type, const void* const data, const uint32_t size);
+
+  /** \brief Map message index in place
+   *
+   *  RING_EMPTY if it is not published yet, RING_LAPPED if it was already
+   *  overwritten (continue at getHead() - numSlots or later).
+   */
+  ReadResult beginRead(const uint64_t index, View* const view) const;
+
+  //! true if view was not overwritten while reading it.
+  bool endRead(const View& view) const;
+
+  /** \brief Copy message index into data (getSlotSize() bytes)
+   *
+   *  Retries if the writer was in the slot meanwhile.
+   */
+  ReadResult read(const uint64_t index, uint32_t* const type, void* const data,
+                  uint32_t* const size) const;
+
+ private:
+  Slot* slot(const uint64_t index) const {
+    return reinterpret_cast<Slot*>(base + kAlignment +
+                                   (index % header->numSlots) *
+                                       header->slotStride);
+  }
+
+  std::string name;
+  bool owner;
+  size_t mappedSize;
+  char* base;
+  Header* header;
+};
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "io_wrapper/output_3d_wrapper.h"
+
+namespace dso {
+
+class FrameHessian;
+class CalibHessian;
+class FrameShell;
+
+namespace IOWrap {
+
+/** \brief Writes the trajectory incrementally, pose by pose as it gets final
+ *
+ *  The same poses as FullSystem::printResult, in the TUM format
+ *  [timestamp x y z qx qy qz qw] of camToWorld, but appended as soon as they
+ *  no longer change instead of all at the end of the run:
+ *  - keyframes when they are marginalized (publishKeyframes, final=true),
+ *  - other frames (without setting_onlyLogKFPoses) once the next keyframe is
+ *    made, i.e. their pose relative to their reference was mapped.
+ *  The lines are therefore ordered by finalization, not by timestamp.
+ *
+ *  The callbacks only format the lines into a buffer. A writer thread appends
+ *  and fsyncs it every syncIntervalMs, so a crash loses at most that much.
+ *  join() has to be called before the FullSystem is deleted: it writes the
+ *  frames still pending (and without setting_onlyLogKFPoses the keyframes
+ *  still in the window) and flushes.
+ */
+class TrajectoryOutputWrapper : public Output3DWrapper {
+ public:
+  TrajectoryOutputWrapper(const std::string& path, const int syncIntervalMs);
+
+  //! join() if not done yet.
+  virtual ~TrajectoryOutputWrapper();
+
+  virtual void publishKeyframes(std::vector<FrameHessian*>& frames, bool final,
+                                CalibHessian* HCalib) override;
+
+  virtual void publishCamPose(FrameShell* frame,
+                              CalibHessian* HCalib) override;
+
+  virtual void join() override;
+
+  //! The FullSystem (and its shells) is gone, forget the pending frames.
+  virtual void reset() override;
+
+ private:
+  //! Format the pose of shell into buffer. [mutex]
+  void append(const FrameShell* const shell);
+
+  void writerLoop();
+
+  std::string path;
+  const int syncIntervalMs;
+  const bool onlyKeyframes;
+  int fd;
+
+  boost::mutex mutex;
+  boost::condition_variable stopSignal;
+  std::string buffer;                    //!< [mutex] not yet written lines
+  std::vector<FrameShell*> pending;      //!< [mutex] tracked, not mapped
+  std::map<int, FrameShell*> keyframes;  //!< [mutex] window KFs by id
+  bool running;                          //!< [mutex]
+  long numWritten;                       //!< [mutex]
+
+  boost::thread writerThread;
+};
+
+}  // namespace IOWrap
+
+}  // namespace dso
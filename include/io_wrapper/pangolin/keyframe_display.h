@@ -4,9 +4,12 @@
 
 #include <fstream>
 #include <sstream>
+#include <vector>
 
 #include <pangolin/pangolin.h>
 
+#include "io_wrapper/output_wrapper/map_store.h"
+#include "util/memory_stats.h"
 #include "util/num_type.h"
 
 namespace dso {
@@ -48,17 +51,42 @@ class KeyFrameDisplay {
   // keeping some additional information so we can render it differently.
   void setFromF(FrameShell* fs, CalibHessian* HCalib);
 
+  //! Take over the points, pose and calibration of other (which is left
+  //! with the old ones), e.g. a newer copy of the same keyframe.
+  void takeDataFrom(KeyFrameDisplay* other);
+
+  //! Camera only (pose and calibration) of other, no points.
+  void copyCamFrom(const KeyFrameDisplay& other);
+
   // copies & filters internal data to GL buffer for rendering. if nothing to
   // do: does nothing.
   bool refreshPC(bool canRefresh, float scaledTH, float absTH, int mode,
                  float minBS, int sparsity);
 
+  /** \brief Append the points passing the display filters to vertices
+   *
+   *  In camera coordinates, or (inWorld) transformed by camToWorld. Every
+   *  pattern pixel of a point is one vertex, colors get one entry per vertex.
+   */
+  void makeVertices(float scaledTH, float absTH, int mode, float minBS,
+                    int sparsity, bool inWorld, std::vector<Vec3f>* vertices,
+                    std::vector<Vec3b>* colors) const;
+
+  //! Free the GL buffers, e.g. once the points are drawn by a KeyFrameChunk.
+  void releaseBuffers();
+
+  //! Free the points and GL buffers, only the camera is drawn from now on,
+  //! e.g. once the points are drawn from a MapStore.
+  void releasePoints();
+
   // renders cam & pointcloud.
   void drawCam(float lineWidth = 1, float* color = 0, float sizeFactor = 1);
   void drawPC(float pointSize);
 
   int id;
   bool active;
+  //! Marginalized, its points and pose will not change anymore.
+  bool final;
   SE3 camToWorld;
 
   inline bool operator<(const KeyFrameDisplay& other) const {
@@ -66,6 +94,9 @@ class KeyFrameDisplay {
   }
 
  private:
+  //! Sets memory to the bytes of the point buffers.
+  void accountMemory();
+
   float fx, fy, cx, cy;
   float fxi, fyi, cxi, cyi;
   int width, height;
@@ -79,12 +110,123 @@ class KeyFrameDisplay {
   int numSparsePoints;
   int numSparseBufferSize;
   InputPointSparse<MAX_RES_PER_POINT>* originalInputSparse;
+  int pattern;  // residual pattern of the points, Settings::pattern.
 
   bool bufferValid;
   int numGLBufferPoints;
   int numGLBufferGoodPoints;
   pangolin::GlBuffer vertexBuffer;
   pangolin::GlBuffer colorBuffer;
+
+  // kept between refreshes instead of reallocated.
+  std::vector<Vec3f> tmpVertexBuffer;
+  std::vector<Vec3b> tmpColorBuffer;
+
+  MemoryAccount memory{MEM_VIEWER};
+};
+
+/** \brief Points of up to kMaxKeyframes final keyframes in one buffer
+ *
+ *  Final keyframes do not change anymore, so their points are transformed
+ *  into world coordinates once and drawn together with a single draw call
+ *  instead of one per keyframe. The buffer is only rebuilt and uploaded when
+ *  a keyframe is added or the display filters change.
+ *
+ *  draw() skips chunks outside the view frustum and thins out distant ones:
+ *  seen from more than 4 of its radii away, only every n-th point is drawn
+ *  (level of detail, n growing with the distance up to kMaxLod).
+ */
+class KeyFrameChunk {
+ public:
+  static const int kMaxKeyframes = 32;
+  static const int kMaxLod = 8;
+
+  KeyFrameChunk();
+
+  bool full() const {
+    return static_cast<int>(members.size()) >= kMaxKeyframes;
+  }
+
+  //! kf is not owned and has to stay alive as long as the chunk.
+  void add(KeyFrameDisplay* kf);
+
+  //! Rebuild and upload the buffer if keyframes were added or the filters
+  //! changed since the last call.
+  void refresh(float scaledTH, float absTH, int mode, float minBS,
+               int sparsity);
+
+  //! mvp: projection * modelview of the view, eye: its camera center.
+  void draw(float pointSize, const Eigen::Matrix4d& mvp,
+            const Eigen::Vector3d& eye);
+
+ private:
+  bool isOutside(const Eigen::Matrix4d& mvp) const;
+
+  //! Sets memory to the bytes of the point buffers.
+  void accountMemory();
+
+  std::vector<KeyFrameDisplay*> members;
+  bool dirty;
+  float my_scaledTH, my_absTH;
+  int my_displayMode;
+  float my_minRelBS;
+  int my_sparsifyFactor;
+
+  std::vector<Vec3f> vertices;
+  std::vector<Vec3b> colors;
+  Eigen::Vector3d boxMin, boxMax;
+
+  int numGLBufferPoints;
+  int numGLBufferGoodPoints;
+  pangolin::GlBuffer vertexBuffer;
+  pangolin::GlBuffer colorBuffer;
+
+  MemoryAccount memory{MEM_VIEWER};
+};
+
+/** \brief Points of a MapStore around the eye in one buffer
+ *
+ *  Replaces the KeyFrameChunks if the viewer has a MapStore, the final
+ *  keyframes then only keep their camera. The points within radius of the
+ *  eye are queried again when the store changed, the display filters changed
+ *  or the eye moved by more than a quarter of radius. The store only holds
+ *  marginalized points, they are drawn like those of a keyframe.
+ */
+class MapStoreView {
+ public:
+  //! store is not owned and has to outlive the view.
+  MapStoreView(MapStore* store, float radius);
+
+  void refresh(const Eigen::Vector3d& eye, float scaledTH, float absTH,
+               int mode, float minBS, int sparsity);
+
+  void draw(float pointSize);
+
+ private:
+  //! Sets memory to the bytes of the point buffers.
+  void accountMemory();
+
+  MapStore* store;
+  const float radius;
+
+  bool valid;
+  uint64_t my_storeVersion;
+  Eigen::Vector3f my_center;
+  float my_scaledTH, my_absTH;
+  int my_displayMode;
+  float my_minRelBS;
+  int my_sparsifyFactor;
+
+  std::vector<MapStore::Point> points;
+  std::vector<Vec3f> vertices;
+  std::vector<Vec3b> colors;
+
+  int numGLBufferPoints;
+  int numGLBufferGoodPoints;
+  pangolin::GlBuffer vertexBuffer;
+  pangolin::GlBuffer colorBuffer;
+
+  MemoryAccount memory{MEM_VIEWER};
 };
 }  // namespace IOWrap
 }  // namespace dso
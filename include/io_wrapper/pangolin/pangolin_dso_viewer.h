@@ -2,12 +2,14 @@
 
 #include <deque>
 #include <map>
+#include <vector>
 
 #include <pangolin/pangolin.h>
 #include <boost/thread.hpp>
 
 #include "io_wrapper/output_3d_wrapper.h"
 #include "util/minimal_image.h"
+#include "util/settings.h"
 
 namespace dso {
 
@@ -18,6 +20,9 @@ class FrameShell;
 namespace IOWrap {
 
 class KeyFrameDisplay;
+class KeyFrameChunk;
+class MapStore;
+class MapStoreView;
 
 struct GraphConnection {
   KeyFrameDisplay* from;
@@ -34,36 +39,62 @@ class PangolinDSOViewer : public Output3DWrapper {
   void run();
   void close();
 
+  /** \brief Settings the GUI sliders adjust, e.g. &FullSystem::settings
+   *
+   *  nullptr (the default) for none, e.g. while the FullSystem is replaced.
+   */
+  void setSettings(Settings* settings);
+
+  /** \brief Draw the final keyframes from store, before run()
+   *
+   *  Their points are then dropped by the viewer, only those of store within
+   *  radius of the eye are drawn. store has to outlive the viewer.
+   */
+  void setMapStore(MapStore* store, float radius);
+
   void addImageToDisplay(std::string name, MinimalImageB3* image);
   void clearAllImagesToDisplay();
 
   // ==================== Output3DWrapper Functionality ======================
   virtual void publishGraph(
-      const std::map<
-          uint64_t, Eigen::Vector2i, std::less<uint64_t>,
-          Eigen::aligned_allocator<std::pair<const uint64_t, Eigen::Vector2i>>>&
-          connectivity) override;
+      const FlatHashMap<Eigen::Vector2i>& connectivity) override;
   virtual void publishKeyframes(std::vector<FrameHessian*>& frames, bool final,
                                 CalibHessian* HCalib) override;
   virtual void publishCamPose(FrameShell* frame, CalibHessian* HCalib) override;
 
   virtual void pushLiveFrame(FrameHessian* image) override;
   virtual void pushDepthImage(MinimalImageB3* image) override;
-  virtual bool needPushDepthImage() override;
+  //! The video and depth image, if shown.
+  virtual int capabilities() override;
 
   virtual void join() override;
 
   virtual void reset() override;
 
  private:
+  //! A keyframe copied by publishKeyframes, not yet merged by the viewer.
+  struct PendingKeyframe {
+    int frameID;
+    bool final;
+    KeyFrameDisplay* display;
+  };
+
   bool needReset;
   void reset_internal();
   void drawConstraints();
 
+  //! Swap out what the callbacks published since the last frame and merge it
+  //! into the render state, holding model3DMutex only for the swap.
+  void applyUpdates();
+  void rebuildConnections(const FlatHashMap<Eigen::Vector2i>& connectivity);
+
   boost::thread runThread;
   bool running;
   int w, h;
 
+  boost::mutex settingsMutex;
+  Settings* settings;  //!< [settingsMutex]
+
   // images rendering
   boost::mutex openImagesMutex;
   MinimalImageB3* internalVideoImg;
@@ -71,14 +102,28 @@ class PangolinDSOViewer : public Output3DWrapper {
   MinimalImageB3* internalResImg;
   bool videoImgChanged, kfImgChanged, resImgChanged;
 
-  // 3D model rendering
+  // 3D model rendering, published by the callbacks.
   boost::mutex model3DMutex;
-  KeyFrameDisplay* currentCam;
+  KeyFrameDisplay* currentCam;                    //!< [model3DMutex]
+  std::vector<PendingKeyframe> pendingKeyframes;  //!< [model3DMutex]
+  std::vector<KeyFrameDisplay*> spareDisplays;    //!< [model3DMutex] reused
+  FlatHashMap<Eigen::Vector2i> pendingGraph;      //!< [model3DMutex]
+  bool graphChanged;                              //!< [model3DMutex]
+  //! [model3DMutex] poses of tracked frames not yet in allFramePoses.
+  std::vector<Vec3f, Eigen::aligned_allocator<Vec3f>> pendingFramePoses;
+
+  // 3D model rendering, owned by the run thread.
+  KeyFrameDisplay* currentCamDraw;
   std::vector<KeyFrameDisplay*> keyframes;
   std::vector<Vec3f, Eigen::aligned_allocator<Vec3f>> allFramePoses;
   std::map<int, KeyFrameDisplay*> keyframesByKFID;
   std::vector<GraphConnection, Eigen::aligned_allocator<GraphConnection>>
       connections;
+  //! Final keyframes, drawn in chunks instead of one by one.
+  std::vector<KeyFrameChunk*> chunks;
+  //! Instead of chunks, if there is a MapStore.
+  MapStoreView* mapView;
+  std::vector<KeyFrameDisplay*> retiredDisplays;  //!< back to spareDisplays
 
   // render settings
   bool settings_showKFCameras;
@@ -1,21 +1,27 @@
 #pragma once
 
 #include <math.h>
+
+#include <algorithm>
 #include <vector>
 
 #include "optimization_backend/accumulators/matrix_accumulators.h"
 #include "util/index_thread_reduce.h"
+#include "util/memory_stats.h"
 #include "util/num_type.h"
 
 namespace dso {
 
 class EFPoint;
+class EFResidual;
 class EnergyFunctional;
 
 class AccumulatedSCHessianSSE {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  inline AccumulatedSCHessianSSE() {
+  //! maxFrames - window size the accumulators keep room for.
+  explicit inline AccumulatedSCHessianSSE(const int maxFrames)
+      : maxFrames(maxFrames) {
     for (int i = 0; i < NUM_THREADS; ++i) {
       accE[i] = 0;
       accEB[i] = 0;
@@ -23,92 +29,30 @@ public:
       nframes[i] = 0;
     }
   };
-  inline ~AccumulatedSCHessianSSE() {
-    for (int i = 0; i < NUM_THREADS; ++i) {
-      if (accE[i] != 0) {
-        delete[] accE[i];
-      }
-      if (accEB[i] != 0) {
-        delete[] accEB[i];
-      }
-      if (accD[i] != 0) {
-        delete[] accD[i];
-      }
-    }
-  };
 
   inline void setZero(int n, int min = 0, int max = 1, Vec10 *stats = 0,
                       int tid = 0) {
-    if (n != nframes[tid]) {
-      if (accE[tid] != 0) {
-        delete[] accE[tid];
-      }
-      if (accEB[tid] != 0) {
-        delete[] accEB[tid];
-      }
-      if (accD[tid] != 0) {
-        delete[] accD[tid];
-      }
-      accE[tid] = new AccumulatorXX<8, CPARS>[n * n];
-      accEB[tid] = new AccumulatorX<8>[n * n];
-      accD[tid] = new AccumulatorXX<8, 8>[n * n * n];
-    }
+    // keep room for a full window, see AccumulatedTopHessianSSE::setZero.
+    const int reserve = std::max(n, maxFrames + 1);
+    accE[tid] = accEArena[tid].reset(n * n, reserve * reserve);
+    accEB[tid] = accEBArena[tid].reset(n * n, reserve * reserve);
+    accD[tid] = accDArena[tid].reset(n * n * n, reserve * reserve * reserve);
     accbc[tid].initialize();
     accHcc[tid].initialize();
-
-    for (int i = 0; i < n * n; ++i) {
-      accE[tid][i].initialize();
-      accEB[tid][i].initialize();
-
-      for (int j = 0; j < n; ++j) {
-        accD[tid][i * n + j].initialize();
-      }
-    }
     nframes[tid] = n;
   }
   void stitchDouble(MatXX &H_sc, VecX &b_sc, const EnergyFunctional *const EF,
                     int tid = 0);
   void addPoint(EFPoint *p, bool shiftPriorToZero, int tid = 0);
 
+  /** \brief Sum up the accumulators of all threads into H and b
+   *
+   *  Same scheme as AccumulatedTopHessianSSE::stitchDoubleMT: the threads'
+   *  accumulators are summed per frame pair / triple, then H is assembled per
+   *  block row in a fixed order, independent of threads and scheduling.
+   */
   void stitchDoubleMT(IndexThreadReduce<Vec10> *red, MatXX &H, VecX &b,
-                      const EnergyFunctional *const EF, bool MT) {
-    // sum up, splitting by bock in square.
-    if (MT) {
-      MatXX Hs[NUM_THREADS];
-      VecX bs[NUM_THREADS];
-      for (int i = 0; i < NUM_THREADS; ++i) {
-        assert(nframes[0] == nframes[i]);
-        Hs[i] = MatXX::Zero(nframes[0] * 8 + CPARS, nframes[0] * 8 + CPARS);
-        bs[i] = VecX::Zero(nframes[0] * 8 + CPARS);
-      }
-
-      red->reduce(boost::bind(&AccumulatedSCHessianSSE::stitchDoubleInternal,
-                              this, Hs, bs, EF, boost::placeholders::_1,
-                              boost::placeholders::_2, boost::placeholders::_3,
-                              boost::placeholders::_4),
-                  0, nframes[0] * nframes[0], 0);
-
-      // sum up results
-      H = Hs[0];
-      b = bs[0];
-
-      for (int i = 1; i < NUM_THREADS; ++i) {
-        H.noalias() += Hs[i];
-        b.noalias() += bs[i];
-      }
-    } else {
-      H = MatXX::Zero(nframes[0] * 8 + CPARS, nframes[0] * 8 + CPARS);
-      b = VecX::Zero(nframes[0] * 8 + CPARS);
-      stitchDoubleInternal(&H, &b, EF, 0, nframes[0] * nframes[0], 0, -1);
-    }
-
-    // make diagonal by copying over parts.
-    for (int h = 0; h < nframes[0]; ++h) {
-      int hIdx = CPARS + h * 8;
-      H.block<CPARS, 8>(0, hIdx).noalias() =
-          H.block<8, CPARS>(hIdx, 0).transpose();
-    }
-  }
+                      const EnergyFunctional *const EF, bool MT);
 
   AccumulatorXX<8, CPARS> *accE[NUM_THREADS];
   AccumulatorX<8> *accEB[NUM_THREADS];
@@ -116,6 +60,7 @@ public:
   AccumulatorXX<CPARS, CPARS> accHcc[NUM_THREADS];
   AccumulatorX<CPARS> accbc[NUM_THREADS];
   int nframes[NUM_THREADS];
+  int maxFrames;
 
   void addPointsInternal(std::vector<EFPoint *> *points, bool shiftPriorToZero,
                          int min = 0, int max = 1, Vec10 *stats = 0,
@@ -126,7 +71,37 @@ public:
   }
 
 private:
-  void stitchDoubleInternal(MatXX *H, VecX *b, const EnergyFunctional *const EF,
-                            int min, int max, Vec10 *stats, int tid);
+  //! The accD updates of a point: for every pair of its active residuals
+  //! (r1, r2), HdiF * r1->JpJdF * r2->JpJdF^T.
+  void addPointD(const std::vector<EFResidual *> &active, float HdiF, int tid);
+#if DSO_AVX_DISPATCH
+  //! addPointD with one AVX column per instruction, only call if useAVX().
+  DSO_TARGET_AVX void addPointDAVX(const std::vector<EFResidual *> &active,
+                                   float HdiF, int tid);
+#endif
+
+  //! Sum threads [0, numThreads) of the frame pairs [min, max) into pairE,
+  //! pairEB and of their triples into tripleD.
+  void stitchPairsInternal(int numThreads, int min, int max, Vec10 *stats,
+                           int tid);
+
+  //! Write the block rows [min, max) of H and b, row nframes[0] being the
+  //! calibration. The calibration columns are copied over afterwards.
+  void stitchRowsInternal(MatXX *H, VecX *b, const EnergyFunctional *const EF,
+                          int numThreads, int min, int max, Vec10 *stats,
+                          int tid);
+
+  AccumulatorArena<AccumulatorXX<8, CPARS>> accEArena[NUM_THREADS];
+  AccumulatorArena<AccumulatorX<8>> accEBArena[NUM_THREADS];
+  AccumulatorArena<AccumulatorXX<8, 8>> accDArena[NUM_THREADS];
+
+  std::vector<Mat8C, Eigen::aligned_allocator<Mat8C>> pairE;
+  std::vector<Vec8, Eigen::aligned_allocator<Vec8>> pairEB;
+  std::vector<Mat88, Eigen::aligned_allocator<Mat88>> tripleD;
+  std::vector<char> tripleUsed;
+  MemoryAccount pairMemory{MEM_ACCUMULATORS};
+
+  //! The active residuals of the point in addPoint, kept for their capacity.
+  std::vector<EFResidual *> activeRes[NUM_THREADS];
 };
 } // namespace dso
@@ -5,7 +5,9 @@
 
 #include "optimization_backend/accumulators/matrix_accumulators.h"
 #include "util/index_thread_reduce.h"
+#include "util/memory_stats.h"
 #include "util/num_type.h"
+#include "util/stage_timing.h"
 
 namespace dso {
 
@@ -15,7 +17,9 @@ class EnergyFunctional;
 class AccumulatedTopHessianSSE {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-  inline AccumulatedTopHessianSSE() {
+  //! maxFrames - window size the accumulators keep room for.
+  explicit inline AccumulatedTopHessianSSE(const int maxFrames)
+      : maxFrames(maxFrames) {
     for (int tid = 0; tid < NUM_THREADS; ++tid) {
       nres[tid] = 0;
       acc[tid] = 0;
@@ -23,14 +27,6 @@ public:
     }
   };
 
-  inline ~AccumulatedTopHessianSSE() {
-    for (int tid = 0; tid < NUM_THREADS; ++tid) {
-      if (acc[tid] != 0) {
-        delete[] acc[tid];
-      }
-    }
-  };
-
   //! Reset the accumulator and related variables to zero
   /*!
     Construct an accumulator to compute Hessian wrt. frames, and set initial
@@ -59,8 +55,13 @@ public:
   void addPoint(EFPoint *const p, const EnergyFunctional *const ef,
                 const int tid = 0);
 
-  //! TODO
+  //! Sum up the accumulators of all threads into H and b
   /*!
+    First the per-thread accumulators of every frame pair are summed (in
+    parallel over pairs), then H and b are assembled in parallel over block
+    rows, each row adding its pairs in a fixed order. The result does not
+    depend on the number of threads or the scheduling.
+
     @param[in] red       - sth for multi threading
     @param[in] EF        -
     @param[in] usePrior  -
@@ -73,7 +74,9 @@ public:
                       const bool MT);
 
   int nframes[NUM_THREADS];
+  int maxFrames;
 
+  //! nframes x nframes accumulators of each thread, in accArena[tid].
   EIGEN_ALIGN16 AccumulatorApprox *acc[NUM_THREADS];
 
   int nres[NUM_THREADS];
@@ -82,25 +85,33 @@ public:
   void addPointsInternal(std::vector<EFPoint *> *points,
                          const EnergyFunctional *const ef, int min = 0,
                          int max = 1, Vec10 *stats = 0, int tid = 0) {
+    ScopedStageTimer stageTimer(STAGE_ADD_POINTS);
     for (int i = min; i < max; ++i) {
       addPoint<mode>((*points)[i], ef, tid);
     }
   }
 
 private:
-  //! TODO
-  /*!
-    @param[in] EF        -
-    @param[in] usePrior  -
-    @param[in] min       -
-    @param[in] max       -
-    @param[in] stats     -
-    @param[in] tid       -
-    @param[out] H        - Hessian matrix (size = (n * (6 + 2) + 4)^2)
-    @param[out] b        - b              (size = n * (6 + 2) + 4)
-  */
-  void stitchDoubleInternal(MatXX *H, VecX *b, const EnergyFunctional *const EF,
-                            bool usePrior, int min, int max, Vec10 *stats,
-                            int tid);
+  /** \brief Sum the accumulators of threads [0, numThreads) of the frame
+   *  pairs [min, max) into pairH.
+   */
+  void stitchPairsInternal(int numThreads, int min, int max, Vec10 *stats,
+                           int tid);
+
+  /** \brief Write the block rows [min, max) of H and b from pairH
+   *
+   *  Row r < nframes is the 8 rows of frame r, row nframes the CPARS rows of
+   *  the calibration. The blocks above the diagonal are added afterwards.
+   */
+  void stitchRowsInternal(MatXX *H, VecX *b, const EnergyFunctional *const EF,
+                          bool usePrior, int min, int max, Vec10 *stats,
+                          int tid);
+
+  AccumulatorArena<AccumulatorApprox> accArena[NUM_THREADS];
+
+  //! Summed accumulators of every frame pair, see stitchPairsInternal.
+  std::vector<MatPCPC, Eigen::aligned_allocator<MatPCPC>> pairH;
+  std::vector<char> pairUsed;
+  MemoryAccount pairMemory{MEM_ACCUMULATORS};
 };
 } // namespace dso
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util/cpu_features.h"
 #include "util/num_type.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
@@ -33,6 +34,10 @@ class AccumulatorApprox {
     num = numIn1 = numIn1k = numIn1m = 0;
   }
 
+  //! Whether update() / updateSSE() was called since initialize(). The
+  //! updateTopRight / updateBotRight calls always come with one of them.
+  inline bool touched() const { return numIn1 + numIn1k + numIn1m != 0; }
+
   void finish();
 
   void updateSSE(const float* const x, const float* const y, const float a,
@@ -129,6 +134,17 @@ class AccumulatorApprox {
 
  private:
   void shiftUp(bool force);
+#if DSO_NEON
+  //! The Data part of updateSSE, a row of the upper triangle at a time:
+  //! Data(r, c) += x[c] * (a x[r] + b y[r]) + y[c] * (c y[r] + b x[r]).
+  void updateDataNEON(const float* const x, const float* const y,
+                      const float a, const float b, const float c);
+  //! updateTopRight with x, y = [x4 x6], [y4 y6].
+  void updateTopRightNEON(const float* const x, const float* const y,
+                          const float TR00, const float TR10, const float TR01,
+                          const float TR11, const float TR02,
+                          const float TR12);
+#endif
 
  private:
   EIGEN_ALIGN16 float Data[60];
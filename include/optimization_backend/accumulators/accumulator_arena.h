@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+
+#include <glog/logging.h>
+
+#include "util/memory_stats.h"
+
+namespace dso {
+
+/** \brief Cache line aligned array of accumulators that is reused across calls
+ *
+ *  Replaces new T[n] / delete[] per size change in the Hessian accumulators:
+ *  the array only grows (to at least the reserve given to reset()), so a
+ *  window that grows and shrinks by one frame every keyframe does not
+ *  reallocate. reset() only clears the entries that were updated since they
+ *  were last cleared (T::touched()), instead of zeroing the whole array.
+ *
+ *  T needs initialize() and touched().
+ */
+template <typename T>
+class AccumulatorArena {
+ public:
+  static const int kCacheLine = 64;
+
+  AccumulatorArena() : raw(nullptr), data(nullptr), capacity(0) {}
+  ~AccumulatorArena() { release(); }
+
+  AccumulatorArena(const AccumulatorArena&) = delete;
+  AccumulatorArena& operator=(const AccumulatorArena&) = delete;
+
+  /** \brief Get n zeroed accumulators
+   *
+   *  @param[in] n       - number of accumulators used from now on
+   *  @param[in] reserve - capacity to allocate if n does not fit
+   *  @return the first accumulator, valid until the next reset()
+   */
+  inline T* reset(const int n, const int reserve) {
+    if (n > capacity) {
+      allocate(std::max(n, reserve));
+    }
+    for (int i = 0; i < n; ++i) {
+      if (data[i].touched()) {
+        data[i].initialize();
+      }
+    }
+    return data;
+  }
+
+  inline int getCapacity() const { return capacity; }
+
+ private:
+  void allocate(const int n) {
+    release();
+    raw = malloc(sizeof(T) * n + kCacheLine);
+    CHECK_NOTNULL(raw);
+    memory.set(sizeof(T) * n + kCacheLine);
+    data = reinterpret_cast<T*>(
+        (reinterpret_cast<uintptr_t>(raw) + kCacheLine - 1) &
+        ~static_cast<uintptr_t>(kCacheLine - 1));
+    for (int i = 0; i < n; ++i) {
+      new (data + i) T();
+      data[i].initialize();
+    }
+    capacity = n;
+  }
+
+  void release() {
+    for (int i = 0; i < capacity; ++i) {
+      data[i].~T();
+    }
+    free(raw);
+    memory.set(0);
+    raw = nullptr;
+    data = nullptr;
+    capacity = 0;
+  }
+
+  void* raw;
+  T* data;
+  int capacity;
+  MemoryAccount memory{MEM_ACCUMULATORS};
+};
+
+}  // dso
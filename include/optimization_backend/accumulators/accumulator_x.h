@@ -20,6 +20,9 @@ class AccumulatorX {
     num = numIn1 = numIn1k = numIn1m = 0;
   }
 
+  //! Whether update() was called since initialize().
+  inline bool touched() const { return numIn1 + numIn1k + numIn1m != 0; }
+
   inline void finish() {
     shiftUp(true);
     num = numIn1 + numIn1k + numIn1m;
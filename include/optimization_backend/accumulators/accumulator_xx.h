@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util/cpu_features.h"
 #include "util/num_type.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
@@ -20,6 +21,9 @@ class AccumulatorXX {
     num = numIn1 = numIn1k = numIn1m = 0;
   }
 
+  //! Whether update() was called since initialize().
+  inline bool touched() const { return numIn1 + numIn1k + numIn1m != 0; }
+
   inline void finish() {
     shiftUp(true);
     num = numIn1 + numIn1k + numIn1m;
@@ -32,6 +36,32 @@ class AccumulatorXX {
     shiftUp(false);
   }
 
+  //! update() with the weight already in Lw = w * L, for an Lw used for
+  //! many updates.
+  inline void updateWeighted(const Eigen::Matrix<float, i, 1>& Lw,
+                             const Eigen::Matrix<float, j, 1>& R) {
+    A.noalias() += Lw * R.transpose();
+    ++numIn1;
+    shiftUp(false);
+  }
+
+#if DSO_AVX_DISPATCH
+  //! updateWeighted for 8 rows, one column of A per instruction. Only call
+  //! if useAVX().
+  DSO_TARGET_AVX inline void updateWeightedAVX(const __m256 Lw,
+                                               const float* const R) {
+    static_assert(i == 8, "updateWeightedAVX takes 8 rows");
+    float* const a = A.data();
+    for (int c = 0; c < j; ++c) {
+      _mm256_storeu_ps(a + 8 * c,
+                       _mm256_add_ps(_mm256_loadu_ps(a + 8 * c),
+                                     _mm256_mul_ps(Lw, _mm256_set1_ps(R[c]))));
+    }
+    ++numIn1;
+    shiftUp(false);
+  }
+#endif
+
  public:
   Eigen::Matrix<float, i, j> A;
   Eigen::Matrix<float, i, j> A1k;
@@ -4,5 +4,7 @@
 #include "optimization_backend/accumulators/accumulator_14.h"
 #include "optimization_backend/accumulators/accumulator_9.h"
 #include "optimization_backend/accumulators/accumulator_approx.h"
+#include "optimization_backend/accumulators/accumulator_arena.h"
 #include "optimization_backend/accumulators/accumulator_x.h"
 #include "optimization_backend/accumulators/accumulator_xx.h"
+#include "optimization_backend/accumulators/sym_accumulator.h"
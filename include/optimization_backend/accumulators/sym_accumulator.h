@@ -0,0 +1,270 @@
+#pragma once
+
+#include <string.h>
+
+#include <glog/logging.h>
+
+#include "util/cpu_features.h"
+#include "util/num_type.h"
+
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
+
+namespace dso {
+
+/** \brief Sum of J * J^T over columns J of N floats, for any N
+ *
+ *  Only the upper triangle is kept, row by row (kEntries entries), every
+ *  entry as 4 lanes so 4 columns are added at once. The lanes are summed in
+ *  three levels (the last <= 1000 updates, <= 1000 of those, the rest) to keep
+ *  the float error down; finish() folds them into H. The loops have constant
+ *  bounds, so each update unrolls into one multiply-add per entry.
+ *
+ *  The updates take the N columns (and the weight) as separate arguments, or
+ *  as an array (the ...Array variants). updateAVX_eighted keeps 8 lanes per
+ *  entry of its own, only call it if useAVX(); updateNEON_eighted uses fused
+ *  multiply adds, only call it if useNEON().
+ */
+template <int N>
+class SymAccumulator {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  static constexpr int kEntries = N * (N + 1) / 2;
+
+  inline void initialize() {
+    H.setZero();
+    b.setZero();
+    memset(SSEData, 0, sizeof(float) * 4 * kEntries);
+    memset(SSEData1k, 0, sizeof(float) * 4 * kEntries);
+    memset(SSEData1m, 0, sizeof(float) * 4 * kEntries);
+#if DSO_AVX_DISPATCH
+    memset(AVXData, 0, sizeof(float) * 8 * kEntries);
+#endif
+    num = numIn1 = numIn1k = numIn1m = 0;
+  }
+
+  inline void finish() {
+    H.setZero();
+    shiftUp(true);
+    CHECK_EQ(numIn1, 0.f);
+    CHECK_EQ(numIn1k, 0.f);
+    int idx = 0;
+    for (int r = 0; r < N; ++r) {
+      for (int c = r; c < N; ++c) {
+        float d = SSEData1m[idx + 0] + SSEData1m[idx + 1] + SSEData1m[idx + 2] +
+                  SSEData1m[idx + 3];
+        H(r, c) = H(c, r) = d;
+        idx += 4;
+      }
+    }
+  }
+
+  //! updateSSEArray of the N columns J.
+  template <typename... Js>
+  inline void updateSSE(const Js... J) {
+    static_assert(sizeof...(Js) == N, "updateSSE takes N columns");
+    const __m128 columns[N] = {J...};
+    updateSSEArray(columns);
+  }
+
+  //! updateSSE_eightedArray of the N columns and the weight, last.
+  template <typename... Js>
+  inline void updateSSE_eighted(const Js... Jw) {
+    static_assert(sizeof...(Js) == N + 1,
+                  "updateSSE_eighted takes N columns and the weight");
+    const __m128 columns[N + 1] = {Jw...};
+    updateSSE_eightedArray(columns, columns[N]);
+  }
+
+  //! updateSingleArray of the N values J.
+  template <typename... Js>
+  inline void updateSingle(const Js... J) {
+    static_assert(sizeof...(Js) == N, "updateSingle takes N values");
+    const float values[N] = {J...};
+    updateSingleArray(values);
+  }
+
+  //! updateSingleWeightedArray of the N values and the weight, last.
+  template <typename... Js>
+  inline void updateSingleWeighted(const Js... Jw) {
+    static_assert(sizeof...(Js) == N + 1,
+                  "updateSingleWeighted takes N values and the weight");
+    const float values[N + 1] = {Jw...};
+    updateSingleWeightedArray(values, values[N]);
+  }
+
+  //! Add J * J^T for 4 columns at once.
+  inline void updateSSEArray(const __m128* J) {
+    float* pt = SSEData;
+    for (int r = 0; r < N; ++r) {
+      for (int c = r; c < N; ++c) {
+        _mm_store_ps(pt, _mm_add_ps(_mm_load_ps(pt), _mm_mul_ps(J[r], J[c])));
+        pt += 4;
+      }
+    }
+
+    num += 4;
+    ++numIn1;
+    shiftUp(false);
+  }
+
+  //! Add w * J * J^T for 4 columns at once.
+  inline void updateSSE_eightedArray(const __m128* J, const __m128 w) {
+    float* pt = SSEData;
+    for (int r = 0; r < N; ++r) {
+      const __m128 Jrw = _mm_mul_ps(J[r], w);
+      for (int c = r; c < N; ++c) {
+        _mm_store_ps(pt, _mm_add_ps(_mm_load_ps(pt), _mm_mul_ps(Jrw, J[c])));
+        pt += 4;
+      }
+    }
+
+    num += 4;
+    ++numIn1;
+    shiftUp(false);
+  }
+
+#if DSO_AVX_DISPATCH
+  //! 8-wide updateSSE_eighted, only call if useAVX().
+  template <typename... Js>
+  DSO_TARGET_AVX inline void updateAVX_eighted(const Js... Jw) {
+    static_assert(sizeof...(Js) == N + 1,
+                  "updateAVX_eighted takes N columns and the weight");
+    const __m256 columns[N + 1] = {Jw...};
+    updateAVX_eightedArray(columns, columns[N]);
+  }
+
+  DSO_TARGET_AVX inline void updateAVX_eightedArray(const __m256* J,
+                                                    const __m256 w) {
+    // same entry order as updateSSE_eighted. AVXData is only 16 byte aligned.
+    float* pt = AVXData;
+    for (int r = 0; r < N; ++r) {
+      const __m256 Jrw = _mm256_mul_ps(J[r], w);
+      for (int c = r; c < N; ++c) {
+        _mm256_storeu_ps(
+            pt, _mm256_add_ps(_mm256_loadu_ps(pt), _mm256_mul_ps(Jrw, J[c])));
+        pt += 8;
+      }
+    }
+
+    num += 8;
+    ++numIn1;
+    shiftUp(false);
+  }
+#endif
+
+#if DSO_NEON
+  //! updateSSE_eighted with fused multiply adds, only call if useNEON().
+  template <typename... Js>
+  inline void updateNEON_eighted(const Js... Jw) {
+    static_assert(sizeof...(Js) == N + 1,
+                  "updateNEON_eighted takes N columns and the weight");
+    const float32x4_t columns[N + 1] = {Jw...};
+    updateNEON_eightedArray(columns, columns[N]);
+  }
+
+  inline void updateNEON_eightedArray(const float32x4_t* J,
+                                      const float32x4_t w) {
+    // same entry order as updateSSE_eighted.
+    float* pt = SSEData;
+    for (int r = 0; r < N; ++r) {
+      const float32x4_t Jrw = vmulq_f32(J[r], w);
+      for (int c = r; c < N; ++c) {
+        vst1q_f32(pt, vfmaq_f32(vld1q_f32(pt), Jrw, J[c]));
+        pt += 4;
+      }
+    }
+
+    num += 4;
+    ++numIn1;
+    shiftUp(false);
+  }
+#endif
+
+  //! Add J * J^T for one column, into lane off.
+  inline void updateSingleArray(const float* J, const int off = 0) {
+    float* pt = SSEData + off;
+    for (int r = 0; r < N; ++r) {
+      for (int c = r; c < N; ++c) {
+        *pt += J[c] * J[r];
+        pt += 4;
+      }
+    }
+
+    ++num;
+    ++numIn1;
+    shiftUp(false);
+  }
+
+  //! Add w * J * J^T for one column, into lane off.
+  inline void updateSingleWeightedArray(const float* J, const float w,
+                                        const int off = 0) {
+    float* pt = SSEData + off;
+    for (int r = 0; r < N; ++r) {
+      *pt += J[r] * J[r] * w;
+      pt += 4;
+      const float Jrw = J[r] * w;
+      for (int c = r + 1; c < N; ++c) {
+        *pt += J[c] * Jrw;
+        pt += 4;
+      }
+    }
+
+    ++num;
+    ++numIn1;
+    shiftUp(false);
+  }
+
+ public:
+  Eigen::Matrix<float, N, N> H;
+  Eigen::Matrix<float, N, 1> b;
+  size_t num;
+
+ private:
+  inline void shiftUp(const bool force) {
+    if (numIn1 > 1000 || force) {
+#if DSO_AVX_DISPATCH
+      for (int i = 0; i < kEntries; ++i) {
+        _mm_store_ps(SSEData + 4 * i,
+                     _mm_add_ps(_mm_load_ps(SSEData + 4 * i),
+                                _mm_add_ps(_mm_load_ps(AVXData + 8 * i),
+                                           _mm_load_ps(AVXData + 8 * i + 4))));
+      }
+      memset(AVXData, 0, sizeof(float) * 8 * kEntries);
+#endif
+      for (int i = 0; i < kEntries; ++i) {
+        _mm_store_ps(SSEData1k + 4 * i,
+                     _mm_add_ps(_mm_load_ps(SSEData + 4 * i),
+                                _mm_load_ps(SSEData1k + 4 * i)));
+      }
+      numIn1k += numIn1;
+      numIn1 = 0;
+      memset(SSEData, 0, sizeof(float) * 4 * kEntries);
+    }
+
+    if (numIn1k > 1000 || force) {
+      for (int i = 0; i < kEntries; ++i) {
+        _mm_store_ps(SSEData1m + 4 * i,
+                     _mm_add_ps(_mm_load_ps(SSEData1k + 4 * i),
+                                _mm_load_ps(SSEData1m + 4 * i)));
+      }
+      numIn1m += numIn1k;
+      numIn1k = 0;
+      memset(SSEData1k, 0, sizeof(float) * 4 * kEntries);
+    }
+  }
+
+ private:
+  EIGEN_ALIGN16 float SSEData[4 * kEntries];
+  EIGEN_ALIGN16 float SSEData1k[4 * kEntries];
+  EIGEN_ALIGN16 float SSEData1m[4 * kEntries];
+#if DSO_AVX_DISPATCH
+  // 8 lanes per entry, folded into SSEData by shiftUp.
+  EIGEN_ALIGN16 float AVXData[8 * kEntries];
+#endif
+  float numIn1, numIn1k, numIn1m;
+};
+
+}  // dso
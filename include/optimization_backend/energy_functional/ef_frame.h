@@ -1,11 +1,14 @@
 #pragma once
 
+#include <vector>
+
 #include "util/num_type.h"
 
 namespace dso {
 
 class FrameHessian;
 class EFPoint;
+class EFResidual;
 
 class EFFrame {
  public:
@@ -19,7 +22,12 @@ class EFFrame {
                      // diag(prior) * (delta_prior)
   Vec8 delta;        // state - state_zero.
 
+  //! The points hosted here, their residualsAll are the residuals with this
+  //! host.
   std::vector<EFPoint*> points;
+  //! The residuals with this frame as target, in no particular order.
+  //! Kept by EnergyFunctional::insertResidual / dropResidual(s).
+  std::vector<EFResidual*> residualsAsTarget;
   FrameHessian* data;
   int idx;  // idx in frames.
 
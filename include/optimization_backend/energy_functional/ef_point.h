@@ -1,6 +1,8 @@
 #pragma once
 
+#include "util/inline_vector.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 
 namespace dso {
 
@@ -12,7 +14,7 @@ enum EFPointStatus { PS_GOOD = 0, PS_MARGINALIZE, PS_DROP };
 
 class EFPoint {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(EFPoint)
   EFPoint(PointHessian* d, EFFrame* host_) : data(d), host(host_) {
     takeData();
     stateFlag = EFPointStatus::PS_GOOD;
@@ -30,7 +32,7 @@ class EFPoint {
   EFFrame* host;
 
   // contains all residuals.
-  std::vector<EFResidual*> residualsAll;
+  InlineVector<EFResidual*, MAX_WINDOW_FRAMES> residualsAll;
 
   float bdSumF;
   float HdiF;
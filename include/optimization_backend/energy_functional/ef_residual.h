@@ -3,7 +3,9 @@
 #include <glog/logging.h>
 
 #include "optimization_backend/raw_residual_jacobian.h"
+#include "util/memory_stats.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 
 namespace dso {
 
@@ -14,7 +16,7 @@ class EnergyFunctional;
 
 class EFResidual {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(EFResidual)
 
   inline EFResidual(PointFrameResidual* org, EFPoint* point_, EFFrame* host_,
                     EFFrame* target_)
@@ -22,17 +24,26 @@ class EFResidual {
     isLinearized = false;
     isActiveAndIsGoodNEW = false;
     J = new RawResidualJacobian();
+    MemoryStats::add(MEM_JACOBIANS, sizeof(RawResidualJacobian));
     CHECK(((long)this) % 16 == 0);
     CHECK(((long)J) % 16 == 0);
   }
 
-  inline ~EFResidual() { delete J; }
+  inline ~EFResidual() {
+    delete J;
+    MemoryStats::add(MEM_JACOBIANS,
+                     -static_cast<int64_t>(sizeof(RawResidualJacobian)));
+  }
 
-  //! Use the newest Jacobians to update JpJdF
-  void takeDataF();
+  //! Use the newest Jacobians to update JpJdF. packJacobian: the pattern
+  //! rows are read packed from then on, see RawResidualJacobian::pack().
+  void takeDataF(bool packJacobian);
 
   void fixLinearizationF(EnergyFunctional* ef);
 
+  //! Undo fixLinearizationF, i.e. go back to the active part.
+  void resetLinearizationF(EnergyFunctional* ef);
+
   inline const bool& isActive() const { return isActiveAndIsGoodNEW; }
 
  public:
@@ -43,6 +54,8 @@ class EFResidual {
   EFFrame* host;
   EFFrame* target;
   int idxInAll;
+  //! index in target->residualsAsTarget.
+  int idxInTarget;
 
   RawResidualJacobian* J;
 
@@ -1,11 +1,18 @@
 #pragma once
 
 #include <math.h>
+#include <atomic>
+#include <array>
 #include <map>
+#include <utility>
 #include <vector>
 
+#include "optimization_backend/energy_functional/ef_point.h"
+#include "util/flat_hash_map.h"
 #include "util/index_thread_reduce.h"
+#include "util/memory_stats.h"
 #include "util/num_type.h"
+#include "util/settings.h"
 
 namespace dso {
 
@@ -22,6 +29,8 @@ class AccumulatedTopHessian;
 class AccumulatedTopHessianSSE;
 class AccumulatedSCHessian;
 class AccumulatedSCHessianSSE;
+class SparseSchurSolver;
+class PcgSolver;
 
 extern bool EFAdjointsValid;
 extern bool EFIndicesValid;
@@ -38,26 +47,44 @@ class EnergyFunctional {
   friend class AccumulatedSCHessian;
   friend class AccumulatedSCHessianSSE;
 
-  EnergyFunctional();
+  explicit EnergyFunctional(const Settings& settings);
   ~EnergyFunctional();
 
+  /** \brief Drop all frames, points, residuals and the prior
+   *
+   *  Like a new EnergyFunctional, but the accumulators and solvers are kept.
+   *  The FrameHessians etc. lose their ef counterparts and are not deleted.
+   */
+  void clear();
+
   EFResidual* insertResidual(PointFrameResidual* r);
   EFFrame* insertFrame(FrameHessian* fh, CalibHessian* Hcalib);
   EFPoint* insertPoint(PointHessian* ph);
 
   void dropResidual(EFResidual* r);
+  /** \brief dropResidual for all of rs
+   *
+   *  The residuals of every affected point are compacted in one pass (keeping
+   *  their order) and connectivityMap is updated once per host / target pair.
+   *  rs must not contain a residual twice.
+   */
+  void dropResiduals(const std::vector<EFResidual*>& rs);
 
   /** \brief Marginalize a frame using Schur complement.
    *
+   *  fh must neither host points nor be the target of residuals any more.
    *
    *  @param[in] fh - frame to marginalize
   */
   void marginalizeFrame(EFFrame* fh);
+
+  //! Remove a single point from its host (swap-and-pop) and delete it.
   void removePoint(EFPoint* ph);
 
   /** \brief Marginalize a frame using Schur complement.
    *
-   *  1. Compute contribution of marginalized points to the Hessian.
+   *  1. Compute contribution of marginalized points to the Hessian, on red
+   *     with per-thread accumulators if settings.multiThreading.
    *  2. Drop residuals of all marginalized points
   */
   void marginalizePointsF();
@@ -75,21 +102,42 @@ class EnergyFunctional {
   /** \brief Uncalled function
    *
    *  This function is used in FullSystem::calcMEnergy(), but it will never be
-   *  called for now due to the global variable setting_forceAceptStep
+   *  called for now due to Settings::forceAceptStep
   */
   double calcMEnergyF();
 
   /** \brief Uncalled function
    *
    *  This function is used in FullSystem::calcLEnergy(), but it will never be
-   *  called for now due to the global variable setting_forceAceptStep
+   *  called for now due to Settings::forceAceptStep
   */
   double calcLEnergyF_MT();
 
+  /** \brief Bring frame indices and allPoints up to date
+   *
+   *  Residuals get their hostIDX / targetIDX on insertResidual, they are only
+   *  renumbered (on red if settings.multiThreading) if a frame moved, i.e.
+   *  after marginalizeFrame. With settings.validateEF checkIndices follows.
+   */
   void makeIDX();
 
+  //! CHECK every index and count of frames, points and residuals.
+  void checkIndices() const;
+
+  /** \brief Set adHTdeltaF, cDeltaF and the deltas of all frames and points
+   *
+   *  A pair is only recomputed if the state of host or target or their
+   *  adjoints changed since (deltaVersions). Lays out the adjoints first if
+   *  the frames changed since setAdjointsF.
+   */
   void setDeltaF(CalibHessian* HCalib);
 
+  /** \brief Set adHost / adTarget (and their float copies) for all frame pairs
+   *
+   *  Only pairs whose host or target evaluation point changed since they were
+   *  last computed (FrameHessian::evalPTVersion) are recomputed, the others
+   *  are kept, also across frame insertions / marginalizations.
+   */
   void setAdjointsF(CalibHessian* Hcalib);
 
  public:
@@ -104,13 +152,32 @@ class EnergyFunctional {
   //! Number of residuals in energy function
   int nResiduals;
 
+  /** \brief Number of residuals with fixed linearization (isLinearized)
+   *
+   *  Kept up to date by EFResidual::fixLinearizationF / resetLinearizationF and
+   *  dropResidual. While it is 0, accumulateLF_MT only has to add the priors.
+   *  Atomic as FullSystem::flagPointsForRemoval relinearizes in parallel.
+   */
+  std::atomic<int> nResLinearized;
+
   //! Marginalized Hessian
   MatXX HM;
 
   //! Marginalized b
   VecX bM;
 
+  //! Bytes of HM and bM, set after they change size.
+  MemoryAccount hessianMemory{MEM_HESSIAN};
+
   int resInA, resInL, resInM;
+
+  //! |H * x - b| / |b| of the last solve (scaled system, before orthogonalize)
+  double lastSolveRelResidual;
+
+  //! Wall time of the last solveSystemF: building H, b / solving and
+  //! resubstituting x.
+  double lastAccumulateMs, lastSolveMs;
+
   MatXX lastHS;
   VecX lastbS;
   VecX lastX;
@@ -122,9 +189,12 @@ class EnergyFunctional {
 
   IndexThreadReduce<Vec10>* red;
 
-  std::map<uint64_t, Eigen::Vector2i, std::less<uint64_t>,
-           Eigen::aligned_allocator<std::pair<const uint64_t, Eigen::Vector2i>>>
-      connectivityMap;
+  //! settings of the FullSystem owning this.
+  const Settings& settings;
+
+  //! (host frameID << 32) + target frameID -> [active, marginalized]
+  //! residuals, for all keyframes ever in the window.
+  FlatHashMap<Eigen::Vector2i> connectivityMap;
 
  private:
   VecX getStitchedDeltaF() const;
@@ -141,7 +211,11 @@ class EnergyFunctional {
   */
   void accumulateAF_MT(MatXX& H, VecX& b, const bool MT);
 
-  /** \brief Accumulate linearized residuals
+  /** \brief Accumulate linearized residuals (and the priors)
+   *
+   *  Without any linearized residual (the usual case during optimize(), they
+   *  only exist between flagPointsForRemoval and the point marginalization)
+   *  the accumulation is skipped and only the priors are written.
    *
    *  @param[in]  MT - whether use multi threads
    *  @param[out] H  -
@@ -162,7 +236,37 @@ class EnergyFunctional {
   void orthogonalize(VecX* b, MatXX* H);
 
  private:
-  Mat18f* adHTdeltaF;
+  /** \brief Remove all points whose stateFlag is flag
+   *
+   *  One pass over the points of every frame, the remaining points keep their
+   *  order (and with it the order makeIDX puts them into allPoints).
+   */
+  void removePointsFlagged(const EFPointStatus flag);
+
+  //! hostIDX / targetIDX of the residuals of allPoints [min, max).
+  void makeResidualIDX(int min, int max, Vec10* stats, int tid);
+
+  //! Drop all residuals of p and delete it, p must be unlinked from its host.
+  void deletePoint(EFPoint* p);
+
+  //! Take r out of r->target->residualsAsTarget (moving the last one there).
+  void unlinkFromTarget(EFResidual* r);
+
+  /** \brief Solve H * x = b with a float LDLT and double refinement
+   *
+   *  The factorization runs in float (twice the SIMD width, half the memory
+   *  traffic), followed by settings.solverRefineSteps steps of iterative
+   *  refinement against the double residual b - H * x. Falls back to the
+   *  double LDLT if the refinement does not reduce the residual (H too badly
+   *  conditioned for float).
+   */
+  VecX solveMixedPrecision(const MatXX& H, const VecX& b) const;
+
+  //! [h + t * nFrames] delta of host and target times their adjoints, in
+  //! one aligned array; the stateVersion of host and target and the
+  //! adVersions each entry was computed with.
+  std::vector<Mat18f, Eigen::aligned_allocator<Mat18f>> adHTdeltaF;
+  std::vector<std::array<uint64_t, 4>> deltaVersions;
 
   Mat88* adHost;
   Mat88* adTarget;
@@ -170,6 +274,11 @@ class EnergyFunctional {
   Mat88f* adHostF;
   Mat88f* adTargetF;
 
+  //! frames at the last layout of adHost / adTarget, and the evalPTVersion
+  //! of host and target each entry was computed with.
+  std::vector<EFFrame*> adFrames;
+  std::vector<std::pair<uint64_t, uint64_t>> adVersions;
+
   VecC cPrior;
   VecCf cDeltaF;
   VecCf cPriorF;
@@ -179,6 +288,12 @@ class EnergyFunctional {
 
   AccumulatedSCHessianSSE* accSSE_bot;
 
+  //! used instead of the dense LDLT if settings.solverMode has SOLVER_SPARSE.
+  SparseSchurSolver* sparseSolver;
+
+  //! used instead of the dense LDLT if settings.solverMode has SOLVER_PCG.
+  PcgSolver* pcgSolver;
+
   std::vector<EFPoint*> allPoints;
   std::vector<EFPoint*> allPointsToMarg;
 
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "util/index_thread_reduce.h"
+#include "util/num_type.h"
+#include "util/settings.h"
+
+namespace dso {
+
+/** \brief Block-Jacobi preconditioned conjugate gradient for the reduced
+ *  camera system
+ *
+ *  Solves H * x = b for the (CPARS + 8 * nFrames) system of
+ *  EnergyFunctional::solveSystemF when SOLVER_PCG is set. The preconditioner
+ *  is the inverse of the calibration block and of every 8x8 frame block on the
+ *  diagonal of H. Iterates until |H * x - b| <= settings.pcgTolerance * |b| or
+ *  for at most settings.pcgMaxIterations iterations, starting from the given x
+ *  if that is a better guess than 0.
+ *
+ *  The products with H are split by block rows over the given thread pool.
+ */
+class PcgSolver {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  explicit PcgSolver(const Settings& settings);
+
+  /** \brief Solve H * x = b, H symmetric positive definite
+   *
+   *  @param[in]     H   - system matrix, dimension CPARS + 8 * n
+   *  @param[in]     b   - right hand side
+   *  @param[in,out] x   - initial guess if it has the size of b, the solution
+   *  @param[in]     red - pool for the products with H, nullptr for none
+   *  @return false on a breakdown (H not positive definite), x is left
+   *          untouched then.
+   */
+  bool solve(const MatXX& H, const VecX& b, VecX* x,
+             IndexThreadReduce<Vec10>* red);
+
+  //! CG iterations of the last solve().
+  inline int getLastIterations() const { return lastIterations; }
+
+ private:
+  //! Invert the diagonal blocks of H into blockInv.
+  bool makePreconditioner(const MatXX& H);
+
+  void applyPreconditioner(const VecX& r, VecX* z) const;
+
+  //! y = H * p over [min, max) block rows.
+  void multiplyRows(const MatXX* H, const VecX* p, VecX* y, int min, int max,
+                    Vec10* stats, int tid) const;
+
+  void multiply(const MatXX& H, const VecX& p, VecX* y,
+                IndexThreadReduce<Vec10>* red) const;
+
+  MatCC calibInv;
+  std::vector<Mat88, Eigen::aligned_allocator<Mat88>> blockInv;
+  int lastIterations;
+  const Settings& settings;
+};
+
+}  // dso
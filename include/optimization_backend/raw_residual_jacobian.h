@@ -1,13 +1,23 @@
 #pragma once
 
+#include <math.h>
+#include <stdint.h>
+
+#include <glog/logging.h>
+
 #include "util/num_type.h"
+#include "util/object_pool.h"
+
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
 
 namespace dso {
 struct RawResidualJacobian {
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(RawResidualJacobian)
 
-  //! [8 x 1] Individual residual of every point in a pattern
-  VecNRf resF;
+  //! resF, JIdx[0], JIdx[1], JabF[0], JabF[1]: the terms per pattern point.
+  static constexpr int kPatternRows = 5;
 
   //! [2 x 6] Derivative of pixel j wrt. relative pose from i to j
   Vec6f Jpdxi[2];
@@ -18,12 +28,6 @@ struct RawResidualJacobian {
   //! [2 x 1] Derivative of pixel j wrt. inverse depth i
   Vec2f Jpdd;  // 2x1
 
-  //! [8 x 2] Derivative of residual wrt. pixel j (whole pattern 8 points)
-  VecNRf JIdx[2];
-
-  //! [8 x 2] Derivative of residual wrt. photometric parameters (whole pattern)
-  VecNRf JabF[2];
-
   //! [2 x 2] Intermediate variable for computing Hesssian
   Mat22f JIdx2;
 
@@ -32,5 +36,61 @@ struct RawResidualJacobian {
 
   //! [2 x 2] Intermediate variable for computing Hesssian
   Mat22f Jab2;
+
+  //! The pattern rows as 16 bit integers, row r in units of packedScale[r].
+  //! Right after the blocks above, so accumulating a packed residual reads
+  //! 4 cache lines instead of 5. Only valid while isPacked, see pack().
+  EIGEN_ALIGN16 int16_t packedRows[kPatternRows][MAX_RES_PER_POINT];
+  float packedScale[kPatternRows];
+  bool isPacked = false;
+
+  //! [8 x 1] Individual residual of every point in a pattern
+  VecNRf resF;
+
+  //! [8 x 2] Derivative of residual wrt. pixel j (whole pattern 8 points)
+  VecNRf JIdx[2];
+
+  //! [8 x 2] Derivative of residual wrt. photometric parameters (whole pattern)
+  VecNRf JabF[2];
+
+  /** Round the pattern rows into packedRows, each row scaled to its largest
+   *  magnitude (about 1/32767 of it is the error). The float rows stay as
+   *  they are; JIdx2, JabJIdx and Jab2 are not affected.
+   */
+  inline void pack() {
+    const VecNRf* rows = &resF;
+    for (int r = 0; r < kPatternRows; ++r) {
+      const float maxAbs = rows[r].cwiseAbs().maxCoeff();
+      const float toPacked = maxAbs > 0 ? 32767 / maxAbs : 0;
+      packedScale[r] = maxAbs / 32767;
+      for (int i = 0; i < MAX_RES_PER_POINT; ++i) {
+        packedRows[r][i] = static_cast<int16_t>(lrintf(rows[r][i] * toPacked));
+      }
+    }
+    isPacked = true;
+  }
+
+  //! The pattern rows, in the order of kPatternRows: the float members, or
+  //! packedRows unpacked into scratch if isPacked.
+  inline const VecNRf* patternRows(VecNRf* scratch) const {
+    // resF, JIdx and JabF are one array of rows.
+    DCHECK_EQ(static_cast<const void*>(&resF + kPatternRows),
+              static_cast<const void*>(JabF + 2));
+    if (!isPacked) {
+      return &resF;
+    }
+    for (int r = 0; r < kPatternRows; ++r) {
+      const __m128 scale = _mm_set1_ps(packedScale[r]);
+      for (int i = 0; i < MAX_RES_PER_POINT; i += 4) {
+        // sign extend 4 int16 to int32: into the high halves, shift back.
+        const __m128i q = _mm_loadl_epi64(
+            reinterpret_cast<const __m128i*>(packedRows[r] + i));
+        const __m128i q32 = _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16);
+        _mm_store_ps(scratch[r].data() + i,
+                     _mm_mul_ps(_mm_cvtepi32_ps(q32), scale));
+      }
+    }
+    return scratch;
+  }
 };
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "util/num_type.h"
+
+namespace dso {
+
+/** \brief Block sparse Cholesky solver for the reduced camera system
+ *
+ *  Solves H * x = b for the (CPARS + 8 * nFrames) system of
+ *  EnergyFunctional::solveSystemF when SOLVER_SPARSE is set. H is cut into the
+ *  calibration block and one 8x8 block per frame; only blocks with a non-zero
+ *  entry go into the sparse matrix. Frame pairs without shared residuals and
+ *  without marginalization prior between them stay empty, which leaves large
+ *  windows mostly sparse.
+ *
+ *  Uses CHOLMOD (supernodal LLT) if built with HAS_CHOLMOD, Eigen's
+ *  SimplicialLDLT otherwise. The symbolic analysis is reused as long as the
+ *  block pattern does not change.
+ */
+class SparseSchurSolver {
+ public:
+  SparseSchurSolver();
+  ~SparseSchurSolver();
+
+  /** \brief Solve H * x = b, H symmetric positive definite
+   *
+   *  @return false if the factorization failed, x is left untouched then.
+   */
+  bool solve(const MatXX& H, const VecX& b, VecX* x);
+
+ private:
+  struct Factorization;
+
+  //! Non-zero flags of the lower triangle blocks, row major.
+  void makePattern(const MatXX& H, std::vector<bool>* pattern) const;
+
+  Factorization* factorization;
+  std::vector<bool> lastPattern;
+  int lastDim;
+};
+
+}  // dso
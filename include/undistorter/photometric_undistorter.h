@@ -2,6 +2,7 @@
 
 #include <glog/logging.h>
 
+#include "util/cpu_features.h"
 #include "util/image_and_exposure.h"
 #include "util/minimal_image.h"
 #include "util/num_type.h"
@@ -19,9 +20,14 @@ class PhotometricUndistorter {
   ~PhotometricUndistorter();
 
   float* GetG() { return valid_ ? G_ : nullptr; };
+  float* GetVignetteInv() { return vignette_map_inv_; };
 
   void UnMapFloatImage(float* const image);
 
+  //! Take images of 1/reduction of the size from now on: the vignette is
+  //! averaged over reduction x reduction blocks. See Undistorter::ReduceInput.
+  void ReduceInput(const int reduction);
+
   // removes readout noise, and converts to irradiance.
   // affine normalizes values to 0 <= I < 256.
   // raw irradiance = a*I + b.
@@ -29,10 +35,17 @@ class PhotometricUndistorter {
   template <typename T>
   void ProcessFrame(T* const image_in, const float exposure_time,
                     const float factor = 1) {
+    ProcessFrameInto<T>(image_in, output_, exposure_time, factor);
+  }
+
+  // same as ProcessFrame, but writes into output (of size w_ * h_).
+  template <typename T>
+  void ProcessFrameInto(const T* const image_in, ImageAndExposure* output,
+                        const float exposure_time, const float factor = 1) {
     int wh = w_ * h_;
-    float* const data = output_->image;
-    CHECK_EQ(output_->w, w_);
-    CHECK_EQ(output_->h, h_);
+    float* const data = output->image;
+    CHECK_EQ(output->w, w_);
+    CHECK_EQ(output->h, h_);
     CHECK_NOTNULL(data);
 
     if (!valid_ || exposure_time <= 0.f ||
@@ -41,31 +54,46 @@ class PhotometricUndistorter {
       for (int i = 0; i < wh; ++i) {
         data[i] = factor * image_in[i];
       }
-      output_->exposure_time = exposure_time;
-      output_->timestamp = 0.;
     } else {
-      for (int i = 0; i < wh; ++i) {
-        data[i] = G_[image_in[i]];
-      }
-
-      if (setting_photometricCalibration == 2) {
-        for (int i = 0; i < wh; ++i) {
-          data[i] *= vignette_map_inv_[i];
-        }
-      }
-
-      output_->exposure_time = exposure_time;
-      output_->timestamp = 0.;
+      // gamma and vignette in one pass.
+      ApplyResponse<T>(
+          image_in,
+          setting_photometricCalibration == 2 ? vignette_map_inv_ : nullptr,
+          data);
     }
+    output->exposure_time = exposure_time;
+    output->timestamp = 0.;
 
     if (!setting_useExposure) {
-      output_->exposure_time = 1.f;
+      output->exposure_time = 1.f;
     }
   }
 
  public:
   ImageAndExposure* output_;
 
+ private:
+  // out = G_[in], times vignette_inv if given.
+  template <typename T>
+  void ApplyResponse(const T* const image_in, const float* const vignette_inv,
+                     float* const out) const {
+    const int wh = w_ * h_;
+    if (vignette_inv != nullptr) {
+      for (int i = 0; i < wh; ++i) {
+        out[i] = G_[image_in[i]] * vignette_inv[i];
+      }
+    } else {
+      for (int i = 0; i < wh; ++i) {
+        out[i] = G_[image_in[i]];
+      }
+    }
+  }
+#if DSO_AVX_DISPATCH
+  DSO_TARGET_AVX2 void ApplyResponse8AVX2(const unsigned char* const image_in,
+                                          const float* const vignette_inv,
+                                          float* const out, const int n) const;
+#endif
+
  private:
   float G_[256 * 256];
   int G_depth_;
@@ -74,4 +102,10 @@ class PhotometricUndistorter {
   int w_, h_;
   bool valid_;
 };
-}
\ No newline at end of file
+
+// 8-bit input only ever reads the first 256 entries of G_.
+template <>
+void PhotometricUndistorter::ApplyResponse<unsigned char>(
+    const unsigned char* const image_in, const float* const vignette_inv,
+    float* const out) const;
+}
@@ -2,8 +2,10 @@
 
 #include <glog/logging.h>
 #include <Eigen/Core>
+#include <type_traits>
 
 #include "undistorter/photometric_undistorter.h"
+#include "util/cpu_features.h"
 #include "util/global_funcs.h"
 #include "util/image_and_exposure.h"
 #include "util/minimal_image.h"
@@ -12,6 +14,11 @@
 
 namespace dso {
 
+class UndistorterCuda;
+
+template <typename Running>
+class IndexThreadReduce;
+
 class Undistorter {
  public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -29,6 +36,21 @@ class Undistorter {
   };
   bool IsValid() { return valid_; };
 
+  /** \brief Take the input at 1/reduction of its size from now on
+   *
+   *  For decoders that read an image at a reduced size directly (see
+   *  IOWrap::readImageBW_8U): the remap and the vignette are scaled to the
+   *  smaller input, which GetOriginalSize() returns from then on. The output
+   *  stays the same. reduction is 1, 2, 4 or 8 and divides the input size,
+   *  and there is a remap (not pass through), else nothing changes and false
+   *  is returned.
+   */
+  bool ReduceInput(const int reduction);
+
+  //! Largest reduction (1, 2, 4 or 8) for ReduceInput() that still leaves
+  //! the input at least as large as the output.
+  int GetMaxInputReduction() const;
+
   static Undistorter* GetUndistorterForFile(const std::string& file_config,
                                             const std::string& file_gamma,
                                             const std::string& file_vignette);
@@ -41,118 +63,111 @@ class Undistorter {
   ImageAndExposure* Undistort(const MinimalImage<T>* image_raw,
                               float exposure = 0, double timestamp = 0,
                               float factor = 1) const {
+    ImageAndExposure* result = new ImageAndExposure(w_, h_, timestamp);
+    UndistortInto<T>(image_raw, result, exposure, timestamp, factor);
+    return result;
+  }
+
+  /** \brief Undistort into a caller-owned image of the output size.
+   *
+   *  Same as Undistort(), but reuses the buffer of result instead of
+   *  allocating a new image for every frame.
+   */
+  template <typename T>
+  void UndistortInto(const MinimalImage<T>* image_raw,
+                     ImageAndExposure* result, float exposure = 0,
+                     double timestamp = 0, float factor = 1) const {
     LOG_IF(FATAL, image_raw->w != w_org_ || image_raw->h != h_org_)
         << "Wrong image size (" << image_raw->w << ", " << image_raw->h
         << ") instead of (" << w_ << ", " << h_ << ")!";
-
-    photometric_undistorter_->ProcessFrame<T>(image_raw->data, exposure,
-                                              factor);
-    ImageAndExposure* result = new ImageAndExposure(w_, h_, timestamp);
-    photometric_undistorter_->output_->CopyMetaTo(*result);
-
-    if (!pass_through_) {
-      float* out_data = result->image;
-      float* in_data = photometric_undistorter_->output_->image;
-
-      float* noise_map_x = nullptr;
-      float* noise_map_y = nullptr;
+    CHECK_EQ(result->w, w_);
+    CHECK_EQ(result->h, h_);
+
+#if defined(HAS_CUDA)
+    const bool onGPU =
+        std::is_same<T, unsigned char>::value && setting_preprocessGPU &&
+        UndistortGPU(reinterpret_cast<const unsigned char*>(image_raw->data),
+                     result, exposure, factor);
+#else
+    const bool onGPU = false;
+#endif
+    if (onGPU) {
+      // photometric correction and remap done.
+    } else if (!pass_through_) {
+      photometric_undistorter_->ProcessFrame<T>(image_raw->data, exposure,
+                                                factor);
+      photometric_undistorter_->output_->CopyMetaTo(*result);
       if (benchmark_varNoise > 0) {
-        const int num_noise =
-            (benchmark_noiseGridsize + 8) * (benchmark_noiseGridsize + 8);
-        noise_map_x = new float[num_noise];
-        noise_map_y = new float[num_noise];
-        memset(noise_map_x, 0, sizeof(float) * num_noise);
-        memset(noise_map_y, 0, sizeof(float) * num_noise);
-
-        for (int i = 0; i < num_noise; ++i) {
-          noise_map_x[i] =
-              2.f * benchmark_varNoise *
-              (static_cast<float>(rand()) / static_cast<float>(RAND_MAX) -
-               0.5f);
-          noise_map_y[i] =
-              2.f * benchmark_varNoise *
-              (static_cast<float>(rand()) / static_cast<float>(RAND_MAX) -
-               0.5f);
-        }
-      }
-
-      for (int idx = w_ * h_ - 1; idx >= 0; --idx) {
-        // get interp. values
-        float xx = remap_x_[idx];
-        float yy = remap_y_[idx];
-
-        if (benchmark_varNoise > 0) {
-          const float delta_x = getInterpolatedElement11BiCub(
-              noise_map_x,
-              4.f + (xx / static_cast<float>(w_org_)) * benchmark_noiseGridsize,
-              4.f + (yy / static_cast<float>(h_org_)) * benchmark_noiseGridsize,
-              benchmark_noiseGridsize + 8);
-          const float delta_y = getInterpolatedElement11BiCub(
-              noise_map_y,
-              4.f + (xx / static_cast<float>(w_org_)) * benchmark_noiseGridsize,
-              4.f + (yy / static_cast<float>(h_org_)) * benchmark_noiseGridsize,
-              benchmark_noiseGridsize + 8);
-          float x = idx % w_ + delta_x;
-          float y = idx / w_ + delta_y;
-          if (x < 0.01f) {
-            x = 0.01f;
-          }
-          if (y < 0.01f) {
-            y = 0.01f;
-          }
-          if (x > static_cast<float>(w_) - 1.01f) {
-            x = static_cast<float>(w_) - 1.01f;
-          }
-          if (y > static_cast<float>(h_) - 1.01f) {
-            y = static_cast<float>(h_) - 1.01f;
-          }
-
-          xx = getInterpolatedElement(remap_x_, x, y, w_);
-          yy = getInterpolatedElement(remap_y_, x, y, w_);
-        }
-
-        if (xx < 0) {
-          out_data[idx] = 0.f;
-        } else {
-          // get integer and rational parts
-          const int xxi = static_cast<int>(xx);
-          const int yyi = static_cast<int>(yy);
-          xx -= static_cast<float>(xxi);
-          yy -= static_cast<float>(yyi);
-          const float xxyy = xx * yy;
-
-          // get array base pointer
-          const float* src = in_data + xxi + yyi * w_org_;
-
-          // interpolate (bilinear)
-          out_data[idx] = xxyy * src[1 + w_org_] + (yy - xxyy) * src[w_org_] +
-                          (xx - xxyy) * src[1] + (1 - xx - yy + xxyy) * src[0];
-        }
-      }
-
-      if (benchmark_varNoise > 0) {
-        delete[] noise_map_x;
-        delete[] noise_map_y;
+        RemapWithNoise(photometric_undistorter_->output_->image, result->image,
+                       timestamp);
+      } else {
+        Remap(photometric_undistorter_->output_->image, result->image);
       }
     } else {
-      memcpy(result->image, photometric_undistorter_->output_->image,
-             sizeof(float) * w_ * h_);
+      // same size, no need for the intermediate image.
+      photometric_undistorter_->ProcessFrameInto<T>(image_raw->data, result,
+                                                    exposure, factor);
     }
+    result->timestamp = timestamp;
 
-    ApplyBlurNoise(result->image);
-
-    return result;
+    ApplyBlurNoise(result->image, timestamp);
   }
 
  public:
   PhotometricUndistorter* photometric_undistorter_;
 
  protected:
-  void ApplyBlurNoise(float* const img) const;
-
-  void MakeOptimalKCrop();
+  //! The noise of the benchmark_* settings is a function of setting_randomSeed
+  //! and timestamp only, i.e. reproducible whatever thread undistorts a frame.
+  void ApplyBlurNoise(float* const img, const double timestamp) const;
+
+  //! Bilinear remap of in (input size) to out (output size) via the table.
+  void Remap(const float* const in, float* const out) const;
+#if DSO_AVX_DISPATCH
+  DSO_TARGET_AVX2 void RemapAVX2(const float* const in, float* const out) const;
+#endif
+#if DSO_NEON
+  //! Remap of the leading multiple of 4 pixels.
+  void RemapNEON(const float* const in, float* const out) const;
+#endif
+  //! Remap with benchmark_varNoise applied to the remap coordinates.
+  void RemapWithNoise(const float* const in, float* const out,
+                      const double timestamp) const;
+  //! Precompute remap_offset_ / remap_weights_ from remap_x_ / remap_y_.
+  void MakeRemapTable();
+#if defined(HAS_CUDA)
+  //! Photometric correction and Remap on gpu_, false if that is not possible
+  //! (no device, benchmark_varNoise).
+  bool UndistortGPU(const unsigned char* const raw, ImageAndExposure* result,
+                    const float exposure, const float factor) const;
+#endif
+
+  /** \brief DistortCoordinates of n points in chunks on red
+   *
+   *  Every model maps each point on its own, so the chunks are independent.
+   *  in and out may be the same arrays, like for DistortCoordinates.
+   */
+  void DistortCoordinatesMT(float* const in_x, float* const in_y,
+                            float* const out_x, float* const out_y,
+                            const int n, IndexThreadReduce<Vec10>* red) const;
+
+  void MakeOptimalKCrop(IndexThreadReduce<Vec10>* red);
   void MakeOptimalKFull();
 
+  /** \brief K_, pass_through_ and remap_x_ / remap_y_ for output_calibration
+   *  (line 3 of the calibration file, -1 crop, -2 full, -3 none)
+   */
+  void MakeRemap(const float* const output_calibration);
+
+  /** \brief The remap of MakeRemap from / to setting_remapCacheDir
+   *
+   *  The file name is a hash of the calibration file, the input and output
+   *  resolution and the benchmark settings changing K_. Load returns false if
+   *  there is no such file or it does not fit, Save writes aside and renames.
+   */
+  bool LoadRemapCache(const std::string& path);
+  void SaveRemapCache(const std::string& path) const;
+
   void ReadFromFile(const char* file_config, const int argc,
                     const std::string& prefix = "");
 
@@ -166,5 +181,15 @@ class Undistorter {
 
   float* remap_x_;
   float* remap_y_;
+
+  // per output pixel: offset of the top-left input pixel and the four bilinear
+  // weights (00, 10, 01, 11, each w_ * h_ long). invalid pixels have offset -1
+  // and zero weights, and are written as 0 without reading the input.
+  int* remap_offset_;
+  float* remap_weights_;
+
+  // UndistortGPU, created on first use. An Undistorter is only ever used by
+  // one thread, see DatasetReader.
+  mutable UndistorterCuda* gpu_;
 };
 }
@@ -0,0 +1,47 @@
+#pragma once
+
+namespace dso {
+
+/** \brief Photometric correction and remap of Undistorter::UndistortInto on a
+ *  CUDA device
+ *
+ *  Only the 8 bit raw image goes up and the undistorted float image comes
+ *  back, the response, vignette and remap tables stay in device memory.
+ *  Results are identical to the CPU path. Only compiled with DSO_CUDA
+ *  (HAS_CUDA), see setting_preprocessGPU.
+ *
+ *  Not thread safe, every Undistorter has its own (and its own stream).
+ */
+class UndistorterCuda {
+ public:
+  /** \brief Upload the tables of an Undistorter
+   *
+   *  @param[in] remapOffset  - Undistorter::remap_offset_ (w * h), nullptr
+   *                            for pass through (w, h == wOrg, hOrg)
+   *  @param[in] remapWeights - Undistorter::remap_weights_ (4 * w * h)
+   *  @param[in] G            - inverse response (256), nullptr for none
+   *  @param[in] vignetteInv  - inverse vignette (wOrg * hOrg), nullptr for
+   *                            none
+   */
+  UndistorterCuda(int wOrg, int hOrg, int w, int h, const int* remapOffset,
+                  const float* remapWeights, const float* G,
+                  const float* vignetteInv);
+  ~UndistorterCuda();
+
+  //! Whether there is a CUDA device to run on.
+  static bool deviceAvailable();
+
+  /** \brief Undistort raw (wOrg x hOrg) into out (w x h)
+   *
+   *  @param[in] response - apply G (and the vignette if vignette), else
+   *                        scale by factor like the uncalibrated CPU path
+   */
+  void process(const unsigned char* raw, bool response, bool vignette,
+               float factor, float* out);
+
+ private:
+  struct Impl;
+  Impl* impl;
+};
+
+}  // dso
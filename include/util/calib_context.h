@@ -0,0 +1,51 @@
+#pragma once
+
+#include "util/num_type.h"
+#include "util/settings.h"
+
+namespace dso {
+
+//! one value per pyramid level, e.g. the tracking RMSE of every level.
+typedef Eigen::Matrix<double, PYR_LEVELS, 1> VecPyr;
+
+/** \brief Image size and pinhole intrinsics of one camera, per pyramid level
+ *
+ *  Owned by the caller of FullSystem, which keeps it alive as long as the
+ *  FullSystem and its output frames. Handed by reference to everything
+ *  working on its images (FrameHessian, CoarseTracker, CoarseDistanceMap,
+ *  PixelSelector, CoarseInitializer), so several cameras of different size
+ *  can run in one process.
+ */
+struct CalibContext {
+  CalibContext();
+
+  /** \brief Pyramid of the undistorted image size w x h with calibration
+   *  matrix K
+   *
+   *  Halves the image while its size is even and the next level keeps more
+   *  than 5000 pixels, up to maxLevels levels (at most PYR_LEVELS).
+   */
+  CalibContext(const int w, const int h, const Eigen::Matrix3f& K,
+               const int maxLevels = 6);
+
+  //! Number of pyramid levels used, at most PYR_LEVELS.
+  int pyrLevelsUsed;
+
+  // widths and heights in all pyramid levels.
+  int w[PYR_LEVELS], h[PYR_LEVELS];
+
+  // intrinsic parameters in all pyramid levels.
+  float fx[PYR_LEVELS], fy[PYR_LEVELS], cx[PYR_LEVELS], cy[PYR_LEVELS];
+
+  // inverse intrinsic parameters in all pyramid levels.
+  float fxi[PYR_LEVELS], fyi[PYR_LEVELS], cxi[PYR_LEVELS], cyi[PYR_LEVELS];
+
+  // calibration matrix and its inverse in all pyramid levels.
+  Eigen::Matrix3f K[PYR_LEVELS], Ki[PYR_LEVELS];
+
+  // w - 3 and h - 3 of level 0.
+  float wM3;
+  float hM3;
+};
+
+}  // dso
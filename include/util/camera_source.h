@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include "undistorter/undistorter.h"
+#include "util/image_and_exposure.h"
+#include "util/minimal_image.h"
+
+namespace dso {
+
+/** \brief Frames of a live camera, as the driver's own buffers
+ *
+ *  Acquire() hands out a filled driver buffer (mmap'd or DMA memory) without
+ *  copying it, Release() gives it back to the driver. A V4L2 device is
+ *  V4L2CameraSource; a GenICam camera is wrapped the same way around the pop /
+ *  push buffer calls of its SDK.
+ */
+class CameraSource {
+ public:
+  struct Buffer {
+    //! w * h 8 bit pixels, no padding between rows.
+    const unsigned char* data;
+    int w, h;
+    //! seconds, from the driver.
+    double timestamp;
+    //! ms, 0 if the driver does not report it.
+    float exposure;
+    //! driver slot, for Release().
+    int index;
+  };
+
+  virtual ~CameraSource() {}
+
+  /** \brief Wait for the next filled buffer
+   *
+   *  @return false at the end of the stream or on an error.
+   */
+  virtual bool Acquire(Buffer* const buffer) = 0;
+
+  //! Give a buffer of Acquire() back to the driver.
+  virtual void Release(const Buffer& buffer) = 0;
+};
+
+/** \brief 8 bit grey frames of a V4L2 device, streamed through mmap'd buffers
+ *
+ *  Only on linux. The device has to deliver V4L2_PIX_FMT_GREY at w x h
+ *  without row padding, anything else would need a copy to become a
+ *  MinimalImageB view. IsOpen() is false if that or streaming fails.
+ */
+class V4L2CameraSource : public CameraSource {
+ public:
+  V4L2CameraSource(const std::string& device, const int w, const int h,
+                   const int numBuffers = 4);
+  ~V4L2CameraSource() override;
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  bool Acquire(Buffer* const buffer) override;
+  void Release(const Buffer& buffer) override;
+
+ private:
+  void Close();
+
+  std::string device_;
+  int w_, h_;
+  int fd_;
+  std::vector<void*> mapped_;
+  std::vector<size_t> mapped_size_;
+};
+
+/** \brief Undistorted frames of a CameraSource, in reused images
+ *
+ *  Next() undistorts the driver buffer, wrapped as a MinimalImageB view, into
+ *  an image of the pool and gives the buffer back right after, so a frame is
+ *  read from driver memory once and written once. The images go back with
+ *  Recycle() (from any thread); the pool only grows if all are in use.
+ *
+ *  Like the Undistorter, Next() is for one thread only.
+ */
+class CameraReader {
+ public:
+  //! source and undistorter are the caller's and have to outlive this.
+  CameraReader(CameraSource* const source, const Undistorter* const undistorter,
+               const int poolSize = 4);
+  //! Deletes all images of the pool, recycled or not.
+  ~CameraReader();
+
+  /** \brief Next frame of the source, undistorted
+   *
+   *  @return an image of the pool, or nullptr at the end of the stream.
+   */
+  ImageAndExposure* Next();
+
+  //! Give an image of Next() back to the pool.
+  void Recycle(ImageAndExposure* const image);
+
+ private:
+  CameraSource* source_;
+  const Undistorter* undistorter_;
+  int w_, h_;
+
+  boost::mutex pool_mutex_;
+  std::vector<ImageAndExposure*> free_;
+  std::vector<ImageAndExposure*> all_;
+};
+
+}  // namespace dso
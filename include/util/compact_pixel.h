@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cmath>
+#include <limits>
+
+#include "util/num_type.h"
+
+namespace dso {
+
+/** \brief [intensity, gx, gy] of one pixel as 16 bit fixed point
+ *
+ *  Compact (6 instead of 12 bytes) storage of FrameHessian::dI for keyframes in
+ *  the window, see Settings::compactKeyframePyramid. Values are stored with a
+ *  resolution of 1 / kScale and clamped to about +-1024, which covers
+ *  photometrically corrected intensities and their central differences.
+ *  Non-finite intensities are kept as kInvalid and read back as NaN.
+ */
+struct CompactPixel {
+  static constexpr float kScale = 32.f;
+  static constexpr int16_t kInvalid = std::numeric_limits<int16_t>::min();
+
+  int16_t v[3];
+
+  static inline int16_t encode(const float x) {
+    const float s = x * kScale;
+    if (s >= 32767.f) {
+      return 32767;
+    }
+    if (s <= -32767.f) {
+      return -32767;
+    }
+    return static_cast<int16_t>(std::lrint(s));
+  }
+
+  inline void set(const Eigen::Vector3f& p) {
+    v[0] = std::isfinite(p[0]) ? encode(p[0]) : kInvalid;
+    v[1] = encode(p[1]);
+    v[2] = encode(p[2]);
+  }
+
+  //! Values still multiplied by kScale, the intensity is NaN if invalid.
+  inline Eigen::Vector3f scaled() const {
+    return Eigen::Vector3f(v[0] == kInvalid
+                               ? std::numeric_limits<float>::quiet_NaN()
+                               : static_cast<float>(v[0]),
+                           v[1], v[2]);
+  }
+
+  inline Eigen::Vector3f get() const { return scaled() * (1.f / kScale); }
+};
+
+}  // dso
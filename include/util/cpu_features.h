@@ -0,0 +1,62 @@
+#pragma once
+
+#include "util/settings.h"
+
+// Kernels for wider instruction sets are compiled with function level target
+// attributes and picked at runtime, so the binary still runs on CPUs without
+// them.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DSO_AVX_DISPATCH 1
+#define DSO_TARGET_AVX __attribute__((target("avx")))
+#define DSO_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DSO_AVX_DISPATCH 0
+#endif
+
+// NEON is part of the aarch64 baseline, its kernels are picked at build time
+// and replace the SSE2NEON translation of the SSE ones where that is slow. 32
+// bit ARM keeps the translation.
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DSO_NEON 1
+#else
+#define DSO_NEON 0
+#endif
+
+namespace dso {
+
+//! Whether AVX kernels may be used: supported by the CPU and setting_useAVX.
+inline bool useAVX() {
+#if DSO_AVX_DISPATCH
+  static const bool supported = __builtin_cpu_supports("avx");
+  return supported && setting_useAVX;
+#else
+  return false;
+#endif
+}
+
+//! Whether AVX2 kernels may be used: supported by the CPU and setting_useAVX.
+inline bool useAVX2() {
+#if DSO_AVX_DISPATCH
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported && setting_useAVX;
+#else
+  return false;
+#endif
+}
+
+//! Whether the native NEON kernels may be used: aarch64 and setting_useAVX
+//! (off: the SSE2NEON translation, to compare against).
+inline bool useNEON() {
+#if DSO_NEON
+  return setting_useAVX;
+#else
+  return false;
+#endif
+}
+
+//! Log the instruction set every dispatched kernel runs with.
+void logCpuDispatch();
+
+}  // dso
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cuda_runtime.h>
+#include <glog/logging.h>
+
+//! LOG(FATAL) with the CUDA error message if call does not return cudaSuccess.
+#define CUDA_CHECK(call)                                                   \
+  do {                                                                     \
+    const cudaError_t err = (call);                                        \
+    LOG_IF(FATAL, err != cudaSuccess)                                      \
+        << #call << " failed: " << cudaGetErrorString(err);                \
+  } while (0)
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <boost/thread.hpp>
 #include <glog/logging.h>
 
 #include "undistorter/undistorter.h"
-#include "util/global_calib.h"
+#include "util/calib_context.h"
+#include "util/frame_archive.h"
 
 #if HAS_ZIPLIB
 #include "zip.h"
@@ -11,6 +13,13 @@
 
 namespace dso {
 
+/** \brief Frames of a dataset, undistorted
+ *
+ *  path is a directory of images, a .zip of them or a FrameArchive
+ *  (.dsoframes, see FrameArchive::Write). The latter already holds undistorted
+ *  frames with their timestamps, exposures and calibration, so calibration,
+ *  gamma, vignette and timestamp files are not read for it.
+ */
 class DatasetReader {
  public:
   DatasetReader(const std::string& path, const std::string& file_calibration,
@@ -23,10 +32,12 @@ class DatasetReader {
   ~DatasetReader();
 
   Eigen::VectorXf GetOriginalCalib() {
+    CHECK(undistorter_ != nullptr) << "no original calibration in an archive";
     return undistorter_->GetOriginalParameter().cast<float>();
   }
 
   Eigen::Vector2i GetOriginalDimensions() {
+    CHECK(undistorter_ != nullptr) << "no original calibration in an archive";
     return undistorter_->GetOriginalSize();
   }
 
@@ -34,19 +45,40 @@ class DatasetReader {
     CHECK_NOTNULL(K);
     CHECK_NOTNULL(w);
     CHECK_NOTNULL(h);
-    *K = undistorter_->GetK().cast<float>();
-    *w = undistorter_->GetSize()[0];
-    *h = undistorter_->GetSize()[1];
+    if (archive_ != nullptr) {
+      *K = archive_->GetK();
+    } else {
+      *K = undistorter_->GetK().cast<float>();
+    }
+    *w = width_;
+    *h = height_;
+  }
+
+  //! Size of the undistorted frames.
+  Eigen::Vector2i GetSize() const { return Eigen::Vector2i(width_, height_); }
+
+  /** \brief Whether GetImage() returns views instead of new images
+   *
+   *  True for float archives: the pixels stay in the mapped file, GetImage()
+   *  is cheaper than GetImageInto() then.
+   */
+  bool IsZeroCopy() const {
+    return archive_ != nullptr &&
+           archive_->GetPixelFormat() == FrameArchive::PIXEL_FLOAT;
   }
 
-  void SetGlobalCalibration() {
+  //! Pyramid calibration of the undistorted frames, for a FullSystem, with
+  //! at most maxLevels levels.
+  CalibContext GetCalibContext(const int maxLevels = 6) {
     int w_out, h_out;
     Eigen::Matrix3f K;
     GetCalibMono(&K, &w_out, &h_out);
-    SetGlobalCalib(w_out, h_out, K);
+    return CalibContext(w_out, h_out, K, maxLevels);
   }
 
-  size_t GetNumImages() const { return files_.size(); }
+  size_t GetNumImages() const {
+    return archive_ != nullptr ? archive_->GetNumFrames() : files_.size();
+  }
 
   double GetTimestamp(const int id) const {
     if (timestamps_.size() == 0) {
@@ -72,16 +104,60 @@ class DatasetReader {
     return scales_[id];
   }
 
+  //! Owned by the caller. At 1/GetDecodeReduction() of the size of the file.
   MinimalImageB* GetImageRaw(const int id) {
-    return GetImageRawInternal(id, 0);
+    return GetImageRawInternal(id, 0)->getClone();
   }
 
+  /** \brief Fraction of their size images are decoded at
+   *
+   *  1, or with setting_reducedDecode the largest of 2, 4 and 8 that
+   *  leaves them at least at the undistorted size (see
+   *  Undistorter::ReduceInput).
+   */
+  int GetDecodeReduction() const { return decode_reduction_; }
+
   ImageAndExposure* GetImage(const int id,
                              const bool force_load_directly = false) {
     return GetImageInternal(id, 0);
   }
 
+  /** \brief Like GetImage(), but undistorts into a caller-owned image.
+   *
+   *  @param[in]  id  - frame id
+   *  @param[out] img - image of the undistorted size, its buffer is reused
+   */
+  void GetImageInto(const int id, ImageAndExposure* img);
+
+  /** \brief Start decoding and undistorting frames in the background.
+   *
+   *  Every worker owns its own Undistorter (and zip handle and read buffer
+   *  for .zip datasets), frames are buffered in a bounded ring and handed out
+   *  in the order of ids by Next(). GetImage*() stay usable from one other
+   *  thread meanwhile.
+   *
+   *  @param[in] ids         - frame ids, in the order Next() returns them
+   *  @param[in] num_workers - number of decoder / undistorter threads
+   *  @param[in] capacity    - maximum number of frames buffered ahead
+   */
+  void StartPrefetch(const std::vector<int>& ids, const int num_workers,
+                     const int capacity);
+
+  /** \brief Next prefetched frame, blocks until it is ready.
+   *
+   *  @return the frame (owned by the caller), or nullptr once all frames passed
+   *          to StartPrefetch() were returned.
+   */
+  ImageAndExposure* Next();
+
+  //! Stop the prefetch workers and drop all frames not returned yet.
+  void StopPrefetch();
+
   float* GetPhotometricGamma() {
+    if (archive_ != nullptr) {
+      // the mapping is copy-on-write.
+      return const_cast<float*>(archive_->GetGamma());
+    }
     if (undistorter_ == nullptr ||
         undistorter_->photometric_undistorter_ == nullptr) {
       return nullptr;
@@ -90,14 +166,30 @@ class DatasetReader {
   }
 
  public:
-  // Undistorter. [0] always exists, [1-2] only when MT is enabled.
+  // Undistorter. [0] always exists, [1-2] only when MT is enabled. nullptr
+  // when reading a FrameArchive.
   Undistorter* undistorter_;
   void LoadScales(const std::string &file_scales);
  private:
   void SetFiles(std::string dir);
 
-  MinimalImageB* GetImageRawInternal(const int id, const int unused);
-  ImageAndExposure* GetImageInternal(const int id, const int unused);
+  //! Open path as FrameArchive if it is one, instead of files and undistorter.
+  bool OpenArchive(const std::string& path);
+
+  //! Frame id of archive_, a view into it or converted from uint8.
+  ImageAndExposure* GetArchiveImage(const int id);
+
+  //! ReduceInput of undistorter by decode_reduction_, the first call sets it.
+  void ReduceForDecode(Undistorter* const undistorter);
+
+  // reader_id: index into zip_readers_ and raw_images_, the same as
+  // undistorter_id. The image is raw_images_[reader_id], valid until the next
+  // call with that reader_id.
+  MinimalImageB* GetImageRawInternal(const int id, const int reader_id);
+  // undistorter_id: 0 for undistorter_, k for prefetch_undistorters_[k - 1].
+  ImageAndExposure* GetImageInternal(const int id, const int undistorter_id);
+
+  void PrefetchLoop(const int worker);
 
   void LoadTimestamps();
   void LoadTimestamps(const std::string& file_timestamps);
@@ -110,15 +202,44 @@ class DatasetReader {
 
   int width_, height_;
   int width_org_, height_org_;
+  int decode_reduction_ = 0;
+
+  // decoded images, reused: [0] for the caller of GetImage*, [k] for prefetch
+  // worker k.
+  std::vector<MinimalImageB*> raw_images_;
 
   std::string path_;
   std::string file_calibration_;
+  std::string file_gamma_;
+  std::string file_vignette_;
+
+  // prefetch ring: frame prefetch_ids_[k] lives in slot k % capacity.
+  std::vector<int> prefetch_ids_;
+  std::vector<ImageAndExposure*> prefetch_ring_;
+  std::vector<Undistorter*> prefetch_undistorters_;
+  boost::thread_group prefetch_threads_;
+  size_t prefetch_next_claim_ = 0;
+  size_t prefetch_next_out_ = 0;
+  bool prefetch_running_ = false;
+  boost::mutex prefetch_mutex_;
+  boost::condition_variable prefetch_ready_;
+  boost::condition_variable prefetch_space_;
 
   bool is_zipped_;
 
+  FrameArchive* archive_ = nullptr;
+
 #if HAS_ZIPLIB
+  struct ZipReader {
+    zip_t* archive = nullptr;
+    std::vector<char> buffer;
+  };
+
   zip_t* zip_archive_;
-  char* data_buffer_;
+
+  // [0] for the caller of GetImage*, [k] for prefetch worker k, opened on
+  // first use. [0].archive is zip_archive_.
+  std::vector<ZipReader> zip_readers_;
 #endif
 };
 }
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+#include <glog/logging.h>
+
+namespace dso {
+
+/** \brief Open addressing hash map from uint64_t keys to T
+ *
+ *  Linear probing in one flat array of (key, value) slots whose size is a power
+ *  of two, kept at most half full. Meant for small, insert-only key sets that
+ *  are looked up very often, like EnergyFunctional::connectivityMap (updated
+ *  for every residual insert / drop). There is no erase, and iteration order
+ *  is unspecified. References are invalidated when a new key is inserted.
+ *
+ *  kEmptyKey marks unused slots and cannot be used as a key.
+ */
+template <typename T>
+class FlatHashMap {
+ public:
+  typedef std::pair<uint64_t, T> Slot;
+  typedef std::vector<Slot, Eigen::aligned_allocator<Slot>> SlotVector;
+
+  static constexpr uint64_t kEmptyKey = ~(uint64_t)0;
+
+  //! Forward iterator over the used slots.
+  template <typename SlotIt, typename SlotRef>
+  class Iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Slot value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef SlotRef reference;
+    typedef typename std::remove_reference<SlotRef>::type* pointer;
+
+    Iterator(SlotIt it, SlotIt end) : it(it), end(end) { skipEmpty(); }
+
+    inline reference operator*() const { return *it; }
+    inline pointer operator->() const { return &*it; }
+    inline Iterator& operator++() {
+      ++it;
+      skipEmpty();
+      return *this;
+    }
+    inline bool operator==(const Iterator& other) const {
+      return it == other.it;
+    }
+    inline bool operator!=(const Iterator& other) const {
+      return it != other.it;
+    }
+
+   private:
+    inline void skipEmpty() {
+      while (it != end && it->first == kEmptyKey) {
+        ++it;
+      }
+    }
+
+    SlotIt it, end;
+  };
+  typedef Iterator<typename SlotVector::iterator, Slot&> iterator;
+  typedef Iterator<typename SlotVector::const_iterator, const Slot&>
+      const_iterator;
+
+  FlatHashMap() : used(0) {}
+
+  //! Value of key, value-initialized T() if key is new.
+  inline T& operator[](const uint64_t key) {
+    CHECK_NE(key, kEmptyKey);
+    if (2 * (used + 1) > slots.size()) {
+      grow();
+    }
+    const size_t i = findSlot(key);
+    if (slots[i].first == kEmptyKey) {
+      slots[i].first = key;
+      slots[i].second = T();
+      ++used;
+    }
+    return slots[i].second;
+  }
+
+  //! Value of key, which has to exist.
+  inline const T& at(const uint64_t key) const {
+    CHECK(!slots.empty());
+    const size_t i = findSlot(key);
+    CHECK_EQ(slots[i].first, key);
+    return slots[i].second;
+  }
+
+  inline size_t count(const uint64_t key) const {
+    return !slots.empty() && slots[findSlot(key)].first == key ? 1 : 0;
+  }
+
+  inline size_t size() const { return used; }
+  inline bool empty() const { return used == 0; }
+
+  inline void clear() {
+    slots.clear();
+    used = 0;
+  }
+
+  inline iterator begin() { return iterator(slots.begin(), slots.end()); }
+  inline iterator end() { return iterator(slots.end(), slots.end()); }
+  inline const_iterator begin() const {
+    return const_iterator(slots.begin(), slots.end());
+  }
+  inline const_iterator end() const {
+    return const_iterator(slots.end(), slots.end());
+  }
+
+ private:
+  //! splitmix64 finalizer, frame id pairs differ in few, structured bits.
+  static inline uint64_t hash(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  //! Slot holding key, or the empty slot where it would be inserted.
+  inline size_t findSlot(const uint64_t key) const {
+    const size_t mask = slots.size() - 1;
+    size_t i = hash(key) & mask;
+    while (slots[i].first != key && slots[i].first != kEmptyKey) {
+      i = (i + 1) & mask;
+    }
+    return i;
+  }
+
+  void grow() {
+    SlotVector old(slots.empty() ? 64 : 2 * slots.size(),
+                   Slot(kEmptyKey, T()));
+    old.swap(slots);
+    for (const Slot& slot : old) {
+      if (slot.first != kEmptyKey) {
+        slots[findSlot(slot.first)] = slot;
+      }
+    }
+  }
+
+  SlotVector slots;
+  size_t used;
+};
+
+template <typename T>
+constexpr uint64_t FlatHashMap<T>::kEmptyKey;
+
+}  // dso
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace dso {
+
+class DatasetReader;
+
+/** \brief Memory-mapped container of undistorted frames
+ *
+ *  Holds the frames of a sequence as DatasetReader returns them, i.e. after
+ *  photometric and geometric undistortion, together with their timestamps,
+ *  exposures and initial scales, the undistorted calibration and the
+ *  photometric response. Reading it back needs neither image decoding nor
+ *  undistortion, and float frames are handed out as views into the mapping.
+ *
+ *  Layout: Header, numFrames Entry, then every frame at an offset aligned to
+ *  kFrameAlignment, as width * height float or uint8 (rounded) pixels.
+ */
+class FrameArchive {
+ public:
+  enum PixelFormat { PIXEL_FLOAT = 0, PIXEL_UINT8 = 1 };
+
+  static const char kMagic[8];
+  static const uint32_t kVersion = 1;
+  static const uint64_t kFrameAlignment = 4096;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t pixelFormat;
+    uint32_t width, height;
+    uint32_t numFrames;
+    uint32_t hasGamma;
+    double K[4];  //!< fx, fy, cx, cy of the undistorted frames
+    float gamma[256];
+  };
+
+  struct Entry {
+    uint64_t offset;  //!< of the pixels, from the start of the file
+    double timestamp;
+    float exposure;
+    float initScale;
+  };
+
+  //! File extension DatasetReader opens as a FrameArchive.
+  static bool IsArchivePath(const std::string& path);
+
+  /** \brief Write frames ids of reader into a new archive at path
+   *
+   *  @return false if the file could not be written
+   */
+  static bool Write(const std::string& path, DatasetReader* const reader,
+                    const std::vector<int>& ids, const PixelFormat format);
+
+  //! Map the archive at path, LOG(FATAL) if it is missing or malformed.
+  explicit FrameArchive(const std::string& path);
+  ~FrameArchive();
+
+  int GetNumFrames() const { return header_->numFrames; }
+  int GetWidth() const { return header_->width; }
+  int GetHeight() const { return header_->height; }
+  PixelFormat GetPixelFormat() const {
+    return static_cast<PixelFormat>(header_->pixelFormat);
+  }
+  Eigen::Matrix3f GetK() const;
+
+  //! Photometric response G, nullptr if written without one.
+  const float* GetGamma() const {
+    return header_->hasGamma ? header_->gamma : nullptr;
+  }
+
+  const Entry& GetEntry(const int id) const { return entries_[id]; }
+
+  /** \brief Pixels of frame id, width * height of GetPixelFormat()
+   *
+   *  The mapping is copy-on-write, writes to them stay in this process.
+   */
+  void* GetPixels(const int id) const {
+    return static_cast<char*>(data_) + entries_[id].offset;
+  }
+
+ private:
+  void* data_;
+  size_t size_;
+  const Header* header_;
+  const Entry* entries_;
+};
+
+}  // dso
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <deque>
+
+#include <glog/logging.h>
+
+#include "util/frame_shell.h"
+
+namespace dso {
+
+/** \brief FrameShells of a FullSystem in the order they were added
+ *
+ *  size() counts every shell ever added, also the dropped ones, so it keeps
+ *  working as the next id. Iteration, back() and operator[] only see the
+ *  kept shells, which are [size() - numKept(), size()). Without dropBefore()
+ *  this is a plain vector of all shells.
+ *
+ *  Does not own the shells.
+ */
+class FrameHistory {
+ public:
+  typedef std::deque<FrameShell*>::const_iterator const_iterator;
+
+  size_t size() const { return numDropped + shells.size(); }
+  bool empty() const { return size() == 0; }
+  size_t numKept() const { return shells.size(); }
+
+  //! The i-th shell added, has to be kept.
+  FrameShell* operator[](const size_t i) const {
+    DCHECK_GE(i, numDropped);
+    return shells[i - numDropped];
+  }
+  FrameShell* back() const { return shells.back(); }
+
+  const_iterator begin() const { return shells.begin(); }
+  const_iterator end() const { return shells.end(); }
+
+  void emplace_back(FrameShell* const shell) { shells.emplace_back(shell); }
+
+  /** \brief Drop the shells in front with an id below id
+   *
+   *  @param[in] release - called with every dropped shell, e.g. to delete it
+   */
+  template <typename Release>
+  void dropBefore(const int id, Release release) {
+    while (!shells.empty() && shells.front()->id < id) {
+      release(shells.front());
+      shells.pop_front();
+      ++numDropped;
+    }
+  }
+
+  void clear() {
+    shells.clear();
+    numDropped = 0;
+  }
+
+ private:
+  std::deque<FrameShell*> shells;
+  size_t numDropped = 0;
+};
+
+}  // namespace dso
@@ -2,13 +2,15 @@
 
 #include <algorithm>
 
+#include "util/memory_stats.h"
 #include "util/num_type.h"
+#include "util/object_pool.h"
 
 namespace dso {
 
 class FrameShell {
  public:
-  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  DSO_POOLED_OPERATOR_NEW(FrameShell)
   int id;            // INTERNAL ID, starting at zero.
   int incoming_id;   // ID passed into DSO
   double timestamp;  // timestamp passed into DSO.
@@ -31,6 +33,8 @@ class FrameShell {
   int marginalizedAt;
   double movedByOpt;
 
+  MemoryAccount memory{MEM_FRAME_SHELLS, sizeof(FrameShell)};
+
   inline FrameShell() {
     id = 0;
     poseValid = true;
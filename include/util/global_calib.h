@@ -1,19 +0,0 @@
-#pragma once
-
-#include "util/num_type.h"
-#include "util/settings.h"
-
-namespace dso {
-extern int wG[PYR_LEVELS], hG[PYR_LEVELS];
-extern float fxG[PYR_LEVELS], fyG[PYR_LEVELS], cxG[PYR_LEVELS], cyG[PYR_LEVELS];
-
-extern float fxiG[PYR_LEVELS], fyiG[PYR_LEVELS], cxiG[PYR_LEVELS],
-    cyiG[PYR_LEVELS];
-
-extern Eigen::Matrix3f KG[PYR_LEVELS], KiG[PYR_LEVELS];
-
-extern float wM3G;
-extern float hM3G;
-
-void SetGlobalCalib(const int w, const int h, const Eigen::Matrix3f& K);
-}
@@ -3,6 +3,7 @@
 #include <fstream>
 
 #include "io_wrapper/image_display.h"
+#include "util/compact_pixel.h"
 #include "util/num_type.h"
 #include "util/settings.h"
 
@@ -59,6 +60,24 @@ EIGEN_ALWAYS_INLINE Eigen::Vector3f getInterpolatedElement33(
          (1 - dx - dy + dxdy) * *(const Eigen::Vector3f*)(bp);
 }
 
+// Get interpolated [intensity, gx, gy] from a compact (fixed point) image.
+EIGEN_ALWAYS_INLINE Eigen::Vector3f getInterpolatedElement33(
+    const CompactPixel* const mat, const float x, const float y,
+    const int width) {
+  int ix = static_cast<int>(x);
+  int iy = static_cast<int>(y);
+  float dx = x - ix;
+  float dy = y - iy;
+  float dxdy = dx * dy;
+  const CompactPixel* bp = mat + ix + iy * width;
+
+  // interpolate the fixed point values, scale once.
+  return (dxdy * bp[1 + width].scaled() + (dy - dxdy) * bp[width].scaled() +
+          (dx - dxdy) * bp[1].scaled() +
+          (1 - dx - dy + dxdy) * bp[0].scaled()) *
+         (1.f / CompactPixel::kScale);
+}
+
 EIGEN_ALWAYS_INLINE Eigen::Vector3f getInterpolatedElement33OverAnd(
     const Eigen::Vector3f* const mat, const bool* overMat, const float x,
     const float y, const int width, bool& over_out) {
@@ -12,11 +12,22 @@ class ImageAndExposure {
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
   ImageAndExposure(int w_, int h_, double timestamp_ = 0)
-      : w(w_), h(h_), timestamp(timestamp_) {
+      : w(w_), h(h_), timestamp(timestamp_), owns_image(true) {
     image = new float[w * h];
     exposure_time = 1.f;
   }
-  ~ImageAndExposure() { delete[] image; }
+
+  //! View of w * h pixels owned by someone else (e.g. a FrameArchive).
+  ImageAndExposure(int w_, int h_, float* view, double timestamp_)
+      : image(view), w(w_), h(h_), timestamp(timestamp_), owns_image(false) {
+    exposure_time = 1.f;
+  }
+
+  ~ImageAndExposure() {
+    if (owns_image) {
+      delete[] image;
+    }
+  }
 
   void CopyMetaTo(ImageAndExposure& other) {
     other.exposure_time = exposure_time;
@@ -34,5 +45,8 @@ class ImageAndExposure {
   int w, h;      // width and height;
   double timestamp, init_scale;
   float exposure_time;  // exposure time in ms.
+
+ private:
+  bool owns_image;
 };
 }
@@ -3,180 +3,344 @@
 #include <iostream>
 #include <stdio.h>
 
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
 #include <boost/thread.hpp>
 #include <glog/logging.h>
 
 #include "util/num_type.h"
+#include "util/sampling_profiler.h"
 #include "util/settings.h"
+#include "util/thread_config.h"
 
 namespace dso {
 
+/** \brief Work-stealing pool used for all index-range reductions.
+ *
+ *  reduce() splits [first, end) into chunks of stepSize and hands every slot
+ *  (tid) a contiguous run of chunks in its own queue. Slot w is run by worker
+ *  w: it pops from the front of its own queue and, once empty, steals from
+ *  the back of the others. Each slot accumulates into its own Running, which
+ *  are summed in slot order once all slots are done.
+ *
+ *  Every slot is run once per reduce() (with an empty range if it got no
+ *  chunk), so per-thread state can be reset through reduce(f, 0, 0, 0).
+ *  That also makes worker w, which runs slot w whenever it is free, the first
+ *  to touch per-thread state it allocates there, which puts it on the
+ *  worker's NUMA node.
+ *
+ *  With setting_reduceNumaNodes each worker is pinned to one NUMA node, the
+ *  workers of a node numbered consecutively (ThreadConfig::GetReduceNode).
+ *  The runs of chunks then give each node one contiguous part of the range,
+ *  the same part for the same range in every call, and slots steal from the
+ *  slots of their own node first.
+ *
+ *  With setting_deterministicReduce nothing is stolen, so which slot runs
+ *  which chunk only depends on the range, stepSize and the number of workers:
+ *  the Running, per-thread state and anything merged in tid order come out
+ *  the same in every run. The chunks are then dealt round robin (unless
+ *  setting_reduceNumaNodes), which balances about as well as stealing does
+ *  for the many small chunks of the stepSize 50 calls; with stepSize 0 every
+ *  slot gets one chunk either way. The slots' Running are always added up
+ *  pairwise in a fixed tree.
+ *
+ *  reduce() may be called from several threads at once, e.g. by several
+ *  FullSystems sharing one pool. Every call is a job of its own and the
+ *  workers take slots of all of them. A slot whose worker is busy with
+ *  another call is run by an idle worker or by the calling thread, which
+ *  otherwise waits; what a slot computes does not depend on the thread.
+ */
 template <typename Running> class IndexThreadReduce {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-  inline IndexThreadReduce() {
-    nextIndex = 0;
-    maxIndex = 0;
-    stepSize = 1;
-    callPerIndex =
-        boost::bind(&IndexThreadReduce::callPerIndexDefault, this,
-                    boost::placeholders::_1, boost::placeholders::_2,
-                    boost::placeholders::_3, boost::placeholders::_4);
+  /** \brief Start the worker threads.
+   *
+   *  @param[in] threads - number of workers. <= 0 uses setting_numThreads, or
+   *                       the hardware concurrency if that is <= 0 as well.
+   *                       Clamped to [1, NUM_THREADS].
+   */
+  inline explicit IndexThreadReduce(int threads = 0) {
+    if (threads <= 0) {
+      threads = setting_numThreads;
+    }
+    if (threads <= 0) {
+      threads = static_cast<int>(boost::thread::hardware_concurrency());
+    }
+    numThreads = std::max(1, std::min(threads, NUM_THREADS));
+
+    for (int i = 0; i < numThreads; ++i) {
+      workerNode[i] = ThreadConfig::GetReduceNode(i, numThreads);
+      workerBusy[i] = false;
+    }
 
     running = true;
-    for (int i = 0; i < NUM_THREADS; ++i) {
-      isDone[i] = false;
-      gotOne[i] = true;
+    for (int i = 0; i < numThreads; ++i) {
       workerThreads[i] = boost::thread(&IndexThreadReduce::workerLoop, this, i);
     }
+    LOG(INFO) << "ThreadReduce started with " << numThreads << " workers.";
   }
   inline ~IndexThreadReduce() {
-    running = false;
-
     exMutex.lock();
+    running = false;
     todo_signal.notify_all();
     exMutex.unlock();
 
-    for (int i = 0; i < NUM_THREADS; ++i) {
+    for (int i = 0; i < numThreads; ++i) {
       workerThreads[i].join();
     }
 
     printf("destroyed ThreadReduce\n");
   }
 
-  inline void
+  //! Run callPerIndex on [first, end), returns the sum of the slots' Running.
+  inline Running
   reduce(boost::function<void(int, int, Running *, int)> callPerIndex,
          int first, int end, int stepSize = 0) {
+    Running stats;
     memset((void*)&stats, 0, sizeof(Running));
 
-    //		if(!multiThreading)
-    //		{
-    //			callPerIndex(first, end, &stats, 0);
-    //			return;
-    //		}
-
     if (stepSize == 0) {
-      stepSize = ((end - first) + NUM_THREADS - 1) / NUM_THREADS;
+      stepSize = ((end - first) + numThreads - 1) / numThreads;
     }
 
-    // printf("reduce called\n");
-
-    boost::unique_lock<boost::mutex> lock(exMutex);
-
-    // save
-    this->callPerIndex = callPerIndex;
-    nextIndex = first;
-    maxIndex = end;
-    this->stepSize = stepSize;
-
-    // go worker threads!
-    for (int i = 0; i < NUM_THREADS; ++i) {
-      isDone[i] = false;
-      gotOne[i] = false;
+    Job job;
+    job.callPerIndex = callPerIndex;
+    job.maxIndex = end;
+    job.stepSize = stepSize;
+    job.stealing = !setting_deterministicReduce;
+    // the workers work on what the caller works on.
+    job.tags = SamplingProfiler::getTags();
+
+    // hand out contiguous runs of chunks, one run per slot, or deal them
+    // round robin if they stay where they are. Either way every slot's
+    // chunks are in increasing order.
+    const int numChunks =
+        (stepSize > 0 && end > first) ? (end - first + stepSize - 1) / stepSize
+                                      : 0;
+    const bool roundRobin = !job.stealing && !setting_reduceNumaNodes;
+    auto slotOf = [&](const int c) {
+      return roundRobin ? c % numThreads
+                        : (int)((long)c * numThreads / numChunks);
+    };
+    int slotChunks[NUM_THREADS] = {0};
+    for (int c = 0; c < numChunks; ++c) {
+      ++slotChunks[slotOf(c)];
+    }
+    for (int w = 0, next = 0; w < numThreads; next += slotChunks[w], ++w) {
+      job.slots[w].front = job.slots[w].back = next;
+    }
+    job.chunks.resize(numChunks);
+    for (int c = 0; c < numChunks; ++c) {
+      job.chunks[job.slots[slotOf(c)].back++] = first + c * stepSize;
     }
 
-    // let them start!
+    boost::unique_lock<boost::mutex> lock(exMutex);
+    activeJobs.push_back(&job);
     todo_signal.notify_all();
 
-    // printf("reduce waiting for threads to finish\n");
-    // wait for all worker threads to signal they are done.
-    while (true) {
-      // wait for at least one to finish
-      done_signal.wait(lock);
-      // printf("thread finished!\n");
-
-      // check if actually all are finished.
-      bool allDone = true;
-      for (int i = 0; i < NUM_THREADS; ++i) {
-        allDone = allDone && isDone[i];
+    // run the slots of workers that are busy with other calls, else wait.
+    while (job.numDone < numThreads) {
+      int slot = -1;
+      for (int w = 0; w < numThreads && slot < 0; ++w) {
+        if (!job.claimed[w] && workerBusy[w]) {
+          slot = w;
+        }
       }
-
-      // all are finished! exit.
-      if (allDone) {
-        break;
+      if (slot < 0) {
+        done_signal.wait(lock);
+        continue;
       }
+      claimSlot(&job, slot);
+      lock.unlock();
+      runSlot(&job, slot);
+      lock.lock();
+      finishSlot(&job);
     }
+    lock.unlock();
 
-    nextIndex = 0;
-    maxIndex = 0;
-    this->callPerIndex =
-        boost::bind(&IndexThreadReduce::callPerIndexDefault, this,
-                    boost::placeholders::_1, boost::placeholders::_2,
-                    boost::placeholders::_3, boost::placeholders::_4);
-
-    // printf("reduce done (all threads finished)\n");
+    // pairwise: ((0 + 1) + (2 + 3)) + ..., the same order in every call.
+    for (int width = 1; width < numThreads; width *= 2) {
+      for (int i = 0; i + width < numThreads; i += 2 * width) {
+        job.slots[i].stats += job.slots[i + width].stats;
+      }
+    }
+    stats += job.slots[0].stats;
+    return stats;
   }
 
-  Running stats;
+  //! Number of workers, i.e. the range of tid passed to callPerIndex.
+  inline int getNumThreads() const { return numThreads; }
 
 private:
+  struct Slot {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    Running stats;
+    // [front, back) of Job::chunks still to run, protected by mutex.
+    boost::mutex mutex;
+    int front = 0;
+    int back = 0;
+  };
+
+  //! One reduce() call, on the stack of its caller.
+  struct Job {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    boost::function<void(int, int, Running *, int)> callPerIndex;
+    int maxIndex = 0;
+    int stepSize = 1;
+    // false with setting_deterministicReduce.
+    bool stealing = true;
+    ProfileTags tags;
+    // first index of every chunk, grouped by slot.
+    std::vector<int> chunks;
+    Slot slots[NUM_THREADS];
+
+    // protected by exMutex.
+    bool claimed[NUM_THREADS] = {false};
+    int numClaimed = 0;
+    int numDone = 0;
+  };
+
   boost::thread workerThreads[NUM_THREADS];
-  bool isDone[NUM_THREADS];
-  bool gotOne[NUM_THREADS];
+  // NUMA node of every worker, -1 for any.
+  int workerNode[NUM_THREADS];
+  int numThreads;
 
   boost::mutex exMutex;
+  // workers wait for a slot to run, callers for their job to finish or for
+  // a slot of theirs to be left by its busy worker.
   boost::condition_variable todo_signal;
   boost::condition_variable done_signal;
 
-  int nextIndex;
-  int maxIndex;
-  int stepSize;
-
+  // protected by exMutex.
+  // jobs with slots nobody took yet, oldest first.
+  std::vector<Job *> activeJobs;
+  // whether a worker is running a slot.
+  bool workerBusy[NUM_THREADS];
   bool running;
 
-  boost::function<void(int, int, Running *, int)> callPerIndex;
+  //! Mark a slot as taken, the job leaves activeJobs with its last one.
+  void claimSlot(Job *job, const int slot) {
+    job->claimed[slot] = true;
+    if (++job->numClaimed == numThreads) {
+      activeJobs.erase(
+          std::find(activeJobs.begin(), activeJobs.end(), job));
+    }
+  }
 
-  void callPerIndexDefault(int i, int j, Running *k, int tid) {
-    LOG(ERROR) << "ERROR: should never be called....";
-    assert(false);
+  void finishSlot(Job *job) {
+    if (++job->numDone == numThreads) {
+      done_signal.notify_all();
+    }
   }
 
-  void workerLoop(int idx) {
-    boost::unique_lock<boost::mutex> lock(exMutex);
+  //! The slot worker idx runs next: its own one of the oldest job that has
+  //! it free, else one whose worker is busy elsewhere.
+  bool findSlot(const int idx, Job **job, int *slot) const {
+    for (Job *j : activeJobs) {
+      if (!j->claimed[idx]) {
+        *job = j;
+        *slot = idx;
+        return true;
+      }
+    }
+    for (Job *j : activeJobs) {
+      for (int w = 0; w < numThreads; ++w) {
+        if (!j->claimed[w] && workerBusy[w]) {
+          *job = j;
+          *slot = w;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
 
-    while (running) {
-      // try to get something to do.
-      int todo = 0;
-      bool gotSomething = false;
-      if (nextIndex < maxIndex) {
-        // got something!
-        todo = nextIndex;
-        nextIndex += stepSize;
-        gotSomething = true;
+  //! Take the next chunk of a slot from its own queue, or steal one from
+  //! another slot, one on the same NUMA node first (if stealing).
+  bool getChunk(Job *job, const int slot, int *todo) {
+    {
+      Slot &own = job->slots[slot];
+      boost::unique_lock<boost::mutex> qlock(own.mutex);
+      if (own.front < own.back) {
+        *todo = job->chunks[own.front++];
+        return true;
       }
+    }
+    if (!job->stealing) {
+      return false;
+    }
 
-      // if got something: do it (unlock in the meantime)
-      if (gotSomething) {
-        lock.unlock();
+    for (int sameNode = 1; sameNode >= 0; --sameNode) {
+      for (int k = 1; k < numThreads; ++k) {
+        const int v = (slot + k) % numThreads;
+        if ((workerNode[v] == workerNode[slot]) != (sameNode == 1)) {
+          continue;
+        }
+        Slot &victim = job->slots[v];
+        boost::unique_lock<boost::mutex> qlock(victim.mutex);
+        if (victim.front < victim.back) {
+          *todo = job->chunks[--victim.back];
+          return true;
+        }
+      }
+    }
+    return false;
+  }
 
-        assert(callPerIndex != 0);
+  void runSlot(Job *job, const int slot) {
+    Running *s = &job->slots[slot].stats;
+    memset((void*)s, 0, sizeof(Running));
 
-        Running s;
-        memset((void*)&s, 0, sizeof(Running));
-        callPerIndex(todo, std::min(todo + stepSize, maxIndex), &s, idx);
-        gotOne[idx] = true;
-        lock.lock();
-        stats += s;
-      }
+    bool gotOne = false;
+    int todo = 0;
+    while (getChunk(job, slot, &todo)) {
+      job->callPerIndex(todo, std::min(todo + job->stepSize, job->maxIndex), s,
+                        slot);
+      gotOne = true;
+    }
+    if (!gotOne) {
+      job->callPerIndex(0, 0, s, slot);
+    }
+  }
 
-      // otherwise wait on signal, releasing lock in the meantime.
-      else {
-        if (!gotOne[idx]) {
-          lock.unlock();
-          assert(callPerIndex != 0);
-          Running s;
-          memset((void*)&s, 0, sizeof(Running));
-          callPerIndex(0, 0, &s, idx);
-          gotOne[idx] = true;
-          lock.lock();
-          stats += s;
-        }
-        isDone[idx] = true;
-        // printf("worker %d waiting..\n", idx);
-        done_signal.notify_all();
+  void workerLoop(int idx) {
+    ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_REDUCE,
+                                    workerNode[idx]);
+    ThreadConfig::SetThreadName("reduce" + std::to_string(idx));
+
+    boost::unique_lock<boost::mutex> lock(exMutex);
+
+    while (true) {
+      Job *job = nullptr;
+      int slot = -1;
+      while (running && !findSlot(idx, &job, &slot)) {
         todo_signal.wait(lock);
       }
+      if (!running) {
+        return;
+      }
+      claimSlot(job, slot);
+      workerBusy[idx] = true;
+      // own slots left in other jobs can now be run by someone else.
+      for (const Job *other : activeJobs) {
+        if (!other->claimed[idx]) {
+          todo_signal.notify_all();
+          done_signal.notify_all();
+          break;
+        }
+      }
+      SamplingProfiler::setTags(job->tags);
+      lock.unlock();
+
+      runSlot(job, slot);
+
+      lock.lock();
+      workerBusy[idx] = false;
+      finishSlot(job);
     }
   }
 };
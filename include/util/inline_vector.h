@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <type_traits>
+
+#include <glog/logging.h>
+
+namespace dso {
+
+/** \brief The part of std::vector the point residual lists use, with a fixed
+ *  capacity of N elements stored in the object itself
+ *
+ *  The residuals of a point are bounded by the window size, so they need no
+ *  allocation of their own and iterating them stays within the point. Going
+ *  past N is a CHECK failure. Only for trivially copyable T (pointers).
+ */
+template <typename T, int N>
+class InlineVector {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "InlineVector only holds trivially copyable types");
+
+ public:
+  typedef T value_type;
+  typedef T* iterator;
+  typedef const T* const_iterator;
+
+  InlineVector() : n(0) {}
+
+  inline size_t size() const { return n; }
+  inline bool empty() const { return n == 0; }
+  static constexpr size_t capacity() { return N; }
+
+  inline T& operator[](const size_t i) {
+    DCHECK_LT(i, n);
+    return items[i];
+  }
+  inline const T& operator[](const size_t i) const {
+    DCHECK_LT(i, n);
+    return items[i];
+  }
+  inline T& back() {
+    DCHECK_GT(n, 0u);
+    return items[n - 1];
+  }
+  inline const T& back() const {
+    DCHECK_GT(n, 0u);
+    return items[n - 1];
+  }
+
+  inline iterator begin() { return items; }
+  inline iterator end() { return items + n; }
+  inline const_iterator begin() const { return items; }
+  inline const_iterator end() const { return items + n; }
+
+  inline void emplace_back(const T& value) {
+    CHECK_LT(n, static_cast<size_t>(N)) << "InlineVector full";
+    items[n++] = value;
+  }
+  inline void push_back(const T& value) { emplace_back(value); }
+  inline void pop_back() {
+    DCHECK_GT(n, 0u);
+    --n;
+  }
+
+  //! New elements are value-initialized.
+  inline void resize(const size_t size) {
+    CHECK_LE(size, static_cast<size_t>(N));
+    for (size_t i = n; i < size; ++i) {
+      items[i] = T();
+    }
+    n = size;
+  }
+  //! Only checks that size fits.
+  inline void reserve(const size_t size) const {
+    CHECK_LE(size, static_cast<size_t>(N));
+  }
+  inline void clear() { n = 0; }
+
+ private:
+  T items[N];
+  size_t n;
+};
+
+}  // namespace dso
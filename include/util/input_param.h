@@ -17,8 +17,66 @@ struct InputParam {
   int start_id = 0;
   int end_id = 10000000;
 
+  int num_threads = 0;
+  int prefetch_threads = 2;
+  int prefetch_buffer = 16;
+  int pyramid_pool_size = 4;
+  int opt_trial_steps = 1;
+  int init_attempts = 1;
+  int init_attempt_spacing = 5;
+  int reloc_keyframes = 0;
+  int reloc_candidates = 3;
+  int reloc_max_frames = 100;
+  int pattern = 8;
+  int pyr_levels = 6;
+  int result_sync_interval_ms = 0;
+  int snapshot_interval = 0;
+  int shm_slots = 256;
+  int map_store_cache_points = 4000000;
+  int output_queue_size = 0;
+  int output_backpressure = 2;
+  int stage_timing_interval = 0;
+  int memory_stats_interval = 0;
+  int metrics_port = 0;
+  int random_seed = 3141592;
+  int sweep_samples = 0;
+  int sweep_jobs = 1;
+  int replay_repeats = 1;
+  int batch_jobs = 0;
+  int batch_memory_mb = 0;
+  int batch_instance_mb = 0;
+  int trace_max_events = 8000000;
+  int profile_hz = 1000;
+  int profile_max_samples = 100000;
+  int profile_top_frames = 0;
+
+  std::string tracker_cpus = "";
+  std::string mapper_cpus = "";
+  std::string reduce_cpus = "";
+  int tracker_rt_priority = 0;
+  int mapper_rt_priority = 0;
+  int reduce_rt_priority = 0;
+  int tracker_nice = 0;
+  int mapper_nice = 0;
+  int reduce_nice = 0;
+  bool reduce_numa_nodes = false;
+  bool deterministic_reduce = false;
+
   float play_speed = 0.f;
+  float min_rel_energy_decrease = 0.f;
+  float keyframe_time_budget_ms = 0.f;
+  float lazy_relin_threshold = 0.f;
+  float latency_budget_ms = 0.f;
+  float latency_hysteresis = 0.2f;
+  float tracking_deadline_factor = 0.f;
+  float coarse_subsample_ratio = 1.f;
+  float reloc_min_score = 0.5f;
+  float reloc_max_rmse = 12.f;
+  float map_store_cell_size = 2.f;
+  float map_store_view_radius = 20.f;
+  int coarse_tracking_finest_level = 0;
   double rescale = 0.;
+  double regression_tolerance = 0.05;
 
   std::string path_2_timestamps = "";
   std::string path_2_images = "";
@@ -27,6 +85,21 @@ struct InputParam {
   std::string path_2_gamma = "";
   std::string path_2_log = "";
   std::string path_2_scales = "";
+  std::string path_2_snapshot = "snapshot.bin";
+  std::string shm_output = "";
+  std::string path_2_map_store = "";
+  std::string path_2_stage_timing = "stage_timing.csv";
+  std::string path_2_perf_counters = "perf_counters.csv";
+  std::string path_2_trace = "trace.json";
+  std::string path_2_remap_cache = "";
+  std::string path_2_profile = "profile.folded";
+  std::string path_2_groundtruth = "";
+  std::string path_2_replay_report = "replay_bench.json";
+  std::string replay_threads = "";
+  std::string replay_presets = "";
+  std::string sweep_params = "";
+  std::string path_2_replay_baseline = "";
+  std::string path_2_batch_list = "";
 
   bool use_scales = false;
   bool use_sample_output = false;
@@ -37,9 +110,24 @@ struct InputParam {
   bool prefetch = false;
   bool no_gui = false;
   bool multi_threading = true;
+  bool use_avx = true;
+  bool compact_keyframes = false;
+  bool release_keyframe_pyramid = true;
+  bool compact_jacobians = false;
+  bool bounded_frame_history = false;
+  bool validate_ef = false;
+  bool coarse_tracking_gpu = false;
+  bool preprocess_gpu = false;
+  bool reduced_decode = false;
   bool save = false;
   bool preload = false;
   bool disable_ros = false;
+  bool resume_from_snapshot = false;
+  bool localization_mode = false;
+  bool stage_timing = false;
+  bool perf_counters = false;
+  bool trace = false;
+  bool profile = false;
   bool disable_reconfigure = false;
 };
 
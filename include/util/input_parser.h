@@ -3,17 +3,23 @@
 #include <string>
 
 #include "util/input_param.h"
+#include "util/settings.h"
 
 namespace dso {
 
 class InputParser {
  public:
   static InputParam Read(const std::string& config);
-  static void Config(InputParam* const input);
+  //! Apply input to the process settings and to the tuning settings.
+  static void Config(InputParam* const input, Settings* const settings);
+  /** \brief Apply input to the tuning settings only, e.g. of one of several
+   *  FullSystems. The preset and mode still set their process settings.
+   */
+  static void ConfigTuning(InputParam* const input, Settings* const settings);
 
  private:
-  static void Preset(InputParam* const input);
-  static void SetMode(const int mode);
+  static void Preset(InputParam* const input, Settings* const settings);
+  static void SetMode(const int mode, Settings* const settings);
   static void ConfigLog(const bool _show_log, const std::string& _log_path);
   static void LoadTrajectory(const std::string& file_path, const SE3& Tdc,
                              TimestampWithSE3* const time_and_pose);
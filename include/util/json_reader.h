@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dso {
+
+/** \brief A parsed JSON value, e.g. of a dso_replay_bench report
+ *
+ *  Enough JSON for the files DSO writes itself: numbers are doubles, strings
+ *  keep their escapes resolved only for \" \\ \/ \n \t (\u is kept as is),
+ *  objects keep their order.
+ */
+class JsonValue {
+ public:
+  enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+  JsonValue() : type(NUL), boolean(false), number(0) {}
+
+  //! Parse text into value, false (with the position in error) if invalid.
+  static bool Parse(const std::string& text, JsonValue* value,
+                    std::string* error);
+
+  //! Member key of an object, nullptr if there is none or no object.
+  const JsonValue* find(const std::string& key) const;
+
+  //! The number, or fallback if it is none.
+  double asNumber(const double fallback) const {
+    return type == NUMBER ? number : fallback;
+  }
+
+  Type type;
+  bool boolean;
+  double number;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+};
+
+}  // dso
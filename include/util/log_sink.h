@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <boost/lockfree/queue.hpp>
+#include <boost/thread.hpp>
+
+namespace dso {
+
+/** \brief Background writer for the setting_logStuff diagnostic logs
+ *
+ *  write() and defer() never block and never touch a file: they put a record
+ *  into a bounded lock-free queue, from which a writer thread appends it to
+ *  logs/<name>.bin of its stream. If the queue is full, the record is dropped
+ *  and counted. Any thread may write to any stream.
+ *
+ *  Every record is a uint32 count followed by count doubles (native byte
+ *  order), the columns of the former text logs.
+ */
+class LogSink {
+ public:
+  typedef std::function<void()> Task;
+
+  static const int kQueueSize = 1024;
+
+  /** \brief Open directory/<name>.bin for every stream and start the writer
+   *
+   *  @param[in] directory - has to exist
+   *  @param[in] streams   - names, streams are indexed in this order
+   */
+  LogSink(const std::string& directory,
+          const std::vector<std::string>& streams);
+
+  //! Write everything queued, then close the files.
+  ~LogSink();
+
+  //! Queue a record of num values for stream, false if dropped.
+  bool write(const int stream, const double* const values, const int num);
+
+  bool write(const int stream, const std::initializer_list<double> values) {
+    return write(stream, values.begin(), static_cast<int>(values.size()));
+  }
+
+  /** \brief Run task on the writer thread, false if dropped
+   *
+   *  For expensive diagnostics (e.g. eigen decompositions) working on copied
+   *  data. The task usually write()s its results.
+   */
+  bool defer(Task&& task);
+
+  //! Records and tasks dropped because the queue was full.
+  long getNumDropped() const { return numDropped; }
+
+ private:
+  struct Record {
+    int stream;
+    std::vector<double> values;
+    Task task;
+  };
+
+  bool push(Record* const record);
+  void writerLoop();
+
+  std::vector<std::ofstream*> files;  //!< [writer thread]
+  boost::lockfree::queue<Record*, boost::lockfree::capacity<kQueueSize>>
+      queue;
+  std::atomic<bool> running;
+  std::atomic<long> numDropped;
+
+  boost::thread writerThread;
+};
+
+}  // dso
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+namespace dso {
+
+//! The subsystems whose memory MemoryStats counts.
+enum MemoryTag {
+  MEM_PYRAMIDS = 0,  //!< image pyramids and compact images, pooled ones too
+  MEM_JACOBIANS,     //!< RawResidualJacobian of the residuals
+  MEM_HESSIAN,       //!< EnergyFunctional::HM and bM
+  MEM_ACCUMULATORS,  //!< Hessian accumulators and their stitching buffers
+  MEM_FRAME_SHELLS,  //!< FrameShell, one per frame ever tracked
+  MEM_VIEWER,        //!< point buffers of the viewer, CPU and GL
+  MEM_MAP_STORE,     //!< cached cells of IOWrap::MapStore
+  MEM_RELOC_INDEX,   //!< keyframes kept by RelocIndex
+  NUM_MEMORY_TAGS
+};
+
+/** \brief Current and peak bytes allocated per subsystem
+ *
+ *  The owners of the big allocations report them with add() or through a
+ *  MemoryAccount, e.g. a frame its pyramid. Counting is two relaxed atomic
+ *  operations, always on. With setting_memoryStatsInterval FullSystem logs a
+ *  summary every that many frames.
+ */
+class MemoryStats {
+ public:
+  static const char* name(const MemoryTag tag);
+
+  //! bytes were allocated under tag, freed if negative.
+  static inline void add(const MemoryTag tag, const int64_t bytes) {
+    const int64_t now =
+        currentBytes[tag].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = peakBytes[tag].load(std::memory_order_relaxed);
+    while (now > peak && !peakBytes[tag].compare_exchange_weak(
+                             peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  static int64_t current(const MemoryTag tag) {
+    return currentBytes[tag].load(std::memory_order_relaxed);
+  }
+
+  static int64_t peak(const MemoryTag tag) {
+    return peakBytes[tag].load(std::memory_order_relaxed);
+  }
+
+  //! One line with current and peak MB of every tag.
+  static void logSummary();
+
+ private:
+  static std::atomic<int64_t> currentBytes[NUM_MEMORY_TAGS];
+  static std::atomic<int64_t> peakBytes[NUM_MEMORY_TAGS];
+};
+
+/** \brief The bytes one object holds under a tag, given back when it dies
+ *
+ *  For members: set() whenever the buffers of the owner change size. A copy
+ *  counts the same bytes once more (e.g. copies of a FrameShell), assigning
+ *  keeps the bytes of the target.
+ */
+class MemoryAccount {
+ public:
+  explicit MemoryAccount(const MemoryTag tag, const int64_t bytes = 0)
+      : tag(tag), bytes(0) {
+    set(bytes);
+  }
+
+  MemoryAccount(const MemoryAccount& other) : tag(other.tag), bytes(0) {
+    set(other.bytes);
+  }
+
+  MemoryAccount& operator=(const MemoryAccount&) { return *this; }
+
+  ~MemoryAccount() { set(0); }
+
+  //! The owner holds newBytes from now on.
+  inline void set(const int64_t newBytes) {
+    if (newBytes != bytes) {
+      MemoryStats::add(tag, newBytes - bytes);
+      bytes = newBytes;
+    }
+  }
+
+  int64_t get() const { return bytes; }
+
+ private:
+  const MemoryTag tag;
+  int64_t bytes;
+};
+
+}  // dso
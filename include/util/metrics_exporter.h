@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+namespace dso {
+
+//! The values MetricsExporter publishes besides stage timings and memory.
+enum Metric {
+  METRIC_FRAMES = 0,             //!< frames given to FullSystem
+  METRIC_KEYFRAMES,              //!< keyframes made
+  METRIC_INITIALIZED,            //!< FullSystem::initialized (0 / 1)
+  METRIC_LOST,                   //!< FullSystem::isLost (0 / 1)
+  METRIC_COARSE_RMSE,            //!< lastCoarseRMSE[0] of the last frame
+  METRIC_FINE_TRACK_RMSE,        //!< statistics_lastFineTrackRMSE
+  METRIC_OPT_ITERATIONS,         //!< statistics_lastNumOptIts
+  METRIC_CREATED_POINTS,         //!< statistics_numCreatedPoints
+  METRIC_ACTIVATED_POINTS,       //!< statistics_numActivatedPoints
+  METRIC_DROPPED_POINTS,         //!< statistics_numDroppedPoints
+  METRIC_MARG_RES_FWD,           //!< statistics_numMargResFwd
+  METRIC_MARG_RES_BWD,           //!< statistics_numMargResBwd
+  METRIC_FORCE_DROPPED_RES_FWD,  //!< statistics_numForceDroppedResFwd
+  METRIC_FORCE_DROPPED_RES_BWD,  //!< statistics_numForceDroppedResBwd
+  METRIC_ACTIVE_FRAMES,          //!< frames in the window
+  METRIC_ACTIVE_POINTS,          //!< EnergyFunctional::nPoints
+  METRIC_ACTIVE_RESIDUALS,       //!< EnergyFunctional::nResiduals
+  METRIC_RESIDUALS_ACTIVE,       //!< EnergyFunctional::resInA
+  METRIC_RESIDUALS_LINEARIZED,   //!< EnergyFunctional::resInL
+  METRIC_RESIDUALS_MARGINALIZED, //!< EnergyFunctional::resInM
+  METRIC_UNMAPPED_FRAMES,        //!< depth of unmappedTrackedFrames
+  METRIC_CATCH_UP_DROPPED,       //!< frames the mapper dropped to catch up
+  METRIC_DEADLINE_SKIPPED,       //!< frames skipped for their deadline
+  NUM_METRICS
+};
+
+/** \brief Prometheus text endpoint of the FullSystem state
+ *
+ *  FullSystem sets the metrics with set() when setting_metricsPort is set: the
+ *  tracking ones per frame, the mapping ones per keyframe (printLogLine()). A
+ *  thread started with start(port) answers every GET /metrics with them, the
+ *  stage latencies of StageTiming (as summary, with setting_stageTiming) and
+ *  the memory of MemoryStats, in the Prometheus text format (version 0.0.4).
+ *  It serves one connection at a time and does not touch FullSystem.
+ */
+class MetricsExporter {
+ public:
+  static inline void set(const Metric metric, const double value) {
+    values[metric].store(value, std::memory_order_relaxed);
+  }
+
+  static double get(const Metric metric) {
+    return values[metric].load(std::memory_order_relaxed);
+  }
+
+  //! Listen on all interfaces at port, false if it could not be bound.
+  static bool start(const int port);
+
+  //! Stop the thread of start() and close its socket.
+  static void stop();
+
+  //! All metrics as the body of /metrics.
+  static std::string render();
+
+ private:
+  static std::atomic<double> values[NUM_METRICS];
+};
+
+}  // dso
@@ -34,6 +34,20 @@ class MinimalImage {
     if (ownData) delete[] data;
   }
 
+  /*
+   * w_ x h_ pixels of own memory, keeps the buffer if it is own and of that
+   * size already. The pixels are undefined after a reallocation.
+   */
+  inline void resize(int w_, int h_) {
+    if (!ownData || w_ * h_ != w * h) {
+      if (ownData) delete[] data;
+      data = new T[w_ * h_];
+      ownData = true;
+    }
+    w = w_;
+    h = h_;
+  }
+
   inline MinimalImage *getClone() {
     MinimalImage *clone = new MinimalImage(w, h);
     memcpy(clone->data, data, sizeof(T) * w * h);
@@ -10,11 +10,17 @@ namespace dso {
 #define SSEE(val, idx) (*(((float*)&val) + idx))
 
 #define MAX_RES_PER_POINT 8
-#define NUM_THREADS 6
+// Upper bound of the frames in the window, settings.maxFrames has to stay
+// below it. Sizes the residual lists stored in every point.
+#define MAX_WINDOW_FRAMES 16
+// Maximum number of reduce workers; the actual count is chosen at runtime
+// (see setting_numThreads).
+#define NUM_THREADS 32
 
 #define todouble(x) (x).cast<double>()
 
 typedef Sophus::SE3d SE3;
+typedef Sophus::SE3f SE3f;
 typedef Sophus::Sim3d Sim3;
 typedef Sophus::SO3d SO3;
 
@@ -65,6 +71,7 @@ typedef Eigen::Matrix<float, 2, 2> Mat22f;
 typedef Eigen::Matrix<float, 3, 1> Vec3f;
 typedef Eigen::Matrix<float, 2, 1> Vec2f;
 typedef Eigen::Matrix<float, 6, 1> Vec6f;
+typedef Eigen::Matrix<unsigned char, 3, 1> Vec3b;
 
 typedef Eigen::Matrix<double, 4, 9> Mat49;
 typedef Eigen::Matrix<double, 8, 9> Mat89;
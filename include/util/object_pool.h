@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+namespace dso {
+
+/** \brief Slab allocator for one type of small, frequently created object.
+ *
+ *  Objects are carved out of chunks of kSlotsPerChunk slots (aligned to at
+ *  least 16 bytes, more if T requires it, e.g. Eigen AVX types),
+ *  so objects created together (e.g. the residuals of one point, and their
+ *  Jacobians) end up next to each other in memory instead of scattered over the
+ *  heap. Freed slots go to a free list and are reused first; pointers stay
+ *  valid until the object is deleted.
+ *
+ *  Thread safe: every thread keeps a small cache of free slots and only takes
+ *  the pool mutex to move kBatch slots at once between its cache and the shared
+ *  free list. Objects may be deleted by a different thread than the one that
+ *  created them.
+ *
+ *  Use through DSO_POOLED_OPERATOR_NEW inside the class.
+ */
+template <typename T>
+class ObjectPool {
+ public:
+  static void* Allocate() { return Instance().AllocateSlot(); }
+  static void Free(void* ptr) { Instance().FreeSlot(ptr); }
+
+ private:
+  static const int kSlotsPerChunk = 1024;
+  static const int kBatch = 64;
+
+  struct alignas(alignof(T) > 16 ? alignof(T) : 16) Slot {
+    union {
+      Slot* next;
+      unsigned char data[sizeof(T)];
+    };
+  };
+
+  ObjectPool() : freeList(nullptr) {}
+  ~ObjectPool() {
+    for (Slot* chunk : chunks) {
+      Eigen::internal::aligned_free(chunk);
+    }
+  }
+
+  //! Free slots owned by one thread, handed back to the pool on thread exit.
+  struct LocalCache {
+    Slot* head = nullptr;
+    int count = 0;
+    ~LocalCache() {
+      while (count > 0) {
+        Instance().ReturnBatch(this, count);
+      }
+    }
+  };
+
+  static ObjectPool& Instance() {
+    static ObjectPool pool;
+    return pool;
+  }
+
+  static LocalCache& Local() {
+    // construct the pool first, so it outlives the caches.
+    Instance();
+    static thread_local LocalCache cache;
+    return cache;
+  }
+
+  void* AllocateSlot() {
+    LocalCache& cache = Local();
+    if (cache.head == nullptr) {
+      TakeBatch(&cache);
+    }
+    Slot* slot = cache.head;
+    cache.head = slot->next;
+    --cache.count;
+    return slot->data;
+  }
+
+  void FreeSlot(void* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    LocalCache& cache = Local();
+    Slot* slot = static_cast<Slot*>(ptr);
+    slot->next = cache.head;
+    cache.head = slot;
+    if (++cache.count > 2 * kBatch) {
+      ReturnBatch(&cache, kBatch);
+    }
+  }
+
+  //! Move kBatch slots from the shared free list (or a new chunk) to cache.
+  void TakeBatch(LocalCache* cache) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (freeList == nullptr) {
+      Slot* chunk = static_cast<Slot*>(
+          Eigen::internal::aligned_malloc(sizeof(Slot) * kSlotsPerChunk));
+      CHECK_EQ(reinterpret_cast<size_t>(chunk) % alignof(Slot), 0u);
+      chunks.emplace_back(chunk);
+      // hand out the chunk front to back.
+      for (int i = kSlotsPerChunk - 1; i >= 0; --i) {
+        chunk[i].next = freeList;
+        freeList = &chunk[i];
+      }
+    }
+    // splice off the first kBatch slots, keeping their order.
+    Slot* first = freeList;
+    Slot* last = first;
+    int n = 1;
+    while (n < kBatch && last->next != nullptr) {
+      last = last->next;
+      ++n;
+    }
+    freeList = last->next;
+    last->next = cache->head;
+    cache->head = first;
+    cache->count += n;
+  }
+
+  //! Move up to n slots from cache back to the shared free list.
+  void ReturnBatch(LocalCache* cache, int n) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    for (int i = 0; i < n && cache->head != nullptr; ++i) {
+      Slot* slot = cache->head;
+      cache->head = slot->next;
+      --cache->count;
+      slot->next = freeList;
+      freeList = slot;
+    }
+  }
+
+  boost::mutex mutex;
+  Slot* freeList;
+  std::vector<Slot*> chunks;
+};
+
+}  // dso
+
+//! Class operator new / delete taking objects of type T from ObjectPool<T>.
+#define DSO_POOLED_OPERATOR_NEW(T)                 \
+  void* operator new(std::size_t size) {           \
+    CHECK_EQ(size, sizeof(T));                     \
+    return ::dso::ObjectPool<T>::Allocate();       \
+  }                                                \
+  void operator delete(void* ptr) {                \
+    ::dso::ObjectPool<T>::Free(ptr);               \
+  }
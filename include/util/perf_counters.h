@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace dso {
+
+enum TimingStage : int;
+
+//! The hardware events counted by PerfCounters.
+enum PerfEvent {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_L1D_MISSES,     //!< L1 data cache read misses
+  PERF_LLC_MISSES,     //!< last level cache misses
+  PERF_BRANCH_MISSES,  //!< mispredicted branches
+  NUM_PERF_EVENTS
+};
+
+//! Counter values of one thread at some point, see PerfCounters::read().
+struct PerfSample {
+  uint64_t values[NUM_PERF_EVENTS];
+};
+
+/** \brief Hardware performance counters of the timed stages (perf_event_open)
+ *
+ *  Every thread opens its own counter group on its first read(), counting
+ *  only that thread in user space, so the counts of the IndexThreadReduce
+ *  workers are attributed to the worker that ran them (named by
+ *  ThreadConfig::SetThreadName()). A ScopedStageTimer
+ *  records the counts of its scope into the counters of its stage and thread
+ *  if setting_perfCounters is set.
+ *
+ *  Counters that cannot be opened (no PMU, e.g. in a VM, or a too restrictive
+ *  /proc/sys/kernel/perf_event_paranoid) stay 0, which is logged once.
+ *  When the kernel multiplexes the counters, their values are extrapolated to
+ *  the time the group was enabled.
+ */
+class PerfCounters {
+ public:
+  static const char* name(const PerfEvent event);
+
+  //! Counters of the calling thread so far, false if it has none open.
+  static bool read(PerfSample* const sample);
+
+  //! Add the counts from start to end to stage of the calling thread.
+  static void record(const TimingStage stage, const PerfSample& start,
+                     const PerfSample& end);
+
+  //! Per stage the sum over all threads: count, IPC and misses per 1000
+  //! instructions, per thread as well for stages run on several threads.
+  static void logSummary();
+
+  /** \brief Write the counters of every thread and stage to path
+   *
+   *  A CSV file with the line "thread,stage,count,cycles,instructions,
+   *  l1d_misses,llc_misses,branch_misses" and one line per thread and stage
+   *  that was recorded. Threads are listed in the order they first read.
+   */
+  static bool dump(const std::string& path);
+};
+
+}  // dso
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+#include "util/num_type.h"
+
+namespace dso {
+
+class FrameShell;
+
+/** \brief Camera poses at any time, extrapolated from the last tracked frames
+ *
+ *  push() takes the pose of every tracked frame (tracking thread). refine()
+ *  corrects the last two once the optimizer moved the keyframe they were
+ *  tracked against, or the frame itself once it is a keyframe (mapping
+ *  thread). predictPose() extrapolates from the last two with the constant
+ *  velocity trackNewCoarse assumes for its first hypothesis, in units of
+ *  their time difference.
+ *
+ *  predictPose() never blocks and may be called from any thread: the two
+ *  poses are behind a seqlock, a reader copies them and retries if a write
+ *  came in between. Writers serialize on a mutex of their own.
+ */
+class PosePredictor {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  PosePredictor();
+
+  //! The pose of a newly tracked frame, with a later timestamp than the last.
+  void push(const FrameShell& shell);
+
+  /** \brief keyframe moved to camToWorld
+   *
+   *  The last poses of keyframe itself are set to camToWorld, those tracked
+   *  against it are moved along.
+   */
+  void refine(const FrameShell* keyframe, const SE3& camToWorld);
+
+  //! Forget all poses, e.g. after tracking was lost.
+  void clear();
+
+  /** \brief Camera to world at timestamp
+   *
+   *  The last pose if there is only one or the last two have the same
+   *  timestamp. Timestamps before the last one interpolate.
+   *
+   *  @return false if there is no pose.
+   */
+  bool predictPose(double timestamp, SE3* camToWorld) const;
+
+ private:
+  struct Sample {
+    double timestamp;
+    // only compared, never dereferenced.
+    const FrameShell* shell;
+    const FrameShell* trackingRef;
+    SE3 camToTrackingRef;
+    SE3 camToWorld;
+  };
+
+  struct State {
+    //! samples[num - 1] is the newest.
+    Sample samples[2];
+    int num;
+  };
+
+  //! Make state odd (being written) / even (consistent) again.
+  void beginWrite();
+  void endWrite();
+
+  boost::mutex writeMutex;
+  std::atomic<unsigned int> seq;
+  State state;
+};
+
+}  // namespace dso
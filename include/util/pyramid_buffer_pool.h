@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "util/calib_context.h"
+#include "util/num_type.h"
+#include "util/settings.h"
+
+namespace dso {
+
+/** \brief Recycles the image pyramids (dIp, absSquaredGrad) of dead frames.
+ *
+ *  Every tracked frame needs a full pyramid, but most of them are dropped again
+ *  as non-keyframes right after tracing. Instead of freeing their multi-MB
+ *  buffers, FrameHessian hands them back here and the next frame takes them,
+ *  which avoids the allocation churn (and page faults) at camera rate.
+ *
+ *  At most setting_pyramidPoolSize pyramids are kept (of any size, the oldest
+ *  is freed first), the rest is freed. Keyframes keep their pyramid until they
+ *  are deleted after marginalization. Thread safe: frames are created on the
+ *  tracking thread and usually deleted on the mapping thread, and several
+ *  FullSystems with different calibrations may share the pool.
+ */
+class PyramidBufferPool {
+ public:
+  /** \brief Fill dIp and absSquaredGrad for levels [0, calib.pyrLevelsUsed)
+   *
+   *  Takes a pooled pyramid of the size of calib if there is one, allocates a
+   *  new one otherwise. The contents are undefined.
+   */
+  static void Acquire(const CalibContext& calib,
+                      Eigen::Vector3f* dIp[PYR_LEVELS],
+                      float* absSquaredGrad[PYR_LEVELS]);
+
+  /** \brief Give a pyramid from Acquire with calib back, and set the pointers
+   *  to null
+   *
+   *  Null pointers (frames that never made their images) are ignored.
+   */
+  static void Release(const CalibContext& calib,
+                      Eigen::Vector3f* dIp[PYR_LEVELS],
+                      float* absSquaredGrad[PYR_LEVELS]);
+
+  /** \brief Free all pooled pyramids */
+  static void Clear();
+
+ private:
+  struct Pyramid {
+    Eigen::Vector3f* dIp[PYR_LEVELS];
+    float* absSquaredGrad[PYR_LEVELS];
+    int levels;
+    int sizes[PYR_LEVELS];
+  };
+
+  static void Free(Pyramid* pyramid);
+  static bool MatchesCalib(const Pyramid& pyramid, const CalibContext& calib);
+
+  static boost::mutex mutex;
+  static std::vector<Pyramid> pool;
+};
+
+}  // dso
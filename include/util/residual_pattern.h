@@ -0,0 +1,56 @@
+#pragma once
+
+#include <type_traits>
+
+#include "util/num_type.h"
+#include "util/settings.h"
+
+namespace dso {
+
+/** \brief Pattern kPattern of staticPattern, its size known at compile time
+ *
+ *  The loops over the pattern in PointFrameResidual::linearize(),
+ *  ImmaturePoint::traceOn() and CoarseInitializer::calcResAndGS() are
+ *  templates on the pattern, so they are unrolled for its number of points.
+ *  withPattern() calls the instantiation of Settings::pattern.
+ */
+template <int kPattern>
+struct ResidualPattern {
+  static_assert(staticPatternNum[kPattern] <= MAX_RES_PER_POINT,
+                "pattern does not fit into MAX_RES_PER_POINT");
+
+  static constexpr int num = staticPatternNum[kPattern];
+  static constexpr int padding = staticPatternPadding[kPattern];
+
+  //! [num x 2] pixel offsets of the points.
+  static const int (*offsets())[2] { return staticPattern[kPattern]; }
+};
+
+//! Whether the pattern code is instantiated for pattern: 0 (1 point), 1 and
+//! 2 (5 points) and 8 (8 points, the default).
+inline bool isSupportedPattern(const int pattern) {
+  return pattern == 0 || pattern == 1 || pattern == 2 || pattern == 8;
+}
+
+/** \brief f(std::integral_constant<int, pattern>()), pattern 8 if it is not
+ *  supported
+ *
+ *  e.g. withPattern(settings.pattern, [&](auto p) {
+ *         return run<decltype(p)::value>(); });
+ */
+template <typename F>
+inline auto withPattern(const int pattern, F&& f)
+    -> decltype(f(std::integral_constant<int, 8>())) {
+  switch (pattern) {
+    case 0:
+      return f(std::integral_constant<int, 0>());
+    case 1:
+      return f(std::integral_constant<int, 1>());
+    case 2:
+      return f(std::integral_constant<int, 2>());
+    default:
+      return f(std::integral_constant<int, 8>());
+  }
+}
+
+}  // dso
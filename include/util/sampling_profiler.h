@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace dso {
+
+//! What the calling thread works on, recorded with every sample.
+struct ProfileTags {
+  int frameId;     //!< FrameShell::id, -1 if none
+  int keyframeId;  //!< FrameHessian::frameID once it is a keyframe, else -1
+  int stage;       //!< TimingStage of the innermost ScopedStageTimer, or -1
+};
+
+/** \brief SIGPROF sampler tagged with the frame and stage of every sample
+ *
+ *  With setting_profile, start() arms ITIMER_PROF at setting_profileHz (of
+ *  process CPU time). The signal handler takes the interrupted program
+ *  counter and walks the frame pointer chain within the stack of the thread
+ *  (for threads that called registerThread(), e.g. through
+ *  ThreadConfig::SetThreadName), then stores the stack, the thread name and
+ *  the ProfileTags of the thread into a ring of setting_profileMaxSamples
+ *  samples, overwriting the oldest. Deep stacks need -fno-omit-frame-pointer
+ *  (DSO_FRAME_POINTERS), otherwise they end at the first function without a
+ *  frame pointer.
+ *
+ *  FullSystem tags the tracker and mapper with the frame they work on,
+ *  ScopedStageTimer with the stage and IndexThreadReduce hands the tags of the
+ *  caller to its workers. write() dumps folded stacks ("a;b;c count", for
+ *  flamegraph.pl or speedscope), with setting_profileTopFrames only those of
+ *  the frames with the most samples, each under its own "frame <id>" root.
+ */
+class SamplingProfiler {
+ public:
+  //! Allocate the ring and start sampling, false if the timer failed.
+  static bool start();
+
+  //! Stop sampling, the samples are kept for write().
+  static void stop();
+
+  //! Record the stack bounds of the calling thread, so its stacks are walked.
+  static void registerThread();
+
+  //! Tag the calling thread with frameId / keyframeId.
+  static void setFrame(const int frameId, const int keyframeId);
+
+  //! Tag the calling thread with stage, returns the previous stage tag.
+  static int setStage(const int stage);
+
+  static ProfileTags getTags();
+  static void setTags(const ProfileTags& tags);
+
+  //! Write the folded stacks (see above) to path, false on error.
+  static bool write(const std::string& path);
+
+  //! Number of samples per thread and of the frames with the most samples.
+  static void logSummary();
+};
+
+}  // dso
@@ -42,70 +42,310 @@ namespace dso {
 /*! 1000 0000 0000 */
 #define SOLVER_ORTHOGONALIZE_X_LATER (int)2048
 
-// ============== PARAMETERS TO BE DECIDED ON COMPILE TIME =================
-#define PYR_LEVELS 6
-extern int PYR_LEVELS_USED;
-
-extern float setting_keyframesPerSecond;
-extern bool setting_realTimeMaxKF;
-extern double setting_maxShiftWeightT;
-extern double setting_maxShiftWeightR;
-extern double setting_maxShiftWeightRT;
-extern double setting_maxAffineWeight;
-extern double setting_kfGlobalWeight;
-
-extern float setting_idepthFixPrior;
-extern float setting_idepthFixPriorMargFac;
-extern float setting_initialRotPrior;
-extern float setting_initialTransPrior;
-extern float setting_initialAffBPrior;
-extern float setting_initialAffAPrior;
-extern float setting_initialCalibHessian;
-
-extern int setting_solverMode;
-extern double setting_solverModeDelta;
-
-extern float setting_minIdepthH_act;
-extern float setting_minIdepthH_marg;
-
-extern float setting_maxIdepth;
-extern float setting_maxPixSearch;
-extern float setting_desiredImmatureDensity;  // done
-extern float setting_desiredPointDensity;     // done
-extern float setting_minPointsRemaining;
-extern float setting_maxLogAffFacInWindow;
-extern int setting_minFrames;
-extern int setting_maxFrames;
-extern int setting_minFrameAge;
-extern int setting_maxOptIterations;
-extern int setting_minOptIterations;
-extern float setting_thOptIterations;
-extern float setting_outlierTH;
-extern float setting_outlierTHSumComponent;
-
-extern int setting_pattern;
-extern float setting_margWeightFac;
-extern int setting_GNItsOnPointActivation;
-
-extern float setting_minTraceQuality;
-extern int setting_minTraceTestRadius;
-extern float setting_reTrackThreshold;
-
-extern int setting_minGoodActiveResForMarg;
-extern int setting_minGoodResForMarg;
-extern int setting_minInlierVotesForMarg;
+/*! 0001 0000 0000 0000: block sparse solve (see SparseSchurSolver) */
+#define SOLVER_SPARSE (int)4096
 
-extern int setting_photometricCalibration;
-extern bool setting_useExposure;
-extern float setting_affineOptModeA;
-extern float setting_affineOptModeB;
-extern int setting_gammaWeightsPixelSelect;
+/*! 0010 0000 0000 0000: float factorization plus double refinement */
+#define SOLVER_MIXED_PRECISION (int)8192
 
-extern bool setting_forceAceptStep;
+/*! 0100 0000 0000 0000: block-Jacobi PCG solve (see PcgSolver) */
+#define SOLVER_PCG (int)16384
 
-extern float setting_huberTH;
+// ============== PARAMETERS TO BE DECIDED ON COMPILE TIME =================
+// capacity of the per-level arrays. The levels used (and allocated) are
+// CalibContext::pyrLevelsUsed, at most Int.PyrLevels.
+#define PYR_LEVELS 8
+
+/** \brief Tuning of one FullSystem
+ *
+ *  Everything that changes what DSO computes: keyframe selection, priors,
+ *  solver, window size, point densities, thresholds, tracing. Every
+ *  FullSystem keeps its own copy (FullSystem::settings) and hands it to the
+ *  parts it creates, so several instances with different tuning can share a
+ *  process. The defaults are those of the original DSO.
+ */
+struct Settings {
+  /* Parameters controlling when KF's are taken */
+  // if !=0, takes a fixed number of KF per second.
+  float keyframesPerSecond = 0.f;
+
+  // if true, takes as many KF's as possible (will break the system if the
+  // camera stays stationary)
+  bool realTimeMaxKF = false;
+
+  double maxShiftWeightT = 0.04 * (640 + 480);
+  double maxShiftWeightR = 0. * (640 + 480);
+  double maxShiftWeightRT = 0.02 * (640 + 480);
+
+  // general weight on threshold, the larger the more KF's are taken (e.g., 2
+  // = double the amount of KF's).
+  double kfGlobalWeight = 1.;
+
+  double maxAffineWeight = 2.;
+
+  /* initial hessian values to fix unobservable dimensions / priors on affine
+   * lighting parameters. */
+  float idepthFixPrior = 50.f * 50.f;
+  float idepthFixPriorMargFac = 600.f * 600.f;
+  float initialRotPrior = 1e11f;
+  float initialTransPrior = 1e10f;
+  float initialAffBPrior = 1e14f;
+  float initialAffAPrior = 1e14f;
+  float initialCalibHessian = 5e9f;
+
+  /* some modes for solving the resulting linear system (e.g. orthogonalize
+   * wrt. unobservable dimensions) */
+
+  //! Default: SOLVER_FIX_LAMBDA | SOLVER_ORTHOGONALIZE_X_LATER
+  /*! 1000 1000 0000 */
+  int solverMode = SOLVER_FIX_LAMBDA | SOLVER_ORTHOGONALIZE_X_LATER;
+
+  double solverModeDelta = 0.00001;
+
+  // SOLVER_MIXED_PRECISION: double precision refinement steps after the float
+  // solve.
+  int solverRefineSteps = 2;
+
+  // SOLVER_PCG: iteration limit and stop at |H * x - b| < tolerance * |b|.
+  int pcgMaxIterations = 100;
+  double pcgTolerance = 1e-6;
+  bool forceAceptStep = true;
+
+  /* some thresholds on when to activate / marginalize points */
+  float minIdepthH_act = 100.f;
+  float minIdepthH_marg = 50.f;
+
+  float desiredImmatureDensity = 1500.f;  // immature points per frame
+
+  // aimed total points in the active window.
+  float desiredPointDensity = 2000.f;
+
+  // marg a frame if less than X% points remain.
+  float minPointsRemaining = 0.05f;
+
+  // marg a frame if factor between intensities to current frame is larger
+  // than 1/X or X.
+  float maxLogAffFacInWindow = 0.7f;
+
+  int minFrames = 5;  // min frames in window.
+  int maxFrames = 7;  // max frames in window.
+  int minFrameAge = 1;
+  int maxOptIterations = 6;  // max GN iterations.
+  int minOptIterations = 1;  // min GN iterations.
+
+  // factor on break threshold for GN iteration (larger = break earlier)
+  float thOptIterations = 1.2f;
+
+  // also break GN iteration if an accepted step decreased the energy by less
+  // than this fraction. 0: only break on the step size.
+  float minRelEnergyDecrease = 0.f;
+
+  // wall time (ms) for makeKeyFrame up to the end of optimize(). GN iteration
+  // breaks if the next iteration is predicted to end later. 0: no budget.
+  float keyframeTimeBudgetMs = 0.f;
+
+  // in the GN iterations, residuals whose host and target pose steps and
+  // point inverse depth step are below this factor on the break threshold
+  // keep their Jacobians and only get the residual re-evaluated. 0:
+  // relinearize all.
+  float lazyRelinThreshold = 0.f;
+
+  // wall time (ms) per frame the LatencyController scales the point densities
+  // and GN iterations to, between latencyMinScale and latencyMaxScale times
+  // the configured densities. It only raises them again below
+  // (1 - latencyHysteresis) of the budget. 0: no control.
+  float latencyBudgetMs = 0.f;
+  float latencyHysteresis = 0.2f;
+  float latencyMinScale = 0.25f;
+  float latencyMaxScale = 2.f;
+
+  // deadline mode: a frame is due at its timestamp and has to be tracked this
+  // many frame intervals later. Later frames are skipped, tracking cuts its
+  // re-track attempts and refinement to make it. 0: no deadline.
+  float trackingDeadlineFactor = 0.f;
+
+  // number of step scales (1, 1/2, 1/4, ...) evaluated per GN iteration
+  // before the best one is taken, at most 10. 1: always take the full step.
+  int optTrialSteps = 1;
+
+  /* Outlier Threshold on photometric energy */
+  float outlierTH = 12.f * 12.f;  // higher -> less strict
+
+  // higher -> less strong gradient-based reweighting .
+  float outlierTHSumComponent = 50.f * 50.f;
+
+  // residual pattern of the points, index into staticPattern. Only the ones
+  // of isSupportedPattern() (at most MAX_RES_PER_POINT points).
+  int pattern = 8;
+
+  // factor on hessian when marginalizing, to account for inaccurate
+  // linearization points.
+  float margWeightFac = 0.5f * 0.5f;
+
+  /* when to re-track a frame */
+  float reTrackThreshold = 1.5f;  // (larger = re-track more often)
+  // evaluate re-track attempts concurrently (same result as one after
+  // another).
+  bool concurrentReTrack = true;
+
+  /* require some minimum number of residuals for a point to become valid */
+  int minGoodActiveResForMarg = 3;
+  int minGoodResForMarg = 4;
+
+  //-1: fix. >=0: optimize (with prior, if > 0).
+  float affineOptModeA = 1e12f;
+
+  //-1: fix. >=0: optimize (with prior, if > 0).
+  float affineOptModeB = 1e8f;
+
+  // 1 = use original intensity for pixel selection;
+  // 0 = use gamma-corrected intensity.
+  int gammaWeightsPixelSelect = 1;
+
+  float huberTH = 9.f;  // Huber Threshold
+
+  // parameters controlling adaptive energy threshold computation.
+  float frameEnergyTHConstWeight = 0.5;
+  float frameEnergyTHN = 0.7f;
+  float frameEnergyTHFacMedian = 1.5f;
+  float overallEnergyTHWeight = 1.f;
+  float coarseCutoffTH = 20.f;
+
+  // coarse tracking iterates on this fraction of the reference points on the
+  // coarseSubsampleLevels finest levels (every 8x8 cell keeps its strongest
+  // gradients), only the result of every level is checked on all of them. 1:
+  // all points in every iteration.
+  float coarseSubsampleRatio = 1.f;
+  int coarseSubsampleLevels = 1;
+  // coarse tracking refines down to this level only, level 0 just gets its
+  // residual evaluated (for the thresholds and flow indicators of keyframe
+  // selection). Keyframes, point selection and the window optimization keep
+  // full resolution. 0: refine on all levels.
+  int coarseTrackingFinestLvl = 0;
+  // residuals and Gauss-Newton system of coarse tracking on a CUDA device,
+  // needs a build with DSO_CUDA (see CoarseTrackerCuda).
+  bool coarseTrackingGPU = false;
+
+  // parameters controlling pixel selection
+  float minGradHistCut = 0.5f;
+  float minGradHistAdd = 7.f;
+  float gradDownweightPerLevel = 0.75f;  // 梯度阈值变化的系数
+  bool selectDirectionDistribution = true;
+  // split PixelSelector::select into rows of blocks on the mapping thread
+  // pool. the random projection directions then depend on the row, not the
+  // order.
+  bool parallelPixelSelection = false;
+
+  /* settings controling initial immature point tracking */
+
+  // max length of the ep. line segment searched during immature point
+  // tracking. relative to image resolution.
+  float maxPixSearch = 0.027f;
+
+  float minTraceQuality = 3.f;
+  int minTraceTestRadius = 2;
+  int GNItsOnPointActivation = 3;
+  float trace_stepsize = 1.f;      // stepsize for initial discrete search.
+  int trace_GNIterations = 3;      // max # GN iterations
+  float trace_GNThreshold = 0.1f;  // GN stop after this stepsize.
+
+  // for energy-based outlier check, be slightly more relaxed by this factor.
+  float trace_extraSlackOnTH = 1.2f;
+
+  // if pixel-interval is smaller than this, leave it be.
+  float trace_slackInterval = 1.5f;
+
+  // if pixel-interval is smaller than this, leave it be.
+  float trace_minImprovementFactor = 2.f;
+
+  // > 1: on segments longer than 4 strides, the discrete search scores every
+  // n-th step first and then only the steps around the best one. 1 =
+  // exhaustive.
+  int trace_coarseStride = 1;
+
+  // number of CoarseInitializers running at the same time, anchored at frames
+  // initAttemptSpacing apart. The first to converge initializes.
+  // 1: a single initializer, anchored at the first frame.
+  int initAttempts = 1;
+  int initAttemptSpacing = 5;
+
+  // keep only a 16 bit fixed point copy of level 0 for keyframes in the
+  // window (see FrameHessian::makeCompact), instead of the full float
+  // pyramid.
+  bool compactKeyframePyramid = false;
+  // otherwise give the pyramid of keyframes in the window back to the pool
+  // and keep level 0 only, unchanged (see FrameHessian::releasePyramid).
+  bool releaseKeyframePyramid = true;
+
+  // keep the pattern rows of linearized residuals (resF, JIdx, JabF) as 16
+  // bit integers scaled per row for the energy functional, see
+  // RawResidualJacobian::pack(). Less to read per accumulation, about 1/32767
+  // of the largest entry of a row as error.
+  bool compactJacobians = false;
+
+  // drop the FrameShells of frames before the window (FullSystem
+  // allFrameHistory / allKeyFramesHistory) once they are final, so long runs
+  // keep a bounded history. Their poses only reach output wrappers, e.g.
+  // TrajectoryOutputWrapper, printResult only writes the kept ones.
+  bool boundedFrameHistory = false;
+
+  // check all indices of the energy functional (frames, points, residuals)
+  // after every EnergyFunctional::makeIDX, a full pass for debugging.
+  bool validateEF = false;
+
+  // > 0: keep that many of the last keyframes leaving the window (RelocIndex)
+  // and relocalize on them once tracking is lost, instead of giving up. Each
+  // lost frame is tracked against the relocCandidates most similar ones
+  // scoring at least relocMinScore, a final RMSE below relocMaxRMSE starts a
+  // new window there. After relocMaxFrames lost frames isLost is set.
+  int relocKeyframes = 0;
+  int relocCandidates = 3;
+  float relocMinScore = 0.5f;
+  float relocMaxRMSE = 12.f;
+  int relocMaxFrames = 100;
+
+  // FullSystem::initializeFromDepth: a selected pixel without depth takes
+  // the nearest one within depthInitSearchRadius pixels, and at least
+  // depthInitMinPoints points are needed.
+  int depthInitSearchRadius = 2;
+  int depthInitMinPoints = 100;
+
+  // run mapping on its own thread and reductions on the worker pool.
+  bool multiThreading = true;
+
+  // > 0: save the window to snapshotPath (FullSystem::saveSnapshot) after
+  // every that many keyframes.
+  std::string snapshotPath = "snapshot.bin";
+  int snapshotInterval = 0;
+
+  // track against the keyframes of the snapshot given to loadSnapshot as a
+  // frozen map: nothing is mapped, every frame is tracked against the stored
+  // keyframe closest to its predicted pose (see FullSystem::trackNewFrame).
+  bool localizationMode = false;
+};
+
+/* Process wide settings: input, logging, instrumentation, display, threads. */
 
+extern int setting_photometricCalibration;
+extern bool setting_useExposure;
 extern bool setting_logStuff;
+extern int setting_logEigenValInterval;
+extern bool setting_stageTiming;
+extern int setting_stageTimingInterval;
+extern std::string setting_stageTimingPath;
+extern int setting_memoryStatsInterval;
+extern int setting_metricsPort;
+extern bool setting_perfCounters;
+extern std::string setting_perfCountersPath;
+extern bool setting_trace;
+extern std::string setting_tracePath;
+extern int setting_traceMaxEvents;
+extern bool setting_profile;
+extern std::string setting_profilePath;
+extern int setting_profileHz;
+extern int setting_profileMaxSamples;
+extern int setting_profileTopFrames;
+extern int setting_randomSeed;
 extern float benchmarkSetting_fxfyfac;
 extern int benchmarkSetting_width;
 extern int benchmarkSetting_height;
@@ -114,25 +354,6 @@ extern float benchmark_varBlurNoise;
 extern int benchmark_noiseGridsize;
 extern float benchmark_initializerSlackFactor;
 
-extern float setting_frameEnergyTHConstWeight;
-extern float setting_frameEnergyTHN;
-
-extern float setting_frameEnergyTHFacMedian;
-extern float setting_overallEnergyTHWeight;
-extern float setting_coarseCutoffTH;
-
-extern float setting_minGradHistCut;
-extern float setting_minGradHistAdd;
-extern float setting_gradDownweightPerLevel;
-extern bool setting_selectDirectionDistribution;
-
-extern float setting_trace_stepsize;
-extern int setting_trace_GNIterations;
-extern float setting_trace_GNThreshold;
-extern float setting_trace_extraSlackOnTH;
-extern float setting_trace_slackInterval;
-extern float setting_trace_minImprovementFactor;
-
 extern bool setting_render_displayCoarseTrackingFull;
 extern bool setting_render_renderWindowFrames;
 extern bool setting_render_plotTrackingFull;
@@ -155,7 +376,24 @@ extern bool debugSaveImages;
 extern int sparsityFactor;
 extern bool goStepByStep;
 extern bool plotStereoImages;
-extern bool multiThreading;
+extern bool setting_useAVX;
+extern bool setting_preprocessGPU;
+extern bool setting_reducedDecode;
+extern std::string setting_remapCacheDir;
+extern int setting_numThreads;
+extern int setting_pyramidPoolSize;
+
+extern std::string setting_trackerCpus;
+extern std::string setting_mapperCpus;
+extern std::string setting_reduceCpus;
+extern int setting_trackerRtPriority;
+extern int setting_mapperRtPriority;
+extern int setting_reduceRtPriority;
+extern int setting_trackerNice;
+extern int setting_mapperNice;
+extern int setting_reduceNice;
+extern bool setting_reduceNumaNodes;
+extern bool setting_deterministicReduce;
 
 extern float freeDebugParam1;
 extern float freeDebugParam2;
@@ -165,16 +403,22 @@ extern float freeDebugParam5;
 
 void handleKey(char k);
 
-extern int staticPattern[10][40][2];
-extern int staticPatternNum[10];
-extern int staticPatternPadding[10];
+/** \brief Set settings-><name> to value, false if it is no tuning setting
+ *
+ *  The tuning settings are the settings that trade speed for accuracy (point
+ *  densities, window size, iterations, thresholds), kTuningSettings in
+ *  settings.cc. value is rounded for int settings and != 0 for bool ones.
+ *  Used by the parameter sweep of dso_replay_bench, after the preset.
+ */
+bool setTuningSetting(Settings* settings, const std::string& name,
+                      const double value);
+
+//! Whether setTuningSetting() knows name.
+bool isTuningSetting(const std::string& name);
 
-//#define patternNum staticPatternNum[setting_pattern]
-//#define patternP staticPattern[setting_pattern]
-//#define patternPadding staticPatternPadding[setting_pattern]
+extern int staticPattern[10][40][2];
 
-//
-#define patternNum 8
-#define patternP staticPattern[8]
-#define patternPadding 2
+//! number of points and padding (largest offset) of each pattern.
+constexpr int staticPatternNum[10] = {1, 5, 5, 9, 9, 13, 25, 21, 8, 25};
+constexpr int staticPatternPadding[10] = {1, 1, 1, 1, 2, 2, 2, 3, 2, 4};
 }  // dso
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "util/perf_counters.h"
+#include "util/sampling_profiler.h"
+#include "util/settings.h"
+#include "util/trace_recorder.h"
+
+namespace dso {
+
+//! The timed stages, see StageTiming.
+enum TimingStage : int {
+  STAGE_PREPROCESS = 0,     //!< FullSystem::preprocessFrame
+  STAGE_TRACK_COARSE,       //!< FullSystem::trackNewCoarse
+  STAGE_TRACE_COARSE,       //!< FullSystem::traceNewCoarse
+  STAGE_MAKE_KEYFRAME,      //!< FullSystem::makeKeyFrame
+  STAGE_ACTIVATE_POINTS,    //!< FullSystem::activatePointsMT
+  STAGE_OPTIMIZE,           //!< FullSystem::optimize
+  STAGE_LINEARIZE_ALL,      //!< FullSystem::linearizeAll
+  STAGE_SOLVE_SYSTEM,       //!< FullSystem::solveSystem
+  STAGE_APPLY_RES,          //!< FullSystem::applyRes_Reductor, per call
+  STAGE_MARGINALIZE_FRAME,  //!< FullSystem::marginalizeFrame
+  STAGE_SET_TRACKING_REF,   //!< CoarseTracker::setCoarseTrackingRef
+  STAGE_LINEARIZE_REDUCTOR,  //!< FullSystem::linearizeAll_Reductor, per call
+  STAGE_ACCUMULATE_AF,       //!< EnergyFunctional::accumulateAF_MT
+  STAGE_ADD_POINTS,  //!< AccumulatedTopHessianSSE::addPointsInternal, per call
+  STAGE_CALC_RES,    //!< CoarseTracker::calcRes
+  NUM_TIMING_STAGES
+};
+
+/** \brief Log-linear latency histogram in nanoseconds (HDR histogram style)
+ *
+ *  Values below kSubBuckets are counted exactly; above, every power of two is
+ *  split into kSubBuckets linear buckets, so a bucket is at most 1/kSubBuckets
+ *  (6.25%) of its value wide. Values from 2^kMaxExponent ns (~18 minutes) on
+ *  share the last bucket. The largest value is kept exactly.
+ */
+class LatencyHistogram {
+ public:
+  static const int kSubBucketBits = 4;
+  static const int kSubBuckets = 1 << kSubBucketBits;
+  static const int kMaxExponent = 40;
+  static const int kNumBuckets =
+      (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+  LatencyHistogram() { clear(); }
+
+  static inline int bucketOf(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(kSubBuckets)) {
+      return static_cast<int>(ns);
+    }
+    if (ns >> kMaxExponent) {
+      return kNumBuckets - 1;
+    }
+    const int shift = 63 - __builtin_clzll(ns) - kSubBucketBits;
+    return (shift + 1) * kSubBuckets +
+           static_cast<int>((ns >> shift) & (kSubBuckets - 1));
+  }
+
+  //! Smallest value of bucket.
+  static inline uint64_t lowerBound(const int bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    const int shift = bucket / kSubBuckets - 1;
+    return static_cast<uint64_t>(kSubBuckets + bucket % kSubBuckets) << shift;
+  }
+
+  void clear();
+
+  inline void add(const uint64_t ns) {
+    ++counts[bucketOf(ns)];
+    ++count;
+    sum += ns;
+    max = ns > max ? ns : max;
+  }
+
+  //! Value below which a fraction q of the values lie, in ns (bucket middle).
+  uint64_t percentile(const double q) const;
+
+  uint64_t counts[kNumBuckets];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+};
+
+/** \brief Latency histograms of the main DSO stages
+ *
+ *  Every thread records into its own histograms (registered on its first
+ *  record()), only written by that thread and read with relaxed atomics, so
+ *  recording takes no lock and no atomic read-modify-write. getHistogram()
+ *  merges the histograms of all threads.
+ *
+ *  Recording is compiled in, but ScopedStageTimer does nothing besides a
+ *  branch unless setting_stageTiming is set. With setting_stageTimingInterval
+ *  FullSystem logs a summary every that many frames. The "per call" stages
+ *  run inside the IndexThreadReduce workers, once per chunk.
+ */
+class StageTiming {
+ public:
+  static const char* name(const TimingStage stage);
+
+  static void record(const TimingStage stage, const uint64_t ns);
+
+  //! Sum over all threads, of what was recorded so far.
+  static LatencyHistogram getHistogram(const TimingStage stage);
+
+  //! One line per stage with count, p50, p95, p99 and max (in ms).
+  static void logSummary();
+
+  /** \brief Write all histograms to path, false on error
+   *
+   *  A CSV file, starting with a line "stage,count,mean_us,p50_us,p95_us,
+   *  p99_us,max_us" and one line in that format per stage, then after an
+   *  empty line "stage,lower_ns,count" and one line per used bucket.
+   */
+  static bool dump(const std::string& path);
+};
+
+/** \brief Records the time from construction to destruction into stage
+ *
+ *  Only if setting_stageTiming was set when it was constructed. The hardware
+ *  counters of the scope are recorded (PerfCounters) if setting_perfCounters
+ *  was set, the scope as span of the trace (TraceRecorder) if setting_trace.
+ *  With setting_profile, the samples of the scope are tagged with stage.
+ */
+class ScopedStageTimer {
+ public:
+  explicit ScopedStageTimer(const TimingStage stage)
+      : stage(stage),
+        active(setting_stageTiming),
+        traced(setting_trace),
+        countersActive(setting_perfCounters && PerfCounters::read(&counters)),
+        profiled(setting_profile) {
+    if (active || traced) {
+      start = TraceRecorder::now();
+    }
+    if (profiled) {
+      previousStage = SamplingProfiler::setStage(stage);
+    }
+  }
+
+  ~ScopedStageTimer() {
+    if (active || traced) {
+      const uint64_t end = TraceRecorder::now();
+      if (active) {
+        StageTiming::record(stage, end - start);
+      }
+      if (traced) {
+        TraceRecorder::span(StageTiming::name(stage), "stage", start, end);
+      }
+    }
+    PerfSample countersEnd;
+    if (countersActive && PerfCounters::read(&countersEnd)) {
+      PerfCounters::record(stage, counters, countersEnd);
+    }
+    if (profiled) {
+      SamplingProfiler::setStage(previousStage);
+    }
+  }
+
+  ScopedStageTimer(const ScopedStageTimer&) = delete;
+  ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+ private:
+  const TimingStage stage;
+  const bool active;
+  const bool traced;
+  uint64_t start;
+  PerfSample counters;
+  const bool countersActive;
+  const bool profiled;
+  int previousStage;
+};
+
+}  // dso
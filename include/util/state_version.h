@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+
+namespace dso {
+
+/** \brief Next value of a global, thread safe counter, starting at 1
+ *
+ *  Stamped onto frame / calibration states whenever they change, so caches of
+ *  values derived from them (FrameFramePrecalc, the adjoints in
+ *  EnergyFunctional) can tell if they are up to date by comparing stamps. The
+ *  stamps are unique over all objects and all time, 0 is never handed out.
+ */
+inline uint64_t nextStateVersion() {
+  static std::atomic<uint64_t> counter(0);
+  return ++counter;
+}
+
+}  // dso
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dso {
+
+/** \brief CPU affinity and scheduling priority of the DSO threads.
+ *
+ *  Every thread calls ApplyToThisThread() with its role once it starts. The
+ *  layout comes from setting_{tracker,mapper,reduce}{Cpus,RtPriority,Nice}.
+ */
+class ThreadConfig {
+ public:
+  enum Role {
+    // thread calling FullSystem::addActiveFrame.
+    ROLE_TRACKER = 0,
+    // FullSystem::mappingLoop.
+    ROLE_MAPPER,
+    // IndexThreadReduce workers.
+    ROLE_REDUCE
+  };
+
+  /** \brief Pin the calling thread and set its priority as configured for role
+   *
+   *  node >= 0 (see GetReduceNode) further restricts the CPUs to those of that
+   *  NUMA node. Failures (e.g. missing permission for realtime priorities) are
+   *  logged and otherwise ignored.
+   */
+  static void ApplyToThisThread(const Role role, const int node = -1);
+
+  /** \brief CPUs of every NUMA node, indexed by node id
+   *
+   *  From /sys/devices/system/node on linux. Empty if that is not available,
+   *  i.e. a single node.
+   */
+  static const std::vector<std::vector<int>>& GetNumaNodes();
+
+  /** \brief NUMA node of reduce worker worker of numWorkers, -1 for any
+   *
+   *  With setting_reduceNumaNodes and more than one node with reduce CPUs,
+   *  the workers are split over those nodes in contiguous blocks: worker
+   *  order follows node order, so a contiguous part of a reduce() range stays
+   *  on one node. -1 otherwise.
+   */
+  static int GetReduceNode(const int worker, const int numWorkers);
+
+  /** \brief Name the calling thread, e.g. "reduce2"
+   *
+   *  Shown in the perf counters, the trace and (truncated to 15 characters) as
+   *  the OS thread name. ApplyToThisThread() names a thread by its role.
+   */
+  static void SetThreadName(const std::string& name);
+
+  //! Name of the calling thread, empty if it has none.
+  static const std::string& GetThreadName();
+
+  /** \brief Log the CPU set and priority chosen for every role */
+  static void LogLayout();
+
+  /** \brief Parse a CPU list like "0-2,5" into {0, 1, 2, 5}
+   *
+   *  @return empty if cpus is empty or malformed.
+   */
+  static std::vector<int> ParseCpuSet(const std::string& cpus);
+
+ private:
+  static std::vector<int> GetCpus(const Role role);
+  //! Ids of the nodes with CPUs of the reduce workers.
+  static std::vector<int> GetReduceNodes();
+  static std::string RoleName(const Role role);
+};
+
+}  // dso
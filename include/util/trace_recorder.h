@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include "util/settings.h"
+
+namespace dso {
+
+/** \brief Timeline of all DSO threads in the Chrome trace event format
+ *
+ *  With setting_trace, the stage timers record their scopes as spans,
+ *  TracedLock() the time spent waiting for a contended mutex and
+ *  ScopedTraceSpan other waits. Counters (e.g. the depth of the queue of
+ *  tracked frames) and instant markers (keyframe decisions, tracking
+ *  reference swaps) complete the picture. write() produces a JSON file for
+ *  chrome://tracing or ui.perfetto.dev.
+ *
+ *  Every thread appends to its own buffer, under a mutex only taken by that
+ *  thread and write(). Names and categories are kept as pointers and have to
+ *  be string literals. At most setting_traceMaxEvents events are kept, later
+ *  ones are counted as dropped.
+ */
+class TraceRecorder {
+ public:
+  //! Current time in ns, on the clock of the spans.
+  static inline uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  //! Something on the calling thread from beginNs to endNs, category e.g.
+  //! "stage" or "wait".
+  static void span(const char* name, const char* category,
+                   const uint64_t beginNs, const uint64_t endNs);
+
+  //! A marker at the current time on the calling thread.
+  static void instant(const char* name);
+
+  //! A value of the counter name from now on.
+  static void counter(const char* name, const double value);
+
+  //! Write the events of all threads to path, false on error.
+  static bool write(const std::string& path);
+};
+
+/** \brief Records the scope as span of category "wait"
+ *
+ *  Only if setting_trace was set when it was constructed.
+ */
+class ScopedTraceSpan {
+ public:
+  explicit ScopedTraceSpan(const char* name)
+      : name(name), active(setting_trace) {
+    if (active) {
+      begin = TraceRecorder::now();
+    }
+  }
+
+  ~ScopedTraceSpan() {
+    if (active) {
+      TraceRecorder::span(name, "wait", begin, TraceRecorder::now());
+    }
+  }
+
+  ScopedTraceSpan(const ScopedTraceSpan&) = delete;
+  ScopedTraceSpan& operator=(const ScopedTraceSpan&) = delete;
+
+ private:
+  const char* const name;
+  const bool active;
+  uint64_t begin;
+};
+
+/** \brief Lock mutex, with setting_trace recording the wait if it is held
+ *
+ *  An uncontended lock costs one try_lock more and records nothing.
+ */
+template <typename Mutex>
+inline boost::unique_lock<Mutex> TracedLock(Mutex& mutex,
+                                            const char* const name) {
+  if (!setting_trace) {
+    return boost::unique_lock<Mutex>(mutex);
+  }
+  boost::unique_lock<Mutex> lock(mutex, boost::try_to_lock);
+  if (!lock.owns_lock()) {
+    const uint64_t begin = TraceRecorder::now();
+    lock.lock();
+    TraceRecorder::span(name, "wait", begin, TraceRecorder::now());
+  }
+  return lock;
+}
+
+}  // dso
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "util/num_type.h"
+
+namespace dso {
+
+//! Camera position in world coordinates at timestamp (in s).
+struct StampedPosition {
+  double timestamp;
+  Vec3 position;
+};
+
+/** \brief Absolute trajectory error of a monocular estimate
+ *
+ *  The scale of a monocular trajectory is arbitrary, so the estimate is first
+ *  aligned to the ground truth with the similarity transform minimizing the
+ *  squared position errors (Umeyama). Poses are matched by the closest
+ *  ground truth timestamp.
+ */
+struct TrajectoryError {
+  int numMatched = 0;
+  double rmse = 0;
+  double mean = 0;
+  double median = 0;
+  double max = 0;
+  //! Scale of the alignment, ground truth units per estimate unit.
+  double scale = 0;
+
+  /** \brief Read the positions of a trajectory file, false if there are none
+   *
+   *  One pose per line, starting with timestamp and position: "t tx ty tz ..."
+   *  as in result.txt (TUM format) or "t,tx,ty,tz,..." as in the EuRoC ground
+   *  truth. Timestamps above 1e12 are taken as ns. Lines starting with '#' and
+   *  lines that do not parse are skipped.
+   */
+  static bool Load(const std::string& path,
+                   std::vector<StampedPosition>* trajectory);
+
+  /** \brief Error of estimate against groundtruth
+   *
+   *  Every estimated pose is matched to the ground truth pose closest in time,
+   *  if it is at most maxDt away. False if there are less than 3 matches.
+   */
+  static bool Compute(const std::vector<StampedPosition>& estimate,
+                      const std::vector<StampedPosition>& groundtruth,
+                      const double maxDt, TrajectoryError* error);
+};
+
+}  // dso
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <chrono>
+
+namespace dso {
+
+/** \brief Monotonic wall clock stopwatch, started on construction */
+class WallTimer {
+ public:
+  WallTimer() : start(std::chrono::steady_clock::now()) {}
+
+  inline void reset() { start = std::chrono::steady_clock::now(); }
+
+  //! Milliseconds since construction or the last reset().
+  inline double elapsedMs() const {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start;
+};
+
+}  // dso
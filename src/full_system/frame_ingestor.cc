@@ -0,0 +1,210 @@
+#include "full_system/frame_ingestor.h"
+
+#include <iterator>
+
+#include <glog/logging.h>
+
+#include "full_system/full_system.h"
+#include "util/image_and_exposure.h"
+#include "util/thread_config.h"
+
+namespace dso {
+
+FrameIngestor::FrameIngestor(FullSystem* const system, const int capacity,
+                             const DropPolicy policy,
+                             const bool preprocessAhead)
+    : system(system),
+      capacity(capacity),
+      policy(policy),
+      preprocessAhead(preprocessAhead),
+      running(true),
+      draining(false),
+      preprocessing(preprocessAhead),
+      numQueued(0),
+      numDropped(0),
+      numProcessed(0) {
+  CHECK_NOTNULL(system);
+  CHECK_GE(capacity, 1);
+  trackingThread = boost::thread(&FrameIngestor::trackingLoop, this);
+  if (preprocessAhead) {
+    preprocessThread = boost::thread(&FrameIngestor::preprocessLoop, this);
+  }
+}
+
+FrameIngestor::~FrameIngestor() { stop(false); }
+
+bool FrameIngestor::push(ImageAndExposure* const image, const int id,
+                         const Callback& done) {
+  Frame frame{image, id, done, nullptr};
+  Frame dropped{nullptr, 0, Callback(), nullptr};
+  bool accepted = true;
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    if (!running) {
+      accepted = false;
+    } else if (static_cast<int>(queue.size()) < capacity) {
+      queue.emplace_back(std::move(frame));
+    } else if (policy == DROP_OLDEST) {
+      dropped = std::move(queue.front());
+      queue.pop_front();
+      queue.emplace_back(std::move(frame));
+    } else {
+      accepted = false;
+    }
+    numQueued = queue.size();
+  }
+  queueSignal.notify_one();
+
+  // outside the lock, the callbacks may take their time.
+  if (dropped.image != nullptr) {
+    drop(&dropped);
+  }
+  if (!accepted) {
+    drop(&frame);
+  }
+  return accepted;
+}
+
+void FrameIngestor::stop(const bool drain) {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    if (!running) {
+      return;
+    }
+    running = false;
+    draining = drain;
+  }
+  queueSignal.notify_all();
+  readySignal.notify_all();
+  if (preprocessAhead) {
+    preprocessThread.join();
+  }
+  trackingThread.join();
+
+  // left over if not draining.
+  std::deque<Frame> left;
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    left.swap(queue);
+    left.insert(left.end(), std::make_move_iterator(ready.begin()),
+                std::make_move_iterator(ready.end()));
+    ready.clear();
+    numQueued = 0;
+  }
+  for (Frame& frame : left) {
+    drop(&frame);
+  }
+}
+
+void FrameIngestor::drop(Frame* const frame) {
+  ++numDropped;
+  delete frame->image;
+  frame->image = nullptr;
+  if (frame->fh != nullptr) {
+    FullSystem::deletePreprocessedFrame(frame->fh);
+    frame->fh = nullptr;
+  }
+  if (frame->done) {
+    frame->done(frame->id, FRAME_DROPPED);
+  }
+}
+
+void FrameIngestor::trackingLoop() {
+  ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_TRACKER);
+
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  Frame frame;
+  while (nextFrame(&lock, &frame)) {
+    lock.unlock();
+
+    FrameStatus status = FRAME_LOST;
+    if (!system->isLost) {
+      const long skippedBefore = system->getNumDeadlineSkippedFrames();
+      if (frame.fh != nullptr) {
+        system->addPreprocessedFrame(frame.fh);
+        frame.fh = nullptr;
+      } else {
+        system->addActiveFrame(frame.image, frame.id);
+      }
+      ++numProcessed;
+      if (system->getNumDeadlineSkippedFrames() != skippedBefore) {
+        status = FRAME_SKIPPED;
+      } else if (!system->isLost) {
+        status = FRAME_TRACKED;
+      }
+    } else if (frame.fh != nullptr) {
+      FullSystem::deletePreprocessedFrame(frame.fh);
+    }
+    delete frame.image;
+    if (frame.done) {
+      frame.done(frame.id, status);
+    }
+
+    lock.lock();
+  }
+}
+
+bool FrameIngestor::nextFrame(boost::unique_lock<boost::mutex>* lock,
+                              Frame* frame) {
+  if (preprocessAhead) {
+    while (ready.empty() && preprocessing) {
+      readySignal.wait(*lock);
+    }
+    if (ready.empty() || (!running && !draining)) {
+      return false;
+    }
+    *frame = std::move(ready.front());
+    ready.pop_front();
+    // lets preprocessLoop start on the next one.
+    readySignal.notify_all();
+    return true;
+  }
+
+  while (queue.empty() && running) {
+    queueSignal.wait(*lock);
+  }
+  if (queue.empty() || (!running && !draining)) {
+    return false;
+  }
+  *frame = std::move(queue.front());
+  queue.pop_front();
+  numQueued = queue.size();
+  return true;
+}
+
+void FrameIngestor::preprocessLoop() {
+  ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_TRACKER);
+
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while (true) {
+    // one frame ahead: the next one is only taken (and can still be dropped
+    // by push() until then) once the tracking thread has the last one.
+    while (!ready.empty() && (running || draining)) {
+      readySignal.wait(lock);
+    }
+    while (queue.empty() && running) {
+      queueSignal.wait(lock);
+    }
+    if (queue.empty() || (!running && !draining)) {
+      break;
+    }
+
+    Frame frame = std::move(queue.front());
+    queue.pop_front();
+    numQueued = queue.size();
+    lock.unlock();
+
+    frame.fh = system->preprocessFrame(frame.image, frame.id, true);
+    delete frame.image;
+    frame.image = nullptr;
+
+    lock.lock();
+    ready.emplace_back(std::move(frame));
+    readySignal.notify_all();
+  }
+
+  preprocessing = false;
+  readySignal.notify_all();
+}
+
+}  // dso
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <cmath>
 
+#include "full_system/hessian_blocks/frame_pyramid_cuda.h"
 #include "full_system/immature_point.h"
 #include "full_system/initializer/coarse_initializer.h"
 #include "full_system/pixel_selector.h"
@@ -19,16 +20,39 @@
 #include "io_wrapper/output_3d_wrapper.h"
 #include "optimization_backend/energy_functional/energy_functional.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
 #include "util/image_and_exposure.h"
+#include "util/memory_stats.h"
+#include "util/metrics_exporter.h"
+#include "util/sampling_profiler.h"
+#include "util/pyramid_buffer_pool.h"
+#include "util/stage_timing.h"
+#include "util/thread_config.h"
+#include "util/trace_recorder.h"
 
 namespace dso {
-int FrameHessian::instanceCounter = 0;
-int PointHessian::instanceCounter = 0;
-int CalibHessian::instanceCounter = 0;
+std::atomic<int> FrameHessian::instanceCounter(0);
+std::atomic<int> PointHessian::instanceCounter(0);
+std::atomic<int> CalibHessian::instanceCounter(0);
+
+FullSystem::FullSystem(const CalibContext& calib, const Settings& settings,
+                       IndexThreadReduce<Vec10>* reducePool)
+    : calib(calib),
+      settings(settings),
+      Hcalib(calib),
+      latencyController(&this->settings) {
+  // residuals of a point go to the other frames of the window.
+  CHECK_LT(settings.maxFrames, MAX_WINDOW_FRAMES)
+      << "maxFrames has to stay below MAX_WINDOW_FRAMES (num_type.h).";
+  if (reducePool != nullptr) {
+    treadReduce = treadReduceTracking = reducePool;
+  } else {
+    ownTreadReduce.reset(new IndexThreadReduce<Vec10>());
+    ownTreadReduceTracking.reset(new IndexThreadReduce<Vec10>());
+    treadReduce = ownTreadReduce.get();
+    treadReduceTracking = ownTreadReduceTracking.get();
+  }
 
-FullSystem::FullSystem() {
   int retstat = 0;
   if (setting_logStuff) {
     retstat += system("rm -rf logs");
@@ -37,64 +61,44 @@ FullSystem::FullSystem() {
     retstat += system("rm -rf mats");
     retstat += system("mkdir mats");
 
-    calibLog = new std::ofstream();
-    calibLog->open("logs/calibLog.txt", std::ios::trunc | std::ios::out);
-    calibLog->precision(12);
-
-    numsLog = new std::ofstream();
-    numsLog->open("logs/numsLog.txt", std::ios::trunc | std::ios::out);
-    numsLog->precision(10);
-
-    coarseTrackingLog = new std::ofstream();
-    coarseTrackingLog->open("logs/coarseTrackingLog.txt",
-                            std::ios::trunc | std::ios::out);
-    coarseTrackingLog->precision(10);
-
-    eigenAllLog = new std::ofstream();
-    eigenAllLog->open("logs/eigenAllLog.txt", std::ios::trunc | std::ios::out);
-    eigenAllLog->precision(10);
-
-    eigenPLog = new std::ofstream();
-    eigenPLog->open("logs/eigenPLog.txt", std::ios::trunc | std::ios::out);
-    eigenPLog->precision(10);
-
-    eigenALog = new std::ofstream();
-    eigenALog->open("logs/eigenALog.txt", std::ios::trunc | std::ios::out);
-    eigenALog->precision(10);
-
-    DiagonalLog = new std::ofstream();
-    DiagonalLog->open("logs/diagonal.txt", std::ios::trunc | std::ios::out);
-    DiagonalLog->precision(10);
-
-    variancesLog = new std::ofstream();
-    variancesLog->open("logs/variancesLog.txt",
-                       std::ios::trunc | std::ios::out);
-    variancesLog->precision(10);
-
-    nullspacesLog = new std::ofstream();
-    nullspacesLog->open("logs/nullspacesLog.txt",
-                        std::ios::trunc | std::ios::out);
-    nullspacesLog->precision(10);
+    logSink = new LogSink(
+        "logs", {"calibLog", "numsLog", "eigenAllLog", "eigenPLog",
+                 "eigenALog", "diagonal", "variancesLog", "nullspacesLog",
+                 "coarseTrackingLog"});
   } else {
-    nullspacesLog = 0;
-    variancesLog = 0;
-    DiagonalLog = 0;
-    eigenALog = 0;
-    eigenPLog = 0;
-    eigenAllLog = 0;
-    numsLog = 0;
-    calibLog = 0;
+    logSink = nullptr;
   }
 
   CHECK_NE(retstat, 293847);
 
-  selectionMap = new float[wG[0] * hG[0]];
+  // the components read the settings of this instance, not the argument.
+  coarseDistanceMap = new CoarseDistanceMap(calib);
+  coarseTracker = new CoarseTracker(calib, this->settings);
+  coarseTracker_forNewKF = new CoarseTracker(calib, this->settings);
+  coarseTracker_ready = new CoarseTracker(calib, this->settings);
+  newReferenceReady = false;
+  coarseInitializer = new CoarseInitializer(calib, this->settings);
+  framesSinceInitAnchor = 0;
+  pixelSelector = new PixelSelector(calib, this->settings);
+
+  pyramidGPU = nullptr;
+#if defined(HAS_CUDA)
+  if (setting_preprocessGPU) {
+    if (FramePyramidCuda::deviceAvailable()) {
+      pyramidGPU = new FramePyramidCuda(calib.w, calib.h, calib.pyrLevelsUsed);
+    } else {
+      LOG(WARNING) << "no CUDA device, making image pyramids on the CPU.";
+    }
+  }
+#endif
 
-  coarseDistanceMap = new CoarseDistanceMap(wG[0], hG[0]);
-  coarseTracker = new CoarseTracker(wG[0], hG[0]);
-  coarseTracker_forNewKF = new CoarseTracker(wG[0], hG[0]);
-  coarseInitializer = new CoarseInitializer(wG[0], hG[0]);
-  pixelSelector = new PixelSelector(wG[0], hG[0]);
+  relocIndex = settings.relocKeyframes > 0
+                   ? new RelocIndex(calib, settings.relocKeyframes)
+                   : nullptr;
+  relocalizing = false;
+  numRelocFrames = 0;
+  relocStartTimestamp = 0;
+  localizationSceneDepth = 1;
 
   statistics_lastNumOptIts = 0;
   statistics_numDroppedPoints = 0;
@@ -106,12 +110,16 @@ FullSystem::FullSystem() {
   statistics_numMargResBwd = 0;
 
   lastCoarseRMSE.setConstant(100);
+  deadlineAnchorTs = -1;
+  lastInputTimestamp = 0;
+  numDeadlineSkippedFrames = 0;
+  shellHorizon = 0;
 
   currentMinActDist = 2;
   initialized = false;
 
-  ef = new EnergyFunctional();
-  ef->red = &this->treadReduce;
+  ef = new EnergyFunctional(this->settings);
+  ef->red = treadReduce;
 
   isLost = false;
   initFailed = false;
@@ -119,8 +127,15 @@ FullSystem::FullSystem() {
   needNewKFAfter = -1;
 
   linearizeOperation = true;
+  numUnmappedFrames = 0;
+  mapperSleeping = false;
+  needToKetchupMapping = false;
+  numCatchUpDroppedFrames = 0;
   runMapping = true;
   mappingThread = boost::thread(&FullSystem::mappingLoop, this);
+  referencePending = false;
+  runReference = true;
+  referenceThread = boost::thread(&FullSystem::referenceLoop, this);
   lastRefStopID = 0;
 
   minIdJetVisDebug = -1;
@@ -132,42 +147,179 @@ FullSystem::FullSystem() {
 FullSystem::~FullSystem() {
   blockUntilMappingIsFinished();
 
-  if (setting_logStuff) {
-    calibLog->close();
-    delete calibLog;
-    numsLog->close();
-    delete numsLog;
-    coarseTrackingLog->close();
-    delete coarseTrackingLog;
-    eigenAllLog->close();
-    delete eigenAllLog;
-    eigenPLog->close();
-    delete eigenPLog;
-    eigenALog->close();
-    delete eigenALog;
-    DiagonalLog->close();
-    delete DiagonalLog;
-    variancesLog->close();
-    delete variancesLog;
-    nullspacesLog->close();
-    delete nullspacesLog;
-  }
-
-  delete[] selectionMap;
+  delete logSink;
 
   for (FrameShell *s : allFrameHistory) {
     delete s;
   }
-  for (FrameHessian *fh : unmappedTrackedFrames) {
-    delete fh;
+  FrameHessian *unmapped;
+  while (unmappedTrackedFrames.pop(unmapped)) {
+    delete unmapped;
   }
 
   delete coarseDistanceMap;
   delete coarseTracker;
   delete coarseTracker_forNewKF;
+  delete coarseTracker_ready;
+#if defined(HAS_CUDA)
+  delete pyramidGPU;
+#endif
+  delete relocIndex;
+  for (FrameShell *s : relocShells) {
+    delete s;
+  }
+  for (CoarseTracker *worker : coarseTrackerWorkers) {
+    delete worker;
+  }
+  for (CoarseInitializer *attempt : initAttempts) {
+    if (attempt != coarseInitializer) {
+      if (attempt->frameID >= 0) {
+        delete attempt->firstFrame;
+      }
+      delete attempt;
+    }
+  }
   delete coarseInitializer;
   delete pixelSelector;
   delete ef;
+  PyramidBufferPool::Clear();
+}
+
+void FullSystem::reset() {
+  waitForIdleMapper();
+
+  {
+    boost::unique_lock<boost::mutex> lock = TracedLock(trackMutex, "trackMutex");
+    boost::unique_lock<boost::mutex> mapLock =
+        TracedLock(mapMutex, "mapMutex");
+
+    clearWindow();
+
+    std::vector<CoarseInitializer *> attempts = initAttempts;
+    if (attempts.empty()) {
+      attempts.emplace_back(coarseInitializer);
+    }
+    for (CoarseInitializer *attempt : attempts) {
+      // once initialized, the first frame of coarseInitializer was the first
+      // keyframe.
+      if (attempt->frameID >= 0 &&
+          !(initialized && attempt == coarseInitializer)) {
+        delete attempt->firstFrame;
+      }
+      attempt->frameID = -1;
+    }
+    framesSinceInitAnchor = 0;
+
+    {
+      boost::unique_lock<boost::mutex> crlock =
+          TracedLock(shellPoseMutex, "shellPoseMutex");
+      for (FrameShell *s : allFrameHistory) {
+        delete s;
+      }
+      allFrameHistory.clear();
+      allKeyFramesHistory.clear();
+      shellHorizon = 0;
+      for (FrameShell *s : relocShells) {
+        delete s;
+      }
+      relocShells.clear();
+    }
+    pixelSelector->reset();
+
+    // a new map, in a new world frame.
+    if (relocIndex != nullptr) {
+      relocIndex->clear();
+    }
+    relocalizing = false;
+    numRelocFrames = 0;
+
+    // the calibration starts over, the gamma function stays.
+    CalibHessian initialCalib(calib);
+    memcpy(initialCalib.B, Hcalib.B, sizeof(float) * 256);
+    memcpy(initialCalib.Binv, Hcalib.Binv, sizeof(float) * 256);
+    Hcalib = initialCalib;
+
+    statistics_lastNumOptIts = 0;
+    statistics_numDroppedPoints = 0;
+    statistics_numActivatedPoints = 0;
+    statistics_numCreatedPoints = 0;
+    statistics_numForceDroppedResBwd = 0;
+    statistics_numForceDroppedResFwd = 0;
+    statistics_numMargResFwd = 0;
+    statistics_numMargResBwd = 0;
+    {
+      boost::unique_lock<boost::mutex> statsLock(optStatsMutex);
+      lastOptStats.clear();
+    }
+
+    lastCoarseRMSE.setConstant(100);
+    deadlineAnchorTs = -1;
+    lastInputTimestamp = 0;
+    numDeadlineSkippedFrames = 0;
+
+    currentMinActDist = 2;
+    initialized = false;
+    isLost = false;
+    initFailed = false;
+
+    needNewKFAfter = -1;
+    needToKetchupMapping = false;
+    numCatchUpDroppedFrames = 0;
+    lastRefStopID = 0;
+    posePredictor.clear();
+
+    minIdJetVisDebug = -1;
+    maxIdJetVisDebug = -1;
+    minIdJetVisTracker = -1;
+    maxIdJetVisTracker = -1;
+  }
+
+  for (IOWrap::Output3DWrapper *ow : outputWrapper) {
+    ow->reset();
+  }
+}
+
+void FullSystem::waitForIdleMapper() {
+  // the mapper keeps running, but must not touch the window any more.
+  while (runMapping && (numUnmappedFrames > 0 || !mapperSleeping)) {
+    boost::this_thread::yield();
+  }
+  // the reference still reads the image of the last keyframe.
+  waitForTrackingReference();
+}
+
+void FullSystem::clearWindow() {
+  ef->clear();
+  for (FrameHessian *fh : frameHessians) {
+    delete fh;
+  }
+  frameHessians.clear();
+  activeResiduals.clear();
+  framePrecalc.clear();
+  framePrecalcFrames.clear();
+  trialPrecalc.clear();
+  lazyFrameSteps.clear();
+  for (std::vector<float>& energies : allResVec) {
+    energies.clear();
+  }
+
+  boost::unique_lock<boost::mutex> crlock =
+      TracedLock(coarseTrackerSwapMutex, "coarseTrackerSwapMutex");
+  for (CoarseTracker *tracker :
+       {coarseTracker, coarseTracker_ready, coarseTracker_forNewKF}) {
+    tracker->lastRef = nullptr;
+    tracker->refFrameID = -1;
+  }
+  newReferenceReady = false;
+}
+
+void FullSystem::setLost() {
+  posePredictor.clear();
+  if (relocIndex == nullptr || settings.localizationMode) {
+    isLost = true;
+  } else {
+    relocalizing = true;
+  }
 }
 
 void FullSystem::setGammaFunction(float *const BInv) {
@@ -196,7 +348,13 @@ void FullSystem::setGammaFunction(float *const BInv) {
 
 void FullSystem::printResult(std::string file) {
   boost::unique_lock<boost::mutex> lock(trackMutex);
-  boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+  boost::unique_lock<boost::mutex> crlock =
+      TracedLock(shellPoseMutex, "shellPoseMutex");
+
+  LOG_IF(WARNING, allFrameHistory.numKept() < allFrameHistory.size())
+      << "BoundedFrameHistory: " << file << " only gets the last "
+      << allFrameHistory.numKept() << " of " << allFrameHistory.size()
+      << " frames, use the trajectory output wrapper for all.";
 
   std::ofstream myfile;
   myfile.open(file.c_str());
@@ -225,49 +383,158 @@ void FullSystem::addActiveFrame(ImageAndExposure *image, int id) {
     return;
   }
   boost::unique_lock<boost::mutex> lock(trackMutex);
+  // the id PreprocessNewFrame gives the shell.
+  SamplingProfiler::setFrame(allFrameHistory.size(), -1);
+
+  double budgetMs = 0;
+  if (!startNewFrame(image->timestamp, id, &budgetMs)) {
+    return;
+  }
+  trackNewFrame(PreprocessNewFrame(image, id), budgetMs, &lock);
+}
+
+void FullSystem::addPreprocessedFrame(FrameHessian *fh) {
+  if (isLost) {
+    deletePreprocessedFrame(fh);
+    return;
+  }
+  boost::unique_lock<boost::mutex> lock(trackMutex);
+  SamplingProfiler::setFrame(allFrameHistory.size(), -1);
+
+  double budgetMs = 0;
+  if (!startNewFrame(fh->shell->timestamp, fh->shell->incoming_id,
+                     &budgetMs)) {
+    deletePreprocessedFrame(fh);
+    return;
+  }
+  addToFrameHistory(fh);
+  trackNewFrame(fh, budgetMs, &lock);
+}
+
+void FullSystem::deletePreprocessedFrame(FrameHessian *fh) {
+  delete fh->shell;
+  delete fh;
+}
+
+bool FullSystem::startNewFrame(const double timestamp, const int id,
+                               double *budgetMs) {
+  if (settings.boundedFrameHistory) {
+    // keeps the last two for the motion model of trackNewCoarse.
+    allFrameHistory.dropBefore(
+        std::min<int>(shellHorizon, allFrameHistory.size() - 2),
+        [](FrameShell *s) { delete s; });
+  }
+
+  // skip a late frame before anything is done with it.
+  *budgetMs = 0;
+  if (!trackingDeadline(timestamp, budgetMs)) {
+    ++numDeadlineSkippedFrames;
+    LOG(WARNING) << "frame " << id << " missed its tracking deadline by "
+                 << -*budgetMs << " ms, skipped.";
+    for (IOWrap::Output3DWrapper *ow : outputWrapper) {
+      ow->publishSkippedFrame(id, timestamp, -*budgetMs);
+    }
+    return false;
+  }
+  return true;
+}
 
-  FrameHessian *fh = PreprocessNewFrame(image, id);
+void FullSystem::trackNewFrame(FrameHessian *fh, const double budgetMs,
+                               boost::unique_lock<boost::mutex> *lock) {
+  if (setting_stageTiming && setting_stageTimingInterval > 0 &&
+      fh->shell->id > 0 && fh->shell->id % setting_stageTimingInterval == 0) {
+    StageTiming::logSummary();
+  }
+  if (setting_memoryStatsInterval > 0 && fh->shell->id > 0 &&
+      fh->shell->id % setting_memoryStatsInterval == 0) {
+    MemoryStats::logSummary();
+  }
+
+  if (relocalizing) {
+    if (relocalize(fh)) {
+      lock->unlock();
+      deliverTrackedFrame(fh, true);
+    }
+    publishTrackingMetrics();
+    return;
+  }
 
   if (!initialized) {
     // use initializer!
+    if (settings.initAttempts > 1) {
+      if (trackInitAttempts(fh)) {
+        initializeFromInitializer(fh);
+        lock->unlock();
+        deliverTrackedFrame(fh, true);
+      }
+      publishTrackingMetrics();
+      return;
+    }
+
     if (coarseInitializer->frameID < 0) {
       // first frame set. fh is kept by coarseInitializer.
-      coarseInitializer->setFirst(&Hcalib, fh);
-    } else if (coarseInitializer->trackFrame(fh, outputWrapper)) {
+      coarseInitializer->setFirst(
+          &Hcalib, fh, settings.multiThreading ? treadReduceTracking : nullptr);
+    } else if (coarseInitializer->trackFrame(
+                   fh, outputWrapper,
+                   settings.multiThreading ? treadReduceTracking : nullptr)) {
       // if SNAPPED
       initializeFromInitializer(fh);
-      lock.unlock();
+      lock->unlock();
       deliverTrackedFrame(fh, true);
     } else {
       // if still initializing
       fh->shell->poseValid = false;
       delete fh;
     }
+    publishTrackingMetrics();
     return;
   } else {
     // do front-end operation.
     // ============== SWAP tracking reference?. ==============
-    if (coarseTracker_forNewKF->refFrameID > coarseTracker->refFrameID) {
-      boost::unique_lock<boost::mutex> crlock(coarseTrackerSwapMutex);
-      CoarseTracker *tmp = coarseTracker;
-      coarseTracker = coarseTracker_forNewKF;
-      coarseTracker_forNewKF = tmp;
+    if (newReferenceReady) {
+      boost::unique_lock<boost::mutex> crlock =
+          TracedLock(coarseTrackerSwapMutex, "coarseTrackerSwapMutex");
+      std::swap(coarseTracker, coarseTracker_ready);
+      newReferenceReady = false;
+      if (setting_trace) {
+        TraceRecorder::instant("swap tracking reference");
+      }
+    }
+
+    if (settings.localizationMode) {
+      // from where fh is expected, else from where the last frame was.
+      SE3 camToWorld;
+      if (!posePredictor.predictPose(fh->shell->timestamp, &camToWorld)) {
+        boost::unique_lock<boost::mutex> crlock =
+            TracedLock(shellPoseMutex, "shellPoseMutex");
+        camToWorld = allFrameHistory[allFrameHistory.size() - 2]->camToWorld;
+      }
+      FrameHessian *ref = selectLocalizationReference(camToWorld);
+      if (ref != coarseTracker->lastRef) {
+        setLocalizationReference(ref);
+      }
     }
 
-    Vec4 tres = trackNewCoarse(fh);
+    WallTimer trackTimer;
+    Vec4 tres = trackNewCoarse(fh, budgetMs);
+    latencyController.addTrackingTime(trackTimer.elapsedMs());
     if (!std::isfinite(tres[0]) || !std::isfinite(tres[1]) ||
         !std::isfinite(tres[2]) || !std::isfinite(tres[3])) {
       LOG(WARNING) << "Initial Tracking failed: LOST!";
-      isLost = true;
+      setLost();
+      fh->shell->poseValid = false;
+      delete fh;
+      publishTrackingMetrics();
       return;
     }
 
     bool needToMakeKF = false;
-    if (setting_keyframesPerSecond > 0) {
+    if (settings.keyframesPerSecond > 0) {
       needToMakeKF =
           allFrameHistory.size() == 1 ||
           (fh->shell->timestamp - allKeyFramesHistory.back()->timestamp) >
-              0.95f / setting_keyframesPerSecond;
+              0.95f / settings.keyframesPerSecond;
     } else {
       Vec2 refToFh = AffLight::fromToVecExposure(
           coarseTracker->lastRef->ab_exposure, fh->ab_exposure,
@@ -276,13 +543,13 @@ void FullSystem::addActiveFrame(ImageAndExposure *image, int id) {
       // BRIGHTNESS CHECK
       const bool condition_1 = (allFrameHistory.size() == 1);
       const bool condition_2 =
-          (setting_kfGlobalWeight * setting_maxShiftWeightT * sqrt(tres[1]) /
-                   (wG[0] + hG[0]) +
-               setting_kfGlobalWeight * setting_maxShiftWeightR *
-                   sqrt(tres[2]) / (wG[0] + hG[0]) +
-               setting_kfGlobalWeight * setting_maxShiftWeightRT *
-                   sqrt(tres[3]) / (wG[0] + hG[0]) +
-               setting_kfGlobalWeight * setting_maxAffineWeight *
+          (settings.kfGlobalWeight * settings.maxShiftWeightT * sqrt(tres[1]) /
+                   (calib.w[0] + calib.h[0]) +
+               settings.kfGlobalWeight * settings.maxShiftWeightR *
+                   sqrt(tres[2]) / (calib.w[0] + calib.h[0]) +
+               settings.kfGlobalWeight * settings.maxShiftWeightRT *
+                   sqrt(tres[3]) / (calib.w[0] + calib.h[0]) +
+               settings.kfGlobalWeight * settings.maxAffineWeight *
                    fabs(log(refToFh[0])) >
            1);
       const bool condition_3 = (2 * coarseTracker->firstCoarseRMSE < tres[0]);
@@ -292,19 +559,60 @@ void FullSystem::addActiveFrame(ImageAndExposure *image, int id) {
     for (IOWrap::Output3DWrapper *ow : outputWrapper) {
       ow->publishCamPose(fh->shell, &Hcalib);
     }
+    posePredictor.push(*fh->shell);
 
-    lock.unlock();
+    if (settings.localizationMode) {
+      // nothing is mapped, the pose of fh is final.
+      delete fh;
+      publishTrackingMetrics();
+      return;
+    }
+
+    if (setting_trace) {
+      TraceRecorder::instant(needToMakeKF ? "keyframe" : "non-keyframe");
+    }
+
+    lock->unlock();
     deliverTrackedFrame(fh, needToMakeKF);
+    publishTrackingMetrics();
     return;
   }
 }
 
-Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
+bool FullSystem::trackingDeadline(const double timestamp, double *budgetMs) {
+  *budgetMs = 0;
+  const double intervalMs = 1000 * (timestamp - lastInputTimestamp);
+  lastInputTimestamp = timestamp;
+  if (!(settings.trackingDeadlineFactor > 0)) {
+    return true;
+  }
+
+  // initialization takes as long as it takes, and needs a frame interval.
+  if (!initialized || !(intervalMs > 0)) {
+    deadlineAnchorTs = -1;
+    return true;
+  }
+  if (deadlineAnchorTs < 0) {
+    deadlineAnchorTs = timestamp;
+    deadlineClock.reset();
+  }
+
+  const double dueMs = 1000 * (timestamp - deadlineAnchorTs);
+  *budgetMs = dueMs + settings.trackingDeadlineFactor * intervalMs -
+              deadlineClock.elapsedMs();
+  return *budgetMs > 0;
+}
+
+Vec4 FullSystem::trackNewCoarse(FrameHessian *fh, const double budgetMs) {
+  ScopedStageTimer stageTimer(STAGE_TRACK_COARSE);
   CHECK_GT(allFrameHistory.size(), 0);
+  WallTimer timer;
   // set pose initialization.
 
   for (IOWrap::Output3DWrapper *ow : outputWrapper) {
-    ow->pushLiveFrame(fh);
+    if (ow->capabilities() & IOWrap::Output3DWrapper::CAP_LIVE_FRAME) {
+      ow->pushLiveFrame(fh);
+    }
   }
 
   FrameHessian *lastF = coarseTracker->lastRef;
@@ -313,9 +621,8 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
 
   std::vector<SE3, Eigen::aligned_allocator<SE3>> lastF_2_fh_tries;
   if (allFrameHistory.size() == 2) {
-    for (unsigned int i = 0; i < lastF_2_fh_tries.size(); ++i) {
-      lastF_2_fh_tries.emplace_back(SE3());
-    }
+    // no motion yet, e.g. right after initializeFromDepth.
+    lastF_2_fh_tries.emplace_back(SE3());
   } else {
     FrameShell *slast = allFrameHistory[allFrameHistory.size() - 2];
     FrameShell *sprelast = allFrameHistory[allFrameHistory.size() - 3];
@@ -323,7 +630,8 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
     SE3 lastF_2_slast;
     {
       // lock on global pose consistency!
-      boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+      boost::unique_lock<boost::mutex> crlock =
+          TracedLock(shellPoseMutex, "shellPoseMutex");
       slast_2_sprelast = sprelast->camToWorld.inverse() * slast->camToWorld;
       lastF_2_slast = slast->camToWorld.inverse() * lastF->shell->camToWorld;
       aff_last_2_l = slast->aff_g2l;
@@ -450,21 +758,82 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
   // If on a coarse level, tracking is WORSE than achievedRes, we will not
   // continue to save time.
 
-  Vec5 achievedRes = Vec5::Constant(NAN);
+  VecPyr achievedRes = VecPyr::Constant(NAN);
   bool haveOneGood = false;
   int tryIterations = 0;
+
+  // Re-track attempts (all but the first try) may be evaluated concurrently in
+  // batches. A batch is tracked with the achievedRes from before the batch as
+  // abort threshold, which is never lower than the one the serial loop would
+  // use, and then replayed in order against the actual achievedRes. This gives
+  // exactly the serial result.
+  const bool concurrentReTrack =
+      settings.multiThreading && settings.concurrentReTrack &&
+      !setting_render_displayCoarseTrackingFull && lastF_2_fh_tries.size() > 2;
+  std::vector<SE3, Eigen::aligned_allocator<SE3>> batchPoses;
+  std::vector<AffLight> batchAffs;
+  std::vector<char> batchIsGood;
+  std::vector<std::vector<CoarseTrackerLevelResult>> batchLevels;
+  unsigned int batchStart = 0, batchEnd = 0;
+
   for (unsigned int i = 0; i < lastF_2_fh_tries.size(); ++i) {
+    // with a good try, the deadline wins over the remaining ones.
+    double remainingMs = 0;
+    if (budgetMs > 0) {
+      remainingMs = budgetMs - timer.elapsedMs();
+      if (haveOneGood && remainingMs <= 0) {
+        LOG(WARNING) << "tracking deadline reached after " << i << " tries.";
+        break;
+      }
+      // still tracked on the coarsest level, to have a result at all.
+      remainingMs = std::max(remainingMs, 1e-3);
+    }
+
     AffLight aff_g2l_this = aff_last_2_l;
     SE3 lastF_2_fh_this = lastF_2_fh_tries[i];
 
-    // in each level has to be at least as good as the last try.
-    bool trackingIsGood = coarseTracker->trackNewestCoarse(
-        fh, lastF_2_fh_this, aff_g2l_this, PYR_LEVELS_USED - 1, achievedRes);
+    bool trackingIsGood;
+    if (concurrentReTrack && i > 0) {
+      if (i >= batchEnd) {
+        trackNewCoarseBatch(fh, lastF_2_fh_tries, aff_last_2_l, achievedRes, i,
+                            &batchEnd, &batchPoses, &batchAffs, &batchIsGood,
+                            &batchLevels);
+        batchStart = i;
+      }
+
+      // replay the abort check of trackNewestCoarse with the actual
+      // achievedRes.
+      const int k = i - batchStart;
+      coarseTracker->lastResiduals.setConstant(NAN);
+      coarseTracker->lastFlowIndicators.setConstant(1000);
+      coarseTracker->lastLevelResults.clear();
+      trackingIsGood = batchIsGood[k];
+      for (const CoarseTrackerLevelResult &l : batchLevels[k]) {
+        coarseTracker->lastResiduals[l.lvl] = l.residual;
+        coarseTracker->lastFlowIndicators = l.flowIndicators;
+        coarseTracker->lastLevelResults.push_back(l);
+        if (l.residual > 1.5 * achievedRes[l.lvl]) {
+          trackingIsGood = false;
+          break;
+        }
+      }
+      if (trackingIsGood) {
+        lastF_2_fh_this = batchPoses[k];
+        aff_g2l_this = batchAffs[k];
+      }
+    } else {
+      // in each level has to be at least as good as the last try.
+      trackingIsGood = coarseTracker->trackNewestCoarse(
+          fh, lastF_2_fh_this, aff_g2l_this, calib.pyrLevelsUsed - 1,
+          achievedRes, nullptr, remainingMs);
+      LOG_IF(WARNING, coarseTracker->lastOutOfTime && !setting_debugout_runquiet)
+          << "tracking deadline: try " << i << " cut its refinement.";
+    }
     ++tryIterations;
 
     if (i != 0) {
       LOG(WARNING) << "RE-TRACK ATTEMPT " << i << " with initOption " << i
-                   << " and start-lvl " << PYR_LEVELS_USED - 1 << " (ab "
+                   << " and start-lvl " << calib.pyrLevelsUsed - 1 << " (ab "
                    << aff_g2l_this.a << " " << aff_g2l_this.b
                    << "): " << achievedRes[0] << " " << achievedRes[1] << " "
                    << achievedRes[2] << " " << achievedRes[3] << " "
@@ -490,7 +859,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
 
     // take over achieved res (always).
     if (haveOneGood) {
-      for (int i = 0; i < 5; ++i) {
+      for (int i = 0; i < PYR_LEVELS; ++i) {
         if (!std::isfinite((float)achievedRes[i]) ||
             achievedRes[i] > coarseTracker->lastResiduals[i]) {
           // take over if achievedRes is either bigger or NAN.
@@ -500,7 +869,7 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
     }
 
     if (haveOneGood &&
-        achievedRes[0] < lastCoarseRMSE[0] * setting_reTrackThreshold) {
+        achievedRes[0] < lastCoarseRMSE[0] * settings.reTrackThreshold) {
       break;
     }
   }
@@ -532,66 +901,119 @@ Vec4 FullSystem::trackNewCoarse(FrameHessian *fh) {
               << "!";
   }
 
-  if (setting_logStuff) {
-    (*coarseTrackingLog) << std::setprecision(16) << fh->shell->id << " "
-                         << fh->shell->timestamp << " " << fh->ab_exposure
-                         << " " << fh->shell->camToWorld.log().transpose()
-                         << " " << aff_g2l.a << " " << aff_g2l.b << " "
-                         << achievedRes[0] << " " << tryIterations << "\n";
+  if (logSink != nullptr) {
+    const Vec6 log = fh->shell->camToWorld.log();
+    logSink->write(LOG_COARSE_TRACKING,
+                   {static_cast<double>(fh->shell->id), fh->shell->timestamp,
+                    fh->ab_exposure, log[0], log[1], log[2], log[3], log[4],
+                    log[5], aff_g2l.a, aff_g2l.b, achievedRes[0],
+                    static_cast<double>(tryIterations)});
   }
 
   return Vec4(achievedRes[0], flowVecs[0], flowVecs[1], flowVecs[2]);
 }
 
+void FullSystem::trackNewCoarseBatch(
+    FrameHessian *fh,
+    const std::vector<SE3, Eigen::aligned_allocator<SE3>> &lastF_2_fh_tries,
+    const AffLight &aff_last_2_l, const VecPyr &minResForAbort,
+    const unsigned int first, unsigned int *end,
+    std::vector<SE3, Eigen::aligned_allocator<SE3>> *poses,
+    std::vector<AffLight> *affs, std::vector<char> *isGood,
+    std::vector<std::vector<CoarseTrackerLevelResult>> *levels) {
+  const int numWorkers = treadReduceTracking->getNumThreads();
+  while (static_cast<int>(coarseTrackerWorkers.size()) < numWorkers) {
+    coarseTrackerWorkers.emplace_back(
+        new CoarseTracker(calib, settings, false));
+  }
+  for (CoarseTracker *worker : coarseTrackerWorkers) {
+    worker->shareReference(*coarseTracker);
+  }
+
+  *end = std::min<unsigned int>(first + numWorkers, lastF_2_fh_tries.size());
+  const int n = *end - first;
+  poses->assign(lastF_2_fh_tries.begin() + first,
+                lastF_2_fh_tries.begin() + *end);
+  affs->assign(n, aff_last_2_l);
+  isGood->assign(n, false);
+  levels->resize(n);
+
+  treadReduceTracking->reduce(
+      [&](int min, int max, Vec10 *stats, int tid) {
+        CoarseTracker *worker = coarseTrackerWorkers[tid];
+        for (int k = min; k < max; ++k) {
+          (*isGood)[k] = worker->trackNewestCoarse(fh, (*poses)[k], (*affs)[k],
+                                                   calib.pyrLevelsUsed - 1,
+                                                   minResForAbort);
+          (*levels)[k] = worker->lastLevelResults;
+        }
+      },
+      0, n, 1);
+}
+
+void FullSystem::traceNewCoarse_Reductor(
+    FrameHessian *fh, const std::vector<ImmaturePoint *> *points,
+    const std::vector<int> *pointHost,
+    const std::vector<TraceHostPrecalc> *hostPrecalc, int min, int max,
+    Vec10 *stats, int tid) {
+  for (int k = min; k < max; ++k) {
+    ImmaturePoint *ph = (*points)[k];
+    const TraceHostPrecalc &hp = (*hostPrecalc)[(*pointHost)[k]];
+    ph->traceOn(fh, hp.KRKi, hp.Kt, hp.aff, &Hcalib, false);
+
+    ++(*stats)[ph->lastTraceStatus];
+    ++(*stats)[kTraceStatTotal];
+  }
+}
+
 void FullSystem::traceNewCoarse(FrameHessian *fh) {
-  boost::unique_lock<boost::mutex> lock(mapMutex);
+  ScopedStageTimer stageTimer(STAGE_TRACE_COARSE);
+  boost::unique_lock<boost::mutex> lock =
+      TracedLock(mapMutex, "mapMutex");
 
-  int trace_total = 0, trace_good = 0, trace_oob = 0, trace_out = 0,
-      trace_skip = 0, trace_badcondition = 0, trace_uninitialized = 0;
+  const Mat33f& K = Hcalib.getK();
+  const Mat33f& Ki = Hcalib.getKi();
 
-  Mat33f K = Mat33f::Identity();
-  K(0, 0) = Hcalib.fxl();
-  K(1, 1) = Hcalib.fyl();
-  K(0, 2) = Hcalib.cxl();
-  K(1, 2) = Hcalib.cyl();
+  // projection from every active frame to the new one, computed once per host.
+  std::vector<TraceHostPrecalc> hostPrecalc(frameHessians.size());
+  std::vector<ImmaturePoint *> points;
+  std::vector<int> pointHost;
+  for (size_t h = 0; h < frameHessians.size(); ++h) {
+    FrameHessian *host = frameHessians[h];
 
-  // go through all active frames
-  for (FrameHessian *host : frameHessians) {
     // Tcur_host = Tcur_w * Tw_host
-    SE3 hostToNew = fh->PRE_worldToCam * host->PRE_camToWorld;
-    Mat33f KRKi = K * hostToNew.rotationMatrix().cast<float>() * K.inverse();
-    Vec3f Kt = K * hostToNew.translation().cast<float>();
-
-    Vec2f aff = AffLight::fromToVecExposure(host->ab_exposure, fh->ab_exposure,
-                                            host->aff_g2l(), fh->aff_g2l())
-                    .cast<float>();
-
-    for (ImmaturePoint *ph : host->immaturePoints) {
-      ph->traceOn(fh, KRKi, Kt, aff, &Hcalib, false);
-      switch (ph->lastTraceStatus) {
-      case ImmaturePointStatus::IPS_GOOD:
-        ++trace_good;
-        break;
-      case ImmaturePointStatus::IPS_BADCONDITION:
-        ++trace_badcondition;
-        break;
-      case ImmaturePointStatus::IPS_OOB:
-        ++trace_oob;
-        break;
-      case ImmaturePointStatus::IPS_OUTLIER:
-        ++trace_out;
-        break;
-      case ImmaturePointStatus::IPS_SKIPPED:
-        ++trace_skip;
-        break;
-      case ImmaturePointStatus::IPS_UNINITIALIZED:
-        ++trace_uninitialized;
-        break;
-      default:
-        break;
-      }
-      ++trace_total;
-    }
+    const SE3f hostToNew = fh->hostToThisF(host);
+    hostPrecalc[h].KRKi = K * hostToNew.rotationMatrix() * Ki;
+    hostPrecalc[h].Kt = K * hostToNew.translation();
+    hostPrecalc[h].aff =
+        AffLight::fromToVecExposure(host->ab_exposure, fh->ab_exposure,
+                                    host->aff_g2l(), fh->aff_g2l())
+            .cast<float>();
+
+    points.insert(points.end(), host->immaturePoints.begin(),
+                  host->immaturePoints.end());
+    pointHost.resize(points.size(), h);
+  }
+
+  Vec10 traceStats = Vec10::Zero();
+  if (settings.multiThreading) {
+    traceStats = treadReduce->reduce(
+        boost::bind(&FullSystem::traceNewCoarse_Reductor, this, fh, &points,
+                    &pointHost, &hostPrecalc, boost::placeholders::_1,
+                    boost::placeholders::_2, boost::placeholders::_3,
+                    boost::placeholders::_4),
+        0, points.size(), 50);
+  } else {
+    traceNewCoarse_Reductor(fh, &points, &pointHost, &hostPrecalc, 0,
+                            points.size(), &traceStats, 0);
+  }
+
+  if (!setting_debugout_runquiet) {
+    VLOG(1) << "TRACE: " << traceStats[kTraceStatTotal] << " points. "
+            << traceStats[IPS_GOOD] << " good, " << traceStats[IPS_SKIPPED]
+            << " skip, " << traceStats[IPS_BADCONDITION] << " badcond, "
+            << traceStats[IPS_OOB] << " oob, " << traceStats[IPS_OUTLIER]
+            << " out, " << traceStats[IPS_UNINITIALIZED] << " uninit.";
   }
 }
 
@@ -599,32 +1021,34 @@ void FullSystem::activatePointsMT_Reductor(
     std::vector<PointHessian *> *optimized,
     std::vector<ImmaturePoint *> *toOptimize, int min, int max, Vec10 *stats,
     int tid) {
-  ImmaturePointTemporaryResidual *tr =
-      new ImmaturePointTemporaryResidual[frameHessians.size()];
+  std::vector<ImmaturePointTemporaryResidual> &tr = activationScratch[tid];
+  if (tr.size() < frameHessians.size()) {
+    tr.resize(frameHessians.size());
+  }
   for (int k = min; k < max; ++k) {
-    (*optimized)[k] = optimizeImmaturePoint((*toOptimize)[k], 1, tr);
+    (*optimized)[k] = optimizeImmaturePoint((*toOptimize)[k], 1, tr.data());
   }
-  delete[] tr;
 }
 
 void FullSystem::activatePointsMT() {
-  if (ef->nPoints < setting_desiredPointDensity * 0.66) {
+  ScopedStageTimer stageTimer(STAGE_ACTIVATE_POINTS);
+  if (ef->nPoints < settings.desiredPointDensity * 0.66) {
     currentMinActDist -= 0.8;
-  } else if (ef->nPoints < setting_desiredPointDensity * 0.8) {
+  } else if (ef->nPoints < settings.desiredPointDensity * 0.8) {
     currentMinActDist -= 0.5;
-  } else if (ef->nPoints < setting_desiredPointDensity * 0.9) {
+  } else if (ef->nPoints < settings.desiredPointDensity * 0.9) {
     currentMinActDist -= 0.2;
-  } else if (ef->nPoints < setting_desiredPointDensity) {
+  } else if (ef->nPoints < settings.desiredPointDensity) {
     currentMinActDist -= 0.1;
   }
 
-  if (ef->nPoints > setting_desiredPointDensity * 1.5) {
+  if (ef->nPoints > settings.desiredPointDensity * 1.5) {
     currentMinActDist += 0.8;
-  } else if (ef->nPoints > setting_desiredPointDensity * 1.3) {
+  } else if (ef->nPoints > settings.desiredPointDensity * 1.3) {
     currentMinActDist += 0.5;
-  } else if (ef->nPoints > setting_desiredPointDensity * 1.15) {
+  } else if (ef->nPoints > settings.desiredPointDensity * 1.15) {
     currentMinActDist += 0.2;
-  } else if (ef->nPoints > setting_desiredPointDensity) {
+  } else if (ef->nPoints > settings.desiredPointDensity) {
     currentMinActDist += 0.1;
   }
 
@@ -636,7 +1060,7 @@ void FullSystem::activatePointsMT() {
 
   if (!setting_debugout_runquiet) {
     LOG(INFO) << "SPARSITY:  MinActDist " << currentMinActDist << " (need "
-              << setting_desiredPointDensity << " points, have " << ef->nPoints
+              << settings.desiredPointDensity << " points, have " << ef->nPoints
               << " points)!";
   }
 
@@ -648,22 +1072,40 @@ void FullSystem::activatePointsMT() {
 
   // coarseTracker->debugPlotDistMap("distMap");
 
-  std::vector<ImmaturePoint *> toOptimize;
-  toOptimize.reserve(20000);
-
+  // all immature points of the older frames as one range, host by host.
+  std::vector<FrameHessian *> hosts;
+  std::vector<int> hostStart(1, 0);
+  std::vector<Mat33f, Eigen::aligned_allocator<Mat33f>> hostKRKi;
+  std::vector<Vec3f, Eigen::aligned_allocator<Vec3f>> hostKt;
   for (FrameHessian *host : frameHessians) {
     // go through all active frames
     if (host == newestHs) {
       continue;
     }
 
-    SE3 fhToNew = newestHs->PRE_worldToCam * host->PRE_camToWorld;
-    Mat33f KRKi =
-        (coarseDistanceMap->K[1] * fhToNew.rotationMatrix().cast<float>() *
-         coarseDistanceMap->Ki[0]);
-    Vec3f Kt = (coarseDistanceMap->K[1] * fhToNew.translation().cast<float>());
+    const SE3f fhToNew = newestHs->hostToThisF(host);
+    hosts.emplace_back(host);
+    hostStart.emplace_back(hostStart.back() + host->immaturePoints.size());
+    hostKRKi.emplace_back(coarseDistanceMap->K[1] * fhToNew.rotationMatrix() *
+                          coarseDistanceMap->Ki[0]);
+    hostKt.emplace_back(coarseDistanceMap->K[1] * fhToNew.translation());
+  }
 
-    for (unsigned int i = 0; i < host->immaturePoints.size(); ++i) {
+  // pixel in the distance map of every point, -1 if it is not activated.
+  // Distances only decrease with addIntoDistFinal, so a point too close to
+  // the active ones already in the initial map is never activated: only the
+  // others have to go through the serial pass below.
+  std::vector<int> candidateIdx(hostStart.back(), -1);
+  std::vector<float> candidateDist(hostStart.back());
+  auto projectPoints = [&](int min, int max, Vec10 *stats, int tid) {
+    int h = std::upper_bound(hostStart.begin(), hostStart.end(), min) -
+            hostStart.begin() - 1;
+    for (int k = min; k < max; ++k) {
+      while (k >= hostStart[h + 1]) {
+        ++h;
+      }
+      FrameHessian *host = hosts[h];
+      const int i = k - hostStart[h];
       ImmaturePoint *ph = host->immaturePoints[i];
       ph->idxInImmaturePoints = i;
 
@@ -683,7 +1125,7 @@ void FullSystem::activatePointsMT() {
                           ph->lastTraceStatus == IPS_BADCONDITION ||
                           ph->lastTraceStatus == IPS_OOB) &&
                          ph->lastTracePixelInterval < 8 &&
-                         ph->quality > setting_minTraceQuality &&
+                         ph->quality > settings.minTraceQuality &&
                          (ph->idepth_max + ph->idepth_min) > 0;
 
       // if I cannot activate the point, skip it. Maybe also delete it.
@@ -698,31 +1140,56 @@ void FullSystem::activatePointsMT() {
       }
 
       // see if we need to activate point due to distance map.
-      Vec3f ptp = KRKi * Vec3f(ph->u, ph->v, 1) +
-                  Kt * (0.5f * (ph->idepth_max + ph->idepth_min));
+      Vec3f ptp = hostKRKi[h] * Vec3f(ph->u, ph->v, 1) +
+                  hostKt[h] * (0.5f * (ph->idepth_max + ph->idepth_min));
       int u = ptp[0] / ptp[2] + 0.5f;
       int v = ptp[1] / ptp[2] + 0.5f;
 
-      if (u > 0 && v > 0 && u < wG[1] && v < hG[1]) {
-        float dist = coarseDistanceMap->fwdWarpedIDDistFinal[u + wG[1] * v] +
-                     (ptp[0] - floorf(ptp[0]));
+      if (u > 0 && v > 0 && u < calib.w[1] && v < calib.h[1]) {
+        candidateDist[k] = ptp[0] - floorf(ptp[0]);
+        float dist =
+            coarseDistanceMap->fwdWarpedIDDistFinal[u + calib.w[1] * v] +
+            candidateDist[k];
 
         if (dist >= currentMinActDist * ph->my_type) {
-          coarseDistanceMap->addIntoDistFinal(u, v);
-          toOptimize.emplace_back(ph);
+          candidateIdx[k] = u + calib.w[1] * v;
         }
       } else {
         delete ph;
         host->immaturePoints[i] = 0;
       }
     }
+  };
+  if (settings.multiThreading) {
+    treadReduce->reduce(projectPoints, 0, hostStart.back(), 500);
+  } else {
+    projectPoints(0, hostStart.back(), nullptr, 0);
+  }
+
+  // in point order, as every activation changes the distances of the next.
+  std::vector<ImmaturePoint *> toOptimize;
+  toOptimize.reserve(20000);
+  for (size_t h = 0; h < hosts.size(); ++h) {
+    for (int k = hostStart[h]; k < hostStart[h + 1]; ++k) {
+      const int idx = candidateIdx[k];
+      if (idx < 0) {
+        continue;
+      }
+      ImmaturePoint *ph = hosts[h]->immaturePoints[k - hostStart[h]];
+      float dist = coarseDistanceMap->fwdWarpedIDDistFinal[idx] +
+                   candidateDist[k];
+      if (dist >= currentMinActDist * ph->my_type) {
+        coarseDistanceMap->addIntoDistFinal(idx % calib.w[1], idx / calib.w[1]);
+        toOptimize.emplace_back(ph);
+      }
+    }
   }
 
   std::vector<PointHessian *> optimized;
   optimized.resize(toOptimize.size());
 
-  if (multiThreading) {
-    treadReduce.reduce(
+  if (settings.multiThreading) {
+    treadReduce->reduce(
         boost::bind(&FullSystem::activatePointsMT_Reductor, this, &optimized,
                     &toOptimize, boost::placeholders::_1,
                     boost::placeholders::_2, boost::placeholders::_3,
@@ -748,24 +1215,25 @@ void FullSystem::activatePointsMT() {
       delete ph;
     } else if (newpoint == (PointHessian *)((long)(-1)) ||
                ph->lastTraceStatus == IPS_OOB) {
-      delete ph;
       ph->host->immaturePoints[ph->idxInImmaturePoints] = 0;
+      delete ph;
     } else {
       CHECK(newpoint == 0 || newpoint == (PointHessian *)((long)(-1)));
     }
   }
 
   for (FrameHessian *host : frameHessians) {
-    for (int i = 0; i < (int)host->immaturePoints.size(); ++i) {
-      if (host->immaturePoints[i] == 0) {
-        host->immaturePoints[i] = host->immaturePoints.back();
-        host->immaturePoints.pop_back();
-        --i;
-      }
-    }
+    compactOutNull(host->immaturePoints);
   }
 }
 
+namespace {
+
+// what flagPointsForRemoval does with a point.
+enum PointFlag : uint8_t { POINT_KEEP = 0, POINT_DROP, POINT_MARGINALIZE };
+
+}  // namespace
+
 void FullSystem::flagPointsForRemoval() {
   CHECK(EFIndicesValid);
 
@@ -787,60 +1255,88 @@ void FullSystem::flagPointsForRemoval() {
     }
   }
 
-  int flag_oob = 0, flag_in = 0, flag_inin = 0, flag_nores = 0;
+  pointFlagHostStart.resize(frameHessians.size() + 1);
+  pointFlagHostStart[0] = 0;
+  for (size_t h = 0; h < frameHessians.size(); ++h) {
+    pointFlagHostStart[h + 1] =
+        pointFlagHostStart[h] + frameHessians[h]->pointHessians.size();
+  }
+  const int numPoints = pointFlagHostStart.back();
+  pointFlags.assign(numPoints, POINT_KEEP);
+
+  if (settings.multiThreading) {
+    treadReduce->reduce(
+        boost::bind(&FullSystem::flagPointsForRemoval_Reductor, this,
+                    &fhsToKeepPoints, &fhsToMargPoints,
+                    boost::placeholders::_1, boost::placeholders::_2,
+                    boost::placeholders::_3, boost::placeholders::_4),
+        0, numPoints, 0);
+  } else {
+    flagPointsForRemoval_Reductor(&fhsToKeepPoints, &fhsToMargPoints, 0,
+                                  numPoints, nullptr, 0);
+  }
 
-  for (FrameHessian *host : frameHessians) {
-    // go through all active frames
+  for (size_t h = 0; h < frameHessians.size(); ++h) {
+    FrameHessian *host = frameHessians[h];
+    const uint8_t *flags = pointFlags.data() + pointFlagHostStart[h];
     for (size_t i = 0; i < host->pointHessians.size(); ++i) {
-      PointHessian *ph = host->pointHessians[i];
-      if (ph == nullptr) {
+      if (flags[i] == POINT_KEEP) {
         continue;
       }
+      if (flags[i] == POINT_MARGINALIZE) {
+        host->pointHessiansMarginalized.emplace_back(host->pointHessians[i]);
+      } else {
+        host->pointHessiansOut.emplace_back(host->pointHessians[i]);
+      }
+      host->pointHessians[i] = nullptr;
+    }
 
-      if (ph->idepth_scaled < 0 || ph->residuals.size() == 0) {
-        host->pointHessiansOut.emplace_back(ph);
-        ph->efPoint->stateFlag = EFPointStatus::PS_DROP;
-        host->pointHessians[i] = nullptr;
-        ++flag_nores;
-      } else if (ph->isOOB(fhsToKeepPoints, fhsToMargPoints) ||
-                 host->flaggedForMarginalization) {
-        ++flag_oob;
-        if (ph->isInlierNew()) {
-          flag_in++;
-          int ngoodRes = 0;
-          for (PointFrameResidual *r : ph->residuals) {
-            r->resetOOB();
-            r->linearize(&Hcalib);
-            r->efResidual->isLinearized = false;
-            r->applyRes(true);
-            if (r->efResidual->isActive()) {
-              r->efResidual->fixLinearizationF(ef);
-              ++ngoodRes;
-            }
-          }
-          if (ph->idepth_hessian > setting_minIdepthH_marg) {
-            ++flag_inin;
-            ph->efPoint->stateFlag = EFPointStatus::PS_MARGINALIZE;
-            host->pointHessiansMarginalized.emplace_back(ph);
-          } else {
-            ph->efPoint->stateFlag = EFPointStatus::PS_DROP;
-            host->pointHessiansOut.emplace_back(ph);
-          }
-        } else {
-          host->pointHessiansOut.emplace_back(ph);
-          ph->efPoint->stateFlag = EFPointStatus::PS_DROP;
-        }
+    compactOutNull(host->pointHessians);
+  }
+}
 
-        host->pointHessians[i] = 0;
-      }
+void FullSystem::flagPointsForRemoval_Reductor(
+    const std::vector<FrameHessian *> *fhsToKeepPoints,
+    const std::vector<FrameHessian *> *fhsToMargPoints, const int min,
+    const int max, Vec10 *stats, const int tid) {
+  int h = std::upper_bound(pointFlagHostStart.begin(),
+                           pointFlagHostStart.end(), min) -
+          pointFlagHostStart.begin() - 1;
+  for (int k = min; k < max; ++k) {
+    while (k >= pointFlagHostStart[h + 1]) {
+      ++h;
+    }
+    FrameHessian *host = frameHessians[h];
+    PointHessian *ph = host->pointHessians[k - pointFlagHostStart[h]];
+    if (ph == nullptr) {
+      continue;
     }
 
-    for (int i = 0; i < (int)host->pointHessians.size(); ++i) {
-      if (host->pointHessians[i] == 0) {
-        host->pointHessians[i] = host->pointHessians.back();
-        host->pointHessians.pop_back();
-        --i;
+    if (ph->idepth_scaled < 0 || ph->residuals.size() == 0) {
+      ph->efPoint->stateFlag = EFPointStatus::PS_DROP;
+      pointFlags[k] = POINT_DROP;
+    } else if (ph->isOOB(*fhsToKeepPoints, *fhsToMargPoints) ||
+               host->flaggedForMarginalization) {
+      pointFlags[k] = POINT_DROP;
+      if (ph->isInlierNew()) {
+        // only touches the residuals of ph (and the atomic
+        // ef->nResLinearized).
+        for (PointFrameResidual *r : ph->residuals) {
+          r->resetOOB();
+          r->linearize(&Hcalib);
+          r->efResidual->resetLinearizationF(ef);
+          r->applyRes(true);
+          if (r->efResidual->isActive()) {
+            r->efResidual->fixLinearizationF(ef);
+          }
+        }
+        if (ph->idepth_hessian > settings.minIdepthH_marg) {
+          pointFlags[k] = POINT_MARGINALIZE;
+        }
       }
+      ph->efPoint->stateFlag = pointFlags[k] == POINT_MARGINALIZE
+                                   ? EFPointStatus::PS_MARGINALIZE
+                                   : EFPointStatus::PS_DROP;
     }
   }
 }
@@ -848,19 +1344,22 @@ void FullSystem::flagPointsForRemoval() {
 void FullSystem::deliverTrackedFrame(FrameHessian *const fh,
                                      const bool needKF) {
   if (linearizeOperation) {
-    if (goStepByStep && lastRefStopID != coarseTracker->refFrameID) {
-      MinimalImageF3 img(wG[0], hG[0], fh->dI);
-      IOWrap::displayImage("frameToTrack", &img);
-      while (true) {
-        char k = IOWrap::waitKey(0);
-        if (k == ' ') {
-          break;
+    // headless there are no windows and no keys, nothing to do per frame.
+    if (IOWrap::canDisplay()) {
+      if (goStepByStep && lastRefStopID != coarseTracker->refFrameID) {
+        MinimalImageF3 img(calib.w[0], calib.h[0], fh->dI);
+        IOWrap::displayImage("frameToTrack", &img);
+        while (true) {
+          char k = IOWrap::waitKey(0);
+          if (k == ' ') {
+            break;
+          }
+          handleKey(k);
         }
-        handleKey(k);
+        lastRefStopID = coarseTracker->refFrameID;
+      } else {
+        handleKey(IOWrap::pollKey());
       }
-      lastRefStopID = coarseTracker->refFrameID;
-    } else {
-      handleKey(IOWrap::waitKey(1));
     }
 
     if (needKF) {
@@ -869,60 +1368,102 @@ void FullSystem::deliverTrackedFrame(FrameHessian *const fh,
       makeNonKeyFrame(fh);
     }
   } else {
-    boost::unique_lock<boost::mutex> lock(trackMapSyncMutex);
-    unmappedTrackedFrames.emplace_back(fh);
+    // published before the frame, so the mapper sees it along with fh.
     if (needKF) {
       needNewKFAfter = fh->shell->trackingRef->id;
     }
-    trackedFrameSignal.notify_all();
+    ++numUnmappedFrames;
+    if (!unmappedTrackedFrames.push(fh)) {
+      // mapping is a full queue behind, wait for it to make room.
+      ScopedTraceSpan wait("unmappedTrackedFrames full");
+      while (!unmappedTrackedFrames.push(fh)) {
+        boost::this_thread::yield();
+      }
+    }
+    if (setting_trace) {
+      TraceRecorder::counter("unmappedTrackedFrames", numUnmappedFrames);
+    }
 
-    while (coarseTracker_forNewKF->refFrameID == -1 &&
-           coarseTracker->refFrameID == -1) {
-      mappedFrameSignal.wait(lock);
+    // wake up the mapper only if it sleeps. The fence pairs with the one in
+    // waitForTrackedFrame, so either it sees fh or we see it sleeping.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mapperSleeping) {
+      boost::unique_lock<boost::mutex> lock =
+          TracedLock(trackMapSyncMutex, "trackMapSyncMutex");
+      trackedFrameSignal.notify_all();
     }
 
-    lock.unlock();
+    if (coarseTracker->refFrameID == -1 && !newReferenceReady) {
+      boost::unique_lock<boost::mutex> lock =
+          TracedLock(trackMapSyncMutex, "trackMapSyncMutex");
+      ScopedTraceSpan wait("mappedFrameSignal");
+      while (coarseTracker->refFrameID == -1 && !newReferenceReady) {
+        mappedFrameSignal.wait(lock);
+      }
+    }
+  }
+}
+
+bool FullSystem::waitForTrackedFrame(FrameHessian **fh) {
+  while (!unmappedTrackedFrames.pop(*fh)) {
+    boost::unique_lock<boost::mutex> lock =
+        TracedLock(trackMapSyncMutex, "trackMapSyncMutex");
+    mapperSleeping = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      ScopedTraceSpan wait("trackedFrameSignal");
+      while (runMapping && unmappedTrackedFrames.read_available() == 0) {
+        trackedFrameSignal.wait(lock);
+      }
+    }
+    mapperSleeping = false;
+
+    if (!runMapping) {
+      return false;
+    }
+  }
+  --numUnmappedFrames;
+  if (setting_trace) {
+    TraceRecorder::counter("unmappedTrackedFrames", numUnmappedFrames);
   }
+  return true;
 }
 
 void FullSystem::mappingLoop() {
-  boost::unique_lock<boost::mutex> lock(trackMapSyncMutex);
+  ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_MAPPER);
 
+  FrameHessian *fh;
   while (runMapping) {
-    while (unmappedTrackedFrames.size() == 0) {
-      trackedFrameSignal.wait(lock);
-      if (!runMapping) {
-        return;
-      }
+    if (!waitForTrackedFrame(&fh)) {
+      return;
     }
-
-    FrameHessian *fh = unmappedTrackedFrames.front();
-    unmappedTrackedFrames.pop_front();
+    SamplingProfiler::setFrame(fh->shell->id, -1);
 
     // guaranteed to make a KF for the very first two tracked frames.
     if (allKeyFramesHistory.size() <= 2) {
-      lock.unlock();
       makeKeyFrame(fh);
-      lock.lock();
-      mappedFrameSignal.notify_all();
+      signalMappedFrame();
       continue;
     }
 
-    if (unmappedTrackedFrames.size() > 3) {
+    if (unmappedTrackedFrames.read_available() > 3) {
       needToKetchupMapping = true;
     }
 
-    if (unmappedTrackedFrames.size() > 0) {
+    if (unmappedTrackedFrames.read_available() > 0) {
       // if there are other frames to tracke, do that first.
-      lock.unlock();
       makeNonKeyFrame(fh);
-      lock.lock();
 
-      if (needToKetchupMapping && unmappedTrackedFrames.size() > 0) {
-        FrameHessian *fh = unmappedTrackedFrames.front();
-        unmappedTrackedFrames.pop_front();
+      if (needToKetchupMapping && unmappedTrackedFrames.pop(fh)) {
+        --numUnmappedFrames;
+        ++numCatchUpDroppedFrames;
+        if (setting_trace) {
+          TraceRecorder::instant("catch-up drop");
+          TraceRecorder::counter("unmappedTrackedFrames", numUnmappedFrames);
+        }
         {
-          boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+          boost::unique_lock<boost::mutex> crlock =
+              TracedLock(shellPoseMutex, "shellPoseMutex");
           assert(fh->shell->trackingRef != 0);
           fh->shell->camToWorld =
               fh->shell->trackingRef->camToWorld * fh->shell->camToTrackingRef;
@@ -933,37 +1474,105 @@ void FullSystem::mappingLoop() {
       }
 
     } else {
-      if (setting_realTimeMaxKF ||
+      if (settings.realTimeMaxKF ||
           needNewKFAfter >= frameHessians.back()->shell->id) {
-        lock.unlock();
         makeKeyFrame(fh);
         needToKetchupMapping = false;
-        lock.lock();
       } else {
-        lock.unlock();
         makeNonKeyFrame(fh);
-        lock.lock();
       }
     }
-    mappedFrameSignal.notify_all();
+    signalMappedFrame();
   }
   LOG(INFO) << "MAPPING FINISHED!";
 }
 
+void FullSystem::signalMappedFrame() {
+  boost::unique_lock<boost::mutex> lock =
+      TracedLock(trackMapSyncMutex, "trackMapSyncMutex");
+  mappedFrameSignal.notify_all();
+}
+
 void FullSystem::blockUntilMappingIsFinished() {
-  boost::unique_lock<boost::mutex> lock(trackMapSyncMutex);
+  boost::unique_lock<boost::mutex> lock =
+      TracedLock(trackMapSyncMutex, "trackMapSyncMutex");
   runMapping = false;
   trackedFrameSignal.notify_all();
   lock.unlock();
 
   mappingThread.join();
+
+  boost::unique_lock<boost::mutex> referenceLock(referenceMutex);
+  runReference = false;
+  referenceSignal.notify_all();
+  referenceLock.unlock();
+
+  referenceThread.join();
+}
+
+void FullSystem::startTrackingReference() {
+  waitForTrackingReference();
+
+  coarseTracker_forNewKF->makeK(&Hcalib);
+  coarseTracker_forNewKF->splatCoarseTrackingRef(frameHessians);
+
+  boost::unique_lock<boost::mutex> lock(referenceMutex);
+  referencePending = true;
+  referenceSignal.notify_all();
+}
+
+void FullSystem::waitForTrackingReference() {
+  boost::unique_lock<boost::mutex> lock(referenceMutex);
+  if (referencePending) {
+    ScopedTraceSpan wait("referenceSignal");
+    while (referencePending) {
+      referenceSignal.wait(lock);
+    }
+  }
+}
+
+void FullSystem::publishTrackingReference() {
+  {
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(coarseTrackerSwapMutex, "coarseTrackerSwapMutex");
+    std::swap(coarseTracker_ready, coarseTracker_forNewKF);
+    newReferenceReady = true;
+  }
+  signalMappedFrame();
+}
+
+void FullSystem::referenceLoop() {
+  ThreadConfig::ApplyToThisThread(ThreadConfig::ROLE_MAPPER);
+
+  boost::unique_lock<boost::mutex> lock(referenceMutex);
+  while (true) {
+    while (!referencePending && runReference) {
+      referenceSignal.wait(lock);
+    }
+    if (!referencePending) {
+      return;
+    }
+    lock.unlock();
+
+    // single threaded, treadReduce is busy with the rest of the keyframe.
+    coarseTracker_forNewKF->finishCoarseTrackingRef();
+    coarseTracker_forNewKF->debugPlotIDepthMap(
+        &minIdJetVisTracker, &maxIdJetVisTracker, outputWrapper);
+    coarseTracker_forNewKF->debugPlotIDepthMapFloat(outputWrapper);
+    publishTrackingReference();
+
+    lock.lock();
+    referencePending = false;
+    referenceSignal.notify_all();
+  }
 }
 
 void FullSystem::makeNonKeyFrame(FrameHessian *const fh) {
   // needs to be set by mapping thread. no lock required since we are in mapping
   // thread.
   {
-    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
     CHECK_NOTNULL(fh->shell->trackingRef);
     fh->shell->camToWorld =
         fh->shell->trackingRef->camToWorld * fh->shell->camToTrackingRef;
@@ -975,9 +1584,18 @@ void FullSystem::makeNonKeyFrame(FrameHessian *const fh) {
 }
 
 void FullSystem::makeKeyFrame(FrameHessian *const fh) {
+  ScopedStageTimer stageTimer(STAGE_MAKE_KEYFRAME);
+  latencyController.update(linearizeOperation);
+  keyframeTimer.reset();
+  const int framesSinceKeyframe =
+      allKeyFramesHistory.empty()
+          ? 1
+          : fh->shell->id - allKeyFramesHistory.back()->id;
+
   // needs to be set by mapping thread
   {
-    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
     CHECK_NOTNULL(fh->shell->trackingRef);
 
     // Tw_cur = Tw_ref * Tref_cur
@@ -988,7 +1606,8 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
 
   traceNewCoarse(fh);
 
-  boost::unique_lock<boost::mutex> lock(mapMutex);
+  boost::unique_lock<boost::mutex> lock =
+      TracedLock(mapMutex, "mapMutex");
 
   // ============== Flag Frames to be Marginalized. ==============
   flagFramesForMarginalization(fh);
@@ -998,6 +1617,7 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
   frameHessians.emplace_back(fh);
   fh->frameID = allKeyFramesHistory.size();
   allKeyFramesHistory.emplace_back(fh->shell);
+  SamplingProfiler::setFrame(fh->shell->id, fh->frameID);
   ef->insertFrame(fh, &Hcalib);
 
   setPrecalcValues();
@@ -1027,7 +1647,9 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
 
   // ============== OPTIMIZE ALL ==============
   fh->frameEnergyTH = frameHessians.back()->frameEnergyTH;
-  float rmse = optimize(setting_maxOptIterations);
+  WallTimer optimizeTimer;
+  float rmse = optimize(settings.maxOptIterations);
+  const double optimizeMs = optimizeTimer.elapsedMs();
 
   // ============== Figure Out if INITIALIZATION FAILED ==============
   if (allKeyFramesHistory.size() <= 4) {
@@ -1043,22 +1665,15 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
     }
   }
 
-  if (isLost) {
+  if (isLost || relocalizing) {
     return;
   }
 
   // ============== REMOVE OUTLIER ==============
   removeOutliers();
 
-  {
-    boost::unique_lock<boost::mutex> crlock(coarseTrackerSwapMutex);
-    coarseTracker_forNewKF->makeK(&Hcalib);
-    coarseTracker_forNewKF->setCoarseTrackingRef(frameHessians);
-
-    coarseTracker_forNewKF->debugPlotIDepthMap(
-        &minIdJetVisTracker, &maxIdJetVisTracker, outputWrapper);
-    coarseTracker_forNewKF->debugPlotIDepthMapFloat(outputWrapper);
-  }
+  // the rest of the reference is made while the keyframe is finished.
+  startTrackingReference();
 
   debugPlot("post Optimize");
 
@@ -1072,6 +1687,7 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
   // ============== add new Immature points & new residuals ==============
   makeNewTraces(fh, 0);
 
+  touchWindowPoints();
   for (IOWrap::Output3DWrapper *ow : outputWrapper) {
     ow->publishGraph(ef->connectivityMap);
     ow->publishKeyframes(frameHessians, false, &Hcalib);
@@ -1085,12 +1701,126 @@ void FullSystem::makeKeyFrame(FrameHessian *const fh) {
     }
   }
 
+  // the upper levels were only needed for point selection and as tracking
+  // reference, both done by now.
+  if (settings.compactKeyframePyramid) {
+    waitForTrackingReference();
+    fh->makeCompact();
+  } else if (settings.releaseKeyframePyramid) {
+    waitForTrackingReference();
+    fh->releasePyramid();
+  }
+
+  if (settings.boundedFrameHistory) {
+    // the frames before the window were published final (keyframes on
+    // marginalization, the others by the publishKeyframes above). The frames
+    // still queued for mapping were tracked on fh's reference or a newer one.
+    int horizon = frameHessians.front()->shell->id;
+    if (fh->shell->trackingRef != nullptr) {
+      horizon = std::min(horizon, fh->shell->trackingRef->id);
+    }
+    allKeyFramesHistory.dropBefore(horizon, [](FrameShell *s) {});
+    shellHorizon = horizon;
+  }
+
+  latencyController.addKeyframeTime(keyframeTimer.elapsedMs(), optimizeMs,
+                                    framesSinceKeyframe);
   printLogLine();
+  publishMappingMetrics();
+  if (setting_logEigenValInterval > 0 &&
+      allKeyFramesHistory.back()->id % setting_logEigenValInterval == 0) {
+    printEigenValLine();
+  }
+
+  // the next frame is tracked on fh then, as without the mapping thread.
+  if (linearizeOperation) {
+    waitForTrackingReference();
+  }
+
+  if (settings.snapshotInterval > 0 &&
+      fh->frameID % settings.snapshotInterval == 0) {
+    lock.unlock();
+    saveSnapshot(settings.snapshotPath);
+  }
+}
+
+bool FullSystem::trackInitAttempts(FrameHessian *fh) {
+  if (initAttempts.empty()) {
+    initAttempts.emplace_back(coarseInitializer);
+  }
+  while (static_cast<int>(initAttempts.size()) < settings.initAttempts) {
+    initAttempts.emplace_back(new CoarseInitializer(calib, settings));
+  }
+
+  int numAnchored = 0;
+  while (numAnchored < static_cast<int>(initAttempts.size()) &&
+         initAttempts[numAnchored]->frameID >= 0) {
+    ++numAnchored;
+  }
+
+  // one attempt per worker, each single threaded. Only the oldest one draws.
+  std::vector<char> converged(numAnchored, false);
+  std::vector<IOWrap::Output3DWrapper *> noWrappers;
+  auto trackAttempts = [&](int min, int max, Vec10 *stats, int tid) {
+    for (int k = min; k < max; ++k) {
+      converged[k] = initAttempts[k]->trackFrame(
+          fh, k == 0 ? outputWrapper : noWrappers, nullptr);
+    }
+  };
+  if (settings.multiThreading && numAnchored > 1) {
+    treadReduceTracking->reduce(trackAttempts, 0, numAnchored, 1);
+  } else {
+    trackAttempts(0, numAnchored, nullptr, 0);
+  }
+
+  for (int k = 0; k < numAnchored; ++k) {
+    if (!converged[k]) {
+      continue;
+    }
+    LOG(INFO) << "Initialization attempt " << k << " of " << numAnchored
+              << " converged (first frame "
+              << initAttempts[k]->firstFrame->shell->id << ").";
+    coarseInitializer = initAttempts[k];
+    for (int j = 0; j < numAnchored; ++j) {
+      if (j != k) {
+        delete initAttempts[j]->firstFrame;
+        initAttempts[j]->frameID = -1;
+      }
+    }
+    return true;
+  }
+
+  // start the next attempt at fh, restarting the oldest one if all are used.
+  ++framesSinceInitAnchor;
+  CoarseInitializer *next = nullptr;
+  if (numAnchored == 0 ||
+      framesSinceInitAnchor >= settings.initAttemptSpacing) {
+    if (numAnchored < static_cast<int>(initAttempts.size())) {
+      next = initAttempts[numAnchored];
+    } else if (!initAttempts[0]->isSnapped()) {
+      next = initAttempts[0];
+      delete next->firstFrame;
+      std::rotate(initAttempts.begin(), initAttempts.begin() + 1,
+                  initAttempts.end());
+    }
+  }
+
+  if (next != nullptr) {
+    // fh is kept by next.
+    next->setFirst(&Hcalib, fh,
+                   settings.multiThreading ? treadReduceTracking : nullptr);
+    framesSinceInitAnchor = 0;
+  } else {
+    fh->shell->poseValid = false;
+    delete fh;
+  }
+  return false;
 }
 
 void FullSystem::initializeFromInitializer(FrameHessian *newFrame) {
   LOG(WARNING) << "Initalize";
-  boost::unique_lock<boost::mutex> lock(mapMutex);
+  boost::unique_lock<boost::mutex> lock =
+      TracedLock(mapMutex, "mapMutex");
 
   // add first frame.
   FrameHessian *firstFrame = coarseInitializer->firstFrame;
@@ -1101,9 +1831,9 @@ void FullSystem::initializeFromInitializer(FrameHessian *newFrame) {
   ef->insertFrame(firstFrame, &Hcalib);
   setPrecalcValues();
 
-  firstFrame->pointHessians.reserve(wG[0] * hG[0] * 0.2f);
-  firstFrame->pointHessiansMarginalized.reserve(wG[0] * hG[0] * 0.2f);
-  firstFrame->pointHessiansOut.reserve(wG[0] * hG[0] * 0.2f);
+  firstFrame->pointHessians.reserve(calib.w[0] * calib.h[0] * 0.2f);
+  firstFrame->pointHessiansMarginalized.reserve(calib.w[0] * calib.h[0] * 0.2f);
+  firstFrame->pointHessiansOut.reserve(calib.w[0] * calib.h[0] * 0.2f);
 
   // sum of inverse depths, number of inverse depths
   float sumID = 1e-5, numID = 1e-5;
@@ -1116,11 +1846,11 @@ void FullSystem::initializeFromInitializer(FrameHessian *newFrame) {
 
   // randomly sub-select the points I need.
   float keepPercentage =
-      setting_desiredPointDensity / coarseInitializer->numPoints[0];
+      settings.desiredPointDensity / coarseInitializer->numPoints[0];
 
   if (!setting_debugout_runquiet) {
     LOG(INFO) << "Initialization: keep " << 100 * keepPercentage << "% (need "
-              << setting_desiredPointDensity << ", have "
+              << settings.desiredPointDensity << ", have "
               << coarseInitializer->numPoints[0] << ")!";
   }
 
@@ -1161,7 +1891,8 @@ void FullSystem::initializeFromInitializer(FrameHessian *newFrame) {
 
   // really no lock required, as we are initializing.
   {
-    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
     firstFrame->shell->camToWorld = SE3();
     firstFrame->shell->aff_g2l = AffLight(0, 0);
     firstFrame->setEvalPT_scaled(firstFrame->shell->camToWorld.inverse(),
@@ -1184,42 +1915,140 @@ void FullSystem::initializeFromInitializer(FrameHessian *newFrame) {
 
 void FullSystem::makeNewTraces(FrameHessian *newFrame, float *gtDepth) {
   pixelSelector->allowFast = true;
-  int numPointsTotal = pixelSelector->makeMaps(newFrame, selectionMap,
-                                               setting_desiredImmatureDensity);
+  int numPointsTotal = pixelSelector->makeMaps(
+      newFrame, &selectedPixels, settings.desiredImmatureDensity, 1, false, 1,
+      settings.multiThreading ? treadReduce : nullptr);
 
   newFrame->pointHessians.reserve(numPointsTotal * 1.2f);
   newFrame->pointHessiansMarginalized.reserve(numPointsTotal * 1.2f);
   newFrame->pointHessiansOut.reserve(numPointsTotal * 1.2f);
 
-  for (int y = patternPadding + 1; y < hG[0] - patternPadding - 2; ++y) {
-    for (int x = patternPadding + 1; x < wG[0] - patternPadding - 2; ++x) {
-      int i = x + y * wG[0];
-      if (selectionMap[i] == 0) {
-        continue;
-      }
+  // the pixels are in row order, so are the points.
+  newTraces.resize(selectedPixels.size());
+  if (settings.multiThreading) {
+    treadReduce->reduce(
+        boost::bind(&FullSystem::makeNewTraces_Reductor, this, newFrame,
+                    boost::placeholders::_1, boost::placeholders::_2,
+                    boost::placeholders::_3, boost::placeholders::_4),
+        0, selectedPixels.size(), 0);
+  } else {
+    makeNewTraces_Reductor(newFrame, 0, selectedPixels.size(), nullptr, 0);
+  }
 
-      ImmaturePoint *impt =
-          new ImmaturePoint(x, y, newFrame, selectionMap[i], &Hcalib);
-      if (!std::isfinite(impt->energyTH)) {
-        delete impt;
-      } else {
-        newFrame->immaturePoints.emplace_back(impt);
-      }
+  newFrame->immaturePoints.reserve(newFrame->immaturePoints.size() +
+                                   newTraces.size());
+  for (ImmaturePoint *impt : newTraces) {
+    if (impt != nullptr) {
+      newFrame->immaturePoints.emplace_back(impt);
     }
   }
 }
 
-void FullSystem::setPrecalcValues() {
-  for (FrameHessian *fh : frameHessians) {
-    fh->targetPrecalc.resize(frameHessians.size());
-    for (size_t i = 0; i < frameHessians.size(); ++i) {
-      fh->targetPrecalc[i].set(fh, frameHessians[i], &Hcalib);
+void FullSystem::makeNewTraces_Reductor(FrameHessian *newFrame, const int min,
+                                        const int max, Vec10 *stats,
+                                        const int tid) {
+  const int padding = staticPatternPadding[settings.pattern];
+  for (int k = min; k < max; ++k) {
+    const PixelCandidate &p = selectedPixels[k];
+    newTraces[k] = nullptr;
+    if (p.u < padding + 1 || p.u >= calib.w[0] - padding - 2 ||
+        p.v < padding + 1 || p.v >= calib.h[0] - padding - 2) {
+      continue;
+    }
+
+    ImmaturePoint *impt =
+        new ImmaturePoint(p.u, p.v, newFrame, p.type, &Hcalib);
+    if (!std::isfinite(impt->energyTH)) {
+      delete impt;
+    } else {
+      newTraces[k] = impt;
     }
   }
+}
 
+void FullSystem::setPrecalcValues() {
+  updateFramePrecalc();
   ef->setDeltaF(&Hcalib);
 }
 
+void FullSystem::updateFramePrecalc() {
+  const int n = frameHessians.size();
+
+  if (frameHessians != framePrecalcFrames) {
+    // old position of every frame, -1 for new ones.
+    std::vector<int> oldIdx(n, -1);
+    for (int i = 0; i < n; ++i) {
+      for (size_t o = 0; o < framePrecalcFrames.size(); ++o) {
+        if (framePrecalcFrames[o] == frameHessians[i]) {
+          oldIdx[i] = o;
+        }
+      }
+    }
+
+    const int oldN = framePrecalcFrames.size();
+    std::vector<FrameFramePrecalc, Eigen::aligned_allocator<FrameFramePrecalc>>
+        precalc(n * n);
+    for (int h = 0; h < n; ++h) {
+      for (int t = 0; t < n; ++t) {
+        if (oldIdx[h] >= 0 && oldIdx[t] >= 0) {
+          precalc[h * n + t] = framePrecalc[oldIdx[h] * oldN + oldIdx[t]];
+        }
+      }
+    }
+    framePrecalc.swap(precalc);
+    framePrecalcFrames = frameHessians;
+  }
+
+  for (int h = 0; h < n; ++h) {
+    FrameHessian *host = frameHessians[h];
+    host->targetPrecalc = framePrecalc.data() + h * n;
+    for (int t = 0; t < n; ++t) {
+      FrameFramePrecalc &precalc = framePrecalc[h * n + t];
+      if (!precalc.isUpToDate(host, frameHessians[t], &Hcalib)) {
+        precalc.set(host, frameHessians[t], &Hcalib);
+      }
+    }
+  }
+}
+
+void FullSystem::publishTrackingMetrics() {
+  if (setting_metricsPort <= 0) {
+    return;
+  }
+  MetricsExporter::set(METRIC_FRAMES, allFrameHistory.size());
+  MetricsExporter::set(METRIC_INITIALIZED, initialized);
+  MetricsExporter::set(METRIC_LOST, isLost);
+  MetricsExporter::set(METRIC_COARSE_RMSE, lastCoarseRMSE[0]);
+  MetricsExporter::set(METRIC_UNMAPPED_FRAMES, numUnmappedFrames);
+  MetricsExporter::set(METRIC_CATCH_UP_DROPPED, numCatchUpDroppedFrames);
+  MetricsExporter::set(METRIC_DEADLINE_SKIPPED, numDeadlineSkippedFrames);
+}
+
+void FullSystem::publishMappingMetrics() {
+  if (setting_metricsPort <= 0) {
+    return;
+  }
+  MetricsExporter::set(METRIC_LOST, isLost);
+  MetricsExporter::set(METRIC_KEYFRAMES, allKeyFramesHistory.size());
+  MetricsExporter::set(METRIC_FINE_TRACK_RMSE, statistics_lastFineTrackRMSE);
+  MetricsExporter::set(METRIC_OPT_ITERATIONS, statistics_lastNumOptIts);
+  MetricsExporter::set(METRIC_CREATED_POINTS, statistics_numCreatedPoints);
+  MetricsExporter::set(METRIC_ACTIVATED_POINTS, statistics_numActivatedPoints);
+  MetricsExporter::set(METRIC_DROPPED_POINTS, statistics_numDroppedPoints);
+  MetricsExporter::set(METRIC_MARG_RES_FWD, statistics_numMargResFwd);
+  MetricsExporter::set(METRIC_MARG_RES_BWD, statistics_numMargResBwd);
+  MetricsExporter::set(METRIC_FORCE_DROPPED_RES_FWD,
+                       statistics_numForceDroppedResFwd);
+  MetricsExporter::set(METRIC_FORCE_DROPPED_RES_BWD,
+                       statistics_numForceDroppedResBwd);
+  MetricsExporter::set(METRIC_ACTIVE_FRAMES, frameHessians.size());
+  MetricsExporter::set(METRIC_ACTIVE_POINTS, ef->nPoints);
+  MetricsExporter::set(METRIC_ACTIVE_RESIDUALS, ef->nResiduals);
+  MetricsExporter::set(METRIC_RESIDUALS_ACTIVE, ef->resInA);
+  MetricsExporter::set(METRIC_RESIDUALS_LINEARIZED, ef->resInL);
+  MetricsExporter::set(METRIC_RESIDUALS_MARGINALIZED, ef->resInM);
+}
+
 void FullSystem::printLogLine() {
   if (frameHessians.size() == 0) {
     return;
@@ -1242,115 +2071,98 @@ void FullSystem::printLogLine() {
     return;
   }
 
-  if (numsLog != 0) {
-    (*numsLog) << allKeyFramesHistory.back()->id << " "
-               << statistics_lastFineTrackRMSE << " "
-               << (int)statistics_numCreatedPoints << " "
-               << (int)statistics_numActivatedPoints << " "
-               << (int)statistics_numDroppedPoints << " "
-               << (int)statistics_lastNumOptIts << " " << ef->resInA << " "
-               << ef->resInL << " " << ef->resInM << " "
-               << statistics_numMargResFwd << " " << statistics_numMargResBwd
-               << " " << statistics_numForceDroppedResFwd << " "
-               << statistics_numForceDroppedResBwd << " "
-               << frameHessians.back()->aff_g2l().a << " "
-               << frameHessians.back()->aff_g2l().b << " "
-               << frameHessians.back()->shell->id -
-                      frameHessians.front()->shell->id
-               << " " << (int)frameHessians.size() << " "
-               << "\n";
-    numsLog->flush();
+  if (logSink != nullptr) {
+    logSink->write(
+        LOG_NUMS,
+        {static_cast<double>(allKeyFramesHistory.back()->id),
+         statistics_lastFineTrackRMSE,
+         static_cast<double>(statistics_numCreatedPoints),
+         static_cast<double>(statistics_numActivatedPoints),
+         static_cast<double>(statistics_numDroppedPoints),
+         static_cast<double>(statistics_lastNumOptIts),
+         static_cast<double>(ef->resInA), static_cast<double>(ef->resInL),
+         static_cast<double>(ef->resInM),
+         static_cast<double>(statistics_numMargResFwd),
+         static_cast<double>(statistics_numMargResBwd),
+         static_cast<double>(statistics_numForceDroppedResFwd),
+         static_cast<double>(statistics_numForceDroppedResBwd),
+         frameHessians.back()->aff_g2l().a, frameHessians.back()->aff_g2l().b,
+         static_cast<double>(frameHessians.back()->shell->id -
+                             frameHessians.front()->shell->id),
+         static_cast<double>(frameHessians.size())});
   }
 }
 
 void FullSystem::printEigenValLine() {
-  if (!setting_logStuff) {
+  if (logSink == nullptr) {
     return;
   }
   if (ef->lastHS.rows() < 12) {
     return;
   }
 
-  MatXX Hp = ef->lastHS.bottomRightCorner(ef->lastHS.cols() - CPARS,
-                                          ef->lastHS.cols() - CPARS);
-  MatXX Ha = ef->lastHS.bottomRightCorner(ef->lastHS.cols() - CPARS,
-                                          ef->lastHS.cols() - CPARS);
-  int n = Hp.cols() / 8;
-  assert(Hp.cols() % 8 == 0);
-
-  // sub-select
-  for (int i = 0; i < n; ++i) {
-    MatXX tmp6 = Hp.block(i * 8, 0, 6, n * 8);
-    Hp.block(i * 6, 0, 6, n * 8) = tmp6;
-
-    MatXX tmp2 = Ha.block(i * 8 + 6, 0, 2, n * 8);
-    Ha.block(i * 2, 0, 2, n * 8) = tmp2;
-  }
-  for (int i = 0; i < n; ++i) {
-    MatXX tmp6 = Hp.block(0, i * 8, n * 8, 6);
-    Hp.block(0, i * 6, n * 8, 6) = tmp6;
-
-    MatXX tmp2 = Ha.block(0, i * 8 + 6, n * 8, 2);
-    Ha.block(0, i * 2, n * 8, 2) = tmp2;
-  }
-
-  VecX eigenvaluesAll = ef->lastHS.eigenvalues().real();
-  VecX eigenP = Hp.topLeftCorner(n * 6, n * 6).eigenvalues().real();
-  VecX eigenA = Ha.topLeftCorner(n * 2, n * 2).eigenvalues().real();
-  VecX diagonal = ef->lastHS.diagonal();
-
-  std::sort(eigenvaluesAll.data(),
-            eigenvaluesAll.data() + eigenvaluesAll.size());
-  std::sort(eigenP.data(), eigenP.data() + eigenP.size());
-  std::sort(eigenA.data(), eigenA.data() + eigenA.size());
-
-  int nz = std::max(100, setting_maxFrames * 10);
-
-  if (eigenAllLog != 0) {
-    VecX ea = VecX::Zero(nz);
-    ea.head(eigenvaluesAll.size()) = eigenvaluesAll;
-    (*eigenAllLog) << allKeyFramesHistory.back()->id << " " << ea.transpose()
-                   << "\n";
-    eigenAllLog->flush();
-  }
-  if (eigenALog != 0) {
-    VecX ea = VecX::Zero(nz);
-    ea.head(eigenA.size()) = eigenA;
-    (*eigenALog) << allKeyFramesHistory.back()->id << " " << ea.transpose()
-                 << "\n";
-    eigenALog->flush();
-  }
-  if (eigenPLog != 0) {
-    VecX ea = VecX::Zero(nz);
-    ea.head(eigenP.size()) = eigenP;
-    (*eigenPLog) << allKeyFramesHistory.back()->id << " " << ea.transpose()
-                 << "\n";
-    eigenPLog->flush();
-  }
-
-  if (DiagonalLog != 0) {
-    VecX ea = VecX::Zero(nz);
-    ea.head(diagonal.size()) = diagonal;
-    (*DiagonalLog) << allKeyFramesHistory.back()->id << " " << ea.transpose()
-                   << "\n";
-    DiagonalLog->flush();
-  }
-
-  if (variancesLog != 0) {
-    VecX ea = VecX::Zero(nz);
-    ea.head(diagonal.size()) = ef->lastHS.inverse().diagonal();
-    (*variancesLog) << allKeyFramesHistory.back()->id << " " << ea.transpose()
-                    << "\n";
-    variancesLog->flush();
-  }
-
-  std::vector<VecX> &nsp = ef->lastNullspaces_forLogging;
-  (*nullspacesLog) << allKeyFramesHistory.back()->id << " ";
-  for (unsigned int i = 0; i < nsp.size(); ++i)
-    (*nullspacesLog) << nsp[i].dot(ef->lastHS * nsp[i]) << " "
-                     << nsp[i].dot(ef->lastbS) << " ";
-  (*nullspacesLog) << "\n";
-  nullspacesLog->flush();
+  // copied, the decompositions run on the log thread.
+  const double id = allKeyFramesHistory.back()->id;
+  const MatXX HS = ef->lastHS;
+  const VecX bS = ef->lastbS;
+  const std::vector<VecX> nsp = ef->lastNullspaces_forLogging;
+  LogSink* const sink = logSink;
+  const int maxFrames = settings.maxFrames;
+
+  logSink->defer([id, HS, bS, nsp, sink, maxFrames]() {
+    MatXX Hp = HS.bottomRightCorner(HS.cols() - CPARS, HS.cols() - CPARS);
+    MatXX Ha = HS.bottomRightCorner(HS.cols() - CPARS, HS.cols() - CPARS);
+    int n = Hp.cols() / 8;
+    assert(Hp.cols() % 8 == 0);
+
+    // sub-select
+    for (int i = 0; i < n; ++i) {
+      MatXX tmp6 = Hp.block(i * 8, 0, 6, n * 8);
+      Hp.block(i * 6, 0, 6, n * 8) = tmp6;
+
+      MatXX tmp2 = Ha.block(i * 8 + 6, 0, 2, n * 8);
+      Ha.block(i * 2, 0, 2, n * 8) = tmp2;
+    }
+    for (int i = 0; i < n; ++i) {
+      MatXX tmp6 = Hp.block(0, i * 8, n * 8, 6);
+      Hp.block(0, i * 6, n * 8, 6) = tmp6;
+
+      MatXX tmp2 = Ha.block(0, i * 8 + 6, n * 8, 2);
+      Ha.block(0, i * 2, n * 8, 2) = tmp2;
+    }
+
+    VecX eigenvaluesAll = HS.eigenvalues().real();
+    VecX eigenP = Hp.topLeftCorner(n * 6, n * 6).eigenvalues().real();
+    VecX eigenA = Ha.topLeftCorner(n * 2, n * 2).eigenvalues().real();
+    VecX diagonal = HS.diagonal();
+    VecX variances = HS.inverse().diagonal();
+
+    std::sort(eigenvaluesAll.data(),
+              eigenvaluesAll.data() + eigenvaluesAll.size());
+    std::sort(eigenP.data(), eigenP.data() + eigenP.size());
+    std::sort(eigenA.data(), eigenA.data() + eigenA.size());
+
+    // id, then the values zero padded to nz.
+    const int nz = std::max(100, maxFrames * 10);
+    auto writePadded = [&](const int stream, const VecX& values) {
+      VecX ea = VecX::Zero(nz + 1);
+      ea[0] = id;
+      ea.segment(1, values.size()) = values;
+      sink->write(stream, ea.data(), ea.size());
+    };
+    writePadded(LOG_EIGEN_ALL, eigenvaluesAll);
+    writePadded(LOG_EIGEN_A, eigenA);
+    writePadded(LOG_EIGEN_P, eigenP);
+    writePadded(LOG_DIAGONAL, diagonal);
+    writePadded(LOG_VARIANCES, variances);
+
+    std::vector<double> nullspaces(1, id);
+    for (unsigned int i = 0; i < nsp.size(); ++i) {
+      nullspaces.emplace_back(nsp[i].dot(HS * nsp[i]));
+      nullspaces.emplace_back(nsp[i].dot(bS));
+    }
+    sink->write(LOG_NULLSPACES, nullspaces.data(), nullspaces.size());
+  });
 }
 
 void FullSystem::printFrameLifetimes() {
@@ -1380,24 +2192,39 @@ void FullSystem::printEvalLine() { return; }
 
 FrameHessian *FullSystem::PreprocessNewFrame(ImageAndExposure *const image,
                                              const int id) {
-  // ============== add into allFrameHistory ==============
-  FrameHessian *fh = new FrameHessian();
+  FrameHessian *fh = preprocessFrame(image, id, false);
+  addToFrameHistory(fh);
+  return fh;
+}
+
+FrameHessian *FullSystem::preprocessFrame(const ImageAndExposure *image,
+                                          const int id, const bool ahead) {
+  ScopedStageTimer stageTimer(STAGE_PREPROCESS);
+  FrameHessian *fh = new FrameHessian(calib, settings);
   FrameShell *shell = new FrameShell();
 
   // no lock required, as fh is not used anywhere yet.
   shell->camToWorld = SE3();
   shell->aff_g2l = AffLight(0, 0);
-  shell->marginalizedAt = shell->id = allFrameHistory.size();
   shell->timestamp = image->timestamp;
   shell->incoming_id = id;
   fh->shell = shell;
-  allFrameHistory.emplace_back(shell);
 
   // ============== make Images / derivatives etc. ==============
+  // ahead, the tracking pool and the gpu may be busy with the tracker.
   fh->ab_exposure = image->exposure_time;
-  fh->makeImages(image->image, &Hcalib);
+  fh->makeImages(image->image, &Hcalib,
+                 !ahead && settings.multiThreading ? treadReduceTracking
+                                                   : nullptr,
+                 ahead ? nullptr : pyramidGPU);
 
   return fh;
 }
 
+void FullSystem::addToFrameHistory(FrameHessian *fh) {
+  // ============== add into allFrameHistory ==============
+  fh->shell->marginalizedAt = fh->shell->id = allFrameHistory.size();
+  allFrameHistory.emplace_back(fh->shell);
+}
+
 } // namespace dso
@@ -10,19 +10,18 @@
 #include "full_system/immature_point.h"
 #include "io_wrapper/image_display.h"
 #include "io_wrapper/image_rw.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
 
 namespace dso {
 
 void FullSystem::debugPlotTracking() {
-  if (disableAllDisplay) {
+  if (!IOWrap::canDisplay()) {
     return;
   }
   if (!setting_render_plotTrackingFull) {
     return;
   }
-  int wh = hG[0] * wG[0];
+  int wh = calib.h[0] * calib.w[0];
 
   int idx = 0;
   for (FrameHessian* f : frameHessians) {
@@ -32,7 +31,7 @@ void FullSystem::debugPlotTracking() {
     // destructor.
     for (FrameHessian* f2 : frameHessians) {
       if (f2->debugImage == 0) {
-        f2->debugImage = new MinimalImageB3(wG[0], hG[0]);
+        f2->debugImage = new MinimalImageB3(calib.w[0], calib.h[0]);
       }
     }
 
@@ -40,14 +39,12 @@ void FullSystem::debugPlotTracking() {
       MinimalImageB3* debugImage = f2->debugImage;
       images.emplace_back(debugImage);
 
-      Eigen::Vector3f* fd = f2->dI;
-
       Vec2 affL = AffLight::fromToVecExposure(f2->ab_exposure, f->ab_exposure,
                                               f2->aff_g2l(), f->aff_g2l());
 
       for (int i = 0; i < wh; ++i) {
         // BRIGHTNESS TRANSFER
-        float colL = affL[0] * fd[i][0] + affL[1];
+        float colL = affL[0] * f2->intensityAt(i) + affL[1];
         if (colL < 0) {
           colL = 0;
         }
@@ -80,7 +77,7 @@ void FullSystem::debugPlotTracking() {
 }
 
 void FullSystem::debugPlot(std::string name) {
-  if (disableAllDisplay) {
+  if (!IOWrap::canDisplay()) {
     return;
   }
   if (!setting_render_renderWindowFrames) {
@@ -140,15 +137,12 @@ void FullSystem::debugPlot(std::string name) {
     minIdJetVisDebug = minID;
   }
 
-  int wh = hG[0] * wG[0];
+  int wh = calib.h[0] * calib.w[0];
   for (unsigned int f = 0; f < frameHessians.size(); ++f) {
-    MinimalImageB3* img = new MinimalImageB3(wG[0], hG[0]);
+    MinimalImageB3* img = new MinimalImageB3(calib.w[0], calib.h[0]);
     images.emplace_back(img);
-    // float* fd = frameHessians[f]->I;
-    Eigen::Vector3f* fd = frameHessians[f]->dI;
-
     for (int i = 0; i < wh; ++i) {
-      int c = fd[i][0] * 0.9f;
+      int c = frameHessians[f]->intensityAt(i) * 0.9f;
       if (c > 255) {
         c = 255;
       }
@@ -309,11 +303,9 @@ void FullSystem::debugPlot(std::string name) {
 
   if ((debugSaveImages && false)) {
     for (unsigned int f = 0; f < frameHessians.size(); ++f) {
-      MinimalImageB3* img = new MinimalImageB3(wG[0], hG[0]);
-      Eigen::Vector3f* fd = frameHessians[f]->dI;
-
+      MinimalImageB3* img = new MinimalImageB3(calib.w[0], calib.h[0]);
       for (int i = 0; i < wh; ++i) {
-        int c = fd[i][0] * 0.9f;
+        int c = frameHessians[f]->intensityAt(i) * 0.9f;
         if (c > 255) {
           c = 255;
         }
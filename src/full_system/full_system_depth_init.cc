@@ -0,0 +1,162 @@
+#include "full_system/full_system.h"
+
+#include <math.h>
+#include <vector>
+
+#include "full_system/immature_point.h"
+#include "full_system/pixel_selector2.h"
+#include "full_system/tracker/coarse_tracker.h"
+#include "io_wrapper/output_3d_wrapper.h"
+#include "optimization_backend/energy_functional/energy_functional.h"
+#include "util/frame_shell.h"
+#include "util/image_and_exposure.h"
+#include "util/trace_recorder.h"
+
+namespace dso {
+
+namespace {
+
+inline bool validDepth(const float d) { return d > 0 && std::isfinite(d); }
+
+// depth at (u, v), else the nearest valid one within radius, 0 if none.
+float depthNear(const float* depth, const int w, const int h, const int u,
+                const int v, const int radius) {
+  if (validDepth(depth[u + v * w])) {
+    return depth[u + v * w];
+  }
+  float best = 0;
+  int bestDist = radius * radius + 1;
+  for (int dy = -radius; dy <= radius; ++dy) {
+    for (int dx = -radius; dx <= radius; ++dx) {
+      const int x = u + dx, y = v + dy;
+      const int dist = dx * dx + dy * dy;
+      if (x < 0 || y < 0 || x >= w || y >= h || dist >= bestDist ||
+          !validDepth(depth[x + y * w])) {
+        continue;
+      }
+      best = depth[x + y * w];
+      bestDist = dist;
+    }
+  }
+  return best;
+}
+
+}  // namespace
+
+bool FullSystem::initializeFromDepth(ImageAndExposure* image, const int id,
+                                     const float* depth) {
+  CHECK_NOTNULL(depth);
+  boost::unique_lock<boost::mutex> lock(trackMutex);
+  if (initialized) {
+    LOG(ERROR) << "initializeFromDepth: already initialized.";
+    return false;
+  }
+
+  FrameHessian* fh = PreprocessNewFrame(image, id);
+
+  // the pixels a keyframe would get, with the depth they have.
+  std::vector<PixelCandidate> candidates;
+  pixelSelector->allowFast = true;
+  pixelSelector->makeMaps(fh, &candidates, settings.desiredPointDensity, 1,
+                          false, 1,
+                          settings.multiThreading ? treadReduce : nullptr);
+  const int padding = staticPatternPadding[settings.pattern];
+  std::vector<std::pair<const PixelCandidate*, float>> seeds;
+  seeds.reserve(candidates.size());
+  for (const PixelCandidate& p : candidates) {
+    if (p.u < padding + 1 || p.u >= calib.w[0] - padding - 2 ||
+        p.v < padding + 1 || p.v >= calib.h[0] - padding - 2) {
+      continue;
+    }
+    const float d = depthNear(depth, calib.w[0], calib.h[0], p.u, p.v,
+                              settings.depthInitSearchRadius);
+    if (d > 0) {
+      seeds.emplace_back(&p, d);
+    }
+  }
+
+  if (static_cast<int>(seeds.size()) < settings.depthInitMinPoints) {
+    LOG(WARNING) << "initializeFromDepth: only " << seeds.size() << " of "
+                 << candidates.size() << " selected pixels have a depth, "
+                 << settings.depthInitMinPoints << " needed.";
+    fh->shell->poseValid = false;
+    delete fh;
+    return false;
+  }
+
+  boost::unique_lock<boost::mutex> mapLock = TracedLock(mapMutex, "mapMutex");
+  {
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
+    fh->shell->camToWorld = SE3();
+    fh->shell->aff_g2l = AffLight(0, 0);
+    fh->setEvalPT_scaled(fh->shell->camToWorld.inverse(), fh->shell->aff_g2l);
+    fh->shell->trackingRef = 0;
+    fh->shell->camToTrackingRef = SE3();
+  }
+
+  fh->idx = frameHessians.size();
+  frameHessians.emplace_back(fh);
+  fh->frameID = allKeyFramesHistory.size();
+  allKeyFramesHistory.emplace_back(fh->shell);
+  ef->insertFrame(fh, &Hcalib);
+  setPrecalcValues();
+
+  fh->pointHessians.reserve(seeds.size());
+  for (const std::pair<const PixelCandidate*, float>& seed : seeds) {
+    const PixelCandidate& p = *seed.first;
+    ImmaturePoint* pt = new ImmaturePoint(p.u, p.v, fh, p.type, &Hcalib);
+    if (!std::isfinite(pt->energyTH)) {
+      delete pt;
+      continue;
+    }
+
+    pt->idepth_max = pt->idepth_min = 1;
+    PointHessian* ph = new PointHessian(pt, &Hcalib);
+    delete pt;
+    if (!std::isfinite(ph->energyTH)) {
+      delete ph;
+      continue;
+    }
+
+    ph->setIdepth(1 / seed.second);
+    ph->setIdepthZero(ph->idepth);
+    ph->hasDepthPrior = true;
+    ph->setPointStatus(PointHessian::ACTIVE);
+
+    fh->pointHessians.emplace_back(ph);
+    ef->insertPoint(ph);
+  }
+  initialized = true;
+
+  // tracked against right away. There are no residuals into fh yet, so the
+  // reference is made from the points themselves.
+  std::vector<Vec3f> points;
+  points.reserve(fh->pointHessians.size());
+  for (const PointHessian* ph : fh->pointHessians) {
+    points.emplace_back(ph->u, ph->v, ph->idepth_scaled);
+  }
+  waitForTrackingReference();
+  coarseTracker_forNewKF->makeK(&Hcalib);
+  coarseTracker_forNewKF->splatCoarseTrackingRef(fh, points);
+  coarseTracker_forNewKF->finishCoarseTrackingRef(
+      settings.multiThreading ? treadReduce : nullptr);
+  publishTrackingReference();
+  if (settings.compactKeyframePyramid) {
+    fh->makeCompact();
+  } else if (settings.releaseKeyframePyramid) {
+    fh->releasePyramid();
+  }
+
+  touchWindowPoints();
+  for (IOWrap::Output3DWrapper* ow : outputWrapper) {
+    ow->publishGraph(ef->connectivityMap);
+    ow->publishKeyframes(frameHessians, false, &Hcalib);
+  }
+
+  LOG(INFO) << "INITIALIZE FROM DEPTH (" << fh->pointHessians.size()
+            << " pts)!";
+  return true;
+}
+
+}  // namespace dso
@@ -0,0 +1,90 @@
+#include "full_system/full_system.h"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "full_system/tracker/coarse_tracker.h"
+#include "optimization_backend/energy_functional/energy_functional.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+
+namespace {
+
+// another keyframe only takes over once it is this much closer than the
+// reference, so the reference does not flip between two equally close ones.
+constexpr double kLocalizationSwitchRatio = 0.8;
+
+// translation plus the rotation angle times sceneDepth, roughly how far the
+// scene moves in front of the camera.
+double poseDistance(const SE3& a, const SE3& b, const double sceneDepth) {
+  const SE3 aToB = a.inverse() * b;
+  return aToB.translation().norm() + aToB.so3().log().norm() * sceneDepth;
+}
+
+}  // namespace
+
+void FullSystem::startLocalization() {
+  std::vector<float> depths;
+  for (const FrameHessian* fh : frameHessians) {
+    for (const PointHessian* ph : fh->pointHessians) {
+      if (ph->idepth_scaled > 0) {
+        depths.emplace_back(1 / ph->idepth_scaled);
+      }
+    }
+  }
+  if (!depths.empty()) {
+    std::nth_element(depths.begin(), depths.begin() + depths.size() / 2,
+                     depths.end());
+    localizationSceneDepth = depths[depths.size() / 2];
+  }
+
+  // no residuals: nothing is linearized or optimized in this mode.
+  ef->makeIDX();
+  initialized = true;
+  if (!frameHessians.empty()) {
+    setLocalizationReference(frameHessians.back());
+  }
+  LOG(INFO) << "Localization on " << frameHessians.size()
+            << " keyframes, scene depth " << localizationSceneDepth << ".";
+}
+
+FrameHessian* FullSystem::selectLocalizationReference(
+    const SE3& camToWorld) const {
+  FrameHessian* const current = coarseTracker->lastRef;
+  FrameHessian* best = current;
+  double bestDistance =
+      current == nullptr
+          ? INFINITY
+          : kLocalizationSwitchRatio *
+                poseDistance(current->shell->camToWorld, camToWorld,
+                             localizationSceneDepth);
+  for (FrameHessian* kf : frameHessians) {
+    const double distance = poseDistance(kf->shell->camToWorld, camToWorld,
+                                         localizationSceneDepth);
+    if (distance < bestDistance) {
+      best = kf;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+void FullSystem::setLocalizationReference(FrameHessian* kf) {
+  std::vector<Vec3f> points;
+  points.reserve(kf->pointHessians.size());
+  for (const PointHessian* ph : kf->pointHessians) {
+    points.emplace_back(ph->u, ph->v, ph->idepth_scaled);
+  }
+  coarseTracker->makeK(&Hcalib);
+  coarseTracker->splatCoarseTrackingRef(kf, points);
+  coarseTracker->finishCoarseTrackingRef(
+      settings.multiThreading ? treadReduceTracking : nullptr);
+  if (!setting_debugout_runquiet) {
+    LOG(INFO) << "Tracking against keyframe " << kf->shell->incoming_id
+              << " (" << points.size() << " points).";
+  }
+}
+
+}  // namespace dso
@@ -14,15 +14,15 @@
 #include "io_wrapper/output_3d_wrapper.h"
 #include "optimization_backend/energy_functional/energy_functional.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
+#include "util/stage_timing.h"
 
 namespace dso {
 
 void FullSystem::flagFramesForMarginalization(FrameHessian* newFH) {
-  if (setting_minFrameAge > setting_maxFrames) {
-    for (size_t i = setting_maxFrames; i < frameHessians.size(); ++i) {
-      FrameHessian* fh = frameHessians[i - setting_maxFrames];
+  if (settings.minFrameAge > settings.maxFrames) {
+    for (size_t i = settings.maxFrames; i < frameHessians.size(); ++i) {
+      FrameHessian* fh = frameHessians[i - settings.maxFrames];
       fh->flaggedForMarginalization = true;
     }
     return;
@@ -40,35 +40,37 @@ void FullSystem::flagFramesForMarginalization(FrameHessian* newFH) {
         frameHessians.back()->ab_exposure, fh->ab_exposure,
         frameHessians.back()->aff_g2l(), fh->aff_g2l());
 
-    if ((in < setting_minPointsRemaining * (in + out) ||
-         fabs(logf((float)refToFh[0])) > setting_maxLogAffFacInWindow) &&
-        static_cast<int>(frameHessians.size()) - flagged > setting_minFrames) {
+    if ((in < settings.minPointsRemaining * (in + out) ||
+         fabs(logf((float)refToFh[0])) > settings.maxLogAffFacInWindow) &&
+        static_cast<int>(frameHessians.size()) - flagged > settings.minFrames) {
       fh->flaggedForMarginalization = true;
       ++flagged;
     }
   }
 
   // marginalize one.
-  if (static_cast<int>(frameHessians.size()) - flagged >= setting_maxFrames) {
+  if (static_cast<int>(frameHessians.size()) - flagged >= settings.maxFrames) {
     double smallestScore = 1;
     FrameHessian* toMarginalize = 0;
     FrameHessian* latest = frameHessians.back();
 
     for (FrameHessian* fh : frameHessians) {
-      if (fh->frameID > latest->frameID - setting_minFrameAge ||
+      if (fh->frameID > latest->frameID - settings.minFrameAge ||
           fh->frameID == 0) {
         continue;
       }
 
       double distScore = 0;
-      for (FrameFramePrecalc& ffh : fh->targetPrecalc) {
-        if (ffh.target->frameID > latest->frameID - setting_minFrameAge + 1 ||
+      for (size_t i = 0; i < frameHessians.size(); ++i) {
+        const FrameFramePrecalc& ffh = fh->targetPrecalc[i];
+        if (ffh.target->frameID > latest->frameID - settings.minFrameAge + 1 ||
             ffh.target == ffh.host) {
           continue;
         }
         distScore += 1 / (1e-5 + ffh.distanceLL);
       }
-      distScore *= -sqrtf(fh->targetPrecalc.back().distanceLL);
+      distScore *=
+          -sqrtf(fh->targetPrecalc[frameHessians.size() - 1].distanceLL);
 
       if (distScore < smallestScore) {
         smallestScore = distScore;
@@ -81,42 +83,29 @@ void FullSystem::flagFramesForMarginalization(FrameHessian* newFH) {
 }
 
 void FullSystem::marginalizeFrame(FrameHessian* frame) {
+  ScopedStageTimer stageTimer(STAGE_MARGINALIZE_FRAME);
   // marginalize or remove all this frames points.
 
   CHECK_EQ(frame->pointHessians.size(), 0);
 
-  ef->marginalizeFrame(frame->efFrame);
-
-  // drop all observations of existing points in that frame.
-
-  for (FrameHessian* fh : frameHessians) {
-    if (fh == frame) {
-      continue;
-    }
-
-    for (PointHessian* ph : fh->pointHessians) {
-      for (size_t i = 0; i < ph->residuals.size(); ++i) {
-        PointFrameResidual* r = ph->residuals[i];
-        if (r->target == frame) {
-          if (ph->lastResiduals[0].first == r) {
-            ph->lastResiduals[0].first = nullptr;
-          } else if (ph->lastResiduals[1].first == r) {
-            ph->lastResiduals[1].first = nullptr;
-          }
-
-          if (r->host->frameID < r->target->frameID) {
-            ++statistics_numForceDroppedResFwd;
-          } else {
-            ++statistics_numForceDroppedResBwd;
-          }
-
-          ef->dropResidual(r->efResidual);
-          deleteOut<PointFrameResidual>(ph->residuals, i);
-          break;
-        }
-      }
+  // drop all observations of existing points in that frame, before its
+  // EFFrame (their target) goes.
+  const std::vector<EFResidual*>& asTarget =
+      frame->efFrame->residualsAsTarget;
+  std::vector<PointFrameResidual*> toDrop;
+  toDrop.reserve(asTarget.size());
+  for (EFResidual* efr : asTarget) {
+    PointFrameResidual* r = efr->data;
+    if (r->host->frameID < r->target->frameID) {
+      ++statistics_numForceDroppedResFwd;
+    } else {
+      ++statistics_numForceDroppedResBwd;
     }
+    toDrop.emplace_back(r);
   }
+  dropResiduals(toDrop);
+
+  ef->marginalizeFrame(frame->efFrame);
 
   {
     std::vector<FrameHessian*> v;
@@ -128,6 +117,9 @@ void FullSystem::marginalizeFrame(FrameHessian* frame) {
 
   frame->shell->marginalizedAt = frameHessians.back()->shell->id;
   frame->shell->movedByOpt = frame->w2c_leftEps().norm();
+  if (relocIndex != nullptr) {
+    relocIndex->add(frame);
+  }
 
   deleteOutOrder<FrameHessian>(frameHessians, frame);
   for (size_t i = 0; i < frameHessians.size(); ++i) {
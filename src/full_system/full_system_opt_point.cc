@@ -11,7 +11,6 @@
 
 #include "full_system/immature_point.h"
 #include "io_wrapper/image_display.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
 
 namespace dso {
@@ -46,7 +45,7 @@ PointHessian* FullSystem::optimizeImmaturePoint(
     residuals[i].state_energy = residuals[i].state_NewEnergy;
   }
 
-  if (!std::isfinite(lastEnergy) || lastHdd < setting_minIdepthH_act) {
+  if (!std::isfinite(lastEnergy) || lastHdd < settings.minIdepthH_act) {
     if (print) {
       LOG(WARNING) << "OptPoint: Not well-constrained (" << nres
                    << " res, H=" << lastHdd << "). E=" << lastEnergy
@@ -62,7 +61,7 @@ PointHessian* FullSystem::optimizeImmaturePoint(
   }
 
   float lambda = 0.1;
-  for (int iteration = 0; iteration < setting_GNItsOnPointActivation;
+  for (int iteration = 0; iteration < settings.GNItsOnPointActivation;
        ++iteration) {
     float H = lastHdd;
     H *= 1 + lambda;
@@ -76,7 +75,7 @@ PointHessian* FullSystem::optimizeImmaturePoint(
       newEnergy += point->linearizeResidual(&Hcalib, 1, residuals + i, newHdd,
                                             newbd, newIdepth);
 
-    if (!std::isfinite(lastEnergy) || newHdd < setting_minIdepthH_act) {
+    if (!std::isfinite(lastEnergy) || newHdd < settings.minIdepthH_act) {
       if (print) {
         LOG(WARNING) << "OptPoint: Not well-constrained (" << nres
                      << " res, H=" << newHdd << "). E=" << lastEnergy
@@ -152,6 +151,7 @@ PointHessian* FullSystem::optimizeImmaturePoint(
   p->setIdepth(currentIdepth);
   p->setPointStatus(PointHessian::ACTIVE);
 
+  p->residuals.reserve(numGoodRes);
   for (int i = 0; i < nres; ++i)
     if (residuals[i].state_state == ResState::IN) {
       PointFrameResidual* r =
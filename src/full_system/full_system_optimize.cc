@@ -12,25 +12,53 @@
 #include "io_wrapper/image_display.h"
 #include "optimization_backend/energy_functional/energy_functional.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
+#include "util/stage_timing.h"
 
 namespace dso {
 
+bool FullSystem::canRelinLazily(const PointFrameResidual* const r) const {
+  if (!r->efResidual->isActiveAndIsGoodNEW) {
+    return false;  // no Jacobians to keep
+  }
+  const PointHessian* const p = r->point;
+  const Vec2f& hostStep = lazyFrameSteps[r->host->idx];
+  const Vec2f& targetStep = lazyFrameSteps[r->target->idx];
+  const float th =
+      settings.lazyRelinThreshold * 0.00005f * settings.thOptIterations;
+  const float idepth = fabsf(p->idepth);
+  // rotation, translation (times the inverse depth) and the relative inverse
+  // depth step, against the GN break threshold of doStepFromBackup.
+  return std::max(hostStep[0], targetStep[0]) < th &&
+         std::max(hostStep[1], targetStep[1]) * idepth < th &&
+         fabsf(p->step) < th * idepth;
+}
+
 void FullSystem::linearizeAll_Reductor(
-    const bool fixLinearization,
+    const bool fixLinearization, const bool lazy, const bool apply,
     std::vector<PointFrameResidual*>* const toRemove, const int min,
     const int max, Vec10* const stats, const int tid) {
+  ScopedStageTimer stageTimer(STAGE_LINEARIZE_REDUCTOR);
   CHECK_GE(min, 0);
   CHECK_LE(max, activeResiduals.size());
-  CHECK_LT(min, max);
+  CHECK_LE(min, max);
+  const FrameHessian* newFrame = frameHessians.back();
   for (int k = min; k < max; ++k) {
     PointFrameResidual* r = activeResiduals[k];
-    (*stats)[0] += r->linearize(&Hcalib);  // add the residual of this point
+    if (lazy && canRelinLazily(r)) {
+      (*stats)[0] += r->linearize(&Hcalib, false);
+      (*stats)[1] += 1;
+    } else {
+      (*stats)[0] += r->linearize(&Hcalib);  // add the residual of this point
+    }
+    if (r->target == newFrame && r->state_NewEnergyWithOutlier >= 0) {
+      allResVec[tid].emplace_back(r->state_NewEnergyWithOutlier);
+    }
 
-    if (fixLinearization) {
+    if (apply || fixLinearization) {
       r->applyRes(true);
-
+    }
+    if (fixLinearization) {
       if (r->efResidual->isActive()) {
         if (r->isNew) {
           PointHessian* p = r->point;
@@ -65,51 +93,52 @@ void FullSystem::linearizeAll_Reductor(
 
 void FullSystem::applyRes_Reductor(const bool copyJacobians, const int min,
                                    const int max, Vec10* stats, int tid) {
+  ScopedStageTimer stageTimer(STAGE_APPLY_RES);
   CHECK_GE(min, 0);
   CHECK_LE(max, activeResiduals.size());
-  CHECK_LT(min, max);
+  CHECK_LE(min, max);
   for (int k = min; k < max; ++k) {
     activeResiduals[k]->applyRes(true);
   }
 }
 
 void FullSystem::setNewFrameEnergyTH() {
-  // collect all residuals and make decision on TH.
-  allResVec.clear();
-  allResVec.reserve(activeResiduals.size() * 2);
+  // the energies of the active residuals into newFrame, as collected by the
+  // workers of the last linearizeAll_Reductor pass. The nth element does not
+  // depend on their order.
   FrameHessian* newFrame = frameHessians.back();
-
-  for (PointFrameResidual* r : activeResiduals) {
-    if (r->state_NewEnergyWithOutlier >= 0 && r->target == newFrame) {
-      allResVec.emplace_back(r->state_NewEnergyWithOutlier);
-    }
+  std::vector<float>& energies = allResVec[0];
+  for (int i = 1; i < NUM_THREADS; ++i) {
+    energies.insert(energies.end(), allResVec[i].begin(), allResVec[i].end());
   }
 
-  if (allResVec.size() == 0) {
+  if (energies.size() == 0) {
     // should never happen, but lets make sure.
-    newFrame->frameEnergyTH = 12 * 12 * patternNum;
+    newFrame->frameEnergyTH = 12 * 12 * staticPatternNum[settings.pattern];
     return;
   }
 
-  const int nthIdx = setting_frameEnergyTHN * allResVec.size();
+  const int nthIdx = settings.frameEnergyTHN * energies.size();
 
-  CHECK_LT(nthIdx, allResVec.size());
-  CHECK_LT(setting_frameEnergyTHN, 1);
+  CHECK_LT(nthIdx, energies.size());
+  CHECK_LT(settings.frameEnergyTHN, 1);
 
-  std::nth_element(allResVec.begin(), allResVec.begin() + nthIdx,
-                   allResVec.end());
-  const float nthElement = sqrtf(allResVec[nthIdx]);
+  std::nth_element(energies.begin(), energies.begin() + nthIdx,
+                   energies.end());
+  const float nthElement = sqrtf(energies[nthIdx]);
 
-  newFrame->frameEnergyTH = nthElement * setting_frameEnergyTHFacMedian;
+  newFrame->frameEnergyTH = nthElement * settings.frameEnergyTHFacMedian;
   newFrame->frameEnergyTH =
-      26.0f * setting_frameEnergyTHConstWeight +
-      newFrame->frameEnergyTH * (1 - setting_frameEnergyTHConstWeight);
+      26.0f * settings.frameEnergyTHConstWeight +
+      newFrame->frameEnergyTH * (1 - settings.frameEnergyTHConstWeight);
   newFrame->frameEnergyTH = newFrame->frameEnergyTH * newFrame->frameEnergyTH;
   newFrame->frameEnergyTH *=
-      setting_overallEnergyTHWeight * setting_overallEnergyTHWeight;
+      settings.overallEnergyTHWeight * settings.overallEnergyTHWeight;
 }
 
-Vec3 FullSystem::linearizeAll(const bool fixLinearization) {
+Vec3 FullSystem::linearizeAll(const bool fixLinearization,
+                              int* const numLazy, const bool applyRes) {
+  ScopedStageTimer stageTimer(STAGE_LINEARIZE_ALL);
   double lastEnergyP = 0;  // energy of all active points
   double lastEnergyR = 0;
   double num = 0;
@@ -119,18 +148,45 @@ Vec3 FullSystem::linearizeAll(const bool fixLinearization) {
   std::vector<PointFrameResidual*> toRemove[NUM_THREADS];
   for (int i = 0; i < NUM_THREADS; ++i) {
     toRemove[i].clear();
+    allResVec[i].clear();
+  }
+
+  // a calibration step moves every point, momentum steps are more than
+  // FrameHessian::step.
+  const float lazyTH =
+      settings.lazyRelinThreshold * 0.00005f * settings.thOptIterations;
+  const bool lazy =
+      numLazy != nullptr && !fixLinearization && lazyTH > 0 &&
+      !(settings.solverMode & SOLVER_MOMENTUM) &&
+      Hcalib.step.cwiseQuotient(Hcalib.value).lpNorm<Eigen::Infinity>() <
+          lazyTH;
+  if (lazy) {
+    lazyFrameSteps.resize(frameHessians.size());
+    for (FrameHessian* fh : frameHessians) {
+      lazyFrameSteps[fh->idx] = Vec2f(fh->step.segment<3>(3).norm(),
+                                      fh->step.segment<3>(0).norm());
+    }
   }
 
-  if (multiThreading) {
-    treadReduce.reduce(boost::bind(&FullSystem::linearizeAll_Reductor, this,
-                                   fixLinearization, toRemove, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4),
-                       0, activeResiduals.size(), 0);
-    lastEnergyP = treadReduce.stats[0];
+  double numLazyRes = 0;
+  if (settings.multiThreading) {
+    const Vec10 stats = treadReduce->reduce(
+        boost::bind(&FullSystem::linearizeAll_Reductor, this, fixLinearization,
+                    lazy, applyRes, toRemove, boost::placeholders::_1,
+                    boost::placeholders::_2, boost::placeholders::_3,
+                    boost::placeholders::_4),
+        0, activeResiduals.size(), 0);
+    lastEnergyP = stats[0];
+    numLazyRes = stats[1];
   } else {
-    Vec10 stats;
-    linearizeAll_Reductor(fixLinearization, toRemove, 0, activeResiduals.size(),
-                          &stats, 0);
+    Vec10 stats = Vec10::Zero();
+    linearizeAll_Reductor(fixLinearization, lazy, applyRes, toRemove, 0,
+                          activeResiduals.size(), &stats, 0);
     lastEnergyP = stats[0];
+    numLazyRes = stats[1];
+  }
+  if (numLazy != nullptr) {
+    *numLazy = static_cast<int>(numLazyRes);
   }
 
   setNewFrameEnergyTH();
@@ -145,26 +201,14 @@ Vec3 FullSystem::linearizeAll(const bool fixLinearization) {
       }
     }
 
-    int nResRemoved = 0;
-    for (int i = 0; i < NUM_THREADS; ++i) {
-      for (PointFrameResidual* r : toRemove[i]) {
-        PointHessian* ph = r->point;
-
-        if (ph->lastResiduals[0].first == r) {
-          ph->lastResiduals[0].first = 0;
-        } else if (ph->lastResiduals[1].first == r) {
-          ph->lastResiduals[1].first = 0;
-        }
-
-        for (unsigned int k = 0; k < ph->residuals.size(); ++k)
-          if (ph->residuals[k] == r) {
-            ef->dropResidual(r->efResidual);
-            deleteOut<PointFrameResidual>(ph->residuals, k);
-            ++nResRemoved;
-            break;
-          }
-      }
+    // with setting_deterministicReduce worker i runs the i-th chunk of the
+    // reduce above (stepSize 0, one chunk per worker), so this is the order
+    // of activeResiduals, the same as single threaded.
+    for (int i = 1; i < NUM_THREADS; ++i) {
+      toRemove[0].insert(toRemove[0].end(), toRemove[i].begin(),
+                         toRemove[i].end());
     }
+    dropResiduals(toRemove[0]);
   }
 
   return Vec3(lastEnergyP, lastEnergyR, num);
@@ -178,11 +222,9 @@ bool FullSystem::doStepFromBackup(float stepfacC, float stepfacT,
   pstepfac.segment<3>(3).setConstant(stepfacR);
   pstepfac.segment<4>(6).setConstant(stepfacA);
 
-  float sumA = 0, sumB = 0, sumT = 0, sumR = 0, sumID = 0, numID = 0;
+  float sumA = 0, sumB = 0, sumT = 0, sumR = 0;
 
-  float sumNID = 0;
-
-  if (setting_solverMode & SOLVER_MOMENTUM) {
+  if (settings.solverMode & SOLVER_MOMENTUM) {
     Hcalib.setValue(Hcalib.value_backup + Hcalib.step);
     for (FrameHessian* fh : frameHessians) {
       Vec10 step = fh->step;
@@ -193,16 +235,6 @@ bool FullSystem::doStepFromBackup(float stepfacC, float stepfacT,
       sumB += step[7] * step[7];
       sumT += step.segment<3>(0).squaredNorm();
       sumR += step.segment<3>(3).squaredNorm();
-
-      for (PointHessian* ph : fh->pointHessians) {
-        float step = ph->step + 0.5f * (ph->step_backup);
-        ph->setIdepth(ph->idepth_backup + step);
-        sumID += step * step;
-        sumNID += fabsf(ph->idepth_backup);
-        ++numID;
-
-        ph->setIdepthZero(ph->idepth_backup + step);
-      }
     }
   } else {
     Hcalib.setValue(Hcalib.value_backup + stepfacC * Hcalib.step);
@@ -212,45 +244,136 @@ bool FullSystem::doStepFromBackup(float stepfacC, float stepfacT,
       sumB += fh->step[7] * fh->step[7];
       sumT += fh->step.segment<3>(0).squaredNorm();
       sumR += fh->step.segment<3>(3).squaredNorm();
-
-      for (PointHessian* ph : fh->pointHessians) {
-        ph->setIdepth(ph->idepth_backup + stepfacD * ph->step);
-        sumID += ph->step * ph->step;
-        sumNID += fabsf(ph->idepth_backup);
-        ++numID;
-
-        ph->setIdepthZero(ph->idepth_backup + stepfacD * ph->step);
-      }
     }
   }
 
+  const Vec10 pointSums = forAllOptPoints(boost::bind(
+      &FullSystem::stepPoints_Reductor, this, stepfacD,
+      boost::placeholders::_1, boost::placeholders::_2,
+      boost::placeholders::_3, boost::placeholders::_4));
+  const float sumNID = pointSums[0] / pointSums[1];
+
   sumA /= frameHessians.size();
   sumB /= frameHessians.size();
   sumR /= frameHessians.size();
   sumT /= frameHessians.size();
-  sumID /= numID;
-  sumNID /= numID;
 
   if (!setting_debugout_runquiet) {
-    LOG(INFO) << "STEPS: A " << sqrtf(sumA) / (0.0005 * setting_thOptIterations)
-              << "; B " << sqrtf(sumB) / (0.00005 * setting_thOptIterations)
-              << "; R " << sqrtf(sumR) / (0.00005 * setting_thOptIterations)
+    LOG(INFO) << "STEPS: A "
+              << sqrtf(sumA) / (0.0005 * settings.thOptIterations)
+              << "; B " << sqrtf(sumB) / (0.00005 * settings.thOptIterations)
+              << "; R " << sqrtf(sumR) / (0.00005 * settings.thOptIterations)
               << "; T "
-              << sqrtf(sumT) * sumNID / (0.00005 * setting_thOptIterations)
+              << sqrtf(sumT) * sumNID / (0.00005 * settings.thOptIterations)
               << ".";
   }
 
   EFDeltaValid = false;
   setPrecalcValues();
 
-  return sqrtf(sumA) < 0.0005 * setting_thOptIterations &&
-         sqrtf(sumB) < 0.00005 * setting_thOptIterations &&
-         sqrtf(sumR) < 0.00005 * setting_thOptIterations &&
-         sqrtf(sumT) * sumNID < 0.00005 * setting_thOptIterations;
+  return sqrtf(sumA) < 0.0005 * settings.thOptIterations &&
+         sqrtf(sumB) < 0.00005 * settings.thOptIterations &&
+         sqrtf(sumR) < 0.00005 * settings.thOptIterations &&
+         sqrtf(sumT) * sumNID < 0.00005 * settings.thOptIterations;
+}
+
+float FullSystem::selectTrialStep(const float stepsize) {
+  // one Vec10 entry per candidate.
+  const int numTrials = std::min(settings.optTrialSteps, 10);
+  if (numTrials <= 1 || (settings.solverMode & SOLVER_MOMENTUM)) {
+    return stepsize;
+  }
+
+  std::vector<float> scales(numTrials);
+  trialPrecalc.resize(numTrials);
+  while (static_cast<int>(trialCalib.size()) < numTrials) {
+    trialCalib.emplace_back(new CalibHessian(calib));
+  }
+  for (int k = 0; k < numTrials; ++k) {
+    scales[k] = ldexpf(stepsize, -k);
+    Hcalib.setValue(Hcalib.value_backup + scales[k] * Hcalib.step);
+    for (FrameHessian* fh : frameHessians) {
+      fh->setState(fh->state_backup + scales[k] * fh->step);
+    }
+    updateFramePrecalc();
+    trialPrecalc[k] = framePrecalc;
+    trialCalib[k]->setValue(Hcalib.value);
+  }
+  // Hcalib and the frame states are left at the last candidate here; the
+  // doStepFromBackup with the returned scale is what finally sets them.
+
+  Vec10 energies = Vec10::Zero();
+  if (settings.multiThreading) {
+    energies = treadReduce->reduce(
+        boost::bind(&FullSystem::trialEnergy_Reductor, this, &scales,
+                    boost::placeholders::_1, boost::placeholders::_2,
+                    boost::placeholders::_3, boost::placeholders::_4),
+        0, activeResiduals.size(), 50);
+  } else {
+    trialEnergy_Reductor(&scales, 0, activeResiduals.size(), &energies, 0);
+  }
+
+  int best = 0;
+  for (int k = 1; k < numTrials; ++k) {
+    if (energies[k] < energies[best]) {
+      best = k;
+    }
+  }
+  if (!setting_debugout_runquiet) {
+    LOG(INFO) << "TRIAL STEPS: " << energies.head(numTrials).transpose()
+              << ", taking " << scales[best] << ".";
+  }
+  return scales[best];
+}
+
+void FullSystem::trialEnergy_Reductor(const std::vector<float>* const scales,
+                                      const int min, const int max,
+                                      Vec10* const stats, const int tid) {
+  const int n = frameHessians.size();
+  for (int k = min; k < max; ++k) {
+    const PointFrameResidual* r = activeResiduals[k];
+    const PointHessian* ph = r->point;
+    const int pair = r->host->idx * n + r->target->idx;
+    for (size_t c = 0; c < scales->size(); ++c) {
+      // as set by doStepFromBackup(..., stepfacD = (*scales)[c]).
+      const float idepth = ph->idepth_backup + (*scales)[c] * ph->step;
+      (*stats)[c] += r->evalEnergy(trialPrecalc[c][pair],
+                                   SCALE_IDEPTH * idepth, trialCalib[c].get());
+    }
+  }
+}
+
+void FullSystem::stepPoints_Reductor(const float stepfacD, const int min,
+                                     const int max, Vec10* const stats,
+                                     const int tid) {
+  const bool momentum = settings.solverMode & SOLVER_MOMENTUM;
+  float sumNID = 0;
+  for (int k = min; k < max; ++k) {
+    PointHessian* ph = optPoints[k];
+    const float step =
+        momentum ? ph->step + 0.5f * ph->step_backup : stepfacD * ph->step;
+    ph->setIdepth(ph->idepth_backup + step);
+    ph->setIdepthZero(ph->idepth_backup + step);
+    sumNID += fabsf(ph->idepth_backup);
+  }
+  (*stats)[0] += sumNID;
+  (*stats)[1] += max - min;
+}
+
+Vec10 FullSystem::forAllOptPoints(
+    const boost::function<void(int, int, Vec10*, int)>& fn) {
+  // plain loads and stores per point, only worth splitting when there are
+  // many.
+  if (settings.multiThreading) {
+    return treadReduce->reduce(fn, 0, optPoints.size(), 256);
+  }
+  Vec10 stats = Vec10::Zero();
+  fn(0, optPoints.size(), &stats, 0);
+  return stats;
 }
 
 void FullSystem::backupState(const bool backupLastStep) {
-  if (setting_solverMode & SOLVER_MOMENTUM) {
+  if (settings.solverMode & SOLVER_MOMENTUM) {
     // We never come into this part
     if (backupLastStep) {
       Hcalib.step_backup = Hcalib.step;
@@ -258,10 +381,6 @@ void FullSystem::backupState(const bool backupLastStep) {
       for (FrameHessian* fh : frameHessians) {
         fh->step_backup = fh->step;
         fh->state_backup = fh->get_state();
-        for (PointHessian* ph : fh->pointHessians) {
-          ph->idepth_backup = ph->idepth;
-          ph->step_backup = ph->step;
-        }
       }
     } else {
       Hcalib.step_backup.setZero();
@@ -269,10 +388,6 @@ void FullSystem::backupState(const bool backupLastStep) {
       for (FrameHessian* fh : frameHessians) {
         fh->step_backup.setZero();
         fh->state_backup = fh->get_state();
-        for (PointHessian* ph : fh->pointHessians) {
-          ph->idepth_backup = ph->idepth;
-          ph->step_backup = 0;
-        }
       }
     }
   } else {
@@ -280,9 +395,27 @@ void FullSystem::backupState(const bool backupLastStep) {
     Hcalib.value_backup = Hcalib.value;
     for (FrameHessian* fh : frameHessians) {
       fh->state_backup = fh->get_state();
-      for (PointHessian* ph : fh->pointHessians) {
-        ph->idepth_backup = ph->idepth;
-      }
+    }
+  }
+
+  forAllOptPoints(boost::bind(&FullSystem::backupPoints_Reductor, this,
+                              backupLastStep, boost::placeholders::_1,
+                              boost::placeholders::_2, boost::placeholders::_3,
+                              boost::placeholders::_4));
+}
+
+void FullSystem::backupPoints_Reductor(const bool backupLastStep,
+                                       const int min, const int max,
+                                       Vec10* const stats, const int tid) {
+  if (settings.solverMode & SOLVER_MOMENTUM) {
+    for (int k = min; k < max; ++k) {
+      PointHessian* ph = optPoints[k];
+      ph->idepth_backup = ph->idepth;
+      ph->step_backup = backupLastStep ? ph->step : 0;
+    }
+  } else {
+    for (int k = min; k < max; ++k) {
+      optPoints[k]->idepth_backup = optPoints[k]->idepth;
     }
   }
 }
@@ -291,18 +424,27 @@ void FullSystem::loadSateBackup() {
   Hcalib.setValue(Hcalib.value_backup);
   for (FrameHessian* fh : frameHessians) {
     fh->setState(fh->state_backup);
-    for (PointHessian* ph : fh->pointHessians) {
-      ph->setIdepth(ph->idepth_backup);
-      ph->setIdepthZero(ph->idepth_backup);
-    }
   }
+  forAllOptPoints(boost::bind(&FullSystem::loadPointBackup_Reductor, this,
+                              boost::placeholders::_1, boost::placeholders::_2,
+                              boost::placeholders::_3,
+                              boost::placeholders::_4));
 
   EFDeltaValid = false;
   setPrecalcValues();
 }
 
+void FullSystem::loadPointBackup_Reductor(const int min, const int max,
+                                          Vec10* const stats, const int tid) {
+  for (int k = min; k < max; ++k) {
+    PointHessian* ph = optPoints[k];
+    ph->setIdepth(ph->idepth_backup);
+    ph->setIdepthZero(ph->idepth_backup);
+  }
+}
+
 double FullSystem::calcLEnergy() {
-  if (setting_forceAceptStep) {
+  if (settings.forceAceptStep) {
     return 0;
   }
 
@@ -311,7 +453,7 @@ double FullSystem::calcLEnergy() {
 }
 
 double FullSystem::calcMEnergy() {
-  if (setting_forceAceptStep) {
+  if (settings.forceAceptStep) {
     return 0;
   }
   return ef->calcMEnergyF();
@@ -319,6 +461,7 @@ double FullSystem::calcMEnergy() {
 
 void FullSystem::printOptRes(const Vec3& res, double resL, double resM,
                              double resPrior, double LExact, float a, float b) {
+  const int patternNum = staticPatternNum[settings.pattern];
   LOG(INFO) << "A(" << res[0] << ")=(AV "
             << sqrtf((float)(res[0] / (patternNum * ef->resInA)))
             << "). Num: A(" << ef->resInA << ") + M(" << ef->resInM << "); ab "
@@ -326,6 +469,7 @@ void FullSystem::printOptRes(const Vec3& res, double resL, double resM,
 }
 
 float FullSystem::optimize(int mnumOptIts) {
+  ScopedStageTimer stageTimer(STAGE_OPTIMIZE);
   if (frameHessians.size() < 2) {
     return 0;
   } else if (frameHessians.size() < 3) {
@@ -336,10 +480,12 @@ float FullSystem::optimize(int mnumOptIts) {
 
   //----- Get statistics and active residuals -----//
   activeResiduals.clear();
+  optPoints.clear();
   int numPoints = 0;  // number of pointHessians
   int numLRes = 0;    // number of linearized PointFrameResiduals
   for (FrameHessian* fh : frameHessians) {
     for (PointHessian* ph : fh->pointHessians) {
+      optPoints.emplace_back(ph);
       for (PointFrameResidual* r : ph->residuals) {
         if (!r->efResidual->isLinearized) {
           activeResiduals.emplace_back(r);
@@ -359,19 +505,12 @@ float FullSystem::optimize(int mnumOptIts) {
   }
   // ------------------------------------------------
 
-  Vec3 lastEnergy = linearizeAll(false);
+  // applied in the same pass, while each residual is still in cache.
+  Vec3 lastEnergy = linearizeAll(false, nullptr, true);
 
   double lastEnergyL = calcLEnergy();  // always 0
   double lastEnergyM = calcMEnergy();  // always 0
 
-  if (multiThreading) {
-    treadReduce.reduce(
-        boost::bind(&FullSystem::applyRes_Reductor, this, true, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4),
-        0, activeResiduals.size(), 50);
-  } else {
-    applyRes_Reductor(true, 0, activeResiduals.size(), 0, 0);
-  }
-
   if (!setting_debugout_runquiet) {
     LOG(INFO) << "Initial Error";
     printOptRes(lastEnergy, lastEnergyL, lastEnergyM, 0, 0,
@@ -386,17 +525,29 @@ float FullSystem::optimize(int mnumOptIts) {
 
   // 4 + 8 * N (Note: 8 = pose+ (a, b))
   VecX previousX = VecX::Constant(CPARS + 8 * frameHessians.size(), NAN);
+  std::vector<OptIterationStats> optStats;
+  optStats.reserve(mnumOptIts);
+  double iterationsMs = 0;
+  const char* stopReason = "max. iterations";
   for (int iteration = 0; iteration < mnumOptIts; ++iteration) {
+    WallTimer iterationTimer, phaseTimer;
+    OptIterationStats stats;
+    stats.iteration = iteration;
+
     // solve!
     backupState(iteration != 0);
+    stats.applyMs = phaseTimer.elapsedMs();
     // solveSystemNew(0);
     solveSystem(iteration, lambda);
+    stats.accumulateMs = ef->lastAccumulateMs;
+    stats.solveMs = ef->lastSolveMs;
+    stats.stepNorm = ef->lastX.norm();
     double incDirChange = (1e-20 + previousX.dot(ef->lastX)) /
                           (1e-20 + previousX.norm() * ef->lastX.norm());
     previousX = ef->lastX;
 
     if (std::isfinite(incDirChange) &&
-        (setting_solverMode & SOLVER_STEPMOMENTUM)) {
+        (settings.solverMode & SOLVER_STEPMOMENTUM)) {
       float newStepsize = exp(incDirChange * 1.4);
       if (incDirChange < 0 && stepsize > 1) {
         stepsize = 1;
@@ -411,40 +562,56 @@ float FullSystem::optimize(int mnumOptIts) {
       }
     }
 
-    bool canbreak =
-        doStepFromBackup(stepsize, stepsize, stepsize, stepsize, stepsize);
+    phaseTimer.reset();
+    const float stepScale = selectTrialStep(stepsize);
+    stats.linearizeMs = phaseTimer.elapsedMs();
+
+    phaseTimer.reset();
+    bool canbreak = doStepFromBackup(stepScale, stepScale, stepScale,
+                                     stepScale, stepScale);
+    stats.applyMs += phaseTimer.elapsedMs();
 
     // eval new energy!
-    Vec3 newEnergy = linearizeAll(false);
+    phaseTimer.reset();
+    Vec3 newEnergy = linearizeAll(false, &stats.numLazyResiduals);
 
     double newEnergyL = calcLEnergy();  // always 0
     double newEnergyM = calcMEnergy();  // always 0
+    stats.linearizeMs += phaseTimer.elapsedMs();
+
+    const double newEnergyTotal =
+        newEnergy[0] + newEnergy[1] + newEnergyL + newEnergyM;
+    const double lastEnergyTotal =
+        lastEnergy[0] + lastEnergy[1] + lastEnergyL + lastEnergyM;
+    stats.energy = newEnergyTotal;
 
     if (!setting_debugout_runquiet) {
       const std::string status =
-          (newEnergy[0] + newEnergy[1] + newEnergyL + newEnergyM <
-           lastEnergy[0] + lastEnergy[1] + lastEnergyL + lastEnergyM)
-              ? "ACCEPT"
-              : "REJECT";
+          (newEnergyTotal < lastEnergyTotal) ? "ACCEPT" : "REJECT";
       LOG(INFO) << status << ", iteration: " << iteration
                 << ", log10(lambda): " << log10(lambda)
                 << ", incDirChange: " << incDirChange
-                << ", stepsize: " << stepsize << "): ";
+                << ", stepsize: " << stepScale
+                << ", solve residual: " << ef->lastSolveRelResidual
+                << ", lazy residuals: " << stats.numLazyResiduals << " / "
+                << activeResiduals.size() << "): ";
       printOptRes(newEnergy, newEnergyL, newEnergyM, 0, 0,
                   frameHessians.back()->aff_g2l().a,
                   frameHessians.back()->aff_g2l().b);
     }
 
-    if (setting_forceAceptStep ||
-        (newEnergy[0] + newEnergy[1] + newEnergyL + newEnergyM <
-         lastEnergy[0] + lastEnergy[1] + lastEnergyL + lastEnergyM)) {
-      if (multiThreading) {
-        treadReduce.reduce(boost::bind(&FullSystem::applyRes_Reductor, this,
+    phaseTimer.reset();
+    stats.accepted =
+        settings.forceAceptStep || newEnergyTotal < lastEnergyTotal;
+    if (stats.accepted) {
+      if (settings.multiThreading) {
+        treadReduce->reduce(boost::bind(&FullSystem::applyRes_Reductor, this,
                                        true, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4),
                            0, activeResiduals.size(), 50);
       } else {
         applyRes_Reductor(true, 0, activeResiduals.size(), 0, 0);
       }
+      stats.applyMs += phaseTimer.elapsedMs();
 
       lastEnergy = newEnergy;
       lastEnergyL = newEnergyL;
@@ -453,16 +620,63 @@ float FullSystem::optimize(int mnumOptIts) {
       lambda *= 0.25;
     } else {
       loadSateBackup();
-      lastEnergy = linearizeAll(false);
+      stats.applyMs += phaseTimer.elapsedMs();
+      phaseTimer.reset();
+      int numLazy = 0;
+      lastEnergy = linearizeAll(false, &numLazy);
+      stats.numLazyResiduals += numLazy;
 
       lastEnergyL = calcLEnergy();  // always 0
       lastEnergyM = calcMEnergy();  // always 0
+      stats.linearizeMs += phaseTimer.elapsedMs();
       lambda *= 1e2;
     }
 
-    if (canbreak && iteration >= setting_minOptIterations) {
+    optStats.emplace_back(stats);
+    iterationsMs += iterationTimer.elapsedMs();
+
+    if (iteration < settings.minOptIterations) {
+      continue;
+    }
+    if (canbreak) {
+      stopReason = "small step";
+      break;
+    }
+    // only count actual decreases, an increase gets lambda raised instead.
+    const double relEnergyDecrease =
+        (lastEnergyTotal - newEnergyTotal) / (1e-20 + lastEnergyTotal);
+    if (stats.accepted && relEnergyDecrease >= 0 &&
+        relEnergyDecrease < settings.minRelEnergyDecrease) {
+      stopReason = "small energy decrease";
       break;
     }
+    if (settings.keyframeTimeBudgetMs > 0 &&
+        keyframeTimer.elapsedMs() + iterationsMs / (iteration + 1) >
+            settings.keyframeTimeBudgetMs) {
+      stopReason = "keyframe time budget";
+      break;
+    }
+  }
+
+  statistics_lastNumOptIts = optStats.size();
+  if (!setting_debugout_runquiet) {
+    OptIterationStats sum{};
+    for (const OptIterationStats& stats : optStats) {
+      sum.linearizeMs += stats.linearizeMs;
+      sum.accumulateMs += stats.accumulateMs;
+      sum.solveMs += stats.solveMs;
+      sum.applyMs += stats.applyMs;
+      sum.numLazyResiduals += stats.numLazyResiduals;
+    }
+    LOG(INFO) << "OPTIMIZE done after " << optStats.size() << " iterations ("
+              << stopReason << "), ms: linearize " << sum.linearizeMs
+              << ", accumulate " << sum.accumulateMs << ", solve "
+              << sum.solveMs << ", apply " << sum.applyMs
+              << "; lazy residuals " << sum.numLazyResiduals;
+  }
+  {
+    boost::unique_lock<boost::mutex> lock(optStatsMutex);
+    lastOptStats.swap(optStats);
   }
 
   Vec10 newStateZero = Vec10::Zero();
@@ -480,25 +694,28 @@ float FullSystem::optimize(int mnumOptIts) {
   if (!std::isfinite(lastEnergy[0]) || !std::isfinite(lastEnergy[1]) ||
       !std::isfinite(lastEnergy[2])) {
     LOG(ERROR) << "KF Tracking failed: LOST!";
-    isLost = true;
+    setLost();
   }
 
+  const int patternNum = staticPatternNum[settings.pattern];
   statistics_lastFineTrackRMSE =
       sqrtf((float)(lastEnergy[0] / (patternNum * ef->resInA)));
 
-  if (calibLog != 0) {
-    (*calibLog) << Hcalib.value_scaled.transpose() << " "
-                << frameHessians.back()->get_state_scaled().transpose() << " "
-                << sqrtf((float)(lastEnergy[0] / (patternNum * ef->resInA)))
-                << " " << ef->resInM << "\n";
-    calibLog->flush();
+  if (logSink != nullptr) {
+    Eigen::Matrix<double, 16, 1> calib;
+    calib << Hcalib.value_scaled,
+        frameHessians.back()->get_state_scaled(),
+        statistics_lastFineTrackRMSE, static_cast<double>(ef->resInM);
+    logSink->write(LOG_CALIB, calib.data(), calib.size());
   }
 
   {
-    boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
     for (FrameHessian* fh : frameHessians) {
       fh->shell->camToWorld = fh->PRE_camToWorld;
       fh->shell->aff_g2l = fh->aff_g2l();
+      posePredictor.refine(fh->shell, fh->shell->camToWorld);
     }
   }
 
@@ -508,6 +725,7 @@ float FullSystem::optimize(int mnumOptIts) {
 }
 
 void FullSystem::solveSystem(int iteration, double lambda) {
+  ScopedStageTimer stageTimer(STAGE_SOLVE_SYSTEM);
   ef->lastNullspaces_forLogging =
       getNullspaces(ef->lastNullspaces_pose, ef->lastNullspaces_scale,
                     ef->lastNullspaces_affA, ef->lastNullspaces_affB);
@@ -527,16 +745,49 @@ void FullSystem::removeOutliers() {
       if (ph->residuals.empty()) {
         fh->pointHessiansOut.emplace_back(ph);
         ph->efPoint->stateFlag = EFPointStatus::PS_DROP;
-        fh->pointHessians[i] = fh->pointHessians.back();
-        fh->pointHessians.pop_back();
-        --i;
+        fh->pointHessians[i] = nullptr;
         ++numPointsDropped;
       }
     }
+    compactOutNull(fh->pointHessians);
   }
   ef->dropPointsF();
 }
 
+void FullSystem::dropResiduals(
+    const std::vector<PointFrameResidual*>& residuals) {
+  std::vector<EFResidual*> efResiduals;
+  std::vector<PointHessian*> points;
+  efResiduals.reserve(residuals.size());
+  points.reserve(residuals.size());
+  for (PointFrameResidual* r : residuals) {
+    PointHessian* ph = r->point;
+    if (ph->lastResiduals[0].first == r) {
+      ph->lastResiduals[0].first = nullptr;
+    } else if (ph->lastResiduals[1].first == r) {
+      ph->lastResiduals[1].first = nullptr;
+    }
+    efResiduals.emplace_back(r->efResidual);
+    points.emplace_back(ph);
+  }
+  ef->dropResiduals(efResiduals);
+
+  // the dropped residuals are the ones without efResidual now.
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  for (PointHessian* ph : points) {
+    size_t kept = 0;
+    for (PointFrameResidual* r : ph->residuals) {
+      if (r->efResidual == nullptr) {
+        delete r;
+      } else {
+        ph->residuals[kept++] = r;
+      }
+    }
+    ph->residuals.resize(kept);
+  }
+}
+
 std::vector<VecX> FullSystem::getNullspaces(
     std::vector<VecX>& nullspaces_pose, std::vector<VecX>& nullspaces_scale,
     std::vector<VecX>& nullspaces_affA, std::vector<VecX>& nullspaces_affB) {
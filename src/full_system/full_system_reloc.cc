@@ -0,0 +1,170 @@
+#include "full_system/full_system.h"
+
+#include <vector>
+
+#include "full_system/immature_point.h"
+#include "full_system/tracker/coarse_tracker.h"
+#include "optimization_backend/energy_functional/energy_functional.h"
+#include "util/frame_shell.h"
+#include "util/trace_recorder.h"
+
+namespace dso {
+
+bool FullSystem::relocalize(FrameHessian *fh) {
+  if (numRelocFrames++ == 0) {
+    relocStartTimestamp = fh->shell->timestamp;
+
+    // the window is given up, its keyframes are the most likely to be seen
+    // again.
+    waitForIdleMapper();
+    boost::unique_lock<boost::mutex> mapLock =
+        TracedLock(mapMutex, "mapMutex");
+    for (FrameHessian *kf : frameHessians) {
+      if (kf->shell->poseValid && kf->shell->camToWorld.matrix().allFinite()) {
+        relocIndex->add(kf);
+      }
+    }
+    clearWindow();
+    LOG(WARNING) << "Tracking lost, relocalizing on " << relocIndex->size()
+                 << " keyframes.";
+  }
+
+  const std::vector<RelocIndex::Match> matches = relocIndex->query(
+      fh, settings.relocCandidates, settings.relocMinScore);
+  std::vector<Vec3f> points;
+  for (const RelocIndex::Match &match : matches) {
+    const RelocIndex::Entry &entry = *match.second;
+    FrameHessian *kf = restoreKeyframe(entry);
+
+    points.clear();
+    points.reserve(entry.points.size());
+    for (const RelocIndex::Point &p : entry.points) {
+      points.emplace_back(p.u, p.v, p.idepthScaled);
+    }
+    coarseTracker->makeK(&Hcalib);
+    coarseTracker->splatCoarseTrackingRef(kf, points);
+    coarseTracker->finishCoarseTrackingRef(
+        settings.multiThreading ? treadReduceTracking : nullptr);
+
+    // the thumbnails matched, so start at the pose of the keyframe.
+    SE3 kfToFh;
+    AffLight aff_g2l = entry.aff_g2l;
+    const bool trackingIsGood = coarseTracker->trackNewestCoarse(
+        fh, kfToFh, aff_g2l, calib.pyrLevelsUsed - 1,
+        VecPyr::Constant(NAN));
+    const double rmse = coarseTracker->lastResiduals[0];
+    if (trackingIsGood && rmse < settings.relocMaxRMSE) {
+      LOG(WARNING) << "Relocalized frame " << fh->shell->incoming_id
+                   << " on keyframe " << entry.incomingId << " (score "
+                   << match.first << ", RMSE " << rmse << ") after "
+                   << numRelocFrames << " frames, "
+                   << fh->shell->timestamp - relocStartTimestamp << " s.";
+      // tracks the next frames until fh is the reference.
+      lastCoarseRMSE = coarseTracker->lastResiduals;
+      initializeFromRelocalization(kf, entry, fh, kfToFh, aff_g2l);
+      numRelocFrames = 0;
+      relocalizing = false;
+      return true;
+    }
+
+    if (!setting_debugout_runquiet) {
+      LOG(INFO) << "Relocalization on keyframe " << entry.incomingId
+                << " (score " << match.first << ") failed, RMSE " << rmse
+                << ".";
+    }
+    coarseTracker->lastRef = nullptr;
+    coarseTracker->refFrameID = -1;
+    delete kf->shell;
+    delete kf;
+  }
+
+  if (numRelocFrames >= settings.relocMaxFrames) {
+    LOG(ERROR) << "No relocalization within " << numRelocFrames
+               << " frames: LOST!";
+    isLost = true;
+  }
+  fh->shell->poseValid = false;
+  delete fh;
+  return false;
+}
+
+FrameHessian *FullSystem::restoreKeyframe(const RelocIndex::Entry &entry) {
+  FrameHessian *kf = new FrameHessian(calib, settings);
+  FrameShell *shell = new FrameShell();
+  shell->id = entry.id;
+  shell->incoming_id = entry.incomingId;
+  shell->timestamp = entry.timestamp;
+  shell->camToWorld = entry.camToWorld;
+  shell->aff_g2l = entry.aff_g2l;
+  kf->shell = shell;
+  kf->ab_exposure = entry.ab_exposure;
+
+  std::vector<float> image(calib.w[0] * calib.h[0]);
+  relocIndex->decodeImage(entry, image.data());
+  kf->makeImages(image.data(), &Hcalib,
+                 settings.multiThreading ? treadReduceTracking : nullptr,
+                 pyramidGPU);
+  kf->setEvalPT_scaled(entry.camToWorld.inverse(), entry.aff_g2l);
+  return kf;
+}
+
+void FullSystem::initializeFromRelocalization(FrameHessian *keyframe,
+                                              const RelocIndex::Entry &entry,
+                                              FrameHessian *newFrame,
+                                              const SE3 &keyframeToNew,
+                                              const AffLight &aff_g2l) {
+  boost::unique_lock<boost::mutex> lock = TracedLock(mapMutex, "mapMutex");
+
+  keyframe->idx = frameHessians.size();
+  frameHessians.emplace_back(keyframe);
+  keyframe->frameID = allKeyFramesHistory.size();
+  allKeyFramesHistory.emplace_back(keyframe->shell);
+  relocShells.emplace_back(keyframe->shell);
+  ef->insertFrame(keyframe, &Hcalib);
+  setPrecalcValues();
+
+  // the depths of the old map become priors, so the new window continues in
+  // its scale.
+  keyframe->pointHessians.reserve(entry.points.size());
+  for (const RelocIndex::Point &p : entry.points) {
+    ImmaturePoint *pt = new ImmaturePoint(p.u + 0.5f, p.v + 0.5f, keyframe,
+                                          p.type, &Hcalib);
+    if (!std::isfinite(pt->energyTH)) {
+      delete pt;
+      continue;
+    }
+
+    pt->idepth_max = pt->idepth_min = 1;
+    PointHessian *ph = new PointHessian(pt, &Hcalib);
+    delete pt;
+    if (!std::isfinite(ph->energyTH)) {
+      delete ph;
+      continue;
+    }
+
+    ph->setIdepthScaled(p.idepthScaled);
+    ph->setIdepthZero(ph->idepth);
+    ph->hasDepthPrior = true;
+    ph->setPointStatus(PointHessian::ACTIVE);
+
+    keyframe->pointHessians.emplace_back(ph);
+    ef->insertPoint(ph);
+  }
+
+  {
+    boost::unique_lock<boost::mutex> crlock =
+        TracedLock(shellPoseMutex, "shellPoseMutex");
+    newFrame->shell->camToWorld =
+        keyframe->shell->camToWorld * keyframeToNew.inverse();
+    newFrame->shell->aff_g2l = aff_g2l;
+    newFrame->setEvalPT_scaled(newFrame->shell->camToWorld.inverse(),
+                               newFrame->shell->aff_g2l);
+    newFrame->shell->trackingRef = keyframe->shell;
+    newFrame->shell->camToTrackingRef = keyframeToNew.inverse();
+  }
+
+  LOG(INFO) << "INITIALIZE FROM RELOCALIZATION ("
+            << keyframe->pointHessians.size() << " pts)!";
+}
+
+}  // namespace dso
@@ -0,0 +1,397 @@
+#include "full_system/full_system.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "full_system/immature_point.h"
+#include "full_system/map_snapshot.h"
+#include "full_system/tracker/coarse_tracker.h"
+#include "io_wrapper/output_3d_wrapper.h"
+#include "optimization_backend/energy_functional/energy_functional.h"
+#include "util/frame_shell.h"
+#include "util/wall_timer.h"
+
+namespace dso {
+
+namespace {
+
+inline size_t align8(const size_t offset) { return (offset + 7) & ~size_t(7); }
+
+void writeSE3(const SE3& T, double* out) {
+  const Eigen::Quaterniond q = T.unit_quaternion();
+  out[0] = q.x();
+  out[1] = q.y();
+  out[2] = q.z();
+  out[3] = q.w();
+  out[4] = T.translation().x();
+  out[5] = T.translation().y();
+  out[6] = T.translation().z();
+}
+
+SE3 readSE3(const double* in) {
+  return SE3(Eigen::Quaterniond(in[3], in[0], in[1], in[2]).normalized(),
+             Vec3(in[4], in[5], in[6]));
+}
+
+void writePadding(std::ofstream* out) {
+  static const char zeros[8] = {0};
+  const size_t pos = out->tellp();
+  out->write(zeros, align8(pos) - pos);
+}
+
+}  // namespace
+
+bool FullSystem::saveSnapshot(const std::string& path) {
+  boost::unique_lock<boost::mutex> lock(mapMutex);
+  if (!initialized || frameHessians.size() < 2) {
+    LOG(WARNING) << "No window to snapshot yet.";
+    return false;
+  }
+  WallTimer timer;
+
+  // written aside and renamed, a crash never leaves a partial snapshot.
+  const std::string tmpPath = path + ".tmp";
+  std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot write snapshot " << tmpPath;
+    return false;
+  }
+
+  MapSnapshot::Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MapSnapshot::kMagic, sizeof(header.magic));
+  header.version = MapSnapshot::kVersion;
+  header.width = calib.w[0];
+  header.height = calib.h[0];
+  header.numFrames = frameHessians.size();
+  header.hmSize = ef->HM.cols();
+  for (int i = 0; i < 4; ++i) {
+    header.calib[i] = Hcalib.value[i];
+    header.calibZero[i] = Hcalib.value_zero[i];
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(ef->HM.data()),
+            ef->HM.size() * sizeof(double));
+  out.write(reinterpret_cast<const char*>(ef->bM.data()),
+            ef->bM.size() * sizeof(double));
+
+  const int numPixels = calib.w[0] * calib.h[0];
+  std::vector<float> image(numPixels);
+  std::vector<MapSnapshot::Point> points;
+  std::vector<MapSnapshot::ImmaturePoint> immaturePoints;
+  for (FrameHessian* fh : frameHessians) {
+    MapSnapshot::Frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.incomingId = fh->shell->incoming_id;
+    frame.numPoints = fh->pointHessians.size();
+    frame.numImmaturePoints = fh->immaturePoints.size();
+    frame.abExposure = fh->ab_exposure;
+    frame.frameEnergyTH = fh->frameEnergyTH;
+    frame.timestamp = fh->shell->timestamp;
+    {
+      boost::unique_lock<boost::mutex> crlock(shellPoseMutex);
+      writeSE3(fh->shell->camToWorld, frame.camToWorld);
+      frame.affG2l[0] = fh->shell->aff_g2l.a;
+      frame.affG2l[1] = fh->shell->aff_g2l.b;
+    }
+    writeSE3(fh->get_worldToCam_evalPT(), frame.evalPT);
+    for (int i = 0; i < 10; ++i) {
+      frame.state[i] = fh->get_state()[i];
+      frame.stateZero[i] = fh->get_state_zero()[i];
+    }
+
+    for (int idx = 0; idx < numPixels; ++idx) {
+      image[idx] = fh->intensityAt(idx);
+    }
+
+    points.resize(fh->pointHessians.size());
+    for (size_t k = 0; k < fh->pointHessians.size(); ++k) {
+      const PointHessian* ph = fh->pointHessians[k];
+      points[k].u = ph->u;
+      points[k].v = ph->v;
+      points[k].myType = ph->my_type;
+      points[k].idepth = ph->idepth;
+      points[k].idepthZero = ph->idepth_zero;
+      points[k].idepthHessian = ph->idepth_hessian;
+      points[k].maxRelBaseline = ph->maxRelBaseline;
+      points[k].numGoodResiduals = ph->numGoodResiduals;
+      points[k].hasDepthPrior = ph->hasDepthPrior;
+    }
+
+    immaturePoints.resize(fh->immaturePoints.size());
+    for (size_t k = 0; k < fh->immaturePoints.size(); ++k) {
+      const ImmaturePoint* ip = fh->immaturePoints[k];
+      immaturePoints[k].u = ip->u;
+      immaturePoints[k].v = ip->v;
+      immaturePoints[k].myType = ip->my_type;
+      immaturePoints[k].idepthMin = ip->idepth_min;
+      immaturePoints[k].idepthMax = ip->idepth_max;
+      immaturePoints[k].quality = ip->quality;
+      immaturePoints[k].lastTraceStatus = ip->lastTraceStatus;
+    }
+
+    writePadding(&out);
+    out.write(reinterpret_cast<const char*>(&frame), sizeof(frame));
+    out.write(reinterpret_cast<const char*>(image.data()),
+              numPixels * sizeof(float));
+    out.write(reinterpret_cast<const char*>(points.data()),
+              points.size() * sizeof(MapSnapshot::Point));
+    out.write(reinterpret_cast<const char*>(immaturePoints.data()),
+              immaturePoints.size() * sizeof(MapSnapshot::ImmaturePoint));
+  }
+
+  out.close();
+  if (out.fail() || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    LOG(ERROR) << "Writing snapshot " << path << " failed";
+    return false;
+  }
+  LOG(INFO) << "Saved snapshot of " << frameHessians.size() << " keyframes ("
+            << ef->nPoints << " points) to " << path << " in "
+            << timer.elapsedMs() << " ms";
+  return true;
+}
+
+bool FullSystem::loadSnapshot(const std::string& path) {
+  CHECK(!initialized && allFrameHistory.empty())
+      << "Snapshots can only be loaded into a fresh FullSystem!";
+  WallTimer timer;
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(WARNING) << "No snapshot " << path;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(MapSnapshot::Header)) {
+    close(fd);
+    LOG(ERROR) << path << " is no snapshot!";
+    return false;
+  }
+  const size_t size = st.st_size;
+  // private and writable: the images are handed to makeImages as float*.
+  char* const data = static_cast<char*>(
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Cannot map snapshot " << path;
+    return false;
+  }
+
+  const MapSnapshot::Header* header =
+      reinterpret_cast<const MapSnapshot::Header*>(data);
+  const int numPixels = calib.w[0] * calib.h[0];
+
+  // check the whole layout before touching the system.
+  bool valid =
+      memcmp(header->magic, MapSnapshot::kMagic, sizeof(header->magic)) == 0 &&
+      header->version == MapSnapshot::kVersion &&
+      static_cast<int>(header->width) == calib.w[0] &&
+      static_cast<int>(header->height) == calib.h[0] &&
+      header->numFrames >= 2 &&
+      header->hmSize == 8 * header->numFrames + CPARS;
+  std::vector<size_t> frameOffsets;
+  size_t offset = sizeof(MapSnapshot::Header) +
+                  (header->hmSize + 1) * header->hmSize * sizeof(double);
+  for (uint32_t k = 0; valid && k < header->numFrames; ++k) {
+    offset = align8(offset);
+    if (offset + sizeof(MapSnapshot::Frame) > size) {
+      valid = false;
+      break;
+    }
+    const MapSnapshot::Frame* frame =
+        reinterpret_cast<const MapSnapshot::Frame*>(data + offset);
+    frameOffsets.emplace_back(offset);
+    offset += sizeof(MapSnapshot::Frame) + numPixels * sizeof(float) +
+              frame->numPoints * sizeof(MapSnapshot::Point) +
+              frame->numImmaturePoints * sizeof(MapSnapshot::ImmaturePoint);
+  }
+  if (!valid || offset > size) {
+    munmap(data, size);
+    LOG(ERROR) << path << " is no snapshot of version " << MapSnapshot::kVersion
+               << " for " << calib.w[0] << " x " << calib.h[0] << " images!";
+    return false;
+  }
+
+  boost::unique_lock<boost::mutex> lock(trackMutex);
+  boost::unique_lock<boost::mutex> mlock(mapMutex);
+
+  VecC calib, calibZero;
+  for (int i = 0; i < 4; ++i) {
+    calib[i] = header->calib[i];
+    calibZero[i] = header->calibZero[i];
+  }
+  Hcalib.value_zero = calibZero;
+  Hcalib.setValue(calib);
+
+  // ============== keyframes, in window order ==============
+  for (const size_t frameOffset : frameOffsets) {
+    const MapSnapshot::Frame* frame =
+        reinterpret_cast<const MapSnapshot::Frame*>(data + frameOffset);
+    float* const image = reinterpret_cast<float*>(
+        data + frameOffset + sizeof(MapSnapshot::Frame));
+
+    FrameShell* shell = new FrameShell();
+    shell->marginalizedAt = shell->id = allFrameHistory.size();
+    shell->incoming_id = frame->incomingId;
+    shell->timestamp = frame->timestamp;
+    shell->camToWorld = readSE3(frame->camToWorld);
+    shell->aff_g2l = AffLight(frame->affG2l[0], frame->affG2l[1]);
+    if (!allFrameHistory.empty()) {
+      shell->trackingRef = allFrameHistory.back();
+      shell->camToTrackingRef =
+          shell->trackingRef->camToWorld.inverse() * shell->camToWorld;
+    }
+    allFrameHistory.emplace_back(shell);
+
+    FrameHessian* fh = new FrameHessian(this->calib, settings);
+    fh->shell = shell;
+    fh->ab_exposure = frame->abExposure;
+    fh->frameEnergyTH = frame->frameEnergyTH;
+    fh->makeImages(image, &Hcalib,
+                   settings.multiThreading ? treadReduceTracking : nullptr);
+
+    Vec10 state, stateZero;
+    for (int i = 0; i < 10; ++i) {
+      state[i] = frame->state[i];
+      stateZero[i] = frame->stateZero[i];
+    }
+    fh->setEvalPT(readSE3(frame->evalPT), stateZero);
+    fh->setState(state);
+
+    fh->idx = frameHessians.size();
+    frameHessians.emplace_back(fh);
+    fh->frameID = allKeyFramesHistory.size();
+    allKeyFramesHistory.emplace_back(shell);
+    ef->insertFrame(fh, &Hcalib);
+  }
+  setPrecalcValues();
+
+  const double* hm = reinterpret_cast<const double*>(header + 1);
+  const int n = header->hmSize;
+  ef->HM = Eigen::Map<const MatXX>(hm, n, n);
+  ef->bM = Eigen::Map<const VecX>(hm + n * n, n);
+
+  // ============== points, colors and weights from the host image ==========
+  for (size_t k = 0; k < frameOffsets.size(); ++k) {
+    FrameHessian* fh = frameHessians[k];
+    const MapSnapshot::Frame* frame =
+        reinterpret_cast<const MapSnapshot::Frame*>(data + frameOffsets[k]);
+    const MapSnapshot::Point* points =
+        reinterpret_cast<const MapSnapshot::Point*>(
+            data + frameOffsets[k] + sizeof(MapSnapshot::Frame) +
+            numPixels * sizeof(float));
+    const MapSnapshot::ImmaturePoint* immaturePoints =
+        reinterpret_cast<const MapSnapshot::ImmaturePoint*>(points +
+                                                            frame->numPoints);
+
+    fh->pointHessians.reserve(frame->numPoints);
+    for (uint32_t i = 0; i < frame->numPoints; ++i) {
+      const MapSnapshot::Point& p = points[i];
+      ImmaturePoint* pt = new ImmaturePoint(p.u, p.v, fh, p.myType, &Hcalib);
+      if (!std::isfinite(pt->energyTH)) {
+        delete pt;
+        continue;
+      }
+      pt->idepth_max = pt->idepth_min = p.idepth;
+      PointHessian* ph = new PointHessian(pt, &Hcalib);
+      delete pt;
+      if (!std::isfinite(ph->energyTH)) {
+        delete ph;
+        continue;
+      }
+
+      ph->setIdepth(p.idepth);
+      ph->setIdepthZero(p.idepthZero);
+      ph->idepth_hessian = p.idepthHessian;
+      ph->maxRelBaseline = p.maxRelBaseline;
+      ph->numGoodResiduals = p.numGoodResiduals;
+      ph->hasDepthPrior = p.hasDepthPrior != 0;
+      ph->setPointStatus(PointHessian::ACTIVE);
+
+      fh->pointHessians.emplace_back(ph);
+      ef->insertPoint(ph);
+    }
+
+    fh->immaturePoints.reserve(frame->numImmaturePoints);
+    for (uint32_t i = 0; i < frame->numImmaturePoints; ++i) {
+      const MapSnapshot::ImmaturePoint& p = immaturePoints[i];
+      ImmaturePoint* pt = new ImmaturePoint(p.u, p.v, fh, p.myType, &Hcalib);
+      if (!std::isfinite(pt->energyTH)) {
+        delete pt;
+        continue;
+      }
+      pt->idepth_min = p.idepthMin;
+      pt->idepth_max = p.idepthMax;
+      pt->quality = p.quality;
+      pt->lastTraceStatus = static_cast<ImmaturePointStatus>(p.lastTraceStatus);
+      fh->immaturePoints.emplace_back(pt);
+    }
+  }
+  munmap(data, size);
+
+  float rmse = 0;
+  if (settings.localizationMode) {
+    startLocalization();
+  } else {
+    // ============== residuals to every other keyframe, in window order =====
+    for (FrameHessian* target : frameHessians) {
+      for (FrameHessian* host : frameHessians) {
+        if (host == target) {
+          continue;
+        }
+        for (PointHessian* ph : host->pointHessians) {
+          PointFrameResidual* r = new PointFrameResidual(ph, host, target);
+          r->setState(ResState::IN);
+          ph->residuals.emplace_back(r);
+          ef->insertResidual(r);
+          ph->lastResiduals[1] = ph->lastResiduals[0];
+          ph->lastResiduals[0] =
+              std::pair<PointFrameResidual*, ResState>(r, ResState::IN);
+        }
+      }
+    }
+    ef->makeIDX();
+    initialized = true;
+
+    // one window optimization relinearizes everything, from the converged
+    // state it stops after the minimum number of iterations.
+    rmse = optimize(settings.maxOptIterations);
+    removeOutliers();
+
+    // made right here, before any frame is compacted.
+    waitForTrackingReference();
+    coarseTracker_forNewKF->makeK(&Hcalib);
+    coarseTracker_forNewKF->setCoarseTrackingRef(
+        frameHessians, settings.multiThreading ? treadReduce : nullptr);
+    publishTrackingReference();
+    if (settings.compactKeyframePyramid) {
+      for (FrameHessian* fh : frameHessians) {
+        fh->makeCompact();
+      }
+    } else if (settings.releaseKeyframePyramid) {
+      for (FrameHessian* fh : frameHessians) {
+        fh->releasePyramid();
+      }
+    }
+  }
+
+  touchWindowPoints();
+  for (IOWrap::Output3DWrapper* ow : outputWrapper) {
+    ow->publishGraph(ef->connectivityMap);
+    ow->publishKeyframes(frameHessians, false, &Hcalib);
+  }
+
+  LOG(INFO) << "Resumed from snapshot " << path << ": "
+            << frameHessians.size() << " keyframes, " << ef->nPoints
+            << " points, rmse " << rmse << ", in " << timer.elapsedMs()
+            << " ms";
+  return true;
+}
+
+}  // namespace dso
@@ -0,0 +1,138 @@
+#include "full_system/full_system.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "full_system/window_points.h"
+#include "util/state_version.h"
+#include "util/trace_recorder.h"
+
+namespace dso {
+
+void FullSystem::touchWindowPoints() {
+  for (FrameHessian* fh : frameHessians) {
+    fh->pointsVersion = nextStateVersion();
+  }
+}
+
+bool FullSystem::snapshotWindowPoints(WindowPoints* const out) {
+  CHECK_NOTNULL(out);
+  boost::unique_lock<boost::mutex> lock = TracedLock(mapMutex, "mapMutex");
+
+  bool changed = out->keyframes.size() != frameHessians.size();
+  for (size_t i = 0; !changed && i < frameHessians.size(); ++i) {
+    changed = out->keyframes[i].frameID != frameHessians[i]->frameID ||
+              out->keyframes[i].generation != frameHessians[i]->pointsVersion;
+  }
+  if (!changed) {
+    return false;
+  }
+
+  // the new layout; a keyframe that is still there with the same generation
+  // is copied from where it was, the others are projected.
+  std::vector<WindowPoints::Keyframe> keyframes(frameHessians.size());
+  std::vector<int> oldIdx(frameHessians.size(), -1);
+  size_t total = 0;
+  for (size_t i = 0; i < frameHessians.size(); ++i) {
+    const FrameHessian* fh = frameHessians[i];
+    keyframes[i].frameID = fh->frameID;
+    keyframes[i].generation = fh->pointsVersion;
+    keyframes[i].first = total;
+    keyframes[i].num = fh->pointHessians.size();
+    total += keyframes[i].num;
+    for (size_t j = 0; j < out->keyframes.size(); ++j) {
+      if (out->keyframes[j].frameID == fh->frameID &&
+          out->keyframes[j].generation == fh->pointsVersion) {
+        oldIdx[i] = j;
+        break;
+      }
+    }
+  }
+
+  // the points to copy go to the spare arrays, out gets those of the fill
+  // before that.
+  const std::vector<WindowPoints::Keyframe> oldKeyframes = out->keyframes;
+  if (std::count(oldIdx.begin(), oldIdx.end(), -1) <
+      static_cast<long>(oldIdx.size())) {
+    if (!out->spare) {
+      out->spare.reset(new WindowPoints());
+    }
+    out->swapPoints(out->spare.get());
+  }
+  out->resize(total);
+
+  const float fxi = 1.f / Hcalib.fxl(), fyi = 1.f / Hcalib.fyl();
+  const float cxi = -Hcalib.cxl() * fxi, cyi = -Hcalib.cyl() * fyi;
+
+  // one job per keyframe to copy, and per up to 1024 points to project.
+  static const size_t kChunk = 1024;
+  struct Job {
+    int frame;
+    size_t first, num;
+  };
+  std::vector<Job> jobs;
+  for (size_t i = 0; i < frameHessians.size(); ++i) {
+    if (oldIdx[i] >= 0) {
+      jobs.push_back({static_cast<int>(i), 0, keyframes[i].num});
+      continue;
+    }
+    for (size_t first = 0; first < keyframes[i].num; first += kChunk) {
+      jobs.push_back({static_cast<int>(i), first,
+                      std::min(kChunk, keyframes[i].num - first)});
+    }
+  }
+
+  auto fill = [&](const int min, const int max, Vec10*, const int) {
+    for (int k = min; k < max; ++k) {
+      const Job& job = jobs[k];
+      const WindowPoints::Keyframe& kf = keyframes[job.frame];
+      const size_t dst = kf.first + job.first;
+      if (oldIdx[job.frame] >= 0) {
+        const WindowPoints& old = *out->spare;
+        const size_t src = oldKeyframes[oldIdx[job.frame]].first;
+        std::copy_n(old.x.begin() + src, job.num, out->x.begin() + dst);
+        std::copy_n(old.y.begin() + src, job.num, out->y.begin() + dst);
+        std::copy_n(old.z.begin() + src, job.num, out->z.begin() + dst);
+        std::copy_n(old.idepth.begin() + src, job.num,
+                    out->idepth.begin() + dst);
+        std::copy_n(old.idepthVar.begin() + src, job.num,
+                    out->idepthVar.begin() + dst);
+        std::copy_n(old.hostId.begin() + src, job.num,
+                    out->hostId.begin() + dst);
+        std::copy_n(old.color.begin() + src, job.num, out->color.begin() + dst);
+        continue;
+      }
+
+      const FrameHessian* host = frameHessians[job.frame];
+      const Mat33f R = host->PRE_camToWorldf.rotationMatrix();
+      const Vec3f t = host->PRE_camToWorldf.translation();
+      for (size_t i = 0; i < job.num; ++i) {
+        const PointHessian* ph = host->pointHessians[job.first + i];
+        const float depth = 1.f / ph->idepth_scaled;
+        const Vec3f ptWorld =
+            R * Vec3f((ph->u * fxi + cxi) * depth, (ph->v * fyi + cyi) * depth,
+                      depth) +
+            t;
+        out->x[dst + i] = ptWorld[0];
+        out->y[dst + i] = ptWorld[1];
+        out->z[dst + i] = ptWorld[2];
+        out->idepth[dst + i] = ph->idepth_scaled;
+        out->idepthVar[dst + i] = 1.f / (ph->idepth_hessian + 0.01f);
+        out->hostId[dst + i] = host->frameID;
+        out->color[dst + i] = static_cast<uint8_t>(
+            std::min(255.f, std::max(0.f, ph->color[0] + 0.5f)));
+      }
+    }
+  };
+  if (settings.multiThreading && total > kChunk) {
+    treadReduce->reduce(fill, 0, jobs.size(), 1);
+  } else {
+    fill(0, jobs.size(), nullptr, 0);
+  }
+
+  out->keyframes.swap(keyframes);
+  return true;
+}
+
+}  // namespace dso
@@ -9,6 +9,9 @@ void FrameFramePrecalc::set(FrameHessian* host, FrameHessian* target,
                             CalibHessian* HCalib) {
   this->host = host;
   this->target = target;
+  hostVersion = host->stateVersion;
+  targetVersion = target->stateVersion;
+  calibVersion = HCalib->valueVersion;
 
   // Tth: from host to target (linearized point x0)
   SE3 leftToLeft_0 =
@@ -26,14 +29,9 @@ void FrameFramePrecalc::set(FrameHessian* host, FrameHessian* target,
   PRE_tTll = (leftToLeft.translation()).cast<float>();
   distanceLL = leftToLeft.translation().norm();  // length of baseline
 
-  Mat33f K = Mat33f::Zero();
-  K(0, 0) = HCalib->fxl();
-  K(1, 1) = HCalib->fyl();
-  K(0, 2) = HCalib->cxl();
-  K(1, 2) = HCalib->cyl();
-  K(2, 2) = 1;
-  PRE_KRKiTll = K * PRE_RTll * K.inverse();
-  PRE_RKiTll = PRE_RTll * K.inverse();
+  const Mat33f& K = HCalib->getK();
+  PRE_RKiTll = PRE_RTll * HCalib->getKi();
+  PRE_KRKiTll = K * PRE_RKiTll;
   PRE_KtTll = K * PRE_tTll;
 
   PRE_aff_mode =
@@ -43,4 +41,13 @@ void FrameFramePrecalc::set(FrameHessian* host, FrameHessian* target,
   PRE_b0_mode = host->aff_g2l_0().b;
 }
 
+bool FrameFramePrecalc::isUpToDate(const FrameHessian* host,
+                                   const FrameHessian* target,
+                                   const CalibHessian* HCalib) const {
+  return this->host == host && this->target == target &&
+         hostVersion == host->stateVersion &&
+         targetVersion == target->stateVersion &&
+         calibVersion == HCalib->valueVersion;
+}
+
 }  // dso
\ No newline at end of file
@@ -1,12 +1,22 @@
 #include "full_system/hessian_blocks/frame_hessian.h"
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include <glog/logging.h>
 
 #include "full_system/hessian_blocks/calib_hessian.h"
 #include "full_system/hessian_blocks/frame_frame_pre_calc.h"
+#include "full_system/hessian_blocks/frame_pyramid_cuda.h"
 #include "full_system/hessian_blocks/point_hessian.h"
 #include "full_system/immature_point.h"
 #include "sophus/se3.hpp"
+#include "util/index_thread_reduce.h"
+
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
 
 namespace dso {
 
@@ -14,6 +24,8 @@ void FrameHessian::setStateZero(const Vec10& state_zero) {
   CHECK_LT(state_zero.head<6>().squaredNorm(), 1e-20);
 
   this->state_zero = state_zero;
+  stateVersion = nextStateVersion();
+  evalPTVersion = stateVersion;
 
   for (int i = 0; i < 6; ++i) {
     Vec6 eps;
@@ -70,45 +82,90 @@ void FrameHessian::release() {
   immaturePoints.clear();
 }
 
-void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
-  for (int i = 0; i < PYR_LEVELS_USED; ++i) {
-    dIp[i] = new Eigen::Vector3f[wG[i] * hG[i]];
-    absSquaredGrad[i] = new float[wG[i] * hG[i]];
-  }
-  dI = dIp[0];
+namespace {
 
-  // make d0
-  int w = wG[0];
-  int h = hG[0];
-  for (int i = 0; i < w * h; ++i) {
-    dI[i][0] = color[i];
-  }
+// 2x2 box filter of a planar wlm1 x 2*hl image into a planar wl x hl image.
+void downsampleRows(const float* src, float* dst, const int wl, const int hl,
+                    const int wlm1) {
+  for (int y = 0; y < hl; ++y) {
+    const float* r0 = src + 2 * y * wlm1;
+    const float* r1 = r0 + wlm1;
+    float* d = dst + y * wl;
 
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
-    int wl = wG[lvl], hl = hG[lvl];
+    int x = 0;
+#if defined(ENABLE_SSE)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for (; x + 4 <= wl; x += 4) {
+      const __m128 a0 = _mm_loadu_ps(r0 + 2 * x);
+      const __m128 a1 = _mm_loadu_ps(r0 + 2 * x + 4);
+      const __m128 b0 = _mm_loadu_ps(r1 + 2 * x);
+      const __m128 b1 = _mm_loadu_ps(r1 + 2 * x + 4);
 
-    Eigen::Vector3f* dI_l = dIp[lvl];
+      // same summation order as the scalar path, so results are identical.
+      __m128 sum = _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0));
+      sum = _mm_add_ps(sum, _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+      sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+      sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+      _mm_storeu_ps(d + x, _mm_mul_ps(quarter, sum));
+    }
+#endif
+    for (; x < wl; ++x) {
+      d[x] = 0.25f *
+             (r0[2 * x] + r0[2 * x + 1] + r1[2 * x] + r1[2 * x + 1]);
+    }
+  }
+}
 
-    float* dabs_l = absSquaredGrad[lvl];
+// Intensity, central-difference gradients and squared gradient norm of rows
+// [yMin, yMax) of a planar wl x hl image. The first and last row get zero
+// gradients.
+void makeGradientRows(const float* img, Eigen::Vector3f* dI_l, float* dabs_l,
+                      const int wl, const int hl, CalibHessian* HCalib,
+                      const bool gammaWeights, const int yMin, const int yMax,
+                      Vec10* stats, const int tid) {
 
-    if (lvl > 0) {
-      int lvlm1 = lvl - 1;
-      int wlm1 = wG[lvlm1];
-      Eigen::Vector3f* dI_lm = dIp[lvlm1];
-
-      for (int y = 0; y < hl; ++y)
-        for (int x = 0; x < wl; ++x) {
-          dI_l[x + y * wl][0] =
-              0.25f * (dI_lm[2 * x + 2 * y * wlm1][0] +
-                       dI_lm[2 * x + 1 + 2 * y * wlm1][0] +
-                       dI_lm[2 * x + 2 * y * wlm1 + wlm1][0] +
-                       dI_lm[2 * x + 1 + 2 * y * wlm1 + wlm1][0]);
-        }
+  for (int y = yMin; y < yMax; ++y) {
+    const int rowStart = y * wl;
+    const int rowEnd = rowStart + wl;
+
+    if (y == 0 || y == hl - 1) {
+      for (int idx = rowStart; idx < rowEnd; ++idx) {
+        dI_l[idx] = Eigen::Vector3f(img[idx], 0, 0);
+        dabs_l[idx] = 0;
+      }
+      continue;
     }
 
-    for (int idx = wl; idx < wl * (hl - 1); ++idx) {
-      float dx = 0.5f * (dI_l[idx + 1][0] - dI_l[idx - 1][0]);
-      float dy = 0.5f * (dI_l[idx + wl][0] - dI_l[idx - wl][0]);
+    // indices run over the flat image, i.e. the first and last pixel of a row
+    // see the neighbouring rows, exactly like the scalar version always did.
+    int idx = rowStart;
+#if defined(ENABLE_SSE)
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; idx + 4 <= rowEnd; idx += 4) {
+      __m128 dx = _mm_mul_ps(
+          half, _mm_sub_ps(_mm_loadu_ps(img + idx + 1), _mm_loadu_ps(img + idx - 1)));
+      __m128 dy = _mm_mul_ps(half, _mm_sub_ps(_mm_loadu_ps(img + idx + wl),
+                                              _mm_loadu_ps(img + idx - wl)));
+
+      // zero out nan / inf, the comparison is false for both.
+      dx = _mm_and_ps(dx, _mm_cmplt_ps(_mm_and_ps(dx, absMask), infinity));
+      dy = _mm_and_ps(dy, _mm_cmplt_ps(_mm_and_ps(dy, absMask), infinity));
+      _mm_storeu_ps(dabs_l + idx,
+                    _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+      float dxs[4], dys[4];
+      _mm_storeu_ps(dxs, dx);
+      _mm_storeu_ps(dys, dy);
+      for (int k = 0; k < 4; ++k) {
+        dI_l[idx + k] = Eigen::Vector3f(img[idx + k], dxs[k], dys[k]);
+      }
+    }
+#endif
+    for (; idx < rowEnd; ++idx) {
+      float dx = 0.5f * (img[idx + 1] - img[idx - 1]);
+      float dy = 0.5f * (img[idx + wl] - img[idx - wl]);
 
       if (!std::isfinite(dx)) {
         dx = 0;
@@ -117,13 +174,13 @@ void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
         dy = 0;
       }
 
-      dI_l[idx][1] = dx;
-      dI_l[idx][2] = dy;
-
+      dI_l[idx] = Eigen::Vector3f(img[idx], dx, dy);
       dabs_l[idx] = dx * dx + dy * dy;
+    }
 
-      if (setting_gammaWeightsPixelSelect == 1 && HCalib != 0) {
-        float gw = HCalib->getBGradOnly((float)(dI_l[idx][0]));
+    if (gammaWeights) {
+      for (idx = rowStart; idx < rowEnd; ++idx) {
+        const float gw = HCalib->getBGradOnly(img[idx]);
         dabs_l[idx] *= gw * gw;  // convert to gradient of original color space
                                  // (before removing response).
       }
@@ -131,32 +188,119 @@ void FrameHessian::makeImages(float* color, CalibHessian* HCalib) {
   }
 }
 
+}  // namespace
+
+void FrameHessian::makeImages(float* color, CalibHessian* HCalib,
+                              IndexThreadReduce<Vec10>* threadReduce,
+                              FramePyramidCuda* gpu) {
+  // every level is overwritten below, a recycled pyramid needs no clearing.
+  PyramidBufferPool::Acquire(*calib, dIp, absSquaredGrad);
+  dI = dIp[0];
+  const bool gammaWeights =
+      (settings->gammaWeightsPixelSelect == 1 && HCalib != 0);
+
+#if defined(HAS_CUDA)
+  if (gpu != nullptr) {
+    float* dIf[PYR_LEVELS];
+    for (int lvl = 0; lvl < calib->pyrLevelsUsed; ++lvl) {
+      dIf[lvl] = reinterpret_cast<float*>(dIp[lvl]);
+    }
+    gpu->make(color, gammaWeights ? HCalib->B : nullptr, dIf, absSquaredGrad);
+    return;
+  }
+#endif
+
+  // planar intensity of the current and the previous level, level 0 is the
+  // input itself.
+  std::vector<float> planar[2];
+  const float* img = color;
+
+  for (int lvl = 0; lvl < calib->pyrLevelsUsed; ++lvl) {
+    const int wl = calib->w[lvl], hl = calib->h[lvl];
+
+    if (lvl > 0) {
+      std::vector<float>& dst = planar[lvl % 2];
+      dst.resize(wl * hl);
+      downsampleRows(img, dst.data(), wl, hl, calib->w[lvl - 1]);
+      img = dst.data();
+    }
+
+    // only level 0 is big enough to be worth splitting into row bands.
+    if (lvl == 0 && threadReduce != nullptr) {
+      Eigen::Vector3f* dI_l = dIp[lvl];
+      float* dabs_l = absSquaredGrad[lvl];
+      threadReduce->reduce(
+          [=](int min, int max, Vec10* stats, int tid) {
+            makeGradientRows(img, dI_l, dabs_l, wl, hl, HCalib, gammaWeights,
+                             min, max, stats, tid);
+          },
+          0, hl, 32);
+    } else {
+      makeGradientRows(img, dIp[lvl], absSquaredGrad[lvl], wl, hl, HCalib,
+                       gammaWeights, 0, hl, nullptr, 0);
+    }
+  }
+}
+
+void FrameHessian::makeCompact() {
+  if (dICompact != nullptr) {
+    return;
+  }
+  CHECK_NOTNULL(dI);
+
+  const int wh = calib->w[0] * calib->h[0];
+  dICompact = new CompactPixel[wh];
+  compactMemory.set(wh * sizeof(CompactPixel));
+  for (int i = 0; i < wh; ++i) {
+    dICompact[i].set(dI[i]);
+  }
+
+  PyramidBufferPool::Release(*calib, dIp, absSquaredGrad);
+  delete[] dILevel0;
+  dILevel0 = nullptr;
+  level0Memory.set(0);
+  dI = nullptr;
+}
+
+void FrameHessian::releasePyramid() {
+  if (!hasPyramid()) {
+    return;
+  }
+
+  const int wh = calib->w[0] * calib->h[0];
+  dILevel0 = new Eigen::Vector3f[wh];
+  level0Memory.set(wh * sizeof(Eigen::Vector3f));
+  std::copy(dI, dI + wh, dILevel0);
+  dI = dILevel0;
+  PyramidBufferPool::Release(*calib, dIp, absSquaredGrad);
+}
+
 Vec10 FrameHessian::getPrior() {
   Vec10 p = Vec10::Zero();
   if (frameID == 0) {
-    p.head<3>() = Vec3::Constant(setting_initialTransPrior);
-    p.segment<3>(3) = Vec3::Constant(setting_initialRotPrior);
-    if (setting_solverMode & SOLVER_REMOVE_POSEPRIOR) {
+    p.head<3>() = Vec3::Constant(settings->initialTransPrior);
+    p.segment<3>(3) = Vec3::Constant(settings->initialRotPrior);
+    if (settings->solverMode & SOLVER_REMOVE_POSEPRIOR) {
       p.head<6>().setZero();
     }
 
-    p[6] = setting_initialAffAPrior;
-    p[7] = setting_initialAffBPrior;
+    p[6] = settings->initialAffAPrior;
+    p[7] = settings->initialAffBPrior;
   } else {
-    if (setting_affineOptModeA < 0) {
-      p[6] = setting_initialAffAPrior;
+    if (settings->affineOptModeA < 0) {
+      p[6] = settings->initialAffAPrior;
     } else {
-      p[6] = setting_affineOptModeA;
+      p[6] = settings->affineOptModeA;
     }
 
-    if (setting_affineOptModeB < 0) {
-      p[7] = setting_initialAffBPrior;
+    if (settings->affineOptModeB < 0) {
+      p[7] = settings->initialAffBPrior;
     } else {
-      p[7] = setting_affineOptModeB;
+      p[7] = settings->affineOptModeB;
     }
   }
-  p[8] = setting_initialAffAPrior;
-  p[9] = setting_initialAffBPrior;
+  p[8] = settings->initialAffAPrior;
+  p[9] = settings->initialAffBPrior;
   return p;
 }
 
@@ -0,0 +1,159 @@
+#include "full_system/hessian_blocks/frame_pyramid_cuda.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "util/cuda_check.h"
+
+namespace dso {
+
+namespace {
+
+const int kThreads = 256;
+
+//! downsampleRows of frame_hessian.cc, one pixel of level wl x hl per thread.
+__global__ void downsampleKernel(const float* __restrict__ src,
+                                 float* __restrict__ dst, int wl, int hl,
+                                 int wlm1) {
+  for (int idx = blockIdx.x * blockDim.x + threadIdx.x; idx < wl * hl;
+       idx += blockDim.x * gridDim.x) {
+    const int y = idx / wl;
+    const int x = idx - y * wl;
+    const float* r0 = src + 2 * y * wlm1;
+    const float* r1 = r0 + wlm1;
+    dst[idx] =
+        0.25f * (((r0[2 * x] + r0[2 * x + 1]) + r1[2 * x]) + r1[2 * x + 1]);
+  }
+}
+
+//! makeGradientRows of frame_hessian.cc, explicitly rounded so nvcc does not
+//! contract to fma.
+__global__ void gradientKernel(const float* __restrict__ img,
+                               float* __restrict__ dI,
+                               float* __restrict__ dabs,
+                               const float* __restrict__ B, int wl, int hl) {
+  for (int idx = blockIdx.x * blockDim.x + threadIdx.x; idx < wl * hl;
+       idx += blockDim.x * gridDim.x) {
+    const int y = idx / wl;
+    const float color = img[idx];
+    dI[3 * idx] = color;
+    if (y == 0 || y == hl - 1) {
+      dI[3 * idx + 1] = 0;
+      dI[3 * idx + 2] = 0;
+      dabs[idx] = 0;
+      continue;
+    }
+
+    // flat indices, the first and last pixel of a row see the neighbouring
+    // rows like on the CPU.
+    float dx = __fmul_rn(0.5f, img[idx + 1] - img[idx - 1]);
+    float dy = __fmul_rn(0.5f, img[idx + wl] - img[idx - wl]);
+    if (!isfinite(dx)) {
+      dx = 0;
+    }
+    if (!isfinite(dy)) {
+      dy = 0;
+    }
+    dI[3 * idx + 1] = dx;
+    dI[3 * idx + 2] = dy;
+
+    float g = __fadd_rn(__fmul_rn(dx, dx), __fmul_rn(dy, dy));
+    if (B != nullptr) {
+      // CalibHessian::getBGradOnly.
+      int c = color + 0.5f;
+      c = min(max(c, 5), 250);
+      const float gw = B[c + 1] - B[c];
+      g = __fmul_rn(g, __fmul_rn(gw, gw));
+    }
+    dabs[idx] = g;
+  }
+}
+
+}  // namespace
+
+struct FramePyramidCuda::Impl {
+  int levels;
+  std::vector<int> w, h;
+  // per level: the planar intensity, [intensity gx gy] and the squared
+  // gradient norm.
+  std::vector<float*> img, dI, dabs;
+  float* B;
+  cudaStream_t stream;
+  int maxBlocks;
+};
+
+FramePyramidCuda::FramePyramidCuda(const int* w, const int* h, int levels)
+    : impl(new Impl()) {
+  impl->levels = levels;
+  impl->w.assign(w, w + levels);
+  impl->h.assign(h, h + levels);
+  impl->img.assign(levels, nullptr);
+  impl->dI.assign(levels, nullptr);
+  impl->dabs.assign(levels, nullptr);
+  for (int lvl = 0; lvl < levels; ++lvl) {
+    const size_t wh = static_cast<size_t>(w[lvl]) * h[lvl];
+    CUDA_CHECK(cudaMalloc(&impl->img[lvl], wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->dI[lvl], 3 * wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->dabs[lvl], wh * sizeof(float)));
+  }
+  CUDA_CHECK(cudaMalloc(&impl->B, 256 * sizeof(float)));
+  CUDA_CHECK(cudaStreamCreate(&impl->stream));
+
+  int device, sms;
+  CUDA_CHECK(cudaGetDevice(&device));
+  CUDA_CHECK(
+      cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device));
+  impl->maxBlocks = 4 * sms;
+}
+
+FramePyramidCuda::~FramePyramidCuda() {
+  for (int lvl = 0; lvl < impl->levels; ++lvl) {
+    cudaFree(impl->img[lvl]);
+    cudaFree(impl->dI[lvl]);
+    cudaFree(impl->dabs[lvl]);
+  }
+  cudaFree(impl->B);
+  cudaStreamDestroy(impl->stream);
+  delete impl;
+}
+
+bool FramePyramidCuda::deviceAvailable() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+void FramePyramidCuda::make(const float* color, const float* B,
+                            float* const* dI, float* const* absSquaredGrad) {
+  CUDA_CHECK(cudaMemcpyAsync(impl->img[0], color,
+                             impl->w[0] * impl->h[0] * sizeof(float),
+                             cudaMemcpyHostToDevice, impl->stream));
+  if (B != nullptr) {
+    CUDA_CHECK(cudaMemcpyAsync(impl->B, B, 256 * sizeof(float),
+                               cudaMemcpyHostToDevice, impl->stream));
+  }
+
+  for (int lvl = 0; lvl < impl->levels; ++lvl) {
+    const int wl = impl->w[lvl], hl = impl->h[lvl];
+    const int blocks = std::max(
+        1, std::min(impl->maxBlocks, (wl * hl + kThreads - 1) / kThreads));
+    if (lvl > 0) {
+      downsampleKernel<<<blocks, kThreads, 0, impl->stream>>>(
+          impl->img[lvl - 1], impl->img[lvl], wl, hl, impl->w[lvl - 1]);
+      CUDA_CHECK(cudaGetLastError());
+    }
+    gradientKernel<<<blocks, kThreads, 0, impl->stream>>>(
+        impl->img[lvl], impl->dI[lvl], impl->dabs[lvl],
+        B != nullptr ? impl->B : nullptr, wl, hl);
+    CUDA_CHECK(cudaGetLastError());
+
+    CUDA_CHECK(cudaMemcpyAsync(dI[lvl], impl->dI[lvl],
+                               3 * wl * hl * sizeof(float),
+                               cudaMemcpyDeviceToHost, impl->stream));
+    CUDA_CHECK(cudaMemcpyAsync(absSquaredGrad[lvl], impl->dabs[lvl],
+                               wl * hl * sizeof(float),
+                               cudaMemcpyDeviceToHost, impl->stream));
+  }
+  CUDA_CHECK(cudaStreamSynchronize(impl->stream));
+}
+
+}  // dso
@@ -2,6 +2,7 @@
 
 #include <glog/logging.h>
 
+#include "full_system/hessian_blocks/frame_hessian.h"
 #include "full_system/immature_point.h"
 
 namespace dso {
@@ -27,7 +28,7 @@ PointHessian::PointHessian(const ImmaturePoint* const rawPoint,
   setIdepthScaled((rawPoint->idepth_max + rawPoint->idepth_min) * 0.5);
   setPointStatus(PointHessian::INACTIVE);
 
-  int n = patternNum;
+  int n = staticPatternNum[host->settings->pattern];
   memcpy(color, rawPoint->color, sizeof(float) * n);
   memcpy(weights, rawPoint->weights, sizeof(float) * n);
   energyTH = rawPoint->energyTH;
@@ -35,8 +36,16 @@ PointHessian::PointHessian(const ImmaturePoint* const rawPoint,
   efPoint = 0;
 }
 
+bool PointHessian::isInlierNew() const {
+  const Settings& settings = *host->settings;
+  return static_cast<int>(residuals.size()) >=
+             settings.minGoodActiveResForMarg &&
+         numGoodResiduals >= settings.minGoodResForMarg;
+}
+
 bool PointHessian::isOOB(const std::vector<FrameHessian*>& toKeep,
                          const std::vector<FrameHessian*>& toMarg) const {
+  const Settings& settings = *host->settings;
   int visInToMarg = 0;
   for (PointFrameResidual* r : residuals) {
     if (r->state_state != ResState::IN) {
@@ -48,10 +57,10 @@ bool PointHessian::isOOB(const std::vector<FrameHessian*>& toKeep,
       }
     }
   }
-  if (static_cast<int>(residuals.size()) >= setting_minGoodActiveResForMarg &&
-      numGoodResiduals > setting_minGoodResForMarg + 10 &&
+  if (static_cast<int>(residuals.size()) >= settings.minGoodActiveResForMarg &&
+      numGoodResiduals > settings.minGoodResForMarg + 10 &&
       static_cast<int>(residuals.size()) - visInToMarg <
-          setting_minGoodActiveResForMarg) {
+          settings.minGoodActiveResForMarg) {
     return true;
   }
 
@@ -2,8 +2,12 @@
 
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <limits>
+
 #include "full_system/residual_projections.h"
 #include "util/frame_shell.h"
+#include "util/residual_pattern.h"
 
 namespace dso {
 
@@ -16,13 +20,18 @@ ImmaturePoint::ImmaturePoint(int u_, int v_, FrameHessian* host_, float type,
       idepth_min(0),
       idepth_max(NAN),
       lastTraceStatus(IPS_UNINITIALIZED) {
+  const Settings& settings = *host->settings;
+  const CalibContext& calib = *host->calib;
+  const int patternNum = staticPatternNum[settings.pattern];
+  const int(*const pattern)[2] = staticPattern[settings.pattern];
   gradH.setZero();
 
   for (int idx = 0; idx < patternNum; ++idx) {
-    int dx = patternP[idx][0];
-    int dy = patternP[idx][1];
+    int dx = pattern[idx][0];
+    int dy = pattern[idx][1];
 
-    Vec3f ptc = getInterpolatedElement33BiLin(host->dI, u + dx, v + dy, wG[0]);
+    Vec3f ptc =
+        getInterpolatedElement33BiLin(host->dI, u + dx, v + dy, calib.w[0]);
 
     color[idx] = ptc[0];
     if (!std::isfinite(color[idx])) {
@@ -34,12 +43,12 @@ ImmaturePoint::ImmaturePoint(int u_, int v_, FrameHessian* host_, float type,
 
     // 梯度越大, weight越小(因为潜在误差越大)
     weights[idx] =
-        sqrtf(setting_outlierTHSumComponent /
-              (setting_outlierTHSumComponent + ptc.tail<2>().squaredNorm()));
+        sqrtf(settings.outlierTHSumComponent /
+              (settings.outlierTHSumComponent + ptc.tail<2>().squaredNorm()));
   }
 
-  energyTH = patternNum * setting_outlierTH;
-  energyTH *= setting_overallEnergyTHWeight * setting_overallEnergyTHWeight;
+  energyTH = patternNum * settings.outlierTH;
+  energyTH *= settings.overallEnergyTHWeight * settings.overallEnergyTHWeight;
 
   idepth_GT = 0;
   quality = 10000;
@@ -47,6 +56,102 @@ ImmaturePoint::ImmaturePoint(int u_, int v_, FrameHessian* host_, float type,
 
 ImmaturePoint::~ImmaturePoint() {}
 
+// huber energy of the pattern at (ptx, pty) in frame, 1e5 per sample outside.
+template <int kPattern>
+float ImmaturePoint::traceEnergy(const FrameHessian* frame, const float ptx,
+                                 const float pty, const float* patternDx,
+                                 const float* patternDy,
+                                 const Vec2f& hostToFrame_affine) const {
+#if DSO_AVX_DISPATCH
+  if (kPattern == 8 && useAVX2()) {
+    return traceEnergyAVX2(frame, ptx, pty, patternDx, patternDy,
+                           hostToFrame_affine);
+  }
+#endif
+
+  const CalibContext& calib = *host->calib;
+  const float huberTH = host->settings->huberTH;
+  float energy = 0;
+  for (int idx = 0; idx < ResidualPattern<kPattern>::num; ++idx) {
+    float hitColor = getInterpolatedElement31(
+        frame->dI, ptx + patternDx[idx], pty + patternDy[idx], calib.w[0]);
+
+    if (!std::isfinite(hitColor)) {
+      energy += 1e5;
+      continue;
+    }
+    float residual = hitColor - (hostToFrame_affine[0] * color[idx] +
+                                 hostToFrame_affine[1]);
+    float hw = fabs(residual) < huberTH ? 1 : huberTH / fabs(residual);
+    energy += hw * residual * residual * (2 - hw);
+  }
+  return energy;
+}
+
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX2 float ImmaturePoint::traceEnergyAVX2(
+    const FrameHessian* frame, const float ptx, const float pty,
+    const float* patternDx, const float* patternDy,
+    const Vec2f& hostToFrame_affine) const {
+  // one lane per pattern point.
+  const __m256 x =
+      _mm256_add_ps(_mm256_set1_ps(ptx), _mm256_load_ps(patternDx));
+  const __m256 y =
+      _mm256_add_ps(_mm256_set1_ps(pty), _mm256_load_ps(patternDy));
+  const __m256i ix = _mm256_cvttps_epi32(x);
+  const __m256i iy = _mm256_cvttps_epi32(y);
+  const __m256 dx = _mm256_sub_ps(x, _mm256_cvtepi32_ps(ix));
+  const __m256 dy = _mm256_sub_ps(y, _mm256_cvtepi32_ps(iy));
+  const __m256 dxdy = _mm256_mul_ps(dx, dy);
+  const __m256 one = _mm256_set1_ps(1);
+  const int wl = host->calib->w[0];
+  const __m256i base = _mm256_mullo_epi32(
+      _mm256_add_epi32(ix, _mm256_mullo_epi32(iy, _mm256_set1_epi32(wl))),
+      _mm256_set1_epi32(3));
+  const float* const img = reinterpret_cast<const float*>(frame->dI);
+
+  const __m256 hitColor = _mm256_add_ps(
+      _mm256_add_ps(
+          _mm256_add_ps(
+              _mm256_mul_ps(dxdy,
+                            _mm256_i32gather_ps(img + 3 * wl + 3, base, 4)),
+              _mm256_mul_ps(_mm256_sub_ps(dy, dxdy),
+                            _mm256_i32gather_ps(img + 3 * wl, base, 4))),
+          _mm256_mul_ps(_mm256_sub_ps(dx, dxdy),
+                        _mm256_i32gather_ps(img + 3, base, 4))),
+      _mm256_mul_ps(
+          _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(one, dx), dy), dxdy),
+          _mm256_i32gather_ps(img, base, 4)));
+
+  const __m256 residual = _mm256_sub_ps(
+      hitColor,
+      _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(hostToFrame_affine[0]),
+                                  _mm256_loadu_ps(color)),
+                    _mm256_set1_ps(hostToFrame_affine[1])));
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 absRes = _mm256_and_ps(residual, absMask);
+  const __m256 huberTH = _mm256_set1_ps(host->settings->huberTH);
+  const __m256 hw =
+      _mm256_blendv_ps(_mm256_div_ps(huberTH, absRes), one,
+                       _mm256_cmp_ps(absRes, huberTH, _CMP_LT_OQ));
+  __m256 energy = _mm256_mul_ps(
+      _mm256_mul_ps(_mm256_mul_ps(hw, residual), residual),
+      _mm256_sub_ps(_mm256_set1_ps(2), hw));
+
+  // non-finite samples cost 1e5 each.
+  const __m256 finite = _mm256_cmp_ps(
+      _mm256_and_ps(hitColor, absMask),
+      _mm256_set1_ps(std::numeric_limits<float>::infinity()), _CMP_LT_OQ);
+  energy = _mm256_blendv_ps(_mm256_set1_ps(1e5f), energy, finite);
+
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(energy),
+                        _mm256_extractf128_ps(energy, 1));
+  s = _mm_hadd_ps(s, s);
+  s = _mm_hadd_ps(s, s);
+  return _mm_cvtss_f32(s);
+}
+#endif
+
 /*
  * returns
  * * OOB -> Out of Bound, point is optimized and marginalized
@@ -59,14 +164,31 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
                                            const Vec2f& hostToFrame_affine,
                                            CalibHessian* HCalib,
                                            bool debugPrint) {
+  return withPattern(host->settings->pattern, [&](auto p) {
+    return traceOn<decltype(p)::value>(frame, hostToFrame_KRKi, hostToFrame_Kt,
+                                       hostToFrame_affine, HCalib, debugPrint);
+  });
+}
+
+template <int kPattern>
+ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
+                                           const Mat33f& hostToFrame_KRKi,
+                                           const Vec3f& hostToFrame_Kt,
+                                           const Vec2f& hostToFrame_affine,
+                                           CalibHessian* HCalib,
+                                           bool debugPrint) {
+  typedef ResidualPattern<kPattern> Pattern;
   if (lastTraceStatus == ImmaturePointStatus::IPS_OOB) {
     return lastTraceStatus;
   }
 
   debugPrint = false;  // rand()%100==0;
 
+  const Settings& settings = *host->settings;
+  const CalibContext& calib = *host->calib;
+
   // Max range of epipolar search
-  float maxPixSearch = (wG[0] + hG[0]) * setting_maxPixSearch;
+  float maxPixSearch = (calib.w[0] + calib.h[0]) * settings.maxPixSearch;
 
   if (debugPrint) {
     LOG(INFO) << "trace pt (" << u << " " << v << ") from frame "
@@ -84,7 +206,8 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   float uMin = ptpMin[0] / ptpMin[2];
   float vMin = ptpMin[1] / ptpMin[2];
 
-  if (!(uMin > 4 && vMin > 4 && uMin < wG[0] - 5 && vMin < hG[0] - 5)) {
+  if (!(uMin > 4 && vMin > 4 && uMin < calib.w[0] - 5 &&
+        vMin < calib.h[0] - 5)) {
     // Out of bound
     if (debugPrint) {
       LOG(INFO) << "OOB uMin " << u << " " << v << " - " << uMin << " " << vMin
@@ -105,7 +228,8 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     uMax = ptpMax[0] / ptpMax[2];
     vMax = ptpMax[1] / ptpMax[2];
 
-    if (!(uMax > 4 && vMax > 4 && uMax < wG[0] - 5 && vMax < hG[0] - 5)) {
+    if (!(uMax > 4 && vMax > 4 && uMax < calib.w[0] - 5 &&
+          vMax < calib.h[0] - 5)) {
       // Out of bound
       if (debugPrint) {
         LOG(INFO) << "OOB uMax  " << u << " " << v << " - " << uMax << " "
@@ -119,7 +243,7 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     // Check their distance. everything below 2px is OK (-> skip).
     dist = (uMin - uMax) * (uMin - uMax) + (vMin - vMax) * (vMin - vMax);
     dist = sqrtf(dist);
-    if (dist < setting_trace_slackInterval) {
+    if (dist < settings.trace_slackInterval) {
       if (debugPrint) {
         LOG(INFO) << "TOO CERTAIN ALREADY (dist " << dist << ")!";
       }
@@ -142,12 +266,13 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     float dy = vMax - vMin;
     float d = 1.0f / sqrtf(dx * dx + dy * dy);
 
-    // set to [setting_maxPixSearch].
+    // set to [settings.maxPixSearch].
     uMax = uMin + dist * dx * d;
     vMax = vMin + dist * dy * d;
 
     // may still be out!
-    if (!(uMax > 4 && vMax > 4 && uMax < wG[0] - 5 && vMax < hG[0] - 5)) {
+    if (!(uMax > 4 && vMax > 4 && uMax < calib.w[0] - 5 &&
+          vMax < calib.h[0] - 5)) {
       if (debugPrint) {
         LOG(INFO) << "OOB uMax-coarse " << uMax << " " << vMax << " "
                   << ptpMax[2] << "!";
@@ -173,8 +298,8 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
 
   // ============== Compute error-bounds on result in pixel. ==============
   // If the new interval is not at least 1/2 of the old, SKIP
-  float dx = setting_trace_stepsize * (uMax - uMin);
-  float dy = setting_trace_stepsize * (vMax - vMin);
+  float dx = settings.trace_stepsize * (uMax - uMin);
+  float dy = settings.trace_stepsize * (vMax - vMin);
 
   // a = (gx * dx + gy * dy)^2
   // gradient direction * epipolar line direction
@@ -190,7 +315,7 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   // --> error in pixel is big
   float errorInPixel = 0.2f + 0.2f * (a + b) / a;
 
-  if (errorInPixel * setting_trace_minImprovementFactor > dist &&
+  if (errorInPixel * settings.trace_minImprovementFactor > dist &&
       std::isfinite(idepth_max)) {
     if (debugPrint) {
       LOG(INFO) << "NO SIGNIFICANT IMPROVMENT (" << errorInPixel << ")!";
@@ -223,7 +348,7 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   }
 
   // Number of moving steps
-  int numSteps = 1.9999f + dist / setting_trace_stepsize;
+  int numSteps = 1.9999f + dist / settings.trace_stepsize;
   Mat22f Rplane = hostToFrame_KRKi.topLeftCorner<2, 2>();
 
   float randShift = uMin * 1000 - floorf(uMin * 1000);
@@ -231,8 +356,13 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
   float pty = vMin - randShift * dy;
 
   Vec2f rotatetPattern[MAX_RES_PER_POINT];
-  for (int idx = 0; idx < patternNum; ++idx) {
-    rotatetPattern[idx] = Rplane * Vec2f(patternP[idx][0], patternP[idx][1]);
+  EIGEN_ALIGN32 float patternDx[MAX_RES_PER_POINT];
+  EIGEN_ALIGN32 float patternDy[MAX_RES_PER_POINT];
+  for (int idx = 0; idx < Pattern::num; ++idx) {
+    rotatetPattern[idx] = Rplane * Vec2f(Pattern::offsets()[idx][0],
+                                         Pattern::offsets()[idx][1]);
+    patternDx[idx] = rotatetPattern[idx][0];
+    patternDy[idx] = rotatetPattern[idx][1];
   }
 
   if (!std::isfinite(dx) || !std::isfinite(dy)) {
@@ -248,46 +378,69 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
     numSteps = 99;
   }
 
-  for (int i = 0; i < numSteps; ++i) {
-    float energy = 0;
-    for (int idx = 0; idx < patternNum; ++idx) {
-      float hitColor =
-          getInterpolatedElement31(frame->dI, ptx + rotatetPattern[idx][0],
-                                   pty + rotatetPattern[idx][1], wG[0]);
-
-      if (!std::isfinite(hitColor)) {
-        energy += 1e5;
-        continue;
+  const int coarseStride = settings.trace_coarseStride;
+  if (coarseStride > 1 && numSteps > 4 * coarseStride) {
+    // long segment: score every coarseStride-th step, then all steps within
+    // one stride of the best one. steps never scored keep 1e10.
+    for (int i = 0; i < numSteps; ++i) {
+      errors[i] = 1e10;
+    }
+    int coarseIdx = 0;
+    float coarseEnergy = 1e10;
+    for (int i = 0; i < numSteps; i += coarseStride) {
+      errors[i] =
+          traceEnergy<kPattern>(frame, ptx + i * dx, pty + i * dy, patternDx,
+                                patternDy, hostToFrame_affine);
+      if (errors[i] < coarseEnergy) {
+        coarseEnergy = errors[i];
+        coarseIdx = i;
       }
-      float residual = hitColor - (hostToFrame_affine[0] * color[idx] +
-                                   hostToFrame_affine[1]);
-      float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH /
-                                                            fabs(residual);
-      energy += hw * residual * residual * (2 - hw);
     }
-
-    if (debugPrint) {
-      LOG(INFO) << "step " << ptx << " " << pty
-                << " (id 0): energy = " << energy << "!";
+    const int refineMin = std::max(0, coarseIdx - coarseStride + 1);
+    const int refineMax = std::min(numSteps - 1, coarseIdx + coarseStride - 1);
+    for (int i = refineMin; i <= refineMax; ++i) {
+      if (i % coarseStride != 0) {
+        errors[i] =
+            traceEnergy<kPattern>(frame, ptx + i * dx, pty + i * dy,
+                                  patternDx, patternDy, hostToFrame_affine);
+      }
     }
-
-    errors[i] = energy;
-    if (energy < bestEnergy) {
-      bestU = ptx;
-      bestV = pty;
-      bestEnergy = energy;
-      bestIdx = i;
+    for (int i = 0; i < numSteps; ++i) {
+      if (errors[i] < bestEnergy) {
+        bestU = ptx + i * dx;
+        bestV = pty + i * dy;
+        bestEnergy = errors[i];
+        bestIdx = i;
+      }
     }
+  } else {
+    for (int i = 0; i < numSteps; ++i) {
+      float energy = traceEnergy<kPattern>(frame, ptx, pty, patternDx,
+                                           patternDy, hostToFrame_affine);
 
-    ptx += dx;
-    pty += dy;
+      if (debugPrint) {
+        LOG(INFO) << "step " << ptx << " " << pty
+                  << " (id 0): energy = " << energy << "!";
+      }
+
+      errors[i] = energy;
+      if (energy < bestEnergy) {
+        bestU = ptx;
+        bestV = pty;
+        bestEnergy = energy;
+        bestIdx = i;
+      }
+
+      ptx += dx;
+      pty += dy;
+    }
   }
 
   // find best score outside a +-2px radius.
   float secondBest = 1e10;
   for (int i = 0; i < numSteps; ++i) {
-    if ((i < bestIdx - setting_minTraceTestRadius ||
-         i > bestIdx + setting_minTraceTestRadius) &&
+    if ((i < bestIdx - settings.minTraceTestRadius ||
+         i > bestIdx + settings.minTraceTestRadius) &&
         errors[i] < secondBest)
       secondBest = errors[i];
   }
@@ -298,16 +451,17 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
 
   // ============== do GN optimization ===================
   float uBak = bestU, vBak = bestV, gnstepsize = 1, stepBack = 0;
-  if (setting_trace_GNIterations > 0) {
+  if (settings.trace_GNIterations > 0) {
     bestEnergy = 1e5;
   }
   int gnStepsGood = 0, gnStepsBad = 0;
-  for (int it = 0; it < setting_trace_GNIterations; ++it) {
+  const float huberTH = settings.huberTH;
+  for (int it = 0; it < settings.trace_GNIterations; ++it) {
     float H = 1, b = 0, energy = 0;
-    for (int idx = 0; idx < patternNum; ++idx) {
+    for (int idx = 0; idx < Pattern::num; ++idx) {
       Vec3f hitColor =
           getInterpolatedElement33(frame->dI, bestU + rotatetPattern[idx][0],
-                                   bestV + rotatetPattern[idx][1], wG[0]);
+                                   bestV + rotatetPattern[idx][1], calib.w[0]);
 
       if (!std::isfinite(hitColor[0])) {
         energy += 1e5;
@@ -316,8 +470,7 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
       float residual = hitColor[0] - (hostToFrame_affine[0] * color[idx] +
                                       hostToFrame_affine[1]);
       float dResdDist = dx * hitColor[1] + dy * hitColor[2];
-      float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH /
-                                                            fabs(residual);
+      float hw = fabs(residual) < huberTH ? 1 : huberTH / fabs(residual);
 
       H += hw * dResdDist * dResdDist;
       b += hw * residual * dResdDist;
@@ -366,14 +519,14 @@ ImmaturePointStatus ImmaturePoint::traceOn(FrameHessian* frame,
       }
     }
 
-    if (fabsf(stepBack) < setting_trace_GNThreshold) {
+    if (fabsf(stepBack) < settings.trace_GNThreshold) {
       break;
     }
   }
 
   // ============== detect energy-based outlier. ===================
 
-  if (bestEnergy >= energyTH * setting_trace_extraSlackOnTH) {
+  if (bestEnergy >= energyTH * settings.trace_extraSlackOnTH) {
     if (debugPrint) {
       LOG(WARNING) << "OUTLIER!";
     }
@@ -441,31 +594,38 @@ float ImmaturePoint::calcResidual(CalibHessian* HCalib,
                                   const float outlierTHSlack,
                                   ImmaturePointTemporaryResidual* tmpRes,
                                   float idepth) {
+  const Settings& settings = *host->settings;
+  const int wl = host->calib->w[0];
   FrameFramePrecalc* precalc = &(host->targetPrecalc[tmpRes->target->idx]);
 
   float energyLeft = 0;
   const Eigen::Vector3f* dIl = tmpRes->target->dI;
+  const CompactPixel* dIlCompact = tmpRes->target->dICompact;
   const Mat33f& PRE_KRKiTll = precalc->PRE_KRKiTll;
   const Vec3f& PRE_KtTll = precalc->PRE_KtTll;
   Vec2f affLL = precalc->PRE_aff_mode;
+  const int(*const pattern)[2] = staticPattern[settings.pattern];
 
-  for (int idx = 0; idx < patternNum; ++idx) {
+  for (int idx = 0; idx < staticPatternNum[settings.pattern]; ++idx) {
     float Ku, Kv;
-    if (!projectPoint(this->u + patternP[idx][0], this->v + patternP[idx][1],
-                      idepth, PRE_KRKiTll, PRE_KtTll, &Ku, &Kv)) {
+    if (!projectPoint(this->u + pattern[idx][0], this->v + pattern[idx][1],
+                      idepth, PRE_KRKiTll, PRE_KtTll, *host->calib, &Ku,
+                      &Kv)) {
       return 1e10;
     }
 
-    Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+    Vec3f hitColor = dIlCompact != nullptr
+                         ? getInterpolatedElement33(dIlCompact, Ku, Kv, wl)
+                         : getInterpolatedElement33(dIl, Ku, Kv, wl);
     if (!std::isfinite((float)hitColor[0])) {
       return 1e10;
     }
     // if(benchmarkSpecialOption==5) hitColor =
-    // (getInterpolatedElement13BiCub(tmpRes->target->I, Ku, Kv, wG[0]));
+    // (getInterpolatedElement13BiCub(tmpRes->target->I, Ku, Kv, wl));
 
     float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
 
-    float hw = fabsf(residual) < setting_huberTH ? 1 : setting_huberTH /
+    float hw = fabsf(residual) < settings.huberTH ? 1 : settings.huberTH /
                                                            fabsf(residual);
     energyLeft +=
         weights[idx] * weights[idx] * hw * residual * residual * (2 - hw);
@@ -486,21 +646,25 @@ double ImmaturePoint::linearizeResidual(CalibHessian* HCalib,
     return tmpRes->state_energy;
   }
 
+  const Settings& settings = *host->settings;
+  const int wl = host->calib->w[0];
   FrameFramePrecalc* precalc = &(host->targetPrecalc[tmpRes->target->idx]);
 
   // check OOB due to scale angle change.
 
   float energyLeft = 0;
   const Eigen::Vector3f* dIl = tmpRes->target->dI;
+  const CompactPixel* dIlCompact = tmpRes->target->dICompact;
   const Mat33f& PRE_RTll = precalc->PRE_RTll;
   const Vec3f& PRE_tTll = precalc->PRE_tTll;
   // const float * const Il = tmpRes->target->I;
 
   Vec2f affLL = precalc->PRE_aff_mode;
+  const int(*const pattern)[2] = staticPattern[settings.pattern];
 
-  for (int idx = 0; idx < patternNum; ++idx) {
-    int dx = patternP[idx][0];
-    int dy = patternP[idx][1];
+  for (int idx = 0; idx < staticPatternNum[settings.pattern]; ++idx) {
+    int dx = pattern[idx][0];
+    int dy = pattern[idx][1];
 
     float drescale, u, v, new_idepth;
     float Ku, Kv;
@@ -513,7 +677,9 @@ double ImmaturePoint::linearizeResidual(CalibHessian* HCalib,
       return tmpRes->state_energy;
     }
 
-    Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
+    Vec3f hitColor = dIlCompact != nullptr
+                         ? getInterpolatedElement33(dIlCompact, Ku, Kv, wl)
+                         : getInterpolatedElement33(dIl, Ku, Kv, wl);
 
     if (!std::isfinite((float)hitColor[0])) {
       tmpRes->state_NewState = ResState::OOB;
@@ -521,7 +687,7 @@ double ImmaturePoint::linearizeResidual(CalibHessian* HCalib,
     }
     float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
 
-    float hw = fabsf(residual) < setting_huberTH ? 1 : setting_huberTH /
+    float hw = fabsf(residual) < settings.huberTH ? 1 : settings.huberTH /
                                                            fabsf(residual);
     energyLeft +=
         weights[idx] * weights[idx] * hw * residual * residual * (2 - hw);
@@ -8,6 +8,7 @@
 #include "full_system/pixel_selector2.h"
 #include "full_system/residuals.h"
 #include "util/nanoflann.h"
+#include "util/residual_pattern.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
 #include "SSE2NEON.h"
@@ -15,9 +16,30 @@
 
 namespace dso {
 
-CoarseInitializer::CoarseInitializer(int ww, int hh)
-    : thisToNext_aff(0, 0), thisToNext(SE3()) {
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+namespace {
+
+//! points per block of the sums over all points, fixed so that the result
+//! does not depend on the number of threads.
+const int kPointsPerBlock = 256;
+
+//! 4 values of an Eigen::Array<float, kNum, 1> at p, which is 16 byte aligned
+//! only if kNum is a multiple of 4.
+template <int kNum>
+inline __m128 loadPattern(const float* p) {
+  return kNum % 4 == 0 ? _mm_load_ps(p) : _mm_loadu_ps(p);
+}
+
+}  // namespace
+
+CoarseInitializer::CoarseInitializer(const CalibContext& calib,
+                                     const Settings& settings)
+    : thisToNext_aff(0, 0),
+      thisToNext(SE3()),
+      calib(calib),
+      settings(settings) {
+  const int ww = calib.w[0];
+  const int hh = calib.h[0];
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
     points[lvl] = 0;
     numPoints[lvl] = 0;
   }
@@ -26,6 +48,8 @@ CoarseInitializer::CoarseInitializer(int ww, int hh)
   JbBuffer_new = new Vec10f[ww * hh];
 
   frameID = -1;
+  snapped = false;
+  red = nullptr;
   fixAffine = true;
   printDebug = false;
 
@@ -35,7 +59,7 @@ CoarseInitializer::CoarseInitializer(int ww, int hh)
   wM.diagonal()[7] = SCALE_B;
 }
 CoarseInitializer::~CoarseInitializer() {
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
     if (points[lvl] != 0) {
       delete[] points[lvl];
     }
@@ -47,14 +71,20 @@ CoarseInitializer::~CoarseInitializer() {
 
 bool CoarseInitializer::trackFrame(
     FrameHessian* newFrameHessian,
-    std::vector<IOWrap::Output3DWrapper*>& wraps) {
+    std::vector<IOWrap::Output3DWrapper*>& wraps,
+    IndexThreadReduce<Vec10>* red) {
   newFrame = newFrameHessian;
+  this->red = red;
+  CHECK(firstFrame->hasPyramid())
+      << "pyramid of the first frame already released";
 
   for (IOWrap::Output3DWrapper* ow : wraps) {
-    ow->pushLiveFrame(newFrameHessian);
+    if (ow->capabilities() & IOWrap::Output3DWrapper::CAP_LIVE_FRAME) {
+      ow->pushLiveFrame(newFrameHessian);
+    }
   }
 
-  int maxIterations[] = {5, 5, 10, 30, 50};
+  const int maxIterations[PYR_LEVELS] = {5, 5, 10, 30, 50, 50, 50, 50};
 
   alphaK = 2.5 * 2.5;  //*freeDebugParam1*freeDebugParam1;
   alphaW = 150 * 150;  //*freeDebugParam2*freeDebugParam2;
@@ -63,7 +93,7 @@ bool CoarseInitializer::trackFrame(
 
   if (!snapped) {
     thisToNext.translation().setZero();  // 假设zero motion
-    for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+    for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
       int npts = numPoints[lvl];
       Pnt* ptsl = points[lvl];
       for (int i = 0; i < npts; ++i) {
@@ -87,8 +117,8 @@ bool CoarseInitializer::trackFrame(
   Vec3f latestRes = Vec3f::Zero();
 
   // coarse to fine optimization
-  for (int lvl = PYR_LEVELS_USED - 1; lvl >= 0; --lvl) {
-    if (lvl < PYR_LEVELS_USED - 1) {
+  for (int lvl = calib.pyrLevelsUsed - 1; lvl >= 0; --lvl) {
+    if (lvl < calib.pyrLevelsUsed - 1) {
       propagateDown(lvl + 1);
     }
 
@@ -228,7 +258,7 @@ bool CoarseInitializer::trackFrame(
   thisToNext_aff = refToNew_aff_current;
 
   // Propagate the result from bottom to up again
-  for (int i = 0; i < PYR_LEVELS_USED - 1; ++i) {
+  for (int i = 0; i < calib.pyrLevelsUsed - 1; ++i) {
     propagateUp(i);
   }
 
@@ -242,6 +272,7 @@ bool CoarseInitializer::trackFrame(
   }
 
   debugPlot(0, wraps);
+  this->red = nullptr;
 
   // After the first convergence, we need to successfully track 5 frames more
   return snapped && frameID > snappedAt + 5;
@@ -249,11 +280,8 @@ bool CoarseInitializer::trackFrame(
 
 void CoarseInitializer::debugPlot(
     int lvl, std::vector<IOWrap::Output3DWrapper*>& wraps) {
-  bool needCall = false;
-  for (IOWrap::Output3DWrapper* ow : wraps) {
-    needCall = needCall || ow->needPushDepthImage();
-  }
-  if (!needCall) {
+  if (!IOWrap::Output3DWrapper::anyCapable(
+          wraps, IOWrap::Output3DWrapper::CAP_DEPTH_IMAGE)) {
     return;
   }
 
@@ -291,7 +319,9 @@ void CoarseInitializer::debugPlot(
 
   // IOWrap::displayImage("idepth-R", &iRImg, false);
   for (IOWrap::Output3DWrapper* ow : wraps) {
-    ow->pushDepthImage(&iRImg);
+    if (ow->capabilities() & IOWrap::Output3DWrapper::CAP_DEPTH_IMAGE) {
+      ow->pushDepthImage(&iRImg);
+    }
   }
 }
 
@@ -299,12 +329,25 @@ Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out,
                                       Mat88f& H_out_sc, Vec8f& b_out_sc,
                                       const SE3& refToNew,
                                       AffLight refToNew_aff, bool plot) {
+  return withPattern(settings.pattern, [&](auto p) {
+    return calcResAndGS<decltype(p)::value>(lvl, H_out, b_out, H_out_sc,
+                                            b_out_sc, refToNew, refToNew_aff,
+                                            plot);
+  });
+}
+
+template <int kPattern>
+Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out,
+                                      Mat88f& H_out_sc, Vec8f& b_out_sc,
+                                      const SE3& refToNew,
+                                      AffLight refToNew_aff, bool plot) {
+  typedef ResidualPattern<kPattern> Pattern;
+  typedef Eigen::Array<float, Pattern::num, 1> PatternArray;
   int wl = w[lvl], hl = h[lvl];
 
-  // colorXxx[0]: intensity
-  // colorXxx[1]: gradient x (gx)
-  // colorXxx[2]: gradient y (gy)
-  Eigen::Vector3f* colorRef = firstFrame->dIp[lvl];
+  // colorNew[0]: intensity
+  // colorNew[1]: gradient x (gx)
+  // colorNew[2]: gradient y (gy), the reference is in Pnt::refColor.
   Eigen::Vector3f* colorNew = newFrame->dIp[lvl];
 
   // R * K^{-1}
@@ -323,176 +366,202 @@ Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out,
   float cxl = cx[lvl];
   float cyl = cy[lvl];
 
-  Accumulator11 E;
-  acc9.initialize();
-  E.initialize();
-
   int npts = numPoints[lvl];
   Pnt* ptsl = points[lvl];
-  for (int i = 0; i < npts; ++i) {
-    Pnt* point = ptsl + i;
-
-    point->maxstep = 1e10;
-    if (!point->isGood) {
-      E.updateSingle(point->energy[0]);
-      point->energy_new = point->energy;
-      point->isGood_new = false;
-      continue;
-    }
-
-    // dp0 - dp5: Derivative of residual wrt. se(3)
-    // dp6 - dp7: Derivative of residual wrt. [a b]
-    //        dd: Derivative of residual wrt. inverse depth
-    //         r: sum of single residuals
-    VecNRf dp0, dp1, dp2, dp3, dp4, dp5, dp6, dp7, dd;
-    VecNRf r;
-    JbBuffer_new[i].setZero();
-
-    // sum over all residuals through residual pattern.
-    bool isGood = true;
-    float energy = 0;  // total energy (cost)
-    for (int idx = 0; idx < patternNum; ++idx) {
-      int dx = patternP[idx][0];
-      int dy = patternP[idx][1];
-
-      // pt[2] = inv_d_ref / inv_d_new
-      Vec3f pt =
-          RKi * Vec3f(point->u + dx, point->v + dy, 1) + t * point->idepth_new;
-      float u = pt[0] / pt[2];
-      float v = pt[1] / pt[2];
-      float Ku = fxl * u + cxl;  // u in image new
-      float Kv = fyl * v + cyl;  // v in image new
-
-      // inverse depth wrt image new
-      float new_idepth = point->idepth_new / pt[2];
-
-      if (!(Ku > 1 && Kv > 1 && Ku < wl - 2 && Kv < hl - 2 && new_idepth > 0)) {
-        // If pixel not inside image or depth not positive, break the
-        // computation for this pixel
-        isGood = false;
-        break;
-      }
-      // interpolated [intensity gx gy] in image new
-      Vec3f hitColor = getInterpolatedElement33(colorNew, Ku, Kv, wl);
-      // Vec3f hitColor = getInterpolatedElement33BiCub(colorNew, Ku, Kv, wl);
-
-      // float rlR = colorRef[point->u+dx + (point->v+dy) * wl][0];
-
-      // interpolated [intensity] in image ref
-      float rlR =
-          getInterpolatedElement31(colorRef, point->u + dx, point->v + dy, wl);
-
-      if (!std::isfinite(rlR) || !std::isfinite((float)hitColor[0])) {
-        isGood = false;
-        break;
-      }
-
-      // Photometric error
-      // Note: Here is slightly different from the one in paper.
-      // Here, we merge four coefficients into two.
-      // e = I2 - (e^a * I + b)
-      float residual = hitColor[0] - r2new_aff[0] * rlR - r2new_aff[1];
-
-      // Huber kernel for a robust estimation
-      float hw = fabs(residual) < setting_huberTH ? 1 : setting_huberTH /
-                                                            fabs(residual);
-      energy += hw * residual * residual * (2 - hw);
-
-      // (Tong) Note: I would prefer the following formulation, which makes more
-      // sense
-      // hw = hw * (2 - hw);
-      // energy += hw * residual * residual;
-      if (hw < 1) {
-        // If smaller than 1, it means residual is too large, and Huber works
-        hw = sqrtf(hw);
-      }
-
-      float dxdd = (t[0] - t[2] * u) / pt[2];
-      float dydd = (t[1] - t[2] * v) / pt[2];
-      float dxInterp = hw * hitColor[1] * fxl;
-      float dyInterp = hw * hitColor[2] * fyl;
-      dp0[idx] = new_idepth * dxInterp;
-      dp1[idx] = new_idepth * dyInterp;
-      dp2[idx] = -new_idepth * (u * dxInterp + v * dyInterp);
-
-      dp3[idx] = -u * v * dxInterp - (1 + v * v) * dyInterp;
-      dp4[idx] = (1 + u * u) * dxInterp + u * v * dyInterp;
-      dp5[idx] = -v * dxInterp + u * dyInterp;
-
-      dp6[idx] = -hw * r2new_aff[0] * rlR;
-      dp7[idx] = -hw * 1;
-      dd[idx] = dxInterp * dxdd + dyInterp * dydd;
-      r[idx] = hw * residual;
-
-      // (Tong) Why compute max step this way?
-      float maxstep = 1.0f / Vec2f(dxdd * fxl, dydd * fyl).norm();
-      if (maxstep < point->maxstep) {
-        point->maxstep = maxstep;
-      }
-
-      // immediately compute dp*dd' and dd*dd' in JbBuffer1.
-      JbBuffer_new[i][0] += dp0[idx] * dd[idx];
-      JbBuffer_new[i][1] += dp1[idx] * dd[idx];
-      JbBuffer_new[i][2] += dp2[idx] * dd[idx];
-      JbBuffer_new[i][3] += dp3[idx] * dd[idx];
-      JbBuffer_new[i][4] += dp4[idx] * dd[idx];
-      JbBuffer_new[i][5] += dp5[idx] * dd[idx];
-      JbBuffer_new[i][6] += dp6[idx] * dd[idx];
-      JbBuffer_new[i][7] += dp7[idx] * dd[idx];
-      // residual Jacobian
-      JbBuffer_new[i][8] += r[idx] * dd[idx];
-      JbBuffer_new[i][9] += dd[idx] * dd[idx];
-    }
-
-    if (!isGood || energy > point->outlierTH * 20) {
-      // If current pixel's error is too large, do not update its residual.
-      // Start to process next pixel
-      E.updateSingle(point->energy[0]);
-      point->isGood_new = false;
-      point->energy_new = point->energy;
-      continue;
-    }
-
-    // Add into energy.
-    E.updateSingle(energy);
-    point->isGood_new = true;
-    point->energy_new[0] = energy;
-
-    // Update Hessian matrix by computing 4 floats once
-    for (int i = 0; i + 3 < patternNum; i += 4) {
-      // Update Hessian
-      acc9.updateSSE(
-          _mm_load_ps(((float*)(&dp0)) + i), _mm_load_ps(((float*)(&dp1)) + i),
-          _mm_load_ps(((float*)(&dp2)) + i), _mm_load_ps(((float*)(&dp3)) + i),
-          _mm_load_ps(((float*)(&dp4)) + i), _mm_load_ps(((float*)(&dp5)) + i),
-          _mm_load_ps(((float*)(&dp6)) + i), _mm_load_ps(((float*)(&dp7)) + i),
-          _mm_load_ps(((float*)(&r)) + i));
-    }
-
-    // If patternNum is not multiple times of 4, then we need to add the
-    // remaning points one by one
-    for (int i = ((patternNum >> 2) << 2); i < patternNum; ++i) {
-      acc9.updateSingle(dp0[i], dp1[i], dp2[i], dp3[i], dp4[i], dp5[i], dp6[i],
-                        dp7[i], r[i]);
-    }
+  const int nBlocks = (npts + kPointsPerBlock - 1) / kPointsPerBlock;
+  blockH.resize(nBlocks);
+  blockE.resize(nBlocks);
+  blockNum.resize(nBlocks);
+
+  reduceBlocks(
+      [&](int min, int max, Vec10* stats, int tid) {
+        Accumulator9& acc = threadAcc9[tid];
+        Accumulator11& E = threadE[tid];
+        for (int blk = min; blk < max; ++blk) {
+          acc.initialize();
+          E.initialize();
+          const int end = std::min(npts, (blk + 1) * kPointsPerBlock);
+          for (int i = blk * kPointsPerBlock; i < end; ++i) {
+            Pnt* point = ptsl + i;
+
+            point->maxstep = 1e10;
+            if (!point->isGood) {
+              E.updateSingle(point->energy[0]);
+              point->energy_new = point->energy;
+              point->isGood_new = false;
+              continue;
+            }
+            JbBuffer_new[i].setZero();
+
+            // project the residual pattern, stop at the first pixel that is
+            // not inside the image or has no positive depth.
+            PatternArray u, v, ptz, hitI, hitGx, hitGy;
+            bool isGood = true;
+            for (int idx = 0; idx < Pattern::num; ++idx) {
+              int dx = Pattern::offsets()[idx][0];
+              int dy = Pattern::offsets()[idx][1];
+
+              // pt[2] = inv_d_ref / inv_d_new
+              Vec3f pt = RKi * Vec3f(point->u + dx, point->v + dy, 1) +
+                         t * point->idepth_new;
+              u[idx] = pt[0] / pt[2];
+              v[idx] = pt[1] / pt[2];
+              float Ku = fxl * u[idx] + cxl;  // u in image new
+              float Kv = fyl * v[idx] + cyl;  // v in image new
+
+              // inverse depth wrt image new
+              float new_idepth = point->idepth_new / pt[2];
+
+              if (!(Ku > 1 && Kv > 1 && Ku < wl - 2 && Kv < hl - 2 &&
+                    new_idepth > 0)) {
+                isGood = false;
+                break;
+              }
+              // interpolated [intensity gx gy] in image new
+              Vec3f hitColor = getInterpolatedElement33(colorNew, Ku, Kv, wl);
+
+              if (!std::isfinite(point->refColor[idx]) ||
+                  !std::isfinite((float)hitColor[0])) {
+                isGood = false;
+                break;
+              }
+              ptz[idx] = pt[2];
+              hitI[idx] = hitColor[0];
+              hitGx[idx] = hitColor[1];
+              hitGy[idx] = hitColor[2];
+            }
+
+            float energy = 0;  // total energy (cost)
+            PatternArray rlR, residual, hw;
+            if (isGood) {
+              // interpolated [intensity] in image ref
+              rlR = Eigen::Map<const PatternArray>(point->refColor);
+
+              // Photometric error
+              // Note: Here is slightly different from the one in paper.
+              // Here, we merge four coefficients into two.
+              // e = I2 - (e^a * I + b)
+              residual = hitI - r2new_aff[0] * rlR - r2new_aff[1];
+
+              // Huber kernel for a robust estimation
+              const PatternArray absResidual = residual.abs();
+              hw = (absResidual < settings.huberTH)
+                       .select(PatternArray::Ones(),
+                               settings.huberTH / absResidual);
+              energy = (hw * residual * residual * (2 - hw)).sum();
+            }
+
+            if (!isGood || energy > point->outlierTH * 20) {
+              // If current pixel's error is too large, do not update its
+              // residual. Start to process next pixel
+              E.updateSingle(point->energy[0]);
+              point->isGood_new = false;
+              point->energy_new = point->energy;
+              continue;
+            }
+
+            // where Huber cut the residual (hw < 1) weight with sqrt(hw),
+            // sqrt(1) = 1 for the others.
+            hw = hw.sqrt();
+
+            // inverse depth wrt image new
+            const PatternArray new_idepth = point->idepth_new / ptz;
+            const PatternArray dxdd = (t[0] - t[2] * u) / ptz;
+            const PatternArray dydd = (t[1] - t[2] * v) / ptz;
+            const PatternArray dxInterp = hw * hitGx * fxl;
+            const PatternArray dyInterp = hw * hitGy * fyl;
+
+            // dp0 - dp5: Derivative of residual wrt. se(3)
+            // dp6 - dp7: Derivative of residual wrt. [a b]
+            //        dd: Derivative of residual wrt. inverse depth
+            //         r: sum of single residuals
+            const PatternArray dp0 = new_idepth * dxInterp;
+            const PatternArray dp1 = new_idepth * dyInterp;
+            const PatternArray dp2 =
+                -new_idepth * (u * dxInterp + v * dyInterp);
+            const PatternArray dp3 = -u * v * dxInterp - (1 + v * v) * dyInterp;
+            const PatternArray dp4 = (1 + u * u) * dxInterp + u * v * dyInterp;
+            const PatternArray dp5 = -v * dxInterp + u * dyInterp;
+            const PatternArray dp6 = -hw * r2new_aff[0] * rlR;
+            const PatternArray dp7 = -hw;
+            const PatternArray dd = dxInterp * dxdd + dyInterp * dydd;
+            const PatternArray r = hw * residual;
+
+            // (Tong) Why compute max step this way?
+            point->maxstep = std::min(
+                point->maxstep,
+                (1.0f / ((dxdd * fxl).square() + (dydd * fyl).square()).sqrt())
+                    .minCoeff());
+
+            // immediately compute dp*dd' and dd*dd' in JbBuffer1.
+            JbBuffer_new[i][0] = (dp0 * dd).sum();
+            JbBuffer_new[i][1] = (dp1 * dd).sum();
+            JbBuffer_new[i][2] = (dp2 * dd).sum();
+            JbBuffer_new[i][3] = (dp3 * dd).sum();
+            JbBuffer_new[i][4] = (dp4 * dd).sum();
+            JbBuffer_new[i][5] = (dp5 * dd).sum();
+            JbBuffer_new[i][6] = (dp6 * dd).sum();
+            JbBuffer_new[i][7] = (dp7 * dd).sum();
+            // residual Jacobian
+            JbBuffer_new[i][8] = (r * dd).sum();
+            JbBuffer_new[i][9] = dd.square().sum();
+
+            // Add into energy.
+            E.updateSingle(energy);
+            point->isGood_new = true;
+            point->energy_new[0] = energy;
+
+            // Update Hessian matrix by computing 4 floats once
+            const int n = Pattern::num;
+            for (int k = 0; k + 3 < n; k += 4) {
+              acc.updateSSE(loadPattern<n>(dp0.data() + k),
+                            loadPattern<n>(dp1.data() + k),
+                            loadPattern<n>(dp2.data() + k),
+                            loadPattern<n>(dp3.data() + k),
+                            loadPattern<n>(dp4.data() + k),
+                            loadPattern<n>(dp5.data() + k),
+                            loadPattern<n>(dp6.data() + k),
+                            loadPattern<n>(dp7.data() + k),
+                            loadPattern<n>(r.data() + k));
+            }
+
+            // If the pattern size is not multiple times of 4, then we need to
+            // add the remaning points one by one
+            for (int k = ((n >> 2) << 2); k < n; ++k) {
+              acc.updateSingle(dp0[k], dp1[k], dp2[k], dp3[k], dp4[k], dp5[k],
+                               dp6[k], dp7[k], r[k]);
+            }
+          }
+          acc.finish();
+          E.finish();
+          blockH[blk] = acc.H;
+          blockE[blk] = E.A;
+          blockNum[blk] = E.num;
+        }
+      },
+      nBlocks);
+
+  Mat99f accH = Mat99f::Zero();
+  float EA = 0;
+  size_t Enum = 0;
+  for (int blk = 0; blk < nBlocks; ++blk) {
+    accH += blockH[blk];
+    EA += blockE[blk];
+    Enum += blockNum[blk];
   }
 
-  E.finish();
-  acc9.finish();
-
   // Calculate alpha energy, and decide if we cap it.
   // But We did NOT add anything into it?
   Accumulator11 EAlpha;
   EAlpha.initialize();
   for (int i = 0; i < npts; ++i) {
     Pnt* point = ptsl + i;
-    if (!point->isGood_new) {
-      E.updateSingle((float)(point->energy[1]));
-    } else {
+    if (point->isGood_new) {
       point->energy_new[1] = (point->idepth_new - 1) * (point->idepth_new - 1);
-      E.updateSingle((float)(point->energy_new[1]));
     }
   }
+  // these were added to E after E.finish(), so they only showed in E.num.
+  Enum += npts;
   EAlpha.finish();
   // (Tong) EAlpha.A always zero, Bug???
   float alphaEnergy =
@@ -512,39 +581,54 @@ Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out,
     alphaOpt = alphaW;
   }
 
-  acc9SC.initialize();
-  for (int i = 0; i < npts; ++i) {
-    Pnt* point = ptsl + i;
-    if (!point->isGood_new) {
-      continue;
-    }
-
-    point->lastHessian_new = JbBuffer_new[i][9];
-
-    if (alphaOpt == 0) {
-      JbBuffer_new[i][8] += couplingWeight * (point->idepth_new - point->iR);
-      JbBuffer_new[i][9] += couplingWeight;
-    } else {
-      JbBuffer_new[i][8] += alphaOpt * (point->idepth_new - 1);
-      JbBuffer_new[i][9] += alphaOpt;
-    }
+  reduceBlocks(
+      [&](int min, int max, Vec10* stats, int tid) {
+        Accumulator9& acc = threadAcc9[tid];
+        for (int blk = min; blk < max; ++blk) {
+          acc.initialize();
+          const int end = std::min(npts, (blk + 1) * kPointsPerBlock);
+          for (int i = blk * kPointsPerBlock; i < end; ++i) {
+            Pnt* point = ptsl + i;
+            if (!point->isGood_new) {
+              continue;
+            }
+
+            point->lastHessian_new = JbBuffer_new[i][9];
+
+            if (alphaOpt == 0) {
+              JbBuffer_new[i][8] +=
+                  couplingWeight * (point->idepth_new - point->iR);
+              JbBuffer_new[i][9] += couplingWeight;
+            } else {
+              JbBuffer_new[i][8] += alphaOpt * (point->idepth_new - 1);
+              JbBuffer_new[i][9] += alphaOpt;
+            }
+
+            // TODO: Scaling of photometric part?
+            JbBuffer_new[i][9] = 1 / (1 + JbBuffer_new[i][9]);
+            acc.updateSingleWeighted(
+                JbBuffer_new[i][0], JbBuffer_new[i][1], JbBuffer_new[i][2],
+                JbBuffer_new[i][3], JbBuffer_new[i][4], JbBuffer_new[i][5],
+                JbBuffer_new[i][6], JbBuffer_new[i][7], JbBuffer_new[i][8],
+                JbBuffer_new[i][9]);
+          }
+          acc.finish();
+          blockH[blk] = acc.H;
+        }
+      },
+      nBlocks);
 
-    // TODO: Scaling of photometric part?
-    JbBuffer_new[i][9] = 1 / (1 + JbBuffer_new[i][9]);
-    acc9SC.updateSingleWeighted(JbBuffer_new[i][0], JbBuffer_new[i][1],
-                                JbBuffer_new[i][2], JbBuffer_new[i][3],
-                                JbBuffer_new[i][4], JbBuffer_new[i][5],
-                                JbBuffer_new[i][6], JbBuffer_new[i][7],
-                                JbBuffer_new[i][8], JbBuffer_new[i][9]);
+  Mat99f accSCH = Mat99f::Zero();
+  for (int blk = 0; blk < nBlocks; ++blk) {
+    accSCH += blockH[blk];
   }
-  acc9SC.finish();
 
   // printf("nelements in H: %d, in E: %d, in Hsc: %d / 9!\n", (int)acc9.num,
   // (int)E.num, (int)acc9SC.num*9);
-  H_out = acc9.H.topLeftCorner<8, 8>();        // / acc9.num;
-  b_out = acc9.H.topRightCorner<8, 1>();       // / acc9.num;
-  H_out_sc = acc9SC.H.topLeftCorner<8, 8>();   // / acc9.num;
-  b_out_sc = acc9SC.H.topRightCorner<8, 1>();  // / acc9.num;
+  H_out = accH.topLeftCorner<8, 8>();        // / acc9.num;
+  b_out = accH.topRightCorner<8, 1>();       // / acc9.num;
+  H_out_sc = accSCH.topLeftCorner<8, 8>();   // / acc9.num;
+  b_out_sc = accSCH.topRightCorner<8, 1>();  // / acc9.num;
 
   H_out(0, 0) += alphaOpt * npts;
   H_out(1, 1) += alphaOpt * npts;
@@ -555,7 +639,7 @@ Vec3f CoarseInitializer::calcResAndGS(int lvl, Mat88f& H_out, Vec8f& b_out,
   b_out[1] += tlog[1] * alphaOpt * npts;
   b_out[2] += tlog[2] * alphaOpt * npts;
 
-  return Vec3f(E.A, alphaEnergy, E.num);
+  return Vec3f(EA, alphaEnergy, Enum);
 }
 
 float CoarseInitializer::rescale() {
@@ -624,7 +708,7 @@ void CoarseInitializer::optReg(int lvl) {
 }
 
 void CoarseInitializer::propagateUp(int srcLvl) {
-  CHECK_LT(srcLvl + 1, PYR_LEVELS_USED);
+  CHECK_LT(srcLvl + 1, calib.pyrLevelsUsed);
   // set idepth of target
 
   int nptss = numPoints[srcLvl];
@@ -691,7 +775,7 @@ void CoarseInitializer::propagateDown(int srcLvl) {
 }
 
 void CoarseInitializer::makeGradients(Eigen::Vector3f** data) {
-  for (int lvl = 1; lvl < PYR_LEVELS_USED; ++lvl) {
+  for (int lvl = 1; lvl < calib.pyrLevelsUsed; ++lvl) {
     int lvlm1 = lvl - 1;
     int wl = w[lvl], hl = h[lvl], wlm1 = w[lvlm1];
 
@@ -714,23 +798,27 @@ void CoarseInitializer::makeGradients(Eigen::Vector3f** data) {
 }
 
 void CoarseInitializer::setFirst(CalibHessian* HCalib,
-                                 FrameHessian* newFrameHessian) {
+                                 FrameHessian* newFrameHessian,
+                                 IndexThreadReduce<Vec10>* red) {
+  this->red = red;
   makeK(HCalib);
+  CHECK(newFrameHessian->hasPyramid())
+      << "pyramid of the first frame already released";
   firstFrame = newFrameHessian;
 
-  PixelSelector sel(w[0], h[0]);
+  PixelSelector sel(calib, settings);
 
-  float* statusMap = new float[w[0] * h[0]];
+  std::vector<PixelCandidate> candidates;
   bool* statusMapB = new bool[w[0] * h[0]];
 
   // Point densities needed in different levels
   float densities[] = {0.03, 0.05, 0.15, 0.5, 1};
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
     sel.currentPotential = 3;
     int npts;
     if (lvl == 0) {
-      npts = sel.makeMaps(firstFrame, statusMap, densities[lvl] * w[0] * h[0],
-                          1, false, 2);
+      npts = sel.makeMaps(firstFrame, &candidates,
+                          densities[lvl] * w[0] * h[0], 1, false, 2);
     } else {
       npts = makePixelStatus(firstFrame->dIp[lvl], statusMapB, w[lvl], h[lvl],
                              densities[lvl] * w[0] * h[0]);
@@ -741,52 +829,68 @@ void CoarseInitializer::setFirst(CalibHessian* HCalib,
     }
     points[lvl] = new Pnt[npts];
 
+    if (lvl != 0) {
+      candidates.clear();
+      for (int y = 0; y < h[lvl]; ++y) {
+        for (int x = 0; x < w[lvl]; ++x) {
+          if (statusMapB[x + y * w[lvl]]) {
+            candidates.push_back({x, y, 1});
+          }
+        }
+      }
+    }
+
     // set idepth map to initially 1 everywhere.
     int wl = w[lvl], hl = h[lvl];
     Pnt* pl = points[lvl];
     int nl = 0;
-    for (int y = patternPadding + 1; y < hl - patternPadding - 2; ++y) {
-      for (int x = patternPadding + 1; x < wl - patternPadding - 2; ++x) {
-        if ((lvl != 0 && statusMapB[x + y * wl]) ||
-            (lvl == 0 && statusMap[x + y * wl] != 0)) {
-          // Initialize high-gradient points in every level
-          pl[nl].u = x + 0.1;
-          pl[nl].v = y + 0.1;
-          pl[nl].idepth = 1;
-          pl[nl].iR = 1;
-          pl[nl].isGood = true;
-          pl[nl].energy.setZero();
-          pl[nl].lastHessian = 0;
-          pl[nl].lastHessian_new = 0;
-          pl[nl].my_type = (lvl != 0) ? 1 : statusMap[x + y * wl];
-
-          // cpt[0]: intensity
-          // cpt[1]: gx
-          // cpt[2]: gy
-          Eigen::Vector3f* cpt = firstFrame->dIp[lvl] + x + y * w[lvl];
-          float sumGrad2 = 0;
-
-          for (int idx = 0; idx < patternNum; ++idx) {
-            // Residual pattern, 8 points
-            int dx = patternP[idx][0];
-            int dy = patternP[idx][1];
-
-            // Sum of squared gradients
-            float absgrad = cpt[dx + dy * w[lvl]].tail<2>().squaredNorm();
-            sumGrad2 += absgrad;
-          }
-
-          pl[nl].outlierTH = patternNum * setting_outlierTH;
+    const int padding = staticPatternPadding[settings.pattern];
+    for (const PixelCandidate& c : candidates) {
+      const int x = c.u, y = c.v;
+      if (x < padding + 1 || x >= wl - padding - 2 || y < padding + 1 ||
+          y >= hl - padding - 2) {
+        continue;
+      }
 
-          ++nl;
-          CHECK_LE(nl, npts);
-        }
+      // Initialize high-gradient points in every level
+      pl[nl].u = x + 0.1;
+      pl[nl].v = y + 0.1;
+      pl[nl].idepth = 1;
+      pl[nl].iR = 1;
+      pl[nl].isGood = true;
+      pl[nl].energy.setZero();
+      pl[nl].lastHessian = 0;
+      pl[nl].lastHessian_new = 0;
+      pl[nl].my_type = c.type;
+
+      // cpt[0]: intensity
+      // cpt[1]: gx
+      // cpt[2]: gy
+      Eigen::Vector3f* cpt = firstFrame->dIp[lvl] + x + y * w[lvl];
+      float sumGrad2 = 0;
+
+      for (int idx = 0; idx < staticPatternNum[settings.pattern]; ++idx) {
+        // Residual pattern, 8 points by default
+        int dx = staticPattern[settings.pattern][idx][0];
+        int dy = staticPattern[settings.pattern][idx][1];
+
+        // Sum of squared gradients
+        float absgrad = cpt[dx + dy * w[lvl]].tail<2>().squaredNorm();
+        sumGrad2 += absgrad;
+
+        pl[nl].refColor[idx] = getInterpolatedElement31(
+            firstFrame->dIp[lvl], pl[nl].u + dx, pl[nl].v + dy, wl);
       }
+
+      pl[nl].outlierTH =
+          staticPatternNum[settings.pattern] * settings.outlierTH;
+
+      ++nl;
+      CHECK_LE(nl, npts);
     }
 
     numPoints[lvl] = nl;
   }
-  delete[] statusMap;
   delete[] statusMapB;
 
   makeNN();
@@ -795,9 +899,10 @@ void CoarseInitializer::setFirst(CalibHessian* HCalib,
   snapped = false;
   frameID = snappedAt = 0;
 
-  for (int i = 0; i < PYR_LEVELS_USED; ++i) {
+  for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
     dGrads[i].setZero();
   }
+  this->red = nullptr;
 }
 
 void CoarseInitializer::resetPoints(int lvl) {
@@ -807,7 +912,7 @@ void CoarseInitializer::resetPoints(int lvl) {
     pts[i].energy.setZero();
     pts[i].idepth_new = pts[i].idepth;
 
-    if (lvl == PYR_LEVELS_USED - 1 && !pts[i].isGood) {
+    if (lvl == calib.pyrLevelsUsed - 1 && !pts[i].isGood) {
       float snd = 0, sn = 0;
       for (int n = 0; n < 10; ++n) {
         if (pts[i].neighbours[n] == -1 || !pts[pts[i].neighbours[n]].isGood) {
@@ -881,15 +986,15 @@ void CoarseInitializer::applyStep(int lvl) {
 }
 
 void CoarseInitializer::makeK(CalibHessian* HCalib) {
-  w[0] = wG[0];
-  h[0] = hG[0];
+  w[0] = calib.w[0];
+  h[0] = calib.h[0];
 
   fx[0] = HCalib->fxl();
   fy[0] = HCalib->fyl();
   cx[0] = HCalib->cxl();
   cy[0] = HCalib->cyl();
 
-  for (int level = 1; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 1; level < calib.pyrLevelsUsed; ++level) {
     w[level] = w[0] >> level;
     h[level] = h[0] >> level;
     fx[level] = fx[level - 1] * 0.5;
@@ -898,7 +1003,7 @@ void CoarseInitializer::makeK(CalibHessian* HCalib) {
     cy[level] = (cy[0] + 0.5) / ((int)1 << level) - 0.5;
   }
 
-  for (int level = 0; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 0; level < calib.pyrLevelsUsed; ++level) {
     K[level] << fx[level], 0.0, cx[level], 0.0, fy[level], cy[level], 0.0, 0.0,
         1.0;
     Ki[level] = K[level].inverse();
@@ -919,68 +1024,91 @@ void CoarseInitializer::makeNN() {
   // build indices
   FLANNPointcloud pcs[PYR_LEVELS];
   KDTree* indexes[PYR_LEVELS];
-  for (int i = 0; i < PYR_LEVELS_USED; ++i) {
-    pcs[i] = FLANNPointcloud(numPoints[i], points[i]);
-    indexes[i] =
-        new KDTree(2, pcs[i], nanoflann::KDTreeSingleIndexAdaptorParams(5));
-    indexes[i]->buildIndex();
-  }
+  reduceBlocks(
+      [&](int min, int max, Vec10* stats, int tid) {
+        for (int i = min; i < max; ++i) {
+          pcs[i] = FLANNPointcloud(numPoints[i], points[i]);
+          indexes[i] = new KDTree(2, pcs[i],
+                                  nanoflann::KDTreeSingleIndexAdaptorParams(5));
+          indexes[i]->buildIndex();
+        }
+      },
+      calib.pyrLevelsUsed);
 
   const int nn = 10;
 
   // find NN & parents
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
     Pnt* pts = points[lvl];
     int npts = numPoints[lvl];
 
-    int ret_index[nn];
-    float ret_dist[nn];
-    nanoflann::KNNResultSet<float, int, int> resultSet(nn);
-    nanoflann::KNNResultSet<float, int, int> resultSet1(1);
-
-    for (int i = 0; i < npts; ++i) {
-      // resultSet.init(pts[i].neighbours, pts[i].neighboursDist );
-      resultSet.init(ret_index, ret_dist);
-      Vec2f pt = Vec2f(pts[i].u, pts[i].v);
-      indexes[lvl]->findNeighbors(resultSet, (float*)&pt,
-                                  nanoflann::SearchParams());
-      int myidx = 0;
-      float sumDF = 0;
-      for (int k = 0; k < nn; ++k) {
-        pts[i].neighbours[myidx] = ret_index[k];
-        float df = expf(-ret_dist[k] * NNDistFactor);
-        sumDF += df;
-        pts[i].neighboursDist[myidx] = df;
-        CHECK_GE(ret_index[k], 0);
-        CHECK_LT(ret_index[k], npts);
-        ++myidx;
-      }
-      for (int k = 0; k < nn; ++k) {
-        pts[i].neighboursDist[k] *= 10 / sumDF;
-      }
-
-      if (lvl < PYR_LEVELS_USED - 1) {
-        resultSet1.init(ret_index, ret_dist);
-        pt = pt * 0.5f - Vec2f(0.25f, 0.25f);
-        indexes[lvl + 1]->findNeighbors(resultSet1, (float*)&pt,
+    reduceBlocks(
+        [&](int min, int max, Vec10* stats, int tid) {
+          int ret_index[nn];
+          float ret_dist[nn];
+          nanoflann::KNNResultSet<float, int, int> resultSet(nn);
+          nanoflann::KNNResultSet<float, int, int> resultSet1(1);
+
+          const int end = std::min(npts, max * kPointsPerBlock);
+          for (int i = min * kPointsPerBlock; i < end; ++i) {
+            resultSet.init(ret_index, ret_dist);
+            Vec2f pt = Vec2f(pts[i].u, pts[i].v);
+            indexes[lvl]->findNeighbors(resultSet, (float*)&pt,
                                         nanoflann::SearchParams());
-
-        // Set the parent in the higher level, which will be useful when
-        // propagating results of optimization
-        pts[i].parent = ret_index[0];
-        pts[i].parentDist = expf(-ret_dist[0] * NNDistFactor);
-        CHECK_GE(ret_index[0], 0);
-        CHECK_LT(ret_index[0], numPoints[lvl + 1]);
-      } else {
-        pts[i].parent = -1;
-        pts[i].parentDist = -1;
-      }
-    }
+            int myidx = 0;
+            float sumDF = 0;
+            for (int k = 0; k < nn; ++k) {
+              pts[i].neighbours[myidx] = ret_index[k];
+              float df = expf(-ret_dist[k] * NNDistFactor);
+              sumDF += df;
+              pts[i].neighboursDist[myidx] = df;
+              CHECK_GE(ret_index[k], 0);
+              CHECK_LT(ret_index[k], npts);
+              ++myidx;
+            }
+            for (int k = 0; k < nn; ++k) {
+              pts[i].neighboursDist[k] *= 10 / sumDF;
+            }
+
+            if (lvl < calib.pyrLevelsUsed - 1) {
+              resultSet1.init(ret_index, ret_dist);
+              pt = pt * 0.5f - Vec2f(0.25f, 0.25f);
+              indexes[lvl + 1]->findNeighbors(resultSet1, (float*)&pt,
+                                              nanoflann::SearchParams());
+
+              // Set the parent in the higher level, which will be useful
+              // when propagating results of optimization
+              pts[i].parent = ret_index[0];
+              pts[i].parentDist = expf(-ret_dist[0] * NNDistFactor);
+              CHECK_GE(ret_index[0], 0);
+              CHECK_LT(ret_index[0], numPoints[lvl + 1]);
+            } else {
+              pts[i].parent = -1;
+              pts[i].parentDist = -1;
+            }
+          }
+        },
+        (npts + kPointsPerBlock - 1) / kPointsPerBlock);
   }
 
-  for (int i = 0; i < PYR_LEVELS_USED; ++i) {
+  for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
     delete indexes[i];
   }
 }
 
+void CoarseInitializer::reduceBlocks(
+    const boost::function<void(int, int, Vec10*, int)>& fn, int nBlocks) {
+  const int numThreads = red != nullptr ? red->getNumThreads() : 1;
+  if (static_cast<int>(threadAcc9.size()) < numThreads) {
+    threadAcc9.resize(numThreads);
+    threadE.resize(numThreads);
+  }
+
+  if (red != nullptr) {
+    red->reduce(fn, 0, nBlocks, 1);
+  } else {
+    fn(0, nBlocks, nullptr, 0);
+  }
+}
+
 }  // dso
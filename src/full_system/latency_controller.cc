@@ -0,0 +1,127 @@
+#include "full_system/latency_controller.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace dso {
+
+namespace {
+
+//! weight of a new sample in the moving averages.
+const double kSmoothing = 0.2;
+
+//! keyframes between two changes, about the time the averages need to follow.
+const int kKeyframesPerChange = 5;
+
+//! lower the iterations first if optimize takes more of a keyframe than this.
+const double kOptimizeShare = 0.5;
+
+//! density factors per change, backing off faster than growing again.
+const float kDensityDown = 0.85f;
+const float kDensityUp = 1.05f;
+
+inline void smooth(double* average, const double sample, const bool first) {
+  *average = first ? sample : (1 - kSmoothing) * *average + kSmoothing * sample;
+}
+
+}  // namespace
+
+LatencyController::LatencyController(Settings* settings)
+    : settings(settings),
+      trackingMs(-1),
+      keyframeMs(0),
+      optimizeMs(0),
+      framesPerKeyframe(1),
+      numKeyframes(0),
+      keyframesSinceChange(0),
+      haveBase(false),
+      baseImmatureDensity(0),
+      basePointDensity(0),
+      baseMaxOptIterations(0),
+      densityScale(1) {}
+
+void LatencyController::addTrackingTime(const double ms) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  smooth(&trackingMs, ms, trackingMs < 0);
+}
+
+void LatencyController::addKeyframeTime(const double keyframeMs,
+                                        const double optimizeMs,
+                                        const int frames) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  const bool first = (numKeyframes == 0);
+  smooth(&this->keyframeMs, keyframeMs, first);
+  smooth(&this->optimizeMs, optimizeMs, first);
+  smooth(&framesPerKeyframe, std::max(frames, 1), first);
+  ++numKeyframes;
+  ++keyframesSinceChange;
+}
+
+double LatencyController::frameMs(const bool sequential) const {
+  const double mappingMs = keyframeMs / std::max(framesPerKeyframe, 1.0);
+  const double tracking = std::max(trackingMs, 0.0);
+  return sequential ? tracking + mappingMs : std::max(tracking, mappingMs);
+}
+
+void LatencyController::setDensityScale(const float scale) {
+  densityScale = scale;
+  settings->desiredPointDensity = basePointDensity * scale;
+  settings->desiredImmatureDensity = baseImmatureDensity * scale;
+}
+
+void LatencyController::update(const bool sequential) {
+  if (settings->latencyBudgetMs <= 0) {
+    return;
+  }
+
+  boost::unique_lock<boost::mutex> lock(mutex);
+  if (!haveBase) {
+    basePointDensity = settings->desiredPointDensity;
+    baseImmatureDensity = settings->desiredImmatureDensity;
+    baseMaxOptIterations = settings->maxOptIterations;
+    haveBase = true;
+  }
+  if (keyframesSinceChange < kKeyframesPerChange) {
+    return;
+  }
+
+  const double ms = frameMs(sequential);
+  const int minIterations = std::max(settings->minOptIterations, 1);
+  const int oldIterations = settings->maxOptIterations;
+  const float oldScale = densityScale;
+
+  if (ms > settings->latencyBudgetMs) {
+    if (optimizeMs > kOptimizeShare * keyframeMs &&
+        settings->maxOptIterations > minIterations) {
+      --settings->maxOptIterations;
+    } else if (densityScale > settings->latencyMinScale) {
+      setDensityScale(
+          std::max(settings->latencyMinScale, densityScale * kDensityDown));
+    }
+  } else if (ms <
+             (1 - settings->latencyHysteresis) * settings->latencyBudgetMs) {
+    if (settings->maxOptIterations < baseMaxOptIterations) {
+      ++settings->maxOptIterations;
+    } else if (densityScale < settings->latencyMaxScale) {
+      setDensityScale(
+          std::min(settings->latencyMaxScale, densityScale * kDensityUp));
+    }
+  }
+
+  if (oldIterations == settings->maxOptIterations && oldScale == densityScale) {
+    return;
+  }
+  keyframesSinceChange = 0;
+
+  LOG(INFO) << "latency " << ms << " ms per frame (budget "
+            << settings->latencyBudgetMs << ", tracking " << trackingMs
+            << ", keyframe " << keyframeMs << " / optimize " << optimizeMs
+            << " every " << framesPerKeyframe << " frames): max GN iterations "
+            << oldIterations << " -> " << settings->maxOptIterations
+            << ", density x" << oldScale << " -> x" << densityScale << " ("
+            << settings->desiredPointDensity << " points, "
+            << settings->desiredImmatureDensity << " immature)";
+}
+
+}  // dso
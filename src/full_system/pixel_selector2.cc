@@ -1,16 +1,27 @@
 #include "full_system/pixel_selector2.h"
 
+#include <algorithm>
+
 #include "full_system/hessian_blocks/hessian_blocks.h"
 #include "io_wrapper/image_display.h"
-#include "util/global_calib.h"
+#include "util/frame_shell.h"
 #include "util/global_funcs.h"
+#include "util/index_thread_reduce.h"
 #include "util/num_type.h"
 
+#if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
+#include "SSE2NEON.h"
+#endif
+
 namespace dso {
 
-PixelSelector::PixelSelector(int w, int h) {
+PixelSelector::PixelSelector(const CalibContext& calib,
+                             const Settings& settings)
+    : calib(calib), settings(settings) {
+  const int w = calib.w[0];
+  const int h = calib.h[0];
   randomPattern = new unsigned char[w * h];
-  std::srand(3141592);  // want to be deterministic.
+  std::srand(setting_randomSeed);  // want to be deterministic.
   for (int i = 0; i < w * h; ++i) {
     randomPattern[i] = rand() & 0xFF;
   }
@@ -23,6 +34,7 @@ PixelSelector::PixelSelector(int w, int h) {
 
   allowFast = false;
   gradHistFrame = 0;
+  gradHistFrameId = -1;
 }
 
 PixelSelector::~PixelSelector() {
@@ -32,6 +44,13 @@ PixelSelector::~PixelSelector() {
   delete[] thsSmoothed;
 }
 
+void PixelSelector::reset() {
+  currentPotential = 3;
+  allowFast = false;
+  gradHistFrame = 0;
+  gradHistFrameId = -1;
+}
+
 // 找出梯度的阈值
 int computeHistQuantil(int* hist, float below) {
   int th = hist[0] * below + 0.5f;  // 舍弃的pixel的数量
@@ -46,13 +65,15 @@ int computeHistQuantil(int* hist, float below) {
 }
 
 void PixelSelector::makeHists(const FrameHessian* const fh) {
+  CHECK(fh->hasPyramid()) << "pyramid of frame already released";
   gradHistFrame = fh;
+  gradHistFrameId = fh->shell != nullptr ? fh->shell->id : -1;
 
   // 取出第0层的梯度平方和
   float* mapmax0 = fh->absSquaredGrad[0];
 
-  int w = wG[0];
-  int h = hG[0];
+  int w = calib.w[0];
+  int h = calib.h[0];
 
   // 将图片分割成(w32 x h32)个32x32的patch
   int w32 = w / 32;  // 横向patch的数量
@@ -70,30 +91,44 @@ void PixelSelector::makeHists(const FrameHessian* const fh) {
       int* hist0 = gradHist;  // + 50*(x+y*w32);
       memset(hist0, 0, sizeof(int) * 50);
 
+      // 忽略图片边缘点: 只遍历1 <= it <= w - 2, 1 <= jt <= h - 2
+      const int iMin = std::max(0, 1 - 32 * x);
+      const int iMax = std::min(32, w - 1 - 32 * x);
+      const int jMin = std::max(0, 1 - 32 * y);
+      const int jMax = std::min(32, h - 1 - 32 * y);
+      const __m128 maxG = _mm_set1_ps(48.f);
+
       // 遍历patch中的每一个pixel
-      for (int j = 0; j < 32; ++j) {
-        for (int i = 0; i < 32; ++i) {
-          int it = i + 32 * x;
-          int jt = j + 32 * y;
-          if (it > w - 2 || jt > h - 2 || it < 1 || jt < 1) {
-            // 忽略图片边缘点
-            continue;
-          }
-          // pixel处的梯度
-          int g = sqrtf(map0[i + j * w]);
+      for (int j = jMin; j < jMax; ++j) {
+        const float* row = map0 + j * w;
+        int i = iMin;
+
+        // pixel处的梯度: min(sqrt(ag), 48), 4个pixel一组
+        for (; i + 4 <= iMax; i += 4) {
+          EIGEN_ALIGN16 int g[4];
+          _mm_store_si128(reinterpret_cast<__m128i*>(g),
+                          _mm_cvttps_epi32(_mm_min_ps(
+                              _mm_sqrt_ps(_mm_loadu_ps(row + i)), maxG)));
+          ++hist0[g[0] + 1];
+          ++hist0[g[1] + 1];
+          ++hist0[g[2] + 1];
+          ++hist0[g[3] + 1];
+        }
+        for (; i < iMax; ++i) {
+          int g = sqrtf(row[i]);
           if (g > 48) {
             g = 48;
           }
-
-          // 统计到梯度直方图
           ++hist0[g + 1];
-          ++hist0[0];
         }
+
+        // 统计到梯度直方图
+        hist0[0] += std::max(0, iMax - iMin);
       }
 
       // 将此patch的梯度阈值保存起来
-      ths[x + y * w32] = computeHistQuantil(hist0, setting_minGradHistCut) +
-                         setting_minGradHistAdd;
+      ths[x + y * w32] = computeHistQuantil(hist0, settings.minGradHistCut) +
+                         settings.minGradHistAdd;
     }
 
   // 通过考虑相邻patch, 来对每个patch的梯度进行smoothing
@@ -142,9 +177,12 @@ void PixelSelector::makeHists(const FrameHessian* const fh) {
   }
 }
 
-int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
+int PixelSelector::makeMaps(const FrameHessian* const fh,
+                            std::vector<PixelCandidate>* candidates_out,
                             float density, int recursionsLeft, bool plot,
-                            float thFactor) {
+                            float thFactor,
+                            IndexThreadReduce<Vec10>* threadReduce) {
+  CHECK(fh->hasPyramid()) << "pyramid of frame already released";
   float numHave = 0;        // 所找出的高梯度点的数量
   float numWant = density;  // 所需的高梯度点的数量
   float quotia;             // 比例: want / have
@@ -152,10 +190,10 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
 
   //	if(setting_pixelSelectionUseFast>0 && allowFast)
   //	{
-  //		memset(map_out, 0, sizeof(float)*wG[0]*hG[0]);
+  //		memset(map_out, 0, sizeof(float)*calib.w[0]*calib.h[0]);
   //		std::vector<cv::KeyPoint> pts;
-  //		cv::Mat img8u(hG[0],wG[0],CV_8U);
-  //		for(int i=0;i<wG[0]*hG[0];++i)
+  //		cv::Mat img8u(calib.h[0],calib.w[0],CV_8U);
+  //		for(int i=0;i<calib.w[0]*calib.h[0];++i)
   //		{
   //			float v = fh->dI[i][0]*0.8;
   //			img8u.at<uchar>(i) = (!std::isfinite(v) || v>255) ? 255
@@ -167,7 +205,7 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
   //		{
   //			int x = pts[i].pt.x+0.5;
   //			int y = pts[i].pt.y+0.5;
-  //			map_out[x+y*wG[0]]=1;
+  //			map_out[x+y*calib.w[0]]=1;
   //			numHave++;
   //		}
   //
@@ -181,12 +219,16 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
     // we will allow sub-selecting pixels by up to a quotia of 0.25, otherwise
     // we will re-select.
 
-    if (fh != gradHistFrame) {
+    // 递归调用时直方图不需要重新计算
+    if (fh != gradHistFrame ||
+        (fh->shell != nullptr ? fh->shell->id : -1) != gradHistFrameId) {
       makeHists(fh);
     }
 
     // select!
-    Eigen::Vector3i n = this->select(fh, map_out, currentPotential, thFactor);
+    Eigen::Vector3i n =
+        this->select(fh, candidates_out, currentPotential, thFactor,
+                     threadReduce);
 
     // sub-select!
     numHave = n[0] + n[1] + n[2];  // 总共找出的高梯度点的数量
@@ -213,14 +255,15 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
 
       //		printf("PixelSelector: have %.2f%%, need %.2f%%.
       // RESAMPLE with pot %d -> %d.\n",
-      //				100*numHave/(float)(wG[0]*hG[0]),
-      //				100*numWant/(float)(wG[0]*hG[0]),
+      //				100*numHave/(float)(calib.w[0]*calib.h[0]),
+      //				100*numWant/(float)(calib.w[0]*calib.h[0]),
       //				currentPotential,
       //				idealPotential);
       currentPotential = idealPotential;
 
       // 减小currentPotential, 再次进行搜索高梯度点
-      return makeMaps(fh, map_out, density, recursionsLeft - 1, plot, thFactor);
+      return makeMaps(fh, candidates_out, density, recursionsLeft - 1, plot,
+                      thFactor, threadReduce);
     } else if (recursionsLeft > 0 && quotia < 0.25) {
       // re-sample to get less points!
       // 点太多了
@@ -231,45 +274,43 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
 
       //		printf("PixelSelector: have %.2f%%, need %.2f%%.
       // RESAMPLE with pot %d -> %d.\n",
-      //				100*numHave/(float)(wG[0]*hG[0]),
-      //				100*numWant/(float)(wG[0]*hG[0]),
+      //				100*numHave/(float)(calib.w[0]*calib.h[0]),
+      //				100*numWant/(float)(calib.w[0]*calib.h[0]),
       //				currentPotential,
       //				idealPotential);
       currentPotential = idealPotential;
       // 增加currentPotential, 再次进行搜索高梯度点
-      return makeMaps(fh, map_out, density, recursionsLeft - 1, plot, thFactor);
+      return makeMaps(fh, candidates_out, density, recursionsLeft - 1, plot,
+                      thFactor, threadReduce);
     }
   }
 
-  int numHaveSub = numHave;
   if (quotia < 0.95) {
     // 如果拥有的点仍然太多, 随机删除一些点
-    int wh = wG[0] * hG[0];
-    int rn = 0;
+    std::vector<PixelCandidate>& candidates = *candidates_out;
     unsigned char charTH = 255 * quotia;
-    for (int i = 0; i < wh; ++i) {
-      if (map_out[i] != 0) {
-        if (randomPattern[rn] > charTH) {
-          map_out[i] = 0;
-          --numHaveSub;
-        }
-        ++rn;
+    size_t kept = 0;
+    for (size_t rn = 0; rn < candidates.size(); ++rn) {
+      if (randomPattern[rn] <= charTH) {
+        candidates[kept++] = candidates[rn];
       }
     }
+    candidates.resize(kept);
   }
+  const int numHaveSub = candidates_out->size();
 
   //	printf("PixelSelector: have %.2f%%, need %.2f%%. KEEPCURR with pot %d ->
   //%d. Subsampled to %.2f%%\n",
-  //			100*numHave/(float)(wG[0]*hG[0]),
-  //			100*numWant/(float)(wG[0]*hG[0]),
+  //			100*numHave/(float)(calib.w[0]*calib.h[0]),
+  //			100*numWant/(float)(calib.w[0]*calib.h[0]),
   //			currentPotential,
   //			idealPotential,
-  //			100*numHaveSub/(float)(wG[0]*hG[0]));
+  //			100*numHaveSub/(float)(calib.w[0]*calib.h[0]));
   currentPotential = idealPotential;
 
   if (plot) {
-    int w = wG[0];
-    int h = hG[0];
+    int w = calib.w[0];
+    int h = calib.h[0];
 
     MinimalImageB3 img(w, h);
 
@@ -282,25 +323,66 @@ int PixelSelector::makeMaps(const FrameHessian* const fh, float* map_out,
     }
     IOWrap::displayImage("Selector Image", &img);
 
-    for (int y = 0; y < h; ++y)
-      for (int x = 0; x < w; ++x) {
-        int i = x + y * w;
-        if (map_out[i] == 1) {
-          img.setPixelCirc(x, y, Vec3b(0, 255, 0));
-        } else if (map_out[i] == 2) {
-          img.setPixelCirc(x, y, Vec3b(255, 0, 0));
-        } else if (map_out[i] == 4) {
-          img.setPixelCirc(x, y, Vec3b(0, 0, 255));
-        }
+    for (const PixelCandidate& p : *candidates_out) {
+      if (p.type == 1) {
+        img.setPixelCirc(p.u, p.v, Vec3b(0, 255, 0));
+      } else if (p.type == 2) {
+        img.setPixelCirc(p.u, p.v, Vec3b(255, 0, 0));
+      } else if (p.type == 4) {
+        img.setPixelCirc(p.u, p.v, Vec3b(0, 0, 255));
       }
+    }
     IOWrap::displayImage("Selector Pixels", &img);
   }
 
   return numHaveSub;
 }
 
-Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
-                                      float* map_out, int pot, float thFactor) {
+Eigen::Vector3i PixelSelector::select(
+    const FrameHessian* const fh, std::vector<PixelCandidate>* candidates_out,
+    int pot, float thFactor, IndexThreadReduce<Vec10>* threadReduce) {
+  int h = calib.h[0];
+
+  // patch4的行数
+  const int numBands = (h + 4 * pot - 1) / (4 * pot);
+  if (static_cast<int>(bandCandidates.size()) < numBands) {
+    bandCandidates.resize(numBands);
+  }
+  for (int b = 0; b < numBands; ++b) {
+    bandCandidates[b].clear();
+  }
+
+  Vec10 stats = Vec10::Zero();
+  if (threadReduce != nullptr && settings.parallelPixelSelection) {
+    stats = threadReduce->reduce(
+        boost::bind(&PixelSelector::selectBands, this, fh, pot, thFactor,
+                    boost::placeholders::_1, boost::placeholders::_2,
+                    boost::placeholders::_3, boost::placeholders::_4),
+        0, numBands, 1);
+  } else {
+    selectBands(fh, pot, thFactor, 0, numBands, &stats, 0);
+  }
+
+  // 每一行patch4内按patch的顺序找到, 排成逐行扫描的顺序.
+  candidates_out->clear();
+  for (int b = 0; b < numBands; ++b) {
+    std::vector<PixelCandidate>& band = bandCandidates[b];
+    std::sort(band.begin(), band.end(),
+              [](const PixelCandidate& p, const PixelCandidate& q) {
+                return p.v < q.v || (p.v == q.v && p.u < q.u);
+              });
+    candidates_out->insert(candidates_out->end(), band.begin(), band.end());
+  }
+
+  // 返回使用第0,1,2层梯度找出的高梯度pixel的数量
+  return Eigen::Vector3i(static_cast<int>(stats[0]),
+                         static_cast<int>(stats[1]),
+                         static_cast<int>(stats[2]));
+}
+
+void PixelSelector::selectBands(const FrameHessian* const fh, int pot,
+                                float thFactor, int bandMin, int bandMax,
+                                Vec10* stats, int tid) {
   // map0 = dIp[0], the first level of pyramid
   // map0[0]: intensity
   // map0[1]: gradient x (gx)
@@ -311,10 +393,10 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
   float* mapmax1 = fh->absSquaredGrad[1];  // 第1层梯度平方和
   float* mapmax2 = fh->absSquaredGrad[2];  // 第2层梯度平方和
 
-  int w = wG[0];   //第0层图片宽度
-  int w1 = wG[1];  //第1层图片宽度
-  int w2 = wG[2];  // 第2层图片宽度
-  int h = hG[0];   // 第0层图片高度
+  int w = calib.w[0];  // 第0层图片宽度
+  int w1 = calib.w[1];  //第1层图片宽度
+  int w2 = calib.w[2];  // 第2层图片宽度
+  int h = calib.h[0];  // 第0层图片高度
 
   // 单位投影方向
   const Vec2f directions[16] = {
@@ -325,15 +407,19 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
       Vec2f(0.5556, 0.8315), Vec2f(0.9808, -0.1951), Vec2f(1.0000, 0.0000),
       Vec2f(0.1951, -0.9808)};
 
-  memset(map_out, 0, w * h * sizeof(PixelSelectorStatus));
-
-  float dw1 = setting_gradDownweightPerLevel;  // 梯度阈值变化的系数
+  float dw1 = settings.gradDownweightPerLevel;  // 梯度阈值变化的系数
   float dw2 = dw1 * dw1;                       // dw1 * dw1
 
-  int n3 = 0, n2 = 0, n4 = 0;
+  // n2也用来选randomPattern中的投影方向. 从第一行patch4的y开始,
+  // 所以串行时(bandMin == 0)和原来一样, 并行时不依赖线程的分配.
+  int n2 = bandMin * 4 * pot;
+  const int n2Start = n2;
+  int n3 = 0, n4 = 0;
 
   // 对原图片的每一个patch4进行遍历, patch4的边长为(4 * pot)
-  for (int y4 = 0; y4 < h; y4 += (4 * pot)) {
+  for (int y4 = bandMin * 4 * pot; y4 < h && y4 < bandMax * 4 * pot;
+       y4 += (4 * pot)) {
+    std::vector<PixelCandidate>& band = bandCandidates[y4 / (4 * pot)];
     for (int x4 = 0; x4 < w; x4 += (4 * pot)) {
       int my3 = std::min((4 * pot), h - y4);
       int mx3 = std::min((4 * pot), w - x4);
@@ -396,7 +482,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
 
                     // 梯度在一个随机方向上的投影的模
                     float dirNorm = fabsf((float)(ag0d.dot(dir2)));
-                    if (!setting_selectDirectionDistribution) {
+                    if (!settings.selectDirectionDistribution) {
                       dirNorm = ag0;
                     }
 
@@ -422,7 +508,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
                     // 注意: 下面计算的仍是第0层的梯度
                     Vec2f ag0d = map0[idx].tail<2>();  // 第0层的[gx; gy]
                     float dirNorm = fabsf((float)(ag0d.dot(dir3)));
-                    if (!setting_selectDirectionDistribution) {
+                    if (!settings.selectDirectionDistribution) {
                       dirNorm = ag1;
                     }
 
@@ -447,7 +533,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
                     // 注意: 下面计算的仍是第0层的梯度
                     Vec2f ag0d = map0[idx].tail<2>();  // 第0层的[gx; gy]
                     float dirNorm = fabsf((float)(ag0d.dot(dir4)));
-                    if (!setting_selectDirectionDistribution) {
+                    if (!settings.selectDirectionDistribution) {
                       dirNorm = ag2;
                     }
 
@@ -462,7 +548,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
               if (bestIdx2 > 0) {
                 // 如果我们使用第0层梯度找到了满足的点,
                 // 增加bestVal3(停止更新bestIdx3)
-                map_out[bestIdx2] = 1;
+                band.push_back({bestIdx2 % w, bestIdx2 / w, 1});
                 bestVal3 = 1e10;
                 ++n2;
               }
@@ -472,7 +558,7 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
           if (bestIdx3 > 0) {
             // 如果我们使用第1层梯度找到了满足的点,
             // 增加bestVal4(停止更新bestIdx4)
-            map_out[bestIdx3] = 2;
+            band.push_back({bestIdx3 % w, bestIdx3 / w, 2});
             bestVal4 = 1e10;
             ++n3;
           }
@@ -481,13 +567,14 @@ Eigen::Vector3i PixelSelector::select(const FrameHessian* const fh,
 
       if (bestIdx4 > 0) {
         // 如果我们使用第2层梯度找到了满足的点
-        map_out[bestIdx4] = 4;
+        band.push_back({bestIdx4 % w, bestIdx4 / w, 4});
         ++n4;
       }
     }
   }
 
-  // 返回使用第0,1,2层梯度找出的高梯度pixel的数量
-  return Eigen::Vector3i(n2, n3, n4);
+  (*stats)[0] += n2 - n2Start;
+  (*stats)[1] += n3;
+  (*stats)[2] += n4;
 }
 }
@@ -0,0 +1,169 @@
+#include "full_system/reloc_index.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "util/compact_pixel.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+
+namespace {
+
+int64_t entryBytes(const RelocIndex::Entry& entry) {
+  return sizeof(RelocIndex::Entry) +
+         entry.thumbnail.size() * sizeof(float) +
+         entry.image.size() * sizeof(int16_t) +
+         entry.points.size() * sizeof(RelocIndex::Point);
+}
+
+}  // namespace
+
+RelocIndex::RelocIndex(const CalibContext& calib, const size_t capacity)
+    : calib(calib), capacity(capacity) {
+  CHECK_GT(capacity, 0);
+}
+
+void RelocIndex::add(const FrameHessian* frame) {
+  std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+  entry->id = frame->shell->id;
+  entry->incomingId = frame->shell->incoming_id;
+  entry->timestamp = frame->shell->timestamp;
+  entry->camToWorld = frame->shell->camToWorld;
+  entry->aff_g2l = frame->shell->aff_g2l;
+  entry->ab_exposure = frame->ab_exposure;
+  makeThumbnail(frame, &entry->thumbnail);
+
+  const int wh = calib.w[0] * calib.h[0];
+  entry->image.resize(wh);
+  for (int i = 0; i < wh; ++i) {
+    const float c = frame->intensityAt(i);
+    entry->image[i] =
+        std::isfinite(c) ? CompactPixel::encode(c) : CompactPixel::kInvalid;
+  }
+
+  entry->points.reserve(frame->pointHessians.size() +
+                        frame->pointHessiansMarginalized.size());
+  for (const std::vector<PointHessian*>* points :
+       {&frame->pointHessians, &frame->pointHessiansMarginalized}) {
+    for (const PointHessian* ph : *points) {
+      if (!(ph->idepth_scaled > 0) || !std::isfinite(ph->idepth_scaled)) {
+        continue;
+      }
+      Point p;
+      p.u = ph->u;
+      p.v = ph->v;
+      p.idepthScaled = ph->idepth_scaled;
+      p.type = ph->my_type;
+      entry->points.emplace_back(p);
+    }
+  }
+
+  boost::unique_lock<boost::mutex> lock(mutex);
+  entries.emplace_back(std::move(entry));
+  while (entries.size() > capacity) {
+    entries.pop_front();
+  }
+  int64_t bytes = 0;
+  for (const std::shared_ptr<const Entry>& e : entries) {
+    bytes += entryBytes(*e);
+  }
+  memory.set(bytes);
+}
+
+std::vector<RelocIndex::Match> RelocIndex::query(const FrameHessian* frame,
+                                                 const int n,
+                                                 const float minScore) const {
+  std::vector<float> thumbnail;
+  makeThumbnail(frame, &thumbnail);
+
+  std::vector<Match> matches;
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // newest first, which wins among equal scores.
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+      float score = 0;
+      for (size_t i = 0; i < thumbnail.size(); ++i) {
+        score += thumbnail[i] * (*it)->thumbnail[i];
+      }
+      if (score >= minScore) {
+        matches.emplace_back(score, *it);
+      }
+    }
+  }
+
+  std::stable_sort(matches.begin(), matches.end(),
+                   [](const Match& a, const Match& b) {
+                     return a.first > b.first;
+                   });
+  if (static_cast<int>(matches.size()) > n) {
+    matches.resize(n);
+  }
+  return matches;
+}
+
+void RelocIndex::decodeImage(const Entry& entry, float* image) const {
+  for (size_t i = 0; i < entry.image.size(); ++i) {
+    image[i] = entry.image[i] == CompactPixel::kInvalid
+                   ? NAN
+                   : entry.image[i] * (1.f / CompactPixel::kScale);
+  }
+}
+
+size_t RelocIndex::size() const {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  return entries.size();
+}
+
+void RelocIndex::clear() {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  entries.clear();
+  memory.set(0);
+}
+
+void RelocIndex::makeThumbnail(const FrameHessian* frame,
+                               std::vector<float>* thumbnail) const {
+  // averages of level 0, so compact keyframes give the same as new frames.
+  const int lvl = calib.pyrLevelsUsed - 1;
+  const int wl = calib.w[lvl], hl = calib.h[lvl], s = 1 << lvl;
+  thumbnail->assign(wl * hl, 0);
+
+  float sum = 0;
+  int num = 0;
+  for (int y = 0; y < hl; ++y) {
+    for (int x = 0; x < wl; ++x) {
+      float cell = 0;
+      for (int dy = 0; dy < s; ++dy) {
+        const int row = (y * s + dy) * calib.w[0] + x * s;
+        for (int dx = 0; dx < s; ++dx) {
+          cell += frame->intensityAt(row + dx);
+        }
+      }
+      cell /= s * s;
+      (*thumbnail)[x + y * wl] = cell;
+      if (std::isfinite(cell)) {
+        sum += cell;
+        ++num;
+      }
+    }
+  }
+
+  // invalid cells count as the mean.
+  const float mean = num > 0 ? sum / num : 0;
+  float norm = 0;
+  for (float& c : *thumbnail) {
+    c = std::isfinite(c) ? c - mean : 0;
+    norm += c * c;
+  }
+  if (norm > 0) {
+    const float scale = 1.f / sqrtf(norm);
+    for (float& c : *thumbnail) {
+      c *= scale;
+    }
+  }
+}
+
+}  // namespace dso
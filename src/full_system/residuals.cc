@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <algorithm>
+#include <limits>
 
 #include <Eigen/Eigenvalues>
 #include <Eigen/LU>
@@ -12,20 +13,25 @@
 #include "io_wrapper/image_display.h"
 #include "optimization_backend/energy_functional/energy_functional.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
-#include "util/global_calib.h"
 #include "util/global_funcs.h"
+#include "util/memory_stats.h"
+#include "util/residual_pattern.h"
 
 namespace dso {
-int PointFrameResidual::instanceCounter = 0;
+std::atomic<int> PointFrameResidual::instanceCounter(0);
 
 long runningResID = 0;
 
-PointFrameResidual::PointFrameResidual() { ++instanceCounter; }
+PointFrameResidual::PointFrameResidual() : J(nullptr) { ++instanceCounter; }
 
 PointFrameResidual::~PointFrameResidual() {
   CHECK(efResidual == nullptr);
   --instanceCounter;
-  delete J;
+  if (J != nullptr) {
+    delete J;
+    MemoryStats::add(MEM_JACOBIANS,
+                     -static_cast<int64_t>(sizeof(RawResidualJacobian)));
+  }
 }
 
 PointFrameResidual::PointFrameResidual(PointHessian* point_,
@@ -36,13 +42,22 @@ PointFrameResidual::PointFrameResidual(PointHessian* point_,
   ++instanceCounter;
   resetOOB();
   J = new RawResidualJacobian();
+  MemoryStats::add(MEM_JACOBIANS, sizeof(RawResidualJacobian));
   CHECK(((long)J) % 16 == 0);
 
   isNew = true;
 }
 
-double PointFrameResidual::linearize(CalibHessian* const HCalib) {
+template <int kPattern, bool kOptA, bool kOptB>
+double PointFrameResidual::linearize(CalibHessian* const HCalib,
+                                     const bool updateJacobians) {
+  typedef ResidualPattern<kPattern> Pattern;
   CHECK_NOTNULL(HCalib);
+  const CalibContext& calib = *host->calib;
+  // read once, the stores to J below could alias them.
+  const float huberTH = host->settings->huberTH;
+  const float outlierTHSumComponent = host->settings->outlierTHSumComponent;
+  const int(*const pattern)[2] = Pattern::offsets();
 
   state_NewEnergyWithOutlier = -1;
 
@@ -53,6 +68,7 @@ double PointFrameResidual::linearize(CalibHessian* const HCalib) {
 
   FrameFramePrecalc* precalc = &(host->targetPrecalc[target->idx]);
   const Eigen::Vector3f* dIl = target->dI;  // [intensity gx gy]
+  const CompactPixel* dIlCompact = target->dICompact;
 
   // K * R * K^{-1}: from host to target
   const Mat33f& PRE_KRKiTll = precalc->PRE_KRKiTll;
@@ -70,10 +86,15 @@ double PointFrameResidual::linearize(CalibHessian* const HCalib) {
   const Vec2f affLL = precalc->PRE_aff_mode;  // ATTENTION: FIRST ESTIMATE
   const float b0 = precalc->PRE_b0_mode;      // ATTENTION: FIRST ESTIMATE
 
-  Vec6f d_xi_x, d_xi_y;
-  Vec4f d_C_x, d_C_y;
-  float d_d_x, d_d_y;
-  {
+  if (!updateJacobians) {
+    // everything but resF as of the last applyRes(true).
+    CHECK(efResidual != nullptr && efResidual->isActiveAndIsGoodNEW);
+    *J = *efResidual->J;
+  } else {
+    Vec6f d_xi_x, d_xi_y;
+    Vec4f d_C_x, d_C_y;
+    float d_d_x, d_d_y;
+
     float drescale;    // inverse depth target / inverse depth host
     float new_idepth;  // pixel inverse depth wrt. target
     float u, v;        // pixel coordinates in normalized plane target
@@ -134,10 +155,8 @@ double PointFrameResidual::linearize(CalibHessian* const HCalib) {
     d_xi_y[3] = -(1 + v * v) * HCalib->fyl();
     d_xi_y[4] = u * v * HCalib->fyl();
     d_xi_y[5] = u * HCalib->fyl();
-  }
 
-  // ATTENTION: These derivatives are computed using FIRST ESTIMATE
-  {
+    // ATTENTION: These derivatives are computed using FIRST ESTIMATE
     J->Jpdxi[0] = d_xi_x;
     J->Jpdxi[1] = d_xi_y;
 
@@ -148,117 +167,398 @@ double PointFrameResidual::linearize(CalibHessian* const HCalib) {
     J->Jpdd[1] = d_d_y;
   }
 
-  float JIdxJIdx_00 = 0, JIdxJIdx_11 = 0, JIdxJIdx_10 = 0;
-  float JabJIdx_00 = 0, JabJIdx_01 = 0, JabJIdx_10 = 0, JabJIdx_11 = 0;
-  float JabJab_00 = 0, JabJab_01 = 0, JabJab_11 = 0;
-
   float wJI2_sum = 0;
   float energyLeft = 0;  // total energy of this point (and the whole pattern)
-  for (int idx = 0; idx < patternNum; ++idx) {
-    float Ku, Kv;
-    if (!projectPoint(point->u + patternP[idx][0], point->v + patternP[idx][1],
-                      point->idepth_scaled, PRE_KRKiTll, PRE_KtTll, &Ku, &Kv)) {
+
+  bool vectorized = false;
+#if DSO_AVX_DISPATCH
+  if (kPattern == 8 && useAVX2() && dIlCompact == nullptr) {
+    if (!linearizePatternAVX2(PRE_KRKiTll, PRE_KtTll, affLL, b0, kOptA, kOptB,
+                              updateJacobians, &energyLeft, &wJI2_sum)) {
       state_NewState = ResState::OOB;
       return state_energy;
     }
+    vectorized = true;
+  }
+#endif
+
+  if (!vectorized) {
+    float JIdxJIdx_00 = 0, JIdxJIdx_11 = 0, JIdxJIdx_10 = 0;
+    float JabJIdx_00 = 0, JabJIdx_01 = 0, JabJIdx_10 = 0, JabJIdx_11 = 0;
+    float JabJab_00 = 0, JabJab_01 = 0, JabJab_11 = 0;
+
+    for (int idx = 0; idx < Pattern::num; ++idx) {
+      float Ku, Kv;
+      if (!projectPoint(point->u + pattern[idx][0],
+                        point->v + pattern[idx][1], point->idepth_scaled,
+                        PRE_KRKiTll, PRE_KtTll, calib, &Ku, &Kv)) {
+        state_NewState = ResState::OOB;
+        return state_energy;
+      }
+
+      projectedTo[idx][0] = Ku;
+      projectedTo[idx][1] = Kv;
+
+      // [intensity gx gy]
+      Vec3f hitColor =
+          dIlCompact != nullptr
+              ? getInterpolatedElement33(dIlCompact, Ku, Kv, calib.w[0])
+              : getInterpolatedElement33(dIl, Ku, Kv, calib.w[0]);
+      float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
+
+      float drdA = (color[idx] - b0);
+      if (!std::isfinite(hitColor[0])) {
+        state_NewState = ResState::OOB;
+        return state_energy;
+      }
+
+      float w = sqrtf(outlierTHSumComponent /
+                      (outlierTHSumComponent + hitColor.tail<2>().squaredNorm()));
+      w = 0.5f * (w + weights[idx]);
+
+      float hw = fabsf(residual) < huberTH ? 1 : huberTH / fabsf(residual);
+      energyLeft += w * w * hw * residual * residual * (2 - hw);
+
+      {
+        if (hw < 1) {
+          hw = sqrtf(hw);
+        }
+        hw = hw * w;
+
+        hitColor[1] *= hw;
+        hitColor[2] *= hw;
+
+        J->resF[idx] = residual * hw;
+        wJI2_sum +=
+            hw * hw * (hitColor[1] * hitColor[1] + hitColor[2] * hitColor[2]);
+        if (!updateJacobians) {
+          continue;
+        }
+
+        // ATTENTION: These two derivatives are computed using CURRENT ESTIMATE
+        J->JIdx[0][idx] = hitColor[1];
+        J->JIdx[1][idx] = hitColor[2];
+
+        // ATTENTION: These two derivatives are computed using FIRST ESTIMATE
+        J->JabF[0][idx] = kOptA ? drdA * hw : 0;
+        J->JabF[1][idx] = kOptB ? hw : 0;
+
+        JIdxJIdx_00 += hitColor[1] * hitColor[1];
+        JIdxJIdx_11 += hitColor[2] * hitColor[2];
+        JIdxJIdx_10 += hitColor[1] * hitColor[2];
+
+        JabJIdx_00 += drdA * hw * hitColor[1];
+        JabJIdx_01 += drdA * hw * hitColor[2];
+        JabJIdx_10 += hw * hitColor[1];
+        JabJIdx_11 += hw * hitColor[2];
+
+        JabJab_00 += drdA * drdA * hw * hw;
+        JabJab_01 += drdA * hw * hw;
+        JabJab_11 += hw * hw;
+      }
+    }
+
+    // the backend sums 4 points at once, the ones past the pattern must not
+    // contribute.
+    for (int idx = Pattern::num; idx < MAX_RES_PER_POINT; ++idx) {
+      J->resF[idx] = 0;
+      J->JIdx[0][idx] = J->JIdx[1][idx] = 0;
+      J->JabF[0][idx] = J->JabF[1][idx] = 0;
+    }
+
+    if (updateJacobians) {
+      J->JIdx2(0, 0) = JIdxJIdx_00;
+      J->JIdx2(0, 1) = JIdxJIdx_10;
+      J->JIdx2(1, 0) = JIdxJIdx_10;
+      J->JIdx2(1, 1) = JIdxJIdx_11;
+      J->JabJIdx(0, 0) = JabJIdx_00;
+      J->JabJIdx(0, 1) = JabJIdx_01;
+      J->JabJIdx(1, 0) = JabJIdx_10;
+      J->JabJIdx(1, 1) = JabJIdx_11;
+      J->Jab2(0, 0) = JabJab_00;
+      J->Jab2(0, 1) = JabJab_01;
+      J->Jab2(1, 0) = JabJab_01;
+      J->Jab2(1, 1) = JabJab_11;
+    }
+  }
+
+  state_NewEnergyWithOutlier = energyLeft;
+
+  if (energyLeft >
+          std::max<float>(host->frameEnergyTH, target->frameEnergyTH) ||
+      wJI2_sum < 2) {
+    // if the residual is too large, set it as outlier and return the energy
+    // threshold
+    energyLeft = std::max<float>(host->frameEnergyTH, target->frameEnergyTH);
+    state_NewState = ResState::OUTLIER;
+  } else {
+    state_NewState = ResState::IN;
+  }
+
+  state_NewEnergy = energyLeft;  // new energy will be set in applyRes()
+  return energyLeft;
+}
+
+double PointFrameResidual::linearize(CalibHessian* const HCalib,
+                                     const bool updateJacobians) {
+  const bool optA = !(host->settings->affineOptModeA < 0);
+  const bool optB = !(host->settings->affineOptModeB < 0);
+  return withPattern(host->settings->pattern, [&](auto p) {
+    constexpr int kPattern = decltype(p)::value;
+    if (optA && optB) {
+      return linearize<kPattern, true, true>(HCalib, updateJacobians);
+    } else if (optA) {
+      return linearize<kPattern, true, false>(HCalib, updateJacobians);
+    } else if (optB) {
+      return linearize<kPattern, false, true>(HCalib, updateJacobians);
+    }
+    return linearize<kPattern, false, false>(HCalib, updateJacobians);
+  });
+}
+
+template <int kPattern>
+double PointFrameResidual::evalEnergy(const FrameFramePrecalc& precalc,
+                                      const float idepthScaled,
+                                      CalibHessian* const HCalib) const {
+  typedef ResidualPattern<kPattern> Pattern;
+  const CalibContext& calib = *host->calib;
+  const int(*const pattern)[2] = Pattern::offsets();
+  const float huberTH = host->settings->huberTH;
+  const float outlierTHSumComponent = host->settings->outlierTHSumComponent;
+  if (state_state == ResState::OOB) {
+    return state_energy;
+  }
+
+  {
+    float drescale, new_idepth, u, v, Ku, Kv;
+    Vec3f KliP;
+    if (!projectPoint(point->u, point->v, idepthScaled, 0, 0, HCalib,
+                      precalc.PRE_RTll_0, precalc.PRE_tTll_0, &drescale, &u,
+                      &v, &Ku, &Kv, &KliP, &new_idepth)) {
+      return state_energy;
+    }
+  }
 
-    projectedTo[idx][0] = Ku;
-    projectedTo[idx][1] = Kv;
+  const Eigen::Vector3f* dIl = target->dI;
+  const CompactPixel* dIlCompact = target->dICompact;
+  const float* const color = point->color;
+  const float* const weights = point->weights;
+  const Vec2f affLL = precalc.PRE_aff_mode;
 
-    // [intensity gx gy]
-    Vec3f hitColor = (getInterpolatedElement33(dIl, Ku, Kv, wG[0]));
-    float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
+  float wJI2_sum = 0;
+  float energyLeft = 0;
+  for (int idx = 0; idx < Pattern::num; ++idx) {
+    float Ku, Kv;
+    if (!projectPoint(point->u + pattern[idx][0], point->v + pattern[idx][1],
+                      idepthScaled, precalc.PRE_KRKiTll, precalc.PRE_KtTll,
+                      calib, &Ku, &Kv)) {
+      return state_energy;
+    }
 
-    float drdA = (color[idx] - b0);
+    const Vec3f hitColor =
+        dIlCompact != nullptr
+            ? getInterpolatedElement33(dIlCompact, Ku, Kv, calib.w[0])
+            : getInterpolatedElement33(dIl, Ku, Kv, calib.w[0]);
     if (!std::isfinite(hitColor[0])) {
-      state_NewState = ResState::OOB;
       return state_energy;
     }
+    const float residual = hitColor[0] - (affLL[0] * color[idx] + affLL[1]);
 
-    float w = sqrtf(
-        setting_outlierTHSumComponent /
-        (setting_outlierTHSumComponent + hitColor.tail<2>().squaredNorm()));
+    float w = sqrtf(outlierTHSumComponent /
+                    (outlierTHSumComponent + hitColor.tail<2>().squaredNorm()));
     w = 0.5f * (w + weights[idx]);
 
-    float hw = fabsf(residual) < setting_huberTH ? 1 : setting_huberTH /
-                                                           fabsf(residual);
+    float hw = fabsf(residual) < huberTH ? 1 : huberTH / fabsf(residual);
     energyLeft += w * w * hw * residual * residual * (2 - hw);
 
-    {
-      if (hw < 1) {
-        hw = sqrtf(hw);
-      }
-      hw = hw * w;
+    if (hw < 1) {
+      hw = sqrtf(hw);
+    }
+    hw = hw * w;
+    wJI2_sum += hw * hw * hitColor.tail<2>().squaredNorm();
+  }
 
-      hitColor[1] *= hw;
-      hitColor[2] *= hw;
+  if (energyLeft >
+          std::max<float>(host->frameEnergyTH, target->frameEnergyTH) ||
+      wJI2_sum < 2) {
+    energyLeft = std::max<float>(host->frameEnergyTH, target->frameEnergyTH);
+  }
+  return energyLeft;
+}
 
-      J->resF[idx] = residual * hw;
+double PointFrameResidual::evalEnergy(const FrameFramePrecalc& precalc,
+                                      const float idepthScaled,
+                                      CalibHessian* const HCalib) const {
+  return withPattern(host->settings->pattern, [&](auto p) {
+    return evalEnergy<decltype(p)::value>(precalc, idepthScaled, HCalib);
+  });
+}
 
-      // ATTENTION: These two derivatives are computed using CURRENT ESTIMATE
-      J->JIdx[0][idx] = hitColor[1];
-      J->JIdx[1][idx] = hitColor[2];
+#if DSO_AVX_DISPATCH
+namespace {
+DSO_TARGET_AVX inline float horizontalSum(const __m256 v) {
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  s = _mm_hadd_ps(s, s);
+  s = _mm_hadd_ps(s, s);
+  return _mm_cvtss_f32(s);
+}
+}  // namespace
+
+DSO_TARGET_AVX2 bool PointFrameResidual::linearizePatternAVX2(
+    const Mat33f& KRKi, const Vec3f& Kt, const Vec2f& affLL, const float b0,
+    const bool optA, const bool optB, const bool updateJacobians,
+    float* const energyLeft, float* const wJI2_sum) {
+  static_assert(ResidualPattern<8>::num == 8, "one AVX register per pattern");
+  const Settings& settings = *host->settings;
+  const CalibContext& calib = *host->calib;
+  const int(*const pattern)[2] = ResidualPattern<8>::offsets();
+
+  EIGEN_ALIGN32 float px[8], py[8];
+  for (int idx = 0; idx < 8; ++idx) {
+    px[idx] = point->u + pattern[idx][0];
+    py[idx] = point->v + pattern[idx][1];
+  }
+  const __m256 x = _mm256_load_ps(px);
+  const __m256 y = _mm256_load_ps(py);
+  const __m256 id = _mm256_set1_ps(point->idepth_scaled);
+
+  // ptp = KRKi * (x, y, 1) + Kt * idepth
+  __m256 ptp[3];
+  for (int r = 0; r < 3; ++r) {
+    const __m256 rx = _mm256_mul_ps(_mm256_set1_ps(KRKi(r, 0)), x);
+    const __m256 ry = _mm256_mul_ps(_mm256_set1_ps(KRKi(r, 1)), y);
+    ptp[r] = _mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(rx, ry), _mm256_set1_ps(KRKi(r, 2))),
+        _mm256_mul_ps(_mm256_set1_ps(Kt[r]), id));
+  }
+  const __m256 Ku = _mm256_div_ps(ptp[0], ptp[2]);
+  const __m256 Kv = _mm256_div_ps(ptp[1], ptp[2]);
+
+  EIGEN_ALIGN32 float lane_Ku[8], lane_Kv[8];
+  _mm256_store_ps(lane_Ku, Ku);
+  _mm256_store_ps(lane_Kv, Kv);
+  for (int idx = 0; idx < 8; ++idx) {
+    projectedTo[idx][0] = lane_Ku[idx];
+    projectedTo[idx][1] = lane_Kv[idx];
+  }
 
-      // ATTENTION: These two derivatives are computed using FIRST ESTIMATE
-      J->JabF[0][idx] = drdA * hw;
-      J->JabF[1][idx] = hw;
+  const __m256 minK = _mm256_set1_ps(1.1f);
+  const __m256 inside = _mm256_and_ps(
+      _mm256_and_ps(_mm256_cmp_ps(Ku, minK, _CMP_GT_OQ),
+                    _mm256_cmp_ps(Kv, minK, _CMP_GT_OQ)),
+      _mm256_and_ps(_mm256_cmp_ps(Ku, _mm256_set1_ps(calib.wM3), _CMP_LT_OQ),
+                    _mm256_cmp_ps(Kv, _mm256_set1_ps(calib.hM3), _CMP_LT_OQ)));
+  if (_mm256_movemask_ps(inside) != 0xff) {
+    return false;
+  }
 
-      JIdxJIdx_00 += hitColor[1] * hitColor[1];
-      JIdxJIdx_11 += hitColor[2] * hitColor[2];
-      JIdxJIdx_10 += hitColor[1] * hitColor[2];
+  // bilinear interpolation of [intensity gx gy].
+  const __m256i ix = _mm256_cvttps_epi32(Ku);
+  const __m256i iy = _mm256_cvttps_epi32(Kv);
+  const __m256 dx = _mm256_sub_ps(Ku, _mm256_cvtepi32_ps(ix));
+  const __m256 dy = _mm256_sub_ps(Kv, _mm256_cvtepi32_ps(iy));
+  const __m256 dxdy = _mm256_mul_ps(dx, dy);
+  const __m256 one = _mm256_set1_ps(1);
+  const __m256 w11 = dxdy;
+  const __m256 w01 = _mm256_sub_ps(dy, dxdy);
+  const __m256 w10 = _mm256_sub_ps(dx, dxdy);
+  const __m256 w00 =
+      _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(one, dx), dy), dxdy);
+  const int wl = calib.w[0];
+  const __m256i base = _mm256_mullo_epi32(
+      _mm256_add_epi32(ix, _mm256_mullo_epi32(iy, _mm256_set1_epi32(wl))),
+      _mm256_set1_epi32(3));
+  const float* const dIl = reinterpret_cast<const float*>(target->dI);
+
+  __m256 hit[3];
+  for (int c = 0; c < 3; ++c) {
+    const float* img = dIl + c;
+    hit[c] = _mm256_add_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(
+                _mm256_mul_ps(w11,
+                              _mm256_i32gather_ps(img + 3 * wl + 3, base, 4)),
+                _mm256_mul_ps(w01, _mm256_i32gather_ps(img + 3 * wl, base, 4))),
+            _mm256_mul_ps(w10, _mm256_i32gather_ps(img + 3, base, 4))),
+        _mm256_mul_ps(w00, _mm256_i32gather_ps(img, base, 4)));
+  }
 
-      JabJIdx_00 += drdA * hw * hitColor[1];
-      JabJIdx_01 += drdA * hw * hitColor[2];
-      JabJIdx_10 += hw * hitColor[1];
-      JabJIdx_11 += hw * hitColor[2];
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256 finite =
+      _mm256_cmp_ps(_mm256_and_ps(hit[0], absMask),
+                    _mm256_set1_ps(std::numeric_limits<float>::infinity()),
+                    _CMP_LT_OQ);
+  if (_mm256_movemask_ps(finite) != 0xff) {
+    return false;
+  }
 
-      JabJab_00 += drdA * drdA * hw * hw;
-      JabJab_01 += drdA * hw * hw;
-      JabJab_11 += hw * hw;
+  const __m256 color = _mm256_loadu_ps(point->color);
+  const __m256 residual = _mm256_sub_ps(
+      hit[0], _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(affLL[0]), color),
+                            _mm256_set1_ps(affLL[1])));
+  const __m256 drdA = _mm256_sub_ps(color, _mm256_set1_ps(b0));
+
+  const __m256 thSum = _mm256_set1_ps(settings.outlierTHSumComponent);
+  __m256 w = _mm256_sqrt_ps(_mm256_div_ps(
+      thSum,
+      _mm256_add_ps(thSum, _mm256_add_ps(_mm256_mul_ps(hit[1], hit[1]),
+                                         _mm256_mul_ps(hit[2], hit[2])))));
+  w = _mm256_mul_ps(_mm256_set1_ps(0.5f),
+                    _mm256_add_ps(w, _mm256_loadu_ps(point->weights)));
+
+  const __m256 huberTH = _mm256_set1_ps(settings.huberTH);
+  const __m256 absRes = _mm256_and_ps(residual, absMask);
+  const __m256 huber = _mm256_cmp_ps(absRes, huberTH, _CMP_LT_OQ);
+  __m256 hw = _mm256_blendv_ps(_mm256_div_ps(huberTH, absRes), one, huber);
+  const __m256 energy = _mm256_mul_ps(
+      _mm256_mul_ps(
+          _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(w, w), hw), residual),
+          residual),
+      _mm256_sub_ps(_mm256_set1_ps(2), hw));
+
+  hw = _mm256_mul_ps(_mm256_blendv_ps(_mm256_sqrt_ps(hw), hw, huber), w);
+  const __m256 gx = _mm256_mul_ps(hit[1], hw);
+  const __m256 gy = _mm256_mul_ps(hit[2], hw);
+  const __m256 drdAhw = _mm256_mul_ps(drdA, hw);
+  const __m256 hwhw = _mm256_mul_ps(hw, hw);
+  const __m256 gxgx = _mm256_mul_ps(gx, gx);
+  const __m256 gygy = _mm256_mul_ps(gy, gy);
+
+  _mm256_storeu_ps(J->resF.data(), _mm256_mul_ps(residual, hw));
+  *energyLeft = horizontalSum(energy);
+  *wJI2_sum = horizontalSum(_mm256_mul_ps(hwhw, _mm256_add_ps(gxgx, gygy)));
+  if (!updateJacobians) {
+    return true;
+  }
 
-      wJI2_sum +=
-          hw * hw * (hitColor[1] * hitColor[1] + hitColor[2] * hitColor[2]);
+  _mm256_storeu_ps(J->JIdx[0].data(), gx);
+  _mm256_storeu_ps(J->JIdx[1].data(), gy);
+  _mm256_storeu_ps(J->JabF[0].data(), optA ? drdAhw : _mm256_setzero_ps());
+  _mm256_storeu_ps(J->JabF[1].data(), optB ? hw : _mm256_setzero_ps());
 
-      if (setting_affineOptModeA < 0) {
-        J->JabF[0][idx] = 0;
-      }
-      if (setting_affineOptModeB < 0) {
-        J->JabF[1][idx] = 0;
-      }
-    }
-  }
+  const float JIdxJIdx_00 = horizontalSum(gxgx);
+  const float JIdxJIdx_11 = horizontalSum(gygy);
+  const float JIdxJIdx_10 = horizontalSum(_mm256_mul_ps(gx, gy));
+  const float JabJab_01 = horizontalSum(_mm256_mul_ps(drdAhw, hw));
 
   J->JIdx2(0, 0) = JIdxJIdx_00;
   J->JIdx2(0, 1) = JIdxJIdx_10;
   J->JIdx2(1, 0) = JIdxJIdx_10;
   J->JIdx2(1, 1) = JIdxJIdx_11;
-  J->JabJIdx(0, 0) = JabJIdx_00;
-  J->JabJIdx(0, 1) = JabJIdx_01;
-  J->JabJIdx(1, 0) = JabJIdx_10;
-  J->JabJIdx(1, 1) = JabJIdx_11;
-  J->Jab2(0, 0) = JabJab_00;
+  J->JabJIdx(0, 0) = horizontalSum(_mm256_mul_ps(drdAhw, gx));
+  J->JabJIdx(0, 1) = horizontalSum(_mm256_mul_ps(drdAhw, gy));
+  J->JabJIdx(1, 0) = horizontalSum(_mm256_mul_ps(hw, gx));
+  J->JabJIdx(1, 1) = horizontalSum(_mm256_mul_ps(hw, gy));
+  J->Jab2(0, 0) = horizontalSum(_mm256_mul_ps(drdAhw, drdAhw));
   J->Jab2(0, 1) = JabJab_01;
   J->Jab2(1, 0) = JabJab_01;
-  J->Jab2(1, 1) = JabJab_11;
-
-  state_NewEnergyWithOutlier = energyLeft;
-
-  if (energyLeft >
-          std::max<float>(host->frameEnergyTH, target->frameEnergyTH) ||
-      wJI2_sum < 2) {
-    // if the residual is too large, set it as outlier and return the energy
-    // threshold
-    energyLeft = std::max<float>(host->frameEnergyTH, target->frameEnergyTH);
-    state_NewState = ResState::OUTLIER;
-  } else {
-    state_NewState = ResState::IN;
-  }
-
-  state_NewEnergy = energyLeft;  // new energy will be set in applyRes()
-  return energyLeft;
+  J->Jab2(1, 1) = horizontalSum(hwhw);
+  return true;
 }
+#endif
 
 void PointFrameResidual::debugPlot() {
+  const CalibContext& calib = *host->calib;
   if (state_state == ResState::OOB) {
     return;
   }
@@ -289,9 +589,10 @@ void PointFrameResidual::debugPlot() {
     }
   }
 
-  for (int i = 0; i < patternNum; ++i) {
+  for (int i = 0; i < staticPatternNum[host->settings->pattern]; ++i) {
     if ((projectedTo[i][0] > 2 && projectedTo[i][1] > 2 &&
-         projectedTo[i][0] < wG[0] - 3 && projectedTo[i][1] < hG[0] - 3)) {
+         projectedTo[i][0] < calib.w[0] - 3 &&
+         projectedTo[i][1] < calib.h[0] - 3)) {
       target->debugImage->setPixel1((float)projectedTo[i][0],
                                     (float)projectedTo[i][1], cT);
     }
@@ -306,7 +607,7 @@ void PointFrameResidual::applyRes(const bool copyJacobians) {
     }
     if (state_NewState == ResState::IN) {
       efResidual->isActiveAndIsGoodNEW = true;
-      efResidual->takeDataF();
+      efResidual->takeDataF(host->settings->compactJacobians);
     } else {
       efResidual->isActiveAndIsGoodNEW = false;
     }
@@ -1,5 +1,7 @@
 #include "full_system/tracker/coarse_distance_map.h"
 
+#include <algorithm>
+
 #include <glog/logging.h>
 
 #include "full_system/hessian_blocks/hessian_blocks.h"
@@ -7,13 +9,20 @@
 
 namespace dso {
 
-CoarseDistanceMap::CoarseDistanceMap(int ww, int hh) {
+CoarseDistanceMap::CoarseDistanceMap(const CalibContext& calib)
+    : calib(calib) {
+  const int ww = calib.w[0];
+  const int hh = calib.h[0];
   fwdWarpedIDDistFinal = new float[ww * hh / 4];
 
   bfsList1 = new Eigen::Vector2i[ww * hh / 4];
   bfsList2 = new Eigen::Vector2i[ww * hh / 4];
 
-  int fac = 1 << (PYR_LEVELS_USED - 1);
+  distWork = new int[ww * hh / 4];
+  rowVert = new int[ww / 2 + 2];
+  rowDiag = new int[ww / 2 + 2];
+
+  int fac = 1 << (calib.pyrLevelsUsed - 1);
 
   coarseProjectionGrid =
       new PointFrameResidual*[2048 * (ww * hh / (fac * fac))];
@@ -26,30 +35,32 @@ CoarseDistanceMap::~CoarseDistanceMap() {
   delete[] fwdWarpedIDDistFinal;
   delete[] bfsList1;
   delete[] bfsList2;
+  delete[] distWork;
+  delete[] rowVert;
+  delete[] rowDiag;
   delete[] coarseProjectionGrid;
   delete[] coarseProjectionGridNum;
 }
 
+const int CoarseDistanceMap::kDistInf;
+
 void CoarseDistanceMap::makeDistanceMap(
-    std::vector<FrameHessian*> frameHessians, FrameHessian* frame) {
+    const std::vector<FrameHessian*>& frameHessians, FrameHessian* frame) {
   int w1 = w[1];
   int h1 = h[1];
   int wh1 = w1 * h1;
-  for (int i = 0; i < wh1; ++i) {
-    fwdWarpedIDDistFinal[i] = 1000;
-  }
+  std::fill(distWork, distWork + wh1, kDistInf);
 
   // make coarse tracking templates for latstRef.
-  int numItems = 0;
 
   for (FrameHessian* fh : frameHessians) {
     if (frame == fh) {
       continue;
     }
 
-    SE3 fhToNew = frame->PRE_worldToCam * fh->PRE_camToWorld;
-    Mat33f KRKi = (K[1] * fhToNew.rotationMatrix().cast<float>() * Ki[0]);
-    Vec3f Kt = (K[1] * fhToNew.translation().cast<float>());
+    const SE3f fhToNew = frame->hostToThisF(fh);
+    const Mat33f KRKi = K[1] * fhToNew.rotationMatrix() * Ki[0];
+    const Vec3f Kt = K[1] * fhToNew.translation();
 
     for (PointHessian* ph : fh->pointHessians) {
       CHECK_EQ(ph->status, PointHessian::ACTIVE);
@@ -59,13 +70,78 @@ void CoarseDistanceMap::makeDistanceMap(
       if (!(u > 0 && v > 0 && u < w[1] && v < h[1])) {
         continue;
       }
-      fwdWarpedIDDistFinal[u + w1 * v] = 0;
-      bfsList1[numItems] = Eigen::Vector2i(u, v);
-      ++numItems;
+      distWork[u + w1 * v] = 0;
     }
   }
 
-  growDistBFS(numItems);
+  growDistTwoPass();
+
+  // growDistBFS stops after 39 steps.
+  for (int i = 0; i < wh1; ++i) {
+    fwdWarpedIDDistFinal[i] = distWork[i] < 40 ? distWork[i] : kDistInf;
+  }
+}
+
+void CoarseDistanceMap::distFromRow(int* row, const int* src) {
+  const int w1 = w[1];
+  // rowVert / rowDiag[x + 1]: what pixel x of src passes on vertically /
+  // diagonally. Border columns and odd distances do not go diagonal.
+  rowVert[0] = rowDiag[0] = kDistInf;
+  rowVert[1] = rowDiag[1] = kDistInf;
+  for (int x = 1; x < w1 - 1; ++x) {
+    rowVert[x + 1] = src[x];
+    rowDiag[x + 1] = (src[x] & 1) ? kDistInf : src[x];
+  }
+  rowVert[w1] = rowDiag[w1] = kDistInf;
+  rowVert[w1 + 1] = rowDiag[w1 + 1] = kDistInf;
+
+  for (int x = 0; x < w1; ++x) {
+    const int d =
+        std::min(rowVert[x + 1], std::min(rowDiag[x], rowDiag[x + 2])) + 1;
+    row[x] = std::min(row[x], d);
+  }
+}
+
+void CoarseDistanceMap::growDistTwoPass() {
+  CHECK_NE(w[0], 0);
+  const int w1 = w[1], h1 = h[1];
+
+  // within a row, in both directions (from interior pixels only).
+  auto alongRow = [w1](int* row) {
+    int run = row[1];
+    for (int x = 2; x < w1; ++x) {
+      run = std::min(row[x], run + 1);
+      row[x] = run;
+    }
+    run = row[w1 - 2];
+    for (int x = w1 - 3; x >= 0; --x) {
+      run = std::min(row[x], run + 1);
+      row[x] = run;
+    }
+  };
+
+  // down: rows 1 .. h1 - 1 from the row above, the border rows 0 and h1 - 1
+  // neither pass on down nor along.
+  for (int y = 1; y < h1 - 1; ++y) {
+    if (y > 1) {
+      distFromRow(distWork + y * w1, distWork + (y - 1) * w1);
+    }
+    alongRow(distWork + y * w1);
+  }
+  if (h1 > 2) {
+    distFromRow(distWork + (h1 - 1) * w1, distWork + (h1 - 2) * w1);
+  }
+
+  // up: rows h1 - 2 .. 0 from the row below.
+  for (int y = h1 - 2; y >= 1; --y) {
+    if (y < h1 - 2) {
+      distFromRow(distWork + y * w1, distWork + (y + 1) * w1);
+    }
+    alongRow(distWork + y * w1);
+  }
+  if (h1 > 2) {
+    distFromRow(distWork, distWork + w1);
+  }
 }
 
 void CoarseDistanceMap::growDistBFS(int bfsNum) {
@@ -171,15 +247,15 @@ void CoarseDistanceMap::addIntoDistFinal(int u, int v) {
 }
 
 void CoarseDistanceMap::makeK(CalibHessian* HCalib) {
-  w[0] = wG[0];
-  h[0] = hG[0];
+  w[0] = calib.w[0];
+  h[0] = calib.h[0];
 
   fx[0] = HCalib->fxl();
   fy[0] = HCalib->fyl();
   cx[0] = HCalib->cxl();
   cy[0] = HCalib->cyl();
 
-  for (int level = 1; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 1; level < calib.pyrLevelsUsed; ++level) {
     w[level] = w[0] >> level;
     h[level] = h[0] >> level;
     fx[level] = fx[level - 1] * 0.5;
@@ -188,7 +264,7 @@ void CoarseDistanceMap::makeK(CalibHessian* HCalib) {
     cy[level] = (cy[0] + 0.5) / (1 << level) - 0.5;
   }
 
-  for (int level = 0; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 0; level < calib.pyrLevelsUsed; ++level) {
     K[level] << fx[level], 0.0, cx[level], 0.0, fy[level], cy[level], 0.0, 0.0,
         1.0;
     Ki[level] = K[level].inverse();
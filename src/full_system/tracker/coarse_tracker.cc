@@ -1,12 +1,18 @@
 #include "full_system/tracker/coarse_tracker.h"
 
+#include <stdint.h>
+#include <string.h>
+
 #include <algorithm>
+#include <atomic>
 
 #include "full_system/full_system.h"
 #include "full_system/hessian_blocks/hessian_blocks.h"
 #include "full_system/residuals.h"
+#include "full_system/tracker/coarse_tracker_cuda.h"
 #include "io_wrapper/image_rw.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
+#include "util/stage_timing.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
 #include "SSE2NEON.h"
@@ -14,6 +20,30 @@
 
 namespace dso {
 
+namespace {
+// CoarseTracker::refVersion of the next reference, unique over all trackers.
+std::atomic<int> nextRefVersion(0);
+
+//! H_out, b_out of calcGSSSE from the Accumulator9 sums H of n warped points.
+void scaleGS(const Mat99f& H, const int n, Mat88* H_out, Vec8* b_out) {
+  *H_out = H.topLeftCorner<8, 8>().cast<double>() * (1.0f / n);
+  *b_out = H.topRightCorner<8, 1>().cast<double>() * (1.0f / n);
+
+  H_out->block<8, 3>(0, 0) *= SCALE_XI_ROT;
+  H_out->block<8, 3>(0, 3) *= SCALE_XI_TRANS;
+  H_out->block<8, 1>(0, 6) *= SCALE_A;
+  H_out->block<8, 1>(0, 7) *= SCALE_B;
+  H_out->block<3, 8>(0, 0) *= SCALE_XI_ROT;
+  H_out->block<3, 8>(3, 0) *= SCALE_XI_TRANS;
+  H_out->block<1, 8>(6, 0) *= SCALE_A;
+  H_out->block<1, 8>(7, 0) *= SCALE_B;
+  b_out->segment<3>(0) *= SCALE_XI_ROT;
+  b_out->segment<3>(3) *= SCALE_XI_TRANS;
+  b_out->segment<1>(6) *= SCALE_A;
+  b_out->segment<1>(7) *= SCALE_B;
+}
+}  // namespace
+
 template <int b, typename T>
 T* allocAligned(int size, std::vector<T*>& rawPtrVec) {
   const int padT = 1 + ((1 << b) / sizeof(T));
@@ -23,12 +53,23 @@ T* allocAligned(int size, std::vector<T*>& rawPtrVec) {
   return alignedPtr;
 }
 
-CoarseTracker::CoarseTracker(int ww, int hh) : lastRef_aff_g2l(0, 0) {
+CoarseTracker::CoarseTracker(const CalibContext& calib,
+                             const Settings& settings, bool allocReference)
+    : lastRef_aff_g2l(0, 0), calib(calib), settings(settings) {
+  const int ww = calib.w[0];
+  const int hh = calib.h[0];
   // make coarse tracking templates.
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
     int wl = ww >> lvl;
     int hl = hh >> lvl;
 
+    if (!allocReference) {
+      idepth[lvl] = weightSums[lvl] = weightSums_bak[lvl] = nullptr;
+      pc_u[lvl] = pc_v[lvl] = pc_idepth[lvl] = pc_color[lvl] = nullptr;
+      pc_n[lvl] = pc_nSubset[lvl] = 0;
+      continue;
+    }
+
     idepth[lvl] = allocAligned<4, float>(wl * hl, ptrToDelete);
     weightSums[lvl] = allocAligned<4, float>(wl * hl, ptrToDelete);
     weightSums_bak[lvl] = allocAligned<4, float>(wl * hl, ptrToDelete);
@@ -39,21 +80,36 @@ CoarseTracker::CoarseTracker(int ww, int hh) : lastRef_aff_g2l(0, 0) {
     pc_color[lvl] = allocAligned<4, float>(wl * hl, ptrToDelete);
   }
 
-  // warped buffers
-  buf_warped_idepth = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_u = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_v = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_dx = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_dy = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_residual = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_weight = allocAligned<4, float>(ww * hh, ptrToDelete);
-  buf_warped_refColor = allocAligned<4, float>(ww * hh, ptrToDelete);
+  // warped buffers, 32 byte aligned for the AVX kernels.
+  buf_warped_idepth = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_u = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_v = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_dx = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_dy = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_residual = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_weight = allocAligned<5, float>(ww * hh, ptrToDelete);
+  buf_warped_refColor = allocAligned<5, float>(ww * hh, ptrToDelete);
 
   newFrame = 0;
   lastRef = 0;
   debugPlot = debugPrint = true;
   w[0] = h[0] = 0;
   refFrameID = -1;
+  lastOutOfTime = false;
+
+  gpu = nullptr;
+  refVersion = -1;
+  gpuResValid = false;
+#if defined(HAS_CUDA)
+  if (settings.coarseTrackingGPU) {
+    if (CoarseTrackerCuda::deviceAvailable()) {
+      gpu = new CoarseTrackerCuda(calib.w, calib.h, calib.pyrLevelsUsed);
+    } else {
+      LOG_FIRST_N(WARNING, 1)
+          << "Bool.CoarseTrackingGPU: no CUDA device, tracking on the CPU.";
+    }
+  }
+#endif
 }
 
 CoarseTracker::~CoarseTracker() {
@@ -61,18 +117,52 @@ CoarseTracker::~CoarseTracker() {
     delete[] ptr;
   }
   ptrToDelete.clear();
+#if defined(HAS_CUDA)
+  delete gpu;
+#endif
+}
+
+void CoarseTracker::shareReference(const CoarseTracker& other) {
+  for (int lvl = 0; lvl < PYR_LEVELS; ++lvl) {
+    K[lvl] = other.K[lvl];
+    Ki[lvl] = other.Ki[lvl];
+    fx[lvl] = other.fx[lvl];
+    fy[lvl] = other.fy[lvl];
+    fxi[lvl] = other.fxi[lvl];
+    fyi[lvl] = other.fyi[lvl];
+    cx[lvl] = other.cx[lvl];
+    cy[lvl] = other.cy[lvl];
+    cxi[lvl] = other.cxi[lvl];
+    cyi[lvl] = other.cyi[lvl];
+    w[lvl] = other.w[lvl];
+    h[lvl] = other.h[lvl];
+  }
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
+    pc_u[lvl] = other.pc_u[lvl];
+    pc_v[lvl] = other.pc_v[lvl];
+    pc_idepth[lvl] = other.pc_idepth[lvl];
+    pc_color[lvl] = other.pc_color[lvl];
+    pc_n[lvl] = other.pc_n[lvl];
+    pc_nSubset[lvl] = other.pc_nSubset[lvl];
+  }
+
+  lastRef = other.lastRef;
+  lastRef_aff_g2l = other.lastRef_aff_g2l;
+  refFrameID = other.refFrameID;
+  refVersion = other.refVersion;
+  firstCoarseRMSE = other.firstCoarseRMSE;
 }
 
 void CoarseTracker::makeK(CalibHessian* HCalib) {
-  w[0] = wG[0];
-  h[0] = hG[0];
+  w[0] = calib.w[0];
+  h[0] = calib.h[0];
 
   fx[0] = HCalib->fxl();
   fy[0] = HCalib->fyl();
   cx[0] = HCalib->cxl();
   cy[0] = HCalib->cyl();
 
-  for (int level = 1; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 1; level < calib.pyrLevelsUsed; ++level) {
     w[level] = w[0] >> level;
     h[level] = h[0] >> level;
     fx[level] = fx[level - 1] * 0.5;
@@ -81,7 +171,7 @@ void CoarseTracker::makeK(CalibHessian* HCalib) {
     cy[level] = (cy[0] + 0.5) / ((int)1 << level) - 0.5;
   }
 
-  for (int level = 0; level < PYR_LEVELS_USED; ++level) {
+  for (int level = 0; level < calib.pyrLevelsUsed; ++level) {
     K[level] << fx[level], 0.0, cx[level], 0.0, fy[level], cy[level], 0.0, 0.0,
         1.0;
     Ki[level] = K[level].inverse();
@@ -92,8 +182,238 @@ void CoarseTracker::makeK(CalibHessian* HCalib) {
   }
 }
 
-void CoarseTracker::makeCoarseDepthL0(
-    std::vector<FrameHessian*> frameHessians) {
+namespace {
+
+//! rows of all levels one worker takes at a time in makeCoarseDepthPyramid.
+const int kRowsPerTask = 16;
+
+//! cell size in pixels of the stratification in makeSubset.
+const int kSubsetCell = 8;
+
+/** \brief dst[x] = sum of the 2x2 block (2x, 0) of rows a and b, x < wl
+ *
+ *  Same summation order as the scalar ((a0 + a1) + b0) + b1, so the pyramid
+ *  does not depend on whether the SSE path is taken.
+ */
+inline void downsampleRow(const float* a, const float* b, float* dst,
+                          const int wl) {
+  int x = 0;
+  for (; x + 4 <= wl; x += 4) {
+    const __m128 a0 = _mm_loadu_ps(a + 2 * x);
+    const __m128 a1 = _mm_loadu_ps(a + 2 * x + 4);
+    const __m128 b0 = _mm_loadu_ps(b + 2 * x);
+    const __m128 b1 = _mm_loadu_ps(b + 2 * x + 4);
+    __m128 sum = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)),
+                            _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm_storeu_ps(dst + x, sum);
+  }
+  for (; x < wl; ++x) {
+    dst[x] = a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1];
+  }
+}
+
+}  // namespace
+
+int CoarseTracker::levelOfRow(const int row, int* y) const {
+  int lvl = 0;
+  while (row >= pyrRowStart[lvl + 1]) {
+    ++lvl;
+  }
+  *y = row - pyrRowStart[lvl];
+  return lvl;
+}
+
+void CoarseTracker::forAllRows(
+    void (CoarseTracker::*fn)(int, int, Vec10*, int),
+    IndexThreadReduce<Vec10>* red) {
+  const int nRows = pyrRowStart[calib.pyrLevelsUsed];
+  if (red != nullptr) {
+    red->reduce(boost::bind(fn, this, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, nRows, kRowsPerTask);
+  } else {
+    (this->*fn)(0, nRows, nullptr, 0);
+  }
+}
+
+void CoarseTracker::dilateRows(int min, int max, Vec10* stats, int tid) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  for (int row = min; row < max; ++row) {
+    int y;
+    const int lvl = levelOfRow(row, &y);
+    const int wl = w[lvl];
+    if (y < 1 || y >= h[lvl] - 1) {
+      continue;
+    }
+
+    // levels 0 and 1 take the diagonal neighbours, the others the direct ones.
+    int n[4];
+    if (lvl < 2) {
+      n[0] = 1 + wl, n[1] = -1 - wl, n[2] = wl - 1, n[3] = -wl + 1;
+    } else {
+      n[0] = 1, n[1] = -1, n[2] = wl, n[3] = -wl;
+    }
+
+    float* weightSumsl = weightSums[lvl];
+    const float* weightSumsl_bak = weightSums_bak[lvl];
+    // Don't need to make a temp copy of depth, since I only read values with
+    // weightSumsl>0, and write ones with weightSumsl<=0. For the same reason
+    // the rows can be dilated in any order.
+    float* idepthl = idepth[lvl];
+    const int end = (y + 1) * wl;
+    int i = y * wl;
+
+    // branch free: adding the 0 of a masked out neighbour keeps the sums
+    // bitwise equal to the scalar ones.
+    for (; i + 4 <= end; i += 4) {
+      const __m128 empty =
+          _mm_cmple_ps(_mm_loadu_ps(weightSumsl_bak + i), zero);
+      if (_mm_movemask_ps(empty) == 0) {
+        continue;
+      }
+      __m128 sum = zero, num = zero, numn = zero;
+      for (int k = 0; k < 4; ++k) {
+        const __m128 wk = _mm_loadu_ps(weightSumsl_bak + i + n[k]);
+        const __m128 set = _mm_cmpgt_ps(wk, zero);
+        sum = _mm_add_ps(sum,
+                         _mm_and_ps(set, _mm_loadu_ps(idepthl + i + n[k])));
+        num = _mm_add_ps(num, _mm_and_ps(set, wk));
+        numn = _mm_add_ps(numn, _mm_and_ps(set, one));
+      }
+      const __m128 write = _mm_and_ps(empty, _mm_cmpgt_ps(numn, zero));
+      const __m128 id = _mm_loadu_ps(idepthl + i);
+      const __m128 ws = _mm_loadu_ps(weightSumsl + i);
+      _mm_storeu_ps(idepthl + i,
+                    _mm_or_ps(_mm_and_ps(write, _mm_div_ps(sum, numn)),
+                              _mm_andnot_ps(write, id)));
+      _mm_storeu_ps(weightSumsl + i,
+                    _mm_or_ps(_mm_and_ps(write, _mm_div_ps(num, numn)),
+                              _mm_andnot_ps(write, ws)));
+    }
+
+    for (; i < end; ++i) {
+      if (weightSumsl_bak[i] <= 0) {
+        float sum = 0, num = 0, numn = 0;
+        for (int k = 0; k < 4; ++k) {
+          if (weightSumsl_bak[i + n[k]] > 0) {
+            sum += idepthl[i + n[k]];
+            num += weightSumsl_bak[i + n[k]];
+            ++numn;
+          }
+        }
+        if (numn > 0) {
+          idepthl[i] = sum / numn;
+          weightSumsl[i] = num / numn;
+        }
+      }
+    }
+  }
+}
+
+void CoarseTracker::normalizeRows(int min, int max, Vec10* stats, int tid) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1);
+  const __m128 minusOne = _mm_set1_ps(-1);
+  for (int row = min; row < max; ++row) {
+    int y;
+    const int lvl = levelOfRow(row, &y);
+    const int wl = w[lvl];
+    pcRowStart[row] = 0;
+    if (y < 2 || y >= h[lvl] - 2) {
+      continue;
+    }
+
+    float* weightSumsl = weightSums[lvl];
+    float* idepthl = idepth[lvl];
+    const Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
+    const int end = y * wl + wl - 2;
+    int i = y * wl + 2;
+    int n = 0;
+
+    for (; i + 4 <= end; i += 4) {
+      const __m128 ws = _mm_loadu_ps(weightSumsl + i);
+      const __m128 color = _mm_set_ps(dIRefl[i + 3][0], dIRefl[i + 2][0],
+                                      dIRefl[i + 1][0], dIRefl[i][0]);
+      const __m128 has = _mm_cmpgt_ps(ws, zero);
+      const __m128 id = _mm_div_ps(_mm_loadu_ps(idepthl + i), ws);
+      // color - color is 0 exactly if color is finite.
+      const __m128 valid = _mm_and_ps(
+          _mm_and_ps(has, _mm_cmpeq_ps(_mm_sub_ps(color, color), zero)),
+          _mm_cmpgt_ps(id, zero));
+      _mm_storeu_ps(idepthl + i, _mm_or_ps(_mm_and_ps(valid, id),
+                                           _mm_andnot_ps(valid, minusOne)));
+      // a point that is skipped keeps its weight.
+      const __m128 keep = _mm_andnot_ps(valid, has);
+      _mm_storeu_ps(weightSumsl + i, _mm_or_ps(_mm_and_ps(keep, ws),
+                                               _mm_andnot_ps(keep, one)));
+      n += __builtin_popcount(_mm_movemask_ps(valid));
+    }
+
+    for (; i < end; ++i) {
+      if (weightSumsl[i] > 0) {
+        idepthl[i] /= weightSumsl[i];
+        if (!std::isfinite(dIRefl[i][0]) || !(idepthl[i] > 0)) {
+          // just skip if something is wrong.
+          idepthl[i] = -1;
+          continue;
+        }
+        ++n;
+      } else
+        idepthl[i] = -1;
+
+      weightSumsl[i] = 1;
+    }
+    pcRowStart[row] = n;
+  }
+}
+
+void CoarseTracker::compactRows(int min, int max, Vec10* stats, int tid) {
+  const __m128 zero = _mm_setzero_ps();
+  for (int row = min; row < max; ++row) {
+    int y;
+    const int lvl = levelOfRow(row, &y);
+    const int wl = w[lvl];
+    if (y < 2 || y >= h[lvl] - 2) {
+      continue;
+    }
+
+    // normalizeRows left a positive idepth exactly on the valid points.
+    const float* idepthl = idepth[lvl] + y * wl;
+    const Eigen::Vector3f* dIRefl = lastRef->dIp[lvl] + y * wl;
+    float* lpc_u = pc_u[lvl];
+    float* lpc_v = pc_v[lvl];
+    float* lpc_idepth = pc_idepth[lvl];
+    float* lpc_color = pc_color[lvl];
+    int j = pcRowStart[row];
+    for (int x0 = 2; x0 < wl - 2; x0 += 4) {
+      int mask =
+          x0 + 4 <= wl - 2
+              ? _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(idepthl + x0), zero))
+              : 0;
+      if (x0 + 4 > wl - 2) {
+        for (int x = x0; x < wl - 2; ++x) {
+          mask |= (idepthl[x] > 0) << (x - x0);
+        }
+      }
+      // one iteration per point instead of a branch per pixel.
+      for (; mask != 0; mask &= mask - 1) {
+        const int x = x0 + __builtin_ctz(mask);
+        lpc_u[j] = x;
+        lpc_v[j] = y;
+        lpc_idepth[j] = idepthl[x];
+        lpc_color[j] = dIRefl[x][0];
+        ++j;
+      }
+    }
+  }
+}
+
+void CoarseTracker::splatDepthL0(
+    const std::vector<FrameHessian*>& frameHessians) {
   // make coarse tracking templates for latstRef.
   memset(idepth[0], 0, sizeof(float) * w[0] * h[0]);
   memset(weightSums[0], 0, sizeof(float) * w[0] * h[0]);
@@ -115,168 +435,232 @@ void CoarseTracker::makeCoarseDepthL0(
       }
     }
   }
+}
 
-  for (int lvl = 1; lvl < PYR_LEVELS_USED; ++lvl) {
+void CoarseTracker::makeCoarseDepthPyramid(IndexThreadReduce<Vec10>* red) {
+  for (int lvl = 1; lvl < calib.pyrLevelsUsed; ++lvl) {
     int lvlm1 = lvl - 1;
     int wl = w[lvl], hl = h[lvl], wlm1 = w[lvlm1];
 
-    float* idepth_l = idepth[lvl];
-    float* weightSums_l = weightSums[lvl];
-
-    float* idepth_lm = idepth[lvlm1];
-    float* weightSums_lm = weightSums[lvlm1];
-
-    for (int y = 0; y < hl; ++y)
-      for (int x = 0; x < wl; ++x) {
-        int bidx = 2 * x + 2 * y * wlm1;
-        idepth_l[x + y * wl] = idepth_lm[bidx] + idepth_lm[bidx + 1] +
-                               idepth_lm[bidx + wlm1] +
-                               idepth_lm[bidx + wlm1 + 1];
+    for (int y = 0; y < hl; ++y) {
+      const int bidx = 2 * y * wlm1;
+      downsampleRow(idepth[lvlm1] + bidx, idepth[lvlm1] + bidx + wlm1,
+                    idepth[lvl] + y * wl, wl);
+      downsampleRow(weightSums[lvlm1] + bidx, weightSums[lvlm1] + bidx + wlm1,
+                    weightSums[lvl] + y * wl, wl);
+    }
+  }
 
-        weightSums_l[x + y * wl] =
-            weightSums_lm[bidx] + weightSums_lm[bidx + 1] +
-            weightSums_lm[bidx + wlm1] + weightSums_lm[bidx + wlm1 + 1];
-      }
+  // from here on the levels are independent: the rows of all levels are
+  // processed as one range, every stage a single pass over the pool.
+  pyrRowStart[0] = 0;
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
+    pyrRowStart[lvl + 1] = pyrRowStart[lvl] + h[lvl];
+    memcpy(weightSums_bak[lvl], weightSums[lvl],
+           w[lvl] * h[lvl] * sizeof(float));
   }
+  pcRowStart.resize(pyrRowStart[calib.pyrLevelsUsed]);
 
   // dilate idepth by 1.
-  for (int lvl = 0; lvl < 2; ++lvl) {
-    int numIts = 1;
-
-    for (int it = 0; it < numIts; ++it) {
-      int wh = w[lvl] * h[lvl] - w[lvl];
-      int wl = w[lvl];
-      float* weightSumsl = weightSums[lvl];
-      float* weightSumsl_bak = weightSums_bak[lvl];
-      memcpy(weightSumsl_bak, weightSumsl, w[lvl] * h[lvl] * sizeof(float));
-      // Don't need to make a temp copy of depth, since I only read values with
-      // weightSumsl>0, and write ones with weightSumsl<=0.
-      float* idepthl = idepth[lvl];
-      for (int i = w[lvl]; i < wh; ++i) {
-        if (weightSumsl_bak[i] <= 0) {
-          float sum = 0, num = 0, numn = 0;
-          if (weightSumsl_bak[i + 1 + wl] > 0) {
-            sum += idepthl[i + 1 + wl];
-            num += weightSumsl_bak[i + 1 + wl];
-            ++numn;
-          }
-          if (weightSumsl_bak[i - 1 - wl] > 0) {
-            sum += idepthl[i - 1 - wl];
-            num += weightSumsl_bak[i - 1 - wl];
-            ++numn;
-          }
-          if (weightSumsl_bak[i + wl - 1] > 0) {
-            sum += idepthl[i + wl - 1];
-            num += weightSumsl_bak[i + wl - 1];
-            ++numn;
-          }
-          if (weightSumsl_bak[i - wl + 1] > 0) {
-            sum += idepthl[i - wl + 1];
-            num += weightSumsl_bak[i - wl + 1];
-            ++numn;
-          }
-          if (numn > 0) {
-            idepthl[i] = sum / numn;
-            weightSumsl[i] = num / numn;
-          }
-        }
-      }
-    }
-  }
+  forAllRows(&CoarseTracker::dilateRows, red);
 
-  // dilate idepth by 1 (2 on lower levels).
-  for (int lvl = 2; lvl < PYR_LEVELS_USED; ++lvl) {
-    int wh = w[lvl] * h[lvl] - w[lvl];
-    int wl = w[lvl];
-    float* weightSumsl = weightSums[lvl];
-    float* weightSumsl_bak = weightSums_bak[lvl];
-    memcpy(weightSumsl_bak, weightSumsl, w[lvl] * h[lvl] * sizeof(float));
-    // Don't need to make a temp copy of depth, since I only read values with
-    // weightSumsl>0, and write ones with weightSumsl<=0.
-    float* idepthl = idepth[lvl];
-    for (int i = w[lvl]; i < wh; ++i) {
-      if (weightSumsl_bak[i] <= 0) {
-        float sum = 0, num = 0, numn = 0;
-        if (weightSumsl_bak[i + 1] > 0) {
-          sum += idepthl[i + 1];
-          num += weightSumsl_bak[i + 1];
-          ++numn;
-        }
-        if (weightSumsl_bak[i - 1] > 0) {
-          sum += idepthl[i - 1];
-          num += weightSumsl_bak[i - 1];
-          ++numn;
-        }
-        if (weightSumsl_bak[i + wl] > 0) {
-          sum += idepthl[i + wl];
-          num += weightSumsl_bak[i + wl];
-          ++numn;
-        }
-        if (weightSumsl_bak[i - wl] > 0) {
-          sum += idepthl[i - wl];
-          num += weightSumsl_bak[i - wl];
-          ++numn;
-        }
-        if (numn > 0) {
-          idepthl[i] = sum / numn;
-          weightSumsl[i] = num / numn;
-        }
-      }
+  // normalize idepths and weights, count the points of every row.
+  forAllRows(&CoarseTracker::normalizeRows, red);
+
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
+    int lpc_n = 0;
+    for (int row = pyrRowStart[lvl]; row < pyrRowStart[lvl + 1]; ++row) {
+      const int n = pcRowStart[row];
+      pcRowStart[row] = lpc_n;
+      lpc_n += n;
     }
+    pc_n[lvl] = lpc_n;
   }
 
-  // normalize idepths and weights.
-  for (int lvl = 0; lvl < PYR_LEVELS_USED; ++lvl) {
-    float* weightSumsl = weightSums[lvl];
-    float* idepthl = idepth[lvl];
-    Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
+  // write the points of every row from its offset, in the same order as
+  // the serial scan.
+  forAllRows(&CoarseTracker::compactRows, red);
 
-    int wl = w[lvl], hl = h[lvl];
+  for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
+    makeSubset(lvl);
+  }
+}
 
-    int lpc_n = 0;
-    float* lpc_u = pc_u[lvl];
-    float* lpc_v = pc_v[lvl];
-    float* lpc_idepth = pc_idepth[lvl];
-    float* lpc_color = pc_color[lvl];
+void CoarseTracker::makeSubset(int lvl) {
+  const int n = pc_n[lvl];
+  pc_nSubset[lvl] = n;
+  if (lvl >= settings.coarseSubsampleLevels ||
+      !(settings.coarseSubsampleRatio < 1) || n == 0) {
+    return;
+  }
 
-    for (int y = 2; y < hl - 2; ++y) {
-      for (int x = 2; x < wl - 2; ++x) {
-        int i = x + y * wl;
-
-        if (weightSumsl[i] > 0) {
-          idepthl[i] /= weightSumsl[i];
-          lpc_u[lpc_n] = x;
-          lpc_v[lpc_n] = y;
-          lpc_idepth[lpc_n] = idepthl[i];
-          lpc_color[lpc_n] = dIRefl[i][0];
-
-          if (!std::isfinite(lpc_color[lpc_n]) || !(idepthl[i] > 0)) {
-            // just skip if something is wrong.
-            idepthl[i] = -1;
-            continue;
-          }
-          ++lpc_n;
-        } else
-          idepthl[i] = -1;
+  // the points are in row order, so every band of cells is a contiguous range.
+  const int cellsX = (w[lvl] + kSubsetCell - 1) / kSubsetCell;
+  const Eigen::Vector3f* dIRefl = lastRef->dIp[lvl];
+  std::vector<char> inSubset(n, false);
+  std::vector<int> cellStart;
+  std::vector<uint64_t> byCell;
+  for (int bandStart = 0; bandStart < n;) {
+    const int band = static_cast<int>(pc_v[lvl][bandStart]) / kSubsetCell;
+    int bandEnd = bandStart;
+    while (bandEnd < n &&
+           static_cast<int>(pc_v[lvl][bandEnd]) / kSubsetCell == band) {
+      ++bandEnd;
+    }
+
+    // points of the band by cell. The key orders by decreasing squared
+    // gradient (the bits of a non-negative float order like the float), ties
+    // in row order.
+    cellStart.assign(cellsX + 1, 0);
+    for (int i = bandStart; i < bandEnd; ++i) {
+      ++cellStart[static_cast<int>(pc_u[lvl][i]) / kSubsetCell + 1];
+    }
+    for (int c = 1; c <= cellsX; ++c) {
+      cellStart[c] += cellStart[c - 1];
+    }
+    byCell.resize(bandEnd - bandStart);
+    for (int i = bandStart; i < bandEnd; ++i) {
+      const int x = pc_u[lvl][i];
+      const Eigen::Vector3f& dI =
+          dIRefl[x + w[lvl] * static_cast<int>(pc_v[lvl][i])];
+      const float gradSq = dI[1] * dI[1] + dI[2] * dI[2];
+      uint32_t bits;
+      memcpy(&bits, &gradSq, sizeof(bits));
+      byCell[cellStart[x / kSubsetCell]++] =
+          (static_cast<uint64_t>(~bits) << 32) | (i - bandStart);
+    }
 
-        weightSumsl[i] = 1;
+    // strongest gradients of every cell. cellStart[c] is the end of cell c
+    // now.
+    uint64_t* first = byCell.data();
+    for (int c = 0; c < cellsX; ++c) {
+      uint64_t* last = byCell.data() + cellStart[c];
+      const int count = last - first;
+      if (count > 0) {
+        const int k = std::max(
+            1, static_cast<int>(ceilf(settings.coarseSubsampleRatio * count)));
+        std::nth_element(first, first + k - 1, last);
+        for (uint64_t* p = first; p != first + k; ++p) {
+          inSubset[bandStart + static_cast<uint32_t>(*p)] = true;
+        }
       }
+      first = last;
     }
+    bandStart = bandEnd;
+  }
 
-    pc_n[lvl] = lpc_n;
+  // stable partition of all four arrays, subset first.
+  std::vector<int> order;
+  order.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    if (inSubset[i]) {
+      order.emplace_back(i);
+    }
+  }
+  pc_nSubset[lvl] = order.size();
+  for (int i = 0; i < n; ++i) {
+    if (!inSubset[i]) {
+      order.emplace_back(i);
+    }
+  }
+  std::vector<float> tmp(n);
+  for (float* a : {pc_u[lvl], pc_v[lvl], pc_idepth[lvl], pc_color[lvl]}) {
+    for (int i = 0; i < n; ++i) {
+      tmp[i] = a[order[i]];
+    }
+    memcpy(a, tmp.data(), n * sizeof(float));
+  }
+}
+
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX int CoarseTracker::calcGSAVX(int lvl, float affA) {
+  const __m256 fxl = _mm256_set1_ps(fx[lvl]);
+  const __m256 fyl = _mm256_set1_ps(fy[lvl]);
+  const __m256 b0 = _mm256_set1_ps(lastRef_aff_g2l.b);
+  const __m256 a = _mm256_set1_ps(affA);
+
+  const __m256 one = _mm256_set1_ps(1);
+  const __m256 minusOne = _mm256_set1_ps(-1);
+  const __m256 zero = _mm256_set1_ps(0);
+
+  const int n = buf_warped_n - buf_warped_n % 8;
+  for (int i = 0; i < n; i += 8) {
+    __m256 dx = _mm256_mul_ps(_mm256_load_ps(buf_warped_dx + i), fxl);
+    __m256 dy = _mm256_mul_ps(_mm256_load_ps(buf_warped_dy + i), fyl);
+    __m256 u = _mm256_load_ps(buf_warped_u + i);
+    __m256 v = _mm256_load_ps(buf_warped_v + i);
+    __m256 id = _mm256_load_ps(buf_warped_idepth + i);
+
+    acc.updateAVX_eighted(
+        _mm256_mul_ps(id, dx), _mm256_mul_ps(id, dy),
+        _mm256_sub_ps(zero,
+                      _mm256_mul_ps(id, _mm256_add_ps(_mm256_mul_ps(u, dx),
+                                                      _mm256_mul_ps(v, dy)))),
+        _mm256_sub_ps(
+            zero, _mm256_add_ps(
+                      _mm256_mul_ps(_mm256_mul_ps(u, v), dx),
+                      _mm256_mul_ps(dy, _mm256_add_ps(one, _mm256_mul_ps(v, v))))),
+        _mm256_add_ps(
+            _mm256_mul_ps(_mm256_mul_ps(u, v), dy),
+            _mm256_mul_ps(dx, _mm256_add_ps(one, _mm256_mul_ps(u, u)))),
+        _mm256_sub_ps(_mm256_mul_ps(u, dy), _mm256_mul_ps(v, dx)),
+        _mm256_mul_ps(a,
+                      _mm256_sub_ps(b0, _mm256_load_ps(buf_warped_refColor + i))),
+        minusOne, _mm256_load_ps(buf_warped_residual + i),
+        _mm256_load_ps(buf_warped_weight + i));
+  }
+  return n;
+}
+#endif
+
+#if DSO_NEON
+int CoarseTracker::calcGSNEON(int lvl, float affA) {
+  const float32x4_t b0 = vdupq_n_f32(lastRef_aff_g2l.b);
+  const float32x4_t a = vdupq_n_f32(affA);
+  const float32x4_t one = vdupq_n_f32(1);
+  const float32x4_t minusOne = vdupq_n_f32(-1);
+
+  const int n = buf_warped_n;
+  for (int i = 0; i < n; i += 4) {
+    const float32x4_t dx = vmulq_n_f32(vld1q_f32(buf_warped_dx + i), fx[lvl]);
+    const float32x4_t dy = vmulq_n_f32(vld1q_f32(buf_warped_dy + i), fy[lvl]);
+    const float32x4_t u = vld1q_f32(buf_warped_u + i);
+    const float32x4_t v = vld1q_f32(buf_warped_v + i);
+    const float32x4_t id = vld1q_f32(buf_warped_idepth + i);
+    const float32x4_t uv = vmulq_f32(u, v);
+
+    acc.updateNEON_eighted(
+        vmulq_f32(id, dx), vmulq_f32(id, dy),
+        vnegq_f32(vmulq_f32(id, vfmaq_f32(vmulq_f32(u, dx), v, dy))),
+        vnegq_f32(vfmaq_f32(vmulq_f32(uv, dx), dy, vfmaq_f32(one, v, v))),
+        vfmaq_f32(vmulq_f32(uv, dy), dx, vfmaq_f32(one, u, u)),
+        vfmsq_f32(vmulq_f32(u, dy), v, dx),
+        vmulq_f32(a, vsubq_f32(b0, vld1q_f32(buf_warped_refColor + i))),
+        minusOne, vld1q_f32(buf_warped_residual + i),
+        vld1q_f32(buf_warped_weight + i));
   }
+  return n;
 }
+#endif
 
 void CoarseTracker::calcGSSSE(int lvl, Mat88& H_out, Vec8& b_out,
                               const SE3& refToNew, AffLight aff_g2l) {
+  if (gpuResValid) {
+    // summed by the last calcRes already.
+    scaleGS(gpuH, buf_warped_n, &H_out, &b_out);
+    return;
+  }
+
   acc.initialize();
 
+  const float affA = (float)(AffLight::fromToVecExposure(
+      lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l,
+      aff_g2l)[0]);
+
   __m128 fxl = _mm_set1_ps(fx[lvl]);
   __m128 fyl = _mm_set1_ps(fy[lvl]);
   __m128 b0 = _mm_set1_ps(lastRef_aff_g2l.b);
-  __m128 a = _mm_set1_ps((float)(AffLight::fromToVecExposure(
-      lastRef->ab_exposure, newFrame->ab_exposure, lastRef_aff_g2l,
-      aff_g2l)[0]));
+  __m128 a = _mm_set1_ps(affA);
 
   __m128 one = _mm_set1_ps(1);
   __m128 minusOne = _mm_set1_ps(-1);
@@ -284,7 +668,20 @@ void CoarseTracker::calcGSSSE(int lvl, Mat88& H_out, Vec8& b_out,
 
   int n = buf_warped_n;
   CHECK_EQ(n % 4, 0);
-  for (int i = 0; i < n; i += 4) {
+
+  // the AVX kernel takes all full blocks of 8, SSE the remaining 4. NEON takes
+  // all of them.
+  int start = 0;
+#if DSO_AVX_DISPATCH
+  if (useAVX()) {
+    start = calcGSAVX(lvl, affA);
+  }
+#elif DSO_NEON
+  if (useNEON()) {
+    start = calcGSNEON(lvl, affA);
+  }
+#endif
+  for (int i = start; i < n; i += 4) {
     __m128 dx = _mm_mul_ps(_mm_load_ps(buf_warped_dx + i), fxl);
     __m128 dy = _mm_mul_ps(_mm_load_ps(buf_warped_dy + i), fyl);
     __m128 u = _mm_load_ps(buf_warped_u + i);
@@ -308,25 +705,223 @@ void CoarseTracker::calcGSSSE(int lvl, Mat88& H_out, Vec8& b_out,
   }
 
   acc.finish();
-  H_out = acc.H.topLeftCorner<8, 8>().cast<double>() * (1.0f / n);
-  b_out = acc.H.topRightCorner<8, 1>().cast<double>() * (1.0f / n);
-
-  H_out.block<8, 3>(0, 0) *= SCALE_XI_ROT;
-  H_out.block<8, 3>(0, 3) *= SCALE_XI_TRANS;
-  H_out.block<8, 1>(0, 6) *= SCALE_A;
-  H_out.block<8, 1>(0, 7) *= SCALE_B;
-  H_out.block<3, 8>(0, 0) *= SCALE_XI_ROT;
-  H_out.block<3, 8>(3, 0) *= SCALE_XI_TRANS;
-  H_out.block<1, 8>(6, 0) *= SCALE_A;
-  H_out.block<1, 8>(7, 0) *= SCALE_B;
-  b_out.segment<3>(0) *= SCALE_XI_ROT;
-  b_out.segment<3>(3) *= SCALE_XI_TRANS;
-  b_out.segment<1>(6) *= SCALE_A;
-  b_out.segment<1>(7) *= SCALE_B;
+  scaleGS(acc.H, n, &H_out, &b_out);
+}
+
+void CoarseTracker::accumulateShift(int lvl, const Mat33f& RKi, const Vec3f& t,
+                                    float x, float y, float id, float Ku,
+                                    float Kv, float* sumSquaredShiftT,
+                                    float* sumSquaredShiftRT,
+                                    float* sumSquaredShiftNum) const {
+  float fxl = fx[lvl];
+  float fyl = fy[lvl];
+  float cxl = cx[lvl];
+  float cyl = cy[lvl];
+
+  // translation only (positive)
+  Vec3f ptT = Ki[lvl] * Vec3f(x, y, 1) + t * id;
+  float uT = ptT[0] / ptT[2];
+  float vT = ptT[1] / ptT[2];
+  float KuT = fxl * uT + cxl;
+  float KvT = fyl * vT + cyl;
+
+  // translation only (negative)
+  Vec3f ptT2 = Ki[lvl] * Vec3f(x, y, 1) - t * id;
+  float uT2 = ptT2[0] / ptT2[2];
+  float vT2 = ptT2[1] / ptT2[2];
+  float KuT2 = fxl * uT2 + cxl;
+  float KvT2 = fyl * vT2 + cyl;
+
+  // translation and rotation (negative)
+  Vec3f pt3 = RKi * Vec3f(x, y, 1) - t * id;
+  float u3 = pt3[0] / pt3[2];
+  float v3 = pt3[1] / pt3[2];
+  float Ku3 = fxl * u3 + cxl;
+  float Kv3 = fyl * v3 + cyl;
+
+  // translation and rotation (positive)
+  // already have it.
+
+  *sumSquaredShiftT += (KuT - x) * (KuT - x) + (KvT - y) * (KvT - y);
+  *sumSquaredShiftT += (KuT2 - x) * (KuT2 - x) + (KvT2 - y) * (KvT2 - y);
+  *sumSquaredShiftRT += (Ku - x) * (Ku - x) + (Kv - y) * (Kv - y);
+  *sumSquaredShiftRT += (Ku3 - x) * (Ku3 - x) + (Kv3 - y) * (Kv3 - y);
+  *sumSquaredShiftNum += 2;
+}
+
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX2 int CoarseTracker::calcResAVX2(
+    int lvl, int nl, const Mat33f& RKi, const Vec3f& t, const Vec2f& affLL,
+    float cutoffTH, float* E, int* numTermsInE, int* numTermsInWarped,
+    int* numSaturated, float* sumSquaredShiftT, float* sumSquaredShiftRT,
+    float* sumSquaredShiftNum) {
+  const int wl = w[lvl];
+  const int hl = h[lvl];
+  const float* dINewl = reinterpret_cast<const float*>(newFrame->dIp[lvl]);
+  const float fxl = fx[lvl];
+  const float fyl = fy[lvl];
+  const float cxl = cx[lvl];
+  const float cyl = cy[lvl];
+
+  const float maxEnergy =
+      2 * settings.huberTH * cutoffTH - settings.huberTH * settings.huberTH;
+
+  const float* lpc_u = pc_u[lvl];
+  const float* lpc_v = pc_v[lvl];
+  const float* lpc_idepth = pc_idepth[lvl];
+  const float* lpc_color = pc_color[lvl];
+  const int n = nl - nl % 8;
+
+  const __m256 r00 = _mm256_set1_ps(RKi(0, 0)), r01 = _mm256_set1_ps(RKi(0, 1)),
+               r02 = _mm256_set1_ps(RKi(0, 2));
+  const __m256 r10 = _mm256_set1_ps(RKi(1, 0)), r11 = _mm256_set1_ps(RKi(1, 1)),
+               r12 = _mm256_set1_ps(RKi(1, 2));
+  const __m256 r20 = _mm256_set1_ps(RKi(2, 0)), r21 = _mm256_set1_ps(RKi(2, 1)),
+               r22 = _mm256_set1_ps(RKi(2, 2));
+  const __m256 t0 = _mm256_set1_ps(t[0]), t1 = _mm256_set1_ps(t[1]),
+               t2 = _mm256_set1_ps(t[2]);
+  const __m256 fx8 = _mm256_set1_ps(fxl), fy8 = _mm256_set1_ps(fyl);
+  const __m256 cx8 = _mm256_set1_ps(cxl), cy8 = _mm256_set1_ps(cyl);
+  const __m256 minK = _mm256_set1_ps(2);
+  const __m256 maxKu = _mm256_set1_ps(wl - 3), maxKv = _mm256_set1_ps(hl - 3);
+  const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1);
+  const __m256 two = _mm256_set1_ps(2);
+  const __m256 a8 = _mm256_set1_ps(affLL[0]), b8 = _mm256_set1_ps(affLL[1]);
+  const __m256 huberTH = _mm256_set1_ps(settings.huberTH);
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  const __m256i three = _mm256_set1_epi32(3);
+  const __m256i wl8 = _mm256_set1_epi32(wl);
+  const int rowStride = 3 * wl;
+
+  EIGEN_ALIGN32 float lane_u[8], lane_v[8], lane_id[8], lane_c[3][8],
+      lane_r[8], lane_hw[8], lane_e[8];
+
+  for (int i = 0; i < n; i += 8) {
+    const __m256 x = _mm256_loadu_ps(lpc_u + i);
+    const __m256 y = _mm256_loadu_ps(lpc_v + i);
+    const __m256 id = _mm256_loadu_ps(lpc_idepth + i);
+
+    // pt = RKi * (x, y, 1) + t * id
+    const __m256 pt0 = _mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r00, x), _mm256_mul_ps(r01, y)),
+                      r02),
+        _mm256_mul_ps(t0, id));
+    const __m256 pt1 = _mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r10, x), _mm256_mul_ps(r11, y)),
+                      r12),
+        _mm256_mul_ps(t1, id));
+    const __m256 pt2 = _mm256_add_ps(
+        _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r20, x), _mm256_mul_ps(r21, y)),
+                      r22),
+        _mm256_mul_ps(t2, id));
+    const __m256 u = _mm256_div_ps(pt0, pt2);
+    const __m256 v = _mm256_div_ps(pt1, pt2);
+    const __m256 Ku = _mm256_add_ps(_mm256_mul_ps(fx8, u), cx8);
+    const __m256 Kv = _mm256_add_ps(_mm256_mul_ps(fy8, v), cy8);
+    const __m256 newIdepth = _mm256_div_ps(id, pt2);
+
+    if (lvl == 0 && i % 32 == 0) {
+      accumulateShift(lvl, RKi, t, lpc_u[i], lpc_v[i], lpc_idepth[i],
+                      _mm256_cvtss_f32(Ku), _mm256_cvtss_f32(Kv),
+                      sumSquaredShiftT, sumSquaredShiftRT, sumSquaredShiftNum);
+    }
+
+    // ordered comparisons, so nan projections are out as well.
+    const __m256 inside = _mm256_and_ps(
+        _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(Ku, minK, _CMP_GT_OQ),
+                                    _mm256_cmp_ps(Kv, minK, _CMP_GT_OQ)),
+                      _mm256_and_ps(_mm256_cmp_ps(Ku, maxKu, _CMP_LT_OQ),
+                                    _mm256_cmp_ps(Kv, maxKv, _CMP_LT_OQ))),
+        _mm256_cmp_ps(newIdepth, zero, _CMP_GT_OQ));
+    const int insideBits = _mm256_movemask_ps(inside);
+    if (insideBits == 0) {
+      continue;
+    }
+
+    // bilinear interpolation of the interleaved (I, dx, dy) image, outside
+    // points are masked out of the gathers.
+    const __m256i ix = _mm256_cvttps_epi32(Ku);
+    const __m256i iy = _mm256_cvttps_epi32(Kv);
+    const __m256 dx = _mm256_sub_ps(Ku, _mm256_cvtepi32_ps(ix));
+    const __m256 dy = _mm256_sub_ps(Kv, _mm256_cvtepi32_ps(iy));
+    const __m256 dxdy = _mm256_mul_ps(dx, dy);
+    const __m256 w11 = dxdy;
+    const __m256 w01 = _mm256_sub_ps(dy, dxdy);
+    const __m256 w10 = _mm256_sub_ps(dx, dxdy);
+    const __m256 w00 =
+        _mm256_add_ps(_mm256_sub_ps(_mm256_sub_ps(one, dx), dy), dxdy);
+    const __m256i base = _mm256_mullo_epi32(
+        _mm256_add_epi32(ix, _mm256_mullo_epi32(iy, wl8)), three);
+
+    for (int c = 0; c < 3; ++c) {
+      const float* img = dINewl + c;
+      const __m256 p00 = _mm256_mask_i32gather_ps(zero, img, base, inside, 4);
+      const __m256 p10 =
+          _mm256_mask_i32gather_ps(zero, img + 3, base, inside, 4);
+      const __m256 p01 =
+          _mm256_mask_i32gather_ps(zero, img + rowStride, base, inside, 4);
+      const __m256 p11 =
+          _mm256_mask_i32gather_ps(zero, img + rowStride + 3, base, inside, 4);
+      const __m256 hit = _mm256_add_ps(
+          _mm256_add_ps(
+              _mm256_add_ps(_mm256_mul_ps(w11, p11), _mm256_mul_ps(w01, p01)),
+              _mm256_mul_ps(w10, p10)),
+          _mm256_mul_ps(w00, p00));
+      _mm256_store_ps(lane_c[c], hit);
+    }
+
+    const __m256 refColor = _mm256_loadu_ps(lpc_color + i);
+    const __m256 residual = _mm256_sub_ps(
+        _mm256_load_ps(lane_c[0]),
+        _mm256_add_ps(_mm256_mul_ps(a8, refColor), b8));
+    const __m256 absRes = _mm256_and_ps(residual, absMask);
+    const __m256 hw =
+        _mm256_blendv_ps(_mm256_div_ps(huberTH, absRes), one,
+                         _mm256_cmp_ps(absRes, huberTH, _CMP_LT_OQ));
+    const __m256 energy = _mm256_mul_ps(
+        _mm256_mul_ps(_mm256_mul_ps(hw, residual), residual),
+        _mm256_sub_ps(two, hw));
+
+    _mm256_store_ps(lane_u, u);
+    _mm256_store_ps(lane_v, v);
+    _mm256_store_ps(lane_id, newIdepth);
+    _mm256_store_ps(lane_r, residual);
+    _mm256_store_ps(lane_hw, hw);
+    _mm256_store_ps(lane_e, energy);
+
+    // compact in point order, summing E in the same order as the scalar loop.
+    for (int k = 0; k < 8; ++k) {
+      if (!(insideBits & (1 << k)) || !std::isfinite(lane_c[0][k])) {
+        continue;
+      }
+      if (fabs(lane_r[k]) > cutoffTH) {
+        *E += maxEnergy;
+        ++*numTermsInE;
+        ++*numSaturated;
+        continue;
+      }
+
+      *E += lane_e[k];
+      ++*numTermsInE;
+
+      const int j = (*numTermsInWarped)++;
+      buf_warped_idepth[j] = lane_id[k];
+      buf_warped_u[j] = lane_u[k];
+      buf_warped_v[j] = lane_v[k];
+      buf_warped_dx[j] = lane_c[1][k];
+      buf_warped_dy[j] = lane_c[2][k];
+      buf_warped_residual[j] = lane_r[k];
+      buf_warped_weight[j] = lane_hw[k];
+      buf_warped_refColor[j] = lpc_color[i + k];
+    }
+  }
+  return n;
 }
+#endif
 
 Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
-                            float cutoffTH) {
+                            float cutoffTH, bool subset) {
+  ScopedStageTimer stageTimer(STAGE_CALC_RES);
   float E = 0;
   int numTermsInE = 0;
   int numTermsInWarped = 0;
@@ -351,9 +946,17 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
   float sumSquaredShiftRT = 0;
   float sumSquaredShiftNum = 0;
 
-  // energy for r=setting_coarseCutoffTH.
+  // energy for r=settings.coarseCutoffTH.
   float maxEnergy =
-      2 * setting_huberTH * cutoffTH - setting_huberTH * setting_huberTH;
+      2 * settings.huberTH * cutoffTH - settings.huberTH * settings.huberTH;
+
+  gpuResValid = false;
+#if defined(HAS_CUDA)
+  if (gpu != nullptr && !debugPlot) {
+    return calcResGPU(lvl, RKi, t, affLL, cutoffTH,
+                      subset ? pc_nSubset[lvl] : pc_n[lvl]);
+  }
+#endif
 
   MinimalImageB3* resImage = 0;
   if (debugPlot) {
@@ -361,13 +964,24 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
     resImage->setConst(Vec3b(255, 255, 255));
   }
 
-  int nl = pc_n[lvl];
+  int nl = subset ? pc_nSubset[lvl] : pc_n[lvl];
   float* lpc_u = pc_u[lvl];
   float* lpc_v = pc_v[lvl];
   float* lpc_idepth = pc_idepth[lvl];
   float* lpc_color = pc_color[lvl];
 
-  for (int i = 0; i < nl; ++i) {
+  // the AVX2 kernel takes all full blocks of 8 points, the scalar loop the rest
+  // and everything when plotting.
+  int start = 0;
+#if DSO_AVX_DISPATCH
+  if (!debugPlot && useAVX2()) {
+    start = calcResAVX2(lvl, nl, RKi, t, affLL, cutoffTH, &E, &numTermsInE,
+                        &numTermsInWarped, &numSaturated, &sumSquaredShiftT,
+                        &sumSquaredShiftRT, &sumSquaredShiftNum);
+  }
+#endif
+
+  for (int i = start; i < nl; ++i) {
     float id = lpc_idepth[i];
     float x = lpc_u[i];
     float y = lpc_v[i];
@@ -380,35 +994,8 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
     float new_idepth = id / pt[2];
 
     if (lvl == 0 && i % 32 == 0) {
-      // translation only (positive)
-      Vec3f ptT = Ki[lvl] * Vec3f(x, y, 1) + t * id;
-      float uT = ptT[0] / ptT[2];
-      float vT = ptT[1] / ptT[2];
-      float KuT = fxl * uT + cxl;
-      float KvT = fyl * vT + cyl;
-
-      // translation only (negative)
-      Vec3f ptT2 = Ki[lvl] * Vec3f(x, y, 1) - t * id;
-      float uT2 = ptT2[0] / ptT2[2];
-      float vT2 = ptT2[1] / ptT2[2];
-      float KuT2 = fxl * uT2 + cxl;
-      float KvT2 = fyl * vT2 + cyl;
-
-      // translation and rotation (negative)
-      Vec3f pt3 = RKi * Vec3f(x, y, 1) - t * id;
-      float u3 = pt3[0] / pt3[2];
-      float v3 = pt3[1] / pt3[2];
-      float Ku3 = fxl * u3 + cxl;
-      float Kv3 = fyl * v3 + cyl;
-
-      // translation and rotation (positive)
-      // already have it.
-
-      sumSquaredShiftT += (KuT - x) * (KuT - x) + (KvT - y) * (KvT - y);
-      sumSquaredShiftT += (KuT2 - x) * (KuT2 - x) + (KvT2 - y) * (KvT2 - y);
-      sumSquaredShiftRT += (Ku - x) * (Ku - x) + (Kv - y) * (Kv - y);
-      sumSquaredShiftRT += (Ku3 - x) * (Ku3 - x) + (Kv3 - y) * (Kv3 - y);
-      sumSquaredShiftNum += 2;
+      accumulateShift(lvl, RKi, t, x, y, id, Ku, Kv, &sumSquaredShiftT,
+                      &sumSquaredShiftRT, &sumSquaredShiftNum);
     }
 
     if (!(Ku > 2 && Kv > 2 && Ku < wl - 3 && Kv < hl - 3 && new_idepth > 0)) {
@@ -421,8 +1008,9 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
       continue;
     }
     float residual = hitColor[0] - (float)(affLL[0] * refColor + affLL[1]);
-    float hw =
-        fabs(residual) < setting_huberTH ? 1 : setting_huberTH / fabs(residual);
+    float hw = fabs(residual) < settings.huberTH
+                   ? 1
+                   : settings.huberTH / fabs(residual);
 
     if (fabs(residual) > cutoffTH) {
       if (debugPlot) {
@@ -483,11 +1071,89 @@ Vec6 CoarseTracker::calcRes(int lvl, const SE3& refToNew, AffLight aff_g2l,
   return rs;
 }
 
+#if defined(HAS_CUDA)
+Vec6 CoarseTracker::calcResGPU(int lvl, const Mat33f& RKi, const Vec3f& t,
+                               const Vec2f& affLL, float cutoffTH, int nl) {
+  if (gpu->refVersion != refVersion) {
+    for (int l = 0; l < calib.pyrLevelsUsed; ++l) {
+      gpu->setReference(l, pc_u[l], pc_v[l], pc_idepth[l], pc_color[l],
+                        pc_n[l]);
+    }
+    gpu->refVersion = refVersion;
+  }
+
+  CoarseTrackerCudaParams params;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 3; ++c) {
+      params.RKi[3 * r + c] = RKi(r, c);
+    }
+    params.t[r] = t[r];
+  }
+  params.fx = fx[lvl];
+  params.fy = fy[lvl];
+  params.cx = cx[lvl];
+  params.cy = cy[lvl];
+  params.affA = affLL[0];
+  params.affB = affLL[1];
+  params.b0 = lastRef_aff_g2l.b;
+  params.huberTH = settings.huberTH;
+  params.cutoffTH = cutoffTH;
+  CoarseTrackerCudaResult res;
+  gpu->calcResAndGS(lvl, nl, params, &res);
+
+  int idx = 0;
+  for (int r = 0; r < 9; ++r) {
+    for (int c = r; c < 9; ++c) {
+      gpuH(r, c) = gpuH(c, r) = res.H[idx++];
+    }
+  }
+  // normalized like the CPU path, by the warped points padded to 4.
+  buf_warped_n = (res.numTermsInWarped + 3) / 4 * 4;
+  gpuResValid = true;
+
+  // the flow indicators need only every 32nd point of level 0.
+  float sumSquaredShiftT = 0;
+  float sumSquaredShiftRT = 0;
+  float sumSquaredShiftNum = 0;
+  if (lvl == 0) {
+    for (int i = 0; i < nl; i += 32) {
+      const float x = pc_u[lvl][i];
+      const float y = pc_v[lvl][i];
+      const float id = pc_idepth[lvl][i];
+      const Vec3f pt = RKi * Vec3f(x, y, 1) + t * id;
+      const float Ku = fx[lvl] * pt[0] / pt[2] + cx[lvl];
+      const float Kv = fy[lvl] * pt[1] / pt[2] + cy[lvl];
+      accumulateShift(lvl, RKi, t, x, y, id, Ku, Kv, &sumSquaredShiftT,
+                      &sumSquaredShiftRT, &sumSquaredShiftNum);
+    }
+  }
+
+  Vec6 rs;
+  rs[0] = res.E;
+  rs[1] = res.numTermsInE;
+  rs[2] = sumSquaredShiftT / (sumSquaredShiftNum + 0.1);
+  rs[3] = 0;
+  rs[4] = sumSquaredShiftRT / (sumSquaredShiftNum + 0.1);
+  rs[5] = res.numSaturated / (float)res.numTermsInE;
+  return rs;
+}
+#endif
+
 void CoarseTracker::setCoarseTrackingRef(
-    std::vector<FrameHessian*> frameHessians) {
+    const std::vector<FrameHessian*>& frameHessians,
+    IndexThreadReduce<Vec10>* red) {
+  splatCoarseTrackingRef(frameHessians);
+  finishCoarseTrackingRef(red);
+}
+
+void CoarseTracker::splatCoarseTrackingRef(
+    const std::vector<FrameHessian*>& frameHessians) {
   CHECK_GT(frameHessians.size(), 0);
   lastRef = frameHessians.back();
-  makeCoarseDepthL0(frameHessians);
+  // needs all pyramid levels, i.e. the reference must not be compact or
+  // released yet.
+  CHECK(lastRef->hasPyramid()) << "pyramid of the reference already released";
+  splatDepthL0(frameHessians);
 
   refFrameID = lastRef->shell->id;
   lastRef_aff_g2l = lastRef->aff_g2l();
@@ -495,46 +1161,103 @@ void CoarseTracker::setCoarseTrackingRef(
   firstCoarseRMSE = -1;
 }
 
+void CoarseTracker::splatCoarseTrackingRef(FrameHessian* ref,
+                                           const std::vector<Vec3f>& points) {
+  lastRef = ref;
+  CHECK(lastRef->hasPyramid()) << "pyramid of the reference already released";
+  memset(idepth[0], 0, sizeof(float) * w[0] * h[0]);
+  memset(weightSums[0], 0, sizeof(float) * w[0] * h[0]);
+  for (const Vec3f& p : points) {
+    const int u = p[0] + 0.5f;
+    const int v = p[1] + 0.5f;
+    if (u < 0 || v < 0 || u >= w[0] || v >= h[0]) {
+      continue;
+    }
+    idepth[0][u + w[0] * v] += p[2];
+    weightSums[0][u + w[0] * v] += 1;
+  }
+
+  refFrameID = lastRef->shell->id;
+  lastRef_aff_g2l = lastRef->aff_g2l();
+
+  firstCoarseRMSE = -1;
+}
+
+void CoarseTracker::finishCoarseTrackingRef(IndexThreadReduce<Vec10>* red) {
+  ScopedStageTimer stageTimer(STAGE_SET_TRACKING_REF);
+  CHECK(lastRef->hasPyramid()) << "pyramid of the reference already released";
+  makeCoarseDepthPyramid(red);
+  refVersion = nextRefVersion++;
+}
+
 bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
                                       SE3& lastToNew_out, AffLight& aff_g2l_out,
-                                      int coarsestLvl, Vec5 minResForAbort,
-                                      IOWrap::Output3DWrapper* wrap) {
+                                      int coarsestLvl, VecPyr minResForAbort,
+                                      IOWrap::Output3DWrapper* wrap,
+                                      double budgetMs) {
   debugPlot = setting_render_displayCoarseTrackingFull;
   debugPrint = false;
-  CHECK_LT(coarsestLvl, 5);
-  CHECK_LT(coarsestLvl, PYR_LEVELS_USED);
+  CHECK_LT(coarsestLvl, calib.pyrLevelsUsed);
 
   lastResiduals.setConstant(NAN);
   lastFlowIndicators.setConstant(1000);
+  lastLevelResults.clear();
+  lastOutOfTime = false;
+  WallTimer timer;
 
   newFrame = newFrameHessian;
-  int maxIterations[] = {10, 20, 50, 50, 50};
+#if defined(HAS_CUDA)
+  if (gpu != nullptr) {
+    const float* dI[PYR_LEVELS];
+    for (int lvl = 0; lvl < calib.pyrLevelsUsed; ++lvl) {
+      dI[lvl] = reinterpret_cast<const float*>(newFrame->dIp[lvl]);
+    }
+    gpu->setFrame(dI);
+  }
+#endif
+  const int maxIterations[PYR_LEVELS] = {10, 20, 50, 50, 50, 50, 50, 50};
   float lambdaExtrapolationLimit = 0.001;
 
   SE3 refToNew_current = lastToNew_out;
   AffLight aff_g2l_current = aff_g2l_out;
 
   bool haveRepeated = false;
+  const int finestLvl = std::min(settings.coarseTrackingFinestLvl, coarsestLvl);
 
   for (int lvl = coarsestLvl; lvl >= 0; --lvl) {
+    if (!lastOutOfTime && budgetMs > 0 && timer.elapsedMs() > budgetMs) {
+      lastOutOfTime = true;
+    }
+    // out of time or below finestLvl: no more refinement, only the residual on
+    // level 0.
+    const bool residualOnly = lastOutOfTime || lvl < finestLvl;
+    if (residualOnly) {
+      lvl = 0;
+    }
+
+    // the iterations on the subset, the result checked on all points.
+    const bool subset = pc_nSubset[lvl] < pc_n[lvl] && !residualOnly;
+
     Mat88 H;
     Vec8 b;
     float levelCutoffRepeat = 1;
     Vec6 resOld = calcRes(lvl, refToNew_current, aff_g2l_current,
-                          setting_coarseCutoffTH * levelCutoffRepeat);
+                          settings.coarseCutoffTH * levelCutoffRepeat, subset);
     while (resOld[5] > 0.6 && levelCutoffRepeat < 50) {
       levelCutoffRepeat *= 2;
       resOld = calcRes(lvl, refToNew_current, aff_g2l_current,
-                       setting_coarseCutoffTH * levelCutoffRepeat);
+                       settings.coarseCutoffTH * levelCutoffRepeat, subset);
 
       if (!setting_debugout_runquiet) {
         LOG(INFO) << "INCREASING cutoff to "
-                  << setting_coarseCutoffTH * levelCutoffRepeat << " (ratio is "
-                  << resOld[5] << ")!";
+                  << settings.coarseCutoffTH * levelCutoffRepeat
+                  << " (ratio is " << resOld[5] << ")!";
       }
     }
 
-    calcGSSSE(lvl, H, b, refToNew_current, aff_g2l_current);
+    if (!residualOnly) {
+      calcGSSSE(lvl, H, b, refToNew_current, aff_g2l_current);
+    }
 
     float lambda = 0.01;
 
@@ -551,22 +1274,30 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
                 << relAff.transpose() << ")";
     }
 
-    for (int iteration = 0; iteration < maxIterations[lvl]; ++iteration) {
+    for (int iteration = 0; iteration < maxIterations[lvl] && !residualOnly;
+         ++iteration) {
+      if (budgetMs > 0 && timer.elapsedMs() > budgetMs) {
+        lastOutOfTime = true;
+        break;
+      }
+
       Mat88 Hl = H;
       for (int i = 0; i < 8; ++i) {
         Hl(i, i) *= (1 + lambda);
       }
       Vec8 inc = Hl.ldlt().solve(-b);
 
-      if (setting_affineOptModeA < 0 && setting_affineOptModeB < 0) {
+      if (settings.affineOptModeA < 0 && settings.affineOptModeB < 0) {
         // fix a, b
         inc.head<6>() = Hl.topLeftCorner<6, 6>().ldlt().solve(-b.head<6>());
         inc.tail<2>().setZero();
-      } else if (!(setting_affineOptModeA < 0) && setting_affineOptModeB < 0) {
+      } else if (!(settings.affineOptModeA < 0) &&
+                 settings.affineOptModeB < 0) {
         // fix b
         inc.head<7>() = Hl.topLeftCorner<7, 7>().ldlt().solve(-b.head<7>());
         inc.tail<1>().setZero();
-      } else if (setting_affineOptModeA < 0 && !(setting_affineOptModeB < 0)) {
+      } else if (settings.affineOptModeA < 0 &&
+                 !(settings.affineOptModeB < 0)) {
         // fix a
         Mat88 HlStitch = Hl;
         Vec8 bStitch = b;
@@ -603,8 +1334,9 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
       aff_g2l_new.a += incScaled[6];
       aff_g2l_new.b += incScaled[7];
 
-      Vec6 resNew = calcRes(lvl, refToNew_new, aff_g2l_new,
-                            setting_coarseCutoffTH * levelCutoffRepeat);
+      Vec6 resNew =
+          calcRes(lvl, refToNew_new, aff_g2l_new,
+                  settings.coarseCutoffTH * levelCutoffRepeat, subset);
 
       bool accept = (resNew[0] / resNew[1]) < (resOld[0] / resOld[1]);
 
@@ -644,14 +1376,22 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
       }
     }
 
+    if (subset) {
+      resOld = calcRes(lvl, refToNew_current, aff_g2l_current,
+                       settings.coarseCutoffTH * levelCutoffRepeat, false);
+    }
+
     // set last residual for that level, as well as flow indicators.
     lastResiduals[lvl] = sqrtf((float)(resOld[0] / resOld[1]));
     lastFlowIndicators = resOld.segment<3>(2);
+    lastLevelResults.push_back(
+        {lvl, lastResiduals[lvl], lastFlowIndicators});
     if (lastResiduals[lvl] > 1.5 * minResForAbort[lvl]) {
       return false;
     }
 
-    if (levelCutoffRepeat > 1 && !haveRepeated) {
+    if (levelCutoffRepeat > 1 && !haveRepeated && !residualOnly &&
+        !lastOutOfTime) {
       ++lvl;
       haveRepeated = true;
       LOG(WARNING) << "REPEAT LEVEL!";
@@ -662,8 +1402,8 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
   lastToNew_out = refToNew_current;
   aff_g2l_out = aff_g2l_current;
 
-  if ((setting_affineOptModeA != 0 && fabs(aff_g2l_out.a) > 1.2) ||
-      (setting_affineOptModeB != 0 && fabs(aff_g2l_out.b) > 200.)) {
+  if ((settings.affineOptModeA != 0 && fabs(aff_g2l_out.a) > 1.2) ||
+      (settings.affineOptModeB != 0 && fabs(aff_g2l_out.b) > 200.)) {
     return false;
   }
 
@@ -672,15 +1412,15 @@ bool CoarseTracker::trackNewestCoarse(FrameHessian* newFrameHessian,
                                   lastRef_aff_g2l, aff_g2l_out)
           .cast<float>();
 
-  if ((setting_affineOptModeA == 0 && fabs(log(relAff[0])) > 1.5) ||
-      (setting_affineOptModeB == 0 && fabs(relAff[1]) > 200)) {
+  if ((settings.affineOptModeA == 0 && fabs(log(relAff[0])) > 1.5) ||
+      (settings.affineOptModeB == 0 && fabs(relAff[1]) > 200)) {
     return false;
   }
 
-  if (setting_affineOptModeA < 0) {
+  if (settings.affineOptModeA < 0) {
     aff_g2l_out.a = 0;
   }
-  if (setting_affineOptModeB < 0) {
+  if (settings.affineOptModeB < 0) {
     aff_g2l_out.b = 0;
   }
 
@@ -693,6 +1433,13 @@ void CoarseTracker::debugPlotIDepthMap(
   if (w[1] == 0) {
     return;
   }
+  // skips the sort and colorizing.
+  if (!debugSaveImages &&
+      !IOWrap::Output3DWrapper::anyCapable(
+          wraps, IOWrap::Output3DWrapper::CAP_DEPTH_IMAGE)) {
+    return;
+  }
+  CHECK(lastRef->hasPyramid()) << "pyramid of the reference already released";
 
   int lvl = 0;
 
@@ -784,7 +1531,11 @@ void CoarseTracker::debugPlotIDepthMap(
       }
     // IOWrap::displayImage("coarseDepth LVL0", &mf, false);
 
-    for (IOWrap::Output3DWrapper* ow : wraps) ow->pushDepthImage(&mf);
+    for (IOWrap::Output3DWrapper* ow : wraps) {
+      if (ow->capabilities() & IOWrap::Output3DWrapper::CAP_DEPTH_IMAGE) {
+        ow->pushDepthImage(&mf);
+      }
+    }
 
     if (debugSaveImages) {
       char buf[1000];
@@ -803,7 +1554,9 @@ void CoarseTracker::debugPlotIDepthMapFloat(
   int lvl = 0;
   MinimalImageF mim(w[lvl], h[lvl], idepth[lvl]);
   for (IOWrap::Output3DWrapper* ow : wraps) {
-    ow->pushDepthImageFloat(&mim, lastRef);
+    if (ow->capabilities() & IOWrap::Output3DWrapper::CAP_DEPTH_IMAGE_FLOAT) {
+      ow->pushDepthImageFloat(&mim, lastRef);
+    }
   }
 }
 }  // namespace dso
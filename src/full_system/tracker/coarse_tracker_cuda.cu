@@ -0,0 +1,284 @@
+#include "full_system/tracker/coarse_tracker_cuda.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "util/cuda_check.h"
+
+namespace dso {
+
+namespace {
+
+const int kThreads = 256;
+const int kWarps = kThreads / 32;
+// E and the 45 entries of H.
+const int kSums = 46;
+
+struct DeviceSums {
+  float sums[kSums];
+  int numTermsInE;
+  int numTermsInWarped;
+  int numSaturated;
+};
+
+__device__ inline float warpSum(float v) {
+  for (int offset = 16; offset > 0; offset /= 2) {
+    v += __shfl_down_sync(0xffffffff, v, offset);
+  }
+  return v;
+}
+
+__device__ inline int warpSum(int v) {
+  for (int offset = 16; offset > 0; offset /= 2) {
+    v += __shfl_down_sync(0xffffffff, v, offset);
+  }
+  return v;
+}
+
+//! getInterpolatedElement33 of an interleaved [intensity gx gy] image.
+__device__ inline float3 interpolate33(const float* dI, float x, float y,
+                                       int w) {
+  const int ix = static_cast<int>(x);
+  const int iy = static_cast<int>(y);
+  const float dx = x - ix;
+  const float dy = y - iy;
+  const float dxdy = dx * dy;
+  const float* bp = dI + 3 * (ix + iy * w);
+  const float w11 = dxdy, w01 = dy - dxdy, w10 = dx - dxdy;
+  const float w00 = 1 - dx - dy + dxdy;
+  return make_float3(w11 * bp[3 * w + 3] + w01 * bp[3 * w] + w10 * bp[3] +
+                         w00 * bp[0],
+                     w11 * bp[3 * w + 4] + w01 * bp[3 * w + 1] +
+                         w10 * bp[4] + w00 * bp[1],
+                     w11 * bp[3 * w + 5] + w01 * bp[3 * w + 2] +
+                         w10 * bp[5] + w00 * bp[2]);
+}
+
+/** One point per thread (grid stride): the scalar loop of CoarseTracker::
+ *  calcRes, and for the warped points the Jacobian of calcGSSSE. Every block
+ *  reduces into out with one atomic per sum. */
+__global__ void calcResAndGSKernel(const float* __restrict__ pc_u,
+                                   const float* __restrict__ pc_v,
+                                   const float* __restrict__ pc_idepth,
+                                   const float* __restrict__ pc_color, int n,
+                                   const float* __restrict__ dI, int wl, int hl,
+                                   CoarseTrackerCudaParams p,
+                                   DeviceSums* out) {
+  float sums[kSums];
+  for (int k = 0; k < kSums; ++k) {
+    sums[k] = 0;
+  }
+  int numTermsInE = 0, numTermsInWarped = 0, numSaturated = 0;
+  const float maxEnergy = 2 * p.huberTH * p.cutoffTH - p.huberTH * p.huberTH;
+
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < n;
+       i += blockDim.x * gridDim.x) {
+    const float x = pc_u[i];
+    const float y = pc_v[i];
+    const float id = pc_idepth[i];
+    const float pt0 = p.RKi[0] * x + p.RKi[1] * y + p.RKi[2] + p.t[0] * id;
+    const float pt1 = p.RKi[3] * x + p.RKi[4] * y + p.RKi[5] + p.t[1] * id;
+    const float pt2 = p.RKi[6] * x + p.RKi[7] * y + p.RKi[8] + p.t[2] * id;
+    const float u = pt0 / pt2;
+    const float v = pt1 / pt2;
+    const float Ku = p.fx * u + p.cx;
+    const float Kv = p.fy * v + p.cy;
+    const float newIdepth = id / pt2;
+    if (!(Ku > 2 && Kv > 2 && Ku < wl - 3 && Kv < hl - 3 && newIdepth > 0)) {
+      continue;
+    }
+
+    const float3 hit = interpolate33(dI, Ku, Kv, wl);
+    if (!isfinite(hit.x)) {
+      continue;
+    }
+    const float refColor = pc_color[i];
+    const float residual = hit.x - (p.affA * refColor + p.affB);
+    const float absRes = fabsf(residual);
+    const float hw = absRes < p.huberTH ? 1 : p.huberTH / absRes;
+    ++numTermsInE;
+    if (absRes > p.cutoffTH) {
+      sums[0] += maxEnergy;
+      ++numSaturated;
+      continue;
+    }
+    sums[0] += hw * residual * residual * (2 - hw);
+    ++numTermsInWarped;
+
+    const float dx = hit.y * p.fx;
+    const float dy = hit.z * p.fy;
+    float J[9];
+    J[0] = newIdepth * dx;
+    J[1] = newIdepth * dy;
+    J[2] = -newIdepth * (u * dx + v * dy);
+    J[3] = -(u * v * dx + dy * (1 + v * v));
+    J[4] = u * v * dy + dx * (1 + u * u);
+    J[5] = u * dy - v * dx;
+    J[6] = p.affA * (p.b0 - refColor);
+    J[7] = -1;
+    J[8] = residual;
+    int k = 1;
+#pragma unroll
+    for (int r = 0; r < 9; ++r) {
+      const float Jrw = J[r] * hw;
+#pragma unroll
+      for (int c = r; c < 9; ++c) {
+        sums[k++] += Jrw * J[c];
+      }
+    }
+  }
+
+  // warps, then the warps of the block, then one atomic per sum.
+  __shared__ float blockSums[kWarps][kSums];
+  __shared__ int blockCounts[kWarps][3];
+  const int warp = threadIdx.x / 32;
+  const int lane = threadIdx.x % 32;
+  for (int k = 0; k < kSums; ++k) {
+    const float s = warpSum(sums[k]);
+    if (lane == 0) {
+      blockSums[warp][k] = s;
+    }
+  }
+  numTermsInE = warpSum(numTermsInE);
+  numTermsInWarped = warpSum(numTermsInWarped);
+  numSaturated = warpSum(numSaturated);
+  if (lane == 0) {
+    blockCounts[warp][0] = numTermsInE;
+    blockCounts[warp][1] = numTermsInWarped;
+    blockCounts[warp][2] = numSaturated;
+  }
+  __syncthreads();
+
+  if (threadIdx.x < kSums) {
+    float s = 0;
+    for (int w = 0; w < kWarps; ++w) {
+      s += blockSums[w][threadIdx.x];
+    }
+    atomicAdd(&out->sums[threadIdx.x], s);
+  } else if (threadIdx.x < kSums + 3) {
+    const int c = threadIdx.x - kSums;
+    int s = 0;
+    for (int w = 0; w < kWarps; ++w) {
+      s += blockCounts[w][c];
+    }
+    atomicAdd(c == 0 ? &out->numTermsInE
+                     : (c == 1 ? &out->numTermsInWarped : &out->numSaturated),
+              s);
+  }
+}
+
+}  // namespace
+
+struct CoarseTrackerCuda::Impl {
+  int levels;
+  std::vector<int> w, h;
+  // per level: the reference points (4 arrays of w * h) and the frame.
+  std::vector<float*> pc_u, pc_v, pc_idepth, pc_color, dI;
+  std::vector<int> pc_n;
+  DeviceSums* sums;
+  cudaStream_t stream;
+  int maxBlocks;
+};
+
+CoarseTrackerCuda::CoarseTrackerCuda(const int* w, const int* h, int levels)
+    : refVersion(-1), impl(new Impl()) {
+  impl->levels = levels;
+  impl->w.assign(w, w + levels);
+  impl->h.assign(h, h + levels);
+  impl->pc_u.assign(levels, nullptr);
+  impl->pc_v.assign(levels, nullptr);
+  impl->pc_idepth.assign(levels, nullptr);
+  impl->pc_color.assign(levels, nullptr);
+  impl->dI.assign(levels, nullptr);
+  impl->pc_n.assign(levels, 0);
+  for (int lvl = 0; lvl < levels; ++lvl) {
+    const size_t wh = static_cast<size_t>(w[lvl]) * h[lvl];
+    CUDA_CHECK(cudaMalloc(&impl->pc_u[lvl], wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->pc_v[lvl], wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->pc_idepth[lvl], wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->pc_color[lvl], wh * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->dI[lvl], 3 * wh * sizeof(float)));
+  }
+  CUDA_CHECK(cudaMalloc(&impl->sums, sizeof(DeviceSums)));
+  CUDA_CHECK(cudaStreamCreate(&impl->stream));
+
+  int device, sms;
+  CUDA_CHECK(cudaGetDevice(&device));
+  CUDA_CHECK(
+      cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device));
+  impl->maxBlocks = 4 * sms;
+}
+
+CoarseTrackerCuda::~CoarseTrackerCuda() {
+  for (int lvl = 0; lvl < impl->levels; ++lvl) {
+    cudaFree(impl->pc_u[lvl]);
+    cudaFree(impl->pc_v[lvl]);
+    cudaFree(impl->pc_idepth[lvl]);
+    cudaFree(impl->pc_color[lvl]);
+    cudaFree(impl->dI[lvl]);
+  }
+  cudaFree(impl->sums);
+  cudaStreamDestroy(impl->stream);
+  delete impl;
+}
+
+bool CoarseTrackerCuda::deviceAvailable() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+void CoarseTrackerCuda::setReference(int lvl, const float* u, const float* v,
+                                     const float* idepth, const float* color,
+                                     int n) {
+  CHECK_LT(lvl, impl->levels);
+  CHECK_LE(n, impl->w[lvl] * impl->h[lvl]);
+  const size_t bytes = n * sizeof(float);
+  CUDA_CHECK(cudaMemcpyAsync(impl->pc_u[lvl], u, bytes,
+                             cudaMemcpyHostToDevice, impl->stream));
+  CUDA_CHECK(cudaMemcpyAsync(impl->pc_v[lvl], v, bytes,
+                             cudaMemcpyHostToDevice, impl->stream));
+  CUDA_CHECK(cudaMemcpyAsync(impl->pc_idepth[lvl], idepth, bytes,
+                             cudaMemcpyHostToDevice, impl->stream));
+  CUDA_CHECK(cudaMemcpyAsync(impl->pc_color[lvl], color, bytes,
+                             cudaMemcpyHostToDevice, impl->stream));
+  impl->pc_n[lvl] = n;
+}
+
+void CoarseTrackerCuda::setFrame(const float* const* dI) {
+  for (int lvl = 0; lvl < impl->levels; ++lvl) {
+    const size_t bytes =
+        3 * static_cast<size_t>(impl->w[lvl]) * impl->h[lvl] * sizeof(float);
+    CUDA_CHECK(cudaMemcpyAsync(impl->dI[lvl], dI[lvl], bytes,
+                               cudaMemcpyHostToDevice, impl->stream));
+  }
+}
+
+void CoarseTrackerCuda::calcResAndGS(int lvl, int n,
+                                     const CoarseTrackerCudaParams& params,
+                                     CoarseTrackerCudaResult* result) {
+  CHECK_LT(lvl, impl->levels);
+  CHECK_LE(n, impl->pc_n[lvl]);
+  CUDA_CHECK(cudaMemsetAsync(impl->sums, 0, sizeof(DeviceSums), impl->stream));
+  const int blocks =
+      std::max(1, std::min(impl->maxBlocks, (n + kThreads - 1) / kThreads));
+  calcResAndGSKernel<<<blocks, kThreads, 0, impl->stream>>>(
+      impl->pc_u[lvl], impl->pc_v[lvl], impl->pc_idepth[lvl],
+      impl->pc_color[lvl], n, impl->dI[lvl], impl->w[lvl], impl->h[lvl],
+      params, impl->sums);
+  CUDA_CHECK(cudaGetLastError());
+
+  DeviceSums sums;
+  CUDA_CHECK(cudaMemcpyAsync(&sums, impl->sums, sizeof(DeviceSums),
+                             cudaMemcpyDeviceToHost, impl->stream));
+  CUDA_CHECK(cudaStreamSynchronize(impl->stream));
+
+  result->E = sums.sums[0];
+  for (int k = 0; k < 45; ++k) {
+    result->H[k] = sums.sums[k + 1];
+  }
+  result->numTermsInE = sums.numTermsInE;
+  result->numTermsInWarped = sums.numTermsInWarped;
+  result->numSaturated = sums.numSaturated;
+}
+
+}  // dso
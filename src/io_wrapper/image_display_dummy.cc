@@ -28,6 +28,9 @@ void displayImageStitch(const char* windowName,
                         int rc){};
 
 int waitKey(int milliseconds) { return 0; };
+int pollKey() { return 0; }
 void closeAllWindows(){};
+
+bool canDisplay() { return false; }
 }
 }
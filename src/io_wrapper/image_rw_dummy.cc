@@ -22,6 +22,16 @@ MinimalImageB* readStreamBW_8U(char* data, int numBytes) {
   LOG(WARNING) << "Not implemented. Bye!";
   return nullptr;
 };
+bool readImageBW_8U(const std::string& filename, MinimalImageB* img,
+                    int reduction) {
+  LOG(WARNING) << "Not implemented. Bye!";
+  return false;
+};
+bool readStreamBW_8U(const char* data, int numBytes, MinimalImageB* img,
+                     int reduction) {
+  LOG(WARNING) << "Not implemented. Bye!";
+  return false;
+};
 void writeImage(std::string filename, MinimalImageB* img){};
 void writeImage(std::string filename, MinimalImageB3* img){};
 void writeImage(std::string filename, MinimalImageF* img){};
@@ -1,12 +1,15 @@
 #include "io_wrapper/image_display.h"
 
+#include <atomic>
 #include <string>
 #include <unordered_set>
 
+#include <boost/lockfree/queue.hpp>
 #include <boost/thread.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "util/settings.h"
+#include "util/thread_config.h"
 
 namespace dso {
 
@@ -15,6 +18,62 @@ namespace IOWrap {
 std::unordered_set<std::string> openWindows;
 boost::mutex openCVdisplayMutex;
 
+namespace {
+
+/** The HighGUI event loop, on a thread of its own: it repaints the windows
+ *  and hands the pressed keys over through a lock-free queue, so reading a
+ *  key never sleeps in cv::waitKey on the caller's thread. Started by the
+ *  first pollKey / waitKey, stopped at exit.
+ */
+class KeyThread {
+ public:
+  ~KeyThread() {
+    running = false;
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  void start() {
+    boost::call_once(started, [this] {
+      running = true;
+      thread = boost::thread(&KeyThread::loop, this);
+    });
+  }
+
+  int pop() {
+    char k = 0;
+    return keys.pop(k) ? k : 0;
+  }
+
+ private:
+  void loop() {
+    ThreadConfig::SetThreadName("ui");
+    while (running) {
+      int k;
+      {
+        boost::unique_lock<boost::mutex> lock(openCVdisplayMutex);
+        k = cv::waitKey(1);
+      }
+      // keys beyond the queue are lost, like unread ones in HighGUI.
+      if (k > 0) {
+        keys.push(static_cast<char>(k));
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+  }
+
+  boost::once_flag started = BOOST_ONCE_INIT;
+  std::atomic<bool> running{false};
+  boost::thread thread;
+  // popped by any thread that reads keys.
+  boost::lockfree::queue<char, boost::lockfree::capacity<64>> keys;
+};
+
+KeyThread keyThread;
+
+}  // namespace
+
 void displayImage(const char* windowName, const cv::Mat& image, bool autoSize) {
   if (disableAllDisplay) {
     return;
@@ -44,7 +103,8 @@ void displayImageStitch(const char* windowName,
   int w = images[0]->cols;
   int h = images[0]->rows;
 
-  int num = std::max((int)setting_maxFrames, (int)images.size());
+  // room for a full window of the default size.
+  int num = std::max(Settings().maxFrames, (int)images.size());
 
   // get optimal dimensions.
   int bestCC = 0;
@@ -169,8 +229,26 @@ int waitKey(int milliseconds) {
     return 0;
   }
 
-  boost::unique_lock<boost::mutex> lock(openCVdisplayMutex);
-  return cv::waitKey(milliseconds);
+  keyThread.start();
+  const boost::chrono::steady_clock::time_point until =
+      boost::chrono::steady_clock::now() +
+      boost::chrono::milliseconds(milliseconds);
+  while (true) {
+    const int k = keyThread.pop();
+    if (k != 0 ||
+        (milliseconds > 0 && boost::chrono::steady_clock::now() >= until)) {
+      return k;
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+  }
+}
+
+int pollKey() {
+  if (disableAllDisplay) {
+    return 0;
+  }
+  keyThread.start();
+  return keyThread.pop();
 }
 
 void closeAllWindows() {
@@ -181,5 +259,7 @@ void closeAllWindows() {
   cv::destroyAllWindows();
   openWindows.clear();
 }
+
+bool canDisplay() { return !disableAllDisplay; }
 }
 }
@@ -1,11 +1,54 @@
 #include "io_wrapper/image_rw.h"
 
+#include <fstream>
+#include <vector>
+
 #include <glog/logging.h>
 #include <opencv2/highgui.hpp>
 
 namespace dso {
 
 namespace IOWrap {
+
+namespace {
+
+// imdecode into img, straight into its buffer if the size did not change.
+bool decodeInto(const cv::Mat& encoded, MinimalImageB* img,
+                const int reduction, const std::string& name) {
+  int flags;
+  switch (reduction) {
+    case 1:
+      flags = cv::IMREAD_GRAYSCALE;
+      break;
+    case 2:
+      flags = cv::IMREAD_REDUCED_GRAYSCALE_2;
+      break;
+    case 4:
+      flags = cv::IMREAD_REDUCED_GRAYSCALE_4;
+      break;
+    case 8:
+      flags = cv::IMREAD_REDUCED_GRAYSCALE_8;
+      break;
+    default:
+      LOG(FATAL) << "Decode reduction " << reduction << " is not 1, 2, 4 or 8.";
+      return false;
+  }
+
+  cv::Mat m(img->h, img->w, CV_8U, img->data);
+  cv::imdecode(encoded, flags, &m);
+  if (m.rows * m.cols == 0 || m.type() != CV_8U) {
+    LOG(ERROR) << "cv::imdecode could not read " << name << "!";
+    return false;
+  }
+  if (m.data != img->data) {
+    img->resize(m.cols, m.rows);
+    memcpy((void*)img->data, m.data, m.rows * m.cols);
+  }
+  return true;
+}
+
+}  // namespace
+
 MinimalImageB* readImageBW_8U(std::string filename) {
   cv::Mat m = cv::imread(filename,  cv::IMREAD_GRAYSCALE);
   if (m.rows * m.cols == 0) {
@@ -78,6 +121,34 @@ MinimalImageB* readStreamBW_8U(char* data, int numBytes) {
   return img;
 }
 
+bool readImageBW_8U(const std::string& filename, MinimalImageB* img,
+                    int reduction) {
+  // the encoded bytes are kept per thread, like the decoded image by the
+  // caller.
+  thread_local std::vector<char> bytes;
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  const std::streamoff size = file.tellg();
+  if (!file || size <= 0) {
+    LOG(ERROR) << "Cannot open image " << filename << "!";
+    return false;
+  }
+  bytes.resize(size);
+  file.seekg(0);
+  if (!file.read(bytes.data(), size)) {
+    LOG(ERROR) << "Cannot read image " << filename << "!";
+    return false;
+  }
+  return decodeInto(cv::Mat(1, static_cast<int>(size), CV_8U, bytes.data()),
+                    img, reduction, filename);
+}
+
+bool readStreamBW_8U(const char* data, int numBytes, MinimalImageB* img,
+                     int reduction) {
+  return decodeInto(cv::Mat(1, numBytes, CV_8U, const_cast<char*>(data)), img,
+                    reduction, "stream (" + std::to_string(numBytes) +
+                                   " bytes)");
+}
+
 void writeImage(std::string filename, MinimalImageB* img) {
   cv::imwrite(filename, cv::Mat(img->h, img->w, CV_8U, img->data));
 }
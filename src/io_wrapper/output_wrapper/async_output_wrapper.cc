@@ -0,0 +1,332 @@
+#include "io_wrapper/output_wrapper/async_output_wrapper.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "full_system/immature_point.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+namespace IOWrap {
+
+namespace {
+
+template <typename T>
+MinimalImage<T>* copyImage(const MinimalImage<T>* const image) {
+  MinimalImage<T>* copy = new MinimalImage<T>(image->w, image->h);
+  std::copy(image->data, image->data + image->w * image->h, copy->data);
+  return copy;
+}
+
+// a copy detached from the energy functional and from the residuals of p.
+PointHessian* copyPoint(const PointHessian* const p, FrameHessian* host) {
+  PointHessian* copy = new PointHessian(*p);
+  // the destructor counts down, the implicit copy constructor does not count.
+  ++PointHessian::instanceCounter;
+  copy->efPoint = nullptr;
+  copy->host = host;
+  copy->residuals.clear();
+  copy->lastResiduals[0].first = copy->lastResiduals[1].first = nullptr;
+  return copy;
+}
+
+//! fh with its own shell, state and (withPoints) points, but without images.
+FrameHessian* copyFrame(const FrameHessian* const fh, const bool withPoints) {
+  FrameHessian* copy = new FrameHessian(*fh->calib, *fh->settings);
+  copy->shell = new FrameShell(*fh->shell);
+  copy->frameID = fh->frameID;
+  copy->idx = fh->idx;
+  copy->ab_exposure = fh->ab_exposure;
+  copy->frameEnergyTH = fh->frameEnergyTH;
+  copy->flaggedForMarginalization = fh->flaggedForMarginalization;
+  copy->setEvalPT(fh->get_worldToCam_evalPT(), fh->get_state_zero());
+  copy->setState(fh->get_state());
+  if (!withPoints) {
+    return copy;
+  }
+
+  const std::vector<PointHessian*>* from[3] = {
+      &fh->pointHessians, &fh->pointHessiansMarginalized,
+      &fh->pointHessiansOut};
+  std::vector<PointHessian*>* to[3] = {&copy->pointHessians,
+                                       &copy->pointHessiansMarginalized,
+                                       &copy->pointHessiansOut};
+  for (int k = 0; k < 3; ++k) {
+    to[k]->reserve(from[k]->size());
+    for (const PointHessian* p : *from[k]) {
+      to[k]->emplace_back(copyPoint(p, copy));
+    }
+  }
+  copy->immaturePoints.reserve(fh->immaturePoints.size());
+  for (const ImmaturePoint* p : fh->immaturePoints) {
+    ImmaturePoint* ip = new ImmaturePoint(*p);
+    ip->host = copy;
+    copy->immaturePoints.emplace_back(ip);
+  }
+  return copy;
+}
+
+}  // namespace
+
+struct AsyncOutputWrapper::Snapshot {
+  enum Type {
+    GRAPH,
+    KEYFRAMES,
+    CAM_POSE,
+    LIVE_FRAME,
+    SKIPPED_FRAME,
+    DEPTH_IMAGE,
+    DEPTH_IMAGE_FLOAT,
+    RESET
+  };
+
+  explicit Snapshot(const Type type)
+      : type(type),
+        final(false),
+        calib(nullptr),
+        shell(nullptr),
+        frame(nullptr),
+        imageB3(nullptr),
+        imageF(nullptr),
+        incomingId(-1),
+        timestamp(0),
+        lateMs(0) {}
+
+  ~Snapshot() {
+    for (FrameHessian* fh : frames) {
+      delete fh->shell;
+      delete fh;
+    }
+    if (frame != nullptr) {
+      delete frame->shell;
+      delete frame;
+    }
+    delete calib;
+    delete shell;
+    delete imageB3;
+    delete imageF;
+  }
+
+  bool droppable() const {
+    return type != RESET && !(type == KEYFRAMES && final);
+  }
+
+  const Type type;
+  FlatHashMap<Eigen::Vector2i> graph;
+  std::vector<FrameHessian*> frames;
+  bool final;
+  CalibHessian* calib;
+  FrameShell* shell;
+  FrameHessian* frame;
+  MinimalImageB3* imageB3;
+  MinimalImageF* imageF;
+  int incomingId;
+  double timestamp;
+  double lateMs;
+};
+
+AsyncOutputWrapper::AsyncOutputWrapper(Output3DWrapper* wrapped,
+                                       const size_t capacity,
+                                       const Backpressure policy)
+    : wrapped(CHECK_NOTNULL(wrapped)),
+      capacity(std::max<size_t>(capacity, 1)),
+      policy(policy),
+      busy(false),
+      running(true),
+      numDropped(0) {
+  publisherThread = boost::thread(&AsyncOutputWrapper::publisherLoop, this);
+}
+
+AsyncOutputWrapper::~AsyncOutputWrapper() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    running = false;
+  }
+  queueSignal.notify_all();
+  publisherThread.join();
+  LOG_IF(INFO, numDropped > 0)
+      << "OUT: AsyncOutputWrapper dropped " << numDropped << " snapshots";
+  delete wrapped;
+}
+
+void AsyncOutputWrapper::publishGraph(
+    const FlatHashMap<Eigen::Vector2i>& connectivity) {
+  Snapshot* snapshot = new Snapshot(Snapshot::GRAPH);
+  snapshot->graph = connectivity;
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::publishKeyframes(std::vector<FrameHessian*>& frames,
+                                          bool final, CalibHessian* HCalib) {
+  Snapshot* snapshot = new Snapshot(Snapshot::KEYFRAMES);
+  snapshot->final = final;
+  snapshot->frames.reserve(frames.size());
+  for (const FrameHessian* fh : frames) {
+    snapshot->frames.emplace_back(copyFrame(fh, true));
+  }
+  snapshot->calib = new CalibHessian(*HCalib);
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::publishCamPose(FrameShell* frame,
+                                        CalibHessian* HCalib) {
+  Snapshot* snapshot = new Snapshot(Snapshot::CAM_POSE);
+  snapshot->shell = new FrameShell(*frame);
+  snapshot->calib = new CalibHessian(*HCalib);
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::pushLiveFrame(FrameHessian* image) {
+  Snapshot* snapshot = new Snapshot(Snapshot::LIVE_FRAME);
+  snapshot->frame = copyFrame(image, false);
+  FrameHessian* const copy = snapshot->frame;
+  PyramidBufferPool::Acquire(*copy->calib, copy->dIp, copy->absSquaredGrad);
+  copy->dI = copy->dIp[0];
+  const Eigen::Vector3f* dI = CHECK_NOTNULL(image->dI);
+  std::copy(dI, dI + image->calib->w[0] * image->calib->h[0], copy->dI);
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::publishSkippedFrame(int incomingId, double timestamp,
+                                             double lateMs) {
+  Snapshot* snapshot = new Snapshot(Snapshot::SKIPPED_FRAME);
+  snapshot->incomingId = incomingId;
+  snapshot->timestamp = timestamp;
+  snapshot->lateMs = lateMs;
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::pushDepthImage(MinimalImageB3* image) {
+  Snapshot* snapshot = new Snapshot(Snapshot::DEPTH_IMAGE);
+  snapshot->imageB3 = copyImage(image);
+  push(snapshot);
+}
+
+int AsyncOutputWrapper::capabilities() { return wrapped->capabilities(); }
+
+void AsyncOutputWrapper::pushDepthImageFloat(MinimalImageF* image,
+                                             FrameHessian* KF) {
+  Snapshot* snapshot = new Snapshot(Snapshot::DEPTH_IMAGE_FLOAT);
+  snapshot->imageF = copyImage(image);
+  snapshot->frame = copyFrame(KF, false);
+  push(snapshot);
+}
+
+void AsyncOutputWrapper::join() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    while (!queue.empty() || busy) {
+      spaceSignal.wait(lock);
+    }
+  }
+  wrapped->join();
+}
+
+void AsyncOutputWrapper::reset() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    // the snapshots belong to the system that was reset.
+    for (Snapshot* snapshot : queue) {
+      delete snapshot;
+    }
+    queue.clear();
+    queue.emplace_back(new Snapshot(Snapshot::RESET));
+  }
+  queueSignal.notify_one();
+}
+
+uint64_t AsyncOutputWrapper::getNumDropped() const {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  return numDropped;
+}
+
+void AsyncOutputWrapper::push(Snapshot* snapshot) {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  if (snapshot->droppable() && queue.size() >= capacity) {
+    if (policy == BLOCK) {
+      while (queue.size() >= capacity) {
+        spaceSignal.wait(lock);
+      }
+    } else if (policy == DROP_OLDEST) {
+      std::deque<Snapshot*>::iterator oldest = queue.begin();
+      while (oldest != queue.end() && !(*oldest)->droppable()) {
+        ++oldest;
+      }
+      if (oldest != queue.end()) {
+        delete *oldest;
+        queue.erase(oldest);
+        ++numDropped;
+      } else {
+        // only final keyframes queued, they have to go first.
+        delete snapshot;
+        ++numDropped;
+        return;
+      }
+    } else {
+      delete snapshot;
+      ++numDropped;
+      return;
+    }
+  }
+  queue.emplace_back(snapshot);
+  lock.unlock();
+  queueSignal.notify_one();
+}
+
+void AsyncOutputWrapper::publisherLoop() {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while (true) {
+    while (queue.empty() && running) {
+      queueSignal.wait(lock);
+    }
+    if (queue.empty()) {
+      return;
+    }
+    Snapshot* snapshot = queue.front();
+    queue.pop_front();
+    busy = true;
+    lock.unlock();
+    spaceSignal.notify_all();
+
+    switch (snapshot->type) {
+      case Snapshot::GRAPH:
+        wrapped->publishGraph(snapshot->graph);
+        break;
+      case Snapshot::KEYFRAMES:
+        wrapped->publishKeyframes(snapshot->frames, snapshot->final,
+                                  snapshot->calib);
+        break;
+      case Snapshot::CAM_POSE:
+        wrapped->publishCamPose(snapshot->shell, snapshot->calib);
+        break;
+      case Snapshot::LIVE_FRAME:
+        wrapped->pushLiveFrame(snapshot->frame);
+        break;
+      case Snapshot::SKIPPED_FRAME:
+        wrapped->publishSkippedFrame(snapshot->incomingId,
+                                     snapshot->timestamp, snapshot->lateMs);
+        break;
+      case Snapshot::DEPTH_IMAGE:
+        wrapped->pushDepthImage(snapshot->imageB3);
+        break;
+      case Snapshot::DEPTH_IMAGE_FLOAT:
+        wrapped->pushDepthImageFloat(snapshot->imageF, snapshot->frame);
+        break;
+      case Snapshot::RESET:
+        wrapped->reset();
+        break;
+    }
+    delete snapshot;
+
+    lock.lock();
+    busy = false;
+    if (queue.empty()) {
+      spaceSignal.notify_all();
+    }
+  }
+}
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -0,0 +1,373 @@
+#include "io_wrapper/output_wrapper/map_store.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "io_wrapper/output_wrapper/ply_output_wrapper.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+namespace IOWrap {
+
+namespace {
+
+// cell coordinates are packed into 21 bits each.
+const int kCellBits = 21;
+const int kCellRange = (1 << (kCellBits - 1)) - 1;
+
+int cellCoord(const float v, const float cellSize) {
+  const float c = floorf(v / cellSize);
+  return static_cast<int>(std::max<float>(-kCellRange,
+                                          std::min<float>(kCellRange, c)));
+}
+
+}  // namespace
+
+MapStore::MapStore(const std::string& dir, const float cellSize,
+                   const size_t cachePoints)
+    : dir(dir),
+      cellSize(cellSize),
+      cachePoints(cachePoints),
+      writing(false),
+      running(true),
+      numCachedPoints(0),
+      numStoredPoints(0),
+      storeVersion(0) {
+  CHECK_GT(cellSize, 0);
+  CHECK(mkdir(dir.c_str(), 0755) == 0 || errno == EEXIST)
+      << "OUT: Cannot create " << dir;
+  writerThread = boost::thread(&MapStore::writerLoop, this);
+  LOG(INFO) << "OUT: Created MapStore in " << dir << ", cells of " << cellSize
+            << ", caching up to " << cachePoints << " points";
+}
+
+MapStore::~MapStore() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    running = false;
+  }
+  queueSignal.notify_all();
+  writerThread.join();
+
+  boost::unique_lock<boost::mutex> lock(storeMutex);
+  LOG(INFO) << "OUT: Destroyed MapStore, held " << numStoredPoints
+            << " points in " << cells.size() << " cells";
+  clearCells();
+}
+
+void MapStore::publishKeyframes(std::vector<FrameHessian*>& frames,
+                                bool is_final, CalibHessian* HCalib) {
+  if (!is_final) {
+    return;
+  }
+
+  const float fxi = 1.f / HCalib->fxl(), fyi = 1.f / HCalib->fyl();
+  const float cxi = -HCalib->cxl() * fxi, cyi = -HCalib->cyl() * fyi;
+
+  std::vector<Point> chunk;
+  for (FrameHessian* frame : frames) {
+    if (!frame->shell->poseValid) {
+      continue;
+    }
+    const Eigen::Matrix<double, 3, 4> c2w =
+        frame->shell->camToWorld.matrix3x4();
+
+    // the same points (and positions) as PlyOutputWrapper.
+    chunk.reserve(chunk.size() + frame->pointHessiansMarginalized.size());
+    for (const PointHessian* point : frame->pointHessiansMarginalized) {
+      const float depth = 1.f / point->idepth;
+      const Eigen::Vector4d ptCam((point->u * fxi + cxi) * depth,
+                                  (point->v * fyi + cyi) * depth,
+                                  (1.f + 2.f * fxi) * depth, 1.);
+      const Eigen::Vector3d ptWorld = c2w * ptCam;
+      if (!ptWorld.allFinite()) {
+        continue;
+      }
+
+      Point p;
+      p.x = ptWorld.x();
+      p.y = ptWorld.y();
+      p.z = ptWorld.z();
+      p.intensity = point->color[0];
+      p.idepth = point->idepth;
+      p.idepthVar = 1.f / (point->idepth_hessian + 0.01f);
+      p.relObsBaseline = point->maxRelBaseline;
+      p.keyframe = frame->shell->incoming_id;
+      chunk.emplace_back(p);
+    }
+  }
+
+  if (chunk.empty()) {
+    return;
+  }
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    queue.emplace_back(std::move(chunk));
+  }
+  queueSignal.notify_one();
+}
+
+void MapStore::join() {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while (!queue.empty() || writing) {
+    idleSignal.wait(lock);
+  }
+}
+
+void MapStore::reset() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    queue.clear();
+    while (writing) {
+      idleSignal.wait(lock);
+    }
+  }
+  boost::unique_lock<boost::mutex> lock(storeMutex);
+  clearCells();
+}
+
+void MapStore::query(const Eigen::Vector3f& center, const float radius,
+                     std::vector<Point>* out) {
+  const Eigen::Vector3f lo = center.array() - radius;
+  const Eigen::Vector3f hi = center.array() + radius;
+  const int x0 = cellCoord(lo.x(), cellSize), x1 = cellCoord(hi.x(), cellSize);
+  const int y0 = cellCoord(lo.y(), cellSize), y1 = cellCoord(hi.y(), cellSize);
+  const int z0 = cellCoord(lo.z(), cellSize), z1 = cellCoord(hi.z(), cellSize);
+
+  // the distance of center to the box of cell.
+  auto inRange = [&](const Cell& cell) {
+    const Eigen::Vector3f cellMin =
+        Eigen::Vector3f(cell.x, cell.y, cell.z) * cellSize;
+    const Eigen::Vector3f d =
+        (cellMin - center)
+            .cwiseMax(center - cellMin - Eigen::Vector3f::Constant(cellSize))
+            .cwiseMax(0);
+    return d.squaredNorm() <= radius * radius;
+  };
+
+  boost::unique_lock<boost::mutex> lock(storeMutex);
+  std::vector<Cell*> hits;
+  const double numInBox =
+      double(x1 - x0 + 1) * double(y1 - y0 + 1) * double(z1 - z0 + 1);
+  if (numInBox > cells.size()) {
+    for (const auto& it : cells) {
+      if (inRange(*it.second)) {
+        hits.emplace_back(it.second);
+      }
+    }
+  } else {
+    for (int z = z0; z <= z1; ++z) {
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          const uint64_t key = cellKey(x, y, z);
+          if (cells.count(key) != 0 && inRange(*cells.at(key))) {
+            hits.emplace_back(cells.at(key));
+          }
+        }
+      }
+    }
+  }
+
+  for (Cell* cell : hits) {
+    touchCell(cell);
+    out->insert(out->end(), cell->points.begin(), cell->points.end());
+  }
+  evictCells();
+}
+
+uint64_t MapStore::version() const {
+  boost::unique_lock<boost::mutex> lock(storeMutex);
+  return storeVersion;
+}
+
+uint64_t MapStore::numPoints() const {
+  boost::unique_lock<boost::mutex> lock(storeMutex);
+  return numStoredPoints;
+}
+
+bool MapStore::writePly(const std::string& path) {
+  std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file.is_open()) {
+    LOG(ERROR) << "OUT: Cannot open " << path;
+    return false;
+  }
+  PlyOutputWrapper::WriteHeader(file, 0);
+
+  uint64_t numWritten = 0;
+  std::vector<PlyOutputWrapper::Vertex> buffer;
+  buffer.reserve(1 << 16);
+  auto flush = [&]() {
+    file.write(reinterpret_cast<const char*>(buffer.data()),
+               buffer.size() * sizeof(PlyOutputWrapper::Vertex));
+    numWritten += buffer.size();
+    buffer.clear();
+  };
+  forEachPoint([&](const Point& p) {
+    PlyOutputWrapper::Vertex v;
+    v.x = p.x;
+    v.y = p.y;
+    v.z = p.z;
+    v.intensity = p.intensity;
+    v.idepth = p.idepth;
+    v.idepthVar = p.idepthVar;
+    v.keyframe = p.keyframe;
+    buffer.emplace_back(v);
+    if (buffer.size() == buffer.capacity()) {
+      flush();
+    }
+  });
+  flush();
+
+  // the header has a fixed width, rewrite it with the count.
+  file.seekp(0);
+  PlyOutputWrapper::WriteHeader(file, numWritten);
+  file.close();
+  if (file.fail()) {
+    LOG(ERROR) << "OUT: Writing " << path << " failed";
+    return false;
+  }
+  LOG(INFO) << "OUT: Exported " << numWritten << " points of the MapStore to "
+            << path;
+  return true;
+}
+
+uint64_t MapStore::cellKey(const int x, const int y, const int z) {
+  const uint64_t mask = (uint64_t(1) << kCellBits) - 1;
+  return ((uint64_t(x + kCellRange) & mask) << (2 * kCellBits)) |
+         ((uint64_t(y + kCellRange) & mask) << kCellBits) |
+         (uint64_t(z + kCellRange) & mask);
+}
+
+std::string MapStore::cellPath(const Cell& cell) const {
+  char name[64];
+  snprintf(name, sizeof(name), "/cell_%d_%d_%d.bin", cell.x, cell.y, cell.z);
+  return dir + name;
+}
+
+void MapStore::appendToCell(Cell* cell, const std::vector<Point>& points) {
+  // a file left over by an earlier run is overwritten.
+  std::ofstream file(cellPath(*cell).c_str(),
+                     std::ios::binary | (cell->numPoints == 0
+                                             ? std::ios::trunc
+                                             : std::ios::app));
+  file.write(reinterpret_cast<const char*>(points.data()),
+             points.size() * sizeof(Point));
+  file.close();
+  if (file.fail()) {
+    LOG(ERROR) << "OUT: Writing " << cellPath(*cell) << " failed, dropping "
+               << points.size() << " points";
+    return;
+  }
+
+  cell->numPoints += points.size();
+  numStoredPoints += points.size();
+  if (cell->cached) {
+    cell->points.insert(cell->points.end(), points.begin(), points.end());
+    numCachedPoints += points.size();
+  }
+}
+
+void MapStore::readCell(const Cell& cell, std::vector<Point>* points) const {
+  points->resize(cell.numPoints);
+  std::ifstream file(cellPath(cell).c_str(), std::ios::binary);
+  file.read(reinterpret_cast<char*>(points->data()),
+            cell.numPoints * sizeof(Point));
+  if (!file.good()) {
+    LOG(ERROR) << "OUT: " << cellPath(cell) << " is truncated!";
+    points->resize(file.gcount() / sizeof(Point));
+  }
+}
+
+void MapStore::touchCell(Cell* cell) {
+  if (cell->cached) {
+    lru.splice(lru.begin(), lru, cell->lru);
+    return;
+  }
+  readCell(*cell, &cell->points);
+  cell->cached = true;
+  numCachedPoints += cell->points.size();
+  lru.emplace_front(cell);
+  cell->lru = lru.begin();
+}
+
+void MapStore::evictCells() {
+  while (numCachedPoints > cachePoints && !lru.empty()) {
+    Cell* cell = lru.back();
+    lru.pop_back();
+    numCachedPoints -= cell->points.size();
+    std::vector<Point>().swap(cell->points);
+    cell->cached = false;
+  }
+  memory.set(numCachedPoints * sizeof(Point));
+}
+
+void MapStore::clearCells() {
+  for (const auto& it : cells) {
+    unlink(cellPath(*it.second).c_str());
+    delete it.second;
+  }
+  cells.clear();
+  lru.clear();
+  numCachedPoints = 0;
+  numStoredPoints = 0;
+  ++storeVersion;
+  memory.set(0);
+}
+
+void MapStore::writerLoop() {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while (true) {
+    while (queue.empty() && running) {
+      queueSignal.wait(lock);
+    }
+    if (queue.empty()) {
+      return;
+    }
+
+    std::vector<Point> chunk = std::move(queue.front());
+    queue.pop_front();
+    writing = true;
+    lock.unlock();
+
+    // a keyframe only covers a few cells, one append each.
+    FlatHashMap<std::vector<Point>> bins;
+    for (const Point& p : chunk) {
+      bins[cellKey(cellCoord(p.x, cellSize), cellCoord(p.y, cellSize),
+                   cellCoord(p.z, cellSize))]
+          .emplace_back(p);
+    }
+    {
+      boost::unique_lock<boost::mutex> storeLock(storeMutex);
+      for (const auto& bin : bins) {
+        Cell*& cell = cells[bin.first];
+        if (cell == nullptr) {
+          const Point& p = bin.second.front();
+          cell = new Cell();
+          cell->x = cellCoord(p.x, cellSize);
+          cell->y = cellCoord(p.y, cellSize);
+          cell->z = cellCoord(p.z, cellSize);
+          cell->numPoints = 0;
+          cell->cached = false;
+        }
+        appendToCell(cell, bin.second);
+      }
+      ++storeVersion;
+      evictCells();
+    }
+
+    lock.lock();
+    writing = false;
+    idleSignal.notify_all();
+  }
+}
+
+}  // namespace IOWrap
+}  // namespace dso
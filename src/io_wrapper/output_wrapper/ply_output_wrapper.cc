@@ -0,0 +1,209 @@
+#include "io_wrapper/output_wrapper/ply_output_wrapper.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+namespace IOWrap {
+
+namespace {
+
+const char kPlyHeaderBegin[] =
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "comment DSO marginalized points\n"
+    "element vertex ";
+
+const char kPlyHeaderEnd[] =
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property float intensity\n"
+    "property float idepth\n"
+    "property float idepth_var\n"
+    "property int keyframe\n"
+    "end_header\n";
+
+// the vertex count is patched in place, so it always takes this many digits.
+const int kCountDigits = 20;
+
+std::string formatCount(const uint64_t count) {
+  char buffer[kCountDigits + 2];
+  snprintf(buffer, sizeof(buffer), "%0*llu\n", kCountDigits,
+           static_cast<unsigned long long>(count));
+  return buffer;
+}
+
+}  // namespace
+
+PlyOutputWrapper::PlyOutputWrapper(const std::string& path)
+    : path(path), numWritten(0), running(true) {
+  file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+  LOG_IF(ERROR, !file.is_open()) << "OUT: Cannot open " << path;
+
+  countPos = WriteHeader(file, 0);
+
+  writerThread = boost::thread(&PlyOutputWrapper::writerLoop, this);
+  LOG(INFO) << "OUT: Created PlyOutputWrapper, saving point cloud to " << path;
+}
+
+PlyOutputWrapper::~PlyOutputWrapper() {
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    running = false;
+  }
+  queueSignal.notify_all();
+  writerThread.join();
+
+  if (file.is_open()) {
+    file.seekp(countPos);
+    file << formatCount(numWritten);
+    file.close();
+    LOG_IF(ERROR, file.fail()) << "OUT: Writing " << path << " failed";
+  }
+  LOG(INFO) << "OUT: Destroyed PlyOutputWrapper, wrote " << numWritten
+            << " points";
+}
+
+void PlyOutputWrapper::publishKeyframes(std::vector<FrameHessian*>& frames,
+                                        bool is_final, CalibHessian* HCalib) {
+  if (!is_final) {
+    return;
+  }
+
+  const float fxi = 1.f / HCalib->fxl(), fyi = 1.f / HCalib->fyl();
+  const float cxi = -HCalib->cxl() * fxi, cyi = -HCalib->cyl() * fyi;
+
+  std::vector<Vertex> chunk;
+  for (FrameHessian* frame : frames) {
+    if (!frame->shell->poseValid) {
+      continue;
+    }
+    const Eigen::Matrix<double, 3, 4> c2w =
+        frame->shell->camToWorld.matrix3x4();
+
+    // use only marginalized points.
+    chunk.reserve(chunk.size() + frame->pointHessiansMarginalized.size());
+    for (const PointHessian* point : frame->pointHessiansMarginalized) {
+      const float depth = 1.f / point->idepth;
+      const Eigen::Vector4d ptCam((point->u * fxi + cxi) * depth,
+                                  (point->v * fyi + cyi) * depth,
+                                  (1.f + 2.f * fxi) * depth, 1.);
+      const Eigen::Vector3d ptWorld = c2w * ptCam;
+
+      Vertex v;
+      v.x = ptWorld.x();
+      v.y = ptWorld.y();
+      v.z = ptWorld.z();
+      v.intensity = point->color[0];
+      v.idepth = point->idepth;
+      v.idepthVar = 1.f / (point->idepth_hessian + 0.01f);
+      v.keyframe = frame->shell->incoming_id;
+      chunk.emplace_back(v);
+    }
+  }
+
+  if (chunk.empty()) {
+    return;
+  }
+  {
+    boost::unique_lock<boost::mutex> lock(queueMutex);
+    queue.emplace_back(std::move(chunk));
+  }
+  queueSignal.notify_one();
+}
+
+void PlyOutputWrapper::writerLoop() {
+  boost::unique_lock<boost::mutex> lock(queueMutex);
+  while (true) {
+    while (queue.empty() && running) {
+      queueSignal.wait(lock);
+    }
+    if (queue.empty()) {
+      return;
+    }
+
+    std::vector<Vertex> chunk = std::move(queue.front());
+    queue.pop_front();
+    lock.unlock();
+
+    if (file.is_open()) {
+      file.write(reinterpret_cast<const char*>(chunk.data()),
+                 chunk.size() * sizeof(Vertex));
+      numWritten += chunk.size();
+    }
+
+    lock.lock();
+  }
+}
+
+std::streampos PlyOutputWrapper::WriteHeader(std::ostream& out,
+                                             const uint64_t count) {
+  out << kPlyHeaderBegin;
+  const std::streampos countPos = out.tellp();
+  out << formatCount(count) << kPlyHeaderEnd;
+  return countPos;
+}
+
+bool PlyOutputWrapper::WriteXyz(const std::string& ply,
+                                const std::string& xyz) {
+  std::ifstream in(ply.c_str(), std::ios::binary);
+  if (!in.good()) {
+    LOG(ERROR) << "Cannot open " << ply;
+    return false;
+  }
+
+  std::vector<char> header(strlen(kPlyHeaderBegin) + kCountDigits + 1 +
+                           strlen(kPlyHeaderEnd));
+  in.read(header.data(), header.size());
+  const std::string begin(header.data(), strlen(kPlyHeaderBegin));
+  const std::string end(header.data() + strlen(kPlyHeaderBegin) +
+                            kCountDigits + 1,
+                        strlen(kPlyHeaderEnd));
+  if (!in.good() || begin != kPlyHeaderBegin || end != kPlyHeaderEnd) {
+    LOG(ERROR) << ply << " was not written by PlyOutputWrapper!";
+    return false;
+  }
+  const uint64_t count = strtoull(
+      std::string(header.data() + begin.size(), kCountDigits).c_str(),
+      nullptr, 10);
+
+  std::ofstream out(xyz.c_str());
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot write " << xyz;
+    return false;
+  }
+
+  std::vector<Vertex> chunk(1 << 16);
+  for (uint64_t done = 0; done < count;) {
+    const uint64_t n = std::min<uint64_t>(chunk.size(), count - done);
+    in.read(reinterpret_cast<char*>(chunk.data()), n * sizeof(Vertex));
+    if (!in.good()) {
+      LOG(ERROR) << ply << " is truncated after " << done << " points!";
+      return false;
+    }
+    for (uint64_t i = 0; i < n; ++i) {
+      out << chunk[i].x << " " << chunk[i].y << " " << chunk[i].z << "\n";
+    }
+    done += n;
+  }
+
+  out.close();
+  if (out.fail()) {
+    LOG(ERROR) << "Writing " << xyz << " failed";
+    return false;
+  }
+  LOG(INFO) << "Converted " << count << " points from " << ply << " to "
+            << xyz;
+  return true;
+}
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -0,0 +1,141 @@
+#include "io_wrapper/output_wrapper/shm_output_wrapper.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "util/frame_shell.h"
+
+namespace dso {
+namespace IOWrap {
+
+namespace {
+
+void makePose(const FrameShell* const shell, const int keyframeId,
+              const bool final, CalibHessian* const HCalib,
+              ShmOutputWrapper::Pose* const pose) {
+  pose->id = shell->id;
+  pose->incomingId = shell->incoming_id;
+  pose->keyframeId = keyframeId;
+  pose->final = final;
+  pose->timestamp = shell->timestamp;
+  const Eigen::Quaterniond q = shell->camToWorld.unit_quaternion();
+  const Vec3 t = shell->camToWorld.translation();
+  pose->camToWorld[0] = q.x();
+  pose->camToWorld[1] = q.y();
+  pose->camToWorld[2] = q.z();
+  pose->camToWorld[3] = q.w();
+  pose->camToWorld[4] = t.x();
+  pose->camToWorld[5] = t.y();
+  pose->camToWorld[6] = t.z();
+  if (HCalib != nullptr) {
+    pose->calib[0] = HCalib->fxl();
+    pose->calib[1] = HCalib->fyl();
+    pose->calib[2] = HCalib->cxl();
+    pose->calib[3] = HCalib->cyl();
+  } else {
+    memset(pose->calib, 0, sizeof(pose->calib));
+  }
+}
+
+}  // namespace
+
+ShmOutputWrapper::ShmOutputWrapper(const std::string& name,
+                                   const uint32_t numSlots,
+                                   const uint32_t slotSize)
+    : ring(name, numSlots, slotSize), numMessages(0) {
+  CHECK_GE(slotSize, sizeof(PointsHeader) + sizeof(Point));
+  CHECK_GE(slotSize, sizeof(Pose));
+  LOG_IF(INFO, ring.valid())
+      << "OUT: Created ShmOutputWrapper, publishing into " << name << " ("
+      << numSlots << " slots of " << slotSize << " bytes)";
+}
+
+ShmOutputWrapper::~ShmOutputWrapper() {
+  LOG(INFO) << "OUT: Destroyed ShmOutputWrapper, published " << numMessages
+            << " messages";
+}
+
+void ShmOutputWrapper::publishKeyframes(std::vector<FrameHessian*>& frames,
+                                        bool final, CalibHessian* HCalib) {
+  if (!ring.valid()) {
+    return;
+  }
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  poses.resize(frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    makePose(frames[i]->shell, frames[i]->frameID, final, HCalib, &poses[i]);
+  }
+
+  const size_t perMessage = ring.getSlotSize() / sizeof(Pose);
+  for (size_t first = 0; first < poses.size(); first += perMessage) {
+    const size_t num = std::min(perMessage, poses.size() - first);
+    ring.write(MSG_KEYFRAMES, poses.data() + first, num * sizeof(Pose));
+    ++numMessages;
+  }
+
+  if (final) {
+    for (const FrameHessian* frame : frames) {
+      publishPoints(frame, HCalib);
+    }
+  }
+}
+
+void ShmOutputWrapper::publishCamPose(FrameShell* frame, CalibHessian* HCalib) {
+  if (!ring.valid()) {
+    return;
+  }
+  Pose pose;
+  makePose(frame, -1, false, HCalib, &pose);
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  ring.write(MSG_CAM_POSE, &pose, sizeof(pose));
+  ++numMessages;
+}
+
+void ShmOutputWrapper::publishPoints(const FrameHessian* const frame,
+                                     CalibHessian* const HCalib) {
+  const std::vector<PointHessian*>& points = frame->pointHessiansMarginalized;
+  if (!frame->shell->poseValid || points.empty()) {
+    return;
+  }
+  const float fxi = 1.f / HCalib->fxl(), fyi = 1.f / HCalib->fyl();
+  const float cxi = -HCalib->cxl() * fxi, cyi = -HCalib->cyl() * fyi;
+  const Eigen::Matrix<double, 3, 4> c2w = frame->shell->camToWorld.matrix3x4();
+
+  // the points are converted right into the message buffer.
+  const size_t perMessage =
+      (ring.getSlotSize() - sizeof(PointsHeader)) / sizeof(Point);
+  message.resize(sizeof(PointsHeader) + perMessage * sizeof(Point));
+  PointsHeader* const header = reinterpret_cast<PointsHeader*>(message.data());
+  Point* const out = reinterpret_cast<Point*>(header + 1);
+  header->incomingId = frame->shell->incoming_id;
+  header->total = points.size();
+
+  for (size_t first = 0; first < points.size(); first += perMessage) {
+    const size_t num = std::min(perMessage, points.size() - first);
+    for (size_t i = 0; i < num; ++i) {
+      const PointHessian* point = points[first + i];
+      const float depth = 1.f / point->idepth;
+      const Eigen::Vector4d ptCam((point->u * fxi + cxi) * depth,
+                                  (point->v * fyi + cyi) * depth,
+                                  (1.f + 2.f * fxi) * depth, 1.);
+      const Eigen::Vector3d ptWorld = c2w * ptCam;
+      out[i].x = ptWorld.x();
+      out[i].y = ptWorld.y();
+      out[i].z = ptWorld.z();
+      out[i].intensity = point->color[0];
+      out[i].idepth = point->idepth;
+      out[i].idepthVar = 1.f / (point->idepth_hessian + 0.01f);
+    }
+    header->first = first;
+    header->num = num;
+    ring.write(MSG_POINTS, message.data(),
+               sizeof(PointsHeader) + num * sizeof(Point));
+    ++numMessages;
+  }
+}
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -0,0 +1,183 @@
+#include "io_wrapper/output_wrapper/shm_ring.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace dso {
+namespace IOWrap {
+
+const char ShmRing::kMagic[8] = {'D', 'S', 'O', 'S', 'H', 'M', 'R', '1'};
+
+static_assert(sizeof(ShmRing::Header) <= ShmRing::kAlignment,
+              "ShmRing::Header has to fit in front of the first slot");
+static_assert(sizeof(ShmRing::Slot) == 16, "ShmRing::Slot layout changed");
+
+namespace {
+
+// shm_open wants "/name".
+std::string segmentName(const std::string& name) {
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+inline const char* payload(const ShmRing::Slot* const slot) {
+  return reinterpret_cast<const char*>(slot + 1);
+}
+
+}  // namespace
+
+ShmRing::ShmRing(const std::string& name, const uint32_t numSlots,
+                 const uint32_t slotSize)
+    : name(segmentName(name)),
+      owner(true),
+      mappedSize(0),
+      base(nullptr),
+      header(nullptr) {
+  CHECK_GT(numSlots, 0);
+  const uint32_t stride =
+      (sizeof(Slot) + slotSize + kAlignment - 1) / kAlignment * kAlignment;
+  const size_t size = kAlignment + static_cast<size_t>(numSlots) * stride;
+
+  const int fd =
+      shm_open(this->name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, size) != 0) {
+    LOG(ERROR) << "Cannot create shared memory " << this->name;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Cannot map shared memory " << this->name;
+    return;
+  }
+  mappedSize = size;
+  base = static_cast<char*>(data);
+
+  // ftruncate zeroed everything, i.e. every seq is 0: nothing published.
+  Header* h = reinterpret_cast<Header*>(base);
+  h->version = kVersion;
+  h->numSlots = numSlots;
+  h->slotSize = slotSize;
+  h->slotStride = stride;
+  h->head.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  // readers only accept the segment once the magic is there.
+  memcpy(h->magic, kMagic, sizeof(kMagic));
+  header = h;
+}
+
+ShmRing::ShmRing(const std::string& name)
+    : name(segmentName(name)),
+      owner(false),
+      mappedSize(0),
+      base(nullptr),
+      header(nullptr) {
+  const int fd = shm_open(this->name.c_str(), O_RDONLY, 0);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < kAlignment) {
+    LOG(ERROR) << "Cannot open shared memory " << this->name;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG(ERROR) << "Cannot map shared memory " << this->name;
+    return;
+  }
+  mappedSize = st.st_size;
+  base = static_cast<char*>(data);
+
+  const Header* h = reinterpret_cast<const Header*>(base);
+  if (memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 ||
+      h->version != kVersion || h->numSlots == 0 ||
+      kAlignment + static_cast<size_t>(h->numSlots) * h->slotStride >
+          mappedSize) {
+    LOG(ERROR) << this->name << " is no ShmRing of version " << kVersion;
+    munmap(base, mappedSize);
+    base = nullptr;
+    return;
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  header = reinterpret_cast<Header*>(base);
+}
+
+ShmRing::~ShmRing() {
+  if (base != nullptr) {
+    munmap(base, mappedSize);
+  }
+  if (owner && header != nullptr) {
+    shm_unlink(name.c_str());
+  }
+}
+
+void ShmRing::write(const uint32_t type, const void* const data,
+                    const uint32_t size) {
+  CHECK_LE(size, header->slotSize);
+  const uint64_t index = header->head.load(std::memory_order_relaxed);
+  Slot* const s = slot(index);
+
+  s->seq.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  s->type = type;
+  s->size = size;
+  memcpy(const_cast<char*>(payload(s)), data, size);
+  s->seq.store(2 * index + 2, std::memory_order_release);
+
+  header->head.store(index + 1, std::memory_order_release);
+}
+
+ShmRing::ReadResult ShmRing::beginRead(const uint64_t index,
+                                       View* const view) const {
+  const Slot* const s = slot(index);
+  const uint64_t seq = s->seq.load(std::memory_order_acquire);
+  if (seq > 2 * index + 2) {
+    return RING_LAPPED;
+  }
+  if (seq != 2 * index + 2) {
+    return RING_EMPTY;
+  }
+  view->index = index;
+  view->seq = seq;
+  view->type = s->type;
+  view->size = std::min(s->size, header->slotSize);
+  view->data = payload(s);
+  return RING_OK;
+}
+
+bool ShmRing::endRead(const View& view) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot(view.index)->seq.load(std::memory_order_relaxed) == view.seq;
+}
+
+ShmRing::ReadResult ShmRing::read(const uint64_t index, uint32_t* const type,
+                                  void* const data,
+                                  uint32_t* const size) const {
+  while (true) {
+    View view;
+    const ReadResult result = beginRead(index, &view);
+    if (result != RING_OK) {
+      return result;
+    }
+    memcpy(data, view.data, view.size);
+    if (endRead(view)) {
+      *type = view.type;
+      *size = view.size;
+      return RING_OK;
+    }
+  }
+}
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -0,0 +1,156 @@
+#include "io_wrapper/output_wrapper/trajectory_output_wrapper.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+#include "full_system/hessian_blocks/hessian_blocks.h"
+#include "util/frame_shell.h"
+#include "util/settings.h"
+
+namespace dso {
+namespace IOWrap {
+
+TrajectoryOutputWrapper::TrajectoryOutputWrapper(const std::string& path,
+                                                 const int syncIntervalMs)
+    : path(path),
+      syncIntervalMs(syncIntervalMs),
+      onlyKeyframes(setting_onlyLogKFPoses),
+      running(true),
+      numWritten(0) {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  LOG_IF(ERROR, fd < 0) << "OUT: Cannot open " << path;
+  writerThread = boost::thread(&TrajectoryOutputWrapper::writerLoop, this);
+  LOG(INFO) << "OUT: Created TrajectoryOutputWrapper, writing "
+            << (onlyKeyframes ? "keyframe poses" : "poses") << " to " << path;
+}
+
+TrajectoryOutputWrapper::~TrajectoryOutputWrapper() {
+  join();
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void TrajectoryOutputWrapper::publishKeyframes(
+    std::vector<FrameHessian*>& frames, bool final, CalibHessian* HCalib) {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  if (final) {
+    for (FrameHessian* frame : frames) {
+      keyframes.erase(frame->shell->id);
+      append(frame->shell);
+    }
+    return;
+  }
+  if (onlyKeyframes || frames.empty()) {
+    return;
+  }
+
+  // the window holds every keyframe once it is made. tracked frames before the
+  // newest keyframe were mapped, so their pose is final.
+  for (FrameHessian* frame : frames) {
+    keyframes[frame->shell->id] = frame->shell;
+  }
+  const int newest = frames.back()->shell->id;
+  size_t kept = 0;
+  for (FrameShell* shell : pending) {
+    if (shell->id >= newest) {
+      pending[kept++] = shell;
+    } else if (keyframes.count(shell->id) == 0) {
+      append(shell);
+    }
+  }
+  pending.resize(kept);
+}
+
+void TrajectoryOutputWrapper::publishCamPose(FrameShell* frame,
+                                             CalibHessian* HCalib) {
+  if (onlyKeyframes) {
+    return;
+  }
+  boost::unique_lock<boost::mutex> lock(mutex);
+  pending.emplace_back(frame);
+}
+
+void TrajectoryOutputWrapper::join() {
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!running) {
+      return;
+    }
+    // mapping is finished, all that is left is final.
+    for (FrameShell* shell : pending) {
+      if (keyframes.count(shell->id) == 0) {
+        append(shell);
+      }
+    }
+    if (!onlyKeyframes) {
+      for (const std::pair<const int, FrameShell*>& kf : keyframes) {
+        append(kf.second);
+      }
+    }
+    pending.clear();
+    keyframes.clear();
+    running = false;
+  }
+  stopSignal.notify_all();
+  writerThread.join();
+  LOG(INFO) << "OUT: Wrote " << numWritten << " poses to " << path;
+}
+
+void TrajectoryOutputWrapper::reset() {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  pending.clear();
+  keyframes.clear();
+}
+
+void TrajectoryOutputWrapper::append(const FrameShell* const shell) {
+  if (!shell->poseValid) {
+    return;
+  }
+  const Vec3 t = shell->camToWorld.translation();
+  const Eigen::Quaterniond q = shell->camToWorld.so3().unit_quaternion();
+  char line[256];
+  snprintf(line, sizeof(line),
+           "%.15g %.15g %.15g %.15g %.15g %.15g %.15g %.15g\n",
+           shell->timestamp, t.x(), t.y(), t.z(), q.x(), q.y(), q.z(), q.w());
+  buffer += line;
+  ++numWritten;
+}
+
+void TrajectoryOutputWrapper::writerLoop() {
+  std::string lines;
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while (true) {
+    if (running) {
+      stopSignal.wait_for(lock, boost::chrono::milliseconds(syncIntervalMs));
+    }
+    const bool stop = !running;
+    lines.swap(buffer);
+    lock.unlock();
+
+    if (!lines.empty() && fd >= 0) {
+      size_t done = 0;
+      while (done < lines.size()) {
+        const ssize_t n = write(fd, lines.data() + done, lines.size() - done);
+        if (n < 0) {
+          LOG(ERROR) << "OUT: Writing " << path << " failed";
+          break;
+        }
+        done += n;
+      }
+      fdatasync(fd);
+    }
+    lines.clear();
+
+    if (stop) {
+      return;
+    }
+    lock.lock();
+  }
+}
+
+}  // namespace IOWrap
+}  // namespace dso
@@ -1,6 +1,7 @@
 #include "io_wrapper/pangolin/keyframe_display.h"
 
 #include <stdio.h>
+#include <algorithm>
 
 #include <glog/logging.h>
 #include <pangolin/pangolin.h>
@@ -17,6 +18,7 @@ KeyFrameDisplay::KeyFrameDisplay() {
   originalInputSparse = 0;
   numSparseBufferSize = 0;
   numSparsePoints = 0;
+  pattern = 8;
 
   id = 0;
   active = true;
@@ -31,7 +33,10 @@ KeyFrameDisplay::KeyFrameDisplay() {
   my_sparsifyFactor = 1;
 
   numGLBufferPoints = 0;
+  numGLBufferGoodPoints = 0;
   bufferValid = false;
+  final = false;
+  width = 0;
 }
 void KeyFrameDisplay::setFromF(FrameShell* frame, CalibHessian* HCalib) {
   id = frame->id;
@@ -39,8 +44,8 @@ void KeyFrameDisplay::setFromF(FrameShell* frame, CalibHessian* HCalib) {
   fy = HCalib->fyl();
   cx = HCalib->cxl();
   cy = HCalib->cyl();
-  width = wG[0];
-  height = hG[0];
+  width = HCalib->calib->w[0];
+  height = HCalib->calib->h[0];
   fxi = 1 / fx;
   fyi = 1 / fy;
   cxi = -cx / fx;
@@ -59,15 +64,18 @@ void KeyFrameDisplay::setFromKF(FrameHessian* fh, CalibHessian* HCalib) {
 
   if (numSparseBufferSize < npoints) {
     if (originalInputSparse != 0) {
-      delete originalInputSparse;
+      delete[] originalInputSparse;
     }
     numSparseBufferSize = npoints + 100;
     originalInputSparse =
         new InputPointSparse<MAX_RES_PER_POINT>[numSparseBufferSize];
+    accountMemory();
   }
 
   InputPointSparse<MAX_RES_PER_POINT>* pc = originalInputSparse;
   numSparsePoints = 0;
+  pattern = fh->settings->pattern;
+  const int patternNum = staticPatternNum[pattern];
   for (ImmaturePoint* p : fh->immaturePoints) {
     for (int i = 0; i < patternNum; ++i) {
       pc[numSparsePoints].color[i] = p->color[i];
@@ -131,6 +139,41 @@ void KeyFrameDisplay::setFromKF(FrameHessian* fh, CalibHessian* HCalib) {
   needRefresh = true;
 }
 
+void KeyFrameDisplay::takeDataFrom(KeyFrameDisplay* other) {
+  copyCamFrom(*other);
+  std::swap(originalInputSparse, other->originalInputSparse);
+  std::swap(numSparsePoints, other->numSparsePoints);
+  std::swap(numSparseBufferSize, other->numSparseBufferSize);
+  needRefresh = true;
+  accountMemory();
+  other->accountMemory();
+}
+
+void KeyFrameDisplay::copyCamFrom(const KeyFrameDisplay& other) {
+  id = other.id;
+  fx = other.fx;
+  fy = other.fy;
+  cx = other.cx;
+  cy = other.cy;
+  fxi = other.fxi;
+  fyi = other.fyi;
+  cxi = other.cxi;
+  cyi = other.cyi;
+  width = other.width;
+  height = other.height;
+  camToWorld = other.camToWorld;
+}
+
+void KeyFrameDisplay::releasePoints() {
+  if (originalInputSparse != 0) {
+    delete[] originalInputSparse;
+    originalInputSparse = 0;
+  }
+  numSparsePoints = 0;
+  numSparseBufferSize = 0;
+  releaseBuffers();
+}
+
 KeyFrameDisplay::~KeyFrameDisplay() {
   if (originalInputSparse != 0) {
     delete[] originalInputSparse;
@@ -161,122 +204,133 @@ bool KeyFrameDisplay::refreshPC(bool canRefresh, float scaledTH, float absTH,
     return false;
   }
 
-  // make data
-  Vec3f* tmpVertexBuffer = new Vec3f[numSparsePoints * patternNum];
-  Vec3b* tmpColorBuffer = new Vec3b[numSparsePoints * patternNum];
-  int vertexBufferNumPoints = 0;
+  tmpVertexBuffer.clear();
+  tmpColorBuffer.clear();
+  makeVertices(my_scaledTH, my_absTH, my_displayMode, my_minRelBS,
+               my_sparsifyFactor, false, &tmpVertexBuffer, &tmpColorBuffer);
+  if (tmpVertexBuffer.empty()) {
+    return true;
+  }
+
+  numGLBufferGoodPoints = tmpVertexBuffer.size();
+  if (numGLBufferGoodPoints > numGLBufferPoints) {
+    numGLBufferPoints = numGLBufferGoodPoints * 1.3;
+    vertexBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                              GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+    colorBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                             GL_UNSIGNED_BYTE, 3, GL_DYNAMIC_DRAW);
+  }
+  vertexBuffer.Upload(tmpVertexBuffer.data(),
+                      sizeof(float) * 3 * numGLBufferGoodPoints, 0);
+  colorBuffer.Upload(tmpColorBuffer.data(),
+                     sizeof(unsigned char) * 3 * numGLBufferGoodPoints, 0);
+  bufferValid = true;
+  accountMemory();
+
+  return true;
+}
+
+void KeyFrameDisplay::makeVertices(float scaledTH, float absTH, int mode,
+                                   float minBS, int sparsity, bool inWorld,
+                                   std::vector<Vec3f>* vertices,
+                                   std::vector<Vec3b>* colors) const {
+  const Eigen::Matrix<float, 3, 4> c2w = camToWorld.matrix3x4().cast<float>();
+  const int patternNum = staticPatternNum[pattern];
+  vertices->reserve(vertices->size() + numSparsePoints * patternNum);
+  colors->reserve(colors->size() + numSparsePoints * patternNum);
 
   for (int i = 0; i < numSparsePoints; ++i) {
+    const InputPointSparse<MAX_RES_PER_POINT>& point = originalInputSparse[i];
     /* display modes:
-     * my_displayMode==0 - all pts, color-coded
-     * my_displayMode==1 - normal points
-     * my_displayMode==2 - active only
-     * my_displayMode==3 - nothing
+     * mode==0 - all pts, color-coded
+     * mode==1 - normal points
+     * mode==2 - active only
+     * mode==3 - nothing
      */
 
-    if (my_displayMode == 1 && originalInputSparse[i].status != 1 &&
-        originalInputSparse[i].status != 2) {
+    if (mode == 1 && point.status != 1 && point.status != 2) {
       continue;
-    } else if (my_displayMode == 2 && originalInputSparse[i].status != 1) {
+    } else if (mode == 2 && point.status != 1) {
       continue;
-    } else if (my_displayMode > 2) {
+    } else if (mode > 2) {
       continue;
     }
 
-    if (originalInputSparse[i].idpeth < 0) {
+    if (point.idpeth < 0) {
       continue;
     }
 
-    float depth = 1.0f / originalInputSparse[i].idpeth;
+    float depth = 1.0f / point.idpeth;
     float depth4 = depth * depth;
     depth4 *= depth4;
-    float var = (1.0f / (originalInputSparse[i].idepth_hessian + 0.01));
+    float var = (1.0f / (point.idepth_hessian + 0.01));
 
-    if (var * depth4 > my_scaledTH) {
+    if (var * depth4 > scaledTH) {
       continue;
-    } else if (var > my_absTH) {
+    } else if (var > absTH) {
       continue;
     }
 
-    if (originalInputSparse[i].relObsBaseline < my_minRelBS) {
+    if (point.relObsBaseline < minBS) {
       continue;
     }
 
     for (int pnt = 0; pnt < patternNum; ++pnt) {
-      if (my_sparsifyFactor > 1 && rand() % my_sparsifyFactor != 0) {
+      if (sparsity > 1 && rand() % sparsity != 0) {
         continue;
       }
-      int dx = patternP[pnt][0];
-      int dy = patternP[pnt][1];
+      int dx = staticPattern[pattern][pnt][0];
+      int dy = staticPattern[pattern][pnt][1];
 
       // 这下面载入需要显示的点的位置
-      tmpVertexBuffer[vertexBufferNumPoints][0] =
-          ((originalInputSparse[i].u + dx) * fxi + cxi) * depth;
-      tmpVertexBuffer[vertexBufferNumPoints][1] =
-          ((originalInputSparse[i].v + dy) * fyi + cyi) * depth;
-      tmpVertexBuffer[vertexBufferNumPoints][2] =
-          depth * (1 + 2 * fxi * (rand() / (float)RAND_MAX - 0.5f));
+      Vec3f vertex(((point.u + dx) * fxi + cxi) * depth,
+                   ((point.v + dy) * fyi + cyi) * depth,
+                   depth * (1 + 2 * fxi * (rand() / (float)RAND_MAX - 0.5f)));
+      if (inWorld) {
+        vertex = c2w.leftCols<3>() * vertex + c2w.col(3);
+      }
+      vertices->emplace_back(vertex);
 
       // 这下面控制点的颜色
-      if (my_displayMode == 0) {
-        if (originalInputSparse[i].status == 0) {
-          tmpColorBuffer[vertexBufferNumPoints][0] = 0;
-          tmpColorBuffer[vertexBufferNumPoints][1] = 255;
-          tmpColorBuffer[vertexBufferNumPoints][2] = 255;
-        } else if (originalInputSparse[i].status == 1) {
-          tmpColorBuffer[vertexBufferNumPoints][0] = 0;
-          tmpColorBuffer[vertexBufferNumPoints][1] = 255;
-          tmpColorBuffer[vertexBufferNumPoints][2] = 0;
-        } else if (originalInputSparse[i].status == 2) {
-          tmpColorBuffer[vertexBufferNumPoints][0] = 0;
-          tmpColorBuffer[vertexBufferNumPoints][1] = 0;
-          tmpColorBuffer[vertexBufferNumPoints][2] = 255;
-        } else if (originalInputSparse[i].status == 3) {
-          tmpColorBuffer[vertexBufferNumPoints][0] = 255;
-          tmpColorBuffer[vertexBufferNumPoints][1] = 0;
-          tmpColorBuffer[vertexBufferNumPoints][2] = 0;
+      if (mode == 0) {
+        if (point.status == 0) {
+          colors->emplace_back(0, 255, 255);
+        } else if (point.status == 1) {
+          colors->emplace_back(0, 255, 0);
+        } else if (point.status == 2) {
+          colors->emplace_back(0, 0, 255);
+        } else if (point.status == 3) {
+          colors->emplace_back(255, 0, 0);
         } else {
-          tmpColorBuffer[vertexBufferNumPoints][0] = 255;
-          tmpColorBuffer[vertexBufferNumPoints][1] = 255;
-          tmpColorBuffer[vertexBufferNumPoints][2] = 255;
+          colors->emplace_back(255, 255, 255);
         }
       } else {
-        tmpColorBuffer[vertexBufferNumPoints][0] =
-            originalInputSparse[i].color[pnt];
-        tmpColorBuffer[vertexBufferNumPoints][1] =
-            originalInputSparse[i].color[pnt];
-        tmpColorBuffer[vertexBufferNumPoints][2] =
-            originalInputSparse[i].color[pnt];
+        colors->emplace_back(point.color[pnt], point.color[pnt],
+                             point.color[pnt]);
       }
-      ++vertexBufferNumPoints;
-
-      CHECK_LE(vertexBufferNumPoints, numSparsePoints * patternNum);
     }
   }
+}
 
-  if (vertexBufferNumPoints == 0) {
-    delete[] tmpColorBuffer;
-    delete[] tmpVertexBuffer;
-    return true;
-  }
-
-  numGLBufferGoodPoints = vertexBufferNumPoints;
-  if (numGLBufferGoodPoints > numGLBufferPoints) {
-    numGLBufferPoints = vertexBufferNumPoints * 1.3;
-    vertexBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
-                              GL_FLOAT, 3, GL_DYNAMIC_DRAW);
-    colorBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
-                             GL_UNSIGNED_BYTE, 3, GL_DYNAMIC_DRAW);
+void KeyFrameDisplay::releaseBuffers() {
+  if (numGLBufferPoints > 0) {
+    vertexBuffer.Reinitialise(pangolin::GlArrayBuffer, 0, GL_FLOAT, 3,
+                              GL_DYNAMIC_DRAW);
+    colorBuffer.Reinitialise(pangolin::GlArrayBuffer, 0, GL_UNSIGNED_BYTE, 3,
+                             GL_DYNAMIC_DRAW);
   }
-  vertexBuffer.Upload(tmpVertexBuffer,
-                      sizeof(float) * 3 * numGLBufferGoodPoints, 0);
-  colorBuffer.Upload(tmpColorBuffer,
-                     sizeof(unsigned char) * 3 * numGLBufferGoodPoints, 0);
-  bufferValid = true;
-  delete[] tmpColorBuffer;
-  delete[] tmpVertexBuffer;
+  numGLBufferPoints = numGLBufferGoodPoints = 0;
+  bufferValid = false;
+  std::vector<Vec3f>().swap(tmpVertexBuffer);
+  std::vector<Vec3b>().swap(tmpColorBuffer);
+  accountMemory();
+}
 
-  return true;
+void KeyFrameDisplay::accountMemory() {
+  memory.set(numSparseBufferSize * sizeof(InputPointSparse<MAX_RES_PER_POINT>) +
+             tmpVertexBuffer.capacity() * sizeof(Vec3f) +
+             tmpColorBuffer.capacity() * sizeof(Vec3b) +
+             numGLBufferPoints * (3 * sizeof(float) + 3));
 }
 
 void KeyFrameDisplay::drawCam(float lineWidth, float* color, float sizeFactor) {
@@ -354,5 +408,244 @@ void KeyFrameDisplay::drawPC(float pointSize) {
 
   glPopMatrix();
 }
+
+KeyFrameChunk::KeyFrameChunk() {
+  dirty = false;
+  my_scaledTH = 1e10;
+  my_absTH = 1e10;
+  my_displayMode = 1;
+  my_minRelBS = 0;
+  my_sparsifyFactor = 1;
+  boxMin.setZero();
+  boxMax.setZero();
+  numGLBufferPoints = 0;
+  numGLBufferGoodPoints = 0;
+}
+
+void KeyFrameChunk::add(KeyFrameDisplay* kf) {
+  CHECK(!full());
+  members.emplace_back(kf);
+  dirty = true;
+}
+
+void KeyFrameChunk::refresh(float scaledTH, float absTH, int mode,
+                            float minBS, int sparsity) {
+  if (!dirty && my_scaledTH == scaledTH && my_absTH == absTH &&
+      my_displayMode == mode && my_minRelBS == minBS &&
+      my_sparsifyFactor == sparsity) {
+    return;
+  }
+  dirty = false;
+  my_scaledTH = scaledTH;
+  my_absTH = absTH;
+  my_displayMode = mode;
+  my_minRelBS = minBS;
+  my_sparsifyFactor = sparsity;
+
+  vertices.clear();
+  colors.clear();
+  for (const KeyFrameDisplay* kf : members) {
+    kf->makeVertices(scaledTH, absTH, mode, minBS, sparsity, true, &vertices,
+                     &colors);
+  }
+  numGLBufferGoodPoints = vertices.size();
+  if (numGLBufferGoodPoints == 0) {
+    return;
+  }
+
+  Vec3f lo = vertices[0], hi = vertices[0];
+  for (const Vec3f& vertex : vertices) {
+    lo = lo.cwiseMin(vertex);
+    hi = hi.cwiseMax(vertex);
+  }
+  boxMin = lo.cast<double>();
+  boxMax = hi.cast<double>();
+
+  if (numGLBufferGoodPoints > numGLBufferPoints) {
+    numGLBufferPoints = numGLBufferGoodPoints * 1.3;
+    vertexBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                              GL_FLOAT, 3, GL_STATIC_DRAW);
+    colorBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                             GL_UNSIGNED_BYTE, 3, GL_STATIC_DRAW);
+  }
+  vertexBuffer.Upload(vertices.data(),
+                      sizeof(float) * 3 * numGLBufferGoodPoints, 0);
+  colorBuffer.Upload(colors.data(),
+                     sizeof(unsigned char) * 3 * numGLBufferGoodPoints, 0);
+  accountMemory();
+}
+
+void KeyFrameChunk::accountMemory() {
+  memory.set(vertices.capacity() * sizeof(Vec3f) +
+             colors.capacity() * sizeof(Vec3b) +
+             numGLBufferPoints * (3 * sizeof(float) + 3));
+}
+
+bool KeyFrameChunk::isOutside(const Eigen::Matrix4d& mvp) const {
+  // the clip space planes -w <= x, y, z <= w in world coordinates.
+  for (int row = 0; row < 3; ++row) {
+    for (int sign = -1; sign <= 1; sign += 2) {
+      const Eigen::Vector4d plane =
+          (mvp.row(3) + sign * mvp.row(row)).transpose();
+      // the corner of the box farthest along the plane normal.
+      const Eigen::Vector3d corner(plane[0] >= 0 ? boxMax[0] : boxMin[0],
+                                   plane[1] >= 0 ? boxMax[1] : boxMin[1],
+                                   plane[2] >= 0 ? boxMax[2] : boxMin[2]);
+      if (plane.head<3>().dot(corner) + plane[3] < 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void KeyFrameChunk::draw(float pointSize, const Eigen::Matrix4d& mvp,
+                         const Eigen::Vector3d& eye) {
+  if (numGLBufferGoodPoints == 0 || isOutside(mvp)) {
+    return;
+  }
+
+  const double radius = 0.5 * (boxMax - boxMin).norm();
+  const double distance = (eye - 0.5 * (boxMin + boxMax)).norm();
+  int lod = 1;
+  if (radius > 0) {
+    lod = std::max(1, std::min(kMaxLod, (int)(distance / (4 * radius))));
+  }
+
+  glDisable(GL_LIGHTING);
+  glPointSize(pointSize);
+
+  // every lod-th vertex, by striding over the buffers.
+  colorBuffer.Bind();
+  glColorPointer(colorBuffer.count_per_element, colorBuffer.datatype,
+                 lod * sizeof(unsigned char) * 3, 0);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  vertexBuffer.Bind();
+  glVertexPointer(vertexBuffer.count_per_element, vertexBuffer.datatype,
+                  lod * sizeof(float) * 3, 0);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glDrawArrays(GL_POINTS, 0, numGLBufferGoodPoints / lod);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  vertexBuffer.Unbind();
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  colorBuffer.Unbind();
+}
+
+MapStoreView::MapStoreView(MapStore* store, float radius)
+    : store(store), radius(radius) {
+  valid = false;
+  my_storeVersion = 0;
+  my_center.setZero();
+  my_scaledTH = 1e10;
+  my_absTH = 1e10;
+  my_displayMode = 1;
+  my_minRelBS = 0;
+  my_sparsifyFactor = 1;
+  numGLBufferPoints = 0;
+  numGLBufferGoodPoints = 0;
+}
+
+void MapStoreView::refresh(const Eigen::Vector3d& eye, float scaledTH,
+                           float absTH, int mode, float minBS, int sparsity) {
+  const Eigen::Vector3f center = eye.cast<float>();
+  const uint64_t storeVersion = store->version();
+  if (valid && my_storeVersion == storeVersion &&
+      (center - my_center).norm() < 0.25f * radius &&
+      my_scaledTH == scaledTH && my_absTH == absTH &&
+      my_displayMode == mode && my_minRelBS == minBS &&
+      my_sparsifyFactor == sparsity) {
+    return;
+  }
+  valid = true;
+  my_storeVersion = storeVersion;
+  my_center = center;
+  my_scaledTH = scaledTH;
+  my_absTH = absTH;
+  my_displayMode = mode;
+  my_minRelBS = minBS;
+  my_sparsifyFactor = sparsity;
+
+  points.clear();
+  vertices.clear();
+  colors.clear();
+  // mode 2: active points only, there are none in the store.
+  if (mode < 2) {
+    store->query(center, radius, &points);
+  }
+  vertices.reserve(points.size());
+  colors.reserve(points.size());
+  for (const MapStore::Point& point : points) {
+    // the filters of KeyFrameDisplay::makeVertices.
+    if (point.idepth < 0) {
+      continue;
+    }
+    float depth4 = 1.0f / point.idepth;
+    depth4 *= depth4;
+    depth4 *= depth4;
+    if (point.idepthVar * depth4 > scaledTH || point.idepthVar > absTH ||
+        point.relObsBaseline < minBS) {
+      continue;
+    }
+    if (sparsity > 1 && rand() % sparsity != 0) {
+      continue;
+    }
+
+    vertices.emplace_back(point.x, point.y, point.z);
+    if (mode == 0) {
+      colors.emplace_back(0, 0, 255);
+    } else {
+      const unsigned char c = point.intensity;
+      colors.emplace_back(c, c, c);
+    }
+  }
+
+  numGLBufferGoodPoints = vertices.size();
+  if (numGLBufferGoodPoints > numGLBufferPoints) {
+    numGLBufferPoints = numGLBufferGoodPoints * 1.3;
+    vertexBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                              GL_FLOAT, 3, GL_DYNAMIC_DRAW);
+    colorBuffer.Reinitialise(pangolin::GlArrayBuffer, numGLBufferPoints,
+                             GL_UNSIGNED_BYTE, 3, GL_DYNAMIC_DRAW);
+  }
+  if (numGLBufferGoodPoints > 0) {
+    vertexBuffer.Upload(vertices.data(),
+                        sizeof(float) * 3 * numGLBufferGoodPoints, 0);
+    colorBuffer.Upload(colors.data(),
+                       sizeof(unsigned char) * 3 * numGLBufferGoodPoints, 0);
+  }
+  accountMemory();
+}
+
+void MapStoreView::accountMemory() {
+  memory.set(points.capacity() * sizeof(MapStore::Point) +
+             vertices.capacity() * sizeof(Vec3f) +
+             colors.capacity() * sizeof(Vec3b) +
+             numGLBufferPoints * (3 * sizeof(float) + 3));
+}
+
+void MapStoreView::draw(float pointSize) {
+  if (numGLBufferGoodPoints == 0) {
+    return;
+  }
+
+  glDisable(GL_LIGHTING);
+  glPointSize(pointSize);
+
+  colorBuffer.Bind();
+  glColorPointer(colorBuffer.count_per_element, colorBuffer.datatype, 0, 0);
+  glEnableClientState(GL_COLOR_ARRAY);
+
+  vertexBuffer.Bind();
+  glVertexPointer(vertexBuffer.count_per_element, vertexBuffer.datatype, 0, 0);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glDrawArrays(GL_POINTS, 0, numGLBufferGoodPoints);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  vertexBuffer.Unbind();
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  colorBuffer.Unbind();
+}
 }
 }
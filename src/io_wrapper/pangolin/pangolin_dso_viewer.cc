@@ -6,7 +6,6 @@
 #include "full_system/hessian_blocks/hessian_blocks.h"
 #include "full_system/immature_point.h"
 #include "io_wrapper/pangolin/keyframe_display.h"
-#include "util/global_calib.h"
 #include "util/settings.h"
 
 namespace dso {
@@ -16,6 +15,8 @@ PangolinDSOViewer::PangolinDSOViewer(int w, int h, bool startRunThread) {
   this->w = w;
   this->h = h;
   running = true;
+  settings = nullptr;
+  mapView = nullptr;
 
   {
     boost::unique_lock<boost::mutex> lk(openImagesMutex);
@@ -29,7 +30,11 @@ PangolinDSOViewer::PangolinDSOViewer(int w, int h, bool startRunThread) {
     internalResImg->setBlack();
   }
 
-  { currentCam = new KeyFrameDisplay(); }
+  {
+    currentCam = new KeyFrameDisplay();
+    currentCamDraw = new KeyFrameDisplay();
+    graphChanged = false;
+  }
 
   needReset = false;
 
@@ -38,9 +43,89 @@ PangolinDSOViewer::PangolinDSOViewer(int w, int h, bool startRunThread) {
   }
 }
 
+void PangolinDSOViewer::setSettings(Settings* settings) {
+  boost::unique_lock<boost::mutex> lk(settingsMutex);
+  this->settings = settings;
+}
+
+void PangolinDSOViewer::setMapStore(MapStore* store, float radius) {
+  CHECK(mapView == nullptr);
+  mapView = new MapStoreView(store, radius);
+}
+
 PangolinDSOViewer::~PangolinDSOViewer() {
   close();
   runThread.join();
+  delete mapView;
+}
+
+namespace {
+//! Displays kept for reuse by publishKeyframes, the rest is deleted.
+const size_t kMaxSpareDisplays = 16;
+}  // namespace
+
+void PangolinDSOViewer::applyUpdates() {
+  std::vector<PendingKeyframe> updates;
+  FlatHashMap<Eigen::Vector2i> graph;
+  bool newGraph = false;
+  std::vector<Vec3f, Eigen::aligned_allocator<Vec3f>> framePoses;
+  {
+    boost::unique_lock<boost::mutex> lk3d(model3DMutex);
+    updates.swap(pendingKeyframes);
+    if (graphChanged) {
+      std::swap(graph, pendingGraph);
+      graphChanged = false;
+      newGraph = true;
+    }
+    framePoses.swap(pendingFramePoses);
+    currentCamDraw->copyCamFrom(*currentCam);
+    while (!retiredDisplays.empty() &&
+           spareDisplays.size() < kMaxSpareDisplays) {
+      spareDisplays.emplace_back(retiredDisplays.back());
+      retiredDisplays.pop_back();
+    }
+  }
+  for (KeyFrameDisplay* kfd : retiredDisplays) {
+    delete kfd;
+  }
+  retiredDisplays.clear();
+
+  for (const PendingKeyframe& update : updates) {
+    KeyFrameDisplay* kfd = nullptr;
+    std::map<int, KeyFrameDisplay*>::iterator it =
+        keyframesByKFID.find(update.frameID);
+    if (it == keyframesByKFID.end()) {
+      kfd = update.display;
+      keyframesByKFID[update.frameID] = kfd;
+      keyframes.emplace_back(kfd);
+    } else {
+      kfd = it->second;
+      if (!kfd->final) {
+        kfd->takeDataFrom(update.display);
+      }
+      // now holds the old points, whose buffer publishKeyframes can reuse.
+      retiredDisplays.emplace_back(update.display);
+    }
+
+    if (update.final && !kfd->final) {
+      kfd->final = true;
+      if (mapView != nullptr) {
+        kfd->releasePoints();
+      } else {
+        if (chunks.empty() || chunks.back()->full()) {
+          chunks.emplace_back(new KeyFrameChunk());
+        }
+        chunks.back()->add(kfd);
+        kfd->releaseBuffers();
+      }
+    }
+  }
+
+  if (newGraph) {
+    rebuildConnections(graph);
+  }
+  allFramePoses.insert(allFramePoses.end(), framePoses.begin(),
+                       framePoses.end());
 }
 
 void PangolinDSOViewer::run() {
@@ -122,16 +207,19 @@ void PangolinDSOViewer::run() {
 
   pangolin::Var<bool> settings_resetButton("ui.Reset", false, false);
 
+  const Settings defaults;
   pangolin::Var<int> settings_nPts(
-      "ui.activePoints", setting_desiredPointDensity, 50, 5000, false);
+      "ui.activePoints", defaults.desiredPointDensity, 50, 5000, false);
   pangolin::Var<int> settings_nCandidates(
-      "ui.pointCandidates", setting_desiredImmatureDensity, 50, 5000, false);
-  pangolin::Var<int> settings_nMaxFrames("ui.maxFrames", setting_maxFrames, 4,
+      "ui.pointCandidates", defaults.desiredImmatureDensity, 50, 5000, false);
+  pangolin::Var<int> settings_nMaxFrames("ui.maxFrames", defaults.maxFrames, 4,
                                          10, false);
   pangolin::Var<double> settings_kfFrequency(
-      "ui.kfFrequency", setting_kfGlobalWeight, 0.1, 3, false);
+      "ui.kfFrequency", defaults.kfGlobalWeight, 0.1, 3, false);
   pangolin::Var<double> settings_gradHistAdd(
-      "ui.minGradAdd", setting_minGradHistAdd, 0, 15, false);
+      "ui.minGradAdd", defaults.minGradHistAdd, 0, 15, false);
+  // the sliders show these settings before they adjust them.
+  Settings* shownSettings = nullptr;
 
   pangolin::Var<double> settings_trackFps("ui.Track fps", 0, 0, 0, false);
   pangolin::Var<double> settings_mapFps("ui.KF fps", 0, 0, 0, false);
@@ -141,10 +229,11 @@ void PangolinDSOViewer::run() {
     // Clear entire screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    applyUpdates();
+
     if (setting_render_display3D) {
       // Activate efficiently by object
       Visualization3D_display.Activate(Visualization3D_camera);
-      boost::unique_lock<boost::mutex> lk3d(model3DMutex);
       // pangolin::glDrawColouredCube();
       int refreshed = 0;
       for (KeyFrameDisplay* fh : keyframes) {
@@ -152,6 +241,9 @@ void PangolinDSOViewer::run() {
         if (this->settings_showKFCameras) {
           fh->drawCam(1, blue, 0.1);
         }
+        if (fh->final) {
+          continue;
+        }
 
         refreshed += (int)(fh->refreshPC(
             refreshed < 10, this->settings_scaledVarTH, this->settings_absVarTH,
@@ -159,11 +251,35 @@ void PangolinDSOViewer::run() {
             this->settings_sparsity));
         fh->drawPC(1);
       }
+
+      const Eigen::Matrix4d mvp =
+          Eigen::Map<const Eigen::Matrix<pangolin::GLprecision, 4, 4>>(
+              Visualization3D_camera.GetProjectionModelViewMatrix().m)
+              .cast<double>();
+      const Eigen::Vector3d eye =
+          Eigen::Map<const Eigen::Matrix<pangolin::GLprecision, 4, 4>>(
+              Visualization3D_camera.GetModelViewMatrix().Inverse().m)
+              .col(3)
+              .head<3>()
+              .cast<double>();
+      for (KeyFrameChunk* chunk : chunks) {
+        chunk->refresh(this->settings_scaledVarTH, this->settings_absVarTH,
+                       this->settings_pointCloudMode, this->settings_minRelBS,
+                       this->settings_sparsity);
+        chunk->draw(1, mvp, eye);
+      }
+      if (mapView != nullptr) {
+        mapView->refresh(eye, this->settings_scaledVarTH,
+                         this->settings_absVarTH,
+                         this->settings_pointCloudMode,
+                         this->settings_minRelBS, this->settings_sparsity);
+        mapView->draw(1);
+      }
+
       if (this->settings_showCurrentCamera) {
-        currentCam->drawCam(2, 0, 0.2);
+        currentCamDraw->drawCam(2, 0, 0.2);
       }
       drawConstraints();
-      lk3d.unlock();
     }
 
     openImagesMutex.lock();
@@ -242,11 +358,32 @@ void PangolinDSOViewer::run() {
     this->settings_minRelBS = settings_minRelBS.Get();
     this->settings_sparsity = settings_sparsity.Get();
 
-    setting_desiredPointDensity = settings_nPts.Get();
-    setting_desiredImmatureDensity = settings_nCandidates.Get();
-    setting_maxFrames = settings_nMaxFrames.Get();
-    setting_kfGlobalWeight = settings_kfFrequency.Get();
-    setting_minGradHistAdd = settings_gradHistAdd.Get();
+    {
+      boost::unique_lock<boost::mutex> lk(settingsMutex);
+      if (settings != shownSettings && settings != nullptr) {
+        settings_nPts = static_cast<int>(settings->desiredPointDensity);
+        settings_nCandidates =
+            static_cast<int>(settings->desiredImmatureDensity);
+        settings_nMaxFrames = settings->maxFrames;
+        settings_kfFrequency = settings->kfGlobalWeight;
+        settings_gradHistAdd = settings->minGradHistAdd;
+      }
+      shownSettings = settings;
+      if (settings != nullptr) {
+        if (settings->latencyBudgetMs > 0) {
+          // set by the LatencyController, only shown.
+          settings_nPts = static_cast<int>(settings->desiredPointDensity);
+          settings_nCandidates =
+              static_cast<int>(settings->desiredImmatureDensity);
+        } else {
+          settings->desiredPointDensity = settings_nPts.Get();
+          settings->desiredImmatureDensity = settings_nCandidates.Get();
+        }
+        settings->maxFrames = settings_nMaxFrames.Get();
+        settings->kfGlobalWeight = settings_kfFrequency.Get();
+        settings->minGradHistAdd = settings_gradHistAdd.Get();
+      }
+    }
 
     if (settings_resetButton.Get()) {
       LOG(WARNING) << "RESET!";
@@ -279,6 +416,19 @@ void PangolinDSOViewer::reset() { needReset = true; }
 
 void PangolinDSOViewer::reset_internal() {
   model3DMutex.lock();
+  for (const PendingKeyframe& update : pendingKeyframes) {
+    delete update.display;
+  }
+  pendingKeyframes.clear();
+  pendingGraph.clear();
+  graphChanged = false;
+  pendingFramePoses.clear();
+  model3DMutex.unlock();
+
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    delete chunks[i];
+  }
+  chunks.clear();
   for (size_t i = 0; i < keyframes.size(); ++i) {
     delete keyframes[i];
   }
@@ -286,7 +436,6 @@ void PangolinDSOViewer::reset_internal() {
   allFramePoses.clear();
   keyframesByKFID.clear();
   connections.clear();
-  model3DMutex.unlock();
 
   openImagesMutex.lock();
   internalVideoImg->setBlack();
@@ -373,19 +522,22 @@ void PangolinDSOViewer::drawConstraints() {
 }
 
 void PangolinDSOViewer::publishGraph(
-    const std::map<
-        uint64_t, Eigen::Vector2i, std::less<uint64_t>,
-        Eigen::aligned_allocator<std::pair<const uint64_t, Eigen::Vector2i>>>&
-        connectivity) {
+    const FlatHashMap<Eigen::Vector2i>& connectivity) {
   if (disableAllDisplay || !setting_render_display3D) {
     return;
   }
 
-  model3DMutex.lock();
+  FlatHashMap<Eigen::Vector2i> graph = connectivity;
+  boost::unique_lock<boost::mutex> lk(model3DMutex);
+  std::swap(graph, pendingGraph);
+  graphChanged = true;
+}
+
+void PangolinDSOViewer::rebuildConnections(
+    const FlatHashMap<Eigen::Vector2i>& connectivity) {
   connections.resize(connectivity.size());
   int runningID = 0;
-  int totalActFwd = 0, totalActBwd = 0, totalMargFwd = 0, totalMargBwd = 0;
-  for (std::pair<uint64_t, Eigen::Vector2i> p : connectivity) {
+  for (const std::pair<uint64_t, Eigen::Vector2i>& p : connectivity) {
     int host = (int)(p.first >> 32);
     int target = (int)(p.first & (uint64_t)0xFFFFFFFF);
 
@@ -407,37 +559,48 @@ void PangolinDSOViewer::publishGraph(
         keyframesByKFID.count(target) == 0 ? 0 : keyframesByKFID[target];
     connections[runningID].fwdAct = p.second[0];
     connections[runningID].fwdMarg = p.second[1];
-    totalActFwd += p.second[0];
-    totalMargFwd += p.second[1];
 
     uint64_t inverseKey = (((uint64_t)target) << 32) + ((uint64_t)host);
     Eigen::Vector2i st = connectivity.at(inverseKey);
     connections[runningID].bwdAct = st[0];
     connections[runningID].bwdMarg = st[1];
 
-    totalActBwd += st[0];
-    totalMargBwd += st[1];
-
     ++runningID;
   }
-
-  model3DMutex.unlock();
+  connections.resize(runningID);
 }
+
 void PangolinDSOViewer::publishKeyframes(std::vector<FrameHessian*>& frames,
                                          bool final, CalibHessian* HCalib) {
   if (disableAllDisplay || !setting_render_display3D) {
     return;
   }
 
-  boost::unique_lock<boost::mutex> lk(model3DMutex);
-  for (FrameHessian* fh : frames) {
-    if (keyframesByKFID.find(fh->frameID) == keyframesByKFID.end()) {
-      KeyFrameDisplay* kfd = new KeyFrameDisplay();
-      keyframesByKFID[fh->frameID] = kfd;
-      keyframes.emplace_back(kfd);
+  std::vector<PendingKeyframe> updates(frames.size());
+  {
+    boost::unique_lock<boost::mutex> lk(model3DMutex);
+    for (PendingKeyframe& update : updates) {
+      if (spareDisplays.empty()) {
+        break;
+      }
+      update.display = spareDisplays.back();
+      spareDisplays.pop_back();
+    }
+  }
+  // the copies are made without holding the lock the viewer draws with.
+  for (size_t i = 0; i < frames.size(); ++i) {
+    PendingKeyframe& update = updates[i];
+    if (update.display == nullptr) {
+      update.display = new KeyFrameDisplay();
     }
-    keyframesByKFID[fh->frameID]->setFromKF(fh, HCalib);
+    update.display->setFromKF(frames[i], HCalib);
+    update.frameID = frames[i]->frameID;
+    update.final = final;
   }
+
+  boost::unique_lock<boost::mutex> lk(model3DMutex);
+  pendingKeyframes.insert(pendingKeyframes.end(), updates.begin(),
+                          updates.end());
 }
 void PangolinDSOViewer::publishCamPose(FrameShell* frame,
                                        CalibHessian* HCalib) {
@@ -461,7 +624,7 @@ void PangolinDSOViewer::publishCamPose(FrameShell* frame,
   }
 
   currentCam->setFromF(frame, HCalib);
-  allFramePoses.emplace_back(frame->camToWorld.translation().cast<float>());
+  pendingFramePoses.emplace_back(frame->camToWorld.translation().cast<float>());
 }
 
 void PangolinDSOViewer::pushLiveFrame(FrameHessian* image) {
@@ -479,9 +642,14 @@ void PangolinDSOViewer::pushLiveFrame(FrameHessian* image) {
   videoImgChanged = true;
 }
 
-bool PangolinDSOViewer::needPushDepthImage() {
-  return setting_render_displayDepth;
+int PangolinDSOViewer::capabilities() {
+  if (disableAllDisplay) {
+    return 0;
+  }
+  return (setting_render_displayVideo ? CAP_LIVE_FRAME : 0) |
+         (setting_render_displayDepth ? CAP_DEPTH_IMAGE : 0);
 }
+
 void PangolinDSOViewer::pushDepthImage(MinimalImageB3* image) {
   if (disableAllDisplay || !setting_render_displayDepth) {
     return;
@@ -8,13 +8,14 @@ namespace dso {
 
 void AccumulatedSCHessianSSE::addPoint(EFPoint* p, bool shiftPriorToZero,
                                        int tid) {
-  int ngoodres = 0;
+  std::vector<EFResidual*>& active = activeRes[tid];
+  active.clear();
   for (EFResidual* r : p->residualsAll) {
     if (r->isActive()) {
-      ++ngoodres;
+      active.emplace_back(r);
     }
   }
-  if (ngoodres == 0) {
+  if (active.empty()) {
     p->HdiF = 0;
     p->bdSumF = 0;
     p->data->idepth_hessian = 0;
@@ -40,107 +41,192 @@ void AccumulatedSCHessianSSE::addPoint(EFPoint* p, bool shiftPriorToZero,
 
   CHECK(std::isfinite((float)(p->HdiF)));
 
-  int nFrames2 = nframes[tid] * nframes[tid];
-  for (EFResidual* r1 : p->residualsAll) {
-    if (!r1->isActive()) {
-      continue;
-    }
-    int r1ht = r1->hostIDX + r1->targetIDX * nframes[tid];
-
-    for (EFResidual* r2 : p->residualsAll) {
-      if (!r2->isActive()) {
-        continue;
-      }
-
-      accD[tid][r1ht + r2->targetIDX * nFrames2].update(r1->JpJdF, r2->JpJdF,
-                                                        p->HdiF);
-    }
+#if DSO_AVX_DISPATCH
+  if (useAVX()) {
+    addPointDAVX(active, p->HdiF, tid);
+  } else {
+    addPointD(active, p->HdiF, tid);
+  }
+#else
+  addPointD(active, p->HdiF, tid);
+#endif
 
+  for (const EFResidual* r1 : active) {
+    const int r1ht = r1->hostIDX + r1->targetIDX * nframes[tid];
     accE[tid][r1ht].update(r1->JpJdF, Hcd, p->HdiF);
     accEB[tid][r1ht].update(r1->JpJdF, p->HdiF * p->bdSumF);
   }
 }
 
-void AccumulatedSCHessianSSE::stitchDoubleInternal(
-    MatXX* H, VecX* b, const EnergyFunctional * const EF, int min, int max,
-    Vec10* stats, int tid) {
-  int toAggregate = NUM_THREADS;
-  if (tid == -1) {
-    toAggregate = 1;
-    tid = 0;
-  }  // special case: if we dont do multithreading, dont aggregate.
-  if (min == max) {
-    return;
+void AccumulatedSCHessianSSE::addPointD(const std::vector<EFResidual*>& active,
+                                        const float HdiF, const int tid) {
+  const int nFrames2 = nframes[tid] * nframes[tid];
+  for (const EFResidual* r1 : active) {
+    AccumulatorXX<8, 8>* const row =
+        accD[tid] + r1->hostIDX + r1->targetIDX * nframes[tid];
+    const Vec8f Jw = HdiF * r1->JpJdF;
+    for (const EFResidual* r2 : active) {
+      row[r2->targetIDX * nFrames2].updateWeighted(Jw, r2->JpJdF);
+    }
   }
+}
 
-  int nf = nframes[0];
-  int nframes2 = nf * nf;
-
-  for (int k = min; k < max; ++k) {
-    int i = k % nf;
-    int j = k / nf;
-
-    int iIdx = CPARS + i * 8;
-    int jIdx = CPARS + j * 8;
-    int ijIdx = i + nf * j;
-
-    Mat8C Hpc = Mat8C::Zero();
-    Vec8 bp = Vec8::Zero();
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX void AccumulatedSCHessianSSE::addPointDAVX(
+    const std::vector<EFResidual*>& active, const float HdiF, const int tid) {
+  const int nFrames2 = nframes[tid] * nframes[tid];
+  const __m256 w = _mm256_set1_ps(HdiF);
+  for (const EFResidual* r1 : active) {
+    AccumulatorXX<8, 8>* const row =
+        accD[tid] + r1->hostIDX + r1->targetIDX * nframes[tid];
+    const __m256 Jw = _mm256_mul_ps(w, _mm256_loadu_ps(r1->JpJdF.data()));
+    for (const EFResidual* r2 : active) {
+      row[r2->targetIDX * nFrames2].updateWeightedAVX(Jw, r2->JpJdF.data());
+    }
+  }
+}
+#endif
+
+void AccumulatedSCHessianSSE::stitchPairsInternal(const int numThreads,
+                                                  const int min, const int max,
+                                                  Vec10* stats, const int tid) {
+  const int nf = nframes[0];
+  const int nframes2 = nf * nf;
+
+  for (int ij = min; ij < max; ++ij) {
+    Mat8C& Hpc = pairE[ij];
+    Vec8& bp = pairEB[ij];
+    Hpc.setZero();
+    bp.setZero();
+    for (int tid2 = 0; tid2 < numThreads; ++tid2) {
+      accE[tid2][ij].finish();
+      accEB[tid2][ij].finish();
+      Hpc += accE[tid2][ij].A1m.cast<double>();
+      bp += accEB[tid2][ij].A1m.cast<double>();
+    }
 
-    for (int tid2 = 0; tid2 < toAggregate; ++tid2) {
-      accE[tid2][ijIdx].finish();
-      accEB[tid2][ijIdx].finish();
-      Hpc += accE[tid2][ijIdx].A1m.cast<double>();
-      bp += accEB[tid2][ijIdx].A1m.cast<double>();
+    for (int k = 0; k < nf; ++k) {
+      const int ijk = ij + k * nframes2;
+      Mat88& accDM = tripleD[ijk];
+      accDM.setZero();
+      tripleUsed[ijk] = 0;
+      for (int tid2 = 0; tid2 < numThreads; ++tid2) {
+        accD[tid2][ijk].finish();
+        if (accD[tid2][ijk].num == 0) {
+          continue;
+        }
+        accDM += accD[tid2][ijk].A1m.cast<double>();
+        tripleUsed[ijk] = 1;
+      }
     }
+  }
+}
 
-    H[tid].block<8, CPARS>(iIdx, 0) += EF->adHost[ijIdx] * Hpc;
-    H[tid].block<8, CPARS>(jIdx, 0) += EF->adTarget[ijIdx] * Hpc;
-    b[tid].segment<8>(iIdx) += EF->adHost[ijIdx] * bp;
-    b[tid].segment<8>(jIdx) += EF->adTarget[ijIdx] * bp;
+void AccumulatedSCHessianSSE::stitchRowsInternal(
+    MatXX* H, VecX* b, const EnergyFunctional* const EF, const int numThreads,
+    const int min, const int max, Vec10* stats, const int tid) {
+  const int nf = nframes[0];
+  const int nframes2 = nf * nf;
+
+  for (int r = min; r < max; ++r) {
+    if (r == nf) {
+      for (int tid2 = 0; tid2 < numThreads; ++tid2) {
+        accHcc[tid2].finish();
+        accbc[tid2].finish();
+        H->topLeftCorner<CPARS, CPARS>() += accHcc[tid2].A1m.cast<double>();
+        b->head<CPARS>() += accbc[tid2].A1m.cast<double>();
+      }
+      continue;
+    }
 
-    for (int k = 0; k < nf; ++k) {
-      int kIdx = CPARS + k * 8;
-      int ijkIdx = ijIdx + k * nframes2;
-      int ikIdx = i + nf * k;
+    const int rIdx = CPARS + r * 8;
 
-      Mat88 accDM = Mat88::Zero();
+    // (r, j): rows of the host.
+    for (int j = 0; j < nf; ++j) {
+      const int ij = r + nf * j;
+      H->block<8, CPARS>(rIdx, 0) += EF->adHost[ij] * pairE[ij];
+      b->segment<8>(rIdx) += EF->adHost[ij] * pairEB[ij];
 
-      for (int tid2 = 0; tid2 < toAggregate; ++tid2) {
-        accD[tid2][ijkIdx].finish();
-        if (accD[tid2][ijkIdx].num == 0) {
+      for (int k = 0; k < nf; ++k) {
+        const int ijk = ij + k * nframes2;
+        if (!tripleUsed[ijk]) {
           continue;
         }
-        accDM += accD[tid2][ijkIdx].A1m.cast<double>();
+        const int kIdx = CPARS + k * 8;
+        const int ik = r + nf * k;
+        H->block<8, 8>(rIdx, rIdx) +=
+            EF->adHost[ij] * tripleD[ijk] * EF->adHost[ik].transpose();
+        H->block<8, 8>(rIdx, kIdx) +=
+            EF->adHost[ij] * tripleD[ijk] * EF->adTarget[ik].transpose();
       }
+    }
+
+    // (i, r): rows of the target.
+    for (int i = 0; i < nf; ++i) {
+      const int ij = i + nf * r;
+      const int iIdx = CPARS + i * 8;
+      H->block<8, CPARS>(rIdx, 0) += EF->adTarget[ij] * pairE[ij];
+      b->segment<8>(rIdx) += EF->adTarget[ij] * pairEB[ij];
 
-      H[tid].block<8, 8>(iIdx, iIdx) +=
-          EF->adHost[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-      H[tid].block<8, 8>(jIdx, kIdx) +=
-          EF->adTarget[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
-      H[tid].block<8, 8>(jIdx, iIdx) +=
-          EF->adTarget[ijIdx] * accDM * EF->adHost[ikIdx].transpose();
-      H[tid].block<8, 8>(iIdx, kIdx) +=
-          EF->adHost[ijIdx] * accDM * EF->adTarget[ikIdx].transpose();
+      for (int k = 0; k < nf; ++k) {
+        const int ijk = ij + k * nframes2;
+        if (!tripleUsed[ijk]) {
+          continue;
+        }
+        const int kIdx = CPARS + k * 8;
+        const int ik = i + nf * k;
+        H->block<8, 8>(rIdx, kIdx) +=
+            EF->adTarget[ij] * tripleD[ijk] * EF->adTarget[ik].transpose();
+        H->block<8, 8>(rIdx, iIdx) +=
+            EF->adTarget[ij] * tripleD[ijk] * EF->adHost[ik].transpose();
+      }
     }
   }
+}
 
-  if (min == 0) {
-    for (int tid2 = 0; tid2 < toAggregate; ++tid2) {
-      accHcc[tid2].finish();
-      accbc[tid2].finish();
-      H[tid].topLeftCorner<CPARS, CPARS>() += accHcc[tid2].A1m.cast<double>();
-      b[tid].head<CPARS>() += accbc[tid2].A1m.cast<double>();
-    }
+void AccumulatedSCHessianSSE::stitchDoubleMT(IndexThreadReduce<Vec10>* red,
+                                             MatXX& H, VecX& b,
+                                             const EnergyFunctional* const EF,
+                                             bool MT) {
+  const int nf = nframes[0];
+  const int numThreads = MT ? red->getNumThreads() : 1;
+  for (int i = 1; i < numThreads; ++i) {
+    CHECK_EQ(nframes[i], nf);
+  }
+
+  // resize() keeps the allocation when the window shrinks.
+  pairE.resize(nf * nf);
+  pairEB.resize(nf * nf);
+  tripleD.resize(nf * nf * nf);
+  tripleUsed.resize(nf * nf * nf);
+  pairMemory.set(pairE.capacity() * sizeof(Mat8C) +
+                 pairEB.capacity() * sizeof(Vec8) +
+                 tripleD.capacity() * sizeof(Mat88) + tripleUsed.capacity());
+  H = MatXX::Zero(nf * 8 + CPARS, nf * 8 + CPARS);
+  b = VecX::Zero(nf * 8 + CPARS);
+
+  if (MT) {
+    red->reduce(boost::bind(&AccumulatedSCHessianSSE::stitchPairsInternal,
+                            this, numThreads, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, nf * nf, 0);
+    red->reduce(boost::bind(&AccumulatedSCHessianSSE::stitchRowsInternal, this,
+                            &H, &b, EF, numThreads, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, nf + 1, 1);
+  } else {
+    stitchPairsInternal(1, 0, nf * nf, nullptr, 0);
+    stitchRowsInternal(&H, &b, EF, 1, 0, nf + 1, nullptr, 0);
   }
 
-  //	// ----- new: copy transposed parts for calibration only.
-  //	for(int h=0;h<nf; ++h)
-  //	{
-  //		int hIdx = 4+h*8;
-  //		H.block<4,8>(0,hIdx).noalias() =
-  // H.block<8,4>(hIdx,0).transpose();
-  //	}
+  // make diagonal by copying over parts.
+  for (int h = 0; h < nf; ++h) {
+    int hIdx = CPARS + h * 8;
+    H.block<CPARS, 8>(0, hIdx).noalias() =
+        H.block<8, CPARS>(hIdx, 0).transpose();
+  }
 }
 
 void AccumulatedSCHessianSSE::stitchDouble(MatXX& H, VecX& b,
@@ -1,5 +1,7 @@
 #include "optimization_backend/accumulated_top_hessian_sse.h"
 
+#include <algorithm>
+
 #include <glog/logging.h>
 
 #include "optimization_backend/energy_functional/energy_functional.h"
@@ -14,22 +16,10 @@ namespace dso {
 void AccumulatedTopHessianSSE::setZero(const int nFrames, const int min,
                                        const int max, Vec10 *const stats,
                                        const int tid) {
-  if (nFrames != nframes[tid]) {
-    // if the number of frames has changed, reset accumulator of Hessian to
-    // fit the current shape (N x N)
-    if (acc[tid] != nullptr) {
-      delete[] acc[tid];
-    }
-#if USE_XI_MODEL
-    acc[tid] = new Accumulator14[nFrames * nFrames];
-#else
-    acc[tid] = new AccumulatorApprox[nFrames * nFrames];
-#endif
-  }
-
-  for (int i = 0; i < nFrames * nFrames; ++i) {
-    acc[tid][i].initialize();
-  }
+  // keep room for a full window, so the accumulators are not reallocated
+  // while the window fills up and frames come and go.
+  const int reserve = std::max(nFrames, maxFrames + 1);
+  acc[tid] = accArena[tid].reset(nFrames * nFrames, reserve * reserve);
 
   nframes[tid] = nFrames;
   nres[tid] = 0;
@@ -44,6 +34,8 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint *const p,
 
   VecCf dc = ef->cDeltaF;
   float dd = p->deltaF;
+  // 4 at a time over the zero padding of J past the pattern.
+  const int patternNum = staticPatternNum[ef->settings.pattern];
 
   float bd_acc = 0;
   float Hdd_acc = 0;
@@ -69,6 +61,10 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint *const p,
     }
 
     RawResidualJacobian *rJ = r->J;
+    VecNRf unpacked[RawResidualJacobian::kPatternRows];
+    const VecNRf *rows = rJ->patternRows(unpacked);
+    const VecNRf *JIdx = rows + 1;
+    const VecNRf *JabF = rows + 3;
 
     // Compute an id of a part of Hessian according to host id and target id
     const int htIDX = r->hostIDX + r->targetIDX * nframes[tid];
@@ -76,7 +72,7 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint *const p,
 
     VecNRf resApprox;
     if (mode == 0) {
-      resApprox = rJ->resF;
+      resApprox = rows[0];
     } else if (mode == 2) {
       resApprox = r->res_toZeroF;
     } else if (mode == 1) {
@@ -91,16 +87,14 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint *const p,
       for (int i = 0; i < patternNum; i += 4) {
         // PATTERN: rtz = resF - [JI*Jp Ja]*delta.
         __m128 rtz = _mm_load_ps(((float *)&r->res_toZeroF) + i);
-        rtz = _mm_add_ps(rtz, _mm_mul_ps(_mm_load_ps(((float *)(rJ->JIdx)) + i),
-                                         Jp_delta_x));
         rtz = _mm_add_ps(
-            rtz,
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JIdx + 1)) + i), Jp_delta_y));
+            rtz, _mm_mul_ps(_mm_load_ps(JIdx[0].data() + i), Jp_delta_x));
         rtz = _mm_add_ps(
-            rtz, _mm_mul_ps(_mm_load_ps(((float *)(rJ->JabF)) + i), delta_a));
-        rtz = _mm_add_ps(
-            rtz,
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JabF + 1)) + i), delta_b));
+            rtz, _mm_mul_ps(_mm_load_ps(JIdx[1].data() + i), Jp_delta_y));
+        rtz = _mm_add_ps(rtz,
+                         _mm_mul_ps(_mm_load_ps(JabF[0].data() + i), delta_a));
+        rtz = _mm_add_ps(rtz,
+                         _mm_mul_ps(_mm_load_ps(JabF[1].data() + i), delta_b));
         _mm_store_ps(((float *)&resApprox) + i, rtz);
       }
     }
@@ -109,10 +103,10 @@ void AccumulatedTopHessianSSE::addPoint(EFPoint *const p,
     Vec2f Jab_r(0, 0); // [0]: r * (dr / da) ; [1]: r * (dr / db)
     float rr = 0;      // squared residual
     for (int i = 0; i < patternNum; ++i) {
-      JI_r[0] += resApprox[i] * rJ->JIdx[0][i];
-      JI_r[1] += resApprox[i] * rJ->JIdx[1][i];
-      Jab_r[0] += resApprox[i] * rJ->JabF[0][i];
-      Jab_r[1] += resApprox[i] * rJ->JabF[1][i];
+      JI_r[0] += resApprox[i] * JIdx[0][i];
+      JI_r[1] += resApprox[i] * JIdx[1][i];
+      Jab_r[0] += resApprox[i] * JabF[0][i];
+      Jab_r[1] += resApprox[i] * JabF[1][i];
       rr += resApprox[i] * resApprox[i];
     }
 
@@ -243,77 +237,95 @@ void AccumulatedTopHessianSSE::stitchDouble(MatXX &H, VecX &b,
   }
 }
 
-void AccumulatedTopHessianSSE::stitchDoubleInternal(
-    MatXX *H, VecX *b, const EnergyFunctional *const EF, bool usePrior, int min,
-    int max, Vec10 *stats, int tid) {
-  int toAggregate = NUM_THREADS;
-  if (tid == -1) {
-    toAggregate = 1;
-    tid = 0;
-  } // special case: if we dont do multithreading, dont aggregate.
-
-  if (min == max) {
-    return;
-  }
-
+void AccumulatedTopHessianSSE::stitchPairsInternal(const int numThreads,
+                                                   const int min, const int max,
+                                                   Vec10 *stats,
+                                                   const int tid) {
   for (int k = min; k < max; ++k) {
-    int h = k % nframes[0];
-    int t = k / nframes[0];
-
-    int hIdx = CPARS + h * 8;
-    int tIdx = CPARS + t * 8;
-    int aidx = h + nframes[0] * t;
+    MatPCPC &accH = pairH[k];
+    accH.setZero();
+    pairUsed[k] = 0;
+    for (int tid2 = 0; tid2 < numThreads; ++tid2) {
+      acc[tid2][k].finish();
+      if (acc[tid2][k].num == 0) {
+        continue;
+      }
+      accH += acc[tid2][k].H.cast<double>();
+      pairUsed[k] = 1;
+    }
+  }
+}
 
-    CHECK_EQ(aidx, k);
+void AccumulatedTopHessianSSE::stitchRowsInternal(
+    MatXX *H, VecX *b, const EnergyFunctional *const EF, bool usePrior, int min,
+    int max, Vec10 *stats, int tid) {
+  const int nf = nframes[0];
+  for (int r = min; r < max; ++r) {
+    if (r == nf) {
+      // calibration rows.
+      for (int k = 0; k < nf * nf; ++k) {
+        if (pairUsed[k]) {
+          H->topLeftCorner<CPARS, CPARS>().noalias() +=
+              pairH[k].block<CPARS, CPARS>(0, 0);
+          b->head<CPARS>().noalias() += pairH[k].block<CPARS, 1>(0, CPARS + 8);
+        }
+      }
+      if (usePrior) {
+        H->diagonal().head<CPARS>() += EF->cPrior;
+        b->head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>());
+      }
+      continue;
+    }
 
-    MatPCPC accH = MatPCPC::Zero();
+    const int rIdx = CPARS + r * 8;
 
-    for (int tid2 = 0; tid2 < toAggregate; ++tid2) {
-      acc[tid2][aidx].finish();
-      if (acc[tid2][aidx].num == 0) {
+    // pairs hosted by r.
+    for (int t = 0; t < nf; ++t) {
+      const int aidx = r + nf * t;
+      if (!pairUsed[aidx]) {
         continue;
       }
-      accH += acc[tid2][aidx].H.cast<double>();
-    }
-
-    H[tid].block<8, 8>(hIdx, hIdx).noalias() += EF->adHost[aidx] *
-                                                accH.block<8, 8>(CPARS, CPARS) *
-                                                EF->adHost[aidx].transpose();
+      const MatPCPC &accH = pairH[aidx];
+      const int tIdx = CPARS + t * 8;
 
-    H[tid].block<8, 8>(tIdx, tIdx).noalias() += EF->adTarget[aidx] *
-                                                accH.block<8, 8>(CPARS, CPARS) *
-                                                EF->adTarget[aidx].transpose();
+      H->block<8, 8>(rIdx, rIdx).noalias() += EF->adHost[aidx] *
+                                              accH.block<8, 8>(CPARS, CPARS) *
+                                              EF->adHost[aidx].transpose();
 
-    H[tid].block<8, 8>(hIdx, tIdx).noalias() += EF->adHost[aidx] *
-                                                accH.block<8, 8>(CPARS, CPARS) *
-                                                EF->adTarget[aidx].transpose();
+      H->block<8, 8>(rIdx, tIdx).noalias() += EF->adHost[aidx] *
+                                              accH.block<8, 8>(CPARS, CPARS) *
+                                              EF->adTarget[aidx].transpose();
 
-    H[tid].block<8, CPARS>(hIdx, 0).noalias() +=
-        EF->adHost[aidx] * accH.block<8, CPARS>(CPARS, 0);
+      H->block<8, CPARS>(rIdx, 0).noalias() +=
+          EF->adHost[aidx] * accH.block<8, CPARS>(CPARS, 0);
 
-    H[tid].block<8, CPARS>(tIdx, 0).noalias() +=
-        EF->adTarget[aidx] * accH.block<8, CPARS>(CPARS, 0);
+      b->segment<8>(rIdx).noalias() +=
+          EF->adHost[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
+    }
 
-    H[tid].topLeftCorner<CPARS, CPARS>().noalias() +=
-        accH.block<CPARS, CPARS>(0, 0);
+    // pairs targeting r.
+    for (int h = 0; h < nf; ++h) {
+      const int aidx = h + nf * r;
+      if (!pairUsed[aidx]) {
+        continue;
+      }
+      const MatPCPC &accH = pairH[aidx];
 
-    b[tid].segment<8>(hIdx).noalias() +=
-        EF->adHost[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
+      H->block<8, 8>(rIdx, rIdx).noalias() += EF->adTarget[aidx] *
+                                              accH.block<8, 8>(CPARS, CPARS) *
+                                              EF->adTarget[aidx].transpose();
 
-    b[tid].segment<8>(tIdx).noalias() +=
-        EF->adTarget[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
+      H->block<8, CPARS>(rIdx, 0).noalias() +=
+          EF->adTarget[aidx] * accH.block<8, CPARS>(CPARS, 0);
 
-    b[tid].head<CPARS>().noalias() += accH.block<CPARS, 1>(0, CPARS + 8);
-  }
+      b->segment<8>(rIdx).noalias() +=
+          EF->adTarget[aidx] * accH.block<8, 1>(CPARS, CPARS + 8);
+    }
 
-  // only do this on one thread.
-  if (min == 0 && usePrior) {
-    H[tid].diagonal().head<CPARS>() += EF->cPrior;
-    b[tid].head<CPARS>() += EF->cPrior.cwiseProduct(EF->cDeltaF.cast<double>());
-    for (int h = 0; h < nframes[tid]; ++h) {
-      H[tid].diagonal().segment<8>(CPARS + h * 8) += EF->frames[h]->prior;
-      b[tid].segment<8>(CPARS + h * 8) +=
-          EF->frames[h]->prior.cwiseProduct(EF->frames[h]->delta_prior);
+    if (usePrior) {
+      H->diagonal().segment<8>(rIdx) += EF->frames[r]->prior;
+      b->segment<8>(rIdx) +=
+          EF->frames[r]->prior.cwiseProduct(EF->frames[r]->delta_prior);
     }
   }
 }
@@ -323,45 +335,45 @@ void AccumulatedTopHessianSSE::stitchDoubleMT(IndexThreadReduce<Vec10> *red,
                                               const EnergyFunctional *const EF,
                                               const bool usePrior,
                                               const bool MT) {
-  // sum up, splitting by bock in square.
-  if (MT) {
-    MatXX Hs[NUM_THREADS];
-    VecX bs[NUM_THREADS];
-    for (int i = 0; i < NUM_THREADS; ++i) {
-      assert(nframes[0] == nframes[i]);
-      Hs[i] = MatXX::Zero(nframes[0] * 8 + CPARS, nframes[0] * 8 + CPARS);
-      bs[i] = VecX::Zero(nframes[0] * 8 + CPARS);
-    }
+  const int nf = nframes[0];
+  const int numThreads = MT ? red->getNumThreads() : 1;
+  for (int i = 1; i < numThreads; ++i) {
+    CHECK_EQ(nframes[i], nf);
+  }
+
+  // resize() keeps the allocation when the window shrinks.
+  pairH.resize(nf * nf);
+  pairUsed.resize(nf * nf);
+  pairMemory.set(pairH.capacity() * sizeof(MatPCPC) + pairUsed.capacity());
+  H = MatXX::Zero(nf * 8 + CPARS, nf * 8 + CPARS);
+  b = VecX::Zero(nf * 8 + CPARS);
 
-    red->reduce(boost::bind(&AccumulatedTopHessianSSE::stitchDoubleInternal,
-                            this, Hs, bs, EF, usePrior, boost::placeholders::_1,
+  if (MT) {
+    red->reduce(boost::bind(&AccumulatedTopHessianSSE::stitchPairsInternal,
+                            this, numThreads, boost::placeholders::_1,
                             boost::placeholders::_2, boost::placeholders::_3,
                             boost::placeholders::_4),
-                0, nframes[0] * nframes[0], 0);
-
-    // sum up results
-    H = Hs[0];
-    b = bs[0];
-
-    for (int i = 1; i < NUM_THREADS; ++i) {
-      H.noalias() += Hs[i];
-      b.noalias() += bs[i];
+                0, nf * nf, 0);
+    red->reduce(boost::bind(&AccumulatedTopHessianSSE::stitchRowsInternal,
+                            this, &H, &b, EF, usePrior, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, nf + 1, 1);
+    for (int i = 1; i < numThreads; ++i) {
       nres[0] += nres[i];
     }
   } else {
-    H = MatXX::Zero(nframes[0] * 8 + CPARS, nframes[0] * 8 + CPARS);
-    b = VecX::Zero(nframes[0] * 8 + CPARS);
-    stitchDoubleInternal(&H, &b, EF, usePrior, 0, nframes[0] * nframes[0],
-                         nullptr, -1);
+    stitchPairsInternal(1, 0, nf * nf, nullptr, 0);
+    stitchRowsInternal(&H, &b, EF, usePrior, 0, nf + 1, nullptr, 0);
   }
 
   // make diagonal by copying over parts.
-  for (int h = 0; h < nframes[0]; ++h) {
+  for (int h = 0; h < nf; ++h) {
     int hIdx = CPARS + h * 8;
     H.block<CPARS, 8>(0, hIdx).noalias() =
         H.block<8, CPARS>(hIdx, 0).transpose();
 
-    for (int t = h + 1; t < nframes[0]; ++t) {
+    for (int t = h + 1; t < nf; ++t) {
       int tIdx = CPARS + t * 8;
       H.block<8, 8>(hIdx, tIdx).noalias() +=
           H.block<8, 8>(tIdx, hIdx).transpose();
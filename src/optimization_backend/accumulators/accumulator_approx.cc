@@ -1,6 +1,7 @@
 #include "optimization_backend/accumulators/accumulator_approx.h"
 
 #include <glog/logging.h>
+#include <string.h>
 
 namespace dso {
 
@@ -47,6 +48,15 @@ void AccumulatorApprox::finish() {
 
 void AccumulatorApprox::updateSSE(const float* const x, const float* const y,
                                   const float a, const float b, const float c) {
+#if DSO_NEON
+  if (useNEON()) {
+    updateDataNEON(x, y, a, b, c);
+    ++num;
+    ++numIn1;
+    shiftUp(false);
+    return;
+  }
+#endif
   Data[0] +=
       a * x[0] * x[0] + c * y[0] * y[0] + b * (x[0] * y[0] + y[0] * x[0]);
   Data[1] +=
@@ -175,6 +185,20 @@ void AccumulatorApprox::updateSSE(const float* const x, const float* const y,
 void AccumulatorApprox::update(const float* const x4, const float* const x6,
                                const float* const y4, const float* const y6,
                                const float a, const float b, const float c) {
+#if DSO_NEON
+  if (useNEON()) {
+    float x[10], y[10];
+    memcpy(x, x4, 4 * sizeof(float));
+    memcpy(x + 4, x6, 6 * sizeof(float));
+    memcpy(y, y4, 4 * sizeof(float));
+    memcpy(y + 4, y6, 6 * sizeof(float));
+    updateDataNEON(x, y, a, b, c);
+    ++num;
+    ++numIn1;
+    shiftUp(false);
+    return;
+  }
+#endif
   Data[0] += a * x4[0] * x4[0] + c * y4[0] * y4[0] +
              b * (x4[0] * y4[0] + y4[0] * x4[0]);
   Data[1] += a * x4[1] * x4[0] + c * y4[1] * y4[0] +
@@ -304,6 +328,17 @@ void AccumulatorApprox::updateTopRight(
     const float* const x4, const float* const x6, const float* const y4,
     const float* const y6, const float TR00, const float TR10, const float TR01,
     const float TR11, const float TR02, const float TR12) {
+#if DSO_NEON
+  if (useNEON()) {
+    float x[10], y[10];
+    memcpy(x, x4, 4 * sizeof(float));
+    memcpy(x + 4, x6, 6 * sizeof(float));
+    memcpy(y, y4, 4 * sizeof(float));
+    memcpy(y + 4, y6, 6 * sizeof(float));
+    updateTopRightNEON(x, y, TR00, TR10, TR01, TR11, TR02, TR12);
+    return;
+  }
+#endif
   TopRight_Data[0] += x4[0] * TR00 + y4[0] * TR10;
   TopRight_Data[1] += x4[0] * TR01 + y4[0] * TR11;
   TopRight_Data[2] += x4[0] * TR02 + y4[0] * TR12;
@@ -345,6 +380,53 @@ void AccumulatorApprox::updateTopRight(
   TopRight_Data[29] += x6[5] * TR02 + y6[5] * TR12;
 }
 
+#if DSO_NEON
+void AccumulatorApprox::updateDataNEON(const float* const x,
+                                       const float* const y, const float a,
+                                       const float b, const float c) {
+  float* row = Data;
+  for (int r = 0; r < 10; ++r) {
+    const float pr = a * x[r] + b * y[r];
+    const float qr = c * y[r] + b * x[r];
+    const float32x4_t p = vdupq_n_f32(pr);
+    const float32x4_t q = vdupq_n_f32(qr);
+    // unaligned, the rows of the triangle start anywhere.
+    int k = r;
+    for (; k + 4 <= 10; k += 4) {
+      float32x4_t d = vld1q_f32(row + k - r);
+      d = vfmaq_f32(d, vld1q_f32(x + k), p);
+      d = vfmaq_f32(d, vld1q_f32(y + k), q);
+      vst1q_f32(row + k - r, d);
+    }
+    for (; k < 10; ++k) {
+      row[k - r] += x[k] * pr + y[k] * qr;
+    }
+    row += 10 - r;
+  }
+}
+
+void AccumulatorApprox::updateTopRightNEON(
+    const float* const x, const float* const y, const float TR00,
+    const float TR10, const float TR01, const float TR11, const float TR02,
+    const float TR12) {
+  // the three columns are interleaved, vld3q splits four rows into them.
+  for (int k = 0; k < 8; k += 4) {
+    const float32x4_t xk = vld1q_f32(x + k);
+    const float32x4_t yk = vld1q_f32(y + k);
+    float32x4x3_t d = vld3q_f32(TopRight_Data + 3 * k);
+    d.val[0] = vfmaq_n_f32(vfmaq_n_f32(d.val[0], xk, TR00), yk, TR10);
+    d.val[1] = vfmaq_n_f32(vfmaq_n_f32(d.val[1], xk, TR01), yk, TR11);
+    d.val[2] = vfmaq_n_f32(vfmaq_n_f32(d.val[2], xk, TR02), yk, TR12);
+    vst3q_f32(TopRight_Data + 3 * k, d);
+  }
+  for (int k = 8; k < 10; ++k) {
+    TopRight_Data[3 * k] += x[k] * TR00 + y[k] * TR10;
+    TopRight_Data[3 * k + 1] += x[k] * TR01 + y[k] * TR11;
+    TopRight_Data[3 * k + 2] += x[k] * TR02 + y[k] * TR12;
+  }
+}
+#endif
+
 void AccumulatorApprox::shiftUp(bool force) {
   if (numIn1 > 1000 || force) {
     for (int i = 0; i < 60; i += 4) {
@@ -1,5 +1,6 @@
 #include "optimization_backend/energy_functional/ef_point.h"
 
+#include "full_system/hessian_blocks/frame_hessian.h"
 #include "full_system/hessian_blocks/point_hessian.h"
 #include "optimization_backend/energy_functional/ef_frame.h"
 #include "optimization_backend/energy_functional/ef_residual.h"
@@ -7,10 +8,11 @@
 
 namespace dso {
 void EFPoint::takeData() {
+  const Settings& settings = *data->host->settings;
   priorF = data->hasDepthPrior
-               ? setting_idepthFixPrior * SCALE_IDEPTH * SCALE_IDEPTH
+               ? settings.idepthFixPrior * SCALE_IDEPTH * SCALE_IDEPTH
                : 0;
-  if (setting_solverMode & SOLVER_REMOVE_POSEPRIOR) {
+  if (settings.solverMode & SOLVER_REMOVE_POSEPRIOR) {
     priorF = 0;
   }
 
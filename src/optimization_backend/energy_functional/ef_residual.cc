@@ -6,8 +6,13 @@
 
 namespace dso {
 
-void EFResidual::takeDataF() {
+void EFResidual::takeDataF(const bool packJacobian) {
   std::swap<RawResidualJacobian*>(J, data->J);
+  if (packJacobian) {
+    J->pack();
+  } else {
+    J->isPacked = false;
+  }
 
   // (\frac{\partial r_{i}}{\partial \mathbf{p}_{j}})^{T} \frac{\partial
   // r_{ji}}{\partial \rho_{i}}
@@ -33,21 +38,33 @@ void EFResidual::fixLinearizationF(EnergyFunctional* ef) {
   __m128 delta_a = _mm_set1_ps((float)(dp[6]));
   __m128 delta_b = _mm_set1_ps((float)(dp[7]));
 
-  for (int i = 0; i < patternNum; i += 4) {
+  VecNRf unpacked[RawResidualJacobian::kPatternRows];
+  const VecNRf* rows = J->patternRows(unpacked);
+
+  // lanes past the pattern are 0 in J, see PointFrameResidual::linearize().
+  for (int i = 0; i < staticPatternNum[ef->settings.pattern]; i += 4) {
     // PATTERN: rtz = resF - [JI*Jp Ja]*delta.
-    __m128 rtz = _mm_load_ps(((float*)&J->resF) + i);
-    rtz = _mm_sub_ps(
-        rtz, _mm_mul_ps(_mm_load_ps(((float*)(J->JIdx)) + i), Jp_delta_x));
-    rtz = _mm_sub_ps(
-        rtz, _mm_mul_ps(_mm_load_ps(((float*)(J->JIdx + 1)) + i), Jp_delta_y));
+    __m128 rtz = _mm_load_ps(rows[0].data() + i);
     rtz = _mm_sub_ps(rtz,
-                     _mm_mul_ps(_mm_load_ps(((float*)(J->JabF)) + i), delta_a));
-    rtz = _mm_sub_ps(
-        rtz, _mm_mul_ps(_mm_load_ps(((float*)(J->JabF + 1)) + i), delta_b));
+                     _mm_mul_ps(_mm_load_ps(rows[1].data() + i), Jp_delta_x));
+    rtz = _mm_sub_ps(rtz,
+                     _mm_mul_ps(_mm_load_ps(rows[2].data() + i), Jp_delta_y));
+    rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(rows[3].data() + i), delta_a));
+    rtz = _mm_sub_ps(rtz, _mm_mul_ps(_mm_load_ps(rows[4].data() + i), delta_b));
     _mm_store_ps(((float*)&res_toZeroF) + i, rtz);
   }
 
+  if (!isLinearized) {
+    ++ef->nResLinearized;
+  }
   isLinearized = true;
 }
 
+void EFResidual::resetLinearizationF(EnergyFunctional* ef) {
+  if (isLinearized) {
+    --ef->nResLinearized;
+  }
+  isLinearized = false;
+}
+
 }  // dso
\ No newline at end of file
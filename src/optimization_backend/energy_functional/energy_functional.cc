@@ -1,5 +1,8 @@
 #include "optimization_backend/energy_functional/energy_functional.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include <glog/logging.h>
 
 #include "full_system/full_system.h"
@@ -8,6 +11,10 @@
 #include "optimization_backend/accumulated_sc_hessian_sse.h"
 #include "optimization_backend/accumulated_top_hessian_sse.h"
 #include "optimization_backend/energy_functional/energy_functional_structs.h"
+#include "optimization_backend/pcg_solver.h"
+#include "optimization_backend/sparse_schur_solver.h"
+#include "util/stage_timing.h"
+#include "util/wall_timer.h"
 
 #if !defined(__SSE3__) && !defined(__SSE2__) && !defined(__SSE1__)
 #include "SSE2NEON.h"
@@ -20,20 +27,60 @@ bool EFIndicesValid = false;
 bool EFDeltaValid = false;
 
 void EnergyFunctional::setAdjointsF(CalibHessian *Hcalib) {
-  if (adHost != nullptr) {
+  if (frames != adFrames) {
+    // old position of every frame, -1 for new ones.
+    std::vector<int> oldIdx(nFrames, -1);
+    for (int i = 0; i < nFrames; ++i) {
+      for (size_t o = 0; o < adFrames.size(); ++o) {
+        if (adFrames[o] == frames[i]) {
+          oldIdx[i] = o;
+        }
+      }
+    }
+
+    const int oldN = adFrames.size();
+    Mat88 *newAdHost = new Mat88[nFrames * nFrames];
+    Mat88 *newAdTarget = new Mat88[nFrames * nFrames];
+    Mat88f *newAdHostF = new Mat88f[nFrames * nFrames];
+    Mat88f *newAdTargetF = new Mat88f[nFrames * nFrames];
+    std::vector<std::pair<uint64_t, uint64_t>> versions(
+        nFrames * nFrames, std::pair<uint64_t, uint64_t>(0, 0));
+    for (int h = 0; h < nFrames; ++h) {
+      for (int t = 0; t < nFrames; ++t) {
+        if (oldIdx[h] < 0 || oldIdx[t] < 0) {
+          continue;
+        }
+        const int idx = h + t * nFrames;
+        const int oldIdxHT = oldIdx[h] + oldIdx[t] * oldN;
+        newAdHost[idx] = adHost[oldIdxHT];
+        newAdTarget[idx] = adTarget[oldIdxHT];
+        newAdHostF[idx] = adHostF[oldIdxHT];
+        newAdTargetF[idx] = adTargetF[oldIdxHT];
+        versions[idx] = adVersions[oldIdxHT];
+      }
+    }
+
     delete[] adHost;
-  }
-  if (adTarget != nullptr) {
     delete[] adTarget;
+    delete[] adHostF;
+    delete[] adTargetF;
+    adHost = newAdHost;
+    adTarget = newAdTarget;
+    adHostF = newAdHostF;
+    adTargetF = newAdTargetF;
+    adVersions.swap(versions);
+    adFrames = frames;
   }
 
-  adHost = new Mat88[nFrames * nFrames];
-  adTarget = new Mat88[nFrames * nFrames];
-
   for (int h = 0; h < nFrames; ++h) {
     for (int t = 0; t < nFrames; ++t) {
       FrameHessian *host = frames[h]->data;
       FrameHessian *target = frames[t]->data;
+      const int idx = h + t * nFrames;
+      if (adVersions[idx].first == host->evalPTVersion &&
+          adVersions[idx].second == target->evalPTVersion) {
+        continue;
+      }
 
       SE3 hostToTarget = target->get_worldToCam_evalPT() *
                          host->get_worldToCam_evalPT().inverse();
@@ -68,35 +115,22 @@ void EnergyFunctional::setAdjointsF(CalibHessian *Hcalib) {
       AT.block<1, 8>(6, 0) *= SCALE_A;
       AT.block<1, 8>(7, 0) *= SCALE_B;
 
-      adHost[h + t * nFrames] = AH;
-      adTarget[h + t * nFrames] = AT;
-    }
-  }
-  cPrior = VecC::Constant(setting_initialCalibHessian);
-
-  if (adHostF != nullptr) {
-    delete[] adHostF;
-  }
-  if (adTargetF != nullptr) {
-    delete[] adTargetF;
-  }
-
-  adHostF = new Mat88f[nFrames * nFrames];
-  adTargetF = new Mat88f[nFrames * nFrames];
-
-  for (int h = 0; h < nFrames; ++h) {
-    for (int t = 0; t < nFrames; ++t) {
-      adHostF[h + t * nFrames] = adHost[h + t * nFrames].cast<float>();
-      adTargetF[h + t * nFrames] = adTarget[h + t * nFrames].cast<float>();
+      adHost[idx] = AH;
+      adTarget[idx] = AT;
+      adHostF[idx] = AH.cast<float>();
+      adTargetF[idx] = AT.cast<float>();
+      adVersions[idx] =
+          std::make_pair(host->evalPTVersion, target->evalPTVersion);
     }
   }
-
+  cPrior = VecC::Constant(settings.initialCalibHessian);
   cPriorF = cPrior.cast<float>();
 
   EFAdjointsValid = true;
 }
 
-EnergyFunctional::EnergyFunctional() {
+EnergyFunctional::EnergyFunctional(const Settings& settings)
+    : settings(settings) {
   adHost = nullptr;
   adTarget = nullptr;
 
@@ -104,16 +138,22 @@ EnergyFunctional::EnergyFunctional() {
 
   adHostF = nullptr;
   adTargetF = nullptr;
-  adHTdeltaF = nullptr;
 
   nFrames = nResiduals = nPoints = 0;
+  nResLinearized = 0;
+  lastSolveRelResidual = 0;
+  lastAccumulateMs = 0;
+  lastSolveMs = 0;
 
   HM = MatXX::Zero(CPARS, CPARS);
   bM = VecX::Zero(CPARS);
+  hessianMemory.set((HM.size() + bM.size()) * sizeof(double));
 
-  accSSE_top_L = new AccumulatedTopHessianSSE();
-  accSSE_top_A = new AccumulatedTopHessianSSE();
-  accSSE_bot = new AccumulatedSCHessianSSE();
+  accSSE_top_L = new AccumulatedTopHessianSSE(settings.maxFrames);
+  accSSE_top_A = new AccumulatedTopHessianSSE(settings.maxFrames);
+  accSSE_bot = new AccumulatedSCHessianSSE(settings.maxFrames);
+  sparseSolver = new SparseSchurSolver();
+  pcgSolver = new PcgSolver(settings);
 
   resInA = resInL = resInM = 0;
   currentLambda = 0;
@@ -145,43 +185,86 @@ EnergyFunctional::~EnergyFunctional() {
   if (adTargetF != nullptr) {
     delete[] adTargetF;
   }
-  if (adHTdeltaF != nullptr) {
-    delete[] adHTdeltaF;
-  }
 
   delete accSSE_top_L;
   delete accSSE_top_A;
   delete accSSE_bot;
+  delete sparseSolver;
+  delete pcgSolver;
 }
 
-void EnergyFunctional::setDeltaF(CalibHessian *HCalib) {
-  if (adHTdeltaF != nullptr) {
-    delete[] adHTdeltaF;
-  }
-  adHTdeltaF = new Mat18f[nFrames * nFrames];
-  for (int h = 0; h < nFrames; ++h) {
-    for (int t = 0; t < nFrames; ++t) {
-      int idx = h + t * nFrames;
-      adHTdeltaF[idx] = frames[h]
-                                ->data->get_state_minus_stateZero()
-                                .head<8>()
-                                .cast<float>()
-                                .transpose() *
-                            adHostF[idx] +
-                        frames[t]
-                                ->data->get_state_minus_stateZero()
-                                .head<8>()
-                                .cast<float>()
-                                .transpose() *
-                            adTargetF[idx];
+void EnergyFunctional::clear() {
+  for (EFFrame *f : frames) {
+    for (EFPoint *p : f->points) {
+      for (EFResidual *r : p->residualsAll) {
+        r->data->efResidual = 0;
+        delete r;
+      }
+      p->data->efPoint = 0;
+      delete p;
     }
+    f->data->efFrame = 0;
+    delete f;
+  }
+  frames.clear();
+  allPoints.clear();
+  allPointsToMarg.clear();
+  connectivityMap.clear();
+  // the adjoints are relaid out by the next setAdjointsF.
+  adFrames.clear();
+  adVersions.clear();
+  deltaVersions.clear();
+
+  nFrames = nResiduals = nPoints = 0;
+  nResLinearized = 0;
+  resInA = resInL = resInM = 0;
+  currentLambda = 0;
+
+  HM = MatXX::Zero(CPARS, CPARS);
+  bM = VecX::Zero(CPARS);
+  hessianMemory.set((HM.size() + bM.size()) * sizeof(double));
+
+  EFIndicesValid = false;
+  EFAdjointsValid = false;
+  EFDeltaValid = false;
+}
+
+void EnergyFunctional::setDeltaF(CalibHessian *HCalib) {
+  if (frames != adFrames) {
+    // the adjoints are still laid out for other frames.
+    setAdjointsF(HCalib);
   }
 
-  cDeltaF = HCalib->value_minus_value_zero.cast<float>();
   for (EFFrame *f : frames) {
     f->delta = f->data->get_state_minus_stateZero().head<8>();
     f->delta_prior = (f->data->get_state() - f->data->getPriorZero()).head<8>();
+  }
 
+  // the versions are unique stamps (nextStateVersion), so an entry left at
+  // idx by other frames never matches.
+  adHTdeltaF.resize(nFrames * nFrames);
+  deltaVersions.resize(nFrames * nFrames);
+  for (int t = 0; t < nFrames; ++t) {
+    const FrameHessian *target = frames[t]->data;
+    const Vec8f deltaT = frames[t]->delta.cast<float>();
+    for (int h = 0; h < nFrames; ++h) {
+      const FrameHessian *host = frames[h]->data;
+      const int idx = h + t * nFrames;
+      const std::array<uint64_t, 4> versions = {
+          {host->stateVersion, target->stateVersion, adVersions[idx].first,
+           adVersions[idx].second}};
+      if (deltaVersions[idx] == versions) {
+        continue;
+      }
+      adHTdeltaF[idx].noalias() =
+          frames[h]->delta.cast<float>().transpose() * adHostF[idx];
+      adHTdeltaF[idx].noalias() += deltaT.transpose() * adTargetF[idx];
+      deltaVersions[idx] = versions;
+    }
+  }
+
+  cDeltaF = HCalib->value_minus_value_zero.cast<float>();
+  for (EFFrame *f : frames) {
     for (EFPoint *p : f->points) {
       p->deltaF = p->data->idepth - p->data->idepth_zero;
     }
@@ -191,6 +274,7 @@ void EnergyFunctional::setDeltaF(CalibHessian *HCalib) {
 }
 
 void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, const bool MT) {
+  ScopedStageTimer stageTimer(STAGE_ACCUMULATE_AF);
   if (MT) {
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::setZero, accSSE_top_A,
                             nFrames, boost::placeholders::_1,
@@ -217,6 +301,29 @@ void EnergyFunctional::accumulateAF_MT(MatXX &H, VecX &b, const bool MT) {
 }
 
 void EnergyFunctional::accumulateLF_MT(MatXX &H, VecX &b, const bool MT) {
+  CHECK_GE(nResLinearized.load(), 0);
+  if (nResLinearized == 0) {
+    // same as stitching empty accumulators with usePrior.
+    const int dim = CPARS + 8 * nFrames;
+    H = MatXX::Zero(dim, dim);
+    b = VecX::Zero(dim);
+    H.diagonal().head<CPARS>() = cPrior;
+    b.head<CPARS>() = cPrior.cwiseProduct(cDeltaF.cast<double>());
+    for (int h = 0; h < nFrames; ++h) {
+      H.diagonal().segment<8>(CPARS + h * 8) = frames[h]->prior;
+      b.segment<8>(CPARS + h * 8) =
+          frames[h]->prior.cwiseProduct(frames[h]->delta_prior);
+    }
+
+    for (EFPoint *p : allPoints) {
+      p->Hdd_accLF = 0;
+      p->bd_accLF = 0;
+      p->Hcd_accLF.setZero();
+    }
+    resInL = 0;
+    return;
+  }
+
   if (MT) {
     red->reduce(boost::bind(&AccumulatedTopHessianSSE::setZero, accSSE_top_L,
                             nFrames, boost::placeholders::_1,
@@ -343,6 +450,7 @@ void EnergyFunctional::calcLEnergyPt(int min, int max, Vec10 *stats, int tid) {
   Accumulator11 E;
   E.initialize();
   VecCf dc = cDeltaF;
+  const int patternNum = staticPatternNum[settings.pattern];
 
   for (int i = min; i < max; ++i) {
     EFPoint *p = allPoints[i];
@@ -355,6 +463,9 @@ void EnergyFunctional::calcLEnergyPt(int min, int max, Vec10 *stats, int tid) {
 
       Mat18f dp = adHTdeltaF[r->hostIDX + nFrames * r->targetIDX];
       RawResidualJacobian *rJ = r->J;
+      VecNRf unpacked[RawResidualJacobian::kPatternRows];
+      const VecNRf *JIdx = rJ->patternRows(unpacked) + 1;
+      const VecNRf *JabF = JIdx + 2;
 
       // compute Jp*delta
       float Jp_delta_x_1 = rJ->Jpdxi[0].dot(dp.head<6>()) +
@@ -370,17 +481,13 @@ void EnergyFunctional::calcLEnergyPt(int min, int max, Vec10 *stats, int tid) {
 
       for (int i = 0; i + 3 < patternNum; i += 4) {
         // PATTERN: E = (2*res_toZeroF + J*delta) * J*delta.
-        __m128 Jdelta =
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JIdx)) + i), Jp_delta_x);
+        __m128 Jdelta = _mm_mul_ps(_mm_load_ps(JIdx[0].data() + i), Jp_delta_x);
         Jdelta = _mm_add_ps(
-            Jdelta,
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JIdx + 1)) + i), Jp_delta_y));
+            Jdelta, _mm_mul_ps(_mm_load_ps(JIdx[1].data() + i), Jp_delta_y));
         Jdelta = _mm_add_ps(
-            Jdelta,
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JabF)) + i), delta_a));
+            Jdelta, _mm_mul_ps(_mm_load_ps(JabF[0].data() + i), delta_a));
         Jdelta = _mm_add_ps(
-            Jdelta,
-            _mm_mul_ps(_mm_load_ps(((float *)(rJ->JabF + 1)) + i), delta_b));
+            Jdelta, _mm_mul_ps(_mm_load_ps(JabF[1].data() + i), delta_b));
 
         __m128 r0 = _mm_load_ps(((float *)&r->res_toZeroF) + i);
         r0 = _mm_add_ps(r0, r0);
@@ -389,9 +496,8 @@ void EnergyFunctional::calcLEnergyPt(int min, int max, Vec10 *stats, int tid) {
         E.updateSSENoShift(Jdelta);
       }
       for (int i = ((patternNum >> 2) << 2); i < patternNum; ++i) {
-        float Jdelta = rJ->JIdx[0][i] * Jp_delta_x_1 +
-                       rJ->JIdx[1][i] * Jp_delta_y_1 + rJ->JabF[0][i] * dp[6] +
-                       rJ->JabF[1][i] * dp[7];
+        float Jdelta = JIdx[0][i] * Jp_delta_x_1 + JIdx[1][i] * Jp_delta_y_1 +
+                       JabF[0][i] * dp[6] + JabF[1][i] * dp[7];
         E.updateSingleNoShift(
             (float)(Jdelta * (Jdelta + 2 * r->res_toZeroF[i])));
       }
@@ -414,19 +520,24 @@ double EnergyFunctional::calcLEnergyF_MT() {
 
   E += cDeltaF.cwiseProduct(cPriorF).dot(cDeltaF);
 
-  red->reduce(boost::bind(&EnergyFunctional::calcLEnergyPt, this,
-                          boost::placeholders::_1, boost::placeholders::_2,
-                          boost::placeholders::_3, boost::placeholders::_4),
-              0, allPoints.size(), 50);
+  const Vec10 energies =
+      red->reduce(boost::bind(&EnergyFunctional::calcLEnergyPt, this,
+                              boost::placeholders::_1, boost::placeholders::_2,
+                              boost::placeholders::_3, boost::placeholders::_4),
+                  0, allPoints.size(), 50);
 
-  return E + red->stats[0];
+  return E + energies[0];
 }
 
 EFResidual *EnergyFunctional::insertResidual(PointFrameResidual *r) {
   EFResidual *efr = new EFResidual(r, r->point->efPoint, r->host->efFrame,
                                    r->target->efFrame);
   efr->idxInAll = r->point->efPoint->residualsAll.size();
+  efr->hostIDX = efr->host->idx;
+  efr->targetIDX = efr->target->idx;
   r->point->efPoint->residualsAll.emplace_back(efr);
+  efr->idxInTarget = efr->target->residualsAsTarget.size();
+  efr->target->residualsAsTarget.emplace_back(efr);
 
   connectivityMap[(((uint64_t)efr->host->frameID) << 32) +
                   ((uint64_t)efr->target->frameID)][0]++;
@@ -452,6 +563,7 @@ EFFrame *EnergyFunctional::insertFrame(FrameHessian *fh, CalibHessian *Hcalib) {
   bM.tail<8>().setZero();
   HM.rightCols<8>().setZero();
   HM.bottomRows<8>().setZero();
+  hessianMemory.set((HM.size() + bM.size()) * sizeof(double));
 
   EFIndicesValid = false;
   EFAdjointsValid = false;
@@ -493,6 +605,7 @@ void EnergyFunctional::dropResidual(EFResidual *r) {
   p->residualsAll[r->idxInAll] = p->residualsAll.back();
   p->residualsAll[r->idxInAll]->idxInAll = r->idxInAll;
   p->residualsAll.pop_back();
+  unlinkFromTarget(r);
 
   if (r->isActive()) {
     ++(r->host->data->shell->statistics_goodResOnThis);
@@ -503,15 +616,78 @@ void EnergyFunctional::dropResidual(EFResidual *r) {
   connectivityMap[(((uint64_t)r->host->frameID) << 32) +
                   ((uint64_t)r->target->frameID)][0]--;
   --nResiduals;
+  if (r->isLinearized) {
+    --nResLinearized;
+  }
   r->data->efResidual = 0;
   delete r;
 }
 
+void EnergyFunctional::unlinkFromTarget(EFResidual *r) {
+  std::vector<EFResidual *> &rs = r->target->residualsAsTarget;
+  CHECK_EQ(r, rs[r->idxInTarget]);
+  rs[r->idxInTarget] = rs.back();
+  rs[r->idxInTarget]->idxInTarget = r->idxInTarget;
+  rs.pop_back();
+}
+
+void EnergyFunctional::dropResiduals(const std::vector<EFResidual *> &rs) {
+  if (rs.empty()) {
+    return;
+  }
+
+  FlatHashMap<int> dropsPerPair;
+  std::vector<EFPoint *> points;
+  points.reserve(rs.size());
+  int numLinearized = 0;
+  for (EFResidual *r : rs) {
+    EFPoint *p = r->point;
+    CHECK_EQ(r, p->residualsAll[r->idxInAll]);
+    p->residualsAll[r->idxInAll] = nullptr;
+    points.emplace_back(p);
+    unlinkFromTarget(r);
+
+    if (r->isActive()) {
+      ++(r->host->data->shell->statistics_goodResOnThis);
+    } else {
+      ++(r->host->data->shell->statistics_outlierResOnThis);
+    }
+
+    ++dropsPerPair[(((uint64_t)r->host->frameID) << 32) +
+                   ((uint64_t)r->target->frameID)];
+    if (r->isLinearized) {
+      ++numLinearized;
+    }
+    r->data->efResidual = 0;
+    delete r;
+  }
+
+  for (const FlatHashMap<int>::Slot &drops : dropsPerPair) {
+    connectivityMap[drops.first][0] -= drops.second;
+  }
+  nResiduals -= rs.size();
+  nResLinearized -= numLinearized;
+
+  std::sort(points.begin(), points.end());
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+  for (EFPoint *p : points) {
+    size_t kept = 0;
+    for (EFResidual *r : p->residualsAll) {
+      if (r != nullptr) {
+        r->idxInAll = kept;
+        p->residualsAll[kept++] = r;
+      }
+    }
+    p->residualsAll.resize(kept);
+  }
+}
+
 void EnergyFunctional::marginalizeFrame(EFFrame *fh) {
   CHECK(EFDeltaValid);
   CHECK(EFAdjointsValid);
   CHECK(EFIndicesValid);
   CHECK_EQ(fh->points.size(), 0);
+  CHECK_EQ(fh->residualsAsTarget.size(), 0);
 
   int ndim = nFrames * 8 + CPARS - 8; // new dimension
   int odim = nFrames * 8 + CPARS;     // old dimension
@@ -521,20 +697,24 @@ void EnergyFunctional::marginalizeFrame(EFFrame *fh) {
     int ntail = 8 * (nFrames - fh->idx - 1);
     CHECK_EQ(io + 8 + ntail, nFrames * 8 + CPARS);
 
+    // move the frame block to the end in place: shift the rows inside every
+    // (contiguous) column, then all columns behind it as one range.
     Vec8 bTmp = bM.segment<8>(io);
-    VecX tailTMP = bM.tail(ntail);
-    bM.segment(io, ntail) = tailTMP;
+    std::memmove(bM.data() + io, bM.data() + io + 8, ntail * sizeof(double));
     bM.tail<8>() = bTmp;
 
-    MatXX HtmpCol = HM.block(0, io, odim, 8);
-    MatXX rightColsTmp = HM.rightCols(ntail);
-    HM.block(0, io, odim, ntail) = rightColsTmp;
-    HM.rightCols(8) = HtmpCol;
+    Eigen::Matrix<double, 8, Eigen::Dynamic> HtmpRow = HM.middleRows(io, 8);
+    for (int c = 0; c < odim; ++c) {
+      double *col = HM.data() + (size_t)c * odim;
+      std::memmove(col + io, col + io + 8, ntail * sizeof(double));
+    }
+    HM.bottomRows<8>() = HtmpRow;
 
-    MatXX HtmpRow = HM.block(io, 0, 8, odim);
-    MatXX botRowsTmp = HM.bottomRows(ntail);
-    HM.block(io, 0, ntail, odim) = botRowsTmp;
-    HM.bottomRows(8) = HtmpRow;
+    MatXX HtmpCol = HM.middleCols<8>(io);
+    std::memmove(HM.data() + (size_t)io * odim,
+                 HM.data() + (size_t)(io + 8) * odim,
+                 (size_t)ntail * odim * sizeof(double));
+    HM.rightCols<8>() = HtmpCol;
   }
 
   // marginalize. First add prior here, instead of to active.
@@ -547,35 +727,45 @@ void EnergyFunctional::marginalizeFrame(EFFrame *fh) {
       (HM.diagonal().cwiseAbs() + VecX::Constant(HM.cols(), 10)).cwiseSqrt();
   VecX SVecI = SVec.cwiseInverse();
 
-  // scale!
-  MatXX HMScaled = SVecI.asDiagonal() * HM * SVecI.asDiagonal();
-  VecX bMScaled = SVecI.asDiagonal() * bM;
-
-  // invert bottom part!
-  Mat88 hpi = HMScaled.bottomRightCorner<8, 8>();
-  hpi = 0.5f * (hpi + hpi);
-  hpi = hpi.inverse();
-  hpi = 0.5f * (hpi + hpi);
-
-  // schur-complement!
-  MatXX bli = HMScaled.bottomLeftCorner(8, ndim).transpose() * hpi;
-  HMScaled.topLeftCorner(ndim, ndim).noalias() -=
-      bli * HMScaled.bottomLeftCorner(8, ndim);
-  bMScaled.head(ndim).noalias() -= bli * bMScaled.tail<8>();
-
-  // unscale!
-  HMScaled = SVec.asDiagonal() * HMScaled * SVec.asDiagonal();
-  bMScaled = SVec.asDiagonal() * bMScaled;
+  // scale! (in place, rows then columns)
+  HM.array().colwise() *= SVecI.array();
+  HM.array().rowwise() *= SVecI.transpose().array();
+  bM.array() *= SVecI.array();
+
+  // schur-complement! With the bottom block A = L * L^T, B^T * A^-1 * B is
+  // U * U^T for U^T = L^-1 * B, a rank 8 update of the lower triangle only.
+  // HM is symmetric, the upper triangle is not read until it is set below.
+  const Eigen::LLT<Mat88> hChol(HM.bottomRightCorner<8, 8>());
+  if (hChol.info() == Eigen::Success) {
+    Eigen::Matrix<double, 8, Eigen::Dynamic> Ut = HM.bottomLeftCorner(8, ndim);
+    hChol.matrixL().solveInPlace(Ut);
+    HM.topLeftCorner(ndim, ndim)
+        .selfadjointView<Eigen::Lower>()
+        .rankUpdate(Ut.transpose(), -1);
+    bM.head(ndim).noalias() -=
+        Ut.transpose() * hChol.matrixL().solve(bM.tail<8>());
+  } else {
+    // not positive definite (numerically): the plain inverse.
+    LOG(WARNING) << "marginalizeFrame: frame block is not positive definite.";
+    const Mat88 hpi = HM.bottomRightCorner<8, 8>().inverse();
+    const MatXX bli = HM.bottomLeftCorner(8, ndim).transpose() * hpi;
+    HM.topLeftCorner(ndim, ndim).triangularView<Eigen::Lower>() -=
+        bli * HM.bottomLeftCorner(8, ndim);
+    bM.head(ndim).noalias() -= bli * bM.tail<8>();
+  }
 
-  // set.
-  HM = 0.5 * (HMScaled.topLeftCorner(ndim, ndim) +
-              HMScaled.topLeftCorner(ndim, ndim).transpose());
-  bM = bMScaled.head(ndim);
+  // mirror the lower triangle, unscale and set.
+  MatXX HMNew = HM.topLeftCorner(ndim, ndim).selfadjointView<Eigen::Lower>();
+  HMNew.array().colwise() *= SVec.head(ndim).array();
+  HMNew.array().rowwise() *= SVec.head(ndim).transpose().array();
+  HM.swap(HMNew);
+  bM.array() *= SVec.array();
+  bM.conservativeResize(ndim);
+  hessianMemory.set((HM.size() + bM.size()) * sizeof(double));
 
-  // remove from vector, without changing the order!
+  // remove from vector, without changing the order! makeIDX renumbers them.
   for (unsigned int i = fh->idx; i + 1 < frames.size(); ++i) {
     frames[i] = frames[i + 1];
-    frames[i]->idx = i;
   }
   frames.pop_back();
   --nFrames;
@@ -604,7 +794,7 @@ void EnergyFunctional::marginalizePointsF() {
     for (int i = 0; i < (int)f->points.size(); ++i) {
       EFPoint *p = f->points[i];
       if (p->stateFlag == EFPointStatus::PS_MARGINALIZE) {
-        p->priorF *= setting_idepthFixPriorMargFac;
+        p->priorF *= settings.idepthFixPriorMargFac;
         for (EFResidual *r : p->residualsAll) {
           if (r->isActive()) {
             connectivityMap[(((uint64_t)r->host->frameID) << 32) +
@@ -616,17 +806,44 @@ void EnergyFunctional::marginalizePointsF() {
     }
   }
 
-  accSSE_bot->setZero(nFrames);
-  accSSE_top_A->setZero(nFrames);
-  for (EFPoint *p : allPointsToMarg) {
-    accSSE_top_A->addPoint<2>(p, this);
-    accSSE_bot->addPoint(p, false);
-    removePoint(p);
-  }
+  // the SC pass reads what addPoint<2> wrote into the point, so the top
+  // accumulation has to be finished for all points first.
+  const bool MT = settings.multiThreading && red != nullptr;
   MatXX M, Msc;
   VecX Mb, Mbsc;
-  accSSE_top_A->stitchDouble(M, Mb, this, false, false);
-  accSSE_bot->stitchDouble(Msc, Mbsc, this);
+  if (MT) {
+    red->reduce(boost::bind(&AccumulatedTopHessianSSE::setZero, accSSE_top_A,
+                            nFrames, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, 0, 0);
+    red->reduce(boost::bind(&AccumulatedSCHessianSSE::setZero, accSSE_bot,
+                            nFrames, boost::placeholders::_1,
+                            boost::placeholders::_2, boost::placeholders::_3,
+                            boost::placeholders::_4),
+                0, 0, 0);
+    red->reduce(boost::bind(&AccumulatedTopHessianSSE::addPointsInternal<2>,
+                            accSSE_top_A, &allPointsToMarg, this,
+                            boost::placeholders::_1, boost::placeholders::_2,
+                            boost::placeholders::_3, boost::placeholders::_4),
+                0, allPointsToMarg.size(), 50);
+    red->reduce(boost::bind(&AccumulatedSCHessianSSE::addPointsInternal,
+                            accSSE_bot, &allPointsToMarg, false,
+                            boost::placeholders::_1, boost::placeholders::_2,
+                            boost::placeholders::_3, boost::placeholders::_4),
+                0, allPointsToMarg.size(), 50);
+  } else {
+    accSSE_bot->setZero(nFrames);
+    accSSE_top_A->setZero(nFrames);
+    for (EFPoint *p : allPointsToMarg) {
+      accSSE_top_A->addPoint<2>(p, this);
+      accSSE_bot->addPoint(p, false);
+    }
+  }
+  accSSE_top_A->stitchDoubleMT(red, M, Mb, this, false, MT);
+  accSSE_bot->stitchDoubleMT(red, Msc, Mbsc, this, MT);
+  removePointsFlagged(EFPointStatus::PS_MARGINALIZE);
+  allPointsToMarg.clear();
 
   resInM += accSSE_top_A->nres[0];
 
@@ -634,10 +851,10 @@ void EnergyFunctional::marginalizePointsF() {
   VecX b = Mb - Mbsc;
 
   // By default:
-  // setting_solverMode:             1000 1000 0000
+  // settings.solverMode:             1000 1000 0000
   // SOLVER_ORTHOGONALIZE_POINTMARG: 0000 0000 0100
   // &=                              0000 0000 0000
-  if (setting_solverMode & SOLVER_ORTHOGONALIZE_POINTMARG) {
+  if (settings.solverMode & SOLVER_ORTHOGONALIZE_POINTMARG) {
     // We will never come into this part by default
 
     // have a look if prior is there.
@@ -653,14 +870,14 @@ void EnergyFunctional::marginalizePointsF() {
     }
   }
 
-  HM += setting_margWeightFac * H;
-  bM += setting_margWeightFac * b;
+  HM += settings.margWeightFac * H;
+  bM += settings.margWeightFac * b;
 
   // By default:
-  // setting_solverMode:        1000 1000 0000
+  // settings.solverMode:        1000 1000 0000
   // SOLVER_ORTHOGONALIZE_FULL: 0000 0000 1000
   // &=                         0000 0000 0000
-  if (setting_solverMode & SOLVER_ORTHOGONALIZE_FULL) {
+  if (settings.solverMode & SOLVER_ORTHOGONALIZE_FULL) {
     // We will never come into this part by default
     orthogonalize(&bM, &HM);
   }
@@ -670,30 +887,43 @@ void EnergyFunctional::marginalizePointsF() {
 }
 
 void EnergyFunctional::dropPointsF() {
-  for (EFFrame *f : frames) {
-    for (int i = 0; i < (int)f->points.size(); ++i) {
-      EFPoint *p = f->points[i];
-      if (p->stateFlag == EFPointStatus::PS_DROP) {
-        removePoint(p);
-        --i;
-      }
-    }
-  }
+  removePointsFlagged(EFPointStatus::PS_DROP);
 
   EFIndicesValid = false;
   makeIDX();
 }
 
 void EnergyFunctional::removePoint(EFPoint *p) {
-  for (EFResidual *r : p->residualsAll) {
-    dropResidual(r);
-  }
-
   EFFrame *h = p->host;
   h->points[p->idxInPoints] = h->points.back();
   h->points[p->idxInPoints]->idxInPoints = p->idxInPoints;
   h->points.pop_back();
 
+  deletePoint(p);
+}
+
+void EnergyFunctional::removePointsFlagged(const EFPointStatus flag) {
+  for (EFFrame *f : frames) {
+    size_t kept = 0;
+    for (size_t i = 0; i < f->points.size(); ++i) {
+      EFPoint *p = f->points[i];
+      if (p->stateFlag == flag) {
+        deletePoint(p);
+      } else {
+        p->idxInPoints = kept;
+        f->points[kept++] = p;
+      }
+    }
+    f->points.resize(kept);
+  }
+}
+
+void EnergyFunctional::deletePoint(EFPoint *p) {
+  // drop from the back, so dropResidual never has to move another residual.
+  while (!p->residualsAll.empty()) {
+    dropResidual(p->residualsAll.back());
+  }
+
   --nPoints;
   p->data->efPoint = 0;
 
@@ -714,55 +944,38 @@ void EnergyFunctional::orthogonalize(VecX *b, MatXX *H) {
     N.col(i) = ns[i].normalized();
   }
 
-  // compute Npi := N * (N' * N)^-1 = pseudo inverse of N.
-  Eigen::JacobiSVD<MatXX> svdNN(N, Eigen::ComputeThinU | Eigen::ComputeThinV);
-
-  VecX SNN = svdNN.singularValues();
-  double minSv = 1e10, maxSv = 0;
-  for (int i = 0; i < SNN.size(); ++i) {
-    if (SNN[i] < minSv) {
-      minSv = SNN[i];
-    }
-    if (SNN[i] > maxSv) {
-      maxSv = SNN[i];
-    }
-  }
-  for (int i = 0; i < SNN.size(); ++i) {
-    if (SNN[i] > setting_solverModeDelta * maxSv) {
-      SNN[i] = 1.0 / SNN[i];
-    } else {
-      SNN[i] = 0;
-    }
-  }
-
-  MatXX Npi = svdNN.matrixU() * SNN.asDiagonal() *
-              svdNN.matrixV().transpose();          // [dim] x 9.
-  MatXX NNpiT = N * Npi.transpose();                // [dim] x [dim].
-  MatXX NNpiTS = 0.5 * (NNpiT + NNpiT.transpose()); // = N * (N' * N)^-1 * N'.
+  // the projection N * (N' * N)^-1 * N' onto the nullspaces is Q * Q' for
+  // an orthonormal basis Q of them. Columns that are (nearly) linearly
+  // dependent, below solverModeDelta of the largest, are left out.
+  Eigen::ColPivHouseholderQR<MatXX> qrN(N);
+  qrN.setThreshold(settings.solverModeDelta);
+  const MatXX Q = MatXX(qrN.householderQ()).leftCols(qrN.rank()); // [dim] x r.
 
+  // applied through Q, so this is O(dim^2 * r) instead of two dim^3 products.
   if (b != nullptr) {
-    *b -= NNpiTS * *b;
+    *b -= Q * (Q.transpose() * *b);
   }
   if (H != nullptr) {
-    *H -= NNpiTS * *H * NNpiTS;
+    const MatXX QtHQ = Q.transpose() * *H * Q; // r x r.
+    *H -= Q * QtHQ * Q.transpose();
   }
 }
 
 void EnergyFunctional::solveSystemF(const int iteration, double lambda,
                                     CalibHessian *const HCalib) {
   // By default:
-  // setting_solverMode: 1000 1000 0000
+  // settings.solverMode: 1000 1000 0000
   // SOLVER_USE_GN:      0000 0100 0000
   // &=                  0000 0000 0000
-  if (setting_solverMode & SOLVER_USE_GN) {
+  if (settings.solverMode & SOLVER_USE_GN) {
     lambda = 0;
   }
 
   // By default:
-  // setting_solverMode: 1000 1000 0000
+  // settings.solverMode: 1000 1000 0000
   // SOLVER_FIX_LAMBDA:  0000 1000 0000
   // &=                  0000 1000 0000
-  if (setting_solverMode & SOLVER_FIX_LAMBDA) {
+  if (settings.solverMode & SOLVER_FIX_LAMBDA) {
     // This lambda will be used!
     lambda = 1e-5;
   }
@@ -771,25 +984,28 @@ void EnergyFunctional::solveSystemF(const int iteration, double lambda,
   CHECK(EFAdjointsValid);
   CHECK(EFIndicesValid);
 
+  WallTimer timer;
   MatXX HL_top, HA_top, H_sc;
   VecX bL_top, bA_top, bM_top, b_sc;
 
-  accumulateAF_MT(HA_top, bA_top, multiThreading);
+  accumulateAF_MT(HA_top, bA_top, settings.multiThreading);
 
-  accumulateLF_MT(HL_top, bL_top, multiThreading);
+  accumulateLF_MT(HL_top, bL_top, settings.multiThreading);
 
-  accumulateSCF_MT(H_sc, b_sc, multiThreading);
+  accumulateSCF_MT(H_sc, b_sc, settings.multiThreading);
 
   bM_top = (bM + HM * getStitchedDeltaF());
+  lastAccumulateMs = timer.elapsedMs();
+  timer.reset();
 
   MatXX HFinal_top;
   VecX bFinal_top;
 
   // By default:
-  // setting_solverMode:          1000 1000 0000
+  // settings.solverMode:          1000 1000 0000
   // SOLVER_ORTHOGONALIZE_SYSTEM: 0000 0000 0010
   // &=                           0000 0000 0000
-  if (setting_solverMode & SOLVER_ORTHOGONALIZE_SYSTEM) {
+  if (settings.solverMode & SOLVER_ORTHOGONALIZE_SYSTEM) {
     // We will never come into this part by default
 
     // have a look if prior is there.
@@ -832,10 +1048,10 @@ void EnergyFunctional::solveSystemF(const int iteration, double lambda,
   VecX x;
 
   // By default:
-  // setting_solverMode: 1000 1000 0000
+  // settings.solverMode: 1000 1000 0000
   // SOLVER_SVD:         0000 0000 0001
   // &=                  0000 0000 0000
-  if (setting_solverMode & SOLVER_SVD) {
+  if (settings.solverMode & SOLVER_SVD) {
     // We will never come into this part by default
 
     VecX SVecI = HFinal_top.diagonal().cwiseSqrt().cwiseInverse();
@@ -858,12 +1074,12 @@ void EnergyFunctional::solveSystemF(const int iteration, double lambda,
     VecX Ub = svd.matrixU().transpose() * bFinalScaled;
     int setZero = 0;
     for (int i = 0; i < Ub.size(); ++i) {
-      if (S[i] < setting_solverModeDelta * maxSv) {
+      if (S[i] < settings.solverModeDelta * maxSv) {
         Ub[i] = 0;
         ++setZero;
       }
 
-      if ((setting_solverMode & SOLVER_SVD_CUT7) && (i >= Ub.size() - 7)) {
+      if ((settings.solverMode & SOLVER_SVD_CUT7) && (i >= Ub.size() - 7)) {
         Ub[i] = 0;
         ++setZero;
       } else {
@@ -878,14 +1094,35 @@ void EnergyFunctional::solveSystemF(const int iteration, double lambda,
                      .cwiseSqrt()
                      .cwiseInverse();
     MatXX HFinalScaled = SVecI.asDiagonal() * HFinal_top * SVecI.asDiagonal();
+    VecX bFinalScaled = SVecI.asDiagonal() * bFinal_top;
 
     // SVec.asDiagonal() * svd.matrixV() * Ub;
-    x = SVecI.asDiagonal() *
-        HFinalScaled.ldlt().solve(SVecI.asDiagonal() * bFinal_top);
+    VecX xScaled;
+    // PCG starts from the previous step of this optimize() call (scaled).
+    if ((settings.solverMode & SOLVER_PCG) && iteration > 0 &&
+        lastX.size() == SVecI.size()) {
+      xScaled = lastX.cwiseQuotient(SVecI);
+    }
+    if ((settings.solverMode & SOLVER_PCG) &&
+        pcgSolver->solve(HFinalScaled, bFinalScaled, &xScaled,
+                         settings.multiThreading ? red : nullptr)) {
+      // done.
+    } else if ((settings.solverMode & SOLVER_SPARSE) &&
+               sparseSolver->solve(HFinalScaled, bFinalScaled, &xScaled)) {
+      // done.
+    } else if (settings.solverMode & SOLVER_MIXED_PRECISION) {
+      xScaled = solveMixedPrecision(HFinalScaled, bFinalScaled);
+    } else {
+      xScaled = HFinalScaled.ldlt().solve(bFinalScaled);
+    }
+    lastSolveRelResidual = (HFinalScaled * xScaled - bFinalScaled).norm() /
+                           (1e-20 + bFinalScaled.norm());
+    x = SVecI.asDiagonal() * xScaled;
   }
 
-  if ((setting_solverMode & SOLVER_ORTHOGONALIZE_X) ||
-      (iteration >= 2 && (setting_solverMode & SOLVER_ORTHOGONALIZE_X_LATER))) {
+  if ((settings.solverMode & SOLVER_ORTHOGONALIZE_X) ||
+      (iteration >= 2 &&
+       (settings.solverMode & SOLVER_ORTHOGONALIZE_X_LATER))) {
     VecX xOld = x;
     orthogonalize(&x, 0);
   }
@@ -893,28 +1130,103 @@ void EnergyFunctional::solveSystemF(const int iteration, double lambda,
   lastX = x;
 
   currentLambda = lambda;
-  resubstituteF_MT(x, HCalib, multiThreading);
+  resubstituteF_MT(x, HCalib, settings.multiThreading);
   currentLambda = 0;
+  lastSolveMs = timer.elapsedMs();
 }
 
 void EnergyFunctional::makeIDX() {
+  bool framesMoved = false;
   for (size_t idx = 0; idx < frames.size(); ++idx) {
-    frames[idx]->idx = idx;
+    if (frames[idx]->idx != static_cast<int>(idx)) {
+      frames[idx]->idx = idx;
+      framesMoved = true;
+    }
   }
 
   allPoints.clear();
-
+  allPoints.reserve(nPoints);
   for (EFFrame *f : frames) {
-    for (EFPoint *p : f->points) {
-      allPoints.emplace_back(p);
-      for (EFResidual *r : p->residualsAll) {
-        r->hostIDX = r->host->idx;
-        r->targetIDX = r->target->idx;
-      }
+    allPoints.insert(allPoints.end(), f->points.begin(), f->points.end());
+  }
+
+  if (framesMoved) {
+    if (settings.multiThreading && red != nullptr) {
+      red->reduce(boost::bind(&EnergyFunctional::makeResidualIDX, this,
+                              boost::placeholders::_1, boost::placeholders::_2,
+                              boost::placeholders::_3, boost::placeholders::_4),
+                  0, allPoints.size(), 50);
+    } else {
+      makeResidualIDX(0, allPoints.size(), nullptr, 0);
     }
   }
 
   EFIndicesValid = true;
+  if (settings.validateEF) {
+    checkIndices();
+  }
+}
+
+void EnergyFunctional::makeResidualIDX(const int min, const int max,
+                                       Vec10 *stats, const int tid) {
+  for (int k = min; k < max; ++k) {
+    for (EFResidual *r : allPoints[k]->residualsAll) {
+      r->hostIDX = r->host->idx;
+      r->targetIDX = r->target->idx;
+    }
+  }
+}
+
+void EnergyFunctional::checkIndices() const {
+  CHECK_EQ(static_cast<int>(frames.size()), nFrames);
+  int numPoints = 0, numResiduals = 0, numLinearized = 0;
+  for (size_t idx = 0; idx < frames.size(); ++idx) {
+    const EFFrame *f = frames[idx];
+    CHECK_EQ(f->idx, static_cast<int>(idx));
+    for (size_t i = 0; i < f->points.size(); ++i) {
+      const EFPoint *p = f->points[i];
+      CHECK_EQ(p->host, f);
+      CHECK_EQ(p->idxInPoints, static_cast<int>(i));
+      CHECK_LT(numPoints, static_cast<int>(allPoints.size()));
+      CHECK_EQ(allPoints[numPoints], p);
+      ++numPoints;
+      for (size_t j = 0; j < p->residualsAll.size(); ++j) {
+        const EFResidual *r = p->residualsAll[j];
+        CHECK_EQ(r->point, p);
+        CHECK_EQ(r->idxInAll, static_cast<int>(j));
+        CHECK_EQ(r->host, f);
+        CHECK_EQ(r->hostIDX, f->idx);
+        CHECK_EQ(r->targetIDX, r->target->idx);
+        CHECK_EQ(r->data->efResidual, r);
+        ++numResiduals;
+        if (r->isLinearized) {
+          ++numLinearized;
+        }
+      }
+    }
+  }
+  CHECK_EQ(numPoints, static_cast<int>(allPoints.size()));
+  CHECK_EQ(numPoints, nPoints);
+  CHECK_EQ(numResiduals, nResiduals);
+  CHECK_EQ(numLinearized, nResLinearized.load());
+}
+
+VecX EnergyFunctional::solveMixedPrecision(const MatXX &H,
+                                           const VecX &b) const {
+  const Eigen::LDLT<MatXXf> ldlt(H.cast<float>());
+  VecX x = ldlt.solve(b.cast<float>()).cast<double>();
+  VecX r = b - H * x;
+  for (int i = 0; i < settings.solverRefineSteps; ++i) {
+    x += ldlt.solve(r.cast<float>()).cast<double>();
+    const VecX rNew = b - H * x;
+    // refinement only converges while cond(H) * float eps < 1.
+    if (!(rNew.norm() <= r.norm())) {
+      LOG(WARNING) << "mixed precision refinement diverged, solving in double.";
+      return H.ldlt().solve(b);
+    }
+    r = rNew;
+  }
+  return x;
 }
 
 VecX EnergyFunctional::getStitchedDeltaF() const {
@@ -0,0 +1,134 @@
+#include "optimization_backend/pcg_solver.h"
+
+#include <cmath>
+
+#include <glog/logging.h>
+
+#include "util/settings.h"
+
+namespace dso {
+
+namespace {
+
+//! block b covers rows [blockStart(b), blockStart(b + 1)).
+inline int blockStart(const int b) { return b == 0 ? 0 : CPARS + 8 * (b - 1); }
+
+//! below this dimension a product with H is cheaper than waking the pool.
+const int kMinParallelDim = 256;
+
+}  // namespace
+
+PcgSolver::PcgSolver(const Settings& settings)
+    : lastIterations(0), settings(settings) {}
+
+bool PcgSolver::makePreconditioner(const MatXX& H) {
+  const int nFrames = (H.cols() - CPARS) / 8;
+  blockInv.resize(nFrames);
+
+  const Eigen::LDLT<MatCC> calibLdlt(H.topLeftCorner<CPARS, CPARS>());
+  if (calibLdlt.info() != Eigen::Success || !calibLdlt.isPositive()) {
+    return false;
+  }
+  calibInv = calibLdlt.solve(MatCC::Identity());
+
+  for (int h = 0; h < nFrames; ++h) {
+    const int s = CPARS + 8 * h;
+    const Eigen::LDLT<Mat88> ldlt(H.block<8, 8>(s, s));
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive()) {
+      return false;
+    }
+    blockInv[h] = ldlt.solve(Mat88::Identity());
+  }
+  return true;
+}
+
+void PcgSolver::applyPreconditioner(const VecX& r, VecX* z) const {
+  z->resize(r.size());
+  z->head<CPARS>().noalias() = calibInv * r.head<CPARS>();
+  for (size_t h = 0; h < blockInv.size(); ++h) {
+    const int s = CPARS + 8 * h;
+    z->segment<8>(s).noalias() = blockInv[h] * r.segment<8>(s);
+  }
+}
+
+void PcgSolver::multiplyRows(const MatXX* H, const VecX* p, VecX* y,
+                             int min, int max, Vec10* stats, int tid) const {
+  if (min >= max) {
+    return;
+  }
+  const int r0 = blockStart(min), r1 = blockStart(max);
+  // H is symmetric: use its (contiguous) columns instead of its rows.
+  y->segment(r0, r1 - r0).noalias() =
+      H->middleCols(r0, r1 - r0).transpose() * *p;
+}
+
+void PcgSolver::multiply(const MatXX& H, const VecX& p, VecX* y,
+                         IndexThreadReduce<Vec10>* red) const {
+  y->resize(p.size());
+  const int nBlocks = (H.cols() - CPARS) / 8 + 1;
+  if (red != nullptr && H.cols() >= kMinParallelDim) {
+    red->reduce(boost::bind(&PcgSolver::multiplyRows, this, &H, &p, y,
+                            boost::placeholders::_1, boost::placeholders::_2,
+                            boost::placeholders::_3, boost::placeholders::_4),
+                0, nBlocks, 0);
+  } else {
+    multiplyRows(&H, &p, y, 0, nBlocks, nullptr, 0);
+  }
+}
+
+bool PcgSolver::solve(const MatXX& H, const VecX& b, VecX* x,
+                      IndexThreadReduce<Vec10>* red) {
+  CHECK_EQ(H.rows(), H.cols());
+  CHECK_EQ(H.rows(), b.size());
+  CHECK_EQ((H.cols() - CPARS) % 8, 0);
+
+  lastIterations = 0;
+  if (!makePreconditioner(H)) {
+    LOG(WARNING) << "PCG: diagonal block not positive definite.";
+    return false;
+  }
+
+  const double bNorm = b.norm();
+  VecX xk, r, z, p, Hp;
+
+  // warm start, unless the guess is worse than x = 0.
+  if (x->size() == b.size() && x->allFinite()) {
+    xk = *x;
+    multiply(H, xk, &Hp, red);
+    r = b - Hp;
+  }
+  if (xk.size() != b.size() || !(r.norm() < bNorm)) {
+    xk = VecX::Zero(b.size());
+    r = b;
+  }
+
+  const double tolerance = settings.pcgTolerance * bNorm;
+  applyPreconditioner(r, &z);
+  p = z;
+  double rz = r.dot(z);
+
+  while (lastIterations < settings.pcgMaxIterations && r.norm() > tolerance) {
+    multiply(H, p, &Hp, red);
+    const double pHp = p.dot(Hp);
+    if (!(pHp > 0)) {
+      LOG(WARNING) << "PCG breakdown after " << lastIterations
+                   << " iterations.";
+      return false;
+    }
+
+    const double alpha = rz / pHp;
+    xk += alpha * p;
+    r -= alpha * Hp;
+    ++lastIterations;
+
+    applyPreconditioner(r, &z);
+    const double rzNew = r.dot(z);
+    p = z + (rzNew / rz) * p;
+    rz = rzNew;
+  }
+
+  x->swap(xk);
+  return true;
+}
+
+}  // dso
@@ -0,0 +1,100 @@
+#include "optimization_backend/sparse_schur_solver.h"
+
+#include <algorithm>
+
+#include <Eigen/SparseCore>
+#if defined(HAS_CHOLMOD)
+#include <Eigen/CholmodSupport>
+#else
+#include <Eigen/SparseCholesky>
+#endif
+
+#include <glog/logging.h>
+
+namespace dso {
+
+namespace {
+
+typedef Eigen::SparseMatrix<double> SpMat;
+
+//! block b covers [blockStart(b), blockStart(b + 1)).
+inline int blockStart(const int b) { return b == 0 ? 0 : CPARS + 8 * (b - 1); }
+
+}  // namespace
+
+struct SparseSchurSolver::Factorization {
+#if defined(HAS_CHOLMOD)
+  Eigen::CholmodSupernodalLLT<SpMat, Eigen::Lower> solver;
+#else
+  Eigen::SimplicialLDLT<SpMat, Eigen::Lower> solver;
+#endif
+};
+
+SparseSchurSolver::SparseSchurSolver()
+    : factorization(new Factorization()), lastDim(-1) {}
+
+SparseSchurSolver::~SparseSchurSolver() { delete factorization; }
+
+void SparseSchurSolver::makePattern(const MatXX& H,
+                                    std::vector<bool>* pattern) const {
+  const int nBlocks = (H.cols() - CPARS) / 8 + 1;
+  pattern->assign(nBlocks * nBlocks, false);
+  for (int bj = 0; bj < nBlocks; ++bj) {
+    const int j0 = blockStart(bj), j1 = blockStart(bj + 1);
+    for (int bi = bj; bi < nBlocks; ++bi) {
+      const int i0 = blockStart(bi), i1 = blockStart(bi + 1);
+      (*pattern)[bi * nBlocks + bj] =
+          (H.block(i0, j0, i1 - i0, j1 - j0).array() != 0).any();
+    }
+  }
+}
+
+bool SparseSchurSolver::solve(const MatXX& H, const VecX& b, VecX* x) {
+  CHECK_EQ(H.rows(), H.cols());
+  CHECK_EQ(H.rows(), b.size());
+  CHECK_EQ((H.cols() - CPARS) % 8, 0);
+
+  std::vector<bool> pattern;
+  makePattern(H, &pattern);
+
+  const int dim = H.cols();
+  const int nBlocks = (dim - CPARS) / 8 + 1;
+
+  std::vector<Eigen::Triplet<double>> triplets;
+  for (int bj = 0; bj < nBlocks; ++bj) {
+    const int j0 = blockStart(bj), j1 = blockStart(bj + 1);
+    for (int bi = bj; bi < nBlocks; ++bi) {
+      if (!pattern[bi * nBlocks + bj]) {
+        continue;
+      }
+      const int i0 = blockStart(bi), i1 = blockStart(bi + 1);
+      for (int j = j0; j < j1; ++j) {
+        // lower triangle only, the diagonal blocks are cut at the diagonal.
+        for (int i = std::max(i0, j); i < i1; ++i) {
+          triplets.emplace_back(i, j, H(i, j));
+        }
+      }
+    }
+  }
+
+  SpMat A(dim, dim);
+  A.setFromTriplets(triplets.begin(), triplets.end());
+
+  // the symbolic analysis only depends on the block pattern.
+  if (dim != lastDim || pattern != lastPattern) {
+    factorization->solver.analyzePattern(A);
+    lastDim = dim;
+    lastPattern.swap(pattern);
+  }
+  factorization->solver.factorize(A);
+  if (factorization->solver.info() != Eigen::Success) {
+    LOG(WARNING) << "sparse factorization failed, falling back to dense.";
+    lastDim = -1;
+    return false;
+  }
+
+  *x = factorization->solver.solve(b);
+  return factorization->solver.info() == Eigen::Success;
+}
+
+}  // dso
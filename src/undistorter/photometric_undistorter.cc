@@ -168,6 +168,38 @@ PhotometricUndistorter::~PhotometricUndistorter() {
   delete output_;
 }
 
+void PhotometricUndistorter::ReduceInput(const int reduction) {
+  CHECK(w_ % reduction == 0 && h_ % reduction == 0);
+  const int w = w_ / reduction;
+  const int h = h_ / reduction;
+  // without valid_ the vignette is never read.
+  if (valid_) {
+    float* const map = new float[w * h];
+    float* const mapInv = new float[w * h];
+    for (int y = 0; y < h; ++y) {
+      for (int x = 0; x < w; ++x) {
+        float sum = 0;
+        for (int dy = 0; dy < reduction; ++dy) {
+          for (int dx = 0; dx < reduction; ++dx) {
+            sum += vignette_map_[(x * reduction + dx) +
+                                 (y * reduction + dy) * w_];
+          }
+        }
+        map[x + y * w] = sum / (reduction * reduction);
+        mapInv[x + y * w] = 1.f / map[x + y * w];
+      }
+    }
+    delete[] vignette_map_;
+    delete[] vignette_map_inv_;
+    vignette_map_ = map;
+    vignette_map_inv_ = mapInv;
+  }
+  w_ = w;
+  h_ = h;
+  delete output_;
+  output_ = new ImageAndExposure(w_, h_);
+}
+
 void PhotometricUndistorter::UnMapFloatImage(float* const image) {
   int wh = w_ * h_;
   const float G_depth_float = static_cast<float>(G_depth_);
@@ -187,4 +219,43 @@ void PhotometricUndistorter::UnMapFloatImage(float* const image) {
     image[i] = (BinvC < 0.f ? 0.f : BinvC);
   }
 }
-}  // dso
\ No newline at end of file
+template <>
+void PhotometricUndistorter::ApplyResponse<unsigned char>(
+    const unsigned char* const image_in, const float* const vignette_inv,
+    float* const out) const {
+  const int wh = w_ * h_;
+  int start = 0;
+#if DSO_AVX_DISPATCH
+  if (useAVX2()) {
+    start = wh - wh % 8;
+    ApplyResponse8AVX2(image_in, vignette_inv, out, start);
+  }
+#endif
+
+  if (vignette_inv != nullptr) {
+    for (int i = start; i < wh; ++i) {
+      out[i] = G_[image_in[i]] * vignette_inv[i];
+    }
+  } else {
+    for (int i = start; i < wh; ++i) {
+      out[i] = G_[image_in[i]];
+    }
+  }
+}
+
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX2 void PhotometricUndistorter::ApplyResponse8AVX2(
+    const unsigned char* const image_in, const float* const vignette_inv,
+    float* const out, const int n) const {
+  for (int i = 0; i < n; i += 8) {
+    const __m256i idx = _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(image_in + i)));
+    __m256 val = _mm256_i32gather_ps(G_, idx, 4);
+    if (vignette_inv != nullptr) {
+      val = _mm256_mul_ps(val, _mm256_loadu_ps(vignette_inv + i));
+    }
+    _mm256_storeu_ps(out + i, val);
+  }
+}
+#endif
+}  // dso
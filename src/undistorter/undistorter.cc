@@ -1,15 +1,59 @@
 #include "undistorter/undistorter.h"
 
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <random>
 
+#include "undistorter/undistorter_cuda.h"
 #include "undistorter/undistorter_equidistant.h"
 #include "undistorter/undistorter_fov.h"
 #include "undistorter/undistorter_kb.h"
 #include "undistorter/undistorter_pinhole.h"
 #include "undistorter/undistorter_rad_tan.h"
+#include "util/index_thread_reduce.h"
 
 namespace dso {
 
+namespace {
+
+//! Generator of the noise of the frame at timestamp.
+std::mt19937 NoiseGenerator(const double timestamp) {
+  uint64_t bits;
+  memcpy(&bits, &timestamp, sizeof(bits));
+  std::seed_seq seed{static_cast<uint32_t>(setting_randomSeed),
+                     static_cast<uint32_t>(bits),
+                     static_cast<uint32_t>(bits >> 32)};
+  return std::mt19937(seed);
+}
+
+//! Header of a remap cache file, followed by remap_x_ and remap_y_ (w * h
+//! floats each).
+struct RemapCacheHeader {
+  char magic[8];
+  int32_t version;
+  int32_t w_org, h_org, w, h;
+  int32_t pass_through;
+  double K[9];
+};
+
+const char kRemapCacheMagic[8] = {'D', 'S', 'O', 'R', 'E', 'M', 'A', 'P'};
+const int32_t kRemapCacheVersion = 1;
+
+//! FNV-1a of n bytes, continuing from hash.
+uint64_t HashBytes(const void* const data, const size_t n, uint64_t hash) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < n; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+}  // namespace
+
 Undistorter::~Undistorter() {
   if (remap_x_ != nullptr) {
     delete[] remap_x_;
@@ -17,6 +61,15 @@ Undistorter::~Undistorter() {
   if (remap_y_ != nullptr) {
     delete[] remap_y_;
   }
+  if (remap_offset_ != nullptr) {
+    delete[] remap_offset_;
+  }
+  if (remap_weights_ != nullptr) {
+    delete[] remap_weights_;
+  }
+#if defined(HAS_CUDA)
+  delete gpu_;
+#endif
 }
 
 Undistorter* Undistorter::GetUndistorterForFile(
@@ -126,7 +179,39 @@ void Undistorter::LoadPhotometricCalibration(
                                  image_vignette, size[0], size[1]);
 }
 
-void Undistorter::ApplyBlurNoise(float* const img) const {
+#if defined(HAS_CUDA)
+bool Undistorter::UndistortGPU(const unsigned char* const raw,
+                               ImageAndExposure* result, const float exposure,
+                               const float factor) const {
+  // the noise is drawn on the CPU, per remap coordinate.
+  if (benchmark_varNoise > 0) {
+    return false;
+  }
+  PhotometricUndistorter* const photometric = photometric_undistorter_;
+  if (gpu_ == nullptr) {
+    static const bool available = UndistorterCuda::deviceAvailable();
+    if (!available) {
+      LOG_FIRST_N(WARNING, 1) << "no CUDA device, undistorting on the CPU.";
+      return false;
+    }
+    gpu_ = new UndistorterCuda(
+        w_org_, h_org_, w_, h_, pass_through_ ? nullptr : remap_offset_,
+        pass_through_ ? nullptr : remap_weights_, photometric->GetG(),
+        photometric->GetVignetteInv());
+  }
+
+  // same cases as PhotometricUndistorter::ProcessFrameInto.
+  const bool response = photometric->GetG() != nullptr && exposure > 0.f &&
+                        setting_photometricCalibration != 0;
+  gpu_->process(raw, response, setting_photometricCalibration == 2, factor,
+                result->image);
+  result->exposure_time = setting_useExposure ? exposure : 1.f;
+  return true;
+}
+#endif
+
+void Undistorter::ApplyBlurNoise(float* const img,
+                                 const double timestamp) const {
   CHECK_NOTNULL(img);
   if (benchmark_varBlurNoise == 0.f) {
     return;
@@ -139,11 +224,11 @@ void Undistorter::ApplyBlurNoise(float* const img) const {
   float* const blut_tmp = new float[w_ * h_];
 
   if (benchmark_varBlurNoise > 0) {
+    std::mt19937 rng = NoiseGenerator(timestamp);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
     for (int i = 0; i < num_noise; ++i) {
-      noise_map_x[i] = benchmark_varBlurNoise * (static_cast<float>(rand()) /
-                                                 static_cast<float>(RAND_MAX));
-      noise_map_y[i] = benchmark_varBlurNoise * (static_cast<float>(rand()) /
-                                                 static_cast<float>(RAND_MAX));
+      noise_map_x[i] = benchmark_varBlurNoise * unit(rng);
+      noise_map_y[i] = benchmark_varBlurNoise * unit(rng);
     }
   }
 
@@ -238,7 +323,19 @@ void Undistorter::ApplyBlurNoise(float* const img) const {
   delete[] noise_map_y;
 }
 
-void Undistorter::MakeOptimalKCrop() {
+void Undistorter::DistortCoordinatesMT(float* const in_x, float* const in_y,
+                                       float* const out_x, float* const out_y,
+                                       const int n,
+                                       IndexThreadReduce<Vec10>* red) const {
+  red->reduce(
+      [&](int min, int max, Vec10* stats, int tid) {
+        DistortCoordinates(in_x + min, in_y + min, out_x + min, out_y + min,
+                           max - min);
+      },
+      0, n);
+}
+
+void Undistorter::MakeOptimalKCrop(IndexThreadReduce<Vec10>* red) {
   LOG(WARNING) << "finding CROP optimal new model!";
   K_.setIdentity();
 
@@ -255,7 +352,7 @@ void Undistorter::MakeOptimalKCrop() {
     tg_x[x] = (x - 50000.f) / 10000.f;
     tg_y[x] = 0.f;
   }
-  DistortCoordinates(tg_x, tg_y, tg_x, tg_y, 100000);
+  DistortCoordinatesMT(tg_x, tg_y, tg_x, tg_y, 100000, red);
   for (int x = 0; x < 100000; ++x) {
     if (tg_x[x] > 0 && tg_x[x] < w_org_ - 1) {
       if (min_x == 0.f) {
@@ -268,7 +365,7 @@ void Undistorter::MakeOptimalKCrop() {
     tg_y[y] = (y - 50000.f) / 10000.f;
     tg_x[y] = 0.f;
   }
-  DistortCoordinates(tg_x, tg_y, tg_x, tg_y, 100000);
+  DistortCoordinatesMT(tg_x, tg_y, tg_x, tg_y, 100000, red);
   for (int y = 0; y < 100000; ++y) {
     if (tg_y[y] > 0 && tg_y[y] < h_org_ - 1) {
       if (min_y == 0.f) {
@@ -385,6 +482,9 @@ void Undistorter::ReadFromFile(const char* file_config, const int argc,
   pass_through_ = false;
   remap_x_ = nullptr;
   remap_y_ = nullptr;
+  remap_offset_ = nullptr;
+  remap_weights_ = nullptr;
+  gpu_ = nullptr;
 
   float output_calibration[5];
 
@@ -515,8 +615,43 @@ void Undistorter::ReadFromFile(const char* file_config, const int argc,
   remap_x_ = new float[w_ * h_];
   remap_y_ = new float[w_ * h_];
 
+  std::string cache_path;
+  if (!setting_remapCacheDir.empty()) {
+    std::ifstream calibration(file_config, std::ios::binary);
+    const std::string content((std::istreambuf_iterator<char>(calibration)),
+                              std::istreambuf_iterator<char>());
+    const int32_t sizes[] = {kRemapCacheVersion, argc, w_org_, h_org_, w_,
+                             h_};
+    uint64_t key = HashBytes(content.data(), content.size(),
+                             14695981039346656037ull);
+    key = HashBytes(sizes, sizeof(sizes), key);
+    key = HashBytes(&benchmarkSetting_fxfyfac, sizeof(benchmarkSetting_fxfyfac),
+                    key);
+    char name[64];
+    snprintf(name, sizeof(name), "/remap_%016llx.bin",
+             static_cast<unsigned long long>(key));
+    cache_path = setting_remapCacheDir + name;
+  }
+
+  if (cache_path.empty() || !LoadRemapCache(cache_path)) {
+    MakeRemap(output_calibration);
+    if (!cache_path.empty()) {
+      SaveRemapCache(cache_path);
+    }
+  }
+
+  MakeRemapTable();
+
+  valid_ = true;
+
+  LOG(INFO) << "Rectified Camera Matrix:\n" << K_;
+}
+
+void Undistorter::MakeRemap(const float* const output_calibration) {
+  IndexThreadReduce<Vec10> red;
+
   if (output_calibration[0] == -1) {
-    MakeOptimalKCrop();
+    MakeOptimalKCrop(&red);
   } else if (output_calibration[0] == -2) {
     MakeOptimalKFull();
   } else if (output_calibration[0] == -3) {
@@ -554,15 +689,6 @@ void Undistorter::ReadFromFile(const char* file_config, const int argc,
     pass_through_ = false;
   }
 
-  for (int y = 0; y < h_; ++y) {
-    for (int x = 0; x < w_; ++x) {
-      remap_x_[x + y * w_] = x;
-      remap_y_[x + y * w_] = y;
-    }
-  }
-
-  DistortCoordinates(remap_x_, remap_y_, remap_x_, remap_y_, h_ * w_);
-
   // 原代码逻辑
   // for (int y = 0; y < h_; ++y)
   //   for (int x = 0; x < w_; ++x) {
@@ -592,39 +718,363 @@ void Undistorter::ReadFromFile(const char* file_config, const int argc,
   //     }
   //   }
 
-  for (int y = 0; y < h_; ++y) {
-    for (int x = 0; x < w_; ++x) {
-      // make rounding resistant.
-      float ix = remap_x_[x + y * w_];
-      float iy = remap_y_[x + y * w_];
-
-      if (ix == 0.f) {
-        ix = 0.001f;
-      }
-      if (iy == 0.f) {
-        iy = 0.001f;
-      }
-      if (ix == static_cast<float>(w_org_ - 1)) {
-        ix = static_cast<float>(w_org_) - 1.001f;
-      }
-      if (iy == static_cast<float>(h_org_ - 1)) {
-        iy = static_cast<float>(h_org_) - 1.001f;
+  // rows in chunks: the identity grid, distorted and made rounding resistant.
+  auto makeRows = [&](int min, int max, Vec10* stats, int tid) {
+    for (int y = min; y < max; ++y) {
+      for (int x = 0; x < w_; ++x) {
+        remap_x_[x + y * w_] = x;
+        remap_y_[x + y * w_] = y;
       }
+    }
 
-      // Note: 从这开始和原本代码有些许不同
-      if (ix > 0.f && iy > 0.f && ix < static_cast<float>(w_org_ - 1) &&
-          iy < static_cast<float>(h_org_ - 1)) {
-        remap_x_[x + y * w_] = ix;
-        remap_y_[x + y * w_] = iy;
-      } else {
-        remap_x_[x + y * w_] = -1.f;
-        remap_y_[x + y * w_] = -1.f;
+    DistortCoordinates(remap_x_ + min * w_, remap_y_ + min * w_,
+                       remap_x_ + min * w_, remap_y_ + min * w_,
+                       (max - min) * w_);
+
+    for (int y = min; y < max; ++y) {
+      for (int x = 0; x < w_; ++x) {
+        // make rounding resistant.
+        float ix = remap_x_[x + y * w_];
+        float iy = remap_y_[x + y * w_];
+
+        if (ix == 0.f) {
+          ix = 0.001f;
+        }
+        if (iy == 0.f) {
+          iy = 0.001f;
+        }
+        if (ix == static_cast<float>(w_org_ - 1)) {
+          ix = static_cast<float>(w_org_) - 1.001f;
+        }
+        if (iy == static_cast<float>(h_org_ - 1)) {
+          iy = static_cast<float>(h_org_) - 1.001f;
+        }
+
+        // Note: 从这开始和原本代码有些许不同
+        if (ix > 0.f && iy > 0.f && ix < static_cast<float>(w_org_ - 1) &&
+            iy < static_cast<float>(h_org_ - 1)) {
+          remap_x_[x + y * w_] = ix;
+          remap_y_[x + y * w_] = iy;
+        } else {
+          remap_x_[x + y * w_] = -1.f;
+          remap_y_[x + y * w_] = -1.f;
+        }
       }
     }
+  };
+  red.reduce(makeRows, 0, h_, 8);
+}
+
+bool Undistorter::LoadRemapCache(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if (!in.good()) {
+    return false;
   }
 
-  valid_ = true;
+  RemapCacheHeader header;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in.good() ||
+      memcmp(header.magic, kRemapCacheMagic, sizeof(header.magic)) != 0 ||
+      header.version != kRemapCacheVersion || header.w_org != w_org_ ||
+      header.h_org != h_org_ || header.w != w_ || header.h != h_) {
+    LOG(WARNING) << "Ignoring remap cache " << path << ", it does not fit.";
+    return false;
+  }
+  in.read(reinterpret_cast<char*>(remap_x_), sizeof(float) * w_ * h_);
+  in.read(reinterpret_cast<char*>(remap_y_), sizeof(float) * w_ * h_);
+  if (!in.good()) {
+    LOG(WARNING) << "Ignoring remap cache " << path << ", it is truncated.";
+    return false;
+  }
 
-  LOG(INFO) << "Rectified Camera Matrix:\n" << K_;
+  K_ = Eigen::Map<const Mat33>(header.K);
+  pass_through_ = header.pass_through != 0;
+  LOG(INFO) << "Remap loaded from " << path;
+  return true;
+}
+
+void Undistorter::SaveRemapCache(const std::string& path) const {
+  RemapCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kRemapCacheMagic, sizeof(header.magic));
+  header.version = kRemapCacheVersion;
+  header.w_org = w_org_;
+  header.h_org = h_org_;
+  header.w = w_;
+  header.h = h_;
+  header.pass_through = pass_through_;
+  Eigen::Map<Mat33>(header.K) = K_;
+
+  // written aside and renamed, a crash never leaves a partial cache.
+  const std::string tmp_path = path + ".tmp";
+  std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(remap_x_), sizeof(float) * w_ * h_);
+  out.write(reinterpret_cast<const char*>(remap_y_), sizeof(float) * w_ * h_);
+  out.close();
+  if (!out.good() || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(WARNING) << "Cannot write remap cache " << path;
+    remove(tmp_path.c_str());
+    return;
+  }
+  LOG(INFO) << "Remap saved to " << path;
+}
+
+int Undistorter::GetMaxInputReduction() const {
+  int reduction = 1;
+  while (reduction < 8 && w_org_ % (2 * reduction) == 0 &&
+         h_org_ % (2 * reduction) == 0 && w_org_ / (2 * reduction) >= w_ &&
+         h_org_ / (2 * reduction) >= h_) {
+    reduction *= 2;
+  }
+  return reduction;
+}
+
+bool Undistorter::ReduceInput(const int reduction) {
+  if (reduction == 1) {
+    return true;
+  }
+  if (pass_through_ || (reduction != 2 && reduction != 4 && reduction != 8) ||
+      w_org_ % reduction != 0 || h_org_ % reduction != 0) {
+    LOG(WARNING) << "Cannot reduce the input of " << w_org_ << " x " << h_org_
+                 << " by " << reduction << ".";
+    return false;
+  }
+
+  w_org_ /= reduction;
+  h_org_ /= reduction;
+  // pixel centers: x in the full input is (x + 0.5) / reduction - 0.5 in the
+  // reduced one. Kept off the border like in MakeRemap.
+  const float scale = 1.f / reduction;
+  const float maxX = static_cast<float>(w_org_) - 1.001f;
+  const float maxY = static_cast<float>(h_org_) - 1.001f;
+  for (int idx = 0; idx < w_ * h_; ++idx) {
+    if (remap_x_[idx] < 0) {
+      continue;
+    }
+    remap_x_[idx] = std::min(
+        maxX, std::max(0.001f, (remap_x_[idx] + 0.5f) * scale - 0.5f));
+    remap_y_[idx] = std::min(
+        maxY, std::max(0.001f, (remap_y_[idx] + 0.5f) * scale - 0.5f));
+  }
+  MakeRemapTable();
+  if (photometric_undistorter_ != nullptr) {
+    photometric_undistorter_->ReduceInput(reduction);
+  }
+#if defined(HAS_CUDA)
+  // made again for the new remap on first use.
+  delete gpu_;
+  gpu_ = nullptr;
+#endif
+
+  LOG(INFO) << "Undistorting from input reduced by " << reduction << " to "
+            << w_org_ << " x " << h_org_ << ".";
+  return true;
+}
+
+void Undistorter::MakeRemapTable() {
+  const int wh = w_ * h_;
+  delete[] remap_offset_;
+  delete[] remap_weights_;
+  remap_offset_ = new int[wh];
+  remap_weights_ = new float[4 * wh];
+  float* const w00 = remap_weights_;
+  float* const w10 = remap_weights_ + wh;
+  float* const w01 = remap_weights_ + 2 * wh;
+  float* const w11 = remap_weights_ + 3 * wh;
+
+  for (int idx = 0; idx < wh; ++idx) {
+    float xx = remap_x_[idx];
+    float yy = remap_y_[idx];
+    if (xx < 0) {
+      remap_offset_[idx] = -1;
+      w00[idx] = w10[idx] = w01[idx] = w11[idx] = 0.f;
+      continue;
+    }
+
+    // get integer and rational parts
+    const int xxi = static_cast<int>(xx);
+    const int yyi = static_cast<int>(yy);
+    xx -= static_cast<float>(xxi);
+    yy -= static_cast<float>(yyi);
+    const float xxyy = xx * yy;
+
+    remap_offset_[idx] = xxi + yyi * w_org_;
+    w00[idx] = 1 - xx - yy + xxyy;
+    w10[idx] = xx - xxyy;
+    w01[idx] = yy - xxyy;
+    w11[idx] = xxyy;
+  }
+}
+
+void Undistorter::Remap(const float* const in, float* const out) const {
+  int start = 0;
+#if DSO_AVX_DISPATCH
+  if (useAVX2()) {
+    RemapAVX2(in, out);
+    start = (w_ * h_) - (w_ * h_) % 8;
+  }
+#elif DSO_NEON
+  if (useNEON()) {
+    RemapNEON(in, out);
+    start = (w_ * h_) - (w_ * h_) % 4;
+  }
+#endif
+
+  const int wh = w_ * h_;
+  const float* const w00 = remap_weights_;
+  const float* const w10 = remap_weights_ + wh;
+  const float* const w01 = remap_weights_ + 2 * wh;
+  const float* const w11 = remap_weights_ + 3 * wh;
+  for (int idx = start; idx < wh; ++idx) {
+    if (remap_offset_[idx] < 0) {
+      out[idx] = 0.f;
+      continue;
+    }
+    const float* src = in + remap_offset_[idx];
+    out[idx] = w11[idx] * src[1 + w_org_] + w01[idx] * src[w_org_] +
+               w10[idx] * src[1] + w00[idx] * src[0];
+  }
+}
+
+#if DSO_NEON
+void Undistorter::RemapNEON(const float* const in, float* const out) const {
+  const int wh = w_ * h_;
+  const int n = wh - wh % 4;
+  const float* const w00 = remap_weights_;
+  const float* const w10 = remap_weights_ + wh;
+  const float* const w01 = remap_weights_ + 2 * wh;
+  const float* const w11 = remap_weights_ + 3 * wh;
+
+  for (int idx = 0; idx < n; idx += 4) {
+    // no gather: the two horizontal neighbours of a pixel are one 2 lane
+    // load, unzipping four of them gives the left and the right taps.
+    // invalid pixels read pixel 0 and are set to 0 at the end.
+    const int32x4_t off = vld1q_s32(remap_offset_ + idx);
+    const int32x4_t safe = vmaxq_s32(off, vdupq_n_s32(0));
+    const float* const s0 = in + vgetq_lane_s32(safe, 0);
+    const float* const s1 = in + vgetq_lane_s32(safe, 1);
+    const float* const s2 = in + vgetq_lane_s32(safe, 2);
+    const float* const s3 = in + vgetq_lane_s32(safe, 3);
+    const float32x4_t top01 = vcombine_f32(vld1_f32(s0), vld1_f32(s1));
+    const float32x4_t top23 = vcombine_f32(vld1_f32(s2), vld1_f32(s3));
+    const float32x4_t bot01 =
+        vcombine_f32(vld1_f32(s0 + w_org_), vld1_f32(s1 + w_org_));
+    const float32x4_t bot23 =
+        vcombine_f32(vld1_f32(s2 + w_org_), vld1_f32(s3 + w_org_));
+
+    float32x4_t res = vmulq_f32(vld1q_f32(w11 + idx), vuzp2q_f32(bot01, bot23));
+    res = vfmaq_f32(res, vld1q_f32(w01 + idx), vuzp1q_f32(bot01, bot23));
+    res = vfmaq_f32(res, vld1q_f32(w10 + idx), vuzp2q_f32(top01, top23));
+    res = vfmaq_f32(res, vld1q_f32(w00 + idx), vuzp1q_f32(top01, top23));
+    const uint32x4_t invalid = vcltq_s32(off, vdupq_n_s32(0));
+    vst1q_f32(out + idx, vbslq_f32(invalid, vdupq_n_f32(0.f), res));
+  }
+}
+#endif
+
+#if DSO_AVX_DISPATCH
+DSO_TARGET_AVX2 void Undistorter::RemapAVX2(const float* const in,
+                                            float* const out) const {
+  const int wh = w_ * h_;
+  const int n = wh - wh % 8;
+  const float* const w00 = remap_weights_;
+  const float* const w10 = remap_weights_ + wh;
+  const float* const w01 = remap_weights_ + 2 * wh;
+  const float* const w11 = remap_weights_ + 3 * wh;
+  const float* const in10 = in + 1;
+  const float* const in01 = in + w_org_;
+  const float* const in11 = in + w_org_ + 1;
+
+  const __m256 zero = _mm256_setzero_ps();
+  for (int idx = 0; idx < n; idx += 8) {
+    const __m256i off = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(remap_offset_ + idx));
+    // invalid pixels (offset -1) load nothing and keep 0, times 0 weights.
+    const __m256 valid = _mm256_castsi256_ps(
+        _mm256_cmpgt_epi32(off, _mm256_set1_epi32(-1)));
+    const __m256 p00 = _mm256_mask_i32gather_ps(zero, in, off, valid, 4);
+    const __m256 p10 = _mm256_mask_i32gather_ps(zero, in10, off, valid, 4);
+    const __m256 p01 = _mm256_mask_i32gather_ps(zero, in01, off, valid, 4);
+    const __m256 p11 = _mm256_mask_i32gather_ps(zero, in11, off, valid, 4);
+    const __m256 res = _mm256_add_ps(
+        _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(w11 + idx), p11),
+                          _mm256_mul_ps(_mm256_loadu_ps(w01 + idx), p01)),
+            _mm256_mul_ps(_mm256_loadu_ps(w10 + idx), p10)),
+        _mm256_mul_ps(_mm256_loadu_ps(w00 + idx), p00));
+    _mm256_storeu_ps(out + idx, res);
+  }
+}
+#endif
+
+void Undistorter::RemapWithNoise(const float* const in, float* const out,
+                                 const double timestamp) const {
+  const int num_noise =
+      (benchmark_noiseGridsize + 8) * (benchmark_noiseGridsize + 8);
+  float* const noise_map_x = new float[num_noise];
+  float* const noise_map_y = new float[num_noise];
+
+  std::mt19937 rng = NoiseGenerator(timestamp);
+  std::uniform_real_distribution<float> unit(-0.5f, 0.5f);
+  for (int i = 0; i < num_noise; ++i) {
+    noise_map_x[i] = 2.f * benchmark_varNoise * unit(rng);
+    noise_map_y[i] = 2.f * benchmark_varNoise * unit(rng);
+  }
+
+  for (int idx = w_ * h_ - 1; idx >= 0; --idx) {
+    // get interp. values
+    float xx = remap_x_[idx];
+    float yy = remap_y_[idx];
+
+    const float delta_x = getInterpolatedElement11BiCub(
+        noise_map_x,
+        4.f + (xx / static_cast<float>(w_org_)) * benchmark_noiseGridsize,
+        4.f + (yy / static_cast<float>(h_org_)) * benchmark_noiseGridsize,
+        benchmark_noiseGridsize + 8);
+    const float delta_y = getInterpolatedElement11BiCub(
+        noise_map_y,
+        4.f + (xx / static_cast<float>(w_org_)) * benchmark_noiseGridsize,
+        4.f + (yy / static_cast<float>(h_org_)) * benchmark_noiseGridsize,
+        benchmark_noiseGridsize + 8);
+    float x = idx % w_ + delta_x;
+    float y = idx / w_ + delta_y;
+    if (x < 0.01f) {
+      x = 0.01f;
+    }
+    if (y < 0.01f) {
+      y = 0.01f;
+    }
+    if (x > static_cast<float>(w_) - 1.01f) {
+      x = static_cast<float>(w_) - 1.01f;
+    }
+    if (y > static_cast<float>(h_) - 1.01f) {
+      y = static_cast<float>(h_) - 1.01f;
+    }
+
+    xx = getInterpolatedElement(remap_x_, x, y, w_);
+    yy = getInterpolatedElement(remap_y_, x, y, w_);
+
+    if (xx < 0) {
+      out[idx] = 0.f;
+    } else {
+      // get integer and rational parts
+      const int xxi = static_cast<int>(xx);
+      const int yyi = static_cast<int>(yy);
+      xx -= static_cast<float>(xxi);
+      yy -= static_cast<float>(yyi);
+      const float xxyy = xx * yy;
+
+      // get array base pointer
+      const float* src = in + xxi + yyi * w_org_;
+
+      // interpolate (bilinear)
+      out[idx] = xxyy * src[1 + w_org_] + (yy - xxyy) * src[w_org_] +
+                 (xx - xxyy) * src[1] + (1 - xx - yy + xxyy) * src[0];
+    }
+  }
+
+  delete[] noise_map_x;
+  delete[] noise_map_y;
 }
 }
@@ -0,0 +1,168 @@
+#include "undistorter/undistorter_cuda.h"
+
+#include <algorithm>
+
+#include "util/cuda_check.h"
+
+namespace dso {
+
+namespace {
+
+const int kThreads = 256;
+
+//! PhotometricUndistorter::ProcessFrameInto of an 8 bit image.
+__global__ void responseKernel(const unsigned char* __restrict__ raw,
+                               const float* __restrict__ G,
+                               const float* __restrict__ vignetteInv,
+                               float factor, float* __restrict__ out, int n) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < n;
+       i += blockDim.x * gridDim.x) {
+    if (G == nullptr) {
+      out[i] = factor * raw[i];
+    } else if (vignetteInv == nullptr) {
+      out[i] = G[raw[i]];
+    } else {
+      out[i] = G[raw[i]] * vignetteInv[i];
+    }
+  }
+}
+
+//! Undistorter::Remap, explicitly rounded so nvcc does not contract to fma.
+__global__ void remapKernel(const float* __restrict__ in,
+                            const int* __restrict__ offset,
+                            const float* __restrict__ weights,
+                            float* __restrict__ out, int wh, int wOrg) {
+  const float* w00 = weights;
+  const float* w10 = weights + wh;
+  const float* w01 = weights + 2 * wh;
+  const float* w11 = weights + 3 * wh;
+  for (int idx = blockIdx.x * blockDim.x + threadIdx.x; idx < wh;
+       idx += blockDim.x * gridDim.x) {
+    if (offset[idx] < 0) {
+      out[idx] = 0.f;
+      continue;
+    }
+    const float* src = in + offset[idx];
+    float v = __fadd_rn(__fmul_rn(w11[idx], src[1 + wOrg]),
+                        __fmul_rn(w01[idx], src[wOrg]));
+    v = __fadd_rn(v, __fmul_rn(w10[idx], src[1]));
+    out[idx] = __fadd_rn(v, __fmul_rn(w00[idx], src[0]));
+  }
+}
+
+}  // namespace
+
+struct UndistorterCuda::Impl {
+  int wOrg, hOrg, w, h;
+  unsigned char* raw;
+  // photometrically corrected input, nullptr for pass through.
+  float* corrected;
+  float* out;
+  int* remapOffset;
+  float* remapWeights;
+  float* G;
+  float* vignetteInv;
+  cudaStream_t stream;
+  int maxBlocks;
+};
+
+UndistorterCuda::UndistorterCuda(int wOrg, int hOrg, int w, int h,
+                                 const int* remapOffset,
+                                 const float* remapWeights, const float* G,
+                                 const float* vignetteInv)
+    : impl(new Impl()) {
+  impl->wOrg = wOrg;
+  impl->hOrg = hOrg;
+  impl->w = w;
+  impl->h = h;
+  impl->corrected = nullptr;
+  impl->remapOffset = nullptr;
+  impl->remapWeights = nullptr;
+  impl->G = nullptr;
+  impl->vignetteInv = nullptr;
+
+  const size_t whOrg = static_cast<size_t>(wOrg) * hOrg;
+  const size_t wh = static_cast<size_t>(w) * h;
+  CUDA_CHECK(cudaMalloc(&impl->raw, whOrg));
+  CUDA_CHECK(cudaMalloc(&impl->out, wh * sizeof(float)));
+  if (remapOffset != nullptr) {
+    CUDA_CHECK(cudaMalloc(&impl->corrected, whOrg * sizeof(float)));
+    CUDA_CHECK(cudaMalloc(&impl->remapOffset, wh * sizeof(int)));
+    CUDA_CHECK(cudaMalloc(&impl->remapWeights, 4 * wh * sizeof(float)));
+    CUDA_CHECK(cudaMemcpy(impl->remapOffset, remapOffset, wh * sizeof(int),
+                          cudaMemcpyHostToDevice));
+    CUDA_CHECK(cudaMemcpy(impl->remapWeights, remapWeights,
+                          4 * wh * sizeof(float), cudaMemcpyHostToDevice));
+  } else {
+    CHECK_EQ(static_cast<size_t>(wh), whOrg);
+  }
+  if (G != nullptr) {
+    CUDA_CHECK(cudaMalloc(&impl->G, 256 * sizeof(float)));
+    CUDA_CHECK(
+        cudaMemcpy(impl->G, G, 256 * sizeof(float), cudaMemcpyHostToDevice));
+  }
+  if (vignetteInv != nullptr) {
+    CUDA_CHECK(cudaMalloc(&impl->vignetteInv, whOrg * sizeof(float)));
+    CUDA_CHECK(cudaMemcpy(impl->vignetteInv, vignetteInv,
+                          whOrg * sizeof(float), cudaMemcpyHostToDevice));
+  }
+  CUDA_CHECK(cudaStreamCreate(&impl->stream));
+
+  int device, sms;
+  CUDA_CHECK(cudaGetDevice(&device));
+  CUDA_CHECK(
+      cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device));
+  impl->maxBlocks = 4 * sms;
+}
+
+UndistorterCuda::~UndistorterCuda() {
+  cudaFree(impl->raw);
+  cudaFree(impl->corrected);
+  cudaFree(impl->out);
+  cudaFree(impl->remapOffset);
+  cudaFree(impl->remapWeights);
+  cudaFree(impl->G);
+  cudaFree(impl->vignetteInv);
+  cudaStreamDestroy(impl->stream);
+  delete impl;
+}
+
+bool UndistorterCuda::deviceAvailable() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+void UndistorterCuda::process(const unsigned char* raw, bool response,
+                              bool vignette, float factor, float* out) {
+  const int whOrg = impl->wOrg * impl->hOrg;
+  const int wh = impl->w * impl->h;
+  CHECK(!response || impl->G != nullptr);
+  CUDA_CHECK(cudaMemcpyAsync(impl->raw, raw, whOrg, cudaMemcpyHostToDevice,
+                             impl->stream));
+
+  // pass through: the corrected image is the output.
+  float* corrected =
+      impl->remapOffset != nullptr ? impl->corrected : impl->out;
+  int blocks =
+      std::max(1, std::min(impl->maxBlocks, (whOrg + kThreads - 1) / kThreads));
+  responseKernel<<<blocks, kThreads, 0, impl->stream>>>(
+      impl->raw, response ? impl->G : nullptr,
+      response && vignette ? impl->vignetteInv : nullptr, factor, corrected,
+      whOrg);
+  CUDA_CHECK(cudaGetLastError());
+
+  if (impl->remapOffset != nullptr) {
+    blocks =
+        std::max(1, std::min(impl->maxBlocks, (wh + kThreads - 1) / kThreads));
+    remapKernel<<<blocks, kThreads, 0, impl->stream>>>(
+        impl->corrected, impl->remapOffset, impl->remapWeights, impl->out, wh,
+        impl->wOrg);
+    CUDA_CHECK(cudaGetLastError());
+  }
+
+  CUDA_CHECK(cudaMemcpyAsync(out, impl->out, wh * sizeof(float),
+                             cudaMemcpyDeviceToHost, impl->stream));
+  CUDA_CHECK(cudaStreamSynchronize(impl->stream));
+}
+
+}  // dso
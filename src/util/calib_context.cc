@@ -0,0 +1,81 @@
+#include "util/calib_context.h"
+
+#include <glog/logging.h>
+
+namespace dso {
+
+CalibContext::CalibContext() : pyrLevelsUsed(0), wM3(0), hM3(0) {
+  for (int level = 0; level < PYR_LEVELS; ++level) {
+    w[level] = h[level] = 0;
+  }
+}
+
+CalibContext::CalibContext(const int w, const int h, const Eigen::Matrix3f& K,
+                           const int maxLevels) {
+  LOG_IF(FATAL, maxLevels < 1 || maxLevels > PYR_LEVELS)
+      << "Int.PyrLevels " << maxLevels << " is not in [1, " << PYR_LEVELS
+      << "].";
+  int wlvl = w;
+  int hlvl = h;
+  pyrLevelsUsed = 1;
+  while (wlvl % 2 == 0 && hlvl % 2 == 0 && wlvl * hlvl > 5000 &&
+         pyrLevelsUsed < maxLevels) {
+    wlvl /= 2;
+    hlvl /= 2;
+    ++pyrLevelsUsed;
+  }
+  LOG(INFO) << "using pyramid levels 0 to " << pyrLevelsUsed - 1
+            << ". coarsest resolution: " << wlvl << " x " << hlvl << "!";
+  if (wlvl > 100 && hlvl > 100) {
+    LOG(WARNING) << "===============WARNING!===============\n "
+                    "Using not enough pyramid levels. Consider scaling to a "
+                    "resolution that is a multiple of a power of 2.";
+  }
+  if (pyrLevelsUsed < 3) {
+    LOG(WARNING)
+        << "===============WARNING!===============\n "
+           "I need higher resolution, or I will probably segmentation fault.";
+  }
+
+  wM3 = w - 3;
+  hM3 = h - 3;
+
+  this->w[0] = w;
+  this->h[0] = h;
+  this->K[0] = K;
+  fx[0] = K(0, 0);
+  fy[0] = K(1, 1);
+  cx[0] = K(0, 2);
+  cy[0] = K(1, 2);
+  Ki[0] = K.inverse();
+  fxi[0] = Ki[0](0, 0);
+  fyi[0] = Ki[0](1, 1);
+  cxi[0] = Ki[0](0, 2);
+  cyi[0] = Ki[0](1, 2);
+
+  for (int level = 1; level < PYR_LEVELS; ++level) {
+    if (level >= pyrLevelsUsed) {
+      this->w[level] = this->h[level] = 0;
+      continue;
+    }
+    this->w[level] = w >> level;
+    this->h[level] = h >> level;
+
+    fx[level] = fx[level - 1] * 0.5f;
+    fy[level] = fy[level - 1] * 0.5f;
+    cx[level] = (cx[0] + 0.5f) / (1 << level) - 0.5f;
+    cy[level] = (cy[0] + 0.5f) / (1 << level) - 0.5f;
+
+    // synthetic
+    this->K[level] << fx[level], 0.f, cx[level], 0.f, fy[level], cy[level],
+        0.f, 0.f, 1.f;
+    Ki[level] = this->K[level].inverse();
+
+    fxi[level] = Ki[level](0, 0);
+    fyi[level] = Ki[level](1, 1);
+    cxi[level] = Ki[level](0, 2);
+    cyi[level] = Ki[level](1, 2);
+  }
+}
+
+}  // dso
@@ -0,0 +1,235 @@
+#include "util/camera_source.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace dso {
+
+#if defined(__linux__)
+
+namespace {
+
+int xioctl(const int fd, const unsigned long request, void* arg) {
+  int r;
+  do {
+    r = ioctl(fd, request, arg);
+  } while (r == -1 && errno == EINTR);
+  return r;
+}
+
+}  // namespace
+
+V4L2CameraSource::V4L2CameraSource(const std::string& device, const int w,
+                                   const int h, const int numBuffers)
+    : device_(device), w_(w), h_(h), fd_(-1) {
+  fd_ = open(device.c_str(), O_RDWR);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Could not open " << device << ": " << strerror(errno);
+    return;
+  }
+
+  v4l2_format format;
+  memset(&format, 0, sizeof(format));
+  format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  format.fmt.pix.width = w;
+  format.fmt.pix.height = h;
+  format.fmt.pix.pixelformat = V4L2_PIX_FMT_GREY;
+  format.fmt.pix.field = V4L2_FIELD_NONE;
+  if (xioctl(fd_, VIDIOC_S_FMT, &format) < 0 ||
+      format.fmt.pix.pixelformat != V4L2_PIX_FMT_GREY ||
+      static_cast<int>(format.fmt.pix.width) != w ||
+      static_cast<int>(format.fmt.pix.height) != h ||
+      static_cast<int>(format.fmt.pix.bytesperline) != w) {
+    LOG(ERROR) << device << " does not deliver unpadded " << w << " x " << h
+               << " GREY frames.";
+    Close();
+    return;
+  }
+
+  v4l2_requestbuffers request;
+  memset(&request, 0, sizeof(request));
+  request.count = numBuffers;
+  request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  request.memory = V4L2_MEMORY_MMAP;
+  if (xioctl(fd_, VIDIOC_REQBUFS, &request) < 0 || request.count < 1) {
+    LOG(ERROR) << device << " has no mmap streaming: " << strerror(errno);
+    Close();
+    return;
+  }
+
+  for (unsigned int i = 0; i < request.count; ++i) {
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = i;
+    if (xioctl(fd_, VIDIOC_QUERYBUF, &buf) < 0) {
+      LOG(ERROR) << "VIDIOC_QUERYBUF on " << device << ": " << strerror(errno);
+      Close();
+      return;
+    }
+    void* mapped = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd_, buf.m.offset);
+    if (mapped == MAP_FAILED) {
+      LOG(ERROR) << "mmap of " << device << ": " << strerror(errno);
+      Close();
+      return;
+    }
+    mapped_.emplace_back(mapped);
+    mapped_size_.emplace_back(buf.length);
+    if (xioctl(fd_, VIDIOC_QBUF, &buf) < 0) {
+      LOG(ERROR) << "VIDIOC_QBUF on " << device << ": " << strerror(errno);
+      Close();
+      return;
+    }
+  }
+
+  v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  if (xioctl(fd_, VIDIOC_STREAMON, &type) < 0) {
+    LOG(ERROR) << "VIDIOC_STREAMON on " << device << ": " << strerror(errno);
+    Close();
+    return;
+  }
+  LOG(INFO) << "Streaming " << w << " x " << h << " from " << device
+            << " through " << mapped_.size() << " buffers.";
+}
+
+V4L2CameraSource::~V4L2CameraSource() { Close(); }
+
+void V4L2CameraSource::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  xioctl(fd_, VIDIOC_STREAMOFF, &type);
+  for (size_t i = 0; i < mapped_.size(); ++i) {
+    munmap(mapped_[i], mapped_size_[i]);
+  }
+  mapped_.clear();
+  mapped_size_.clear();
+  close(fd_);
+  fd_ = -1;
+}
+
+bool V4L2CameraSource::Acquire(Buffer* const buffer) {
+  CHECK_NOTNULL(buffer);
+  if (fd_ < 0) {
+    return false;
+  }
+  v4l2_buffer buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  if (xioctl(fd_, VIDIOC_DQBUF, &buf) < 0) {
+    LOG(ERROR) << "VIDIOC_DQBUF on " << device_ << ": " << strerror(errno);
+    return false;
+  }
+  CHECK_LT(buf.index, mapped_.size());
+  CHECK_GE(buf.bytesused, static_cast<unsigned int>(w_ * h_));
+
+  buffer->data = static_cast<const unsigned char*>(mapped_[buf.index]);
+  buffer->w = w_;
+  buffer->h = h_;
+  buffer->timestamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec * 1e-6;
+  buffer->exposure = 0;
+  buffer->index = buf.index;
+  return true;
+}
+
+void V4L2CameraSource::Release(const Buffer& buffer) {
+  if (fd_ < 0) {
+    return;
+  }
+  v4l2_buffer buf;
+  memset(&buf, 0, sizeof(buf));
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index = buffer.index;
+  LOG_IF(ERROR, xioctl(fd_, VIDIOC_QBUF, &buf) < 0)
+      << "VIDIOC_QBUF on " << device_ << ": " << strerror(errno);
+}
+
+#else
+
+V4L2CameraSource::V4L2CameraSource(const std::string& device, const int w,
+                                   const int h, const int numBuffers)
+    : device_(device), w_(w), h_(h), fd_(-1) {
+  LOG(ERROR) << "V4L2 is only supported on linux.";
+}
+
+V4L2CameraSource::~V4L2CameraSource() {}
+
+void V4L2CameraSource::Close() {}
+
+bool V4L2CameraSource::Acquire(Buffer* const buffer) { return false; }
+
+void V4L2CameraSource::Release(const Buffer& buffer) {}
+
+#endif
+
+CameraReader::CameraReader(CameraSource* const source,
+                           const Undistorter* const undistorter,
+                           const int poolSize)
+    : source_(CHECK_NOTNULL(source)),
+      undistorter_(CHECK_NOTNULL(undistorter)) {
+  const Eigen::Vector2i size = undistorter->GetSize();
+  w_ = size[0];
+  h_ = size[1];
+  for (int i = 0; i < poolSize; ++i) {
+    all_.emplace_back(new ImageAndExposure(w_, h_));
+  }
+  free_ = all_;
+}
+
+CameraReader::~CameraReader() {
+  LOG_IF(WARNING, free_.size() != all_.size())
+      << all_.size() - free_.size() << " camera images not recycled.";
+  for (ImageAndExposure* image : all_) {
+    delete image;
+  }
+}
+
+ImageAndExposure* CameraReader::Next() {
+  CameraSource::Buffer buffer;
+  if (!source_->Acquire(&buffer)) {
+    return nullptr;
+  }
+
+  ImageAndExposure* image;
+  {
+    boost::unique_lock<boost::mutex> lock(pool_mutex_);
+    if (free_.empty()) {
+      all_.emplace_back(new ImageAndExposure(w_, h_));
+      free_.emplace_back(all_.back());
+    }
+    image = free_.back();
+    free_.pop_back();
+  }
+
+  // the driver memory is only read here, it goes back right after.
+  const MinimalImageB raw(buffer.w, buffer.h,
+                          const_cast<unsigned char*>(buffer.data));
+  undistorter_->UndistortInto<unsigned char>(&raw, image, buffer.exposure,
+                                             buffer.timestamp);
+  source_->Release(buffer);
+  return image;
+}
+
+void CameraReader::Recycle(ImageAndExposure* const image) {
+  CHECK_NOTNULL(image);
+  boost::unique_lock<boost::mutex> lock(pool_mutex_);
+  DCHECK(std::find(all_.begin(), all_.end(), image) != all_.end());
+  free_.emplace_back(image);
+}
+
+}  // namespace dso
@@ -0,0 +1,31 @@
+#include "util/cpu_features.h"
+
+#include <glog/logging.h>
+
+namespace dso {
+
+void logCpuDispatch() {
+#if DSO_AVX_DISPATCH
+  const char* const avx = useAVX() ? "AVX" : "SSE";
+  const char* const avx2 = useAVX2() ? "AVX2" : "scalar";
+
+  LOG(INFO) << "CPU supports AVX: " << __builtin_cpu_supports("avx")
+            << ", AVX2: " << __builtin_cpu_supports("avx2")
+            << (setting_useAVX ? "" : " (disabled by setting_useAVX)") << ".";
+  LOG(INFO) << "Kernels: Accumulator9 / calcGS " << avx << ", calcRes " << avx2
+            << ", residual linearize " << avx2
+            << ", trace energy " << avx2 << ", undistort remap " << avx2
+            << ", 8 bit photometric " << avx2 << ", image pyramid SSE.";
+#elif DSO_NEON
+  const char* const neon = useNEON() ? "NEON" : "SSE2NEON";
+  LOG(INFO) << "Kernels: Accumulator9 / calcGS " << neon
+            << ", AccumulatorApprox " << neon << ", undistort remap "
+            << (useNEON() ? "NEON" : "scalar") << ", others SSE2NEON"
+            << (setting_useAVX ? "" : " (disabled by setting_useAVX)") << ".";
+#else
+  LOG(INFO) << "Kernels: no runtime dispatch on this architecture, all SIMD "
+               "kernels use the SSE code path.";
+#endif
+}
+
+}  // dso
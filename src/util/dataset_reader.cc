@@ -1,6 +1,7 @@
 #include "util/dataset_reader.h"
 
 #include <dirent.h>
+#include <string.h>
 #include <algorithm>
 #include <fstream>
 #include <string>
@@ -13,12 +14,18 @@ DatasetReader::DatasetReader(const std::string& path,
                              const std::string& file_calibration,
                              const std::string& file_gamma,
                              const std::string& file_vignette)
-    : path_(path), file_calibration_(file_calibration) {
+    : path_(path),
+      file_calibration_(file_calibration),
+      file_gamma_(file_gamma),
+      file_vignette_(file_vignette) {
 #if HAS_ZIPLIB
   zip_archive_ = nullptr;
-  data_buffer_ = nullptr;
 #endif
 
+  if (OpenArchive(path)) {
+    return;
+  }
+
   is_zipped_ = (path.length() > 4 && path.substr(path.length() - 4) == ".zip");
 
   if (is_zipped_) {
@@ -27,6 +34,8 @@ DatasetReader::DatasetReader(const std::string& path,
     zip_archive_ = zip_open(path.c_str(), ZIP_RDONLY, &ziperror);
     LOG_IF(FATAL, ziperror != 0) << "ERROR " << ziperror << "reading archive "
                                  << path << "!";
+    zip_readers_.resize(1);
+    zip_readers_[0].archive = zip_archive_;
 
     files_.clear();
     int numEntries = zip_get_num_entries(zip_archive_, 0);
@@ -55,6 +64,7 @@ DatasetReader::DatasetReader(const std::string& path,
   height_org_ = undistorter_->GetOriginalSize()[1];
   width_ = undistorter_->GetSize()[0];
   height_ = undistorter_->GetSize()[1];
+  ReduceForDecode(undistorter_);
 
   // load timestamps_ if possible.
   LoadTimestamps();
@@ -66,12 +76,18 @@ DatasetReader::DatasetReader(const std::string& path,
                              const std::string& file_gamma,
                              const std::string& file_vignette,
                              const std::string& file_timestamps)
-    : path_(path), file_calibration_(file_calibration) {
+    : path_(path),
+      file_calibration_(file_calibration),
+      file_gamma_(file_gamma),
+      file_vignette_(file_vignette) {
 #if HAS_ZIPLIB
   zip_archive_ = nullptr;
-  data_buffer_ = nullptr;
 #endif
 
+  if (OpenArchive(path)) {
+    return;
+  }
+
   is_zipped_ = (path.length() > 4 && path.substr(path.length() - 4) == ".zip");
 
   if (is_zipped_) {
@@ -80,6 +96,8 @@ DatasetReader::DatasetReader(const std::string& path,
     zip_archive_ = zip_open(path.c_str(), ZIP_RDONLY, &ziperror);
     LOG_IF(FATAL, ziperror != 0) << "ERROR " << ziperror << "reading archive "
                                  << path << "!";
+    zip_readers_.resize(1);
+    zip_readers_[0].archive = zip_archive_;
 
     files_.clear();
     int numEntries = zip_get_num_entries(zip_archive_, 0);
@@ -108,6 +126,7 @@ DatasetReader::DatasetReader(const std::string& path,
   height_org_ = undistorter_->GetOriginalSize()[1];
   width_ = undistorter_->GetSize()[0];
   height_ = undistorter_->GetSize()[1];
+  ReduceForDecode(undistorter_);
 
   // load timestamps_ if possible.
   // LoadTimestamps();
@@ -116,18 +135,62 @@ DatasetReader::DatasetReader(const std::string& path,
 }
 
 DatasetReader::~DatasetReader() {
+  StopPrefetch();
+
 #if HAS_ZIPLIB
+  for (ZipReader& reader : zip_readers_) {
+    if (reader.archive != nullptr && reader.archive != zip_archive_) {
+      zip_close(reader.archive);
+    }
+  }
   if (zip_archive_ != nullptr) {
     zip_close(zip_archive_);
   }
-  if (data_buffer_ != nullptr) {
-    delete data_buffer_;
-  }
 #endif
 
+  for (MinimalImageB* raw : raw_images_) {
+    delete raw;
+  }
   delete undistorter_;
+  delete archive_;
 };
 
+bool DatasetReader::OpenArchive(const std::string& path) {
+  is_zipped_ = false;
+  undistorter_ = nullptr;
+  if (!FrameArchive::IsArchivePath(path)) {
+    return false;
+  }
+
+  archive_ = new FrameArchive(path);
+  width_ = width_org_ = archive_->GetWidth();
+  height_ = height_org_ = archive_->GetHeight();
+  for (int k = 0; k < archive_->GetNumFrames(); ++k) {
+    timestamps_.emplace_back(archive_->GetEntry(k).timestamp);
+    exposures_.emplace_back(archive_->GetEntry(k).exposure);
+  }
+  LOG(INFO) << "Got " << archive_->GetNumFrames() << " undistorted frames in "
+            << path << ", calibration, photometric and timestamp files are "
+            << "not used.";
+  return true;
+}
+
+ImageAndExposure* DatasetReader::GetArchiveImage(const int id) {
+  if (archive_->GetPixelFormat() != FrameArchive::PIXEL_FLOAT) {
+    ImageAndExposure* img = new ImageAndExposure(width_, height_);
+    GetImageInto(id, img);
+    return img;
+  }
+
+  const FrameArchive::Entry& entry = archive_->GetEntry(id);
+  ImageAndExposure* img = new ImageAndExposure(
+      width_, height_, static_cast<float*>(archive_->GetPixels(id)),
+      entry.timestamp);
+  img->exposure_time = entry.exposure;
+  img->init_scale = entry.initScale;
+  return img;
+}
+
 void DatasetReader::SetFiles(std::string dir) {
   DIR* dp;
   if ((dp = opendir(dir.c_str())) == nullptr) {
@@ -154,36 +217,66 @@ void DatasetReader::SetFiles(std::string dir) {
   }
 }
 
+void DatasetReader::ReduceForDecode(Undistorter* const undistorter) {
+  if (decode_reduction_ == 0) {
+    decode_reduction_ =
+        setting_reducedDecode ? undistorter->GetMaxInputReduction() : 1;
+  }
+  CHECK(undistorter->ReduceInput(decode_reduction_));
+}
+
 MinimalImageB* DatasetReader::GetImageRawInternal(const int id,
-                                                  const int unused) {
+                                                  const int reader_id) {
+  LOG_IF(FATAL, archive_ != nullptr)
+      << "A frame archive holds no raw images!";
+  // sized for the workers by StartPrefetch, so only [0] is added here.
+  if (raw_images_.size() <= static_cast<size_t>(reader_id)) {
+    raw_images_.resize(reader_id + 1, nullptr);
+  }
+  if (raw_images_[reader_id] == nullptr) {
+    raw_images_[reader_id] = new MinimalImageB(0, 0);
+  }
+  MinimalImageB* const raw = raw_images_[reader_id];
+
   if (!is_zipped_) {
-    // CHANGE FOR ZIP FILE
-    return IOWrap::readImageBW_8U(files_[id]);
+    LOG_IF(FATAL,
+           !IOWrap::readImageBW_8U(files_[id], raw, decode_reduction_))
+        << "Cannot read image " << files_[id] << "!";
+    return raw;
   } else {
 #if HAS_ZIPLIB
-    if (data_buffer_ == 0)
-      data_buffer_ = new char[width_org_ * height_org_ * 6 + 10000];
-    zip_file_t* fle = zip_fopen(zip_archive_, files_[id].c_str(), 0);
-    long readbytes = zip_fread(fle, data_buffer_,
-                               (long)width_org_ * height_org_ * 6 + 10000);
-
-    if (readbytes > (long)width_org_ * height_org_ * 6) {
-      LOG(WARNING) << "Read " << readbytes << "/"
-                   << (width_org_ * height_org_ * 6 + 10000)
-                   << " bytes for file " << files_[id] << ". Increase buffer!!";
-      delete[] data_buffer_;
-      data_buffer_ = new char[(long)width_org_ * height_org_ * 30];
-      fle = zip_fopen(zip_archive_, files_[id].c_str(), 0);
-      readbytes = zip_fread(fle, data_buffer_,
-                            (long)width_org_ * height_org_ * 30 + 10000);
-
-      LOG_IF(FATAL,
-             readbytes > static_cast<long>(width_org_ * height_org_ * 30))
-          << "Buffer still too small (read " << readbytes << " / "
-          << (width_org_ * height_org_ * 30 + 10000) << ". Abort.";
+    CHECK_LT(reader_id, static_cast<int>(zip_readers_.size()));
+    ZipReader& reader = zip_readers_[reader_id];
+    if (reader.archive == nullptr) {
+      int ziperror = 0;
+      reader.archive = zip_open(path_.c_str(), ZIP_RDONLY, &ziperror);
+      LOG_IF(FATAL, reader.archive == nullptr)
+          << "ERROR " << ziperror << " reading archive " << path_ << "!";
+    }
+
+    // uncompressed size up front: one read into a buffer of the right size.
+    zip_stat_t st;
+    zip_stat_init(&st);
+    LOG_IF(FATAL, zip_stat(reader.archive, files_[id].c_str(), 0, &st) != 0 ||
+                      !(st.valid & ZIP_STAT_SIZE))
+        << "Cannot stat " << files_[id] << " in " << path_ << "!";
+    if (reader.buffer.size() < st.size) {
+      reader.buffer.resize(st.size);
     }
 
-    return IOWrap::readStreamBW_8U(data_buffer_, readbytes);
+    zip_file_t* fle = zip_fopen(reader.archive, files_[id].c_str(), 0);
+    LOG_IF(FATAL, fle == nullptr) << "Cannot open " << files_[id] << " in "
+                                  << path_ << "!";
+    const zip_int64_t readbytes = zip_fread(fle, reader.buffer.data(), st.size);
+    zip_fclose(fle);
+    LOG_IF(FATAL, readbytes != static_cast<zip_int64_t>(st.size))
+        << "Read " << readbytes << " / " << st.size << " bytes of "
+        << files_[id] << "!";
+
+    LOG_IF(FATAL, !IOWrap::readStreamBW_8U(reader.buffer.data(), readbytes,
+                                           raw, decode_reduction_))
+        << "Cannot decode " << files_[id] << " in " << path_ << "!";
+    return raw;
 #else
     LOG(FATAL) << "Cannot read .zip archive, as compile without ziplib!";
 #endif
@@ -191,18 +284,152 @@ MinimalImageB* DatasetReader::GetImageRawInternal(const int id,
 }
 
 ImageAndExposure* DatasetReader::GetImageInternal(const int id,
-                                                  const int unused) {
-  MinimalImageB* minimg = GetImageRawInternal(id, 0);
-  ImageAndExposure* ret2 = undistorter_->Undistort<unsigned char>(
+                                                  const int undistorter_id) {
+  if (archive_ != nullptr) {
+    return GetArchiveImage(id);
+  }
+
+  Undistorter* undistorter =
+      (undistorter_id == 0) ? undistorter_
+                            : prefetch_undistorters_[undistorter_id - 1];
+
+  MinimalImageB* minimg = GetImageRawInternal(id, undistorter_id);
+  ImageAndExposure* ret2 = undistorter->Undistort<unsigned char>(
       minimg, (exposures_.size() == 0 ? 1.0f : exposures_[id]),
       (timestamps_.size() == 0 ? 0.0 : timestamps_[id]));
   
   ret2->init_scale = (scales_.size() == 0) ? 1. : scales_[id];
 
-  delete minimg;
   return ret2;
 }
 
+void DatasetReader::GetImageInto(const int id, ImageAndExposure* img) {
+  if (archive_ != nullptr) {
+    const void* const pixels = archive_->GetPixels(id);
+    if (archive_->GetPixelFormat() == FrameArchive::PIXEL_FLOAT) {
+      memcpy(img->image, pixels, width_ * height_ * sizeof(float));
+    } else {
+      const unsigned char* const bytes =
+          static_cast<const unsigned char*>(pixels);
+      for (int i = 0; i < width_ * height_; ++i) {
+        img->image[i] = bytes[i];
+      }
+    }
+    const FrameArchive::Entry& entry = archive_->GetEntry(id);
+    img->timestamp = entry.timestamp;
+    img->exposure_time = entry.exposure;
+    img->init_scale = entry.initScale;
+    return;
+  }
+
+  MinimalImageB* minimg = GetImageRawInternal(id, 0);
+  undistorter_->UndistortInto<unsigned char>(
+      minimg, img, (exposures_.size() == 0 ? 1.0f : exposures_[id]),
+      (timestamps_.size() == 0 ? 0.0 : timestamps_[id]));
+
+  img->init_scale = (scales_.size() == 0) ? 1. : scales_[id];
+}
+
+void DatasetReader::StartPrefetch(const std::vector<int>& ids,
+                                  const int num_workers, const int capacity) {
+  CHECK(prefetch_undistorters_.empty()) << "Prefetch is already running!";
+  CHECK_GT(num_workers, 0);
+  CHECK_GT(capacity, 0);
+
+  prefetch_ids_ = ids;
+  prefetch_ring_.assign(capacity, nullptr);
+  prefetch_next_claim_ = 0;
+  prefetch_next_out_ = 0;
+  prefetch_running_ = true;
+#if HAS_ZIPLIB
+  // one handle and buffer per worker, libzip handles are not thread safe.
+  if (is_zipped_ && zip_readers_.size() < num_workers + 1u) {
+    zip_readers_.resize(num_workers + 1);
+  }
+#endif
+
+  if (raw_images_.size() < num_workers + 1u) {
+    raw_images_.resize(num_workers + 1, nullptr);
+  }
+
+  // Undistorter::Undistort writes into the photometric undistorter's output
+  // buffer, hence every worker gets its own (none for an archive).
+  for (int i = 0; i < num_workers; ++i) {
+    prefetch_undistorters_.emplace_back(
+        archive_ != nullptr ? nullptr
+                            : Undistorter::GetUndistorterForFile(
+                                  file_calibration_, file_gamma_,
+                                  file_vignette_));
+    if (archive_ == nullptr) {
+      ReduceForDecode(prefetch_undistorters_.back());
+    }
+    prefetch_threads_.create_thread(
+        boost::bind(&DatasetReader::PrefetchLoop, this, i + 1));
+  }
+  LOG(INFO) << "Prefetching " << ids.size() << " images with " << num_workers
+            << " workers, buffering up to " << capacity << ".";
+}
+
+ImageAndExposure* DatasetReader::Next() {
+  boost::unique_lock<boost::mutex> lock(prefetch_mutex_);
+  if (prefetch_next_out_ >= prefetch_ids_.size() || prefetch_ring_.empty()) {
+    return nullptr;
+  }
+
+  ImageAndExposure*& slot =
+      prefetch_ring_[prefetch_next_out_ % prefetch_ring_.size()];
+  while (slot == nullptr) {
+    prefetch_ready_.wait(lock);
+  }
+
+  ImageAndExposure* img = slot;
+  slot = nullptr;
+  ++prefetch_next_out_;
+  prefetch_space_.notify_all();
+  return img;
+}
+
+void DatasetReader::StopPrefetch() {
+  {
+    boost::unique_lock<boost::mutex> lock(prefetch_mutex_);
+    prefetch_running_ = false;
+    prefetch_space_.notify_all();
+  }
+  prefetch_threads_.join_all();
+
+  for (ImageAndExposure*& img : prefetch_ring_) {
+    delete img;
+    img = nullptr;
+  }
+  prefetch_ring_.clear();
+  for (Undistorter* undistorter : prefetch_undistorters_) {
+    delete undistorter;
+  }
+  prefetch_undistorters_.clear();
+}
+
+void DatasetReader::PrefetchLoop(const int worker) {
+  boost::unique_lock<boost::mutex> lock(prefetch_mutex_);
+  while (true) {
+    // wait for a free slot, at most capacity frames ahead of Next().
+    while (prefetch_running_ && prefetch_next_claim_ < prefetch_ids_.size() &&
+           prefetch_next_claim_ >= prefetch_next_out_ + prefetch_ring_.size()) {
+      prefetch_space_.wait(lock);
+    }
+    if (!prefetch_running_ || prefetch_next_claim_ >= prefetch_ids_.size()) {
+      return;
+    }
+
+    const size_t seq = prefetch_next_claim_++;
+    lock.unlock();
+    ImageAndExposure* img = GetImageInternal(prefetch_ids_[seq], worker);
+    lock.lock();
+
+    prefetch_ring_[seq % prefetch_ring_.size()] = img;
+    prefetch_ready_.notify_all();
+  }
+}
+
 void DatasetReader::LoadTimestamps() {
   std::ifstream tr;
   std::string timesFile =
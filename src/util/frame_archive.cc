@@ -0,0 +1,171 @@
+#include "util/frame_archive.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include "util/dataset_reader.h"
+#include "util/image_and_exposure.h"
+
+namespace dso {
+
+const char FrameArchive::kMagic[8] = {'D', 'S', 'O', 'F', 'R', 'A', 'M', 'E'};
+
+namespace {
+
+inline uint64_t alignUp(const uint64_t offset) {
+  return (offset + FrameArchive::kFrameAlignment - 1) /
+         FrameArchive::kFrameAlignment * FrameArchive::kFrameAlignment;
+}
+
+}  // namespace
+
+bool FrameArchive::IsArchivePath(const std::string& path) {
+  const std::string ext = ".dsoframes";
+  return path.length() > ext.length() &&
+         path.compare(path.length() - ext.length(), ext.length(), ext) == 0;
+}
+
+bool FrameArchive::Write(const std::string& path, DatasetReader* const reader,
+                         const std::vector<int>& ids,
+                         const PixelFormat format) {
+  CHECK_NOTNULL(reader);
+
+  Header header;
+  memset(&header, 0, sizeof(Header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.pixelFormat = format;
+  header.numFrames = ids.size();
+
+  Eigen::Matrix3f K;
+  int w, h;
+  reader->GetCalibMono(&K, &w, &h);
+  header.width = w;
+  header.height = h;
+  header.K[0] = K(0, 0);
+  header.K[1] = K(1, 1);
+  header.K[2] = K(0, 2);
+  header.K[3] = K(1, 2);
+  const float* const gamma = reader->GetPhotometricGamma();
+  if (gamma != nullptr) {
+    header.hasGamma = 1;
+    memcpy(header.gamma, gamma, sizeof(header.gamma));
+  }
+
+  std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out.good()) {
+    LOG(ERROR) << "Cannot write frame archive " << path;
+    return false;
+  }
+
+  const size_t pixelSize = (format == PIXEL_FLOAT) ? sizeof(float) : 1;
+  const uint64_t frameBytes = static_cast<uint64_t>(w) * h * pixelSize;
+  std::vector<Entry> entries(ids.size());
+  uint64_t offset = alignUp(sizeof(Header) + entries.size() * sizeof(Entry));
+
+  std::vector<char> padding(kFrameAlignment, 0);
+  std::vector<unsigned char> bytes(format == PIXEL_UINT8 ? w * h : 0);
+  ImageAndExposure img(w, h);
+  out.seekp(offset);
+  for (size_t k = 0; k < ids.size(); ++k) {
+    reader->GetImageInto(ids[k], &img);
+    entries[k].offset = offset;
+    entries[k].timestamp = reader->GetTimestamp(ids[k]);
+    entries[k].exposure = img.exposure_time;
+    entries[k].initScale = img.init_scale;
+
+    if (format == PIXEL_FLOAT) {
+      out.write(reinterpret_cast<const char*>(img.image), frameBytes);
+    } else {
+      for (int i = 0; i < w * h; ++i) {
+        bytes[i] = static_cast<unsigned char>(
+            std::min(255.f, std::max(0.f, roundf(img.image[i]))));
+      }
+      out.write(reinterpret_cast<const char*>(bytes.data()), frameBytes);
+    }
+
+    const uint64_t next = alignUp(offset + frameBytes);
+    out.write(padding.data(), next - offset - frameBytes);
+    offset = next;
+  }
+
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  out.write(reinterpret_cast<const char*>(entries.data()),
+            entries.size() * sizeof(Entry));
+  out.close();
+  if (out.fail()) {
+    LOG(ERROR) << "Writing frame archive " << path << " failed";
+    return false;
+  }
+
+  LOG(INFO) << "Wrote " << ids.size() << " frames of " << w << " x " << h
+            << (format == PIXEL_FLOAT ? " float" : " uint8") << " to " << path
+            << " (" << offset / (1024 * 1024) << " MB)";
+  return true;
+}
+
+FrameArchive::FrameArchive(const std::string& path)
+    : data_(nullptr), size_(0), header_(nullptr), entries_(nullptr) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  LOG_IF(FATAL, fd < 0) << "Cannot open frame archive " << path;
+
+  struct stat st;
+  LOG_IF(FATAL, fstat(fd, &st) != 0) << "Cannot stat frame archive " << path;
+  size_ = st.st_size;
+  LOG_IF(FATAL, size_ < sizeof(Header)) << path << " is no frame archive!";
+
+  // private and writable: frames are handed out as float* (copy-on-write).
+  data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  LOG_IF(FATAL, data_ == MAP_FAILED) << "Cannot map frame archive " << path;
+
+  header_ = static_cast<const Header*>(data_);
+  entries_ = reinterpret_cast<const Entry*>(header_ + 1);
+  LOG_IF(FATAL, memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+                    header_->version != kVersion)
+      << path << " is no frame archive of version " << kVersion << "!";
+
+  const uint64_t frameBytes =
+      static_cast<uint64_t>(header_->width) * header_->height *
+      (header_->pixelFormat == PIXEL_FLOAT ? sizeof(float) : 1);
+  LOG_IF(FATAL, sizeof(Header) + header_->numFrames * sizeof(Entry) > size_)
+      << path << " is truncated!";
+  for (uint32_t k = 0; k < header_->numFrames; ++k) {
+    LOG_IF(FATAL, entries_[k].offset + frameBytes > size_)
+        << path << " is truncated at frame " << k << "!";
+  }
+
+  // frames are read front to back.
+  madvise(data_, size_, MADV_SEQUENTIAL);
+
+  LOG(INFO) << "Mapped frame archive " << path << ": "
+            << header_->numFrames << " frames of " << header_->width << " x "
+            << header_->height
+            << (header_->pixelFormat == PIXEL_FLOAT ? " float" : " uint8");
+}
+
+FrameArchive::~FrameArchive() {
+  if (data_ != nullptr && data_ != MAP_FAILED) {
+    munmap(data_, size_);
+  }
+}
+
+Eigen::Matrix3f FrameArchive::GetK() const {
+  Eigen::Matrix3f K = Eigen::Matrix3f::Identity();
+  K(0, 0) = header_->K[0];
+  K(1, 1) = header_->K[1];
+  K(0, 2) = header_->K[2];
+  K(1, 2) = header_->K[3];
+  return K;
+}
+
+}  // dso
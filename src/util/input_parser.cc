@@ -8,9 +8,12 @@
 #include <opencv2/opencv.hpp>
 
 #include "util/converter.h"
+#include "util/cpu_features.h"
 #include "util/input_param.h"
 #include "util/num_type.h"
+#include "util/residual_pattern.h"
 #include "util/settings.h"
+#include "util/thread_config.h"
 
 namespace dso {
 
@@ -32,10 +35,149 @@ InputParam InputParser::Read(const std::string& config) {
   if (!settings["Int.EndId"].empty()) {
     settings["Int.EndId"] >> param.end_id;
   }
+  if (!settings["Int.NumThreads"].empty()) {
+    settings["Int.NumThreads"] >> param.num_threads;
+  }
+  if (!settings["Int.PrefetchThreads"].empty()) {
+    settings["Int.PrefetchThreads"] >> param.prefetch_threads;
+  }
+  if (!settings["Int.PrefetchBuffer"].empty()) {
+    settings["Int.PrefetchBuffer"] >> param.prefetch_buffer;
+  }
+  if (!settings["Int.PyramidPoolSize"].empty()) {
+    settings["Int.PyramidPoolSize"] >> param.pyramid_pool_size;
+  }
+  if (!settings["Int.TrackerRtPriority"].empty()) {
+    settings["Int.TrackerRtPriority"] >> param.tracker_rt_priority;
+  }
+  if (!settings["Int.MapperRtPriority"].empty()) {
+    settings["Int.MapperRtPriority"] >> param.mapper_rt_priority;
+  }
+  if (!settings["Int.ReduceRtPriority"].empty()) {
+    settings["Int.ReduceRtPriority"] >> param.reduce_rt_priority;
+  }
+  if (!settings["Int.TrackerNice"].empty()) {
+    settings["Int.TrackerNice"] >> param.tracker_nice;
+  }
+  if (!settings["Int.MapperNice"].empty()) {
+    settings["Int.MapperNice"] >> param.mapper_nice;
+  }
+  if (!settings["Int.ReduceNice"].empty()) {
+    settings["Int.ReduceNice"] >> param.reduce_nice;
+  }
+  if (!settings["Bool.ReduceNumaNodes"].empty()) {
+    settings["Bool.ReduceNumaNodes"] >> param.reduce_numa_nodes;
+  }
+  if (!settings["Bool.DeterministicReduce"].empty()) {
+    settings["Bool.DeterministicReduce"] >> param.deterministic_reduce;
+  }
 
   if (!settings["Float.PlaySpeed"].empty()) {
     settings["Float.PlaySpeed"] >> param.play_speed;
   }
+  if (!settings["Float.MinRelEnergyDecrease"].empty()) {
+    settings["Float.MinRelEnergyDecrease"] >> param.min_rel_energy_decrease;
+  }
+  if (!settings["Float.KeyframeTimeBudgetMs"].empty()) {
+    settings["Float.KeyframeTimeBudgetMs"] >> param.keyframe_time_budget_ms;
+  }
+  if (!settings["Float.LazyRelinThreshold"].empty()) {
+    settings["Float.LazyRelinThreshold"] >> param.lazy_relin_threshold;
+  }
+  if (!settings["Float.LatencyBudgetMs"].empty()) {
+    settings["Float.LatencyBudgetMs"] >> param.latency_budget_ms;
+  }
+  if (!settings["Float.LatencyHysteresis"].empty()) {
+    settings["Float.LatencyHysteresis"] >> param.latency_hysteresis;
+  }
+  if (!settings["Float.TrackingDeadlineFactor"].empty()) {
+    settings["Float.TrackingDeadlineFactor"] >> param.tracking_deadline_factor;
+  }
+  if (!settings["Float.CoarseSubsampleRatio"].empty()) {
+    settings["Float.CoarseSubsampleRatio"] >> param.coarse_subsample_ratio;
+  }
+  if (!settings["Float.MapStoreCellSize"].empty()) {
+    settings["Float.MapStoreCellSize"] >> param.map_store_cell_size;
+  }
+  if (!settings["Float.MapStoreViewRadius"].empty()) {
+    settings["Float.MapStoreViewRadius"] >> param.map_store_view_radius;
+  }
+  if (!settings["Int.CoarseTrackingFinestLevel"].empty()) {
+    settings["Int.CoarseTrackingFinestLevel"] >>
+        param.coarse_tracking_finest_level;
+  }
+  if (!settings["Int.OptTrialSteps"].empty()) {
+    settings["Int.OptTrialSteps"] >> param.opt_trial_steps;
+  }
+  if (!settings["Int.InitAttempts"].empty()) {
+    settings["Int.InitAttempts"] >> param.init_attempts;
+  }
+  if (!settings["Int.InitAttemptSpacing"].empty()) {
+    settings["Int.InitAttemptSpacing"] >> param.init_attempt_spacing;
+  }
+  if (!settings["Int.RelocKeyframes"].empty()) {
+    settings["Int.RelocKeyframes"] >> param.reloc_keyframes;
+  }
+  if (!settings["Int.RelocCandidates"].empty()) {
+    settings["Int.RelocCandidates"] >> param.reloc_candidates;
+  }
+  if (!settings["Int.RelocMaxFrames"].empty()) {
+    settings["Int.RelocMaxFrames"] >> param.reloc_max_frames;
+  }
+  if (!settings["Float.RelocMinScore"].empty()) {
+    settings["Float.RelocMinScore"] >> param.reloc_min_score;
+  }
+  if (!settings["Float.RelocMaxRMSE"].empty()) {
+    settings["Float.RelocMaxRMSE"] >> param.reloc_max_rmse;
+  }
+  if (!settings["Int.Pattern"].empty()) {
+    settings["Int.Pattern"] >> param.pattern;
+  }
+  if (!settings["Int.PyrLevels"].empty()) {
+    settings["Int.PyrLevels"] >> param.pyr_levels;
+  }
+  if (!settings["Int.ResultSyncIntervalMs"].empty()) {
+    settings["Int.ResultSyncIntervalMs"] >> param.result_sync_interval_ms;
+  }
+  if (!settings["Int.OutputQueueSize"].empty()) {
+    settings["Int.OutputQueueSize"] >> param.output_queue_size;
+  }
+  if (!settings["Int.OutputBackpressure"].empty()) {
+    settings["Int.OutputBackpressure"] >> param.output_backpressure;
+  }
+  if (!settings["Int.ShmSlots"].empty()) {
+    settings["Int.ShmSlots"] >> param.shm_slots;
+  }
+  if (!settings["Int.MapStoreCachePoints"].empty()) {
+    settings["Int.MapStoreCachePoints"] >> param.map_store_cache_points;
+  }
+  if (!settings["Int.SnapshotInterval"].empty()) {
+    settings["Int.SnapshotInterval"] >> param.snapshot_interval;
+  }
+  if (!settings["Int.StageTimingInterval"].empty()) {
+    settings["Int.StageTimingInterval"] >> param.stage_timing_interval;
+  }
+  if (!settings["Int.MemoryStatsInterval"].empty()) {
+    settings["Int.MemoryStatsInterval"] >> param.memory_stats_interval;
+  }
+  if (!settings["Int.MetricsPort"].empty()) {
+    settings["Int.MetricsPort"] >> param.metrics_port;
+  }
+  if (!settings["Int.RandomSeed"].empty()) {
+    settings["Int.RandomSeed"] >> param.random_seed;
+  }
+  if (!settings["Int.TraceMaxEvents"].empty()) {
+    settings["Int.TraceMaxEvents"] >> param.trace_max_events;
+  }
+  if (!settings["Int.ProfileHz"].empty()) {
+    settings["Int.ProfileHz"] >> param.profile_hz;
+  }
+  if (!settings["Int.ProfileMaxSamples"].empty()) {
+    settings["Int.ProfileMaxSamples"] >> param.profile_max_samples;
+  }
+  if (!settings["Int.ProfileTopFrames"].empty()) {
+    settings["Int.ProfileTopFrames"] >> param.profile_top_frames;
+  }
 
   if (!settings["Double.Rescale"].empty()) {
     settings["Double.Rescale"] >> param.rescale;
@@ -62,6 +204,81 @@ InputParam InputParser::Read(const std::string& config) {
   if (!settings["String.Scales"].empty()) {
     settings["String.Scales"] >> param.path_2_scales;
   }
+  if (!settings["String.ShmOutput"].empty()) {
+    settings["String.ShmOutput"] >> param.shm_output;
+  }
+  if (!settings["String.MapStore"].empty()) {
+    settings["String.MapStore"] >> param.path_2_map_store;
+  }
+  if (!settings["String.Snapshot"].empty()) {
+    settings["String.Snapshot"] >> param.path_2_snapshot;
+  }
+  if (!settings["String.StageTiming"].empty()) {
+    settings["String.StageTiming"] >> param.path_2_stage_timing;
+  }
+  if (!settings["String.PerfCounters"].empty()) {
+    settings["String.PerfCounters"] >> param.path_2_perf_counters;
+  }
+  if (!settings["String.Trace"].empty()) {
+    settings["String.Trace"] >> param.path_2_trace;
+  }
+  if (!settings["String.RemapCache"].empty()) {
+    settings["String.RemapCache"] >> param.path_2_remap_cache;
+  }
+  if (!settings["String.Profile"].empty()) {
+    settings["String.Profile"] >> param.path_2_profile;
+  }
+  if (!settings["String.Groundtruth"].empty()) {
+    settings["String.Groundtruth"] >> param.path_2_groundtruth;
+  }
+  if (!settings["String.ReplayReport"].empty()) {
+    settings["String.ReplayReport"] >> param.path_2_replay_report;
+  }
+  if (!settings["String.ReplayThreads"].empty()) {
+    settings["String.ReplayThreads"] >> param.replay_threads;
+  }
+  if (!settings["String.ReplayPresets"].empty()) {
+    settings["String.ReplayPresets"] >> param.replay_presets;
+  }
+  if (!settings["String.SweepParams"].empty()) {
+    settings["String.SweepParams"] >> param.sweep_params;
+  }
+  if (!settings["Int.SweepSamples"].empty()) {
+    settings["Int.SweepSamples"] >> param.sweep_samples;
+  }
+  if (!settings["Int.SweepJobs"].empty()) {
+    settings["Int.SweepJobs"] >> param.sweep_jobs;
+  }
+  if (!settings["Int.ReplayRepeats"].empty()) {
+    settings["Int.ReplayRepeats"] >> param.replay_repeats;
+  }
+  if (!settings["String.ReplayBaseline"].empty()) {
+    settings["String.ReplayBaseline"] >> param.path_2_replay_baseline;
+  }
+  if (!settings["String.BatchList"].empty()) {
+    settings["String.BatchList"] >> param.path_2_batch_list;
+  }
+  if (!settings["Int.BatchJobs"].empty()) {
+    settings["Int.BatchJobs"] >> param.batch_jobs;
+  }
+  if (!settings["Int.BatchMemoryMB"].empty()) {
+    settings["Int.BatchMemoryMB"] >> param.batch_memory_mb;
+  }
+  if (!settings["Int.BatchInstanceMB"].empty()) {
+    settings["Int.BatchInstanceMB"] >> param.batch_instance_mb;
+  }
+  if (!settings["Double.RegressionTolerance"].empty()) {
+    settings["Double.RegressionTolerance"] >> param.regression_tolerance;
+  }
+  if (!settings["String.TrackerCpus"].empty()) {
+    settings["String.TrackerCpus"] >> param.tracker_cpus;
+  }
+  if (!settings["String.MapperCpus"].empty()) {
+    settings["String.MapperCpus"] >> param.mapper_cpus;
+  }
+  if (!settings["String.ReduceCpus"].empty()) {
+    settings["String.ReduceCpus"] >> param.reduce_cpus;
+  }
 
   if (!settings["Bool.UseScales"].empty()) {
     settings["Bool.UseScales"] >> param.use_scales;
@@ -90,6 +307,33 @@ InputParam InputParser::Read(const std::string& config) {
   if (!settings["Bool.MultiThreading"].empty()) {
     settings["Bool.MultiThreading"] >> param.multi_threading;
   }
+  if (!settings["Bool.UseAVX"].empty()) {
+    settings["Bool.UseAVX"] >> param.use_avx;
+  }
+  if (!settings["Bool.CompactKeyframes"].empty()) {
+    settings["Bool.CompactKeyframes"] >> param.compact_keyframes;
+  }
+  if (!settings["Bool.ReleaseKeyframePyramid"].empty()) {
+    settings["Bool.ReleaseKeyframePyramid"] >> param.release_keyframe_pyramid;
+  }
+  if (!settings["Bool.CompactJacobians"].empty()) {
+    settings["Bool.CompactJacobians"] >> param.compact_jacobians;
+  }
+  if (!settings["Bool.BoundedFrameHistory"].empty()) {
+    settings["Bool.BoundedFrameHistory"] >> param.bounded_frame_history;
+  }
+  if (!settings["Bool.ValidateEF"].empty()) {
+    settings["Bool.ValidateEF"] >> param.validate_ef;
+  }
+  if (!settings["Bool.CoarseTrackingGPU"].empty()) {
+    settings["Bool.CoarseTrackingGPU"] >> param.coarse_tracking_gpu;
+  }
+  if (!settings["Bool.PreprocessGPU"].empty()) {
+    settings["Bool.PreprocessGPU"] >> param.preprocess_gpu;
+  }
+  if (!settings["Bool.ReducedDecode"].empty()) {
+    settings["Bool.ReducedDecode"] >> param.reduced_decode;
+  }
   if (!settings["Bool.Save"].empty()) {
     settings["Bool.Save"] >> param.save;
   }
@@ -102,12 +346,31 @@ InputParam InputParser::Read(const std::string& config) {
   if (!settings["Bool.DisableReconfigure"].empty()) {
     settings["Bool.DisableReconfigure"] >> param.disable_ros;
   }
+  if (!settings["Bool.ResumeFromSnapshot"].empty()) {
+    settings["Bool.ResumeFromSnapshot"] >> param.resume_from_snapshot;
+  }
+  if (!settings["Bool.LocalizationMode"].empty()) {
+    settings["Bool.LocalizationMode"] >> param.localization_mode;
+  }
+  if (!settings["Bool.StageTiming"].empty()) {
+    settings["Bool.StageTiming"] >> param.stage_timing;
+  }
+  if (!settings["Bool.PerfCounters"].empty()) {
+    settings["Bool.PerfCounters"] >> param.perf_counters;
+  }
+  if (!settings["Bool.Trace"].empty()) {
+    settings["Bool.Trace"] >> param.trace;
+  }
+  if (!settings["Bool.Profile"].empty()) {
+    settings["Bool.Profile"] >> param.profile;
+  }
 
   return param;
 }
 
-void InputParser::Config(InputParam* const param) {
+void InputParser::Config(InputParam* const param, Settings* const settings) {
   CHECK_NOTNULL(param);
+  CHECK_NOTNULL(settings);
 
   if (param->no_log) {
     setting_logStuff = false;
@@ -115,8 +378,7 @@ void InputParser::Config(InputParam* const param) {
   }
   ConfigLog(!param->no_log, param->path_2_log);
 
-  Preset(param);
-  SetMode(param->mode);
+  ConfigTuning(param, settings);
   if (param->quiet) {
     setting_debugout_runquiet = true;
     LOG(WARNING) << "QUIET MODE, I'll shut up!";
@@ -134,10 +396,41 @@ void InputParser::Config(InputParam* const param) {
     disableAllDisplay = true;
   }
 
-  if (!param->multi_threading) {
-    multiThreading = false;
-    LOG(WARNING) << "NO Multi Threading!";
-  }
+  setting_numThreads = param->num_threads;
+  setting_pyramidPoolSize = param->pyramid_pool_size;
+  setting_stageTiming = param->stage_timing;
+  setting_stageTimingInterval = param->stage_timing_interval;
+  setting_stageTimingPath = param->path_2_stage_timing;
+  setting_perfCounters = param->perf_counters;
+  setting_perfCountersPath = param->path_2_perf_counters;
+  setting_trace = param->trace;
+  setting_tracePath = param->path_2_trace;
+  setting_remapCacheDir = param->path_2_remap_cache;
+  setting_traceMaxEvents = param->trace_max_events;
+  setting_profile = param->profile;
+  setting_profilePath = param->path_2_profile;
+  setting_profileHz = param->profile_hz;
+  setting_profileMaxSamples = param->profile_max_samples;
+  setting_profileTopFrames = param->profile_top_frames;
+  setting_randomSeed = param->random_seed;
+  setting_memoryStatsInterval = param->memory_stats_interval;
+  setting_metricsPort = param->metrics_port;
+
+  setting_trackerCpus = param->tracker_cpus;
+  setting_mapperCpus = param->mapper_cpus;
+  setting_reduceCpus = param->reduce_cpus;
+  setting_trackerRtPriority = param->tracker_rt_priority;
+  setting_mapperRtPriority = param->mapper_rt_priority;
+  setting_reduceRtPriority = param->reduce_rt_priority;
+  setting_trackerNice = param->tracker_nice;
+  setting_mapperNice = param->mapper_nice;
+  setting_reduceNice = param->reduce_nice;
+  setting_reduceNumaNodes = param->reduce_numa_nodes;
+  setting_deterministicReduce = param->deterministic_reduce;
+  ThreadConfig::LogLayout();
+
+  setting_useAVX = param->use_avx;
+  logCpuDispatch();
 
   if (param->save) {
     debugSaveImages = true;
@@ -161,7 +454,66 @@ void InputParser::Config(InputParam* const param) {
   }
 }
 
-void InputParser::Preset(InputParam* const param) {
+void InputParser::ConfigTuning(InputParam* const param,
+                               Settings* const settings) {
+  CHECK_NOTNULL(param);
+  CHECK_NOTNULL(settings);
+
+  Preset(param, settings);
+  SetMode(param->mode, settings);
+  if (!param->multi_threading) {
+    settings->multiThreading = false;
+    LOG(WARNING) << "NO Multi Threading!";
+  }
+  settings->minRelEnergyDecrease = param->min_rel_energy_decrease;
+  settings->keyframeTimeBudgetMs = param->keyframe_time_budget_ms;
+  settings->lazyRelinThreshold = param->lazy_relin_threshold;
+  settings->latencyBudgetMs = param->latency_budget_ms;
+  settings->latencyHysteresis = param->latency_hysteresis;
+  settings->trackingDeadlineFactor = param->tracking_deadline_factor;
+  settings->coarseSubsampleRatio = param->coarse_subsample_ratio;
+  LOG_IF(FATAL, param->coarse_tracking_finest_level < 0 ||
+                    param->coarse_tracking_finest_level >= param->pyr_levels)
+      << "Int.CoarseTrackingFinestLevel " << param->coarse_tracking_finest_level
+      << " is not a pyramid level (Int.PyrLevels " << param->pyr_levels << ").";
+  settings->coarseTrackingFinestLvl = param->coarse_tracking_finest_level;
+  settings->optTrialSteps = param->opt_trial_steps;
+  settings->initAttempts = param->init_attempts;
+  settings->initAttemptSpacing = param->init_attempt_spacing;
+  settings->relocKeyframes = param->reloc_keyframes;
+  settings->relocCandidates = param->reloc_candidates;
+  settings->relocMinScore = param->reloc_min_score;
+  settings->relocMaxRMSE = param->reloc_max_rmse;
+  settings->relocMaxFrames = param->reloc_max_frames;
+  LOG_IF(FATAL, !isSupportedPattern(param->pattern))
+      << "Int.Pattern " << param->pattern
+      << " is not supported, use 0, 1, 2 or 8.";
+  settings->pattern = param->pattern;
+  settings->compactKeyframePyramid = param->compact_keyframes;
+  settings->releaseKeyframePyramid = param->release_keyframe_pyramid;
+  settings->compactJacobians = param->compact_jacobians;
+  settings->boundedFrameHistory = param->bounded_frame_history;
+  settings->validateEF = param->validate_ef;
+  LOG_IF(WARNING, param->bounded_frame_history &&
+                      param->result_sync_interval_ms <= 0)
+      << "Bool.BoundedFrameHistory without Int.ResultSyncIntervalMs: "
+         "result.txt only gets the frames still in memory.";
+#if defined(HAS_CUDA)
+  settings->coarseTrackingGPU = param->coarse_tracking_gpu;
+  setting_preprocessGPU = param->preprocess_gpu;
+#else
+  LOG_IF(WARNING, param->coarse_tracking_gpu)
+      << "Bool.CoarseTrackingGPU ignored, built without DSO_CUDA.";
+  LOG_IF(WARNING, param->preprocess_gpu)
+      << "Bool.PreprocessGPU ignored, built without DSO_CUDA.";
+#endif
+  setting_reducedDecode = param->reduced_decode;
+  settings->snapshotPath = param->path_2_snapshot;
+  settings->snapshotInterval = param->snapshot_interval;
+  settings->localizationMode = param->localization_mode;
+}
+
+void InputParser::Preset(InputParam* const param, Settings* const settings) {
   CHECK_NOTNULL(param);
 
   if (param->preset == 0 || param->preset == 1) {
@@ -176,12 +528,12 @@ void InputParser::Preset(InputParam* const param) {
                  "resolution\n==============================================";
     param->play_speed = (param->preset == 0 ? 0 : 1);
     param->preload = (param->preset == 1);
-    setting_desiredImmatureDensity = 1500;
-    setting_desiredPointDensity = 2000;
-    setting_minFrames = 5;
-    setting_maxFrames = 7;
-    setting_maxOptIterations = 6;
-    setting_minOptIterations = 1;
+    settings->desiredImmatureDensity = 1500;
+    settings->desiredPointDensity = 2000;
+    settings->minFrames = 5;
+    settings->maxFrames = 7;
+    settings->maxOptIterations = 6;
+    settings->minOptIterations = 1;
     setting_logStuff = false;
   } else if (param->preset == 2 || param->preset == 3) {
     LOG(INFO) << "\n=============== PRESET Settings: ===============\nFAST "
@@ -196,19 +548,19 @@ void InputParser::Preset(InputParam* const param) {
 
     param->play_speed = (param->preset == 2 ? 0 : 5);
     param->preload = (param->preset == 3);
-    setting_desiredImmatureDensity = 600;
-    setting_desiredPointDensity = 800;
-    setting_minFrames = 4;
-    setting_maxFrames = 6;
-    setting_maxOptIterations = 4;
-    setting_minOptIterations = 1;
+    settings->desiredImmatureDensity = 600;
+    settings->desiredPointDensity = 800;
+    settings->minFrames = 4;
+    settings->maxFrames = 6;
+    settings->maxOptIterations = 4;
+    settings->minOptIterations = 1;
     benchmarkSetting_width = 424;
     benchmarkSetting_height = 320;
     setting_logStuff = false;
   }
 }
 
-void InputParser::SetMode(const int mode) {
+void InputParser::SetMode(const int mode, Settings* const settings) {
   switch (mode) {
     case 0:
       LOG(WARNING) << "PHOTOMETRIC MODE WITH CALIBRATION!";
@@ -216,15 +568,15 @@ void InputParser::SetMode(const int mode) {
     case 1:
       LOG(WARNING) << "PHOTOMETRIC MODE WITHOUT CALIBRATION!";
       setting_photometricCalibration = 0;
-      setting_affineOptModeA = 0;
-      setting_affineOptModeB = 0;
+      settings->affineOptModeA = 0;
+      settings->affineOptModeB = 0;
       break;
     case 2:
       LOG(WARNING) << "PHOTOMETRIC MODE WITH PERFECT IMAGES!";
       setting_photometricCalibration = 0;
-      setting_affineOptModeA = -1;
-      setting_affineOptModeB = -1;
-      setting_minGradHistAdd = 3;
+      settings->affineOptModeA = -1;
+      settings->affineOptModeB = -1;
+      settings->minGradHistAdd = 3;
       break;
     default:
       break;
@@ -0,0 +1,179 @@
+#include "util/json_reader.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace dso {
+
+namespace {
+
+// nesting beyond is rejected instead of overflowing the stack.
+const int kMaxDepth = 64;
+
+class Parser {
+ public:
+  explicit Parser(const std::string& text) : text(text), pos(0) {}
+
+  bool parse(JsonValue* value, std::string* error) {
+    const bool ok = parseValue(value, 0) && (skipSpace(), pos == text.size());
+    if (!ok && error != nullptr) {
+      *error = "invalid JSON at offset " + std::to_string(pos);
+    }
+    return ok;
+  }
+
+ private:
+  void skipSpace() {
+    while (pos < text.size() &&
+           isspace(static_cast<unsigned char>(text[pos]))) {
+      ++pos;
+    }
+  }
+
+  bool consume(const char* literal) {
+    const size_t length = strlen(literal);
+    if (text.compare(pos, length, literal) != 0) {
+      return false;
+    }
+    pos += length;
+    return true;
+  }
+
+  bool parseString(std::string* out) {
+    if (pos >= text.size() || text[pos] != '"') {
+      return false;
+    }
+    ++pos;
+    while (pos < text.size() && text[pos] != '"') {
+      char c = text[pos++];
+      if (c == '\\') {
+        if (pos >= text.size()) {
+          return false;
+        }
+        c = text[pos++];
+        switch (c) {
+          case 'n':
+            c = '\n';
+            break;
+          case 't':
+            c = '\t';
+            break;
+          case 'u':
+            *out += "\\u";
+            continue;
+          default:
+            break;
+        }
+      }
+      *out += c;
+    }
+    if (pos >= text.size()) {
+      return false;
+    }
+    ++pos;
+    return true;
+  }
+
+  bool parseValue(JsonValue* value, const int depth) {
+    skipSpace();
+    if (pos >= text.size() || depth > kMaxDepth) {
+      return false;
+    }
+    const char c = text[pos];
+    if (c == '{') {
+      value->type = JsonValue::OBJECT;
+      ++pos;
+      skipSpace();
+      if (pos < text.size() && text[pos] == '}') {
+        ++pos;
+        return true;
+      }
+      while (true) {
+        skipSpace();
+        std::pair<std::string, JsonValue> member;
+        if (!parseString(&member.first)) {
+          return false;
+        }
+        skipSpace();
+        if (!consume(":") || !parseValue(&member.second, depth + 1)) {
+          return false;
+        }
+        value->object.emplace_back(std::move(member));
+        skipSpace();
+        if (consume("}")) {
+          return true;
+        }
+        if (!consume(",")) {
+          return false;
+        }
+      }
+    }
+    if (c == '[') {
+      value->type = JsonValue::ARRAY;
+      ++pos;
+      skipSpace();
+      if (pos < text.size() && text[pos] == ']') {
+        ++pos;
+        return true;
+      }
+      while (true) {
+        value->array.emplace_back();
+        if (!parseValue(&value->array.back(), depth + 1)) {
+          return false;
+        }
+        skipSpace();
+        if (consume("]")) {
+          return true;
+        }
+        if (!consume(",")) {
+          return false;
+        }
+      }
+    }
+    if (c == '"') {
+      value->type = JsonValue::STRING;
+      return parseString(&value->string);
+    }
+    if (consume("true") || consume("false")) {
+      value->type = JsonValue::BOOL;
+      value->boolean = c == 't';
+      return true;
+    }
+    if (consume("null")) {
+      value->type = JsonValue::NUL;
+      return true;
+    }
+    const char* begin = text.c_str() + pos;
+    char* end = nullptr;
+    value->number = strtod(begin, &end);
+    if (end == begin) {
+      return false;
+    }
+    value->type = JsonValue::NUMBER;
+    pos += end - begin;
+    return true;
+  }
+
+  const std::string& text;
+  size_t pos;
+};
+
+}  // namespace
+
+bool JsonValue::Parse(const std::string& text, JsonValue* value,
+                      std::string* error) {
+  *value = JsonValue();
+  return Parser(text).parse(value, error);
+}
+
+const JsonValue* JsonValue::find(const std::string& key) const {
+  for (const std::pair<std::string, JsonValue>& member : object) {
+    if (member.first == key) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+}  // dso
@@ -0,0 +1,85 @@
+#include "util/log_sink.h"
+
+#include <assert.h>
+
+#include <glog/logging.h>
+
+namespace dso {
+
+LogSink::LogSink(const std::string& directory,
+                 const std::vector<std::string>& streams)
+    : running(true), numDropped(0) {
+  for (const std::string& name : streams) {
+    const std::string path = directory + "/" + name + ".bin";
+    files.emplace_back(
+        new std::ofstream(path.c_str(), std::ios::binary | std::ios::trunc));
+    LOG_IF(ERROR, !files.back()->is_open()) << "Cannot open log " << path;
+  }
+  writerThread = boost::thread(&LogSink::writerLoop, this);
+}
+
+LogSink::~LogSink() {
+  running = false;
+  writerThread.join();
+
+  for (std::ofstream* file : files) {
+    file->close();
+    delete file;
+  }
+  LOG_IF(WARNING, numDropped > 0)
+      << "LogSink dropped " << numDropped << " log records!";
+}
+
+bool LogSink::write(const int stream, const double* const values,
+                    const int num) {
+  assert(stream >= 0 && stream < static_cast<int>(files.size()));
+  Record* record = new Record();
+  record->stream = stream;
+  record->values.assign(values, values + num);
+  return push(record);
+}
+
+bool LogSink::defer(Task&& task) {
+  Record* record = new Record();
+  record->stream = -1;
+  record->task = std::move(task);
+  return push(record);
+}
+
+bool LogSink::push(Record* const record) {
+  if (!queue.bounded_push(record)) {
+    ++numDropped;
+    delete record;
+    return false;
+  }
+  return true;
+}
+
+void LogSink::writerLoop() {
+  Record* record;
+  while (true) {
+    // read before popping: once stopped, everything pushed before is queued.
+    // tasks may push new records, so only stop once the queue is empty.
+    const bool stop = !running;
+    if (!queue.pop(record)) {
+      if (stop) {
+        return;
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+      continue;
+    }
+
+    if (record->task) {
+      record->task();
+    } else {
+      std::ofstream* const file = files[record->stream];
+      const uint32_t num = record->values.size();
+      file->write(reinterpret_cast<const char*>(&num), sizeof(num));
+      file->write(reinterpret_cast<const char*>(record->values.data()),
+                  num * sizeof(double));
+    }
+    delete record;
+  }
+}
+
+}  // dso
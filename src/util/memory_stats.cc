@@ -0,0 +1,36 @@
+#include "util/memory_stats.h"
+
+#include <stdio.h>
+#include <string>
+
+#include <glog/logging.h>
+
+namespace dso {
+
+namespace {
+
+const char* const kTagNames[NUM_MEMORY_TAGS] = {
+    "pyramids",     "jacobians",    "hessian",
+    "accumulators", "frame_shells", "viewer",
+    "map_store",    "reloc_index"};
+
+}  // namespace
+
+std::atomic<int64_t> MemoryStats::currentBytes[NUM_MEMORY_TAGS] = {};
+std::atomic<int64_t> MemoryStats::peakBytes[NUM_MEMORY_TAGS] = {};
+
+const char* MemoryStats::name(const MemoryTag tag) { return kTagNames[tag]; }
+
+void MemoryStats::logSummary() {
+  std::string summary = "memory (MB, current / peak):";
+  for (int t = 0; t < NUM_MEMORY_TAGS; ++t) {
+    const MemoryTag tag = static_cast<MemoryTag>(t);
+    char entry[80];
+    snprintf(entry, sizeof(entry), "  %s %.1f / %.1f", kTagNames[t],
+             current(tag) / (1024. * 1024.), peak(tag) / (1024. * 1024.));
+    summary += entry;
+  }
+  LOG(INFO) << summary;
+}
+
+}  // dso
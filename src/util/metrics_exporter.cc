@@ -0,0 +1,250 @@
+#include "util/metrics_exporter.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <memory>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include "util/memory_stats.h"
+#include "util/stage_timing.h"
+
+namespace dso {
+
+namespace {
+
+struct MetricInfo {
+  const char* name;
+  bool counter;  //!< only increases, else a gauge
+  const char* help;
+};
+
+const MetricInfo kMetrics[NUM_METRICS] = {
+    {"dso_frames_total", true, "Frames given to FullSystem."},
+    {"dso_keyframes_total", true, "Keyframes made."},
+    {"dso_initialized", false, "1 once initialized."},
+    {"dso_lost", false, "1 once tracking is lost."},
+    {"dso_coarse_tracking_rmse", false,
+     "Coarse tracking RMSE of the last frame."},
+    {"dso_fine_tracking_rmse", false, "RMSE of the last window optimization."},
+    {"dso_optimization_iterations", false,
+     "Iterations of the last window optimization."},
+    {"dso_points_created_total", true, "Immature points created."},
+    {"dso_points_activated_total", true, "Points activated."},
+    {"dso_points_dropped_total", true, "Points dropped."},
+    {"dso_residuals_marginalized_fwd_total", true,
+     "Residuals marginalized (forward)."},
+    {"dso_residuals_marginalized_bwd_total", true,
+     "Residuals marginalized (backward)."},
+    {"dso_residuals_force_dropped_fwd_total", true,
+     "Residuals dropped at marginalization (forward)."},
+    {"dso_residuals_force_dropped_bwd_total", true,
+     "Residuals dropped at marginalization (backward)."},
+    {"dso_active_frames", false, "Frames in the window."},
+    {"dso_active_points", false, "Points in the energy functional."},
+    {"dso_active_residuals", false, "Residuals in the energy functional."},
+    {"dso_residuals_active", false, "Active residuals of the last solve."},
+    {"dso_residuals_linearized", false,
+     "Residuals with fixed linearization of the last solve."},
+    {"dso_residuals_marginalized", false,
+     "Marginalized residuals of the last solve."},
+    {"dso_unmapped_frames", false,
+     "Tracked frames queued for the mapping thread."},
+    {"dso_catch_up_dropped_frames_total", true,
+     "Frames the mapping thread dropped to catch up."},
+    {"dso_deadline_skipped_frames_total", true,
+     "Frames skipped for missing their tracking deadline."}};
+
+const double kQuantiles[] = {0.5, 0.95, 0.99};
+
+// how often the server checks if it should stop.
+const int kPollTimeoutMs = 200;
+
+boost::mutex serverMutex;
+//! [serverMutex]
+std::unique_ptr<boost::thread> serverThread;
+int serverSocket = -1;
+std::atomic<bool> serverRunning(false);
+
+void append(std::string* text, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+void append(std::string* text, const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  *text += buffer;
+}
+
+void writeAll(const int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    const ssize_t n = send(fd, data.data() + written, data.size() - written,
+                           MSG_NOSIGNAL);
+    if (n <= 0) {
+      return;
+    }
+    written += n;
+  }
+}
+
+// answers one request on fd, the request line is all that is looked at.
+void serve(const int fd) {
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 8192) {
+    pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, kPollTimeoutMs) <= 0) {
+      break;
+    }
+    const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      break;
+    }
+    request.append(buffer, n);
+  }
+
+  // "GET /metrics?query HTTP/1.1"
+  std::string path;
+  if (request.compare(0, 4, "GET ") == 0) {
+    path = request.substr(4, request.find_first_of(" ?\r\n", 4) - 4);
+  }
+
+  std::string status = "200 OK";
+  std::string body;
+  if (path == "/metrics") {
+    body = MetricsExporter::render();
+  } else {
+    status = "404 Not Found";
+    body = "try /metrics\n";
+  }
+  std::string response;
+  append(&response,
+         "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+         "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+         status.c_str(), body.size());
+  writeAll(fd, response + body);
+}
+
+void serverLoop(const int socket) {
+  while (serverRunning.load()) {
+    pollfd pfd = {socket, POLLIN, 0};
+    if (poll(&pfd, 1, kPollTimeoutMs) <= 0) {
+      continue;
+    }
+    const int fd = accept(socket, nullptr, nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    serve(fd);
+    close(fd);
+  }
+}
+
+}  // namespace
+
+std::atomic<double> MetricsExporter::values[NUM_METRICS] = {};
+
+bool MetricsExporter::start(const int port) {
+  boost::unique_lock<boost::mutex> lock(serverMutex);
+  CHECK(serverThread == nullptr) << "metrics exporter already started";
+
+  const int socket = ::socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(socket, 0) << strerror(errno);
+  const int reuse = 1;
+  setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+          0 ||
+      listen(socket, 8) != 0) {
+    LOG(ERROR) << "metrics exporter could not listen on port " << port << ": "
+               << strerror(errno);
+    close(socket);
+    return false;
+  }
+
+  serverSocket = socket;
+  serverRunning = true;
+  serverThread.reset(new boost::thread(serverLoop, socket));
+  LOG(INFO) << "metrics on http://localhost:" << port << "/metrics";
+  return true;
+}
+
+void MetricsExporter::stop() {
+  boost::unique_lock<boost::mutex> lock(serverMutex);
+  if (serverThread == nullptr) {
+    return;
+  }
+  serverRunning = false;
+  serverThread->join();
+  serverThread.reset();
+  close(serverSocket);
+  serverSocket = -1;
+}
+
+std::string MetricsExporter::render() {
+  std::string text;
+  for (int m = 0; m < NUM_METRICS; ++m) {
+    const MetricInfo& info = kMetrics[m];
+    append(&text, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", info.name,
+           info.help, info.name, info.counter ? "counter" : "gauge", info.name,
+           get(static_cast<Metric>(m)));
+  }
+
+  text +=
+      "# HELP dso_stage_latency_seconds Latency of the DSO stages.\n"
+      "# TYPE dso_stage_latency_seconds summary\n";
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    const TimingStage stage = static_cast<TimingStage>(s);
+    const LatencyHistogram histogram = StageTiming::getHistogram(stage);
+    if (histogram.count == 0) {
+      continue;
+    }
+    const char* name = StageTiming::name(stage);
+    for (const double q : kQuantiles) {
+      append(&text,
+             "dso_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %g\n",
+             name, q, histogram.percentile(q) * 1e-9);
+    }
+    append(&text, "dso_stage_latency_seconds_sum{stage=\"%s\"} %.9f\n", name,
+           histogram.sum * 1e-9);
+    append(&text, "dso_stage_latency_seconds_count{stage=\"%s\"} %llu\n", name,
+           static_cast<unsigned long long>(histogram.count));
+  }
+
+  text +=
+      "# HELP dso_memory_bytes Memory allocated per subsystem.\n"
+      "# TYPE dso_memory_bytes gauge\n";
+  for (int t = 0; t < NUM_MEMORY_TAGS; ++t) {
+    const MemoryTag tag = static_cast<MemoryTag>(t);
+    append(&text, "dso_memory_bytes{subsystem=\"%s\"} %lld\n",
+           MemoryStats::name(tag),
+           static_cast<long long>(MemoryStats::current(tag)));
+  }
+  text +=
+      "# HELP dso_memory_peak_bytes Peak memory allocated per subsystem.\n"
+      "# TYPE dso_memory_peak_bytes gauge\n";
+  for (int t = 0; t < NUM_MEMORY_TAGS; ++t) {
+    const MemoryTag tag = static_cast<MemoryTag>(t);
+    append(&text, "dso_memory_peak_bytes{subsystem=\"%s\"} %lld\n",
+           MemoryStats::name(tag),
+           static_cast<long long>(MemoryStats::peak(tag)));
+  }
+  return text;
+}
+
+}  // dso
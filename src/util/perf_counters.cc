@@ -0,0 +1,297 @@
+#include "util/perf_counters.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#include "util/stage_timing.h"
+#include "util/thread_config.h"
+
+namespace dso {
+
+namespace {
+
+const char* const kEventNames[NUM_PERF_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"};
+
+//! The counters of one thread, written only by it.
+struct ThreadCounters {
+  ThreadCounters() {
+    for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+      count[s].store(0, std::memory_order_relaxed);
+      for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+        values[s][e].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // single writer: a plain load and store instead of fetch_add.
+  static inline void increase(std::atomic<uint64_t>* const value,
+                              const uint64_t by) {
+    value->store(value->load(std::memory_order_relaxed) + by,
+                 std::memory_order_relaxed);
+  }
+
+  std::string name;
+  std::atomic<uint64_t> count[NUM_TIMING_STAGES];
+  std::atomic<uint64_t> values[NUM_TIMING_STAGES][NUM_PERF_EVENTS];
+};
+
+boost::mutex registryMutex;
+//! [registryMutex] kept after their thread ended, their counts still count.
+std::vector<std::unique_ptr<ThreadCounters>> registry;
+
+std::atomic<bool> loggedUnavailable(false);
+
+//! The perf_event group of the calling thread.
+struct CounterGroup {
+  CounterGroup() {
+    for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+      fds[e] = -1;
+      slot[e] = -1;
+    }
+  }
+
+  ~CounterGroup() {
+    for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+      if (fds[e] >= 0) {
+        close(fds[e]);
+      }
+    }
+  }
+
+  void open();
+
+  bool tried = false;
+  int numOpen = 0;
+  //! fd of the first event opened, read for the whole group.
+  int leader = -1;
+  int fds[NUM_PERF_EVENTS];
+  //! Position of the event in a group read, -1 if not open.
+  int slot[NUM_PERF_EVENTS];
+  ThreadCounters* counters = nullptr;
+};
+
+thread_local CounterGroup localGroup;
+
+void CounterGroup::open() {
+  tried = true;
+#if defined(__linux__)
+  const uint32_t types[NUM_PERF_EVENTS] = {
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+      PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE};
+  const uint64_t configs[NUM_PERF_EVENTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+      PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+  std::string missing;
+  for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[e];
+    attr.config = configs[e];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // this thread on any CPU.
+    const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+    if (fd < 0) {
+      missing += std::string(" ") + kEventNames[e] + " (" + strerror(errno) +
+                 ")";
+      continue;
+    }
+    if (leader < 0) {
+      leader = fd;
+    }
+    fds[e] = fd;
+    slot[e] = numOpen++;
+  }
+#else
+  const std::string missing = " all (not Linux)";
+#endif
+  if (!missing.empty() && !loggedUnavailable.exchange(true)) {
+    LOG(WARNING) << "perf counters not available:" << missing;
+  }
+}
+
+ThreadCounters* registerThread(const std::string& name) {
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  registry.emplace_back(new ThreadCounters());
+  registry.back()->name =
+      name.empty() ? "thread" + std::to_string(registry.size() - 1) : name;
+  return registry.back().get();
+}
+
+// per 1000 instructions.
+double perKiloInstruction(const uint64_t* const values, const PerfEvent event) {
+  return values[PERF_INSTRUCTIONS] > 0
+             ? 1000. * values[event] / values[PERF_INSTRUCTIONS]
+             : 0.;
+}
+
+void appendLine(const char* const stage, const char* const thread,
+                const uint64_t count, const uint64_t* const values,
+                std::string* const summary) {
+  char line[200];
+  snprintf(line, sizeof(line),
+           "\n%21s %-9s %7llu x  %9.3f Mcyc  IPC %5.2f  per kinstr: L1D %6.2f"
+           "  LLC %6.2f  br %6.2f",
+           stage, thread, static_cast<unsigned long long>(count),
+           values[PERF_CYCLES] * 1e-6,
+           values[PERF_CYCLES] > 0
+               ? static_cast<double>(values[PERF_INSTRUCTIONS]) /
+                     values[PERF_CYCLES]
+               : 0.,
+           perKiloInstruction(values, PERF_L1D_MISSES),
+           perKiloInstruction(values, PERF_LLC_MISSES),
+           perKiloInstruction(values, PERF_BRANCH_MISSES));
+  *summary += line;
+}
+
+}  // namespace
+
+const char* PerfCounters::name(const PerfEvent event) {
+  return kEventNames[event];
+}
+
+bool PerfCounters::read(PerfSample* const sample) {
+  CounterGroup& group = localGroup;
+  if (!group.tried) {
+    group.open();
+  }
+  if (group.numOpen == 0) {
+    return false;
+  }
+
+  // nr, time enabled, time running, then the values in the order opened.
+  uint64_t buffer[3 + NUM_PERF_EVENTS];
+  const ssize_t size = sizeof(uint64_t) * (3 + group.numOpen);
+  if (::read(group.leader, buffer, size) != size) {
+    return false;
+  }
+  const double scale = (buffer[2] > 0 && buffer[2] < buffer[1])
+                           ? static_cast<double>(buffer[1]) / buffer[2]
+                           : 1.;
+  for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+    sample->values[e] =
+        group.slot[e] < 0
+            ? 0
+            : static_cast<uint64_t>(buffer[3 + group.slot[e]] * scale);
+  }
+  return true;
+}
+
+void PerfCounters::record(const TimingStage stage, const PerfSample& start,
+                          const PerfSample& end) {
+  CounterGroup& group = localGroup;
+  if (group.counters == nullptr) {
+    group.counters = registerThread(ThreadConfig::GetThreadName());
+  }
+  ThreadCounters* const counters = group.counters;
+  ThreadCounters::increase(&counters->count[stage], 1);
+  for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+    // extrapolated values can decrease a little.
+    if (end.values[e] > start.values[e]) {
+      ThreadCounters::increase(&counters->values[stage][e],
+                               end.values[e] - start.values[e]);
+    }
+  }
+}
+
+void PerfCounters::logSummary() {
+  std::string summary = "perf counters:";
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    uint64_t count = 0;
+    uint64_t values[NUM_PERF_EVENTS] = {0};
+    int numThreads = 0;
+    for (const std::unique_ptr<ThreadCounters>& thread : registry) {
+      const uint64_t n = thread->count[s].load(std::memory_order_relaxed);
+      if (n == 0) {
+        continue;
+      }
+      count += n;
+      ++numThreads;
+      for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+        values[e] += thread->values[s][e].load(std::memory_order_relaxed);
+      }
+    }
+    if (count == 0) {
+      continue;
+    }
+    const char* const stage = StageTiming::name(static_cast<TimingStage>(s));
+    appendLine(stage, "all", count, values, &summary);
+    if (numThreads < 2) {
+      continue;
+    }
+    for (const std::unique_ptr<ThreadCounters>& thread : registry) {
+      const uint64_t n = thread->count[s].load(std::memory_order_relaxed);
+      if (n == 0) {
+        continue;
+      }
+      uint64_t own[NUM_PERF_EVENTS];
+      for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+        own[e] = thread->values[s][e].load(std::memory_order_relaxed);
+      }
+      appendLine("", thread->name.c_str(), n, own, &summary);
+    }
+  }
+  LOG(INFO) << summary;
+}
+
+bool PerfCounters::dump(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LOG(ERROR) << "could not write perf counters to " << path;
+    return false;
+  }
+
+  fprintf(file, "thread,stage,count");
+  for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+    fprintf(file, ",%s", kEventNames[e]);
+  }
+  fprintf(file, "\n");
+  {
+    boost::unique_lock<boost::mutex> lock(registryMutex);
+    for (const std::unique_ptr<ThreadCounters>& thread : registry) {
+      for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+        const uint64_t n = thread->count[s].load(std::memory_order_relaxed);
+        if (n == 0) {
+          continue;
+        }
+        fprintf(file, "%s,%s,%llu", thread->name.c_str(),
+                StageTiming::name(static_cast<TimingStage>(s)),
+                static_cast<unsigned long long>(n));
+        for (int e = 0; e < NUM_PERF_EVENTS; ++e) {
+          fprintf(file, ",%llu",
+                  static_cast<unsigned long long>(
+                      thread->values[s][e].load(std::memory_order_relaxed)));
+        }
+        fprintf(file, "\n");
+      }
+    }
+  }
+
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  LOG_IF(INFO, ok) << "wrote perf counters to " << path;
+  return ok;
+}
+
+}  // dso
@@ -0,0 +1,94 @@
+#include "util/pose_predictor.h"
+
+#include "util/frame_shell.h"
+
+namespace dso {
+
+PosePredictor::PosePredictor() : seq(0) { state.num = 0; }
+
+void PosePredictor::beginWrite() {
+  seq.store(seq.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+void PosePredictor::endWrite() {
+  seq.store(seq.load(std::memory_order_relaxed) + 1,
+            std::memory_order_release);
+}
+
+void PosePredictor::push(const FrameShell& shell) {
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  beginWrite();
+  if (state.num == 2) {
+    state.samples[0] = state.samples[1];
+  } else {
+    ++state.num;
+  }
+  Sample& s = state.samples[state.num - 1];
+  s.timestamp = shell.timestamp;
+  s.shell = &shell;
+  s.trackingRef = shell.trackingRef;
+  s.camToTrackingRef = shell.camToTrackingRef;
+  s.camToWorld = shell.camToWorld;
+  endWrite();
+}
+
+void PosePredictor::refine(const FrameShell* keyframe, const SE3& camToWorld) {
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  beginWrite();
+  for (int i = 0; i < state.num; ++i) {
+    Sample& s = state.samples[i];
+    if (s.shell == keyframe) {
+      s.camToWorld = camToWorld;
+    } else if (s.trackingRef == keyframe) {
+      s.camToWorld = camToWorld * s.camToTrackingRef;
+    }
+  }
+  endWrite();
+}
+
+void PosePredictor::clear() {
+  boost::unique_lock<boost::mutex> lock(writeMutex);
+  beginWrite();
+  state.num = 0;
+  endWrite();
+}
+
+bool PosePredictor::predictPose(const double timestamp,
+                                SE3* const camToWorld) const {
+  State s;
+  while (true) {
+    const unsigned int before = seq.load(std::memory_order_acquire);
+    if (before & 1) {
+      continue;
+    }
+    s = state;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (seq.load(std::memory_order_relaxed) == before) {
+      break;
+    }
+  }
+
+  if (s.num == 0) {
+    return false;
+  }
+  const Sample& last = s.samples[s.num - 1];
+  *camToWorld = last.camToWorld;
+  if (s.num < 2) {
+    return true;
+  }
+  const Sample& prev = s.samples[0];
+  const double dt = last.timestamp - prev.timestamp;
+  if (!(dt > 0)) {
+    return true;
+  }
+
+  // trackNewCoarse: fh_2_slast = slast_2_sprelast, per frame interval.
+  const SE3 last_2_prev = prev.camToWorld.inverse() * last.camToWorld;
+  const double intervals = (timestamp - last.timestamp) / dt;
+  *camToWorld = last.camToWorld * SE3::exp(last_2_prev.log() * intervals);
+  return true;
+}
+
+}  // namespace dso
@@ -0,0 +1,104 @@
+#include "util/pyramid_buffer_pool.h"
+
+#include "util/memory_stats.h"
+
+namespace dso {
+
+namespace {
+const int64_t kBytesPerPixel = sizeof(Eigen::Vector3f) + sizeof(float);
+}  // namespace
+
+boost::mutex PyramidBufferPool::mutex;
+std::vector<PyramidBufferPool::Pyramid> PyramidBufferPool::pool;
+
+void PyramidBufferPool::Acquire(const CalibContext& calib,
+                                Eigen::Vector3f* dIp[PYR_LEVELS],
+                                float* absSquaredGrad[PYR_LEVELS]) {
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    // newest first, it is the most likely to be in the cache.
+    for (size_t k = pool.size(); k-- > 0;) {
+      if (!MatchesCalib(pool[k], calib)) {
+        continue;
+      }
+      for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
+        dIp[i] = pool[k].dIp[i];
+        absSquaredGrad[i] = pool[k].absSquaredGrad[i];
+      }
+      pool.erase(pool.begin() + k);
+      return;
+    }
+  }
+
+  for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
+    const int wh = calib.w[i] * calib.h[i];
+    dIp[i] = new Eigen::Vector3f[wh];
+    absSquaredGrad[i] = new float[wh];
+    MemoryStats::add(MEM_PYRAMIDS, wh * kBytesPerPixel);
+  }
+}
+
+void PyramidBufferPool::Release(const CalibContext& calib,
+                                Eigen::Vector3f* dIp[PYR_LEVELS],
+                                float* absSquaredGrad[PYR_LEVELS]) {
+  if (dIp[0] == nullptr) {
+    return;
+  }
+
+  Pyramid pyramid;
+  pyramid.levels = calib.pyrLevelsUsed;
+  for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
+    pyramid.dIp[i] = dIp[i];
+    pyramid.absSquaredGrad[i] = absSquaredGrad[i];
+    pyramid.sizes[i] = calib.w[i] * calib.h[i];
+    dIp[i] = nullptr;
+    absSquaredGrad[i] = nullptr;
+  }
+
+  if (setting_pyramidPoolSize <= 0) {
+    Free(&pyramid);
+    return;
+  }
+  Pyramid oldest;
+  oldest.levels = 0;
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (static_cast<int>(pool.size()) >= setting_pyramidPoolSize) {
+      oldest = pool.front();
+      pool.erase(pool.begin());
+    }
+    pool.push_back(pyramid);
+  }
+  Free(&oldest);
+}
+
+void PyramidBufferPool::Clear() {
+  boost::unique_lock<boost::mutex> lock(mutex);
+  for (Pyramid& pyramid : pool) {
+    Free(&pyramid);
+  }
+  pool.clear();
+}
+
+void PyramidBufferPool::Free(Pyramid* pyramid) {
+  for (int i = 0; i < pyramid->levels; ++i) {
+    delete[] pyramid->dIp[i];
+    delete[] pyramid->absSquaredGrad[i];
+    MemoryStats::add(MEM_PYRAMIDS, -pyramid->sizes[i] * kBytesPerPixel);
+  }
+}
+
+bool PyramidBufferPool::MatchesCalib(const Pyramid& pyramid,
+                                     const CalibContext& calib) {
+  if (pyramid.levels != calib.pyrLevelsUsed) {
+    return false;
+  }
+  for (int i = 0; i < calib.pyrLevelsUsed; ++i) {
+    if (pyramid.sizes[i] != calib.w[i] * calib.h[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // dso
@@ -0,0 +1,337 @@
+#include "util/sampling_profiler.h"
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "util/settings.h"
+#include "util/stage_timing.h"
+
+namespace dso {
+
+namespace {
+
+const int kMaxDepth = 24;
+
+struct Sample {
+  uintptr_t pcs[kMaxDepth];  //!< innermost first
+  ProfileTags tags;
+  int depth;
+  char thread[16];
+};
+
+// read by the signal handler: initial-exec, so no allocation on first access.
+__thread ProfileTags localTags __attribute__((tls_model("initial-exec"))) = {
+    -1, -1, -1};
+__thread uintptr_t stackLow __attribute__((tls_model("initial-exec"))) = 0;
+__thread uintptr_t stackHigh __attribute__((tls_model("initial-exec"))) = 0;
+
+std::atomic<bool> sampling(false);
+std::unique_ptr<Sample[]> ring;
+int ringSize = 0;
+//! Samples taken so far, the ring holds the last ringSize of them.
+std::atomic<uint64_t> numSamples(0);
+//! Handlers using ring, stop() waits for them.
+std::atomic<int> activeHandlers(0);
+
+void getContext(const void* context, uintptr_t* pc, uintptr_t* fp) {
+  const ucontext_t* uc = static_cast<const ucontext_t*>(context);
+#if defined(__x86_64__)
+  *pc = uc->uc_mcontext.gregs[REG_RIP];
+  *fp = uc->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+  *pc = uc->uc_mcontext.pc;
+  *fp = uc->uc_mcontext.regs[29];
+#else
+  *pc = *fp = 0;
+#endif
+}
+
+// async-signal-safe: no locks, no allocation, only reads within the stack.
+void onSignal(int, siginfo_t*, void* context) {
+  const int savedErrno = errno;
+  activeHandlers.fetch_add(1);
+  if (sampling.load()) {
+    const uint64_t n = numSamples.fetch_add(1, std::memory_order_relaxed);
+    Sample& sample = ring[n % ringSize];
+
+    uintptr_t pc, fp;
+    getContext(context, &pc, &fp);
+    int depth = 0;
+    if (pc != 0) {
+      sample.pcs[depth++] = pc;
+    }
+    // frame: [fp] = caller fp, [fp + 8] = return address.
+    while (depth < kMaxDepth && fp >= stackLow &&
+           fp + 2 * sizeof(uintptr_t) <= stackHigh &&
+           fp % sizeof(uintptr_t) == 0) {
+      const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+      if (frame[1] == 0) {
+        break;
+      }
+      // -1: inside the call, not after it.
+      sample.pcs[depth++] = frame[1] - 1;
+      if (frame[0] <= fp) {
+        break;
+      }
+      fp = frame[0];
+    }
+    sample.depth = depth;
+    sample.tags = localTags;
+    prctl(PR_GET_NAME, sample.thread);
+    sample.thread[sizeof(sample.thread) - 1] = 0;
+  }
+  activeHandlers.fetch_sub(1);
+  errno = savedErrno;
+}
+
+// exported symbol, else binary+offset (for addr2line) in the executable and
+// only the library name elsewhere, so the leaves in e.g. libm are merged.
+std::string symbolize(const uintptr_t pc, const std::string& executable) {
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void*>(pc), &info) == 0) {
+    char text[32];
+    snprintf(text, sizeof(text), "0x%lx", static_cast<unsigned long>(pc));
+    return text;
+  }
+  if (info.dli_sname != nullptr) {
+    int status = 0;
+    char* demangled =
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = status == 0 ? demangled : info.dli_sname;
+    free(demangled);
+    // the arguments make the stacks unreadable, and contain ';'.
+    const size_t paren = name.find('(');
+    return paren == std::string::npos ? name : name.substr(0, paren);
+  }
+  // not exported (link with -rdynamic).
+  const char* module = info.dli_fname != nullptr ? info.dli_fname : "?";
+  const char* slash = strrchr(module, '/');
+  const char* name = slash != nullptr ? slash + 1 : module;
+  if (executable != module) {
+    return name;
+  }
+  char text[160];
+  snprintf(text, sizeof(text), "%s+0x%lx", name,
+           static_cast<unsigned long>(
+               pc - reinterpret_cast<uintptr_t>(info.dli_fbase)));
+  return text;
+}
+
+// the samples taken so far, oldest first.
+std::vector<const Sample*> collect() {
+  std::vector<const Sample*> samples;
+  const uint64_t n = numSamples.load();
+  const uint64_t kept = std::min<uint64_t>(n, ringSize);
+  for (uint64_t i = n - kept; i < n; ++i) {
+    samples.emplace_back(&ring[i % ringSize]);
+  }
+  return samples;
+}
+
+// the setting_profileTopFrames frames with the most samples, most first.
+std::vector<std::pair<int, int>> topFrames(
+    const std::vector<const Sample*>& samples, const int count) {
+  std::map<int, int> perFrame;
+  for (const Sample* sample : samples) {
+    if (sample->tags.frameId >= 0) {
+      ++perFrame[sample->tags.frameId];
+    }
+  }
+  std::vector<std::pair<int, int>> frames(perFrame.begin(), perFrame.end());
+  std::sort(frames.begin(), frames.end(),
+            [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+              return a.second > b.second ||
+                     (a.second == b.second && a.first < b.first);
+            });
+  if (static_cast<int>(frames.size()) > count) {
+    frames.resize(count);
+  }
+  return frames;
+}
+
+}  // namespace
+
+bool SamplingProfiler::start() {
+  CHECK(ring == nullptr) << "profiler already started";
+  ringSize = std::max(setting_profileMaxSamples, 1);
+  ring.reset(new Sample[ringSize]);
+  numSamples = 0;
+  registerThread();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = onSignal;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  CHECK_EQ(sigaction(SIGPROF, &action, nullptr), 0) << strerror(errno);
+
+  sampling = true;
+  const int intervalUs = 1000000 / std::max(setting_profileHz, 1);
+  itimerval timer;
+  timer.it_interval.tv_sec = intervalUs / 1000000;
+  timer.it_interval.tv_usec = intervalUs % 1000000;
+  timer.it_value = timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+    LOG(ERROR) << "could not start the profiling timer: " << strerror(errno);
+    sampling = false;
+    return false;
+  }
+  LOG(INFO) << "sampling at " << setting_profileHz << " Hz";
+  return true;
+}
+
+void SamplingProfiler::stop() {
+  itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, nullptr);
+  // the handler stays installed: a pending SIGPROF would end the process.
+  sampling = false;
+  while (activeHandlers.load() > 0) {
+  }
+}
+
+void SamplingProfiler::registerThread() {
+#if defined(__linux__)
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) != 0) {
+    return;
+  }
+  void* address = nullptr;
+  size_t size = 0;
+  if (pthread_attr_getstack(&attr, &address, &size) == 0) {
+    stackLow = reinterpret_cast<uintptr_t>(address);
+    stackHigh = stackLow + size;
+  }
+  pthread_attr_destroy(&attr);
+#endif
+}
+
+void SamplingProfiler::setFrame(const int frameId, const int keyframeId) {
+  localTags.frameId = frameId;
+  localTags.keyframeId = keyframeId;
+}
+
+int SamplingProfiler::setStage(const int stage) {
+  const int previous = localTags.stage;
+  localTags.stage = stage;
+  return previous;
+}
+
+ProfileTags SamplingProfiler::getTags() { return localTags; }
+
+void SamplingProfiler::setTags(const ProfileTags& tags) { localTags = tags; }
+
+bool SamplingProfiler::write(const std::string& path) {
+  if (ring == nullptr) {
+    return false;
+  }
+  stop();
+  const std::vector<const Sample*> samples = collect();
+
+  std::map<int, int> keep;  // frame -> rank, empty: all
+  if (setting_profileTopFrames > 0) {
+    const std::vector<std::pair<int, int>> frames =
+        topFrames(samples, setting_profileTopFrames);
+    for (size_t i = 0; i < frames.size(); ++i) {
+      keep[frames[i].first] = i;
+    }
+  }
+
+  char executable[4096];
+  const ssize_t length =
+      readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+  executable[std::max<ssize_t>(length, 0)] = 0;
+
+  std::map<uintptr_t, std::string> symbols;
+  std::map<std::string, int> stacks;
+  for (const Sample* sample : samples) {
+    std::string stack;
+    if (setting_profileTopFrames > 0) {
+      if (keep.count(sample->tags.frameId) == 0) {
+        continue;
+      }
+      stack = "frame " + std::to_string(sample->tags.frameId);
+      if (sample->tags.keyframeId >= 0) {
+        stack += " (kf " + std::to_string(sample->tags.keyframeId) + ")";
+      }
+      stack += ";";
+    }
+    stack += sample->thread[0] != 0 ? sample->thread : "?";
+    if (sample->tags.stage >= 0 && sample->tags.stage < NUM_TIMING_STAGES) {
+      stack += ";[";
+      stack += StageTiming::name(static_cast<TimingStage>(sample->tags.stage));
+      stack += "]";
+    }
+    for (int d = sample->depth - 1; d >= 0; --d) {
+      const uintptr_t pc = sample->pcs[d];
+      std::map<uintptr_t, std::string>::iterator symbol = symbols.find(pc);
+      if (symbol == symbols.end()) {
+        symbol = symbols.emplace(pc, symbolize(pc, executable)).first;
+      }
+      stack += ";" + symbol->second;
+    }
+    ++stacks[stack];
+  }
+
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LOG(ERROR) << "could not write the profile to " << path;
+    return false;
+  }
+  for (const std::pair<const std::string, int>& stack : stacks) {
+    fprintf(file, "%s %d\n", stack.first.c_str(), stack.second);
+  }
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  LOG_IF(INFO, ok) << "wrote " << samples.size() << " samples to " << path;
+  return ok;
+}
+
+void SamplingProfiler::logSummary() {
+  if (ring == nullptr) {
+    return;
+  }
+  const std::vector<const Sample*> samples = collect();
+  std::map<std::string, int> perThread;
+  for (const Sample* sample : samples) {
+    ++perThread[sample->thread];
+  }
+  const double msPerSample = 1000. / std::max(setting_profileHz, 1);
+
+  char line[160];
+  snprintf(line, sizeof(line), "profile: %llu samples (%zu kept):",
+           static_cast<unsigned long long>(numSamples.load()), samples.size());
+  std::string summary = line;
+  for (const std::pair<const std::string, int>& thread : perThread) {
+    snprintf(line, sizeof(line), "\n%16s: %7d samples, %9.1f ms",
+             thread.first.c_str(), thread.second, thread.second * msPerSample);
+    summary += line;
+  }
+  for (const std::pair<int, int>& frame :
+       topFrames(samples, std::max(setting_profileTopFrames, 10))) {
+    snprintf(line, sizeof(line), "\n     frame %6d: %7d samples, %9.1f ms",
+             frame.first, frame.second, frame.second * msPerSample);
+    summary += line;
+  }
+  LOG(INFO) << summary;
+}
+
+}  // dso
@@ -1,146 +1,19 @@
 #include "util/settings.h"
 
+#include <stddef.h>
+#include <cmath>
+
 #include <glog/logging.h>
 #include <boost/bind.hpp>
 
 namespace dso {
-int PYR_LEVELS_USED = PYR_LEVELS;
-
-/* Parameters controlling when KF's are taken */
-// if !=0, takes a fixed number of KF per second.
-float setting_keyframesPerSecond = 0.f;
-
-// if true, takes as many KF's as possible (will break the system if the camera
-// stays stationary)
-bool setting_realTimeMaxKF = false;
-
-double setting_maxShiftWeightT = 0.04 * (640 + 480);
-double setting_maxShiftWeightR = 0. * (640 + 480);
-double setting_maxShiftWeightRT = 0.02 * (640 + 480);
-
-// general weight on threshold, the larger the more KF's are taken (e.g., 2 =
-// double the amount of KF's).
-double setting_kfGlobalWeight = 1.;
-
-double setting_maxAffineWeight = 2.;
-
-/* initial hessian values to fix unobservable dimensions / priors on affine
- * lighting parameters. */
-float setting_idepthFixPrior = 50.f * 50.f;
-float setting_idepthFixPriorMargFac = 600.f * 600.f;
-float setting_initialRotPrior = 1e11f;
-float setting_initialTransPrior = 1e10f;
-float setting_initialAffBPrior = 1e14f;
-float setting_initialAffAPrior = 1e14f;
-float setting_initialCalibHessian = 5e9f;
-
-/* some modes for solving the resulting linear system (e.g. orthogonalize wrt.
- * unobservable dimensions) */
-
-//! Default: SOLVER_FIX_LAMBDA | SOLVER_ORTHOGONALIZE_X_LATER
-/*! 1000 1000 0000 */
-int setting_solverMode = SOLVER_FIX_LAMBDA | SOLVER_ORTHOGONALIZE_X_LATER;
-
-double setting_solverModeDelta = 0.00001;
-bool setting_forceAceptStep = true;
-
-/* some thresholds on when to activate / marginalize points */
-float setting_minIdepthH_act = 100.f;
-float setting_minIdepthH_marg = 50.f;
-
-float setting_desiredImmatureDensity = 1500.f;  // immature points per frame
-
-// aimed total points in the active window.
-float setting_desiredPointDensity = 2000.f;
-
-// marg a frame if less than X% points remain.
-float setting_minPointsRemaining = 0.05f;
-
-// marg a frame if factor between intensities to current frame is larger than
-// 1/X or X.
-float setting_maxLogAffFacInWindow = 0.7f;
-
-int setting_minFrames = 5;  // min frames in window.
-int setting_maxFrames = 7;  // max frames in window.
-int setting_minFrameAge = 1;
-int setting_maxOptIterations = 6;  // max GN iterations.
-int setting_minOptIterations = 1;  // min GN iterations.
-
-// factor on break threshold for GN iteration (larger = break earlier)
-float setting_thOptIterations = 1.2f;
-
-/* Outlier Threshold on photometric energy */
-float setting_outlierTH = 12.f * 12.f;  // higher -> less strict
-
-// higher -> less strong gradient-based reweighting .
-float setting_outlierTHSumComponent = 50.f * 50.f;
-
-int setting_pattern = 8;  // point pattern used. DISABLED.
-
-// factor on hessian when marginalizing, to account for inaccurate linearization
-// points.
-float setting_margWeightFac = 0.5f * 0.5f;
-
-/* when to re-track a frame */
-float setting_reTrackThreshold = 1.5f;  // (larger = re-track more often)
-
-/* require some minimum number of residuals for a point to become valid */
-int setting_minGoodActiveResForMarg = 3;
-int setting_minGoodResForMarg = 4;
-
+// how the undistorter converts the input images (photometric_undistorter.h):
 // 0 = nothing.
 // 1 = apply inv. response.
 // 2 = apply inv. response & remove V.
 int setting_photometricCalibration = 2;
 bool setting_useExposure = true;
 
-//-1: fix. >=0: optimize (with prior, if > 0).
-float setting_affineOptModeA = 1e12f;
-
-//-1: fix. >=0: optimize (with prior, if > 0).
-float setting_affineOptModeB = 1e8f;
-
-// 1 = use original intensity for pixel selection;
-// 0 = use gamma-corrected intensity.
-int setting_gammaWeightsPixelSelect = 1;
-
-float setting_huberTH = 9.f;  // Huber Threshold
-
-// parameters controlling adaptive energy threshold computation.
-float setting_frameEnergyTHConstWeight = 0.5;
-float setting_frameEnergyTHN = 0.7f;
-float setting_frameEnergyTHFacMedian = 1.5f;
-float setting_overallEnergyTHWeight = 1.f;
-float setting_coarseCutoffTH = 20.f;
-
-// parameters controlling pixel selection
-float setting_minGradHistCut = 0.5f;
-float setting_minGradHistAdd = 7.f;
-float setting_gradDownweightPerLevel = 0.75f;  // 梯度阈值变化的系数
-bool setting_selectDirectionDistribution = true;
-
-/* settings controling initial immature point tracking */
-
-// max length of the ep. line segment searched during immature point tracking.
-// relative to image resolution.
-float setting_maxPixSearch = 0.027f;
-
-float setting_minTraceQuality = 3.f;
-int setting_minTraceTestRadius = 2;
-int setting_GNItsOnPointActivation = 3;
-float setting_trace_stepsize = 1.f;  // stepsize for initial discrete search.
-int setting_trace_GNIterations = 3;  // max # GN iterations
-float setting_trace_GNThreshold = 0.1f;  // GN stop after this stepsize.
-
-// for energy-based outlier check, be slightly more relaxed by this factor.
-float setting_trace_extraSlackOnTH = 1.2f;
-
-// if pixel-interval is smaller than this, leave it be.
-float setting_trace_slackInterval = 1.5f;
-
-// if pixel-interval is smaller than this, leave it be.
-float setting_trace_minImprovementFactor = 2.f;
-
 // for benchmarking different undistortion settings
 float benchmarkSetting_fxfyfac = 0.f;
 int benchmarkSetting_width = 0;
@@ -148,6 +21,7 @@ int benchmarkSetting_height = 0;
 float benchmark_varNoise = 0.f;
 float benchmark_varBlurNoise = 0.f;
 float benchmark_initializerSlackFactor = 1.f;
+
 int benchmark_noiseGridsize = 3;
 
 float freeDebugParam1 = 1.f;
@@ -158,10 +32,92 @@ float freeDebugParam5 = 1.f;
 
 bool disableReconfigure = false;
 bool debugSaveImages = false;
-bool multiThreading = true;
+// use AVX / AVX2 kernels if the CPU supports them, NEON ones on aarch64 (see
+// util/cpu_features.h).
+bool setting_useAVX = true;
+// undistortion and image pyramid on a CUDA device, needs a build with DSO_CUDA
+// (see UndistorterCuda, FramePyramidCuda).
+bool setting_preprocessGPU = false;
+// decode dataset images at the smallest power of two fraction of their size
+// that still has the output size, and undistort from that (see
+// Undistorter::ReduceInput).
+bool setting_reducedDecode = false;
+// directory for the undistortion remaps of the calibrations, empty: always
+// compute them (see Undistorter::LoadRemapCache).
+std::string setting_remapCacheDir = "";
+
+// number of reduce worker threads. <= 0: use the hardware concurrency.
+int setting_numThreads = 0;
+
+// max. number of image pyramids of deleted frames kept for reuse (see
+// util/pyramid_buffer_pool.h). 0: every frame allocates its own.
+int setting_pyramidPoolSize = 4;
+
+// CPU sets ("0-2,5") of the tracker, mapper and reduce worker threads, empty:
+// no pinning. Reduce workers default to all cores but the tracker's.
+std::string setting_trackerCpus = "";
+std::string setting_mapperCpus = "";
+std::string setting_reduceCpus = "";
+// > 0: SCHED_FIFO priority, otherwise the nice value is applied.
+int setting_trackerRtPriority = 0;
+int setting_mapperRtPriority = 0;
+int setting_reduceRtPriority = 0;
+int setting_trackerNice = 0;
+int setting_mapperNice = 0;
+int setting_reduceNice = 0;
+// split the reduce workers over the NUMA nodes of their CPUs, one node each,
+// see ThreadConfig::GetReduceNode.
+bool setting_reduceNumaNodes = false;
+// fixed chunks per reduce worker and a fixed summation order, so multi
+// threaded results are reproducible, see IndexThreadReduce.
+bool setting_deterministicReduce = false;
 bool disableAllDisplay = false;
 bool setting_onlyLogKFPoses = true;
 bool setting_logStuff = true;
+// with setting_logStuff: log the window Hessian eigenvalues every N keyframes
+// (decomposed on the log thread, 0 = never).
+int setting_logEigenValInterval = 0;
+// record the latency histograms of the main stages (util/stage_timing.h), log
+// a summary every setting_stageTimingInterval frames (0 = only at the end) and
+// dump them to setting_stageTimingPath at the end.
+bool setting_stageTiming = false;
+int setting_stageTimingInterval = 0;
+std::string setting_stageTimingPath = "stage_timing.csv";
+
+// count cycles, instructions, cache and branch misses of the same stages per
+// thread (perf_event_open), dump them to setting_perfCountersPath at the end.
+bool setting_perfCounters = false;
+std::string setting_perfCountersPath = "perf_counters.csv";
+
+// record a timeline of stages, mutex waits, queue depth and keyframe decisions
+// of all threads, written to setting_tracePath (Chrome trace JSON) at the end.
+bool setting_trace = false;
+std::string setting_tracePath = "trace.json";
+// events beyond are dropped, ~32 bytes each in memory.
+int setting_traceMaxEvents = 8000000;
+
+// sample the stacks of all threads with SIGPROF, tagged with frame and stage,
+// written to setting_profilePath (folded stacks) at the end.
+bool setting_profile = false;
+std::string setting_profilePath = "profile.folded";
+// samples per second of process CPU time.
+int setting_profileHz = 1000;
+// size of the sample ring, ~220 bytes each. Older samples are overwritten.
+int setting_profileMaxSamples = 100000;
+// > 0: only write the samples of that many frames with the most samples.
+int setting_profileTopFrames = 0;
+
+// > 0: log the current and peak memory of every subsystem (MemoryStats) every
+// that many frames.
+int setting_memoryStatsInterval = 0;
+
+// > 0: FullSystem publishes its state for MetricsExporter, which dso serves on
+// this port.
+int setting_metricsPort = 0;
+
+// seed of PixelSelector::randomPattern (and with it of the following rand()
+// calls) and of the benchmark_* image noise, so that runs can be repeated.
+int setting_randomSeed = 3141592;
 
 bool goStepByStep = false;
 
@@ -199,6 +155,107 @@ void handleKey(char k) {
   }
 }
 
+namespace {
+
+struct TuningSetting {
+  enum Type { FLOAT, DOUBLE, INT, BOOL };
+  const char* name;
+  Type type;
+  size_t offset;  //!< of the value in Settings
+};
+
+// pattern is not in, it is checked once by InputParser::ConfigTuning().
+const TuningSetting kTuningSettings[] = {
+    {"desiredImmatureDensity", TuningSetting::FLOAT,
+     offsetof(Settings, desiredImmatureDensity)},
+    {"desiredPointDensity", TuningSetting::FLOAT,
+     offsetof(Settings, desiredPointDensity)},
+    {"minPointsRemaining", TuningSetting::FLOAT,
+     offsetof(Settings, minPointsRemaining)},
+    {"minFrames", TuningSetting::INT, offsetof(Settings, minFrames)},
+    {"maxFrames", TuningSetting::INT, offsetof(Settings, maxFrames)},
+    {"minFrameAge", TuningSetting::INT, offsetof(Settings, minFrameAge)},
+    {"maxOptIterations", TuningSetting::INT,
+     offsetof(Settings, maxOptIterations)},
+    {"minOptIterations", TuningSetting::INT,
+     offsetof(Settings, minOptIterations)},
+    {"thOptIterations", TuningSetting::FLOAT,
+     offsetof(Settings, thOptIterations)},
+    {"minRelEnergyDecrease", TuningSetting::FLOAT,
+     offsetof(Settings, minRelEnergyDecrease)},
+    {"lazyRelinThreshold", TuningSetting::FLOAT,
+     offsetof(Settings, lazyRelinThreshold)},
+    {"maxPixSearch", TuningSetting::FLOAT, offsetof(Settings, maxPixSearch)},
+    {"outlierTH", TuningSetting::FLOAT, offsetof(Settings, outlierTH)},
+    {"huberTH", TuningSetting::FLOAT, offsetof(Settings, huberTH)},
+    {"minTraceQuality", TuningSetting::FLOAT,
+     offsetof(Settings, minTraceQuality)},
+    {"reTrackThreshold", TuningSetting::FLOAT,
+     offsetof(Settings, reTrackThreshold)},
+    {"GNItsOnPointActivation", TuningSetting::INT,
+     offsetof(Settings, GNItsOnPointActivation)},
+    {"coarseCutoffTH", TuningSetting::FLOAT,
+     offsetof(Settings, coarseCutoffTH)},
+    {"coarseSubsampleRatio", TuningSetting::FLOAT,
+     offsetof(Settings, coarseSubsampleRatio)},
+    {"coarseSubsampleLevels", TuningSetting::INT,
+     offsetof(Settings, coarseSubsampleLevels)},
+    {"coarseTrackingFinestLvl", TuningSetting::INT,
+     offsetof(Settings, coarseTrackingFinestLvl)},
+    {"minGradHistCut", TuningSetting::FLOAT,
+     offsetof(Settings, minGradHistCut)},
+    {"minGradHistAdd", TuningSetting::FLOAT,
+     offsetof(Settings, minGradHistAdd)},
+    {"trace_GNIterations", TuningSetting::INT,
+     offsetof(Settings, trace_GNIterations)},
+    {"kfGlobalWeight", TuningSetting::DOUBLE,
+     offsetof(Settings, kfGlobalWeight)},
+    {"compactKeyframePyramid", TuningSetting::BOOL,
+     offsetof(Settings, compactKeyframePyramid)},
+    {"compactJacobians", TuningSetting::BOOL,
+     offsetof(Settings, compactJacobians)},
+    {"selectDirectionDistribution", TuningSetting::BOOL,
+     offsetof(Settings, selectDirectionDistribution)}};
+
+const TuningSetting* findTuningSetting(const std::string& name) {
+  for (const TuningSetting& setting : kTuningSettings) {
+    if (name == setting.name) {
+      return &setting;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+bool setTuningSetting(Settings* settings, const std::string& name,
+                      const double value) {
+  const TuningSetting* setting = findTuningSetting(name);
+  if (setting == nullptr) {
+    return false;
+  }
+  void* member = reinterpret_cast<char*>(settings) + setting->offset;
+  switch (setting->type) {
+    case TuningSetting::FLOAT:
+      *static_cast<float*>(member) = static_cast<float>(value);
+      break;
+    case TuningSetting::DOUBLE:
+      *static_cast<double*>(member) = value;
+      break;
+    case TuningSetting::INT:
+      *static_cast<int*>(member) = static_cast<int>(std::lround(value));
+      break;
+    case TuningSetting::BOOL:
+      *static_cast<bool*>(member) = value != 0;
+      break;
+  }
+  return true;
+}
+
+bool isTuningSetting(const std::string& name) {
+  return findTuningSetting(name) != nullptr;
+}
+
 int staticPattern[10][40][2] = {
     {{0, 0},       {-100, -100}, {-100, -100}, {-100, -100}, {-100, -100},
      {-100, -100}, {-100, -100}, {-100, -100}, {-100, -100}, {-100, -100},  // .
@@ -311,8 +368,4 @@ int staticPattern[10][40][2] = {
      {-200, -200}, {-200, -200}, {-200, -200}, {-200, -200},
      {-200, -200}, {-200, -200}},
 };
-
-int staticPatternNum[10] = {1, 5, 5, 9, 9, 13, 25, 21, 8, 25};
-
-int staticPatternPadding[10] = {1, 1, 1, 1, 2, 2, 2, 3, 2, 4};
 }
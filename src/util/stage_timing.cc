@@ -0,0 +1,184 @@
+#include "util/stage_timing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+namespace dso {
+
+namespace {
+
+const char* const kStageNames[NUM_TIMING_STAGES] = {
+    "PreprocessNewFrame", "trackNewCoarse",   "traceNewCoarse",
+    "makeKeyFrame",       "activatePointsMT", "optimize",
+    "linearizeAll",       "solveSystem",      "applyRes_Reductor",
+    "marginalizeFrame",   "setCoarseTrackingRef", "linearizeAll_Reductor",
+    "accumulateAF_MT",    "addPointsInternal",    "calcRes"};
+
+//! The histograms of one thread, written only by it.
+struct ThreadHistograms {
+  ThreadHistograms() {
+    for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+      for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b) {
+        counts[s][b].store(0, std::memory_order_relaxed);
+      }
+      sum[s].store(0, std::memory_order_relaxed);
+      max[s].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // single writer: a plain load and store instead of fetch_add.
+  static inline void increase(std::atomic<uint64_t>* const value,
+                              const uint64_t by) {
+    value->store(value->load(std::memory_order_relaxed) + by,
+                 std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counts[NUM_TIMING_STAGES]
+                              [LatencyHistogram::kNumBuckets];
+  std::atomic<uint64_t> sum[NUM_TIMING_STAGES];
+  std::atomic<uint64_t> max[NUM_TIMING_STAGES];
+};
+
+boost::mutex registryMutex;
+//! [registryMutex] kept after their thread ended, their counts still count.
+std::vector<std::unique_ptr<ThreadHistograms>> registry;
+
+thread_local ThreadHistograms* localHistograms = nullptr;
+
+ThreadHistograms* registerThread() {
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  registry.emplace_back(new ThreadHistograms());
+  return registry.back().get();
+}
+
+double toMs(const uint64_t ns) { return ns * 1e-6; }
+
+}  // namespace
+
+void LatencyHistogram::clear() {
+  memset(counts, 0, sizeof(counts));
+  count = sum = max = 0;
+}
+
+uint64_t LatencyHistogram::percentile(const double q) const {
+  if (count == 0) {
+    return 0;
+  }
+  // the rank of the value, 1-based.
+  const uint64_t rank = std::max<uint64_t>(1, std::ceil(q * count));
+  uint64_t seen = 0;
+  for (int b = 0; b < kNumBuckets; ++b) {
+    seen += counts[b];
+    if (seen >= rank) {
+      if (b == kNumBuckets - 1) {
+        return max;
+      }
+      const uint64_t middle = (lowerBound(b) + lowerBound(b + 1)) / 2;
+      return middle < max ? middle : max;
+    }
+  }
+  return max;
+}
+
+const char* StageTiming::name(const TimingStage stage) {
+  return kStageNames[stage];
+}
+
+void StageTiming::record(const TimingStage stage, const uint64_t ns) {
+  ThreadHistograms* histograms = localHistograms;
+  if (histograms == nullptr) {
+    histograms = localHistograms = registerThread();
+  }
+  ThreadHistograms::increase(
+      &histograms->counts[stage][LatencyHistogram::bucketOf(ns)], 1);
+  ThreadHistograms::increase(&histograms->sum[stage], ns);
+  if (ns > histograms->max[stage].load(std::memory_order_relaxed)) {
+    histograms->max[stage].store(ns, std::memory_order_relaxed);
+  }
+}
+
+LatencyHistogram StageTiming::getHistogram(const TimingStage stage) {
+  LatencyHistogram histogram;
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  for (const std::unique_ptr<ThreadHistograms>& thread : registry) {
+    for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b) {
+      const uint64_t n =
+          thread->counts[stage][b].load(std::memory_order_relaxed);
+      histogram.counts[b] += n;
+      histogram.count += n;
+    }
+    histogram.sum += thread->sum[stage].load(std::memory_order_relaxed);
+    histogram.max = std::max(
+        histogram.max, thread->max[stage].load(std::memory_order_relaxed));
+  }
+  return histogram;
+}
+
+void StageTiming::logSummary() {
+  std::string summary = "stage timing (ms):";
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    const LatencyHistogram histogram =
+        getHistogram(static_cast<TimingStage>(s));
+    if (histogram.count == 0) {
+      continue;
+    }
+    char line[160];
+    snprintf(line, sizeof(line),
+             "\n%21s: %7llu x  p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f",
+             kStageNames[s], static_cast<unsigned long long>(histogram.count),
+             toMs(histogram.percentile(0.5)), toMs(histogram.percentile(0.95)),
+             toMs(histogram.percentile(0.99)), toMs(histogram.max));
+    summary += line;
+  }
+  LOG(INFO) << summary;
+}
+
+bool StageTiming::dump(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LOG(ERROR) << "could not write stage timings to " << path;
+    return false;
+  }
+
+  LatencyHistogram histograms[NUM_TIMING_STAGES];
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    histograms[s] = getHistogram(static_cast<TimingStage>(s));
+  }
+
+  fprintf(file, "stage,count,mean_us,p50_us,p95_us,p99_us,max_us\n");
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    const LatencyHistogram& h = histograms[s];
+    fprintf(file, "%s,%llu,%.3f,%.3f,%.3f,%.3f,%.3f\n", kStageNames[s],
+            static_cast<unsigned long long>(h.count),
+            h.count > 0 ? h.sum * 1e-3 / h.count : 0., h.percentile(0.5) * 1e-3,
+            h.percentile(0.95) * 1e-3, h.percentile(0.99) * 1e-3,
+            h.max * 1e-3);
+  }
+
+  fprintf(file, "\nstage,lower_ns,count\n");
+  for (int s = 0; s < NUM_TIMING_STAGES; ++s) {
+    for (int b = 0; b < LatencyHistogram::kNumBuckets; ++b) {
+      if (histograms[s].counts[b] > 0) {
+        const uint64_t lower = LatencyHistogram::lowerBound(b);
+        fprintf(file, "%s,%llu,%llu\n", kStageNames[s],
+                static_cast<unsigned long long>(lower),
+                static_cast<unsigned long long>(histograms[s].counts[b]));
+      }
+    }
+  }
+
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  LOG_IF(INFO, ok) << "wrote stage timings to " << path;
+  return ok;
+}
+
+}  // dso
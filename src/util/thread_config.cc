@@ -0,0 +1,252 @@
+#include "util/thread_config.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <boost/thread.hpp>
+#include <glog/logging.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "util/sampling_profiler.h"
+#include "util/settings.h"
+
+namespace dso {
+
+std::vector<int> ThreadConfig::ParseCpuSet(const std::string& cpus) {
+  std::vector<int> result;
+  std::stringstream ss(cpus);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    int first, last;
+    char dash;
+    std::stringstream range(item);
+    if (!(range >> first) || first < 0) {
+      LOG(WARNING) << "Invalid CPU set \"" << cpus << "\", ignored.";
+      return std::vector<int>();
+    }
+    last = first;
+    if (range >> dash) {
+      if (dash != '-' || !(range >> last) || last < first) {
+        LOG(WARNING) << "Invalid CPU set \"" << cpus << "\", ignored.";
+        return std::vector<int>();
+      }
+    }
+#if defined(__linux__)
+    if (last >= CPU_SETSIZE) {
+      LOG(WARNING) << "Invalid CPU set \"" << cpus << "\", cpu " << last
+                   << " is not below " << CPU_SETSIZE << ", ignored.";
+      return std::vector<int>();
+    }
+#endif
+    for (int cpu = first; cpu <= last; ++cpu) {
+      result.emplace_back(cpu);
+    }
+  }
+  return result;
+}
+
+std::vector<int> ThreadConfig::GetCpus(const Role role) {
+  if (role == ROLE_TRACKER) {
+    return ParseCpuSet(setting_trackerCpus);
+  } else if (role == ROLE_MAPPER) {
+    return ParseCpuSet(setting_mapperCpus);
+  }
+
+  std::vector<int> cpus = ParseCpuSet(setting_reduceCpus);
+  if (!cpus.empty()) {
+    return cpus;
+  }
+
+  // by default keep the reduce workers off the tracker cores.
+  const std::vector<int> tracker = ParseCpuSet(setting_trackerCpus);
+  if (tracker.empty()) {
+    return cpus;
+  }
+  const int numCpus = boost::thread::hardware_concurrency();
+  for (int cpu = 0; cpu < numCpus; ++cpu) {
+    if (std::find(tracker.begin(), tracker.end(), cpu) == tracker.end()) {
+      cpus.emplace_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+const std::vector<std::vector<int>>& ThreadConfig::GetNumaNodes() {
+  static const std::vector<std::vector<int>> nodes = [] {
+    std::vector<std::vector<int>> result;
+#if defined(__linux__)
+    const std::string root = "/sys/devices/system/node/";
+    std::ifstream onlineFile(root + "online");
+    std::string online;
+    if (!std::getline(onlineFile, online)) {
+      return result;
+    }
+    for (int node : ParseCpuSet(online)) {
+      std::ifstream cpuFile(root + "node" + std::to_string(node) + "/cpulist");
+      std::string cpus;
+      std::getline(cpuFile, cpus);
+      if (node >= static_cast<int>(result.size())) {
+        result.resize(node + 1);
+      }
+      result[node] = ParseCpuSet(cpus);
+    }
+#endif
+    return result;
+  }();
+  return nodes;
+}
+
+std::vector<int> ThreadConfig::GetReduceNodes() {
+  const std::vector<std::vector<int>>& nodes = GetNumaNodes();
+  const std::vector<int> cpus = GetCpus(ROLE_REDUCE);
+  std::vector<int> result;
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    for (int cpu : nodes[n]) {
+      if (cpus.empty() ||
+          std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) {
+        result.emplace_back(n);
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+int ThreadConfig::GetReduceNode(const int worker, const int numWorkers) {
+  if (!setting_reduceNumaNodes) {
+    return -1;
+  }
+  const std::vector<int> nodes = GetReduceNodes();
+  if (nodes.size() < 2) {
+    return -1;
+  }
+  return nodes[static_cast<long>(worker) * nodes.size() / numWorkers];
+}
+
+std::string ThreadConfig::RoleName(const Role role) {
+  switch (role) {
+    case ROLE_TRACKER:
+      return "tracker";
+    case ROLE_MAPPER:
+      return "mapper";
+    default:
+      return "reduce";
+  }
+}
+
+namespace {
+thread_local std::string threadName;
+}  // namespace
+
+void ThreadConfig::SetThreadName(const std::string& name) {
+  threadName = name;
+#if defined(__linux__)
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+#endif
+  if (setting_profile) {
+    SamplingProfiler::registerThread();
+  }
+}
+
+const std::string& ThreadConfig::GetThreadName() { return threadName; }
+
+void ThreadConfig::ApplyToThisThread(const Role role, const int node) {
+  const int priorities[] = {setting_trackerRtPriority, setting_mapperRtPriority,
+                            setting_reduceRtPriority};
+  const int nices[] = {setting_trackerNice, setting_mapperNice,
+                       setting_reduceNice};
+  std::vector<int> cpus = GetCpus(role);
+  if (node >= 0) {
+    const std::vector<int>& nodeCpus = GetNumaNodes()[node];
+    if (cpus.empty()) {
+      cpus = nodeCpus;
+    } else {
+      cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                [&](const int cpu) {
+                                  return std::find(nodeCpus.begin(),
+                                                   nodeCpus.end(),
+                                                   cpu) == nodeCpus.end();
+                                }),
+                 cpus.end());
+    }
+  }
+  SetThreadName(RoleName(role));
+
+#if defined(__linux__)
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &set);
+    }
+    const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    LOG_IF(WARNING, err != 0) << "Could not pin " << RoleName(role)
+                              << " thread, error " << err << ".";
+  }
+
+  if (priorities[role] > 0) {
+    sched_param param;
+    param.sched_priority = priorities[role];
+    const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    LOG_IF(WARNING, err != 0) << "Could not set realtime priority "
+                              << priorities[role] << " for " << RoleName(role)
+                              << " thread, error " << err << ".";
+  } else if (nices[role] != 0) {
+    // on linux the nice value is per thread.
+    const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    LOG_IF(WARNING, setpriority(PRIO_PROCESS, tid, nices[role]) != 0)
+        << "Could not set nice " << nices[role] << " for " << RoleName(role)
+        << " thread.";
+  }
+#else
+  LOG_IF(WARNING, !cpus.empty() || priorities[role] > 0 || nices[role] != 0)
+      << "Thread affinity / priority is only supported on linux.";
+#endif
+}
+
+void ThreadConfig::LogLayout() {
+  const int priorities[] = {setting_trackerRtPriority, setting_mapperRtPriority,
+                            setting_reduceRtPriority};
+  const int nices[] = {setting_trackerNice, setting_mapperNice,
+                       setting_reduceNice};
+
+  std::stringstream ss;
+  ss << "Thread layout:";
+  for (int r = ROLE_TRACKER; r <= ROLE_REDUCE; ++r) {
+    const Role role = static_cast<Role>(r);
+    const std::vector<int> cpus = GetCpus(role);
+    ss << "\n- " << RoleName(role) << ": cpus ";
+    if (cpus.empty()) {
+      ss << "any";
+    }
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      ss << (i == 0 ? "" : ",") << cpus[i];
+    }
+    if (priorities[r] > 0) {
+      ss << ", SCHED_FIFO " << priorities[r];
+    } else {
+      ss << ", nice " << nices[r];
+    }
+  }
+  const std::vector<int> nodes = GetReduceNodes();
+  if (setting_reduceNumaNodes && nodes.size() > 1) {
+    ss << "\n- reduce workers split over NUMA nodes";
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      ss << (i == 0 ? " " : ",") << nodes[i];
+    }
+  }
+  LOG(INFO) << ss.str();
+}
+
+}  // dso
@@ -0,0 +1,171 @@
+#include "util/trace_recorder.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "util/thread_config.h"
+
+namespace dso {
+
+namespace {
+
+struct TraceEvent {
+  const char* name;
+  const char* category;
+  uint64_t ts;
+  union {
+    uint64_t dur;  //!< 'X'
+    double value;  //!< 'C'
+  };
+  char phase;  //!< 'X' span, 'i' instant, 'C' counter
+};
+
+//! The events of one thread, [mutex] appended only by it.
+struct ThreadTrace {
+  boost::mutex mutex;
+  std::string name;
+  int tid;
+  std::vector<TraceEvent> events;
+};
+
+boost::mutex registryMutex;
+//! [registryMutex] kept after their thread ended.
+std::vector<std::unique_ptr<ThreadTrace>> registry;
+
+thread_local ThreadTrace* localTrace = nullptr;
+
+std::atomic<int64_t> numEvents(0);
+std::atomic<int64_t> numDropped(0);
+
+ThreadTrace* registerThread() {
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  registry.emplace_back(new ThreadTrace());
+  ThreadTrace* trace = registry.back().get();
+  trace->tid = registry.size() - 1;
+  trace->name = ThreadConfig::GetThreadName();
+  if (trace->name.empty()) {
+    trace->name = "thread" + std::to_string(trace->tid);
+  }
+  trace->events.reserve(4096);
+  return trace;
+}
+
+void add(const TraceEvent& event) {
+  if (numEvents.fetch_add(1, std::memory_order_relaxed) >=
+      setting_traceMaxEvents) {
+    numDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ThreadTrace* trace = localTrace;
+  if (trace == nullptr) {
+    trace = localTrace = registerThread();
+  }
+  boost::unique_lock<boost::mutex> lock(trace->mutex);
+  trace->events.emplace_back(event);
+}
+
+}  // namespace
+
+void TraceRecorder::span(const char* name, const char* category,
+                         const uint64_t beginNs, const uint64_t endNs) {
+  TraceEvent event;
+  event.name = name;
+  event.category = category;
+  event.ts = beginNs;
+  event.dur = endNs > beginNs ? endNs - beginNs : 0;
+  event.phase = 'X';
+  add(event);
+}
+
+void TraceRecorder::instant(const char* name) {
+  TraceEvent event;
+  event.name = name;
+  event.category = "marker";
+  event.ts = now();
+  event.dur = 0;
+  event.phase = 'i';
+  add(event);
+}
+
+void TraceRecorder::counter(const char* name, const double value) {
+  TraceEvent event;
+  event.name = name;
+  event.category = "counter";
+  event.ts = now();
+  event.value = value;
+  event.phase = 'C';
+  add(event);
+}
+
+bool TraceRecorder::write(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    LOG(ERROR) << "could not write trace to " << path;
+    return false;
+  }
+
+  boost::unique_lock<boost::mutex> lock(registryMutex);
+  // timestamps relative to the first event, in us.
+  uint64_t origin = UINT64_MAX;
+  for (const std::unique_ptr<ThreadTrace>& trace : registry) {
+    boost::unique_lock<boost::mutex> tlock(trace->mutex);
+    for (const TraceEvent& event : trace->events) {
+      origin = std::min(origin, event.ts);
+    }
+  }
+
+  const int pid = getpid();
+  size_t written = 0;
+  fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(file,
+          "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+          "\"args\": {\"name\": \"dso\"}}",
+          pid);
+  for (const std::unique_ptr<ThreadTrace>& trace : registry) {
+    boost::unique_lock<boost::mutex> tlock(trace->mutex);
+    fprintf(file,
+            ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+            pid, trace->tid, trace->name.c_str());
+    for (const TraceEvent& event : trace->events) {
+      const double ts = (event.ts - origin) * 1e-3;
+      switch (event.phase) {
+        case 'X':
+          fprintf(file,
+                  ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                  "\"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %d}",
+                  event.name, event.category, ts, event.dur * 1e-3, pid,
+                  trace->tid);
+          break;
+        case 'i':
+          fprintf(file,
+                  ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", "
+                  "\"s\": \"t\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+                  event.name, event.category, ts, pid, trace->tid);
+          break;
+        default:
+          fprintf(file,
+                  ",\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, "
+                  "\"pid\": %d, \"args\": {\"value\": %g}}",
+                  event.name, ts, pid, event.value);
+      }
+    }
+    written += trace->events.size();
+  }
+  fprintf(file, "\n]}\n");
+
+  const bool ok = ferror(file) == 0;
+  fclose(file);
+  LOG_IF(INFO, ok) << "wrote " << written << " trace events to " << path;
+  LOG_IF(WARNING, numDropped > 0)
+      << numDropped << " trace events dropped, over setting_traceMaxEvents.";
+  return ok;
+}
+
+}  // dso
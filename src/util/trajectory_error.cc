@@ -0,0 +1,100 @@
+#include "util/trajectory_error.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <Eigen/Geometry>
+#include <glog/logging.h>
+
+namespace dso {
+
+bool TrajectoryError::Load(const std::string& path,
+                           std::vector<StampedPosition>* trajectory) {
+  CHECK_NOTNULL(trajectory);
+  trajectory->clear();
+  std::ifstream file(path.c_str());
+  if (!file.is_open()) {
+    LOG(ERROR) << "could not open trajectory " << path;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::replace(line.begin(), line.end(), ',', ' ');
+    StampedPosition pose;
+    if (sscanf(line.c_str(), "%lf %lf %lf %lf", &pose.timestamp,
+               &pose.position[0], &pose.position[1], &pose.position[2]) != 4) {
+      continue;
+    }
+    if (pose.timestamp > 1e12) {
+      pose.timestamp *= 1e-9;
+    }
+    trajectory->emplace_back(pose);
+  }
+  std::sort(trajectory->begin(), trajectory->end(),
+            [](const StampedPosition& a, const StampedPosition& b) {
+              return a.timestamp < b.timestamp;
+            });
+  return !trajectory->empty();
+}
+
+bool TrajectoryError::Compute(const std::vector<StampedPosition>& estimate,
+                              const std::vector<StampedPosition>& groundtruth,
+                              const double maxDt, TrajectoryError* error) {
+  CHECK_NOTNULL(error);
+  *error = TrajectoryError();
+
+  // groundtruth is sorted by Load(), estimate needs not be.
+  std::vector<const StampedPosition*> matchedEstimate, matchedTruth;
+  for (const StampedPosition& pose : estimate) {
+    std::vector<StampedPosition>::const_iterator next = std::lower_bound(
+        groundtruth.begin(), groundtruth.end(), pose.timestamp,
+        [](const StampedPosition& a, const double t) {
+          return a.timestamp < t;
+        });
+    const StampedPosition* best = nullptr;
+    if (next != groundtruth.end()) {
+      best = &*next;
+    }
+    if (next != groundtruth.begin() &&
+        (best == nullptr || pose.timestamp - (next - 1)->timestamp <
+                                best->timestamp - pose.timestamp)) {
+      best = &*(next - 1);
+    }
+    if (best != nullptr && std::abs(best->timestamp - pose.timestamp) <= maxDt) {
+      matchedEstimate.emplace_back(&pose);
+      matchedTruth.emplace_back(best);
+    }
+  }
+
+  const int n = matchedEstimate.size();
+  if (n < 3) {
+    return false;
+  }
+  Eigen::Matrix3Xd from(3, n), to(3, n);
+  for (int i = 0; i < n; ++i) {
+    from.col(i) = matchedEstimate[i]->position;
+    to.col(i) = matchedTruth[i]->position;
+  }
+  const Eigen::Matrix4d alignment = Eigen::umeyama(from, to, true);
+  const Eigen::Matrix3Xd aligned =
+      (alignment.topLeftCorner<3, 3>() * from).colwise() +
+      alignment.topRightCorner<3, 1>();
+  Eigen::VectorXd errors = (aligned - to).colwise().norm();
+
+  error->numMatched = n;
+  error->rmse = std::sqrt(errors.squaredNorm() / n);
+  error->mean = errors.mean();
+  error->max = errors.maxCoeff();
+  std::nth_element(errors.data(), errors.data() + n / 2, errors.data() + n);
+  error->median = errors[n / 2];
+  error->scale = alignment.topLeftCorner<3, 3>().col(0).norm();
+  return true;
+}
+
+}  // dso